@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "analyze.h"
+#include "analyze-unit-cache.h"
+#include "format-table.h"
+#include "unit-file-cache.h"
+
+int verb_unit_cache(int argc, char *argv[], void *userdata) {
+        _cleanup_(table_unrefp) Table *table = NULL;
+        _cleanup_free_ char *path = NULL;
+        UnitFileCacheStats stats;
+        uint64_t n_loads;
+        int r;
+
+        r = unit_file_cache_path(arg_runtime_scope, &path);
+        if (r < 0)
+                return log_error_errno(r, "Failed to determine path of unit file cache: %m");
+
+        r = unit_file_cache_get_stats(path, &stats);
+        if (r == -ENOENT)
+                return log_error_errno(r, "Unit file cache %s does not exist.", path);
+        if (r < 0)
+                return log_error_errno(r, "Failed to read unit file cache %s: %m", path);
+
+        table = table_new_vertical();
+        if (!table)
+                return log_oom();
+
+        n_loads = stats.n_hits + stats.n_misses;
+
+        r = table_add_many(table,
+                           TABLE_FIELD, "Path",
+                           TABLE_PATH, path,
+                           TABLE_FIELD, "Size",
+                           TABLE_SIZE, stats.size,
+                           TABLE_FIELD, "Files",
+                           TABLE_UINT64, stats.n_entries,
+                           TABLE_FIELD, "Up-to-date",
+                           TABLE_UINT64, stats.n_up_to_date,
+                           TABLE_FIELD, "Last written",
+                           TABLE_TIMESTAMP, stats.timestamp,
+                           TABLE_FIELD, "Hits",
+                           TABLE_UINT64, stats.n_hits,
+                           TABLE_FIELD, "Misses",
+                           TABLE_UINT64, stats.n_misses,
+                           TABLE_FIELD, "Hit rate",
+                           TABLE_PERCENT, n_loads > 0 ? (int) (stats.n_hits * 100 / n_loads) : 0,
+                           TABLE_FIELD, "Preloaded",
+                           TABLE_UINT64, stats.n_preloaded,
+                           TABLE_FIELD, "Preload time",
+                           TABLE_TIMESPAN_MSEC, stats.preload_usec,
+                           TABLE_FIELD, "Load time",
+                           TABLE_TIMESPAN_MSEC, stats.load_usec);
+        if (r < 0)
+                return table_log_add_error(r);
+
+        r = table_print_with_pager(table, arg_json_format_flags, arg_pager_flags, arg_legend);
+        if (r < 0)
+                return r;
+
+        return EXIT_SUCCESS;
+}
@@ -38,6 +38,7 @@
 #include "analyze-time-data.h"
 #include "analyze-timespan.h"
 #include "analyze-timestamp.h"
+#include "analyze-unit-cache.h"
 #include "analyze-unit-files.h"
 #include "analyze-unit-paths.h"
 #include "analyze-verify.h"
@@ -220,6 +221,7 @@ static int help(int argc, char *argv[], void *userdata) {
                "  cat-config NAME|PATH...    Show configuration file and drop-ins\n"
                "  unit-files                 List files and symlinks for units\n"
                "  unit-paths                 List load directories for units\n"
+               "  unit-cache                 Show statistics of the unit file cache\n"
                "  exit-status [STATUS...]    List exit status definitions\n"
                "  capability [CAP...]        List capability definitions\n"
                "  syscall-filter [NAME...]   List syscalls in seccomp filters\n"
@@ -633,6 +635,7 @@ static int run(int argc, char *argv[]) {
                 { "cat-config",        2,        VERB_ANY, 0,            verb_cat_config        },
                 { "unit-files",        VERB_ANY, VERB_ANY, 0,            verb_unit_files        },
                 { "unit-paths",        1,        1,        0,            verb_unit_paths        },
+                { "unit-cache",        1,        1,        0,            verb_unit_cache        },
                 { "exit-status",       VERB_ANY, VERB_ANY, 0,            verb_exit_status       },
                 { "syscall-filter",    VERB_ANY, VERB_ANY, 0,            verb_syscall_filters   },
                 { "capability",        VERB_ANY, VERB_ANY, 0,            verb_capabilities      },
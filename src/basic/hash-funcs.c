@@ -5,6 +5,7 @@
 #include "hash-funcs.h"
 #include "path-util.h"
 #include "strv.h"
+#include "wyhash.h"
 
 void string_hash_func(const char *p, struct siphash *state) {
         siphash24_compress(p, strlen(p) + 1, state);
@@ -20,6 +21,22 @@ DEFINE_HASH_OPS_FULL(string_hash_ops_free_strv_free,
                      char, string_hash_func, string_compare_func, free,
                      char*, strv_free);
 
+uint64_t string_fast_hash_func(const char *p, uint64_t seed) {
+        return wyhash(p, strlen(p), seed);
+}
+
+DEFINE_FAST_HASH_OPS(string_fast_hash_ops, char, string_hash_func, string_fast_hash_func, string_compare_func);
+DEFINE_FAST_HASH_OPS_WITH_KEY_DESTRUCTOR(string_fast_hash_ops_free,
+                                         char, string_hash_func, string_fast_hash_func, string_compare_func, free);
+
+const struct hash_ops string_fast_hash_ops_free_free = {
+        .hash = (hash_func_t) string_hash_func,
+        .fast_hash = (fast_hash_func_t) string_fast_hash_func,
+        .compare = (compare_func_t) string_compare_func,
+        .free_key = free,
+        .free_value = free,
+};
+
 void path_hash_func(const char *q, struct siphash *state) {
         bool add_slash = false;
 
@@ -92,6 +109,16 @@ const struct hash_ops trivial_hash_ops_free_free = {
         .free_value = free,
 };
 
+uint64_t trivial_fast_hash_func(const void *p, uint64_t seed) {
+        return wyhash64(PTR_TO_UINT64(p), seed);
+}
+
+const struct hash_ops trivial_fast_hash_ops = {
+        .hash = trivial_hash_func,
+        .fast_hash = trivial_fast_hash_func,
+        .compare = trivial_compare_func,
+};
+
 void uint64_hash_func(const uint64_t *p, struct siphash *state) {
         siphash24_compress(p, sizeof(uint64_t), state);
 }
@@ -102,6 +129,12 @@ int uint64_compare_func(const uint64_t *a, const uint64_t *b) {
 
 DEFINE_HASH_OPS(uint64_hash_ops, uint64_t, uint64_hash_func, uint64_compare_func);
 
+uint64_t uint64_fast_hash_func(const uint64_t *p, uint64_t seed) {
+        return wyhash64(*p, seed);
+}
+
+DEFINE_FAST_HASH_OPS(uint64_fast_hash_ops, uint64_t, uint64_hash_func, uint64_fast_hash_func, uint64_compare_func);
+
 #if SIZEOF_DEV_T != 8
 void devt_hash_func(const dev_t *p, struct siphash *state) {
         siphash24_compress(p, sizeof(dev_t), state);
@@ -8,11 +8,16 @@
 typedef void (*hash_func_t)(const void *p, struct siphash *state);
 typedef int (*compare_func_t)(const void *a, const void *b);
 
+/* A cheaper alternative to hash_func_t, keyed by a per-map random seed. Not resistant to hash flooding,
+ * hence only use this for maps whose keys cannot be chosen by an unprivileged party. */
+typedef uint64_t (*fast_hash_func_t)(const void *p, uint64_t seed);
+
 struct hash_ops {
         hash_func_t hash;
         compare_func_t compare;
         free_func_t free_key;
         free_func_t free_value;
+        fast_hash_func_t fast_hash; /* if set, used by hashmaps instead of .hash */
 };
 
 #define _DEFINE_HASH_OPS(uq, name, type, hash_func, compare_func, free_key_func, free_value_func, scope) \
@@ -25,6 +30,18 @@ struct hash_ops {
                 .free_value = free_value_func,                          \
         }
 
+#define _DEFINE_FAST_HASH_OPS(uq, name, type, hash_func, fast_hash_func, compare_func, free_key_func, free_value_func, scope) \
+        _unused_ static void (* UNIQ_T(static_hash_wrapper, uq))(const type *, struct siphash *) = hash_func; \
+        _unused_ static uint64_t (* UNIQ_T(static_fast_hash_wrapper, uq))(const type *, uint64_t) = fast_hash_func; \
+        _unused_ static int (* UNIQ_T(static_compare_wrapper, uq))(const type *, const type *) = compare_func; \
+        scope const struct hash_ops name = {                            \
+                .hash = (hash_func_t) hash_func,                        \
+                .compare = (compare_func_t) compare_func,               \
+                .free_key = free_key_func,                              \
+                .free_value = free_value_func,                          \
+                .fast_hash = (fast_hash_func_t) fast_hash_func,         \
+        }
+
 #define _DEFINE_FREE_FUNC(uq, type, wrapper_name, func)                 \
         /* Type-safe free function */                                   \
         static void UNIQ_T(wrapper_name, uq)(void *a) {                 \
@@ -37,6 +54,11 @@ struct hash_ops {
         _DEFINE_HASH_OPS(uq, name, type, hash_func, compare_func,       \
                          UNIQ_T(static_free_wrapper, uq), NULL, scope)
 
+#define _DEFINE_FAST_HASH_OPS_WITH_KEY_DESTRUCTOR(uq, name, type, hash_func, fast_hash_func, compare_func, free_func, scope) \
+        _DEFINE_FREE_FUNC(uq, type, static_free_wrapper, free_func);    \
+        _DEFINE_FAST_HASH_OPS(uq, name, type, hash_func, fast_hash_func, compare_func, \
+                              UNIQ_T(static_free_wrapper, uq), NULL, scope)
+
 #define _DEFINE_HASH_OPS_WITH_VALUE_DESTRUCTOR(uq, name, type, hash_func, compare_func, type_value, free_func, scope) \
         _DEFINE_FREE_FUNC(uq, type_value, static_free_wrapper, free_func); \
         _DEFINE_HASH_OPS(uq, name, type, hash_func, compare_func,       \
@@ -73,6 +95,18 @@ struct hash_ops {
 #define DEFINE_PRIVATE_HASH_OPS_FULL(name, type, hash_func, compare_func, free_key_func, value_type, free_value_func) \
         _DEFINE_HASH_OPS_FULL(UNIQ, name, type, hash_func, compare_func, free_key_func, value_type, free_value_func, static)
 
+#define DEFINE_FAST_HASH_OPS(name, type, hash_func, fast_hash_func, compare_func) \
+        _DEFINE_FAST_HASH_OPS(UNIQ, name, type, hash_func, fast_hash_func, compare_func, NULL, NULL,)
+
+#define DEFINE_PRIVATE_FAST_HASH_OPS(name, type, hash_func, fast_hash_func, compare_func) \
+        _DEFINE_FAST_HASH_OPS(UNIQ, name, type, hash_func, fast_hash_func, compare_func, NULL, NULL, static)
+
+#define DEFINE_FAST_HASH_OPS_WITH_KEY_DESTRUCTOR(name, type, hash_func, fast_hash_func, compare_func, free_func) \
+        _DEFINE_FAST_HASH_OPS_WITH_KEY_DESTRUCTOR(UNIQ, name, type, hash_func, fast_hash_func, compare_func, free_func,)
+
+#define DEFINE_PRIVATE_FAST_HASH_OPS_WITH_KEY_DESTRUCTOR(name, type, hash_func, fast_hash_func, compare_func, free_func) \
+        _DEFINE_FAST_HASH_OPS_WITH_KEY_DESTRUCTOR(UNIQ, name, type, hash_func, fast_hash_func, compare_func, free_func, static)
+
 void string_hash_func(const char *p, struct siphash *state);
 #define string_compare_func strcmp
 extern const struct hash_ops string_hash_ops;
@@ -80,6 +114,12 @@ extern const struct hash_ops string_hash_ops_free;
 extern const struct hash_ops string_hash_ops_free_free;
 extern const struct hash_ops string_hash_ops_free_strv_free;
 
+/* The *_fast_hash_ops variants below use wyhash instead of SipHash. See fast_hash_func_t above. */
+uint64_t string_fast_hash_func(const char *p, uint64_t seed) _pure_;
+extern const struct hash_ops string_fast_hash_ops;
+extern const struct hash_ops string_fast_hash_ops_free;
+extern const struct hash_ops string_fast_hash_ops_free_free;
+
 void path_hash_func(const char *p, struct siphash *state);
 extern const struct hash_ops path_hash_ops;
 extern const struct hash_ops path_hash_ops_free;
@@ -93,12 +133,18 @@ extern const struct hash_ops trivial_hash_ops;
 extern const struct hash_ops trivial_hash_ops_free;
 extern const struct hash_ops trivial_hash_ops_free_free;
 
+uint64_t trivial_fast_hash_func(const void *p, uint64_t seed) _const_;
+extern const struct hash_ops trivial_fast_hash_ops;
+
 /* 32-bit values we can always just embed in the pointer itself, but in order to support 32-bit archs we need store 64-bit
  * values indirectly, since they don't fit in a pointer. */
 void uint64_hash_func(const uint64_t *p, struct siphash *state);
 int uint64_compare_func(const uint64_t *a, const uint64_t *b) _pure_;
 extern const struct hash_ops uint64_hash_ops;
 
+uint64_t uint64_fast_hash_func(const uint64_t *p, uint64_t seed) _pure_;
+extern const struct hash_ops uint64_fast_hash_ops;
+
 /* On some archs dev_t is 32-bit, and on others 64-bit. And sometimes it's 64-bit on 32-bit archs, and sometimes 32-bit on
  * 64-bit archs. Yuck! */
 #if SIZEOF_DEV_T != 8
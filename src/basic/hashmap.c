@@ -5,8 +5,10 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
-#if HAVE_VALGRIND_VALGRIND_H
-#  include <valgrind/valgrind.h>
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
 #endif
 
 #include "alloc-util.h"
@@ -17,13 +19,13 @@
 #include "memory-util.h"
 #include "mempool.h"
 #include "missing_syscall.h"
-#include "process-util.h"
 #include "random-util.h"
 #include "set.h"
 #include "siphash24.h"
 #include "sort-util.h"
 #include "string-util.h"
 #include "strv.h"
+#include "unaligned.h"
 
 #if ENABLE_DEBUG_HASHMAP
 #include "list.h"
@@ -69,6 +71,17 @@
  * Khuong, P. 2013. The Other Robin Hood Hashing.
  * http://www.pvk.ca/Blog/2013/11/26/the-other-robin-hood-hashing/
  * - Short summary of random vs. linear probing, and tombstones vs. backward shift.
+ *
+ * Lookups scan the DIB bytes in groups of 16 with SIMD instructions where available, similar to the
+ * control byte matching of Abseil's SwissTable. A key with initial bucket i can only be stored in bucket
+ * i + d if that bucket's DIB is d, and the scan can stop at the first bucket that is free or has a DIB
+ * smaller than its distance from i. Both conditions are evaluated for a whole group at once, so that keys
+ * are only compared for the candidate buckets.
+ *
+ * Lemire, D. 2019. Fast Random Integer Generation in an Interval.
+ * ACM Trans. Model. Comput. Simul. 29, 1, Article 3 (January 2019).
+ * DOI=10.1145/3230636 https://arxiv.org/abs/1805.10941
+ * - Mapping a hash value to a bucket index with a multiplication instead of a division.
  */
 
 /*
@@ -278,35 +291,6 @@ static _used_ const struct hashmap_type_info hashmap_type_info[_HASHMAP_TYPE_MAX
         },
 };
 
-void hashmap_trim_pools(void) {
-        int r;
-
-        /* The pool is only allocated by the main thread, but the memory can be passed to other
-         * threads. Let's clean up if we are the main thread and no other threads are live. */
-
-        /* We build our own is_main_thread() here, which doesn't use C11 TLS based caching of the
-         * result. That's because valgrind apparently doesn't like TLS to be used from a GCC destructor. */
-        if (getpid() != gettid())
-                return (void) log_debug("Not cleaning up memory pools, not in main thread.");
-
-        r = get_process_threads(0);
-        if (r < 0)
-                return (void) log_debug_errno(r, "Failed to determine number of threads, not cleaning up memory pools: %m");
-        if (r != 1)
-                return (void) log_debug("Not cleaning up memory pools, running in multi-threaded process.");
-
-        mempool_trim(&hashmap_pool);
-        mempool_trim(&ordered_hashmap_pool);
-}
-
-#if HAVE_VALGRIND_VALGRIND_H
-_destructor_ static void cleanup_pools(void) {
-        /* Be nice to valgrind */
-        if (RUNNING_ON_VALGRIND)
-                hashmap_trim_pools();
-}
-#endif
-
 static unsigned n_buckets(HashmapBase *h) {
         return h->has_indirect ? h->indirect.n_buckets
                                : hashmap_type_info[h->type].n_direct_buckets;
@@ -342,16 +326,23 @@ static uint8_t* hash_key(HashmapBase *h) {
 }
 
 static unsigned base_bucket_hash(HashmapBase *h, const void *p) {
-        struct siphash state;
         uint64_t hash;
 
-        siphash24_init(&state, hash_key(h));
+        if (h->hash_ops->fast_hash)
+                /* The first half of the per-map key serves as seed, see fast_hash_func_t */
+                hash = h->hash_ops->fast_hash(p, unaligned_read_ne64(hash_key(h)));
+        else {
+                struct siphash state;
 
-        h->hash_ops->hash(p, &state);
+                siphash24_init(&state, hash_key(h));
 
-        hash = siphash24_finalize(&state);
+                h->hash_ops->hash(p, &state);
+
+                hash = siphash24_finalize(&state);
+        }
 
-        return (unsigned) (hash % n_buckets(h));
+        /* Map the upper 32 bits of the hash onto [0, n_buckets) without a (slow) division */
+        return (unsigned) (((hash >> 32) * n_buckets(h)) >> 32);
 }
 #define bucket_hash(h, p) base_bucket_hash(HASHMAP_BASE(h), p)
 
@@ -781,14 +772,14 @@ static struct HashmapBase* hashmap_base_new(const struct hash_ops *hash_ops, enu
         HashmapBase *h;
         const struct hashmap_type_info *hi = &hashmap_type_info[type];
 
-        bool use_pool = mempool_enabled && mempool_enabled();  /* mempool_enabled is a weak symbol */
+        bool from_pool;
 
-        h = use_pool ? mempool_alloc0_tile(hi->mempool) : malloc0(hi->head_size);
+        h = mempool_alloc0_tile_or_heap(hi->mempool, hi->head_size, &from_pool);
         if (!h)
                 return NULL;
 
         h->type = type;
-        h->from_pool = use_pool;
+        h->from_pool = from_pool;
         h->hash_ops = hash_ops ?: &trivial_hash_ops;
 
         if (type == HASHMAP_TYPE_ORDERED) {
@@ -884,12 +875,7 @@ static void hashmap_free_no_clear(HashmapBase *h) {
         assert_se(pthread_mutex_unlock(&hashmap_debug_list_mutex) == 0);
 #endif
 
-        if (h->from_pool) {
-                /* Ensure that the object didn't get migrated between threads. */
-                assert_se(is_main_thread());
-                mempool_free_tile(hashmap_type_info[h->type].mempool, h);
-        } else
-                free(h);
+        mempool_free_tile_or_heap(hashmap_type_info[h->type].mempool, h, h->from_pool);
 }
 
 HashmapBase* _hashmap_free(HashmapBase *h, free_func_t default_free_key, free_func_t default_free_value) {
@@ -1204,6 +1190,52 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
         return 1;
 }
 
+#if defined(__SSE2__) || defined(__ARM_NEON)
+#define DIB_GROUP_SIZE 16U
+
+#if defined(__SSE2__)
+#define DIB_GROUP_LANE_BITS 1U
+#else
+#define DIB_GROUP_LANE_BITS 4U  /* NEON has no movemask, we narrow to a nibble per lane instead */
+#endif
+
+/*
+ * Evaluates the DIB bytes of DIB_GROUP_SIZE buckets starting at dibs, where the first one is at distance
+ * 'distance' from the initial bucket. Returns masks of the buckets whose DIB equals their distance
+ * (candidates), and of the buckets at which the scan has to stop (free, or DIB smaller than distance),
+ * using DIB_GROUP_LANE_BITS bits per bucket.
+ */
+static void dib_group_match(const dib_raw_t *dibs, unsigned distance, uint64_t *ret_match, uint64_t *ret_stop) {
+#if defined(__SSE2__)
+        __m128i d, ramp, match, stop;
+
+        d = _mm_loadu_si128((const __m128i*) dibs);
+        ramp = _mm_add_epi8(_mm_set1_epi8((char) distance),
+                            _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+
+        match = _mm_cmpeq_epi8(d, ramp);
+        /* There's no unsigned byte comparison in SSE2, but max(d, ramp) != d is equivalent to d < ramp */
+        stop = _mm_or_si128(_mm_cmpeq_epi8(d, _mm_set1_epi8((char) DIB_RAW_FREE)),
+                            _mm_andnot_si128(_mm_cmpeq_epi8(_mm_max_epu8(d, ramp), d), _mm_set1_epi8(-1)));
+
+        *ret_match = (uint64_t) _mm_movemask_epi8(match);
+        *ret_stop = (uint64_t) _mm_movemask_epi8(stop);
+#else
+        static const uint8_t offsets[DIB_GROUP_SIZE] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+        uint8x16_t d, ramp, match, stop;
+
+        d = vld1q_u8(dibs);
+        ramp = vaddq_u8(vdupq_n_u8((uint8_t) distance), vld1q_u8(offsets));
+
+        match = vceqq_u8(d, ramp);
+        stop = vorrq_u8(vceqq_u8(d, vdupq_n_u8(DIB_RAW_FREE)), vcltq_u8(d, ramp));
+
+        *ret_match = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(match), 4)), 0) & UINT64_C(0x1111111111111111);
+        *ret_stop = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(stop), 4)), 0) & UINT64_C(0x1111111111111111);
+#endif
+}
+#endif
+
 /*
  * Finds an entry with a matching key
  * Returns: index of the found entry, or IDX_NIL if not found.
@@ -1216,6 +1248,38 @@ static unsigned base_bucket_scan(HashmapBase *h, unsigned idx, const void *key)
         assert(idx < n_buckets(h));
 
         for (distance = 0; ; distance++) {
+#ifdef DIB_GROUP_SIZE
+                /* Most entries are stored in their initial bucket or close to it, hence check that
+                 * directly. Then take the group path whenever the group neither wraps around the end of
+                 * the table nor reaches DIB values that are not representable, and fall back to looking
+                 * at single buckets otherwise. */
+                while (distance > 0 &&
+                       idx + DIB_GROUP_SIZE <= n_buckets(h) &&
+                       distance + DIB_GROUP_SIZE < DIB_RAW_OVERFLOW) {
+                        uint64_t match, stop;
+
+                        dib_group_match(dibs + idx, distance, &match, &stop);
+
+                        /* Ignore candidates past the first stop */
+                        if (stop != 0)
+                                match &= (stop & -stop) - 1;
+
+                        for (; match != 0; match &= match - 1) {
+                                unsigned i = idx + (unsigned) __builtin_ctzll(match) / DIB_GROUP_LANE_BITS;
+
+                                e = bucket_at(h, i);
+                                if (h->hash_ops->compare(e->key, key) == 0)
+                                        return i;
+                        }
+
+                        if (stop != 0)
+                                return IDX_NIL;
+
+                        idx = next_idx(h, idx + DIB_GROUP_SIZE - 1);
+                        distance += DIB_GROUP_SIZE;
+                }
+#endif
+
                 if (dibs[idx] == DIB_RAW_FREE)
                         return IDX_NIL;
 
@@ -1601,6 +1665,20 @@ unsigned _hashmap_buckets(HashmapBase *h) {
         return n_buckets(h);
 }
 
+size_t _hashmap_memory_usage(HashmapBase *h) {
+        const struct hashmap_type_info *hi;
+
+        if (!h)
+                return 0;
+
+        hi = &hashmap_type_info[h->type];
+
+        /* The header, plus the buckets and DIB array if they are not stored in the header directly. Note
+         * that the header might come from a mempool. */
+        return hi->head_size +
+                (h->has_indirect ? h->indirect.n_buckets * (hi->entry_size + sizeof(dib_raw_t)) : 0);
+}
+
 int _hashmap_merge(Hashmap *h, Hashmap *other) {
         Iterator i;
         unsigned idx;
@@ -2108,6 +2186,76 @@ bool set_fnmatch(Set *include_patterns, Set *exclude_patterns, const char *needl
         return set_fnmatch_one(include_patterns, needle);
 }
 
+void _hashmap_get_stats(HashmapBase *h, HashmapStats *ret) {
+        HashmapStats stats = {};
+
+        assert(ret);
+
+        if (h) {
+                dib_raw_t *dibs = dib_raw_ptr(h);
+
+                stats = (HashmapStats) {
+                        .n_entries = n_entries(h),
+                        .n_buckets = n_buckets(h),
+                        .fast_hash = !!h->hash_ops->fast_hash,
+                };
+
+                for (unsigned idx = 0; idx < stats.n_buckets; idx++) {
+                        unsigned dib;
+
+                        if (dibs[idx] == DIB_RAW_FREE)
+                                continue;
+
+                        dib = bucket_calculate_dib(h, idx, dibs[idx]);
+
+                        stats.max_dib = MAX(stats.max_dib, dib);
+                        stats.total_dib += dib;
+                        stats.dib_histogram[MIN(dib == 0 ? 0 : log2u(dib) + 1, ELEMENTSOF(stats.dib_histogram) - 1)]++;
+                }
+        }
+
+        *ret = stats;
+}
+
+void _hashmap_dump_stats(HashmapBase *h, FILE *f, const char *prefix) {
+        HashmapStats stats;
+
+        _hashmap_get_stats(h, &stats);
+
+        if (!f)
+                f = stdout;
+        prefix = strempty(prefix);
+
+        fprintf(f,
+                "%sEntries: %u\n"
+                "%sBuckets: %u\n"
+                "%sLoad factor: %u%%\n"
+                "%sHash function: %s\n",
+                prefix, stats.n_entries,
+                prefix, stats.n_buckets,
+                prefix, stats.n_buckets > 0 ? (unsigned) (stats.n_entries * 100ULL / stats.n_buckets) : 0,
+                prefix, stats.fast_hash ? "wyhash" : "siphash24");
+
+        if (stats.n_entries == 0)
+                return;
+
+        fprintf(f,
+                "%sProbe length: mean %.2f, max %u\n",
+                prefix, (double) stats.total_dib / stats.n_entries, stats.max_dib);
+
+        for (size_t i = 0; i < ELEMENTSOF(stats.dib_histogram); i++) {
+                if (stats.dib_histogram[i] == 0)
+                        continue;
+
+                if (i <= 1)
+                        fprintf(f, "%sProbe length %zu: %u\n", prefix, i, stats.dib_histogram[i]);
+                else if (i == ELEMENTSOF(stats.dib_histogram) - 1)
+                        fprintf(f, "%sProbe length >= %u: %u\n", prefix, 1U << (i - 1), stats.dib_histogram[i]);
+                else
+                        fprintf(f, "%sProbe length %u-%u: %u\n", prefix, 1U << (i - 1), (2U << (i - 1)) - 1, stats.dib_histogram[i]);
+        }
+}
+
 static int hashmap_entry_compare(
                 struct hashmap_base_entry * const *a,
                 struct hashmap_base_entry * const *b,
@@ -4,6 +4,7 @@
 #include <limits.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 
 #include "hash-funcs.h"
 #include "macro.h"
@@ -272,6 +273,15 @@ static inline unsigned ordered_hashmap_buckets(OrderedHashmap *h) {
         return _hashmap_buckets(HASHMAP_BASE(h));
 }
 
+/* Returns the number of bytes allocated for the hashmap, not including keys and values stored by reference */
+size_t _hashmap_memory_usage(HashmapBase *h) _pure_;
+static inline size_t hashmap_memory_usage(Hashmap *h) {
+        return _hashmap_memory_usage(HASHMAP_BASE(h));
+}
+static inline size_t ordered_hashmap_memory_usage(OrderedHashmap *h) {
+        return _hashmap_memory_usage(HASHMAP_BASE(h));
+}
+
 bool _hashmap_iterate(HashmapBase *h, Iterator *i, void **value, const void **key);
 static inline bool hashmap_iterate(Hashmap *h, Iterator *i, void **value, const void **key) {
         return _hashmap_iterate(HASHMAP_BASE(h), i, value, key);
@@ -409,6 +419,39 @@ static inline int set_dump_sorted(Set *h, void ***ret, size_t *ret_n) {
         return _hashmap_dump_sorted(HASHMAP_BASE(h), ret, ret_n);
 }
 
+/* Probe lengths are the distances of entries from their initial bucket. The histogram counts them in
+ * power-of-two ranges: 0, 1, 2-3, 4-7, …, with the last slot collecting everything longer. */
+typedef struct HashmapStats {
+        unsigned n_entries;
+        unsigned n_buckets;
+        unsigned max_dib;
+        uint64_t total_dib;
+        unsigned dib_histogram[8];
+        bool fast_hash;
+} HashmapStats;
+
+void _hashmap_get_stats(HashmapBase *h, HashmapStats *ret);
+static inline void hashmap_get_stats(Hashmap *h, HashmapStats *ret) {
+        _hashmap_get_stats(HASHMAP_BASE(h), ret);
+}
+static inline void ordered_hashmap_get_stats(OrderedHashmap *h, HashmapStats *ret) {
+        _hashmap_get_stats(HASHMAP_BASE(h), ret);
+}
+static inline void set_get_stats(Set *h, HashmapStats *ret) {
+        _hashmap_get_stats(HASHMAP_BASE(h), ret);
+}
+
+void _hashmap_dump_stats(HashmapBase *h, FILE *f, const char *prefix);
+static inline void hashmap_dump_stats(Hashmap *h, FILE *f, const char *prefix) {
+        _hashmap_dump_stats(HASHMAP_BASE(h), f, prefix);
+}
+static inline void ordered_hashmap_dump_stats(OrderedHashmap *h, FILE *f, const char *prefix) {
+        _hashmap_dump_stats(HASHMAP_BASE(h), f, prefix);
+}
+static inline void set_dump_stats(Set *h, FILE *f, const char *prefix) {
+        _hashmap_dump_stats(HASHMAP_BASE(h), f, prefix);
+}
+
 /*
  * Hashmaps are iterated in unpredictable order.
  * OrderedHashmaps are an exception to this. They are iterated in the order
@@ -465,4 +508,3 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(IteratedCache*, iterated_cache_free);
 
 #define _cleanup_iterated_cache_free_ _cleanup_(iterated_cache_freep)
 
-void hashmap_trim_pools(void);
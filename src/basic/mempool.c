@@ -1,12 +1,22 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
+#if HAVE_VALGRIND_VALGRIND_H
+#  include <valgrind/valgrind.h>
+#endif
 
+#include "alloc-util.h"
 #include "format-util.h"
 #include "macro.h"
 #include "memory-util.h"
 #include "mempool.h"
+#include "process-util.h"
+#include "sort-util.h"
+#include "string-util.h"
+
+#define MEMPOOL_CHUNK_SIZE_MAX (256U * 1024U)
 
 struct pool {
         struct pool *next;
@@ -14,10 +24,44 @@ struct pool {
         size_t n_used;
 };
 
+/* All pools that ever had a chunk allocated. Pools are only used from the main thread, hence no locking. */
+static struct mempool *registered_pools = NULL;
+
 static void* pool_ptr(struct pool *p) {
         return ((uint8_t*) ASSERT_PTR(p)) + ALIGN(sizeof(struct pool));
 }
 
+static bool mempool_on_stack(const struct mempool *mp) {
+        pthread_attr_t attr;
+        void *addr;
+        size_t size;
+        bool b = false;
+
+        /* Registered pools are referenced from registered_pools forever, a pool on the stack would leave a
+         * dangling pointer behind once its frame is gone. This is only checked once per pool, when it is
+         * registered. */
+
+        if (pthread_getattr_np(pthread_self(), &attr) != 0)
+                return false;
+
+        if (pthread_attr_getstack(&attr, &addr, &size) == 0)
+                b = (const uint8_t*) mp >= (const uint8_t*) addr &&
+                    (const uint8_t*) mp < (const uint8_t*) addr + size;
+
+        (void) pthread_attr_destroy(&attr);
+        return b;
+}
+
+static void* mempool_account_tile(struct mempool *mp, void *t) {
+        assert(mp);
+
+        mp->n_allocs++;
+        mp->n_tiles_used++;
+        mp->n_tiles_used_max = MAX(mp->n_tiles_used_max, mp->n_tiles_used);
+
+        return t;
+}
+
 void* mempool_alloc_tile(struct mempool *mp) {
         size_t i;
 
@@ -33,7 +77,7 @@ void* mempool_alloc_tile(struct mempool *mp) {
 
                 t = mp->freelist;
                 mp->freelist = *(void**) mp->freelist;
-                return t;
+                return mempool_account_tile(mp, t);
         }
 
         if (_unlikely_(!mp->first_pool) ||
@@ -41,8 +85,10 @@ void* mempool_alloc_tile(struct mempool *mp) {
                 size_t size, n;
                 struct pool *p;
 
+                /* Double the chunk size each time, but not beyond MEMPOOL_CHUNK_SIZE_MAX, so that little
+                 * memory is wasted by half-filled chunks and chunks have a chance to become unused again */
                 n = mp->first_pool ? mp->first_pool->n_tiles : 0;
-                n = MAX(mp->at_least, n * 2);
+                n = MAX(mp->at_least, MIN(n * 2, MEMPOOL_CHUNK_SIZE_MAX / mp->tile_size));
                 size = PAGE_ALIGN(ALIGN(sizeof(struct pool)) + n*mp->tile_size);
                 n = (size - ALIGN(sizeof(struct pool))) / mp->tile_size;
 
@@ -55,11 +101,19 @@ void* mempool_alloc_tile(struct mempool *mp) {
                 p->n_used = 0;
 
                 mp->first_pool = p;
+
+                if (!mp->registered) {
+                        assert(!mempool_on_stack(mp));
+
+                        mp->registered_next = registered_pools;
+                        registered_pools = mp;
+                        mp->registered = true;
+                }
         }
 
         i = mp->first_pool->n_used++;
 
-        return (uint8_t*) pool_ptr(mp->first_pool) + i*mp->tile_size;
+        return mempool_account_tile(mp, (uint8_t*) pool_ptr(mp->first_pool) + i*mp->tile_size);
 }
 
 void* mempool_alloc0_tile(struct mempool *mp) {
@@ -80,9 +134,44 @@ void* mempool_free_tile(struct mempool *mp, void *p) {
         *(void**) p = mp->freelist;
         mp->freelist = p;
 
+        assert(mp->n_tiles_used > 0);
+        mp->n_tiles_used--;
+
         return NULL;
 }
 
+void* mempool_alloc0_tile_or_heap(struct mempool *mp, size_t size, bool *ret_from_pool) {
+        void *p;
+
+        assert(mp);
+        assert(ret_from_pool);
+
+        /* mempool_enabled is a weak symbol, and the pools are not thread-safe */
+        if (size <= mp->tile_size && mempool_enabled && mempool_enabled()) {
+                p = mempool_alloc0_tile(mp);
+                if (p) {
+                        *ret_from_pool = true;
+                        return p;
+                }
+        }
+
+        p = malloc0(size);
+        if (!p)
+                return NULL;
+
+        *ret_from_pool = false;
+        return p;
+}
+
+void* mempool_free_tile_or_heap(struct mempool *mp, void *p, bool from_pool) {
+        if (!from_pool)
+                return mfree(p);
+
+        /* Ensure that the object didn't get migrated between threads. */
+        assert_se(is_main_thread());
+        return mempool_free_tile(mp, p);
+}
+
 static bool pool_contains(struct mempool *mp, struct pool *p, void *ptr) {
         size_t off;
         void *a;
@@ -105,64 +194,82 @@ static bool pool_contains(struct mempool *mp, struct pool *p, void *ptr) {
         return true;
 }
 
-static bool pool_is_unused(struct mempool *mp, struct pool *p) {
-        assert(mp);
-        assert(p);
+typedef struct PoolUsage {
+        struct pool *pool;
+        size_t n_free;
+} PoolUsage;
+
+static int pool_usage_compare(const PoolUsage *a, const PoolUsage *b) {
+        return CMP((uintptr_t) a->pool, (uintptr_t) b->pool);
+}
 
-        if (p->n_used == 0)
-                return true;
+static PoolUsage* pool_usage_find(struct mempool *mp, PoolUsage *usage, size_t n, void *ptr) {
+        size_t lo = 0, hi = n;
 
-        /* Check if all tiles in this specific pool are in the freelist. */
-        size_t n = 0;
-        void *i = mp->freelist;
-        while (i) {
-                if (pool_contains(mp, p, i))
-                        n++;
+        /* Finds the chunk a tile belongs to, i.e. the one with the highest address below the tile */
+        while (lo < hi) {
+                size_t m = lo + (hi - lo) / 2;
 
-                i = *(void**) i;
+                if ((uint8_t*) usage[m].pool < (uint8_t*) ptr)
+                        lo = m + 1;
+                else
+                        hi = m;
         }
 
-        assert(n <= p->n_used);
+        assert_se(lo > 0);
+        assert(pool_contains(mp, usage[lo - 1].pool, ptr));
 
-        return n == p->n_used;
+        return usage + lo - 1;
 }
 
-static void pool_unlink(struct mempool *mp, struct pool *p) {
-        size_t m = 0;
+void mempool_trim(struct mempool *mp) {
+        _cleanup_free_ PoolUsage *usage = NULL;
+        size_t n = 0, trimmed = 0, left = 0;
 
         assert(mp);
-        assert(p);
 
-        if (p->n_used == 0)
-                return;
+        for (struct pool *p = mp->first_pool; p; p = p->next)
+                n++;
 
-        void **i = &mp->freelist;
-        while (*i) {
-                void *d = *i;
+        if (n > 0) {
+                usage = new(PoolUsage, n);
+                if (!usage)
+                        return (void) log_oom_debug();
 
-                if (pool_contains(mp, p, d)) {
-                        *i = *(void**) d;
-                        m++;
+                n = 0;
+                for (struct pool *p = mp->first_pool; p; p = p->next)
+                        usage[n++] = (PoolUsage) { .pool = p };
 
-                        if (m == p->n_used)
-                                break;
-                } else
-                        i = (void**) d;
+                typesafe_qsort(usage, n, pool_usage_compare);
         }
-}
 
-void mempool_trim(struct mempool *mp) {
-        size_t trimmed = 0, left = 0;
+        /* Count the free tiles of each chunk, with a single pass over the free list. A chunk is unused if
+         * all tiles handed out from it are in the free list. */
+        for (void *i = mp->freelist; i; i = *(void**) i)
+                pool_usage_find(mp, usage, n, i)->n_free++;
 
-        assert(mp);
+        /* Drop the tiles of unused chunks from the free list … */
+        void **i = &mp->freelist;
+        while (*i) {
+                PoolUsage *u = pool_usage_find(mp, usage, n, *i);
+
+                if (u->n_free == u->pool->n_used)
+                        *i = *(void**) *i;
+                else
+                        i = (void**) *i;
+        }
 
+        /* … and free them */
         struct pool **p = &mp->first_pool;
         while (*p) {
                 struct pool *d = *p;
+                PoolUsage *u;
+
+                u = typesafe_bsearch(&(PoolUsage) { .pool = d }, usage, n, pool_usage_compare);
+                assert(u);
 
-                if (pool_is_unused(mp, d)) {
+                if (u->n_free == d->n_used) {
                         trimmed += d->n_tiles * mp->tile_size;
-                        pool_unlink(mp, d);
                         *p = d->next;
                         free(d);
                 } else {
@@ -171,5 +278,64 @@ void mempool_trim(struct mempool *mp) {
                 }
         }
 
-        log_debug("Trimmed %s from memory pool %p. (%s left)", FORMAT_BYTES(trimmed), mp, FORMAT_BYTES(left));
+        log_debug("Trimmed %s from memory pool %s. (%s left)", FORMAT_BYTES(trimmed), strna(mp->name), FORMAT_BYTES(left));
+}
+
+void mempool_trim_all(void) {
+        int r;
+
+        /* The pools are only allocated by the main thread, but the memory can be passed to other
+         * threads. Let's clean up if we are the main thread and no other threads are live. */
+
+        /* We build our own is_main_thread() here, which doesn't use C11 TLS based caching of the
+         * result. That's because valgrind apparently doesn't like TLS to be used from a GCC destructor. */
+        if (getpid() != gettid())
+                return (void) log_debug("Not cleaning up memory pools, not in main thread.");
+
+        r = get_process_threads(0);
+        if (r < 0)
+                return (void) log_debug_errno(r, "Failed to determine number of threads, not cleaning up memory pools: %m");
+        if (r != 1)
+                return (void) log_debug("Not cleaning up memory pools, running in multi-threaded process.");
+
+        for (struct mempool *mp = registered_pools; mp; mp = mp->registered_next)
+                mempool_trim(mp);
+}
+
+#if HAVE_VALGRIND_VALGRIND_H
+_destructor_ static void cleanup_pools(void) {
+        /* Be nice to valgrind */
+        if (RUNNING_ON_VALGRIND)
+                mempool_trim_all();
+}
+#endif
+
+void mempool_dump_all(FILE *f) {
+        assert(f);
+
+        /* Loosely follows the format of malloc_info(), so that the output can be shown next to it */
+
+        fputs("<mempools>\n", f);
+
+        for (struct mempool *mp = registered_pools; mp; mp = mp->registered_next) {
+                size_t n_chunks = 0, n_tiles = 0;
+
+                for (struct pool *p = mp->first_pool; p; p = p->next) {
+                        n_chunks++;
+                        n_tiles += p->n_tiles;
+                }
+
+                fprintf(f,
+                        "<mempool name=\"%s\" tile-size=\"%zu\">\n"
+                        "<chunks count=\"%zu\" size=\"%zu\"/>\n"
+                        "<tiles total=\"%zu\" used=\"%zu\" used-max=\"%zu\"/>\n"
+                        "<allocations count=\"%" PRIu64 "\"/>\n"
+                        "</mempool>\n",
+                        strna(mp->name), mp->tile_size,
+                        n_chunks, n_tiles * mp->tile_size,
+                        n_tiles, mp->n_tiles_used, mp->n_tiles_used_max,
+                        mp->n_allocs);
+        }
+
+        fputs("</mempools>\n", f);
 }
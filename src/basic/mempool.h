@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
 struct pool;
 
@@ -11,18 +13,46 @@ struct mempool {
         void *freelist;
         size_t tile_size;
         size_t at_least;
+
+        /* Statistics, see mempool_dump_all(). A pool is registered in a global list when its first chunk is
+         * allocated, and stays there for the rest of the process' lifetime. Pools hence need static storage,
+         * i.e. should be declared with DEFINE_MEMPOOL(), and must never live on the stack. */
+        const char *name;
+        struct mempool *registered_next;
+        bool registered;
+        size_t n_tiles_used;
+        size_t n_tiles_used_max;
+        uint64_t n_allocs;
 };
 
 void* mempool_alloc_tile(struct mempool *mp);
 void* mempool_alloc0_tile(struct mempool *mp);
 void* mempool_free_tile(struct mempool *mp, void *p);
 
-#define DEFINE_MEMPOOL(pool_name, tile_type, alloc_at_least) \
+#define DEFINE_MEMPOOL_SIZE(pool_name, size, alloc_at_least) \
 static struct mempool pool_name = { \
-        .tile_size = sizeof(tile_type), \
+        .tile_size = size, \
         .at_least = alloc_at_least, \
+        .name = #pool_name, \
 }
 
+#define DEFINE_MEMPOOL(pool_name, tile_type, alloc_at_least) \
+        DEFINE_MEMPOOL_SIZE(pool_name, sizeof(tile_type), alloc_at_least)
+
 __attribute__((weak)) bool mempool_enabled(void);
 
+/* Allocates a zeroed object of the specified size from the pool if pools are enabled and we are running in
+ * the main thread, and from the heap otherwise. The latter is also done if the object doesn't fit into a
+ * tile, so that a pool can be used for objects with a trailing variable-size part, as long as it is usually
+ * small. Stores whether the pool was used in *ret_from_pool, which must be passed to
+ * mempool_free_tile_or_heap() when freeing the object again. */
+void* mempool_alloc0_tile_or_heap(struct mempool *mp, size_t size, bool *ret_from_pool);
+void* mempool_free_tile_or_heap(struct mempool *mp, void *p, bool from_pool);
+
 void mempool_trim(struct mempool *mp);
+
+/* Trims all pools, if we are in the main thread and no other threads are around */
+void mempool_trim_all(void);
+
+/* Writes statistics about all pools in use as XML, to be shown next to malloc_info() */
+void mempool_dump_all(FILE *f);
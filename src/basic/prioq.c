@@ -6,8 +6,11 @@
  * their priority and allows O(1) access to the object with the highest
  * priority. Insertion and removal are Θ(log n). Optionally, the caller can
  * provide a pointer to an index which will be kept up-to-date by the prioq.
+ * Without one, removing or reshuffling an item requires a linear search.
  *
- * The underlying algorithm used in this implementation is a Heap.
+ * The underlying algorithm used in this implementation is a 4-ary heap: with
+ * four children per node the heap is half as deep as a binary one, and the
+ * children that are compared when moving an item down are adjacent in memory.
  */
 
 #include <errno.h>
@@ -16,6 +19,11 @@
 #include "alloc-util.h"
 #include "hashmap.h"
 #include "prioq.h"
+#include "sort-util.h"
+
+#define ARITY 4U
+#define PARENT(k) (((k) - 1) / ARITY)
+#define FIRST_CHILD(k) ((k) * ARITY + 1)
 
 struct prioq_item {
         void *data;
@@ -64,80 +72,76 @@ int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func) {
         return 0;
 }
 
-static void swap(Prioq *q, unsigned j, unsigned k) {
+static void set_item(Prioq *q, unsigned k, struct prioq_item item) {
         assert(q);
-        assert(j < q->n_items);
         assert(k < q->n_items);
 
-        assert(!q->items[j].idx || *(q->items[j].idx) == j);
-        assert(!q->items[k].idx || *(q->items[k].idx) == k);
-
-        SWAP_TWO(q->items[j].data, q->items[k].data);
-        SWAP_TWO(q->items[j].idx, q->items[k].idx);
-
-        if (q->items[j].idx)
-                *q->items[j].idx = j;
-
-        if (q->items[k].idx)
-                *q->items[k].idx = k;
+        q->items[k] = item;
+        if (item.idx)
+                *item.idx = k;
 }
 
 static unsigned shuffle_up(Prioq *q, unsigned idx) {
+        struct prioq_item item;
+
         assert(q);
         assert(idx < q->n_items);
 
+        /* Rather than swapping the item with its parent on each level, move the parents down into the hole
+         * and only place the item once we found its final position */
+
+        item = q->items[idx];
+        assert(!item.idx || *item.idx == idx);
+
         while (idx > 0) {
                 unsigned k;
 
-                k = (idx-1)/2;
+                k = PARENT(idx);
 
-                if (q->compare_func(q->items[k].data, q->items[idx].data) <= 0)
+                if (q->compare_func(q->items[k].data, item.data) <= 0)
                         break;
 
-                swap(q, idx, k);
+                set_item(q, idx, q->items[k]);
                 idx = k;
         }
 
+        set_item(q, idx, item);
         return idx;
 }
 
 static unsigned shuffle_down(Prioq *q, unsigned idx) {
+        struct prioq_item item;
+
         assert(q);
+        assert(idx < q->n_items);
 
-        for (;;) {
-                unsigned j, k, s;
+        item = q->items[idx];
+        assert(!item.idx || *item.idx == idx);
 
-                k = (idx+1)*2; /* right child */
-                j = k-1;       /* left child */
+        for (;;) {
+                unsigned first, last, s;
 
-                if (j >= q->n_items)
+                first = FIRST_CHILD(idx);
+                if (first >= q->n_items)
                         break;
 
-                if (q->compare_func(q->items[j].data, q->items[idx].data) < 0)
-
-                        /* So our left child is smaller than we are, let's
-                         * remember this fact */
-                        s = j;
-                else
-                        s = idx;
+                last = MIN(first + ARITY, q->n_items);
 
-                if (k < q->n_items &&
-                    q->compare_func(q->items[k].data, q->items[s].data) < 0)
+                /* Find the smallest of the children, all of which are adjacent in memory */
+                s = first;
+                for (unsigned k = first + 1; k < last; k++)
+                        if (q->compare_func(q->items[k].data, q->items[s].data) < 0)
+                                s = k;
 
-                        /* So our right child is smaller than we are, let's
-                         * remember this fact */
-                        s = k;
-
-                /* s now points to the smallest of the three items */
-
-                if (s == idx)
-                        /* No swap necessary, we're done */
+                if (q->compare_func(q->items[s].data, item.data) >= 0)
+                        /* No child is smaller than we are, we're done */
                         break;
 
-                swap(q, idx, s);
+                set_item(q, idx, q->items[s]);
                 idx = s;
         }
 
+        set_item(q, idx, item);
         return idx;
 }
 
@@ -268,6 +272,63 @@ void prioq_reshuffle(Prioq *q, void *data, unsigned *idx) {
         shuffle_up(q, k);
 }
 
+static int unsigned_compare_reverse(const unsigned *a, const unsigned *b) {
+        return CMP(*b, *a);
+}
+
+void prioq_reshuffle_many(Prioq *q, unsigned * const *idx, size_t n) {
+        _cleanup_free_ unsigned *dirty = NULL;
+        size_t n_dirty = 0, depth;
+
+        assert(q);
+        assert(idx || n == 0);
+
+        if (n == 0 || q->n_items <= 1)
+                return;
+
+        /* Moving each item individually is not an option, as that relies on the rest of the heap being in
+         * order. Instead, do what building a heap from scratch does, i.e. move items down starting from the
+         * bottom, but limited to the changed items and their ancestors. If that is more than a fraction of
+         * the heap anyway (or we can't allocate the list), just rebuild the whole heap, which takes linear
+         * time. */
+
+        /* The number of levels, i.e. the most items on a path from the last item to the top */
+        depth = 1;
+        for (unsigned k = q->n_items - 1; k > 0; k = PARENT(k))
+                depth++;
+
+        if (n * depth < q->n_items)
+                dirty = new(unsigned, n * depth);
+        if (!dirty) {
+                for (unsigned k = PARENT(q->n_items - 1) + 1; k > 0; k--)
+                        shuffle_down(q, k - 1);
+                return;
+        }
+
+        FOREACH_ARRAY(i, idx, n) {
+                unsigned k = **i;
+
+                if (k == PRIOQ_IDX_NULL)
+                        continue;
+
+                assert(k < q->n_items);
+                assert(q->items[k].idx == *i);
+
+                for (;;) {
+                        dirty[n_dirty++] = k;
+                        if (k == 0)
+                                break;
+                        k = PARENT(k);
+                }
+        }
+
+        typesafe_qsort(dirty, n_dirty, unsigned_compare_reverse);
+
+        for (size_t i = 0; i < n_dirty; i++)
+                if (i == 0 || dirty[i] != dirty[i - 1])
+                        shuffle_down(q, dirty[i]);
+}
+
 void *prioq_peek_by_index(Prioq *q, unsigned idx) {
         if (!q)
                 return NULL;
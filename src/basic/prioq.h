@@ -20,6 +20,10 @@ int prioq_ensure_put(Prioq **q, compare_func_t compare_func, void *data, unsigne
 int prioq_remove(Prioq *q, void *data, unsigned *idx);
 void prioq_reshuffle(Prioq *q, void *data, unsigned *idx);
 
+/* Like prioq_reshuffle(), but for a number of items whose ordering changed at once, identified by their
+ * index pointers. Items not in the queue (i.e. whose index is PRIOQ_IDX_NULL) are ignored. */
+void prioq_reshuffle_many(Prioq *q, unsigned * const *idx, size_t n);
+
 void *prioq_peek_by_index(Prioq *q, unsigned idx) _pure_;
 static inline void *prioq_peek(Prioq *q) {
         return prioq_peek_by_index(q, 0);
@@ -25,6 +25,7 @@
 #include "alloc-util.h"
 #include "architecture.h"
 #include "argv-util.h"
+#include "cgroup-util.h"
 #include "dirent-util.h"
 #include "env-file.h"
 #include "env-util.h"
@@ -1927,47 +1928,123 @@ int make_reaper_process(bool b) {
         return 0;
 }
 
-int posix_spawn_wrapper(const char *path, char *const *argv, char *const *envp, pid_t *ret_pid) {
-        posix_spawnattr_t attr;
+static int posix_spawn_with_attr(
+                posix_spawnattr_t *attr,
+                const char *path,
+                char *const *argv,
+                char *const *envp,
+                const char *cgroup,
+                PidRef *ret_pidref) {
+
+        short flags = POSIX_SPAWN_SETSIGMASK|POSIX_SPAWN_SETSIGDEF; /* Set all signals to SIG_DFL */
         sigset_t mask;
         pid_t pid;
         int r;
 
-        /* Forks and invokes 'path' with 'argv' and 'envp' using CLONE_VM and CLONE_VFORK, which means the
-         * caller will be blocked until the child either exits or exec's. The memory of the child will be
-         * fully shared with the memory of the parent, so that there are no copy-on-write or memory.max
-         * issues. */
-
+        assert(attr);
         assert(path);
         assert(argv);
-        assert(ret_pid);
+        assert(ret_pidref);
 
         assert_se(sigfillset(&mask) >= 0);
 
-        r = posix_spawnattr_init(&attr);
+        r = posix_spawnattr_setsigmask(attr, &mask);
         if (r != 0)
                 return -r; /* These functions return a positive errno on failure */
-        /* Set all signals to SIG_DFL */
-        r = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK|POSIX_SPAWN_SETSIGDEF);
+
+#if HAVE_PIDFD_SPAWN
+        _cleanup_close_ int cgroup_fd = -EBADF, pidfd = -EBADF;
+
+        /* CLONE_INTO_CGROUP only works with the unified hierarchy */
+        if (cgroup && cg_all_unified() > 0) {
+                _cleanup_free_ char *p = NULL;
+
+                r = cg_get_path(SYSTEMD_CGROUP_CONTROLLER, cgroup, NULL, &p);
+                if (r < 0)
+                        return r;
+
+                cgroup_fd = open(p, O_PATH|O_DIRECTORY|O_CLOEXEC);
+                if (cgroup_fd < 0)
+                        log_debug_errno(errno, "Failed to open cgroup '%s', not spawning process into it: %m", p);
+                else {
+                        r = posix_spawnattr_setcgroup_np(attr, cgroup_fd);
+                        if (r != 0)
+                                return -r;
+
+                        flags |= POSIX_SPAWN_SETCGROUP;
+                }
+        }
+
+        r = posix_spawnattr_setflags(attr, flags);
         if (r != 0)
-                goto fail;
-        r = posix_spawnattr_setsigmask(&attr, &mask);
+                return -r;
+
+        r = pidfd_spawn(&pidfd, path, NULL, attr, argv, envp);
+        if (r == 0) {
+                r = pidref_set_pidfd_consume(ret_pidref, TAKE_FD(pidfd));
+                if (r < 0)
+                        return r;
+
+                return FLAGS_SET(flags, POSIX_SPAWN_SETCGROUP);
+        }
+        if (!ERRNO_IS_NOT_SUPPORTED(r) && !ERRNO_IS_PRIVILEGE(r) &&
+            !(r == EBUSY && FLAGS_SET(flags, POSIX_SPAWN_SETCGROUP)))
+                return -r;
+
+        /* clone3() might be unavailable or filtered even if the C library knows about it. If the cgroup
+         * doesn't take processes (EBUSY), spawn the process outside of it and leave it to the caller to
+         * deal with that, as before. */
+        log_debug_errno(r, "Failed to spawn process via clone3(), falling back to posix_spawn(): %m");
+        flags &= ~POSIX_SPAWN_SETCGROUP;
+#endif
+
+        r = posix_spawnattr_setflags(attr, flags);
         if (r != 0)
-                goto fail;
+                return -r;
 
-        r = posix_spawn(&pid, path, NULL, &attr, argv, envp);
+        r = posix_spawn(&pid, path, NULL, attr, argv, envp);
         if (r != 0)
-                goto fail;
+                return -r;
 
-        *ret_pid = pid;
+        r = pidref_set_pid(ret_pidref, pid);
+        if (r < 0)
+                return r;
 
-        posix_spawnattr_destroy(&attr);
         return 0;
+}
+
+int posix_spawn_wrapper(
+                const char *path,
+                char *const *argv,
+                char *const *envp,
+                const char *cgroup,
+                PidRef *ret_pidref) {
+
+        posix_spawnattr_t attr;
+        int r;
 
-fail:
-        assert(r > 0);
+        /* Forks and invokes 'path' with 'argv' and 'envp' using CLONE_VM and CLONE_VFORK, which means the
+         * caller will be blocked until the child either exits or exec's. The memory of the child will be
+         * fully shared with the memory of the parent, so that there are no copy-on-write or memory.max
+         * issues.
+         *
+         * If 'cgroup' is specified and the C library provides pidfd_spawn(), the child is created directly in
+         * that cgroup via clone3() with CLONE_INTO_CGROUP, so that it never runs anywhere else and doesn't need
+         * to be migrated, which takes locks that contend heavily when many processes are started at once.
+         * The child is referenced via the pidfd clone3() returns from the start then. Returns 1 if the child
+         * was spawned into 'cgroup', 0 if the caller needs to move it there itself. */
+
+        assert(path);
+        assert(argv);
+        assert(ret_pidref);
+
+        r = posix_spawnattr_init(&attr);
+        if (r != 0)
+                return -r;
+
+        r = posix_spawn_with_attr(&attr, path, argv, envp, cgroup, ret_pidref);
         posix_spawnattr_destroy(&attr);
-        return -r;
+        return r;
 }
 
 int proc_dir_open(DIR **ret) {
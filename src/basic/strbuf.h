@@ -24,7 +24,8 @@ struct strbuf_node {
         size_t value_len;
 
         struct strbuf_child_entry *children;
-        uint8_t children_count;
+        /* Strings may contain NUL bytes (e.g. nulstr), hence a node can have all 256 children */
+        size_t children_count;
 };
 
 struct strbuf_child_entry {
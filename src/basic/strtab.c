@@ -0,0 +1,494 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "nulstr-util.h"
+#include "sort-util.h"
+#include "strbuf.h"
+#include "string-util.h"
+#include "strtab.h"
+#include "tmpfile-util.h"
+
+typedef struct StrtabEntry {
+        char *key;
+        void *value;
+        size_t size;
+} StrtabEntry;
+
+typedef struct StrtabWriterSection {
+        StrtabEntry *entries;
+        size_t n_entries;
+} StrtabWriterSection;
+
+struct StrtabWriter {
+        StrtabWriterSection *sections;
+        unsigned n_sections;
+};
+
+struct Strtab {
+        union {
+                const struct strtab_header_f *header;
+                const uint8_t *map;
+        };
+        size_t size;
+};
+
+int strtab_writer_new(unsigned n_sections, StrtabWriter **ret) {
+        _cleanup_(strtab_writer_freep) StrtabWriter *w = NULL;
+
+        assert(n_sections > 0);
+        assert(ret);
+
+        w = new(StrtabWriter, 1);
+        if (!w)
+                return -ENOMEM;
+
+        *w = (StrtabWriter) {
+                .sections = new0(StrtabWriterSection, n_sections),
+                .n_sections = n_sections,
+        };
+        if (!w->sections)
+                return -ENOMEM;
+
+        *ret = TAKE_PTR(w);
+        return 0;
+}
+
+StrtabWriter* strtab_writer_free(StrtabWriter *w) {
+        if (!w)
+                return NULL;
+
+        for (unsigned s = 0; s < w->n_sections; s++) {
+                FOREACH_ARRAY(e, w->sections[s].entries, w->sections[s].n_entries) {
+                        free(e->key);
+                        free(e->value);
+                }
+                free(w->sections[s].entries);
+        }
+
+        free(w->sections);
+        return mfree(w);
+}
+
+int strtab_writer_add(StrtabWriter *w, unsigned section, const char *key, const void *value, size_t size) {
+        _cleanup_free_ char *k = NULL;
+        _cleanup_free_ void *v = NULL;
+        StrtabWriterSection *s;
+
+        assert(w);
+        assert(section < w->n_sections);
+        assert(key);
+        assert(value || size == 0);
+
+        s = w->sections + section;
+
+        k = strdup(key);
+        if (!k)
+                return -ENOMEM;
+
+        if (size > 0) {
+                v = memdup(value, size);
+                if (!v)
+                        return -ENOMEM;
+        }
+
+        if (!GREEDY_REALLOC(s->entries, s->n_entries + 1))
+                return -ENOMEM;
+
+        s->entries[s->n_entries++] = (StrtabEntry) {
+                .key = TAKE_PTR(k),
+                .value = TAKE_PTR(v),
+                .size = size,
+        };
+
+        return 0;
+}
+
+int strtab_writer_add_strv(StrtabWriter *w, unsigned section, const char *key, char * const *l) {
+        _cleanup_free_ char *nulstr = NULL;
+        size_t n;
+        int r;
+
+        r = strv_make_nulstr(l, &nulstr, &n);
+        if (r < 0)
+                return r;
+
+        return strtab_writer_add(w, section, key, nulstr, n);
+}
+
+static int entry_compare(const StrtabEntry *a, const StrtabEntry *b) {
+        return strcmp(a->key, b->key);
+}
+
+typedef struct StrtabString {
+        const void *data;
+        size_t size;
+        struct strtab_entry_f *entry;
+        bool is_value;
+} StrtabString;
+
+static int string_compare(const StrtabString *a, const StrtabString *b) {
+        /* Longest strings first, so that the shorter ones can reuse their tails */
+        return CMP(b->size, a->size);
+}
+
+int strtab_writer_write(StrtabWriter *w, const char *type, uint64_t stamp, const char *path, mode_t mode) {
+        _cleanup_(unlink_and_freep) char *path_tmp = NULL;
+        _cleanup_(strbuf_freep) struct strbuf *sb = NULL;
+        _cleanup_free_ struct strtab_section_f *sections = NULL;
+        _cleanup_free_ struct strtab_entry_f *entries = NULL;
+        _cleanup_free_ StrtabString *strings = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        size_t n_entries = 0, n_strings = 0, k = 0;
+        uint64_t entries_off, strings_off;
+        int r;
+
+        assert(w);
+        assert(type);
+        assert(strlen(type) < STRTAB_TYPE_MAX);
+        assert(path);
+
+        for (unsigned s = 0; s < w->n_sections; s++) {
+                StrtabWriterSection *section = w->sections + s;
+
+                typesafe_qsort(section->entries, section->n_entries, entry_compare);
+
+                for (size_t i = 1; i < section->n_entries; i++)
+                        if (streq(section->entries[i-1].key, section->entries[i].key))
+                                return -ENOTUNIQ;
+
+                n_entries += section->n_entries;
+        }
+
+        sections = new0(struct strtab_section_f, w->n_sections);
+        entries = new0(struct strtab_entry_f, n_entries);
+        strings = new(StrtabString, n_entries * 2);
+        if (!sections || (n_entries > 0 && (!entries || !strings)))
+                return -ENOMEM;
+
+        entries_off = sizeof(struct strtab_header_f) + w->n_sections * sizeof(struct strtab_section_f);
+        strings_off = entries_off + n_entries * sizeof(struct strtab_entry_f);
+
+        for (unsigned s = 0; s < w->n_sections; s++) {
+                StrtabWriterSection *section = w->sections + s;
+
+                sections[s] = (struct strtab_section_f) {
+                        .entries_off = htole64(entries_off + k * sizeof(struct strtab_entry_f)),
+                        .n_entries = htole64(section->n_entries),
+                };
+
+                FOREACH_ARRAY(e, section->entries, section->n_entries) {
+                        entries[k].value_size = htole64(e->size);
+
+                        strings[n_strings++] = (StrtabString) {
+                                .data = e->key,
+                                .size = strlen(e->key),
+                                .entry = entries + k,
+                        };
+                        strings[n_strings++] = (StrtabString) {
+                                .data = e->value,
+                                .size = e->size,
+                                .entry = entries + k,
+                                .is_value = true,
+                        };
+
+                        k++;
+                }
+        }
+
+        /* Keys and values go into the same buffer, so that e.g. a unit name key and a path value ending in
+         * that name are stored only once. */
+        typesafe_qsort(strings, n_strings, string_compare);
+
+        sb = strbuf_new();
+        if (!sb)
+                return -ENOMEM;
+
+        FOREACH_ARRAY(i, strings, n_strings) {
+                ssize_t off;
+
+                off = strbuf_add_string(sb, i->data ?: "", i->size);
+                if (off < 0)
+                        return off;
+
+                if (i->is_value)
+                        i->entry->value_off = htole64(strings_off + off);
+                else
+                        i->entry->key_off = htole64(strings_off + off);
+        }
+
+        strbuf_complete(sb);
+
+        struct strtab_header_f h = {
+                .signature = STRTAB_SIGNATURE,
+                .version = htole32(STRTAB_VERSION),
+                .n_sections = htole32(w->n_sections),
+                .stamp = htole64(stamp),
+                .file_size = htole64(strings_off + sb->len),
+                .header_size = htole64(sizeof(struct strtab_header_f)),
+                .section_size = htole64(sizeof(struct strtab_section_f)),
+                .entry_size = htole64(sizeof(struct strtab_entry_f)),
+                .strings_off = htole64(strings_off),
+                .strings_len = htole64(sb->len),
+        };
+        strncpy(h.type, type, sizeof(h.type));
+
+        r = fopen_tmpfile_linkable(path, O_WRONLY|O_CLOEXEC, &path_tmp, &f);
+        if (r < 0)
+                return r;
+
+        if (fchmod(fileno(f), mode) < 0)
+                return -errno;
+
+        fwrite(&h, sizeof(h), 1, f);
+        fwrite(sections, sizeof(struct strtab_section_f), w->n_sections, f);
+        fwrite(entries, sizeof(struct strtab_entry_f), n_entries, f);
+        fwrite(sb->buf, 1, sb->len, f);
+
+        r = flink_tmpfile(f, path_tmp, path, LINK_TMPFILE_REPLACE);
+        if (r < 0)
+                return r;
+
+        path_tmp = mfree(path_tmp);
+        return 0;
+}
+
+static const struct strtab_section_f* strtab_section(const Strtab *t, unsigned section) {
+        assert(t);
+        assert(section < le32toh(t->header->n_sections));
+
+        return (const struct strtab_section_f*) (t->map + le64toh(t->header->header_size) +
+                                                  section * le64toh(t->header->section_size));
+}
+
+static const struct strtab_entry_f* strtab_entry(const Strtab *t, const struct strtab_section_f *s, size_t i) {
+        return (const struct strtab_entry_f*) (t->map + le64toh(s->entries_off) + i * le64toh(t->header->entry_size));
+}
+
+static bool strtab_range_valid(const Strtab *t, uint64_t off, uint64_t size) {
+        uint64_t strings_off = le64toh(t->header->strings_off);
+
+        /* The byte after the data must be within the string buffer as well, since it is the terminating NUL */
+        return off >= strings_off &&
+                off - strings_off < le64toh(t->header->strings_len) &&
+                size < le64toh(t->header->strings_len) - (off - strings_off);
+}
+
+static const char* strtab_key(const Strtab *t, const struct strtab_entry_f *e) {
+        uint64_t off = le64toh(e->key_off);
+
+        /* The string buffer is NUL terminated, which we checked when opening, hence it is enough to check the
+         * start of the key here. */
+        if (!strtab_range_valid(t, off, 0))
+                return NULL;
+
+        return (const char*) t->map + off;
+}
+
+int strtab_open(const char *path, const char *type, Strtab **ret) {
+        _cleanup_(strtab_freep) Strtab *t = NULL;
+        _cleanup_close_ int fd = -EBADF;
+        const struct strtab_header_f *h;
+        const uint8_t sig[] = STRTAB_SIGNATURE;
+        uint64_t strings_off, strings_len, n_sections;
+        struct stat st;
+        void *map;
+
+        assert(path);
+        assert(type);
+        assert(ret);
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+        if (!S_ISREG(st.st_mode))
+                return -EBADMSG;
+        if (st.st_size < (off_t) sizeof(struct strtab_header_f))
+                return -EBADMSG;
+        if (file_offset_beyond_memory_size(st.st_size))
+                return -EFBIG;
+
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+                return -errno;
+
+        t = new(Strtab, 1);
+        if (!t) {
+                (void) munmap(map, st.st_size);
+                return -ENOMEM;
+        }
+
+        *t = (Strtab) {
+                .map = map,
+                .size = st.st_size,
+        };
+        h = t->header;
+
+        if (memcmp(h->signature, sig, sizeof(sig)) != 0 ||
+            le32toh(h->version) != STRTAB_VERSION ||
+            strncmp(h->type, type, sizeof(h->type)) != 0 ||
+            le64toh(h->file_size) != t->size ||
+            le64toh(h->header_size) < sizeof(struct strtab_header_f) ||
+            le64toh(h->section_size) < sizeof(struct strtab_section_f) ||
+            le64toh(h->entry_size) < sizeof(struct strtab_entry_f))
+                return -EBADMSG;
+
+        n_sections = le32toh(h->n_sections);
+        if (le64toh(h->header_size) > t->size ||
+            n_sections > (t->size - le64toh(h->header_size)) / le64toh(h->section_size))
+                return -EBADMSG;
+
+        strings_off = le64toh(h->strings_off);
+        strings_len = le64toh(h->strings_len);
+        if (strings_len == 0 ||
+            strings_off > t->size ||
+            strings_len > t->size - strings_off ||
+            t->map[strings_off + strings_len - 1] != 0)
+                return -EBADMSG;
+
+        for (unsigned s = 0; s < n_sections; s++) {
+                const struct strtab_section_f *section = strtab_section(t, s);
+                uint64_t entries_off = le64toh(section->entries_off);
+
+                if (entries_off > t->size ||
+                    le64toh(section->n_entries) > (t->size - entries_off) / le64toh(h->entry_size))
+                        return -EBADMSG;
+        }
+
+        *ret = TAKE_PTR(t);
+        return 0;
+}
+
+Strtab* strtab_free(Strtab *t) {
+        if (!t)
+                return NULL;
+
+        (void) munmap((void*) t->map, t->size);
+        return mfree(t);
+}
+
+uint64_t strtab_get_stamp(const Strtab *t) {
+        assert(t);
+
+        return le64toh(t->header->stamp);
+}
+
+unsigned strtab_get_n_sections(const Strtab *t) {
+        assert(t);
+
+        return le32toh(t->header->n_sections);
+}
+
+size_t strtab_get_size(const Strtab *t) {
+        assert(t);
+
+        return t->size;
+}
+
+size_t strtab_section_get_n_entries(const Strtab *t, unsigned section) {
+        assert(t);
+
+        if (section >= strtab_get_n_sections(t))
+                return 0;
+
+        return le64toh(strtab_section(t, section)->n_entries);
+}
+
+static int strtab_entry_value(const Strtab *t, const struct strtab_entry_f *e, const void **ret_value, size_t *ret_size) {
+        uint64_t off = le64toh(e->value_off), size = le64toh(e->value_size);
+
+        if (!strtab_range_valid(t, off, size))
+                return -EBADMSG;
+
+        if (ret_value)
+                *ret_value = t->map + off;
+        if (ret_size)
+                *ret_size = size;
+
+        return 0;
+}
+
+int strtab_lookup(const Strtab *t, unsigned section, const char *key, const void **ret_value, size_t *ret_size) {
+        const struct strtab_section_f *s;
+        size_t left = 0, right;
+
+        assert(t);
+        assert(key);
+
+        if (section >= strtab_get_n_sections(t))
+                return 0;
+
+        s = strtab_section(t, section);
+        right = le64toh(s->n_entries);
+
+        while (left < right) {
+                size_t middle = left + (right - left) / 2;
+                const struct strtab_entry_f *e = strtab_entry(t, s, middle);
+                const char *k;
+                int r;
+
+                k = strtab_key(t, e);
+                if (!k)
+                        return -EBADMSG;
+
+                r = strcmp(key, k);
+                if (r == 0) {
+                        r = strtab_entry_value(t, e, ret_value, ret_size);
+                        if (r < 0)
+                                return r;
+
+                        return 1;
+                }
+
+                if (r < 0)
+                        right = middle;
+                else
+                        left = middle + 1;
+        }
+
+        return 0;
+}
+
+int strtab_get_entry(
+                const Strtab *t,
+                unsigned section,
+                size_t i,
+                const char **ret_key,
+                const void **ret_value,
+                size_t *ret_size) {
+
+        const struct strtab_entry_f *e;
+        const char *k;
+        int r;
+
+        assert(t);
+
+        if (i >= strtab_section_get_n_entries(t, section))
+                return -ENXIO;
+
+        e = strtab_entry(t, strtab_section(t, section), i);
+
+        k = strtab_key(t, e);
+        if (!k)
+                return -EBADMSG;
+
+        r = strtab_entry_value(t, e, ret_value, ret_size);
+        if (r < 0)
+                return r;
+
+        if (ret_key)
+                *ret_key = k;
+
+        return 0;
+}
@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "macro.h"
+#include "sparse-endian.h"
+
+/* A simple file format for string tables that are compiled once and then looked up many times, for example
+ * caches of data that is expensive to collect. A file consists of a number of sections, each of which maps
+ * NUL-terminated string keys to binary values. All keys and values are stored de-duplicated in a single
+ * string buffer (see strbuf.h), and the entries of each section are sorted by key, so that the file can be
+ * mmap()ed and looked up in place without parsing.
+ *
+ * The type string identifies the contents of the file, the stamp is an arbitrary value chosen by the
+ * writer, usually a hash of the sources the table was generated from, so that readers can check whether
+ * the file is still up-to-date. */
+
+#define STRTAB_SIGNATURE { 'S', 'D', 'S', 'T', 'R', 'T', 'A', 'B' }
+#define STRTAB_VERSION 1U
+#define STRTAB_TYPE_MAX 16U
+
+/* on-disk objects, all offsets are relative to the beginning of the file */
+struct strtab_header_f {
+        uint8_t signature[8];
+
+        /* incompatible changes of the format bump this */
+        le32_t version;
+        le32_t n_sections;
+
+        /* what the file contains, NUL padded */
+        char type[STRTAB_TYPE_MAX];
+        le64_t stamp;
+        le64_t file_size;
+
+        /* size of structures to allow them to grow */
+        le64_t header_size;
+        le64_t section_size;
+        le64_t entry_size;
+
+        /* the section array follows the header directly */
+        le64_t strings_off;
+        le64_t strings_len;
+} _packed_;
+
+struct strtab_section_f {
+        le64_t entries_off;
+        le64_t n_entries;
+} _packed_;
+
+/* array of entries of a section, sorted by key */
+struct strtab_entry_f {
+        le64_t key_off;
+        /* the value is always followed by a NUL byte in the file, which is not counted in value_size */
+        le64_t value_off;
+        le64_t value_size;
+} _packed_;
+
+typedef struct StrtabWriter StrtabWriter;
+
+int strtab_writer_new(unsigned n_sections, StrtabWriter **ret);
+StrtabWriter* strtab_writer_free(StrtabWriter *w);
+DEFINE_TRIVIAL_CLEANUP_FUNC(StrtabWriter*, strtab_writer_free);
+
+int strtab_writer_add(StrtabWriter *w, unsigned section, const char *key, const void *value, size_t size);
+static inline int strtab_writer_add_string(StrtabWriter *w, unsigned section, const char *key, const char *value) {
+        return strtab_writer_add(w, section, key, value, value ? strlen(value) : 0);
+}
+int strtab_writer_add_strv(StrtabWriter *w, unsigned section, const char *key, char * const *l);
+
+/* Writes the table atomically to the specified path with the specified access mode, replacing any existing
+ * file. */
+int strtab_writer_write(StrtabWriter *w, const char *type, uint64_t stamp, const char *path, mode_t mode);
+
+typedef struct Strtab Strtab;
+
+/* Returns -EBADMSG if the file is not a string table of the specified type, or of an incompatible
+ * version. */
+int strtab_open(const char *path, const char *type, Strtab **ret);
+Strtab* strtab_free(Strtab *t);
+DEFINE_TRIVIAL_CLEANUP_FUNC(Strtab*, strtab_free);
+
+uint64_t strtab_get_stamp(const Strtab *t);
+unsigned strtab_get_n_sections(const Strtab *t);
+size_t strtab_get_size(const Strtab *t);
+size_t strtab_section_get_n_entries(const Strtab *t, unsigned section);
+
+/* Returns 1 and the value if the key was found, 0 if not. Values are followed by a NUL byte, hence string
+ * values may be used directly. */
+int strtab_lookup(const Strtab *t, unsigned section, const char *key, const void **ret_value, size_t *ret_size);
+int strtab_get_entry(
+                const Strtab *t,
+                unsigned section,
+                size_t i,
+                const char **ret_key,
+                const void **ret_value,
+                size_t *ret_size);
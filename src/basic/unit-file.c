@@ -8,11 +8,14 @@
 #include "fs-util.h"
 #include "initrd-util.h"
 #include "macro.h"
+#include "mkdir.h"
+#include "nulstr-util.h"
 #include "path-lookup.h"
 #include "set.h"
 #include "special.h"
 #include "stat-util.h"
 #include "string-util.h"
+#include "strtab.h"
 #include "strv.h"
 #include "unit-file.h"
 
@@ -635,6 +638,271 @@ int unit_file_build_name_map(
         return 1;
 }
 
+/* Sections of the unit name map cache file, see unit_file_build_name_map_cached() */
+enum {
+        NAME_MAP_SECTION_IDS,    /* unit name → fragment path */
+        NAME_MAP_SECTION_NAMES,  /* unit name → nulstr of aliases */
+        NAME_MAP_SECTION_PATHS,  /* path cache, values are empty */
+        _NAME_MAP_SECTION_MAX,
+};
+
+#define NAME_MAP_CACHE_TYPE "unit-name-map"
+#define NAME_MAP_CACHE_HASH_KEY SD_ID128_MAKE(b5,2c,65,0e,b3,3f,4d,c6,a4,ab,9d,4a,29,76,5e,0d)
+
+static void lookup_paths_cache_stamp_entry(int dir_fd, const struct dirent *de, struct siphash *state) {
+        struct stat st;
+
+        /* The maps also depend on where symlinks lead, possibly to files outside of the search path, and
+         * on whether the files they end up at are empty or /dev/null, i.e. masked. Neither changes the
+         * modification time of the directory the symlink or file is in. */
+
+        if (de->d_type == DT_LNK) {
+                _cleanup_free_ char *target = NULL;
+
+                if (readlinkat_malloc(dir_fd, de->d_name, &target) >= 0)
+                        string_hash_func(target, state);
+        } else if (de->d_type != DT_REG)
+                return;
+
+        if (fstatat(dir_fd, de->d_name, &st, 0) < 0) {
+                siphash24_compress(&errno, sizeof(errno), state);
+                return;
+        }
+
+        siphash24_compress(&st.st_dev, sizeof(st.st_dev), state);
+        siphash24_compress(&st.st_ino, sizeof(st.st_ino), state);
+        siphash24_compress(&st.st_rdev, sizeof(st.st_rdev), state);
+        siphash24_compress_byte(IFTODT(st.st_mode), state);
+        siphash24_compress_boolean(st.st_size == 0, state);
+}
+
+static uint64_t lookup_paths_cache_stamp(const LookupPaths *lp, uint64_t timestamp_hash, bool with_paths) {
+        struct siphash state;
+
+        /* The timestamp hash only covers the directories that users may modify. The ones under our own
+         * control, most importantly the generator output, are flushed and recreated on every reload, so
+         * their modification times change even if their contents do not. Hence, for the on-disk cache,
+         * include the entries of those directories instead. In all directories, include what symlinks and
+         * files lead to, see lookup_paths_cache_stamp_entry(). */
+
+        siphash24_init(&state, NAME_MAP_CACHE_HASH_KEY.bytes);
+        siphash24_compress(&timestamp_hash, sizeof(timestamp_hash), &state);
+        siphash24_compress_boolean(with_paths, &state);
+        string_hash_func(strempty(lp->root_dir), &state);
+
+        STRV_FOREACH(dir, lp->search_path) {
+                _cleanup_free_ char *resolved_dir = NULL;
+                _cleanup_closedir_ DIR *d = NULL;
+                bool exclude;
+
+                string_hash_func(*dir, &state);
+
+                /* The search path directories themselves may be symlinks, see unit_file_build_name_map() */
+                if (chase(*dir, NULL, 0, &resolved_dir, NULL) >= 0)
+                        string_hash_func(resolved_dir, &state);
+
+                d = opendir(*dir);
+                if (!d) {
+                        siphash24_compress(&errno, sizeof(errno), &state);
+                        continue;
+                }
+
+                exclude = lookup_paths_mtime_exclude(lp, *dir);
+
+                FOREACH_DIRENT_ALL(de, d, siphash24_compress(&errno, sizeof(errno), &state)) {
+                        if (exclude) {
+                                string_hash_func(de->d_name, &state);
+                                siphash24_compress_byte(de->d_type, &state);
+                        }
+
+                        lookup_paths_cache_stamp_entry(dirfd(d), de, &state);
+                }
+        }
+
+        return siphash24_finalize(&state);
+}
+
+static int unit_file_name_map_load(
+                const char *path,
+                uint64_t stamp,
+                Hashmap **unit_ids_map,
+                Hashmap **unit_names_map,
+                Set **path_cache) {
+
+        _cleanup_hashmap_free_ Hashmap *ids = NULL, *names = NULL;
+        _cleanup_set_free_ Set *paths = NULL;
+        _cleanup_(strtab_freep) Strtab *t = NULL;
+        int r;
+
+        r = strtab_open(path, NAME_MAP_CACHE_TYPE, &t);
+        if (r == -ENOENT)
+                return 0;
+        if (r < 0)
+                return r;
+
+        if (strtab_get_stamp(t) != stamp) {
+                log_debug("Unit name map cache %s is outdated.", path);
+                return 0;
+        }
+
+        for (size_t i = 0; i < strtab_section_get_n_entries(t, NAME_MAP_SECTION_IDS); i++) {
+                _cleanup_free_ char *k = NULL, *v = NULL;
+                const char *key;
+                const void *value;
+
+                r = strtab_get_entry(t, NAME_MAP_SECTION_IDS, i, &key, &value, NULL);
+                if (r < 0)
+                        return r;
+
+                k = strdup(key);
+                v = strdup(value);
+                if (!k || !v)
+                        return -ENOMEM;
+
+                r = hashmap_ensure_put(&ids, &string_hash_ops_free_free, k, v);
+                if (r < 0)
+                        return r;
+
+                TAKE_PTR(k);
+                TAKE_PTR(v);
+        }
+
+        for (size_t i = 0; i < strtab_section_get_n_entries(t, NAME_MAP_SECTION_NAMES); i++) {
+                _cleanup_strv_free_ char **l = NULL;
+                _cleanup_free_ char *k = NULL;
+                const char *key;
+                const void *value;
+                size_t size;
+
+                r = strtab_get_entry(t, NAME_MAP_SECTION_NAMES, i, &key, &value, &size);
+                if (r < 0)
+                        return r;
+
+                k = strdup(key);
+                l = strv_parse_nulstr(value, size);
+                if (!k || !l)
+                        return -ENOMEM;
+
+                r = hashmap_ensure_put(&names, &string_strv_hash_ops, k, l);
+                if (r < 0)
+                        return r;
+
+                TAKE_PTR(k);
+                TAKE_PTR(l);
+        }
+
+        if (path_cache)
+                for (size_t i = 0; i < strtab_section_get_n_entries(t, NAME_MAP_SECTION_PATHS); i++) {
+                        const char *key;
+
+                        r = strtab_get_entry(t, NAME_MAP_SECTION_PATHS, i, &key, NULL, NULL);
+                        if (r < 0)
+                                return r;
+
+                        r = set_put_strdup_full(&paths, &path_hash_ops_free, key);
+                        if (r < 0)
+                                return r;
+                }
+
+        log_debug("Loaded %u unit names from cache %s.", hashmap_size(ids), path);
+
+        hashmap_free_and_replace(*unit_ids_map, ids);
+        hashmap_free_and_replace(*unit_names_map, names);
+        if (path_cache)
+                set_free_and_replace(*path_cache, paths);
+
+        return 1;
+}
+
+static int unit_file_name_map_save(
+                const char *path,
+                uint64_t stamp,
+                Hashmap *unit_ids_map,
+                Hashmap *unit_names_map,
+                Set *path_cache) {
+
+        _cleanup_(strtab_writer_freep) StrtabWriter *w = NULL;
+        const char *key, *value;
+        char **l;
+        int r;
+
+        r = strtab_writer_new(_NAME_MAP_SECTION_MAX, &w);
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH_KEY(value, key, unit_ids_map) {
+                r = strtab_writer_add_string(w, NAME_MAP_SECTION_IDS, key, value);
+                if (r < 0)
+                        return r;
+        }
+
+        HASHMAP_FOREACH_KEY(l, key, unit_names_map) {
+                r = strtab_writer_add_strv(w, NAME_MAP_SECTION_NAMES, key, l);
+                if (r < 0)
+                        return r;
+        }
+
+        SET_FOREACH(key, path_cache) {
+                r = strtab_writer_add(w, NAME_MAP_SECTION_PATHS, key, NULL, 0);
+                if (r < 0)
+                        return r;
+        }
+
+        (void) mkdir_parents(path, 0755);
+
+        return strtab_writer_write(w, NAME_MAP_CACHE_TYPE, stamp, path, 0444);
+}
+
+int unit_file_build_name_map_cached(
+                const LookupPaths *lp,
+                const char *cache_path,
+                uint64_t *cache_timestamp_hash,
+                Hashmap **unit_ids_map,
+                Hashmap **unit_names_map,
+                Set **path_cache) {
+
+        uint64_t timestamp_hash, stamp;
+        int r;
+
+        /* Like unit_file_build_name_map(), but if the in-memory maps are outdated, first tries to load them
+         * from the specified cache file, and if that is outdated too, updates the file after building the
+         * maps. The cache file is meant to live in /run/, so that the maps survive reloads and reexecution
+         * of the manager. */
+
+        assert(lp);
+        assert(cache_timestamp_hash);
+
+        if (!cache_path)
+                return unit_file_build_name_map(lp, cache_timestamp_hash, unit_ids_map, unit_names_map, path_cache);
+
+        if (lookup_paths_timestamp_hash_same(lp, *cache_timestamp_hash, &timestamp_hash))
+                return 0;
+
+        /* Like in unit_file_build_name_map(), calculate the stamp before reading the directories, so that
+         * concurrent modifications make the cache outdated. */
+        stamp = lookup_paths_cache_stamp(lp, timestamp_hash, path_cache);
+
+        r = unit_file_name_map_load(cache_path, stamp, unit_ids_map, unit_names_map, path_cache);
+        if (r < 0)
+                log_debug_errno(r, "Failed to load unit name map cache %s, ignoring: %m", cache_path);
+        if (r > 0) {
+                *cache_timestamp_hash = timestamp_hash;
+                return 1;
+        }
+
+        r = unit_file_build_name_map(lp, NULL, unit_ids_map, unit_names_map, path_cache);
+        if (r < 0)
+                return r;
+
+        *cache_timestamp_hash = timestamp_hash;
+
+        r = unit_file_name_map_save(cache_path, stamp, *unit_ids_map, *unit_names_map, path_cache ? *path_cache : NULL);
+        if (r < 0)
+                log_debug_errno(r, "Failed to write unit name map cache %s, ignoring: %m", cache_path);
+
+        return 1;
+}
+
 static int add_name(
                 const char *unit_name,
                 Set **names,
@@ -158,6 +158,12 @@ char *utf8_is_valid_n(const char *str, size_t len_bytes) {
                 if (_unlikely_(*p == '\0') && len_bytes != SIZE_MAX)
                         return NULL; /* embedded NUL */
 
+                /* Shortcut for plain ASCII, which is what almost all strings we validate consist of */
+                if ((unsigned char) *p < 0x80) {
+                        p++;
+                        continue;
+                }
+
                 len = utf8_encoded_valid_unichar(p,
                                                  len_bytes != SIZE_MAX ? len_bytes - (p - str) : SIZE_MAX);
                 if (_unlikely_(len < 0))
@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "macro.h"
+#include "unaligned.h"
+#include "wyhash.h"
+
+/* The default secret of the reference implementation */
+static const uint64_t wyhash_secret[4] = {
+        UINT64_C(0x2d358dccaa6c78a5),
+        UINT64_C(0x8bb84b93962eacc9),
+        UINT64_C(0x4b33a62ed433d4a3),
+        UINT64_C(0x4d5a2da51de1aa47),
+};
+
+/* 64×64→128 bit multiplication, returning the lower half in *a and the upper half in *b */
+static inline void wymum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+        __uint128_t r = (__uint128_t) *a * *b;
+
+        *a = (uint64_t) r;
+        *b = (uint64_t) (r >> 64);
+#else
+        uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t) *a, lb = (uint32_t) *b,
+                rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb,
+                t = rl + (rm0 << 32), c = t < rl, lo;
+
+        lo = t + (rm1 << 32);
+        c += lo < t;
+
+        *a = lo;
+        *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t wymix(uint64_t a, uint64_t b) {
+        wymum(&a, &b);
+        return a ^ b;
+}
+
+static inline uint64_t wyr8(const uint8_t *p) {
+        return unaligned_read_le64(p);
+}
+
+static inline uint64_t wyr4(const uint8_t *p) {
+        return unaligned_read_le32(p);
+}
+
+static inline uint64_t wyr3(const uint8_t *p, size_t k) {
+        return ((uint64_t) p[0] << 16) | ((uint64_t) p[k >> 1] << 8) | p[k - 1];
+}
+
+static inline uint64_t wyfinish(uint64_t a, uint64_t b, uint64_t seed, size_t len) {
+        a ^= wyhash_secret[1];
+        b ^= seed;
+        wymum(&a, &b);
+
+        return wymix(a ^ wyhash_secret[0] ^ len, b ^ wyhash_secret[1]);
+}
+
+uint64_t wyhash(const void *data, size_t len, uint64_t seed) {
+        const uint64_t *secret = wyhash_secret;
+        const uint8_t *p = ASSERT_PTR(data);
+        uint64_t a, b;
+
+        seed ^= wymix(seed ^ secret[0], secret[1]);
+
+        if (_likely_(len <= 16)) {
+                if (_likely_(len >= 4)) {
+                        a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+                        b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - ((len >> 3) << 2));
+                } else if (_likely_(len > 0)) {
+                        a = wyr3(p, len);
+                        b = 0;
+                } else
+                        a = b = 0;
+        } else {
+                size_t i = len;
+
+                if (_unlikely_(i > 48)) {
+                        uint64_t see1 = seed, see2 = seed;
+
+                        do {
+                                seed = wymix(wyr8(p) ^ secret[1], wyr8(p + 8) ^ seed);
+                                see1 = wymix(wyr8(p + 16) ^ secret[2], wyr8(p + 24) ^ see1);
+                                see2 = wymix(wyr8(p + 32) ^ secret[3], wyr8(p + 40) ^ see2);
+                                p += 48;
+                                i -= 48;
+                        } while (_likely_(i > 48));
+
+                        seed ^= see1 ^ see2;
+                }
+
+                while (_unlikely_(i > 16)) {
+                        seed = wymix(wyr8(p) ^ secret[1], wyr8(p + 8) ^ seed);
+                        i -= 16;
+                        p += 16;
+                }
+
+                a = wyr8(p + i - 16);
+                b = wyr8(p + i - 8);
+        }
+
+        return wyfinish(a, b, seed, len);
+}
+
+uint64_t wyhash64(uint64_t v, uint64_t seed) {
+        uint64_t lo = (uint32_t) v, hi = v >> 32;
+
+        seed ^= wymix(seed ^ wyhash_secret[0], wyhash_secret[1]);
+
+        return wyfinish((lo << 32) | hi, (hi << 32) | lo, seed, sizeof(v));
+}
@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "macro.h"
+
+/* wyhash (final version 4) by Wang Yi, see https://github.com/wangyi-fudan/wyhash. A fast keyed hash
+ * function for hash tables. Unlike SipHash it makes no claims about resisting an attacker who can pick
+ * keys and observe collisions, hence only use it where keys are not controlled by someone else. */
+
+uint64_t wyhash(const void *data, size_t len, uint64_t seed) _pure_;
+
+/* Same as wyhash() on the 8 bytes of a little-endian 64-bit integer, but without going through memory */
+uint64_t wyhash64(uint64_t v, uint64_t seed) _const_;
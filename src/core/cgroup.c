@@ -6,6 +6,7 @@
 
 #include "af-list.h"
 #include "alloc-util.h"
+#include "bitfield.h"
 #include "blockdev-util.h"
 #include "bpf-devices.h"
 #include "bpf-firewall.h"
@@ -112,10 +113,208 @@ bool unit_has_host_root_cgroup(Unit *u) {
         return unit_has_name(u, SPECIAL_ROOT_SLICE);
 }
 
+/* The attributes we write on cgroup v2 whose kernel defaults we know, in the form we write them in. A cgroup
+ * that was just created has all of them at their defaults, hence writing them there is redundant. Values
+ * other than these are remembered when written, see CGroupAttributeCache. */
+static const struct {
+        const char *attribute;
+        const char *value;
+} cgroup_attribute_defaults[] = {
+        { "cpu.idle",         "0"               },
+        { "cpu.weight",       "100\n"           },
+        { "cpu.max",          "max 100000\n"    },
+        { "io.weight",        "default 100\n"   },
+        { "io.bfq.weight",    "100\n"           },
+        { "memory.min",       "0\n"             },
+        { "memory.low",       "0\n"             },
+        { "memory.high",      "max\n"           },
+        { "memory.max",       "max\n"           },
+        { "memory.swap.max",  "max\n"           },
+        { "memory.zswap.max", "max\n"           },
+        { "memory.oom.group", "0"               },
+        { "pids.max",         "max\n"           },
+};
+
+assert_cc(ELEMENTSOF(cgroup_attribute_defaults) <= sizeof_field(CGroupAttributeCache, defaults) * 8);
+
+static ssize_t cgroup_attribute_default_index(const char *attribute) {
+        for (size_t i = 0; i < ELEMENTSOF(cgroup_attribute_defaults); i++)
+                if (streq(cgroup_attribute_defaults[i].attribute, attribute))
+                        return i;
+
+        return -1;
+}
+
+void cgroup_attribute_cache_forget(CGroupAttributeCache *c) {
+        assert(c);
+
+        /* Forgets the non-default values written. The kernel drops the attributes of a controller that is
+         * disabled, and starts over with the defaults when it is enabled again. */
+
+        c->applied = hashmap_free(c->applied);
+}
+
+void cgroup_attribute_cache_reset(CGroupAttributeCache *c, bool created) {
+        assert(c);
+
+        /* All attributes of a freshly created cgroup are at their defaults. For any other cgroup we don't
+         * know, hence we start with writing everything once. */
+
+        c->defaults = created ? (UINT32_C(1) << ELEMENTSOF(cgroup_attribute_defaults)) - 1 : 0;
+        cgroup_attribute_cache_forget(c);
+}
+
+bool cgroup_attribute_cache_is_applied(const CGroupAttributeCache *c, const char *attribute, const char *value) {
+        const char *v;
+        ssize_t i;
+
+        assert(c);
+        assert(attribute);
+        assert(value);
+
+        i = cgroup_attribute_default_index(attribute);
+        if (i >= 0 && BIT_SET(c->defaults, i))
+                return streq(value, cgroup_attribute_defaults[i].value);
+
+        v = hashmap_get(c->applied, attribute);
+        return v && streq(v, value);
+}
+
+int cgroup_attribute_cache_update(CGroupAttributeCache *c, const char *attribute, const char *value, bool applied) {
+        _cleanup_free_ char *a = NULL, *v = NULL;
+        bool is_default;
+        ssize_t i;
+        int r;
+
+        assert(c);
+        assert(attribute);
+        assert(value);
+
+        /* Records the outcome of writing an attribute. If the write failed we don't know what the kernel
+         * has now, hence the attribute will be written again next time. */
+
+        i = cgroup_attribute_default_index(attribute);
+        is_default = i >= 0 && streq(value, cgroup_attribute_defaults[i].value);
+
+        if (i >= 0)
+                SET_FLAG(c->defaults, INDEX_TO_MASK(uint32_t, i), applied && is_default);
+
+        free(hashmap_remove2(c->applied, attribute, (void**) &a));
+        a = mfree(a);
+
+        /* Defaults are covered by the bitmask already */
+        if (!applied || is_default)
+                return 0;
+
+        a = strdup(attribute);
+        v = strdup(value);
+        if (!a || !v)
+                return -ENOMEM;
+
+        r = hashmap_ensure_put(&c->applied, &string_hash_ops_free_free, a, v);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(a);
+        TAKE_PTR(v);
+        return 0;
+}
+
+static int unit_cgroup_apply_fd(Unit *u) {
+        _cleanup_free_ char *p = NULL;
+        Manager *m;
+        int r;
+
+        assert(u);
+        assert(u->manager);
+
+        m = u->manager;
+
+        /* Returns the fd of the cgroup directory if we are within cgroup_context_apply() of this unit. It is
+         * opened when the first attribute is actually written, and then used for all others. The fd is only
+         * kept for one apply: keeping one open per unit would pin as many fds as there are units with a
+         * cgroup. If opening fails we just write by path. */
+
+        if (m->cgroup_apply_unit != u)
+                return -EBADF;
+        if (m->cgroup_apply_fd != -EBADF)
+                return m->cgroup_apply_fd;
+
+        r = cg_get_path(SYSTEMD_CGROUP_CONTROLLER, u->cgroup_path, NULL, &p);
+        if (r < 0)
+                return (m->cgroup_apply_fd = r);
+
+        m->cgroup_apply_fd = RET_NERRNO(open(p, O_DIRECTORY|O_PATH|O_CLOEXEC));
+        if (m->cgroup_apply_fd < 0)
+                log_unit_debug_errno(u, m->cgroup_apply_fd, "Failed to open cgroup %s, writing attributes by path: %m",
+                                     empty_to_root(u->cgroup_path));
+
+        return m->cgroup_apply_fd;
+}
+
+static int unit_cgroup_set_attribute(Unit *u, const char *controller, const char *attribute, const char *value) {
+        CGroupAttributeStats *stats;
+        bool tracked;
+        usec_t t;
+        int r, fd;
+
+        assert(u);
+        assert(u->manager);
+        assert(attribute);
+        assert(value);
+
+        /* Writes a cgroup attribute of the unit, unless it is known to have that value already. We only keep
+         * track of that on cgroup v2, where each attribute belongs to exactly one cgroup of the unit. */
+
+        stats = &u->manager->cgroup_attribute_stats;
+        tracked = cg_all_unified() > 0;
+
+        if (tracked && cgroup_attribute_cache_is_applied(&u->cgroup_attribute_cache, attribute, value)) {
+                stats->n_skipped++;
+                return 0;
+        }
+
+        t = now(CLOCK_MONOTONIC);
+
+        fd = unit_cgroup_apply_fd(u);
+        if (fd >= 0)
+                r = cg_set_attribute_at(fd, attribute, value);
+        else
+                r = cg_set_attribute(controller, u->cgroup_path, attribute, value);
+
+        stats->n_written++;
+        stats->write_usec += usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        /* If we can't remember the value we'll just write it again next time */
+        if (tracked)
+                (void) cgroup_attribute_cache_update(&u->cgroup_attribute_cache, attribute, value, r >= 0);
+
+        return r;
+}
+
+static void unit_cgroup_apply_begin(Unit *u) {
+        assert(u);
+        assert(u->manager);
+        assert(!u->manager->cgroup_apply_unit);
+        assert(u->manager->cgroup_apply_fd == -EBADF);
+
+        /* Only on cgroup v2 all attributes live in the same directory */
+        if (cg_all_unified() > 0)
+                u->manager->cgroup_apply_unit = u;
+}
+
+static void unit_cgroup_apply_end(Unit *u) {
+        assert(u);
+        assert(u->manager);
+
+        u->manager->cgroup_apply_unit = NULL;
+        u->manager->cgroup_apply_fd = safe_close(u->manager->cgroup_apply_fd);
+}
+
 static int set_attribute_and_warn(Unit *u, const char *controller, const char *attribute, const char *value) {
         int r;
 
-        r = cg_set_attribute(controller, u->cgroup_path, attribute, value);
+        r = unit_cgroup_set_attribute(u, controller, attribute, value);
         if (r < 0)
                 log_unit_full_errno(u, LOG_LEVEL_CGROUP_WRITE(r), r, "Failed to set '%s' attribute on '%s' to '%.*s': %m",
                                     strna(attribute), empty_to_root(u->cgroup_path), (int) strcspn(value, NEWLINE), value);
@@ -1207,7 +1406,7 @@ static void cgroup_apply_unified_cpu_idle(Unit *u, uint64_t weight) {
 
         is_idle = weight == CGROUP_WEIGHT_IDLE;
         idle_val = one_zero(is_idle);
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.idle", idle_val);
+        r = unit_cgroup_set_attribute(u, "cpu", "cpu.idle", idle_val);
         if (r < 0 && (r != -ENOENT || is_idle))
                 log_unit_full_errno(u, LOG_LEVEL_CGROUP_WRITE(r), r, "Failed to set '%s' attribute on '%s' to '%s': %m",
                                     "cpu.idle", empty_to_root(u->cgroup_path), idle_val);
@@ -1343,7 +1542,7 @@ static int set_bfq_weight(Unit *u, const char *controller, dev_t dev, uint64_t i
         else
                 xsprintf(buf, "%" PRIu64 "\n", bfq_weight);
 
-        r = cg_set_attribute(controller, u->cgroup_path, p, buf);
+        r = unit_cgroup_set_attribute(u, controller, p, buf);
 
         /* FIXME: drop this when kernels prior
          * 795fe54c2a82 ("bfq: Add per-device weight") v5.4
@@ -1373,7 +1572,7 @@ static void cgroup_apply_io_device_weight(Unit *u, const char *dev_path, uint64_
         r1 = set_bfq_weight(u, "io", dev, io_weight);
 
         xsprintf(buf, DEVNUM_FORMAT_STR " %" PRIu64 "\n", DEVNUM_FORMAT_VAL(dev), io_weight);
-        r2 = cg_set_attribute("io", u->cgroup_path, "io.weight", buf);
+        r2 = unit_cgroup_set_attribute(u, "io", "io.weight", buf);
 
         /* Look at the configured device, when both fail, prefer io.weight errno. */
         r = r2 == -EOPNOTSUPP ? r1 : r2;
@@ -1663,6 +1862,8 @@ static void cgroup_context_apply(
         if (apply_mask == 0)
                 return;
 
+        unit_cgroup_apply_begin(u);
+
         /* Some cgroup attributes are not supported on the host root cgroup, hence silently ignore them here. And other
          * attributes should only be managed for cgroups further down the tree. */
         is_local_root = unit_has_name(u, SPECIAL_ROOT_SLICE);
@@ -1960,6 +2161,8 @@ static void cgroup_context_apply(
                 cgroup_apply_restrict_network_interfaces(u);
 
         unit_modify_nft_set(u, /* add = */ true);
+
+        unit_cgroup_apply_end(u);
 }
 
 static bool unit_get_needs_bpf_firewall(Unit *u) {
@@ -2494,6 +2697,12 @@ static int unit_update_cgroup(
                 return log_unit_error_errno(u, r, "Failed to create cgroup %s: %m", empty_to_root(u->cgroup_path));
         created = r;
 
+        /* Figure out what we know about the attributes of the cgroup */
+        if (created || !u->cgroup_realized)
+                cgroup_attribute_cache_reset(&u->cgroup_attribute_cache, created && cg_all_unified() > 0);
+        else if (u->cgroup_realized_mask != target_mask)
+                cgroup_attribute_cache_forget(&u->cgroup_attribute_cache);
+
         if (cg_unified_controller(SYSTEMD_CGROUP_CONTROLLER) > 0) {
                 uint64_t cgroup_id = 0;
 
@@ -2965,6 +3174,7 @@ static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
 }
 
 unsigned manager_dispatch_cgroup_realize_queue(Manager *m) {
+        CGroupAttributeStats stats;
         ManagerState state;
         unsigned n = 0;
         Unit *i;
@@ -2973,6 +3183,7 @@ unsigned manager_dispatch_cgroup_realize_queue(Manager *m) {
         assert(m);
 
         state = manager_state(m);
+        stats = m->cgroup_attribute_stats;
 
         while ((i = m->cgroup_realize_queue)) {
                 assert(i->in_cgroup_realize_queue);
@@ -2990,6 +3201,17 @@ unsigned manager_dispatch_cgroup_realize_queue(Manager *m) {
                 n++;
         }
 
+        if (n > 0) {
+                CGroupAttributeStats delta = {
+                        .n_written = m->cgroup_attribute_stats.n_written - stats.n_written,
+                        .n_skipped = m->cgroup_attribute_stats.n_skipped - stats.n_skipped,
+                        .write_usec = m->cgroup_attribute_stats.write_usec - stats.write_usec,
+                };
+
+                log_debug("Realized cgroups of %u queued units: %" PRIu64 " attributes written in %s, %" PRIu64 " already set.",
+                          n, delta.n_written, FORMAT_TIMESPAN(delta.write_usec, USEC_PER_MSEC), delta.n_skipped);
+        }
+
         return n;
 }
 
@@ -3080,6 +3302,9 @@ void unit_release_cgroup(Unit *u) {
                 u->cgroup_path = mfree(u->cgroup_path);
         }
 
+        cgroup_attribute_cache_reset(&u->cgroup_attribute_cache, /* created = */ false);
+        unit_flush_cgroup_stats(u);
+
         if (u->cgroup_control_inotify_wd >= 0) {
                 if (inotify_rm_watch(u->manager->cgroup_inotify_fd, u->cgroup_control_inotify_wd) < 0)
                         log_unit_debug_errno(u, errno, "Failed to remove cgroup control inotify watch %i for %s, ignoring: %m", u->cgroup_control_inotify_wd, u->id);
@@ -3131,6 +3356,7 @@ void unit_prune_cgroup(Unit *u) {
         if (!u->cgroup_path)
                 return;
 
+        unit_flush_cgroup_stats(u);
         (void) unit_get_cpu_usage(u, NULL); /* Cache the last CPU usage value before we destroy the cgroup */
 
 #if BPF_FRAMEWORK
@@ -3854,6 +4080,7 @@ void manager_shutdown_cgroup(Manager *m, bool delete) {
         m->cgroup_inotify_fd = safe_close(m->cgroup_inotify_fd);
 
         m->pin_cgroupfs_fd = safe_close(m->pin_cgroupfs_fd);
+        m->cgroup_apply_fd = safe_close(m->cgroup_apply_fd);
 
         m->cgroup_root = mfree(m->cgroup_root);
 }
@@ -3972,6 +4199,60 @@ int manager_notify_cgroup_empty(Manager *m, const char *cgroup) {
         return 1;
 }
 
+assert_cc(CGROUP_STATS_MEMORY_ACCOUNTING(CGROUP_MEMORY_PEAK) == CGROUP_STATS_MEMORY_PEAK);
+assert_cc(CGROUP_STATS_MEMORY_ACCOUNTING(CGROUP_MEMORY_SWAP_PEAK) == CGROUP_STATS_MEMORY_SWAP_PEAK);
+assert_cc(CGROUP_STATS_MEMORY_ACCOUNTING(CGROUP_MEMORY_SWAP_CURRENT) == CGROUP_STATS_MEMORY_SWAP_CURRENT);
+assert_cc(CGROUP_STATS_MEMORY_ACCOUNTING(CGROUP_MEMORY_ZSWAP_CURRENT) == CGROUP_STATS_MEMORY_ZSWAP_CURRENT);
+
+static CGroupStats* unit_cgroup_stats_lookup(Unit *u, CGroupStatsSource source) {
+        usec_t ts;
+
+        assert(u);
+        assert(source >= 0 && source < _CGROUP_STATS_SOURCE_MAX);
+
+        /* Returns the snapshot if the source was read recently enough to be served from it */
+
+        if (!u->cgroup_stats)
+                return NULL;
+
+        ts = u->cgroup_stats->timestamp[source];
+        if (ts == 0 || usec_sub_unsigned(now(CLOCK_MONOTONIC), ts) >= CGROUP_STATS_MAX_AGE_USEC)
+                return NULL;
+
+        return u->cgroup_stats;
+}
+
+static CGroupStats* unit_cgroup_stats_store(Unit *u, CGroupStatsSource source) {
+        assert(u);
+        assert(source >= 0 && source < _CGROUP_STATS_SOURCE_MAX);
+
+        /* Marks the source as read just now, and returns the snapshot to store the values in. If the
+         * snapshot can't be allocated, we just don't cache anything. */
+
+        if (!u->cgroup_stats) {
+                u->cgroup_stats = new0(CGroupStats, 1);
+                if (!u->cgroup_stats)
+                        return NULL;
+        }
+
+        u->cgroup_stats->timestamp[source] = now(CLOCK_MONOTONIC);
+        return u->cgroup_stats;
+}
+
+static void unit_cgroup_stats_invalidate(Unit *u, CGroupStatsSource source) {
+        assert(u);
+
+        if (u->cgroup_stats)
+                u->cgroup_stats->timestamp[source] = 0;
+}
+
+void unit_flush_cgroup_stats(Unit *u) {
+        assert(u);
+
+        /* Makes sure the next read of any accounting data goes to the kernel */
+        u->cgroup_stats = mfree(u->cgroup_stats);
+}
+
 int unit_get_memory_available(Unit *u, uint64_t *ret) {
         uint64_t available = UINT64_MAX, current = 0;
 
@@ -4016,6 +4297,8 @@ int unit_get_memory_available(Unit *u, uint64_t *ret) {
 }
 
 int unit_get_memory_current(Unit *u, uint64_t *ret) {
+        CGroupStats *s;
+        uint64_t v;
         int r;
 
         // FIXME: Merge this into unit_get_memory_accounting after support for cgroup v1 is dropped
@@ -4029,18 +4312,34 @@ int unit_get_memory_current(Unit *u, uint64_t *ret) {
         if (!u->cgroup_path)
                 return -ENODATA;
 
+        s = unit_cgroup_stats_lookup(u, CGROUP_STATS_MEMORY_CURRENT);
+        if (s) {
+                *ret = s->memory_current;
+                return 0;
+        }
+
         /* The root cgroup doesn't expose this information, let's get it from /proc instead */
         if (unit_has_host_root_cgroup(u))
-                return procfs_memory_get_used(ret);
+                r = procfs_memory_get_used(&v);
+        else {
+                if ((u->cgroup_realized_mask & CGROUP_MASK_MEMORY) == 0)
+                        return -ENODATA;
 
-        if ((u->cgroup_realized_mask & CGROUP_MASK_MEMORY) == 0)
-                return -ENODATA;
+                r = cg_all_unified();
+                if (r < 0)
+                        return r;
 
-        r = cg_all_unified();
+                r = cg_get_attribute_as_uint64("memory", u->cgroup_path, r > 0 ? "memory.current" : "memory.usage_in_bytes", &v);
+        }
         if (r < 0)
                 return r;
 
-        return cg_get_attribute_as_uint64("memory", u->cgroup_path, r > 0 ? "memory.current" : "memory.usage_in_bytes", ret);
+        s = unit_cgroup_stats_store(u, CGROUP_STATS_MEMORY_CURRENT);
+        if (s)
+                s->memory_current = v;
+
+        *ret = v;
+        return 0;
 }
 
 int unit_get_memory_accounting(Unit *u, CGroupMemoryAccountingMetric metric, uint64_t *ret) {
@@ -4052,6 +4351,7 @@ int unit_get_memory_accounting(Unit *u, CGroupMemoryAccountingMetric metric, uin
                 [CGROUP_MEMORY_ZSWAP_CURRENT] = "memory.zswap.current",
         };
 
+        CGroupStats *s;
         uint64_t bytes;
         bool updated = false;
         int r;
@@ -4074,6 +4374,13 @@ int unit_get_memory_accounting(Unit *u, CGroupMemoryAccountingMetric metric, uin
         if (!FLAGS_SET(u->cgroup_realized_mask, CGROUP_MASK_MEMORY))
                 return -ENODATA;
 
+        s = unit_cgroup_stats_lookup(u, CGROUP_STATS_MEMORY_ACCOUNTING(metric));
+        if (s) {
+                bytes = s->memory[metric];
+                updated = true;
+                goto finish;
+        }
+
         r = cg_all_unified();
         if (r < 0)
                 return r;
@@ -4085,6 +4392,12 @@ int unit_get_memory_accounting(Unit *u, CGroupMemoryAccountingMetric metric, uin
                 return r;
         updated = r >= 0;
 
+        if (updated) {
+                s = unit_cgroup_stats_store(u, CGROUP_STATS_MEMORY_ACCOUNTING(metric));
+                if (s)
+                        s->memory[metric] = bytes;
+        }
+
 finish:
         if (metric <= _CGROUP_MEMORY_ACCOUNTING_METRIC_CACHED_LAST) {
                 uint64_t *last = &u->memory_accounting_last[metric];
@@ -4106,6 +4419,10 @@ finish:
 }
 
 int unit_get_tasks_current(Unit *u, uint64_t *ret) {
+        CGroupStats *s;
+        uint64_t v;
+        int r;
+
         assert(u);
         assert(ret);
 
@@ -4115,14 +4432,30 @@ int unit_get_tasks_current(Unit *u, uint64_t *ret) {
         if (!u->cgroup_path)
                 return -ENODATA;
 
+        s = unit_cgroup_stats_lookup(u, CGROUP_STATS_TASKS_CURRENT);
+        if (s) {
+                *ret = s->tasks_current;
+                return 0;
+        }
+
         /* The root cgroup doesn't expose this information, let's get it from /proc instead */
         if (unit_has_host_root_cgroup(u))
-                return procfs_tasks_get_current(ret);
+                r = procfs_tasks_get_current(&v);
+        else {
+                if ((u->cgroup_realized_mask & CGROUP_MASK_PIDS) == 0)
+                        return -ENODATA;
 
-        if ((u->cgroup_realized_mask & CGROUP_MASK_PIDS) == 0)
-                return -ENODATA;
+                r = cg_get_attribute_as_uint64("pids", u->cgroup_path, "pids.current", &v);
+        }
+        if (r < 0)
+                return r;
 
-        return cg_get_attribute_as_uint64("pids", u->cgroup_path, "pids.current", ret);
+        s = unit_cgroup_stats_store(u, CGROUP_STATS_TASKS_CURRENT);
+        if (s)
+                s->tasks_current = v;
+
+        *ret = v;
+        return 0;
 }
 
 static int unit_get_cpu_usage_raw(Unit *u, nsec_t *ret) {
@@ -4168,6 +4501,30 @@ static int unit_get_cpu_usage_raw(Unit *u, nsec_t *ret) {
         return 0;
 }
 
+static int unit_get_cpu_usage_cached(Unit *u, nsec_t *ret) {
+        CGroupStats *s;
+        int r;
+
+        assert(u);
+        assert(ret);
+
+        s = unit_cgroup_stats_lookup(u, CGROUP_STATS_CPU_USAGE);
+        if (s) {
+                *ret = s->cpu_usage;
+                return 0;
+        }
+
+        r = unit_get_cpu_usage_raw(u, ret);
+        if (r < 0)
+                return r;
+
+        s = unit_cgroup_stats_store(u, CGROUP_STATS_CPU_USAGE);
+        if (s)
+                s->cpu_usage = *ret;
+
+        return 0;
+}
+
 int unit_get_cpu_usage(Unit *u, nsec_t *ret) {
         nsec_t ns;
         int r;
@@ -4181,7 +4538,7 @@ int unit_get_cpu_usage(Unit *u, nsec_t *ret) {
         if (!UNIT_CGROUP_BOOL(u, cpu_accounting))
                 return -ENODATA;
 
-        r = unit_get_cpu_usage_raw(u, &ns);
+        r = unit_get_cpu_usage_cached(u, &ns);
         if (r == -ENODATA && u->cpu_usage_last != NSEC_INFINITY) {
                 /* If we can't get the CPU usage anymore (because the cgroup was already removed, for example), use our
                  * cached value. */
@@ -4210,7 +4567,10 @@ int unit_get_ip_accounting(
                 CGroupIPAccountingMetric metric,
                 uint64_t *ret) {
 
-        uint64_t value;
+        uint64_t bytes, packets;
+        CGroupStatsSource source;
+        CGroupStats *s;
+        bool ingress;
         int fd, r;
 
         assert(u);
@@ -4221,29 +4581,40 @@ int unit_get_ip_accounting(
         if (!UNIT_CGROUP_BOOL(u, ip_accounting))
                 return -ENODATA;
 
-        fd = IN_SET(metric, CGROUP_IP_INGRESS_BYTES, CGROUP_IP_INGRESS_PACKETS) ?
-                u->ip_accounting_ingress_map_fd :
-                u->ip_accounting_egress_map_fd;
+        ingress = IN_SET(metric, CGROUP_IP_INGRESS_BYTES, CGROUP_IP_INGRESS_PACKETS);
+        fd = ingress ? u->ip_accounting_ingress_map_fd : u->ip_accounting_egress_map_fd;
         if (fd < 0)
                 return -ENODATA;
 
-        if (IN_SET(metric, CGROUP_IP_INGRESS_BYTES, CGROUP_IP_EGRESS_BYTES))
-                r = bpf_firewall_read_accounting(fd, &value, NULL);
-        else
-                r = bpf_firewall_read_accounting(fd, NULL, &value);
+        /* Each map has both the bytes and packets counter, hence read both and keep the other one around */
+        source = ingress ? CGROUP_STATS_IP_INGRESS : CGROUP_STATS_IP_EGRESS;
+        s = unit_cgroup_stats_lookup(u, source);
+        if (s) {
+                *ret = s->ip[metric] + u->ip_accounting_extra[metric];
+                return 0;
+        }
+
+        r = bpf_firewall_read_accounting(fd, &bytes, &packets);
         if (r < 0)
                 return r;
 
+        s = unit_cgroup_stats_store(u, source);
+        if (s) {
+                s->ip[ingress ? CGROUP_IP_INGRESS_BYTES : CGROUP_IP_EGRESS_BYTES] = bytes;
+                s->ip[ingress ? CGROUP_IP_INGRESS_PACKETS : CGROUP_IP_EGRESS_PACKETS] = packets;
+        }
+
         /* Add in additional metrics from a previous runtime. Note that when reexecing/reloading the daemon we compile
          * all BPF programs and maps anew, but serialize the old counters. When deserializing we store them in the
          * ip_accounting_extra[] field, and add them in here transparently. */
 
-        *ret = value + u->ip_accounting_extra[metric];
+        *ret = (IN_SET(metric, CGROUP_IP_INGRESS_BYTES, CGROUP_IP_EGRESS_BYTES) ? bytes : packets) +
+                u->ip_accounting_extra[metric];
 
-        return r;
+        return 0;
 }
 
-static int unit_get_io_accounting_raw(Unit *u, uint64_t ret[static _CGROUP_IO_ACCOUNTING_METRIC_MAX]) {
+int cgroup_io_stat_parse(char *contents, uint64_t ret[static _CGROUP_IO_ACCOUNTING_METRIC_MAX]) {
         static const char *const field_names[_CGROUP_IO_ACCOUNTING_METRIC_MAX] = {
                 [CGROUP_IO_READ_BYTES]       = "rbytes=",
                 [CGROUP_IO_WRITE_BYTES]      = "wbytes=",
@@ -4251,58 +4622,35 @@ static int unit_get_io_accounting_raw(Unit *u, uint64_t ret[static _CGROUP_IO_AC
                 [CGROUP_IO_WRITE_OPERATIONS] = "wios=",
         };
         uint64_t acc[_CGROUP_IO_ACCOUNTING_METRIC_MAX] = {};
-        _cleanup_free_ char *path = NULL;
-        _cleanup_fclose_ FILE *f = NULL;
         int r;
 
-        assert(u);
-
-        if (!u->cgroup_path)
-                return -ENODATA;
-
-        if (unit_has_host_root_cgroup(u))
-                return -ENODATA; /* TODO: return useful data for the top-level cgroup */
-
-        r = cg_all_unified();
-        if (r < 0)
-                return r;
-        if (r == 0) /* TODO: support cgroupv1 */
-                return -ENODATA;
-
-        if (!FLAGS_SET(u->cgroup_realized_mask, CGROUP_MASK_IO))
-                return -ENODATA;
+        assert(contents);
+        assert(ret);
 
-        r = cg_get_path("io", u->cgroup_path, "io.stat", &path);
-        if (r < 0)
-                return r;
+        /* Sums up the counters of all devices listed in the contents of an io.stat file, which is split up
+         * in place. Fields we don't know and fields missing for a device are ignored. */
 
-        f = fopen(path, "re");
-        if (!f)
-                return -errno;
+        for (char *p = contents; *p;) {
+                char *line = p;
 
-        for (;;) {
-                _cleanup_free_ char *line = NULL;
-                const char *p;
+                p += strcspn(p, NEWLINE);
+                if (*p)
+                        *(p++) = 0;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
-                if (r < 0)
-                        return r;
-                if (r == 0)
-                        break;
-
-                p = line;
-                p += strcspn(p, WHITESPACE); /* Skip over device major/minor */
-                p += strspn(p, WHITESPACE);  /* Skip over following whitespace */
+                line += strcspn(line, WHITESPACE); /* Skip over device major/minor */
 
                 for (;;) {
-                        _cleanup_free_ char *word = NULL;
+                        char *word;
 
-                        r = extract_first_word(&p, &word, NULL, EXTRACT_RETAIN_ESCAPE);
-                        if (r < 0)
-                                return r;
-                        if (r == 0)
+                        line += strspn(line, WHITESPACE);
+                        if (!*line)
                                 break;
 
+                        word = line;
+                        line += strcspn(line, WHITESPACE);
+                        if (*line)
+                                *(line++) = 0;
+
                         for (CGroupIOAccountingMetric i = 0; i < _CGROUP_IO_ACCOUNTING_METRIC_MAX; i++) {
                                 const char *x;
 
@@ -4314,7 +4662,6 @@ static int unit_get_io_accounting_raw(Unit *u, uint64_t ret[static _CGROUP_IO_AC
                                         if (r < 0)
                                                 return r;
 
-                                        /* Sum up the stats of all devices */
                                         acc[i] += w;
                                         break;
                                 }
@@ -4326,6 +4673,62 @@ static int unit_get_io_accounting_raw(Unit *u, uint64_t ret[static _CGROUP_IO_AC
         return 0;
 }
 
+static int unit_get_io_accounting_raw(Unit *u, uint64_t ret[static _CGROUP_IO_ACCOUNTING_METRIC_MAX]) {
+        _cleanup_free_ char *path = NULL, *contents = NULL;
+        int r;
+
+        assert(u);
+
+        if (!u->cgroup_path)
+                return -ENODATA;
+
+        if (unit_has_host_root_cgroup(u))
+                return -ENODATA; /* TODO: return useful data for the top-level cgroup */
+
+        r = cg_all_unified();
+        if (r < 0)
+                return r;
+        if (r == 0) /* TODO: support cgroupv1 */
+                return -ENODATA;
+
+        if (!FLAGS_SET(u->cgroup_realized_mask, CGROUP_MASK_IO))
+                return -ENODATA;
+
+        r = cg_get_path("io", u->cgroup_path, "io.stat", &path);
+        if (r < 0)
+                return r;
+
+        /* Read the whole file with a single read(), and split it up in place */
+        r = read_full_virtual_file(path, &contents, NULL);
+        if (r < 0)
+                return r;
+
+        return cgroup_io_stat_parse(contents, ret);
+}
+
+static int unit_get_io_accounting_cached(Unit *u, uint64_t ret[static _CGROUP_IO_ACCOUNTING_METRIC_MAX]) {
+        CGroupStats *s;
+        int r;
+
+        assert(u);
+
+        s = unit_cgroup_stats_lookup(u, CGROUP_STATS_IO);
+        if (s) {
+                memcpy(ret, s->io, sizeof(s->io));
+                return 0;
+        }
+
+        r = unit_get_io_accounting_raw(u, ret);
+        if (r < 0)
+                return r;
+
+        s = unit_cgroup_stats_store(u, CGROUP_STATS_IO);
+        if (s)
+                memcpy(s->io, ret, sizeof(s->io));
+
+        return 0;
+}
+
 int unit_get_io_accounting(
                 Unit *u,
                 CGroupIOAccountingMetric metric,
@@ -4343,7 +4746,7 @@ int unit_get_io_accounting(
         if (allow_cache && u->io_accounting_last[metric] != UINT64_MAX)
                 goto done;
 
-        r = unit_get_io_accounting_raw(u, raw);
+        r = unit_get_io_accounting_cached(u, raw);
         if (r == -ENODATA && u->io_accounting_last[metric] != UINT64_MAX)
                 goto done;
         if (r < 0)
@@ -4370,6 +4773,7 @@ int unit_reset_cpu_accounting(Unit *u) {
         assert(u);
 
         u->cpu_usage_last = NSEC_INFINITY;
+        unit_cgroup_stats_invalidate(u, CGROUP_STATS_CPU_USAGE);
 
         r = unit_get_cpu_usage_raw(u, &u->cpu_usage_base);
         if (r < 0) {
@@ -4385,6 +4789,9 @@ void unit_reset_memory_accounting_last(Unit *u) {
 
         FOREACH_ARRAY(i, u->memory_accounting_last, ELEMENTSOF(u->memory_accounting_last))
                 *i = UINT64_MAX;
+
+        for (CGroupMemoryAccountingMetric metric = 0; metric < _CGROUP_MEMORY_ACCOUNTING_METRIC_MAX; metric++)
+                unit_cgroup_stats_invalidate(u, CGROUP_STATS_MEMORY_ACCOUNTING(metric));
 }
 
 int unit_reset_ip_accounting(Unit *u) {
@@ -4399,6 +4806,8 @@ int unit_reset_ip_accounting(Unit *u) {
                 RET_GATHER(r, bpf_firewall_reset_accounting(u->ip_accounting_egress_map_fd));
 
         zero(u->ip_accounting_extra);
+        unit_cgroup_stats_invalidate(u, CGROUP_STATS_IP_INGRESS);
+        unit_cgroup_stats_invalidate(u, CGROUP_STATS_IP_EGRESS);
 
         return r;
 }
@@ -4408,6 +4817,8 @@ void unit_reset_io_accounting_last(Unit *u) {
 
         FOREACH_ARRAY(i, u->io_accounting_last, _CGROUP_IO_ACCOUNTING_METRIC_MAX)
                 *i = UINT64_MAX;
+
+        unit_cgroup_stats_invalidate(u, CGROUP_STATS_IO);
 }
 
 int unit_reset_io_accounting(Unit *u) {
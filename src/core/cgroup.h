@@ -276,6 +276,55 @@ typedef enum CGroupMemoryAccountingMetric {
         _CGROUP_MEMORY_ACCOUNTING_METRIC_INVALID = -EINVAL,
 } CGroupMemoryAccountingMetric;
 
+/* How many cgroup attributes were written, how long that took, and how many weren't as they were known to
+ * be set already */
+typedef struct CGroupAttributeStats {
+        uint64_t n_written;
+        uint64_t n_skipped;
+        usec_t write_usec;
+} CGroupAttributeStats;
+
+/* What we know about the cgroup attributes of a unit we write (only maintained on cgroup v2) */
+typedef struct CGroupAttributeCache {
+        uint32_t defaults;            /* Which attributes with known kernel default are at it */
+        Hashmap *applied;             /* attribute → value last written, for all other values */
+} CGroupAttributeCache;
+
+/* The sources of the accounting data of a unit, each of which is read in one go */
+typedef enum CGroupStatsSource {
+        CGROUP_STATS_MEMORY_CURRENT,
+        CGROUP_STATS_MEMORY_PEAK,             /* The memory sources are ordered like CGroupMemoryAccountingMetric */
+        CGROUP_STATS_MEMORY_SWAP_PEAK,
+        CGROUP_STATS_MEMORY_SWAP_CURRENT,
+        CGROUP_STATS_MEMORY_ZSWAP_CURRENT,
+        CGROUP_STATS_TASKS_CURRENT,
+        CGROUP_STATS_CPU_USAGE,
+        CGROUP_STATS_IO,
+        CGROUP_STATS_IP_INGRESS,
+        CGROUP_STATS_IP_EGRESS,
+        _CGROUP_STATS_SOURCE_MAX,
+        _CGROUP_STATS_SOURCE_INVALID = -EINVAL,
+} CGroupStatsSource;
+
+#define CGROUP_STATS_MEMORY_ACCOUNTING(metric) (CGROUP_STATS_MEMORY_PEAK + (metric))
+
+/* How long a value read from a cgroup attribute or BPF map is served from the snapshot before it is read
+ * again. This bounds the cost of clients querying many properties of many units, e.g. via GetAll() or
+ * monitoring scrapes. */
+#define CGROUP_STATS_MAX_AGE_USEC (500 * USEC_PER_MSEC)
+
+/* The raw values as last read from the kernel, i.e. before subtracting the values at the time the unit was
+ * started. Allocated only for units whose accounting data is actually looked at. */
+typedef struct CGroupStats {
+        usec_t timestamp[_CGROUP_STATS_SOURCE_MAX]; /* CLOCK_MONOTONIC, 0 if not read (successfully) yet */
+        uint64_t memory_current;
+        uint64_t memory[_CGROUP_MEMORY_ACCOUNTING_METRIC_MAX];
+        uint64_t tasks_current;
+        nsec_t cpu_usage;
+        uint64_t io[_CGROUP_IO_ACCOUNTING_METRIC_MAX];
+        uint64_t ip[_CGROUP_IP_ACCOUNTING_METRIC_MAX];
+} CGroupStats;
+
 typedef struct Unit Unit;
 typedef struct Manager Manager;
 typedef enum ManagerState ManagerState;
@@ -352,6 +401,11 @@ void manager_shutdown_cgroup(Manager *m, bool delete);
 
 unsigned manager_dispatch_cgroup_realize_queue(Manager *m);
 
+void cgroup_attribute_cache_forget(CGroupAttributeCache *c);
+void cgroup_attribute_cache_reset(CGroupAttributeCache *c, bool created);
+bool cgroup_attribute_cache_is_applied(const CGroupAttributeCache *c, const char *attribute, const char *value);
+int cgroup_attribute_cache_update(CGroupAttributeCache *c, const char *attribute, const char *value, bool applied);
+
 Unit *manager_get_unit_by_cgroup(Manager *m, const char *cgroup);
 Unit *manager_get_unit_by_pidref_cgroup(Manager *m, PidRef *pid);
 Unit *manager_get_unit_by_pidref_watching(Manager *m, PidRef *pid);
@@ -373,6 +427,7 @@ int unit_get_memory_accounting(Unit *u, CGroupMemoryAccountingMetric metric, uin
 int unit_get_tasks_current(Unit *u, uint64_t *ret);
 int unit_get_cpu_usage(Unit *u, nsec_t *ret);
 int unit_get_io_accounting(Unit *u, CGroupIOAccountingMetric metric, bool allow_cache, uint64_t *ret);
+int cgroup_io_stat_parse(char *contents, uint64_t ret[static _CGROUP_IO_ACCOUNTING_METRIC_MAX]);
 int unit_get_ip_accounting(Unit *u, CGroupIPAccountingMetric metric, uint64_t *ret);
 
 int unit_reset_cpu_accounting(Unit *u);
@@ -381,6 +436,7 @@ int unit_reset_ip_accounting(Unit *u);
 void unit_reset_io_accounting_last(Unit *u);
 int unit_reset_io_accounting(Unit *u);
 int unit_reset_accounting(Unit *u);
+void unit_flush_cgroup_stats(Unit *u);
 
 #define UNIT_CGROUP_BOOL(u, name)                       \
         ({                                              \
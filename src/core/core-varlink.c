@@ -1,12 +1,20 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include <fnmatch.h>
+
+#include "bus-util.h"
 #include "core-varlink.h"
+#include "dbus.h"
+#include "errno-util.h"
 #include "mkdir-label.h"
+#include "selinux-access.h"
+#include "service.h"
 #include "strv.h"
 #include "user-util.h"
 #include "varlink.h"
 #include "varlink-io.systemd.UserDatabase.h"
 #include "varlink-io.systemd.ManagedOOM.h"
+#include "varlink-io.systemd.Manager.h"
 
 typedef struct LookupParameters {
         const char *user_name;
@@ -18,6 +26,29 @@ typedef struct LookupParameters {
         const char *service;
 } LookupParameters;
 
+typedef struct UnitsPropertiesParameters {
+        char **patterns;
+        char **properties;
+} UnitsPropertiesParameters;
+
+typedef struct UnitMetricsParameters {
+        char **patterns;
+        int accounting;
+} UnitMetricsParameters;
+
+static void units_properties_parameters_done(UnitsPropertiesParameters *p) {
+        assert(p);
+
+        p->patterns = strv_free(p->patterns);
+        p->properties = strv_free(p->properties);
+}
+
+static void unit_metrics_parameters_done(UnitMetricsParameters *p) {
+        assert(p);
+
+        p->patterns = strv_free(p->patterns);
+}
+
 static const char* const managed_oom_mode_properties[] = {
         "ManagedOOMSwap",
         "ManagedOOMMemoryPressure",
@@ -481,6 +512,475 @@ static int vl_method_get_memberships(Varlink *link, JsonVariant *parameters, Var
         return varlink_error(link, "io.systemd.UserDatabase.NoRecordFound", NULL);
 }
 
+static int vl_unit_access_check(Varlink *link, Unit *u) {
+        int r;
+
+        assert(link);
+        assert(u);
+
+        /* The io.systemd.Manager methods return data about all units matching the patterns, hence leave out
+         * the units the caller may not look at, just like GetUnitsProperties() on the bus does. Returns > 0 if
+         * the unit shall be included, 0 if not. */
+
+        r = mac_selinux_unit_access_check_varlink(u, link, "status");
+        if (ERRNO_IS_NEG_PRIVILEGE(r))
+                return 0;
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
+static int build_unit_properties_json(sd_bus *bus, Unit *u, char **properties, JsonVariant **ret) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        int r;
+
+        assert(bus);
+        assert(u);
+        assert(ret);
+
+        /* Let the D-Bus property getters do the work, so that both interfaces expose the very same data,
+         * and convert the result. The message is never sent anywhere. */
+
+        r = sd_bus_message_new(bus, &m, SD_BUS_MESSAGE_METHOD_RETURN);
+        if (r < 0)
+                return r;
+
+        r = bus_unit_append_properties(bus, m, u, properties, &error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_seal(m, 1, 0);
+        if (r < 0)
+                return r;
+
+        r = bus_message_read_json(m, &v);
+        if (r < 0)
+                return r;
+
+        return json_build(ret, JSON_BUILD_OBJECT(
+                                 JSON_BUILD_PAIR("name", JSON_BUILD_STRING(u->id)),
+                                 JSON_BUILD_PAIR("properties", JSON_BUILD_VARIANT(v))));
+}
+
+static int vl_method_get_units_properties(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+
+        static const JsonDispatch dispatch_table[] = {
+                /* Both are nullable, which json_dispatch_strv() takes care of */
+                { "patterns",   _JSON_VARIANT_TYPE_INVALID, json_dispatch_strv, offsetof(UnitsPropertiesParameters, patterns),   0 },
+                { "properties", _JSON_VARIANT_TYPE_INVALID, json_dispatch_strv, offsetof(UnitsPropertiesParameters, properties), 0 },
+                {}
+        };
+
+        _cleanup_(units_properties_parameters_done) UnitsPropertiesParameters p = {};
+        _cleanup_(json_variant_unrefp) JsonVariant *array = NULL;
+        Manager *m = ASSERT_PTR(userdata);
+        sd_bus *bus;
+        const char *k;
+        Unit *u;
+        int r;
+
+        assert(parameters);
+
+        r = varlink_dispatch(link, parameters, dispatch_table, &p);
+        if (r != 0)
+                return r;
+
+        r = mac_selinux_access_check_varlink(link, "status");
+        if (r < 0)
+                return varlink_error(link, VARLINK_ERROR_PERMISSION_DENIED, NULL);
+
+        /* The property getters need some bus to allocate the message on they write into. Any connected
+         * one will do, since nothing is actually sent. */
+        bus = m->api_bus ?: m->system_bus;
+        if (!bus)
+                return varlink_error(link, "io.systemd.Manager.BusNotAvailable", NULL);
+
+        r = json_build(&array, JSON_BUILD_EMPTY_ARRAY);
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH_KEY(u, k, m->units) {
+                _cleanup_(json_variant_unrefp) JsonVariant *e = NULL;
+
+                if (k != u->id)
+                        continue;
+
+                if (!strv_fnmatch_or_empty(p.patterns, u->id, FNM_NOESCAPE))
+                        continue;
+
+                r = vl_unit_access_check(link, u);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        continue;
+
+                r = build_unit_properties_json(bus, u, p.properties, &e);
+                if (r < 0)
+                        return r;
+
+                r = json_variant_append_array(&array, e);
+                if (r < 0)
+                        return r;
+        }
+
+        return varlink_replyb(link, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("units", JSON_BUILD_VARIANT(array))));
+}
+
+static int build_unit_accounting_json(Unit *u, JsonVariant **ret) {
+        uint64_t memory_current, memory_available, tasks_current,
+                memory[_CGROUP_MEMORY_ACCOUNTING_METRIC_MAX],
+                io[_CGROUP_IO_ACCOUNTING_METRIC_MAX],
+                ip[_CGROUP_IP_ACCOUNTING_METRIC_MAX];
+        nsec_t cpu_usage;
+
+        assert(u);
+        assert(ret);
+
+        /* Counters that aren't available are set to UINT64_MAX and left out, like the D-Bus properties
+         * report them. Reading them is cheap when they were recently read already, see CGroupStats. */
+
+        if (unit_get_memory_current(u, &memory_current) < 0)
+                memory_current = UINT64_MAX;
+        if (unit_get_memory_available(u, &memory_available) < 0)
+                memory_available = UINT64_MAX;
+        for (CGroupMemoryAccountingMetric metric = 0; metric < _CGROUP_MEMORY_ACCOUNTING_METRIC_MAX; metric++)
+                if (unit_get_memory_accounting(u, metric, &memory[metric]) < 0)
+                        memory[metric] = UINT64_MAX;
+        if (unit_get_tasks_current(u, &tasks_current) < 0)
+                tasks_current = UINT64_MAX;
+        if (unit_get_cpu_usage(u, &cpu_usage) < 0)
+                cpu_usage = NSEC_INFINITY;
+        for (CGroupIOAccountingMetric metric = 0; metric < _CGROUP_IO_ACCOUNTING_METRIC_MAX; metric++)
+                if (unit_get_io_accounting(u, metric, /* allow_cache= */ false, &io[metric]) < 0)
+                        io[metric] = UINT64_MAX;
+        for (CGroupIPAccountingMetric metric = 0; metric < _CGROUP_IP_ACCOUNTING_METRIC_MAX; metric++)
+                if (unit_get_ip_accounting(u, metric, &ip[metric]) < 0)
+                        ip[metric] = UINT64_MAX;
+
+#define ACCOUNTING_PAIR(name, v) JSON_BUILD_PAIR_CONDITION((v) != UINT64_MAX, name, JSON_BUILD_UNSIGNED(v))
+
+        return json_build(ret, JSON_BUILD_OBJECT(
+                                 JSON_BUILD_PAIR_STRING("name", u->id),
+                                 ACCOUNTING_PAIR("memoryCurrent", memory_current),
+                                 ACCOUNTING_PAIR("memoryAvailable", memory_available),
+                                 ACCOUNTING_PAIR("memoryPeak", memory[CGROUP_MEMORY_PEAK]),
+                                 ACCOUNTING_PAIR("memorySwapCurrent", memory[CGROUP_MEMORY_SWAP_CURRENT]),
+                                 ACCOUNTING_PAIR("memorySwapPeak", memory[CGROUP_MEMORY_SWAP_PEAK]),
+                                 ACCOUNTING_PAIR("memoryZSwapCurrent", memory[CGROUP_MEMORY_ZSWAP_CURRENT]),
+                                 ACCOUNTING_PAIR("tasksCurrent", tasks_current),
+                                 ACCOUNTING_PAIR("cpuUsageNSec", cpu_usage),
+                                 ACCOUNTING_PAIR("ioReadBytes", io[CGROUP_IO_READ_BYTES]),
+                                 ACCOUNTING_PAIR("ioWriteBytes", io[CGROUP_IO_WRITE_BYTES]),
+                                 ACCOUNTING_PAIR("ioReadOperations", io[CGROUP_IO_READ_OPERATIONS]),
+                                 ACCOUNTING_PAIR("ioWriteOperations", io[CGROUP_IO_WRITE_OPERATIONS]),
+                                 ACCOUNTING_PAIR("ipIngressBytes", ip[CGROUP_IP_INGRESS_BYTES]),
+                                 ACCOUNTING_PAIR("ipIngressPackets", ip[CGROUP_IP_INGRESS_PACKETS]),
+                                 ACCOUNTING_PAIR("ipEgressBytes", ip[CGROUP_IP_EGRESS_BYTES]),
+                                 ACCOUNTING_PAIR("ipEgressPackets", ip[CGROUP_IP_EGRESS_PACKETS])));
+
+#undef ACCOUNTING_PAIR
+}
+
+static int vl_method_get_units_accounting(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+
+        static const JsonDispatch dispatch_table[] = {
+                { "patterns", _JSON_VARIANT_TYPE_INVALID, json_dispatch_strv, offsetof(UnitsPropertiesParameters, patterns), 0 },
+                {}
+        };
+
+        _cleanup_(units_properties_parameters_done) UnitsPropertiesParameters p = {};
+        _cleanup_(json_variant_unrefp) JsonVariant *array = NULL;
+        Manager *m = ASSERT_PTR(userdata);
+        const char *k;
+        Unit *u;
+        int r;
+
+        assert(parameters);
+
+        r = varlink_dispatch(link, parameters, dispatch_table, &p);
+        if (r != 0)
+                return r;
+
+        r = mac_selinux_access_check_varlink(link, "status");
+        if (r < 0)
+                return varlink_error(link, VARLINK_ERROR_PERMISSION_DENIED, NULL);
+
+        r = json_build(&array, JSON_BUILD_EMPTY_ARRAY);
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH_KEY(u, k, m->units) {
+                _cleanup_(json_variant_unrefp) JsonVariant *e = NULL;
+
+                if (k != u->id)
+                        continue;
+
+                if (!UNIT_HAS_CGROUP_CONTEXT(u))
+                        continue;
+
+                if (!strv_fnmatch_or_empty(p.patterns, u->id, FNM_NOESCAPE))
+                        continue;
+
+                r = vl_unit_access_check(link, u);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        continue;
+
+                r = build_unit_accounting_json(u, &e);
+                if (r < 0)
+                        return r;
+
+                r = json_variant_append_array(&array, e);
+                if (r < 0)
+                        return r;
+        }
+
+        return varlink_replyb(link, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("units", JSON_BUILD_VARIANT(array))));
+}
+
+static int build_job_metrics_json(Job *j, usec_t ts, JsonVariant **ret) {
+        usec_t running = USEC_INFINITY, waiting = 0;
+
+        assert(j);
+        assert(ret);
+
+        if (j->begin_running_usec > 0) {
+                waiting = usec_sub_unsigned(j->begin_running_usec, j->begin_usec);
+                running = usec_sub_unsigned(ts, j->begin_running_usec);
+        } else if (j->begin_usec > 0)
+                waiting = usec_sub_unsigned(ts, j->begin_usec);
+
+        return json_build(ret, JSON_BUILD_OBJECT(
+                                 JSON_BUILD_PAIR_UNSIGNED("id", j->id),
+                                 JSON_BUILD_PAIR_STRING("type", job_type_to_string(j->type)),
+                                 JSON_BUILD_PAIR_STRING("state", job_state_to_string(j->state)),
+                                 JSON_BUILD_PAIR_UNSIGNED("waitingUSec", waiting),
+                                 JSON_BUILD_PAIR_CONDITION(running != USEC_INFINITY, "runningUSec", JSON_BUILD_UNSIGNED(running))));
+}
+
+static int build_unit_metrics_json(Unit *u, bool accounting, usec_t ts, JsonVariant **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *job = NULL, *acc = NULL;
+        usec_t activation = USEC_INFINITY;
+        int r;
+
+        assert(u);
+        assert(ret);
+
+        if (u->job) {
+                r = build_job_metrics_json(u->job, ts, &job);
+                if (r < 0)
+                        return r;
+        }
+
+        if (accounting && UNIT_HAS_CGROUP_CONTEXT(u)) {
+                r = build_unit_accounting_json(u, &acc);
+                if (r < 0)
+                        return r;
+        }
+
+        /* If the unit is activating again, the timestamp of entering the active state is the previous one */
+        if (timestamp_is_set(u->inactive_exit_timestamp.monotonic) &&
+            u->active_enter_timestamp.monotonic >= u->inactive_exit_timestamp.monotonic)
+                activation = u->active_enter_timestamp.monotonic - u->inactive_exit_timestamp.monotonic;
+
+        return json_build(ret, JSON_BUILD_OBJECT(
+                                 JSON_BUILD_PAIR_STRING("name", u->id),
+                                 JSON_BUILD_PAIR_STRING("loadState", unit_load_state_to_string(u->load_state)),
+                                 JSON_BUILD_PAIR_STRING("activeState", unit_active_state_to_string(unit_active_state(u))),
+                                 JSON_BUILD_PAIR_STRING("subState", unit_sub_state_to_string(u)),
+                                 JSON_BUILD_PAIR_CONDITION(u->type == UNIT_SERVICE, "nRestarts",
+                                                           JSON_BUILD_UNSIGNED(u->type == UNIT_SERVICE ? SERVICE(u)->n_restarts : 0)),
+                                 JSON_BUILD_PAIR_CONDITION(activation != USEC_INFINITY, "activationUSec", JSON_BUILD_UNSIGNED(activation)),
+                                 JSON_BUILD_PAIR_CONDITION(!!job, "job", JSON_BUILD_VARIANT(job)),
+                                 JSON_BUILD_PAIR_CONDITION(!!acc, "accounting", JSON_BUILD_VARIANT(acc))));
+}
+
+/* How many units ListUnitMetrics() reports on before it waits for the client to read the replies, so that
+ * the memory a single call pins in the output buffer stays bounded regardless of the number of units */
+#define UNIT_METRICS_BATCH 256U
+
+typedef struct UnitMetricsListing {
+        Varlink *link;
+        char **units;           /* The units matched by the call, in the order we report on them */
+        size_t n_units;
+        size_t cursor;          /* The next unit to report on */
+        bool accounting;
+        JsonVariant *previous;  /* The reply built last, sent once we know if it's the final one */
+} UnitMetricsListing;
+
+static UnitMetricsListing* unit_metrics_listing_free(UnitMetricsListing *l) {
+        if (!l)
+                return NULL;
+
+        varlink_unref(l->link);
+        strv_free(l->units);
+        json_variant_unref(l->previous);
+
+        return mfree(l);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(UnitMetricsListing*, unit_metrics_listing_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(
+                unit_metrics_listing_hash_ops,
+                void, trivial_hash_func, trivial_compare_func,
+                UnitMetricsListing, unit_metrics_listing_free);
+
+static int unit_metrics_listing_send(Manager *m, UnitMetricsListing *l) {
+        usec_t ts, ts_realtime;
+        unsigned n = 0;
+        int r;
+
+        assert(m);
+        assert(l);
+
+        /* Reports on the next batch of units. Returns > 0 if there are more to report on, 0 once the final
+         * reply has been queued. */
+
+        ts = now(CLOCK_MONOTONIC);
+        ts_realtime = now(CLOCK_REALTIME);
+
+        for (; l->cursor < l->n_units && n < UNIT_METRICS_BATCH; l->cursor++) {
+                _cleanup_(json_variant_unrefp) JsonVariant *e = NULL;
+                Unit *u;
+
+                /* Units that went away in the meantime are left out */
+                u = manager_get_unit(m, l->units[l->cursor]);
+                if (!u)
+                        continue;
+
+                r = build_unit_metrics_json(u, l->accounting, ts, &e);
+                if (r < 0)
+                        return r;
+
+                if (l->previous) {
+                        r = varlink_notifyb(l->link, JSON_BUILD_OBJECT(
+                                                    JSON_BUILD_PAIR_UNSIGNED("timestamp", ts_realtime),
+                                                    JSON_BUILD_PAIR("unit", JSON_BUILD_VARIANT(l->previous))));
+                        if (r < 0)
+                                return r;
+
+                        n++;
+                }
+
+                JSON_VARIANT_REPLACE(l->previous, TAKE_PTR(e));
+        }
+
+        if (l->cursor < l->n_units)
+                return 1;
+
+        r = varlink_replyb(l->link, JSON_BUILD_OBJECT(
+                                   JSON_BUILD_PAIR_UNSIGNED("timestamp", ts_realtime),
+                                   JSON_BUILD_PAIR_CONDITION(!!l->previous, "unit", JSON_BUILD_VARIANT(l->previous))));
+        if (r < 0)
+                return r;
+
+        return 0;
+}
+
+static int vl_unit_metrics_drained(Varlink *link, void *userdata) {
+        Manager *m = ASSERT_PTR(userdata);
+        UnitMetricsListing *l;
+        int r;
+
+        assert(link);
+
+        l = hashmap_get(m->varlink_unit_metrics, link);
+        if (!l)
+                return 0;
+
+        r = unit_metrics_listing_send(m, l);
+        if (r > 0) {
+                r = varlink_bind_drained(link, vl_unit_metrics_drained);
+                if (r >= 0)
+                        return 0;
+        }
+        if (r < 0)
+                (void) varlink_error_errno(link, r);
+
+        unit_metrics_listing_free(hashmap_remove(m->varlink_unit_metrics, link));
+        return r;
+}
+
+static int vl_method_list_unit_metrics(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+
+        static const JsonDispatch dispatch_table[] = {
+                /* Both are nullable, which the callbacks take care of */
+                { "patterns",   _JSON_VARIANT_TYPE_INVALID, json_dispatch_strv,     offsetof(UnitMetricsParameters, patterns),   0 },
+                { "accounting", _JSON_VARIANT_TYPE_INVALID, json_dispatch_tristate, offsetof(UnitMetricsParameters, accounting), 0 },
+                {}
+        };
+
+        _cleanup_(unit_metrics_parameters_done) UnitMetricsParameters p = {
+                .accounting = -1,
+        };
+        _cleanup_(unit_metrics_listing_freep) UnitMetricsListing *l = NULL;
+        Manager *m = ASSERT_PTR(userdata);
+        const char *k;
+        Unit *u;
+        int r;
+
+        assert(parameters);
+
+        r = varlink_dispatch(link, parameters, dispatch_table, &p);
+        if (r != 0)
+                return r;
+
+        r = mac_selinux_access_check_varlink(link, "status");
+        if (r < 0)
+                return varlink_error(link, VARLINK_ERROR_PERMISSION_DENIED, NULL);
+
+        if (!FLAGS_SET(flags, VARLINK_METHOD_MORE))
+                return varlink_error(link, VARLINK_ERROR_EXPECTED_MORE, NULL);
+
+        l = new(UnitMetricsListing, 1);
+        if (!l)
+                return -ENOMEM;
+
+        *l = (UnitMetricsListing) {
+                .link = varlink_ref(link),
+                .accounting = p.accounting != 0,
+        };
+
+        /* Only the names of the matching units are collected here. The replies are generated in batches, the
+         * next one only once the client read the previous one, so that the output buffer doesn't grow with
+         * the number of units. The cgroup counters are served from the per-unit snapshot if they were read
+         * recently, so that scrapes in quick succession don't read them again. */
+
+        HASHMAP_FOREACH_KEY(u, k, m->units) {
+                if (k != u->id)
+                        continue;
+
+                if (!strv_fnmatch_or_empty(p.patterns, u->id, FNM_NOESCAPE))
+                        continue;
+
+                r = vl_unit_access_check(link, u);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        continue;
+
+                r = strv_extend_with_size(&l->units, &l->n_units, u->id);
+                if (r < 0)
+                        return r;
+        }
+
+        r = unit_metrics_listing_send(m, l);
+        if (r <= 0)
+                return r;
+
+        r = hashmap_ensure_put(&m->varlink_unit_metrics, &unit_metrics_listing_hash_ops, link, l);
+        if (r < 0)
+                return r;
+        TAKE_PTR(l);
+
+        return varlink_bind_drained(link, vl_unit_metrics_drained);
+}
+
 static void vl_disconnect(VarlinkServer *s, Varlink *link, void *userdata) {
         Manager *m = ASSERT_PTR(userdata);
 
@@ -489,6 +989,8 @@ static void vl_disconnect(VarlinkServer *s, Varlink *link, void *userdata) {
 
         if (link == m->managed_oom_varlink)
                 m->managed_oom_varlink = varlink_unref(link);
+
+        unit_metrics_listing_free(hashmap_remove(m->varlink_unit_metrics, link));
 }
 
 static int manager_varlink_init_system(Manager *m) {
@@ -510,7 +1012,10 @@ static int manager_varlink_init_system(Manager *m) {
         if (!MANAGER_IS_TEST_RUN(m)) {
                 (void) mkdir_p_label("/run/systemd/userdb", 0755);
 
-                FOREACH_STRING(address, "/run/systemd/userdb/io.systemd.DynamicUser", VARLINK_ADDR_PATH_MANAGED_OOM_SYSTEM) {
+                FOREACH_STRING(address,
+                               "/run/systemd/userdb/io.systemd.DynamicUser",
+                               VARLINK_ADDR_PATH_MANAGED_OOM_SYSTEM,
+                               "/run/systemd/io.systemd.Manager") {
                         if (MANAGER_IS_RELOADING(m)) {
                                 /* If manager is reloading, we skip listening on existing addresses, since
                                  * the fd should be acquired later through deserialization. */
@@ -613,7 +1118,8 @@ int manager_setup_varlink_server(Manager *m, VarlinkServer **ret) {
         r = varlink_server_add_interface_many(
                         s,
                         &vl_interface_io_systemd_UserDatabase,
-                        &vl_interface_io_systemd_ManagedOOM);
+                        &vl_interface_io_systemd_ManagedOOM,
+                        &vl_interface_io_systemd_Manager);
         if (r < 0)
                 return log_error_errno(r, "Failed to add interfaces to varlink server: %m");
 
@@ -622,7 +1128,10 @@ int manager_setup_varlink_server(Manager *m, VarlinkServer **ret) {
                         "io.systemd.UserDatabase.GetUserRecord",  vl_method_get_user_record,
                         "io.systemd.UserDatabase.GetGroupRecord", vl_method_get_group_record,
                         "io.systemd.UserDatabase.GetMemberships", vl_method_get_memberships,
-                        "io.systemd.ManagedOOM.SubscribeManagedOOMCGroups",  vl_method_subscribe_managed_oom_cgroups);
+                        "io.systemd.ManagedOOM.SubscribeManagedOOMCGroups",  vl_method_subscribe_managed_oom_cgroups,
+                        "io.systemd.Manager.GetUnitsProperties", vl_method_get_units_properties,
+                        "io.systemd.Manager.GetUnitsAccounting", vl_method_get_units_accounting,
+                        "io.systemd.Manager.ListUnitMetrics", vl_method_list_unit_metrics);
         if (r < 0)
                 return log_debug_errno(r, "Failed to register varlink methods: %m");
 
@@ -649,4 +1158,5 @@ void manager_varlink_done(Manager *m) {
 
         m->varlink_server = varlink_server_unref(m->varlink_server);
         m->managed_oom_varlink = varlink_close_unref(m->managed_oom_varlink);
+        m->varlink_unit_metrics = hashmap_free(m->varlink_unit_metrics);
 }
@@ -150,9 +150,8 @@ static int property_get_dependencies(
                 sd_bus_error *error) {
 
         Unit *u = userdata, *other;
+        UnitDependencySet *deps;
         UnitDependency d;
-        Hashmap *deps;
-        void *v;
         int r;
 
         assert(bus);
@@ -168,7 +167,7 @@ static int property_get_dependencies(
         if (r < 0)
                 return r;
 
-        HASHMAP_FOREACH_KEY(v, other, deps) {
+        UNIT_DEPENDENCY_SET_FOREACH(other, deps) {
                 r = sd_bus_message_append(reply, "s", other->id);
                 if (r < 0)
                         return r;
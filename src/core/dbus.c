@@ -10,6 +10,7 @@
 #include "bus-common-errors.h"
 #include "bus-error.h"
 #include "bus-internal.h"
+#include "bus-objects.h"
 #include "bus-polkit.h"
 #include "bus-util.h"
 #include "dbus-automount.h"
@@ -608,6 +609,131 @@ int bus_manager_introspect_implementations(FILE *out, const char *pattern) {
                                             &manager_log_control_object));
 }
 
+static const BusObjectImplementation* const unit_type_objects[_UNIT_TYPE_MAX] = {
+        [UNIT_SERVICE]   = &bus_service_object,
+        [UNIT_MOUNT]     = &bus_mount_object,
+        [UNIT_SWAP]      = &bus_swap_object,
+        [UNIT_SOCKET]    = &bus_socket_object,
+        [UNIT_TARGET]    = &bus_target_object,
+        [UNIT_DEVICE]    = &bus_device_object,
+        [UNIT_AUTOMOUNT] = &bus_automount_object,
+        [UNIT_TIMER]     = &bus_timer_object,
+        [UNIT_PATH]      = &bus_path_object,
+        [UNIT_SLICE]     = &bus_slice_object,
+        [UNIT_SCOPE]     = &bus_scope_object,
+};
+
+static void* unit_vtable_object(Unit *u, const sd_bus_vtable *vtable) {
+        assert(u);
+        assert(vtable);
+
+        /* Returns the object the property getters of the specified vtable expect as userdata, i.e. the same
+         * thing the matching find callback above would return for this unit. */
+
+        if (vtable == bus_cgroup_vtable)
+                return unit_get_cgroup_context(u);
+        if (vtable == bus_exec_vtable)
+                return unit_get_exec_context(u);
+        if (vtable == bus_kill_vtable)
+                return unit_get_kill_context(u);
+        if (vtable == bus_unit_cgroup_vtable && !UNIT_HAS_CGROUP_CONTEXT(u))
+                return NULL;
+
+        return u;
+}
+
+static int unit_append_vtable_properties(
+                sd_bus *bus,
+                sd_bus_message *reply,
+                const char *path,
+                const char *interface,
+                const sd_bus_vtable *vtable,
+                void *userdata,
+                char * const *properties,
+                sd_bus_error *error) {
+
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(path);
+        assert(interface);
+        assert(vtable);
+
+        if (FLAGS_SET(vtable[0].flags, SD_BUS_VTABLE_HIDDEN))
+                return 0;
+
+        if (FLAGS_SET(vtable[0].flags, SD_BUS_VTABLE_SENSITIVE)) {
+                r = sd_bus_message_sensitive(reply);
+                if (r < 0)
+                        return r;
+        }
+
+        for (const sd_bus_vtable *v = bus_vtable_next(vtable, vtable); v->type != _SD_BUS_VTABLE_END; v = bus_vtable_next(vtable, v)) {
+                if (!IN_SET(v->type, _SD_BUS_VTABLE_PROPERTY, _SD_BUS_VTABLE_WRITABLE_PROPERTY))
+                        continue;
+
+                /* Like GetAll(), skip hidden and explicit-only properties, unless they are asked for by name */
+                if (strv_isempty(properties)) {
+                        if (v->flags & (SD_BUS_VTABLE_HIDDEN|SD_BUS_VTABLE_PROPERTY_EXPLICIT))
+                                continue;
+                } else if (!strv_contains(properties, v->x.property.member))
+                        continue;
+
+                r = bus_vtable_append_property(bus, reply, path, interface, v, userdata, error);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+int bus_unit_append_properties(sd_bus *bus, sd_bus_message *reply, Unit *u, char * const *properties, sd_bus_error *error) {
+        const BusObjectImplementation *type_object;
+        _cleanup_free_ char *path = NULL;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(u);
+
+        /* Appends an "a{sv}" array with the requested properties of the unit, from all interfaces the unit
+         * object implements. This calls the very same getters Get() and GetAll() would, but without going
+         * through the object tree, so that many units can be covered by a single message. If no properties
+         * are specified, all of them are returned. Unknown property names are silently ignored. */
+
+        path = unit_dbus_path(u);
+        if (!path)
+                return -ENOMEM;
+
+        r = sd_bus_message_open_container(reply, 'a', "{sv}");
+        if (r < 0)
+                return r;
+
+        for (const BusObjectVtablePair *i = unit_object.fallback_vtables; i->vtable; i++) {
+                r = unit_append_vtable_properties(bus, reply, path, unit_object.interface, i->vtable, u, properties, error);
+                if (r < 0)
+                        return r;
+        }
+
+        type_object = unit_type_objects[u->type];
+        assert(type_object);
+
+        for (const BusObjectVtablePair *i = type_object->fallback_vtables; i->vtable; i++) {
+                void *userdata;
+
+                userdata = unit_vtable_object(u, i->vtable);
+                if (!userdata)
+                        continue;
+
+                r = unit_append_vtable_properties(bus, reply, path, type_object->interface, i->vtable, userdata, properties, error);
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_bus_message_close_container(reply);
+}
+
 static int bus_setup_api_vtables(Manager *m, sd_bus *bus) {
         int r;
 
@@ -31,6 +31,8 @@ int bus_verify_bypass_dump_ratelimit_async(Manager *m, sd_bus_message *call, sd_
 
 int bus_forward_agent_released(Manager *m, const char *path);
 
+int bus_unit_append_properties(sd_bus *bus, sd_bus_message *reply, Unit *u, char * const *properties, sd_bus_error *error);
+
 uint64_t manager_bus_n_queued_write(Manager *m);
 
 void dump_bus_properties(FILE *f);
@@ -4197,7 +4197,7 @@ int exec_invoke(
         /* Journald will try to look-up our cgroup in order to populate _SYSTEMD_CGROUP and _SYSTEMD_UNIT fields.
          * Hence we need to migrate to the target cgroup from init.scope before connecting to journald */
         if (params->cgroup_path) {
-                _cleanup_free_ char *p = NULL;
+                _cleanup_free_ char *p = NULL, *current = NULL;
 
                 r = exec_params_get_cgroup_path(params, cgroup_context, &p);
                 if (r < 0) {
@@ -4205,7 +4205,13 @@ int exec_invoke(
                         return log_exec_error_errno(context, params, r, "Failed to acquire cgroup path: %m");
                 }
 
-                r = cg_attach_everywhere(params->cgroup_supported, p, 0, NULL, NULL);
+                /* If we were spawned right into the cgroup, don't take the cgroup locks for nothing */
+                if (cg_all_unified() > 0 &&
+                    cg_pid_get_path(SYSTEMD_CGROUP_CONTROLLER, 0, &current) >= 0 &&
+                    path_equal(current, p))
+                        r = 0;
+                else
+                        r = cg_attach_everywhere(params->cgroup_supported, p, 0, NULL, NULL);
                 if (r == -EUCLEAN) {
                         *exit_status = EXIT_CGROUP;
                         return log_exec_error_errno(context, params, r, "Failed to attach process to cgroup %s "
@@ -33,6 +33,7 @@
 #include "exec-credential.h"
 #include "execute.h"
 #include "execute-serialize.h"
+#include "executor-pool.h"
 #include "exit-status.h"
 #include "fd-util.h"
 #include "fileio.h"
@@ -351,19 +352,64 @@ static void log_command_line(Unit *unit, const char *msg, const char *executable
 
 static int exec_context_load_environment(const Unit *unit, const ExecContext *c, char ***l);
 
+static int exec_spawn_executor(Unit *unit, FILE *f, FDSet *fdset, const char *cgroup, PidRef *ret_pidref) {
+        char serialization_fd_number[DECIMAL_STR_MAX(int) + 1];
+        _cleanup_free_ char *log_level = NULL, *executor_path = NULL;
+        int r;
+
+        assert(unit);
+        assert(f);
+        assert(fdset);
+        assert(ret_pidref);
+
+        r = fd_cloexec(fileno(f), false);
+        if (r < 0)
+                return log_unit_error_errno(unit, r, "Failed to set O_CLOEXEC on serialization fd: %m");
+
+        r = fdset_cloexec(fdset, false);
+        if (r < 0)
+                return log_unit_error_errno(unit, r, "Failed to set O_CLOEXEC on serialized fds: %m");
+
+        r = log_level_to_string_alloc(log_get_max_level(), &log_level);
+        if (r < 0)
+                return log_unit_error_errno(unit, r, "Failed to convert log level to string: %m");
+
+        r = fd_get_path(unit->manager->executor_fd, &executor_path);
+        if (r < 0)
+                return log_unit_error_errno(unit, r, "Failed to get executor path from fd: %m");
+
+        xsprintf(serialization_fd_number, "%i", fileno(f));
+
+        /* The executor binary is pinned, to avoid compatibility problems during upgrades. Returns > 0 if the
+         * executor was spawned directly into the cgroup. */
+        r = posix_spawn_wrapper(
+                        FORMAT_PROC_FD_PATH(unit->manager->executor_fd),
+                        STRV_MAKE(executor_path,
+                                  "--deserialize", serialization_fd_number,
+                                  "--log-level", log_level,
+                                  "--log-target", log_target_to_string(manager_get_executor_log_target(unit->manager))),
+                        environ,
+                        cgroup,
+                        ret_pidref);
+        if (r < 0)
+                return log_unit_error_errno(unit, r, "Failed to spawn executor: %m");
+
+        return r;
+}
+
 int exec_spawn(Unit *unit,
                ExecCommand *command,
                const ExecContext *context,
                ExecParameters *params,
                ExecRuntime *runtime,
                const CGroupContext *cgroup_context,
-               pid_t *ret) {
+               PidRef *ret) {
 
-        char serialization_fd_number[DECIMAL_STR_MAX(int) + 1];
-        _cleanup_free_ char *subcgroup_path = NULL, *log_level = NULL, *executor_path = NULL;
+        _cleanup_(pidref_done) PidRef pidref = PIDREF_NULL;
+        _cleanup_free_ char *subcgroup_path = NULL;
         _cleanup_fdset_free_ FDSet *fdset = NULL;
         _cleanup_fclose_ FILE *f = NULL;
-        pid_t pid;
+        bool in_cgroup = false;
         int r;
 
         assert(unit);
@@ -404,8 +450,8 @@ int exec_spawn(Unit *unit,
          * child's memory.max, serialize all the state needed to start the unit, and pass it to the
          * systemd-executor binary. clone() with CLONE_VM + CLONE_VFORK will pause the parent until the exec
          * and ensure all memory is shared. The child immediately execs the new binary so the delay should
-         * be minimal. Once glibc provides a clone3 wrapper we can switch to that, and clone directly in the
-         * target cgroup. */
+         * be minimal. If the C library supports it, this is done via clone3(), directly in the target
+         * cgroup. */
 
         r = open_serialization_file("sd-executor-state", &f);
         if (r < 0)
@@ -422,47 +468,29 @@ int exec_spawn(Unit *unit,
         if (fseeko(f, 0, SEEK_SET) < 0)
                 return log_unit_error_errno(unit, errno, "Failed to reseek on serialization stream: %m");
 
-        r = fd_cloexec(fileno(f), false);
-        if (r < 0)
-                return log_unit_error_errno(unit, r, "Failed to set O_CLOEXEC on serialization fd: %m");
-
-        r = fdset_cloexec(fdset, false);
-        if (r < 0)
-                return log_unit_error_errno(unit, r, "Failed to set O_CLOEXEC on serialized fds: %m");
-
-        r = log_level_to_string_alloc(log_get_max_level(), &log_level);
-        if (r < 0)
-                return log_unit_error_errno(unit, r, "Failed to convert log level to string: %m");
-
-        r = fd_get_path(unit->manager->executor_fd, &executor_path);
-        if (r < 0)
-                return log_unit_error_errno(unit, r, "Failed to get executor path from fd: %m");
-
-        xsprintf(serialization_fd_number, "%i", fileno(f));
-
-        /* The executor binary is pinned, to avoid compatibility problems during upgrades. */
-        r = posix_spawn_wrapper(
-                        FORMAT_PROC_FD_PATH(unit->manager->executor_fd),
-                        STRV_MAKE(executor_path,
-                                  "--deserialize", serialization_fd_number,
-                                  "--log-level", log_level,
-                                  "--log-target", log_target_to_string(manager_get_executor_log_target(unit->manager))),
-                        environ,
-                        &pid);
-        if (r < 0)
-                return log_unit_error_errno(unit, r, "Failed to spawn executor: %m");
+        /* Hand the serialization over to an idle executor if the pool has one, and spawn one otherwise */
+        r = executor_pool_take(unit->manager, f, fdset, &pidref);
+        if (r > 0)
+                log_unit_debug(unit, "Passed %s to idle executor "PID_FMT, command->path, pidref.pid);
+        else {
+                r = exec_spawn_executor(unit, f, fdset, subcgroup_path, &pidref);
+                if (r < 0)
+                        return r;
 
-        log_unit_debug(unit, "Forked %s as "PID_FMT, command->path, pid);
+                in_cgroup = r > 0;
+                log_unit_debug(unit, "Forked %s as "PID_FMT"%s",
+                               command->path, pidref.pid, in_cgroup ? " in its cgroup" : "");
+        }
 
-        /* We add the new process to the cgroup both in the child (so that we can be sure that no user code is ever
-         * executed outside of the cgroup) and in the parent (so that we can be sure that when we kill the cgroup the
-         * process will be killed too). */
-        if (subcgroup_path)
-                (void) cg_attach(SYSTEMD_CGROUP_CONTROLLER, subcgroup_path, pid);
+        /* Unless the new process was born in the cgroup, we add it to the cgroup both in the child (so that we
+         * can be sure that no user code is ever executed outside of the cgroup) and in the parent (so that we
+         * can be sure that when we kill the cgroup the process will be killed too). */
+        if (subcgroup_path && !in_cgroup)
+                (void) cg_attach(SYSTEMD_CGROUP_CONTROLLER, subcgroup_path, pidref.pid);
 
-        exec_status_start(&command->exec_status, pid);
+        exec_status_start(&command->exec_status, pidref.pid);
 
-        *ret = pid;
+        *ret = TAKE_PIDREF(pidref);
         return 0;
 }
 
@@ -0,0 +1,292 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "env-util.h"
+#include "executor-pool.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "format-util.h"
+#include "iovec-util.h"
+#include "log.h"
+#include "manager.h"
+#include "parse-util.h"
+#include "process-util.h"
+#include "socket-util.h"
+#include "stdio-util.h"
+#include "strv.h"
+#include "syslog-util.h"
+
+/* Spawning systemd-executor costs a fork, an exec and the dynamic linking of the executor, for every single
+ * process we start. With the executor pool enabled, a number of executors is spawned ahead of time while the
+ * manager is idle, and each of them waits on a socket for the serialization of the process it shall turn
+ * into. */
+
+unsigned executor_pool_size_from_env(void) {
+        const char *e;
+        unsigned n;
+        int r;
+
+        e = secure_getenv("SYSTEMD_EXECUTOR_POOL_SIZE");
+        if (!e)
+                return 0;
+
+        r = safe_atou(e, &n);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to parse $SYSTEMD_EXECUTOR_POOL_SIZE, ignoring: %s", e);
+                return 0;
+        }
+
+        return MIN(n, EXECUTOR_POOL_SIZE_MAX);
+}
+
+static int executor_pool_spawn_one(Manager *m) {
+        char fd_number[DECIMAL_STR_MAX(int) + 1];
+        _cleanup_free_ char *log_level = NULL, *executor_path = NULL;
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR;
+        _cleanup_(pidref_done) PidRef pidref = PIDREF_NULL;
+        int r;
+
+        assert(m);
+        assert(m->executor_fd >= 0);
+
+        if (!GREEDY_REALLOC(m->executor_pool, m->n_executor_pool + 1))
+                return -ENOMEM;
+
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, pair) < 0)
+                return -errno;
+
+        r = fd_cloexec(pair[1], false);
+        if (r < 0)
+                return r;
+
+        /* The log settings only matter until the executor gets its work, it is told the current ones then */
+        r = log_level_to_string_alloc(log_get_max_level(), &log_level);
+        if (r < 0)
+                return r;
+
+        r = fd_get_path(m->executor_fd, &executor_path);
+        if (r < 0)
+                return r;
+
+        xsprintf(fd_number, "%i", pair[1]);
+
+        r = posix_spawn_wrapper(
+                        FORMAT_PROC_FD_PATH(m->executor_fd),
+                        STRV_MAKE(executor_path,
+                                  "--pool", fd_number,
+                                  "--log-level", log_level,
+                                  "--log-target", log_target_to_string(manager_get_executor_log_target(m))),
+                        environ,
+                        /* cgroup= */ NULL,
+                        &pidref);
+        if (r < 0)
+                return r;
+
+        log_debug("Spawned idle executor as "PID_FMT".", pidref.pid);
+
+        m->executor_pool[m->n_executor_pool++] = (ExecutorPoolEntry) {
+                .pidref = TAKE_PIDREF(pidref),
+                .fd = TAKE_FD(pair[0]),
+        };
+
+        return 0;
+}
+
+static int executor_pool_dispatch_refill(sd_event_source *source, void *userdata) {
+        Manager *m = ASSERT_PTR(userdata);
+        int r;
+
+        assert(source);
+
+        /* Spawn one executor per event loop iteration, so that refilling never delays other work */
+
+        if (m->n_executor_pool < m->executor_pool_size) {
+                r = executor_pool_spawn_one(m);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to spawn idle executor, not refilling executor pool for now: %m");
+                else if (m->n_executor_pool < m->executor_pool_size)
+                        return 0;
+        }
+
+        return sd_event_source_set_enabled(source, SD_EVENT_OFF);
+}
+
+static int executor_pool_schedule_refill(Manager *m) {
+        int r;
+
+        assert(m);
+
+        if (m->n_executor_pool >= m->executor_pool_size)
+                return 0;
+
+        if (!m->executor_pool_event_source) {
+                r = sd_event_add_defer(m->event, &m->executor_pool_event_source, executor_pool_dispatch_refill, m);
+                if (r < 0)
+                        return r;
+
+                r = sd_event_source_set_priority(m->executor_pool_event_source, SD_EVENT_PRIORITY_IDLE);
+                if (r < 0)
+                        return r;
+
+                (void) sd_event_source_set_description(m->executor_pool_event_source, "manager-executor-pool");
+        }
+
+        return sd_event_source_set_enabled(m->executor_pool_event_source, SD_EVENT_ON);
+}
+
+int executor_pool_take(Manager *m, FILE *serialization, FDSet *fds, PidRef *ret_pidref) {
+        int fds_array[EXECUTOR_POOL_FDS_MAX + 1];
+        ExecutorPoolMessage message;
+        size_t n_fds = 0;
+        int fd, r = 0;
+
+        assert(m);
+        assert(serialization);
+        assert(fds);
+        assert(ret_pidref);
+
+        /* Passes the serialization and the fds it references on to an idle executor, if there is one.
+         * Returns > 0 if so, 0 if the caller needs to spawn an executor itself. */
+
+        if (m->executor_pool_size == 0)
+                return 0;
+
+        if (fdset_size(fds) > EXECUTOR_POOL_FDS_MAX) {
+                log_debug("Too many fds to pass to an idle executor, spawning one.");
+                return 0;
+        }
+
+        message = (ExecutorPoolMessage) {
+                .log_level = log_get_max_level(),
+                .log_target = manager_get_executor_log_target(m),
+        };
+
+        fds_array[n_fds++] = fileno(serialization);
+        FDSET_FOREACH(fd, fds) {
+                message.fds[n_fds - 1] = fd;
+                fds_array[n_fds++] = fd;
+        }
+
+        while (m->n_executor_pool > 0) {
+                ExecutorPoolEntry e = m->executor_pool[--m->n_executor_pool];
+                ssize_t k;
+
+                k = send_many_fds_iov(
+                                e.fd,
+                                fds_array, n_fds,
+                                &IOVEC_MAKE(&message, offsetof(ExecutorPoolMessage, fds) + (n_fds - 1) * sizeof(int)), 1,
+                                MSG_DONTWAIT);
+                safe_close(e.fd);
+                if (k >= 0) {
+                        *ret_pidref = TAKE_PIDREF(e.pidref);
+                        r = 1;
+                        break;
+                }
+
+                /* If the executor died in the meantime, the SIGCHLD handler collects its remains */
+                log_debug_errno(k, "Failed to pass serialization to idle executor "PID_FMT", ignoring: %m", e.pidref.pid);
+                pidref_done(&e.pidref);
+        }
+
+        (void) executor_pool_schedule_refill(m);
+
+        return r;
+}
+
+void executor_pool_flush(Manager *m) {
+        assert(m);
+
+        /* Idle executors exit once they notice that the other end of their socket is gone */
+        FOREACH_ARRAY(e, m->executor_pool, m->n_executor_pool) {
+                safe_close(e->fd);
+                pidref_done(&e->pidref);
+        }
+
+        m->executor_pool = mfree(m->executor_pool);
+        m->n_executor_pool = 0;
+
+        m->executor_pool_event_source = sd_event_source_disable_unref(m->executor_pool_event_source);
+}
+
+int executor_pool_receive(int fd, FILE **ret_serialization) {
+        _cleanup_close_ int socket_fd = fd;
+        ExecutorPoolMessage message = {};
+        int *fds = NULL;
+        size_t n_fds = 0;
+        int max_fd = STDERR_FILENO;
+        ssize_t k;
+        FILE *f;
+
+        assert(fd >= 0);
+        assert(ret_serialization);
+
+        /* Waits for the manager to pass on a serialization, and moves the fds referenced by it to the numbers
+         * the serialization knows them by. Takes possession of the socket fd. Returns 0 if the manager closed
+         * the socket instead, > 0 otherwise. */
+
+        k = receive_many_fds_iov(socket_fd, &IOVEC_MAKE(&message, sizeof(message)), 1, &fds, &n_fds, /* flags= */ 0);
+        if (k == -EIO)
+                return 0;
+        if (k < 0)
+                return k;
+
+        CLEANUP_ARRAY(fds, n_fds, close_many_and_free);
+
+        if ((size_t) k < offsetof(ExecutorPoolMessage, fds) ||
+            (k - offsetof(ExecutorPoolMessage, fds)) % sizeof(int) != 0 ||
+            n_fds != (k - offsetof(ExecutorPoolMessage, fds)) / sizeof(int) + 1)
+                return -EBADMSG;
+
+        if (message.log_level < 0 || message.log_level > LOG_DEBUG ||
+            message.log_target < 0 || message.log_target >= _LOG_TARGET_MAX)
+                return -EBADMSG;
+
+        for (size_t i = 0; i < n_fds - 1; i++) {
+                if (message.fds[i] <= STDERR_FILENO)
+                        return -EBADMSG;
+
+                max_fd = MAX(max_fd, message.fds[i]);
+        }
+
+        /* The log fds are the only other fds we have open at this point, and they might occupy the numbers the
+         * fds need to end up at, hence close them until everything is in place. Then move all fds we got
+         * above the highest number needed, so that none of them is in the way either. */
+        log_close();
+        socket_fd = safe_close(socket_fd);
+
+        for (size_t i = 0; i < n_fds; i++) {
+                int copy;
+
+                if (fds[i] > max_fd)
+                        continue;
+
+                copy = fcntl(fds[i], F_DUPFD_CLOEXEC, max_fd + 1);
+                if (copy < 0)
+                        return -errno;
+
+                safe_close(fds[i]);
+                fds[i] = copy;
+        }
+
+        /* The fds end up without O_CLOEXEC, just like they do when inherited from the manager */
+        for (size_t i = 1; i < n_fds; i++) {
+                if (dup2(fds[i], message.fds[i - 1]) < 0)
+                        return -errno;
+
+                fds[i] = safe_close(fds[i]);
+        }
+
+        log_set_max_level(message.log_level);
+        log_set_target(message.log_target);
+
+        f = take_fdopen(&fds[0], "r");
+        if (!f)
+                return -errno;
+
+        *ret_serialization = f;
+        return 1;
+}
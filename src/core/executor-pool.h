@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "fdset.h"
+#include "pidref.h"
+
+typedef struct Manager Manager;
+
+/* The maximum number of fds the kernel passes in one message (SCM_MAX_FD), one of which is the serialization
+ * fd itself. */
+#define EXECUTOR_POOL_FDS_MAX 252U
+
+/* The upper bound for $SYSTEMD_EXECUTOR_POOL_SIZE */
+#define EXECUTOR_POOL_SIZE_MAX 64U
+
+/* The payload of the message an idle executor receives, along with the serialization fd and the fds
+ * referenced by it. As the serialization refers to the latter by number, the numbers they had in the
+ * manager are passed too, so that they can be moved into place before deserializing. */
+typedef struct ExecutorPoolMessage {
+        int log_level;
+        int log_target;
+        int fds[EXECUTOR_POOL_FDS_MAX];
+} ExecutorPoolMessage;
+
+typedef struct ExecutorPoolEntry {
+        PidRef pidref;
+        int fd;
+} ExecutorPoolEntry;
+
+unsigned executor_pool_size_from_env(void);
+
+int executor_pool_take(Manager *m, FILE *serialization, FDSet *fds, PidRef *ret_pidref);
+void executor_pool_flush(Manager *m);
+
+int executor_pool_receive(int fd, FILE **ret_serialization);
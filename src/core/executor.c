@@ -11,6 +11,7 @@
 #include "exec-invoke.h"
 #include "execute-serialize.h"
 #include "execute.h"
+#include "executor-pool.h"
 #include "exit-status.h"
 #include "fdset.h"
 #include "fd-util.h"
@@ -23,8 +24,10 @@
 #include "static-destruct.h"
 
 static FILE *arg_serialization = NULL;
+static int arg_pool_fd = -EBADF;
 
 STATIC_DESTRUCTOR_REGISTER(arg_serialization, fclosep);
+STATIC_DESTRUCTOR_REGISTER(arg_pool_fd, closep);
 
 static int help(void) {
         _cleanup_free_ char *link = NULL;
@@ -48,6 +51,7 @@ static int help(void) {
                "     --log-location=BOOL   Include code location in messages\n"
                "     --log-time=BOOL       Prefix messages with current time\n"
                "     --deserialize=FD      Deserialize process config from FD\n"
+               "     --pool=FD             Receive process config over socket FD\n"
                "\nSee the %s for details.\n",
                program_invocation_short_name,
                ansi_highlight(),
@@ -62,6 +66,7 @@ static int parse_argv(int argc, char *argv[]) {
                 COMMON_GETOPT_ARGS,
                 ARG_VERSION,
                 ARG_DESERIALIZE,
+                ARG_POOL,
         };
 
         static const struct option options[] = {
@@ -73,6 +78,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "help",           no_argument,       NULL, 'h'                },
                 { "version",        no_argument,       NULL, ARG_VERSION        },
                 { "deserialize",    required_argument, NULL, ARG_DESERIALIZE    },
+                { "pool",           required_argument, NULL, ARG_POOL           },
                 {}
         };
 
@@ -159,6 +165,23 @@ static int parse_argv(int argc, char *argv[]) {
                         break;
                 }
 
+                case ARG_POOL: {
+                        _cleanup_close_ int fd = -EBADF;
+
+                        fd = parse_fd(optarg);
+                        if (fd < 0)
+                                return log_error_errno(fd, "Failed to parse pool socket fd \"%s\": %m", optarg);
+
+                        r = fd_cloexec(fd, /* cloexec= */ true);
+                        if (r < 0)
+                                return log_error_errno(r,
+                                                       "Failed to set pool socket fd %d to close-on-exec: %m",
+                                                       fd);
+
+                        close_and_replace(arg_pool_fd, fd);
+                        break;
+                }
+
                 case '?':
                         return -EINVAL;
 
@@ -166,8 +189,10 @@ static int parse_argv(int argc, char *argv[]) {
                         assert_not_reached();
                 }
 
-        if (!arg_serialization)
+        if (!arg_serialization && arg_pool_fd < 0)
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "No serialization fd specified.");
+        if (arg_serialization && arg_pool_fd >= 0)
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "--deserialize= and --pool= may not be combined.");
 
         return 1 /* work to do */;
 }
@@ -202,6 +227,16 @@ static int run(int argc, char *argv[]) {
         if (r <= 0)
                 return r;
 
+        /* When spawned ahead of time, wait until we are told what to do. This also applies the log settings
+         * the manager uses by now. */
+        if (arg_pool_fd >= 0) {
+                r = executor_pool_receive(TAKE_FD(arg_pool_fd), &arg_serialization);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to receive serialization: %m");
+                if (r == 0) /* The pool was flushed */
+                        return 0;
+        }
+
         /* Now that we know the intended log target, allow IPC and open the final log target. */
         log_set_prohibit_ipc(false);
         log_open();
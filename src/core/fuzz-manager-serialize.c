@@ -29,8 +29,9 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
         assert_se(f = data_to_file(data, size));
 
         (void) manager_deserialize(m, f, fdset);
-        (void) manager_serialize(m, null, fdset, true);
-        (void) manager_serialize(m, null, fdset, false);
+        (void) manager_serialize(m, null, fdset, true, false);
+        (void) manager_serialize(m, null, fdset, false, false);
+        (void) manager_serialize(m, null, fdset, false, true);
 
         return 0;
 }
@@ -8,6 +8,7 @@
 #include "stat-util.h"
 #include "string-util.h"
 #include "strv.h"
+#include "unit-file-cache.h"
 #include "unit-name.h"
 #include "unit.h"
 
@@ -101,8 +102,16 @@ int unit_load_dropin(Unit *u) {
         if (r < 0)
                 return r;
 
-        /* Load .conf dropins */
-        r = unit_find_dropin_paths(u, &l);
+        /* Load .conf dropins. If they were already searched for when the load queue was preloaded, use
+         * that list, unless the unit gained aliases while loading its fragment, or the unit path cache
+         * changed since. */
+        if (u->load_queue_dropins_known &&
+            set_isempty(u->aliases) &&
+            u->load_queue_dropin_timestamp_hash == u->manager->unit_cache_timestamp_hash) {
+                l = TAKE_PTR(u->load_queue_dropin_paths);
+                r = !strv_isempty(l);
+        } else
+                r = unit_find_dropin_paths(u, &l);
         if (r <= 0)
                 return 0;
 
@@ -118,10 +127,7 @@ int unit_load_dropin(Unit *u) {
         STRV_FOREACH(f, u->dropin_paths) {
                 struct stat st;
 
-                r = config_parse(u->id, *f, NULL,
-                                 UNIT_VTABLE(u)->sections,
-                                 config_item_perf_lookup, load_fragment_gperf_lookup,
-                                 0, u, &st);
+                r = unit_file_cache_parse(u, *f, NULL, &st);
                 if (r > 0)
                         u->dropin_mtime = MAX(u->dropin_mtime, timespec_load(&st.st_mtim));
         }
@@ -67,6 +67,7 @@
 #include "strv.h"
 #include "syslog-util.h"
 #include "time-util.h"
+#include "unit-file-cache.h"
 #include "unit-name.h"
 #include "unit-printf.h"
 #include "user-util.h"
@@ -6166,11 +6167,12 @@ int unit_load_fragment(Unit *u) {
         }
 
         /* Possibly rebuild the fragment map to catch new units */
-        r = unit_file_build_name_map(&u->manager->lookup_paths,
-                                     &u->manager->unit_cache_timestamp_hash,
-                                     &u->manager->unit_id_map,
-                                     &u->manager->unit_name_map,
-                                     &u->manager->unit_path_cache);
+        r = unit_file_build_name_map_cached(&u->manager->lookup_paths,
+                                            u->manager->unit_name_map_cache,
+                                            &u->manager->unit_cache_timestamp_hash,
+                                            &u->manager->unit_id_map,
+                                            &u->manager->unit_name_map,
+                                            &u->manager->unit_path_cache);
         if (r < 0)
                 return log_error_errno(r, "Failed to rebuild name map: %m");
 
@@ -6228,12 +6230,7 @@ int unit_load_fragment(Unit *u) {
                         u->fragment_mtime = timespec_load(&st.st_mtim);
 
                         /* Now, parse the file contents */
-                        r = config_parse(u->id, fragment, f,
-                                         UNIT_VTABLE(u)->sections,
-                                         config_item_perf_lookup, load_fragment_gperf_lookup,
-                                         0,
-                                         u,
-                                         NULL);
+                        r = unit_file_cache_parse(u, fragment, f, NULL);
                         if (r == -ENOEXEC)
                                 log_unit_notice_errno(u, r, "Unit configuration has fatal error, unit will not be started.");
                         if (r < 0)
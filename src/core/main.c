@@ -1078,6 +1078,18 @@ static int help(void) {
         return 0;
 }
 
+static bool reexecute_binary_is_us(void) {
+        struct stat a, b;
+
+        /* Only the very binary we are running is known to understand the binary serialization of unit
+         * states. If a different version was installed in the meantime, use the text format. */
+
+        if (stat("/proc/self/exe", &a) < 0 || stat(SYSTEMD_BINARY_PATH, &b) < 0)
+                return false;
+
+        return stat_inode_same(&a, &b);
+}
+
 static int prepare_reexecute(
                 Manager *m,
                 FILE **ret_f,
@@ -1104,7 +1116,9 @@ static int prepare_reexecute(
         if (!fds)
                 return log_oom();
 
-        r = manager_serialize(m, f, fds, switching_root);
+        /* When switching root, the binary we execute next belongs to a different file system, and might be
+         * older than us */
+        r = manager_serialize(m, f, fds, switching_root, /* unit_records= */ !switching_root && reexecute_binary_is_us());
         if (r < 0)
                 return r;
 
@@ -3,6 +3,7 @@
 #include "build.h"
 #include "fd-util.h"
 #include "fileio.h"
+#include "format-util.h"
 #include "hashmap.h"
 #include "manager-dump.h"
 #include "memstream-util.h"
@@ -58,6 +59,32 @@ void manager_dump_units(Manager *s, FILE *f, char **patterns, const char *prefix
         }
 }
 
+static void manager_dump_memory(Manager *m, FILE *f, const char *prefix) {
+        UnitDependenciesMemory d = {};
+        size_t n_units = 0, objects_size = 0;
+        const char *t;
+        Unit *u;
+
+        HASHMAP_FOREACH_KEY(u, t, m->units) {
+                if (u->id != t)
+                        continue;
+
+                n_units++;
+                objects_size += UNIT_VTABLE(u)->object_size;
+                unit_dependencies_memory_usage(&u->dependencies, &d);
+        }
+
+        fprintf(f,
+                "%sUnits: %zu, %s in objects, %s in the name map\n"
+                "%sUnit Dependencies: %zu entries in %zu arrays and %zu hashmaps, %s\n",
+                strempty(prefix), n_units, FORMAT_BYTES(objects_size), FORMAT_BYTES(hashmap_memory_usage(m->units)),
+                strempty(prefix), d.n_entries, d.n_sets_array, d.n_sets_hashmap, FORMAT_BYTES(d.size));
+
+        if (n_units > 0)
+                fprintf(f, "%sUnit Average: %s in the object, %s in dependencies\n",
+                        strempty(prefix), FORMAT_BYTES(objects_size / n_units), FORMAT_BYTES(d.size / n_units));
+}
+
 static void manager_dump_header(Manager *m, FILE *f, const char *prefix) {
 
         /* NB: this is a debug interface for developers. It's not supposed to be machine readable or be
@@ -77,6 +104,14 @@ static void manager_dump_header(Manager *m, FILE *f, const char *prefix) {
                                 timestamp_is_set(t->realtime) ? FORMAT_TIMESTAMP(t->realtime) :
                                                                 FORMAT_TIMESPAN(t->monotonic, 1));
         }
+
+        manager_dump_memory(m, f, prefix);
+
+        fprintf(f, "%sCGroup Attributes: %" PRIu64 " written in %s, %" PRIu64 " already set\n",
+                strempty(prefix),
+                m->cgroup_attribute_stats.n_written,
+                FORMAT_TIMESPAN(m->cgroup_attribute_stats.write_usec, USEC_PER_MSEC),
+                m->cgroup_attribute_stats.n_skipped);
 }
 
 void manager_dump(Manager *m, FILE *f, char **patterns, const char *prefix) {
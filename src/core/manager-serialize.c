@@ -10,13 +10,39 @@
 #include "macro.h"
 #include "manager-serialize.h"
 #include "manager.h"
+#include "memstream-util.h"
 #include "parse-util.h"
 #include "serialize.h"
+#include "sparse-endian.h"
 #include "syslog-util.h"
+#include "unit-name.h"
 #include "unit-serialize.h"
 #include "user-util.h"
 #include "varlink-internal.h"
 
+/* If the serialization is read by the very same binary, i.e. on reload and on reexecution of an unchanged
+ * binary, then after the state of the manager itself the state of the units is serialized as a sequence of
+ * binary records, each consisting of a header and the payload of the size specified in it. Any other
+ * binary, e.g. an older version after a downgrade or the one on the host we switch root into, might not
+ * know about them, hence the text format is used in that case. Records of unknown types
+ * are skipped, so that new types may be added without bumping the version, which is only changed for
+ * incompatible changes of the format. The payload of the record types defined so far is the text
+ * serialization of the unit as generated by unit_serialize_state(). The state of units which are inactive
+ * and hold no resources is not applied during deserialization, but only when the unit is loaded later on,
+ * so that reexecution does not need to load all units the previous instance happened to know about. */
+#define UNIT_RECORDS_VERSION 1U
+#define UNIT_RECORD_SIZE_MAX (16U * 1024U * 1024U)
+
+typedef enum UnitRecordType {
+        UNIT_RECORD_STATE            = 1,
+        UNIT_RECORD_STATE_DEFERRABLE = 2,
+} UnitRecordType;
+
+struct unit_record_f {
+        le64_t type;
+        le64_t size;
+} _packed_;
+
 int manager_open_serialization(Manager *m, FILE **ret_f) {
         assert(ret_f);
 
@@ -70,13 +96,102 @@ static void manager_serialize_gid_refs(Manager *m, FILE *f) {
         manager_serialize_uid_refs_internal(f, m->gid_refs, "destroy-ipc-gid");
 }
 
+static int unit_record_write(FILE *f, UnitRecordType type, const char *name, const char *state, size_t size) {
+        struct unit_record_f h;
+        size_t n;
+
+        assert(f);
+        assert(name);
+        assert(state);
+
+        /* The payload is the unit name on a line of its own, followed by the serialized state, exactly like
+         * in the text serialization */
+        n = strlen(name) + 1 + size;
+        if (n > UNIT_RECORD_SIZE_MAX)
+                return -E2BIG;
+
+        h = (struct unit_record_f) {
+                .type = htole64(type),
+                .size = htole64(n),
+        };
+
+        if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+            fputs(name, f) == EOF ||
+            fputc('\n', f) == EOF ||
+            fwrite(state, 1, size, f) != size)
+                return errno_or_else(EIO);
+
+        return 0;
+}
+
+static bool unit_state_deferrable(Unit *u) {
+        assert(u);
+
+        /* The state of units that are not running and hold no resources is only needed again once somebody
+         * looks at the unit, hence we don't need to load them during deserialization */
+        return !u->perpetual &&
+                !u->job &&
+                !u->nop_job &&
+                !u->cgroup_path &&
+                !u->bus_track &&
+                !unit_get_exec_runtime(u) &&
+                unit_active_state(u) == UNIT_INACTIVE;
+}
+
+static int manager_serialize_unit(Unit *u, FILE *f, FDSet *fds, bool switching_root) {
+        _cleanup_(memstream_done) MemStream ms = {};
+        _cleanup_free_ char *buf = NULL;
+        size_t size, n_fds;
+        FILE *s;
+        char *state;
+        int r;
+
+        assert(u);
+        assert(f);
+        assert(fds);
+
+        s = memstream_init(&ms);
+        if (!s)
+                return log_oom();
+
+        n_fds = fdset_size(fds);
+
+        r = unit_serialize_state(u, s, fds, switching_root);
+        if (r < 0)
+                return r;
+
+        r = memstream_finalize(&ms, &buf, &size);
+        if (r < 0)
+                return log_unit_error_errno(u, r, "Failed to serialize unit state: %m");
+        if (size == 0) /* Unit is excluded from serialization */
+                return 0;
+
+        /* Skip the start marker, it is written by unit_record_write() */
+        state = startswith(buf, u->id);
+        if (!state || *state != '\n')
+                return log_unit_error_errno(u, SYNTHETIC_ERRNO(EBADMSG), "Serialized unit state lacks start marker.");
+        state++;
+
+        r = unit_record_write(
+                        f,
+                        fdset_size(fds) == n_fds && unit_state_deferrable(u) ? UNIT_RECORD_STATE_DEFERRABLE : UNIT_RECORD_STATE,
+                        u->id,
+                        state,
+                        size - (state - buf));
+        if (r < 0)
+                return log_unit_error_errno(u, r, "Failed to serialize unit state: %m");
+
+        return 0;
+}
+
 int manager_serialize(
                 Manager *m,
                 FILE *f,
                 FDSet *fds,
-                bool switching_root) {
+                bool switching_root,
+                bool unit_records) {
 
-        const char *t;
+        const char *t, *state;
         Unit *u;
         int r;
 
@@ -171,17 +286,43 @@ int manager_serialize(
         if (r < 0)
                 return r;
 
+        if (unit_records)
+                (void) serialize_item_format(f, "unit-records", "%u", UNIT_RECORDS_VERSION);
+
         (void) fputc('\n', f);
 
         HASHMAP_FOREACH_KEY(u, t, m->units) {
                 if (u->id != t)
                         continue;
 
-                r = unit_serialize_state(u, f, fds, switching_root);
+                if (unit_records)
+                        r = manager_serialize_unit(u, f, fds, switching_root);
+                else
+                        r = unit_serialize_state(u, f, fds, switching_root);
                 if (r < 0)
                         return r;
         }
 
+        /* Pass on the state of units that were not loaded since the previous deserialization */
+        HASHMAP_FOREACH_KEY(state, t, m->deferred_unit_states) {
+                UnitType type = unit_name_to_type(t);
+
+                if (switching_root && type >= 0 && unit_vtable[type]->exclude_from_switch_root_serialization)
+                        continue;
+
+                if (!unit_records) {
+                        /* The pending state is the text serialization following the start marker */
+                        fputs(t, f);
+                        fputc('\n', f);
+                        fputs(state, f);
+                        continue;
+                }
+
+                r = unit_record_write(f, UNIT_RECORD_STATE_DEFERRABLE, t, state, strlen(state));
+                if (r < 0)
+                        return log_error_errno(r, "Failed to serialize state of unit %s: %m", t);
+        }
+
         r = fflush_and_check(f);
         if (r < 0)
                 return log_error_errno(r, "Failed to flush serialization: %m");
@@ -240,6 +381,162 @@ static int manager_deserialize_units(Manager *m, FILE *f, FDSet *fds) {
         return 0;
 }
 
+static int manager_deserialize_one_unit_state(Manager *m, const char *name, const char *state, size_t size, FDSet *fds) {
+        _cleanup_fclose_ FILE *f = NULL;
+
+        assert(state);
+
+        f = fmemopen_unlocked((char*) state, size, "r");
+        if (!f)
+                return log_oom();
+
+        return manager_deserialize_one_unit(m, name, f, fds);
+}
+
+static int unit_record_parse(char *payload, size_t size, char **ret_state, size_t *ret_size) {
+        char *nl;
+
+        assert(payload);
+        assert(ret_state);
+        assert(ret_size);
+
+        /* Splits the payload into the unit name and the state, which must end in the end marker */
+        nl = memchr(payload, '\n', size);
+        if (!nl || size < 2 || payload[size - 1] != '\n')
+                return -EBADMSG;
+
+        *nl = 0;
+        if (!unit_name_is_valid(payload, UNIT_NAME_ANY))
+                return -EBADMSG;
+
+        *ret_state = nl + 1;
+        *ret_size = size - (nl + 1 - payload);
+        return 0;
+}
+
+static int manager_deserialize_unit_record(Manager *m, UnitRecordType type, char *payload, size_t size, FDSet *fds) {
+        _cleanup_free_ char *p = payload;
+        size_t state_size;
+        char *state;
+        Unit *u;
+        int r;
+
+        assert(m);
+        assert(payload);
+
+        r = unit_record_parse(p, size, &state, &state_size);
+        if (r < 0)
+                return log_notice_errno(r, "Failed to parse unit record, skipping.");
+
+        if (type == UNIT_RECORD_STATE)
+                return manager_deserialize_one_unit_state(m, p, state, state_size, fds);
+
+        /* Units which have been loaded already, e.g. as dependency of another unit, get their state right
+         * away, all others only once they are loaded. */
+        u = manager_get_unit(m, p);
+        if (u && u->load_state != UNIT_STUB)
+                return manager_deserialize_one_unit_state(m, p, state, state_size, fds);
+
+        /* The key is the beginning of the payload buffer, the state follows it in the same allocation */
+        r = hashmap_ensure_put(&m->deferred_unit_states, &string_hash_ops_free, p, state);
+        if (r == -ENOMEM)
+                return log_oom();
+        if (r < 0)
+                return log_notice_errno(r, "Failed to store deferred state of unit %s, skipping: %m", p);
+
+        TAKE_PTR(p);
+        return 0;
+}
+
+static int manager_deserialize_unit_records(Manager *m, FILE *f, FDSet *fds) {
+        int r;
+
+        assert(m);
+        assert(f);
+
+        m->deferred_unit_states = hashmap_free(m->deferred_unit_states);
+
+        for (;;) {
+                _cleanup_free_ char *payload = NULL;
+                struct unit_record_f h;
+                uint64_t type, size;
+
+                if (fread(&h, sizeof(h), 1, f) != 1) {
+                        if (ferror(f))
+                                return log_error_errno(errno_or_else(EIO), "Failed to read unit record: %m");
+                        break;
+                }
+
+                type = le64toh(h.type);
+                size = le64toh(h.size);
+                if (size > UNIT_RECORD_SIZE_MAX)
+                        return log_error_errno(SYNTHETIC_ERRNO(EBADMSG), "Unit record of size %" PRIu64 " too large.", size);
+
+                payload = malloc(size + 1);
+                if (!payload)
+                        return log_oom();
+
+                if (fread(payload, 1, size, f) != size)
+                        return log_error_errno(ferror(f) ? errno_or_else(EIO) : SYNTHETIC_ERRNO(EBADMSG),
+                                               "Failed to read unit record: %m");
+                payload[size] = 0;
+
+                if (!IN_SET(type, UNIT_RECORD_STATE, UNIT_RECORD_STATE_DEFERRABLE)) {
+                        log_debug("Unknown unit record type %" PRIu64 ", skipping.", type);
+                        continue;
+                }
+
+                r = manager_deserialize_unit_record(m, type, TAKE_PTR(payload), size, fds);
+                if (r == -ENOMEM)
+                        return r;
+        }
+
+        return 0;
+}
+
+void manager_apply_deferred_unit_state(Manager *m, Unit *u) {
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *p = NULL;
+        const char *alias;
+        char *state;
+        int r;
+
+        assert(m);
+        assert(u);
+
+        u = unit_follow_merge(u);
+
+        state = hashmap_remove2(m->deferred_unit_states, u->id, (void**) &p);
+        SET_FOREACH(alias, u->aliases) {
+                if (state)
+                        break;
+
+                state = hashmap_remove2(m->deferred_unit_states, alias, (void**) &p);
+        }
+        if (!state)
+                return;
+
+        /* Deferred units do not have any file descriptors serialized */
+        fds = fdset_new();
+        if (!fds)
+                return (void) log_oom();
+
+        f = fmemopen_unlocked(state, strlen(state), "r");
+        if (!f)
+                return (void) log_oom();
+
+        r = unit_deserialize_state(u, f, fds);
+        if (r < 0)
+                return (void) log_unit_notice_errno(u, r, "Failed to apply deferred unit state, ignoring: %m");
+
+        /* Units loaded during deserialization are coldplugged together with all others */
+        if (!MANAGER_IS_RELOADING(m))
+                (void) unit_coldplug(u);
+
+        log_unit_debug(u, "Applied deferred unit state.");
+}
+
 static void manager_deserialize_uid_refs_one_internal(
                 Hashmap** uid_refs,
                 const char *value) {
@@ -285,6 +582,7 @@ static void manager_deserialize_gid_refs_one(Manager *m, const char *value) {
 
 int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
         bool deserialize_varlink_sockets = false;
+        unsigned unit_records = 0;
         int r = 0;
 
         assert(m);
@@ -515,6 +813,13 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                                 (void) varlink_server_deserialize_one(m->varlink_server, val, fds);
                 } else if ((val = startswith(l, "dump-ratelimit=")))
                         deserialize_ratelimit(&m->dump_ratelimit, "dump-ratelimit", val);
+                else if ((val = startswith(l, "unit-records="))) {
+                        r = safe_atou(val, &unit_records);
+                        if (r < 0) {
+                                log_notice_errno(r, "Failed to parse unit records version '%s': %m", val);
+                                unit_records = UINT_MAX;
+                        }
+                }
                 else {
                         ManagerTimestamp q;
 
@@ -535,5 +840,14 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                 }
         }
 
-        return manager_deserialize_units(m, f, fds);
+        /* Older versions serialize units as text */
+        if (unit_records == 0)
+                return manager_deserialize_units(m, f, fds);
+
+        if (unit_records > UNIT_RECORDS_VERSION) {
+                log_warning("Unit state serialized in unsupported format version %u, not deserializing units.", unit_records);
+                return 0;
+        }
+
+        return manager_deserialize_unit_records(m, f, fds);
 }
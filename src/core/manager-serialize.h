@@ -9,5 +9,11 @@
 #define DESTROY_IPC_FLAG (UINT32_C(1) << 31)
 
 int manager_open_serialization(Manager *m, FILE **ret_f);
-int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root);
+/* If unit_records is true, the state of units is serialized in a binary format only the very same binary is
+ * guaranteed to understand. */
+int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root, bool unit_records);
 int manager_deserialize(Manager *m, FILE *f, FDSet *fds);
+
+/* Applies the state of a unit that was serialized by the previous instance, but not deserialized right away
+ * as the unit was inactive, see manager_deserialize(). */
+void manager_apply_deferred_unit_state(Manager *m, Unit *u);
@@ -46,6 +46,7 @@
 #include "event-util.h"
 #include "exec-util.h"
 #include "execute.h"
+#include "executor-pool.h"
 #include "exit-status.h"
 #include "fd-util.h"
 #include "fileio.h"
@@ -56,6 +57,7 @@
 #include "install.h"
 #include "io-util.h"
 #include "label-util.h"
+#include "load-dropin.h"
 #include "load-fragment.h"
 #include "locale-setup.h"
 #include "log.h"
@@ -882,6 +884,7 @@ int manager_new(RuntimeScope runtime_scope, ManagerTestRunFlags test_run_flags,
                 .dev_autofs_fd = -EBADF,
                 .cgroup_inotify_fd = -EBADF,
                 .pin_cgroupfs_fd = -EBADF,
+                .cgroup_apply_fd = -EBADF,
                 .ask_password_inotify_fd = -EBADF,
                 .idle_pipe = { -EBADF, -EBADF, -EBADF, -EBADF},
 
@@ -895,6 +898,7 @@ int manager_new(RuntimeScope runtime_scope, ManagerTestRunFlags test_run_flags,
                 .dump_ratelimit = (const RateLimit) { .interval = 10 * USEC_PER_MINUTE, .burst = 10 },
 
                 .executor_fd = -EBADF,
+                .executor_pool_size = executor_pool_size_from_env(),
         };
 
         unit_defaults_init(&m->defaults, runtime_scope);
@@ -1014,6 +1018,23 @@ int manager_new(RuntimeScope runtime_scope, ManagerTestRunFlags test_run_flags,
                 if (r < 0 && r != -EEXIST)
                         return r;
 
+                /* Keep a copy of the unit name map in /run/, so that it can be reused after reloads and
+                 * reexecution, see unit_file_build_name_map_cached(). */
+                if (MANAGER_IS_SYSTEM(m)) {
+                        m->unit_name_map_cache = strdup("/run/systemd/unit-name-map.cache");
+                        if (!m->unit_name_map_cache)
+                                return -ENOMEM;
+                } else {
+                        r = xdg_user_runtime_dir(&m->unit_name_map_cache, "/systemd/unit-name-map.cache");
+                        if (r < 0)
+                                return r;
+                }
+
+                /* Likewise for the contents of the unit files, see unit_file_cache_parse(). */
+                r = unit_file_cache_path(m->runtime_scope, &m->unit_file_cache.path);
+                if (r < 0)
+                        return r;
+
                 m->executor_fd = open(SYSTEMD_EXECUTOR_BINARY_PATH, O_CLOEXEC|O_PATH);
                 if (m->executor_fd < 0)
                         return log_emergency_errno(errno,
@@ -1645,6 +1666,7 @@ Manager* manager_free(Manager *m) {
 
         hashmap_free(m->units);
         hashmap_free(m->units_by_invocation_id);
+        hashmap_free(m->deferred_unit_states);
         hashmap_free(m->jobs);
         hashmap_free(m->watch_pids);
         hashmap_free(m->watch_pids_more);
@@ -1666,6 +1688,8 @@ Manager* manager_free(Manager *m) {
         sd_event_source_unref(m->user_lookup_event_source);
         sd_event_source_unref(m->memory_pressure_event_source);
 
+        executor_pool_flush(m);
+
         safe_close(m->signal_fd);
         safe_close(m->notify_fd);
         safe_close(m->cgroups_agent_fd);
@@ -1685,6 +1709,8 @@ Manager* manager_free(Manager *m) {
 
         hashmap_free(m->cgroup_unit);
         manager_free_unit_name_maps(m);
+        free(m->unit_name_map_cache);
+        unit_file_cache_done(&m->unit_file_cache);
 
         free(m->switch_root);
         free(m->switch_root_init);
@@ -1962,6 +1988,7 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds, const char *roo
 
                 /* First, enumerate what we can from all config files */
                 dual_timestamp_now(m->timestamps + manager_timestamp_initrd_mangle(MANAGER_TIMESTAMP_UNITS_LOAD_START));
+                unit_file_cache_begin(&m->unit_file_cache);
                 manager_enumerate_perpetual(m);
                 manager_enumerate(m);
                 dual_timestamp_now(m->timestamps + manager_timestamp_initrd_mangle(MANAGER_TIMESTAMP_UNITS_LOAD_FINISH));
@@ -2013,6 +2040,9 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds, const char *roo
                 /* Clean up runtime objects */
                 manager_vacuum(m);
 
+                /* Units loaded from now on are read directly again, until the next reload */
+                unit_file_cache_end(&m->unit_file_cache);
+
                 if (serialization)
                         /* Let's wait for the UnitNew/JobNew messages being sent, before we notify that the
                          * reload is finished */
@@ -2213,6 +2243,72 @@ static int manager_dispatch_target_deps_queue(Manager *m) {
         return r;
 }
 
+static void manager_preload_load_queue(Manager *m) {
+        _cleanup_set_free_ Set *paths = NULL;
+        int r;
+
+        assert(m);
+
+        /* Collects the fragments and drop-ins of all units in the load queue we haven't looked at yet, and
+         * has the unit file cache read them in parallel. The units are then loaded one by one in queue
+         * order as before, and pick up the preloaded contents, hence the result is the same as without.
+         * The drop-in lists are kept on the units, so that unit_load_dropin() doesn't search again. */
+
+        if (!m->unit_file_cache.active || m->n_load_queue_pending == 0)
+                return;
+
+        r = unit_file_build_name_map_cached(&m->lookup_paths,
+                                            m->unit_name_map_cache,
+                                            &m->unit_cache_timestamp_hash,
+                                            &m->unit_id_map,
+                                            &m->unit_name_map,
+                                            &m->unit_path_cache);
+        if (r < 0)
+                return (void) log_debug_errno(r, "Failed to rebuild name map, not preloading unit files: %m");
+
+        LIST_FOREACH(load_queue, u, m->load_queue) {
+                _cleanup_strv_free_ char **dropins = NULL;
+                const char *fragment = NULL;
+
+                /* New units are prepended to the queue, hence once we see a unit we looked at before, we
+                 * have seen all units we haven't looked at yet. */
+                if (u->load_queue_preloaded)
+                        break;
+
+                u->load_queue_preloaded = true;
+                assert(m->n_load_queue_pending > 0);
+                m->n_load_queue_pending--;
+
+                if (u->transient || u->load_state != UNIT_STUB)
+                        continue;
+
+                if (unit_file_find_fragment(m->unit_id_map, m->unit_name_map, u->id, &fragment, NULL) >= 0 &&
+                    fragment) {
+                        r = set_put_strdup_full(&paths, &path_hash_ops_free, fragment);
+                        if (r < 0)
+                                return (void) log_oom_debug();
+                }
+
+                if (unit_find_dropin_paths(u, &dropins) > 0) {
+                        r = set_put_strdupv_full(&paths, &path_hash_ops_free, dropins);
+                        if (r < 0)
+                                return (void) log_oom_debug();
+                }
+
+                /* Aliases are only added when the fragment is loaded, see unit_load_dropin() */
+                if (set_isempty(u->aliases)) {
+                        strv_free_and_replace(u->load_queue_dropin_paths, dropins);
+                        u->load_queue_dropin_timestamp_hash = m->unit_cache_timestamp_hash;
+                        u->load_queue_dropins_known = true;
+                }
+        }
+
+        if (set_isempty(paths))
+                return;
+
+        (void) unit_file_cache_preload(&m->unit_file_cache, paths);
+}
+
 unsigned manager_dispatch_load_queue(Manager *m) {
         Unit *u;
         unsigned n = 0;
@@ -2231,8 +2327,18 @@ unsigned manager_dispatch_load_queue(Manager *m) {
         while ((u = m->load_queue)) {
                 assert(u->in_load_queue);
 
+                /* Loading a unit usually queues its dependencies, read their files in bulk. Do so for the
+                 * units queued before we were called, and then only whenever enough new ones piled up,
+                 * rather than for almost every unit: each round rechecks the unit search path. Units that
+                 * are loaded before they are looked at just read their files themselves. */
+                if (n == 0 || m->n_load_queue_pending >= UNIT_FILE_CACHE_PRELOAD_BATCH)
+                        manager_preload_load_queue(m);
+
                 unit_load(u);
                 n++;
+
+                if (!hashmap_isempty(m->deferred_unit_states))
+                        manager_apply_deferred_unit_state(m, u);
         }
 
         m->dispatching_load_queue = false;
@@ -3548,7 +3654,7 @@ int manager_reload(Manager *m) {
         /* We are officially in reload mode from here on. */
         reloading = manager_reloading_start(m);
 
-        r = manager_serialize(m, f, fds, false);
+        r = manager_serialize(m, f, fds, /* switching_root= */ false, /* unit_records= */ true);
         if (r < 0)
                 return r;
 
@@ -3586,6 +3692,7 @@ int manager_reload(Manager *m) {
         m->unit_file_state_outdated = false;
 
         /* First, enumerate what we can from kernel and suchlike */
+        unit_file_cache_begin(&m->unit_file_cache);
         manager_enumerate_perpetual(m);
         manager_enumerate(m);
 
@@ -3607,6 +3714,7 @@ int manager_reload(Manager *m) {
 
         /* Clean up runtime objects no longer referenced */
         manager_vacuum(m);
+        unit_file_cache_end(&m->unit_file_cache);
 
         /* Clean up deserialized tracked clients */
         m->deserialized_subscribed = strv_free(m->deserialized_subscribed);
@@ -33,6 +33,7 @@ enum {
 assert_cc((int) _MANAGER_SIGNAL_COMMAND_MAX <= (int) _COMMON_SIGNAL_COMMAND_PRIVATE_END);
 
 typedef struct Manager Manager;
+typedef struct ExecutorPoolEntry ExecutorPoolEntry;
 
 /* An externally visible state. We don't actually maintain this as state variable, but derive it from various fields
  * when requested */
@@ -136,6 +137,7 @@ typedef enum WatchdogType {
 #include "job.h"
 #include "path-lookup.h"
 #include "show-status.h"
+#include "unit-file-cache.h"
 #include "unit-name.h"
 
 typedef enum ManagerTestRunFlags {
@@ -191,6 +193,7 @@ struct Manager {
         /* Active jobs and units */
         Hashmap *units;  /* name string => Unit object n:1 */
         Hashmap *units_by_invocation_id;
+        Hashmap *deferred_unit_states; /* name string => serialized state of units not loaded yet */
         Hashmap *jobs;   /* job id => Job object 1:1 */
 
         /* To make it easy to iterate through the units of a specific
@@ -199,6 +202,9 @@ struct Manager {
 
         /* Units that need to be loaded */
         LIST_HEAD(Unit, load_queue); /* this is actually more a stack than a queue, but uh. */
+        /* Units in the load queue manager_preload_load_queue() hasn't looked at yet. As units are prepended
+         * to the queue, these are always at its head. */
+        unsigned n_load_queue_pending;
 
         /* Jobs that need to be run */
         struct Prioq *run_queue;
@@ -289,6 +295,8 @@ struct Manager {
         Hashmap *unit_name_map;
         Set *unit_path_cache;
         uint64_t unit_cache_timestamp_hash;
+        char *unit_name_map_cache;
+        UnitFileCache unit_file_cache;
 
         /* We don't have support for atomically enabling/disabling units, and unit_file_state might become
          * outdated if such operations failed half-way. Therefore, we set this flag if changes to unit files
@@ -368,6 +376,11 @@ struct Manager {
          * file system */
         int pin_cgroupfs_fd;
 
+        /* The unit cgroup_context_apply() currently writes attributes of, and its cgroup directory */
+        Unit *cgroup_apply_unit;
+        int cgroup_apply_fd;
+        CGroupAttributeStats cgroup_attribute_stats;
+
         unsigned gc_marker;
 
         /* The stat() data the last time we saw /etc/localtime */
@@ -484,6 +497,8 @@ struct Manager {
          * we're a user manager, this object manages the client connection from the user manager to
          * systemd-oomd to report changes in ManagedOOM settings (systemd client - oomd server). */
         Varlink *managed_oom_varlink;
+        /* The ListUnitMetrics() calls that wait for the client to read the replies so far, by connection */
+        Hashmap *varlink_unit_metrics;
 
         /* Reference to RestrictFileSystems= BPF program */
         struct restrict_fs_bpf *restrict_fs;
@@ -501,6 +516,12 @@ struct Manager {
         /* Pin the systemd-executor binary, so that it never changes until re-exec, ensuring we don't have
          * serialization/deserialization compatibility issues during upgrades. */
         int executor_fd;
+
+        /* Executors spawned ahead of time, waiting for work, see executor-pool.c */
+        ExecutorPoolEntry *executor_pool;
+        size_t n_executor_pool;
+        unsigned executor_pool_size;
+        sd_event_source *executor_pool_event_source;
 };
 
 static inline usec_t manager_default_timeout_abort_usec(Manager *m) {
@@ -20,7 +20,9 @@
 #include "format-util.h"
 #include "log.h"
 #include "path-util.h"
+#include "process-util.h"
 #include "selinux-util.h"
+#include "socket-util.h"
 #include "stdio-util.h"
 #include "strv.h"
 
@@ -28,6 +30,7 @@ static bool initialized = false;
 
 struct audit_info {
         sd_bus_creds *creds;
+        const struct ucred *ucred;
         const char *path;
         const char *cmdline;
         const char *function;
@@ -50,12 +53,17 @@ static int audit_callback(
         char uid_buf[DECIMAL_STR_MAX(uid_t) + 1] = "n/a";
         char gid_buf[DECIMAL_STR_MAX(gid_t) + 1] = "n/a";
 
-        if (sd_bus_creds_get_audit_login_uid(audit->creds, &login_uid) >= 0)
-                xsprintf(login_uid_buf, UID_FMT, login_uid);
-        if (sd_bus_creds_get_euid(audit->creds, &uid) >= 0)
-                xsprintf(uid_buf, UID_FMT, uid);
-        if (sd_bus_creds_get_egid(audit->creds, &gid) >= 0)
-                xsprintf(gid_buf, GID_FMT, gid);
+        if (audit->creds) {
+                if (sd_bus_creds_get_audit_login_uid(audit->creds, &login_uid) >= 0)
+                        xsprintf(login_uid_buf, UID_FMT, login_uid);
+                if (sd_bus_creds_get_euid(audit->creds, &uid) >= 0)
+                        xsprintf(uid_buf, UID_FMT, uid);
+                if (sd_bus_creds_get_egid(audit->creds, &gid) >= 0)
+                        xsprintf(gid_buf, GID_FMT, gid);
+        } else if (audit->ucred) {
+                xsprintf(uid_buf, UID_FMT, audit->ucred->uid);
+                xsprintf(gid_buf, GID_FMT, audit->ucred->gid);
+        }
 
         (void) snprintf(msgbuf, msgbufsize,
                         "auid=%s uid=%s gid=%s%s%s%s%s%s%s%s%s%s",
@@ -168,6 +176,65 @@ static int access_init(sd_bus_error *error) {
         return 1;
 }
 
+static int access_check_context(
+                const char *scon,
+                const char *unit_context,
+                const char *permission,
+                struct audit_info *audit,
+                sd_bus_error *error) {
+
+        _cleanup_freecon_ char *fcon = NULL;
+        const char *tclass, *acon;
+        bool enforce;
+        int r;
+
+        assert(scon);
+        assert(permission);
+        assert(audit);
+
+        /* delay call until we checked in `access_init()` if SELinux is actually enabled */
+        enforce = mac_selinux_enforcing();
+
+        if (unit_context) {
+                /* Nice! The unit comes with a SELinux context read from the unit file */
+                acon = unit_context;
+                tclass = "service";
+        } else {
+                /* If no unit context is known, use our own */
+                if (getcon_raw(&fcon) < 0) {
+                        log_warning_errno(errno, "SELinux getcon_raw() failed%s (perm=%s): %m",
+                                          enforce ? "" : ", ignoring",
+                                          permission);
+                        if (!enforce)
+                                return 0;
+
+                        return sd_bus_error_setf(error, SD_BUS_ERROR_ACCESS_DENIED, "Failed to get current context: %m");
+                }
+                if (!fcon) {
+                        if (!enforce)
+                                return 0;
+
+                        return sd_bus_error_setf(error, SD_BUS_ERROR_ACCESS_DENIED, "We appear not to have any SELinux context: %m");
+                }
+
+                acon = fcon;
+                tclass = "system";
+        }
+
+        r = selinux_check_access(scon, acon, tclass, permission, audit);
+        if (r < 0) {
+                errno = -(r = errno_or_else(EPERM));
+
+                if (enforce)
+                        sd_bus_error_setf(error, SD_BUS_ERROR_ACCESS_DENIED, "SELinux policy denies access: %m");
+        }
+
+        log_full_errno_zerook(LOG_DEBUG, r,
+                              "SELinux access check scon=%s tcon=%s tclass=%s perm=%s state=%s function=%s path=%s cmdline=%s: %m",
+                              scon, acon, tclass, permission, enforce ? "enforcing" : "permissive", audit->function, strna(audit->path), strna(empty_to_null(audit->cmdline)));
+        return enforce ? r : 0;
+}
+
 /*
    This function communicates with the kernel to check whether or not it should
    allow the access.
@@ -183,11 +250,9 @@ int mac_selinux_access_check_internal(
                 sd_bus_error *error) {
 
         _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *creds = NULL;
-        const char *tclass, *scon, *acon;
         _cleanup_free_ char *cl = NULL;
-        _cleanup_freecon_ char *fcon = NULL;
         char **cmdline = NULL;
-        bool enforce;
+        const char *scon;
         int r = 0;
 
         assert(message);
@@ -199,9 +264,6 @@ int mac_selinux_access_check_internal(
         if (r <= 0)
                 return r;
 
-        /* delay call until we checked in `access_init()` if SELinux is actually enabled */
-        enforce = mac_selinux_enforcing();
-
         r = sd_bus_query_sender_creds(
                         message,
                         SD_BUS_CREDS_PID|SD_BUS_CREDS_EUID|SD_BUS_CREDS_EGID|
@@ -222,32 +284,6 @@ int mac_selinux_access_check_internal(
         if (r < 0)
                 return r;
 
-        if (unit_context) {
-                /* Nice! The unit comes with a SELinux context read from the unit file */
-                acon = unit_context;
-                tclass = "service";
-        } else {
-                /* If no unit context is known, use our own */
-                if (getcon_raw(&fcon) < 0) {
-                        log_warning_errno(errno, "SELinux getcon_raw() failed%s (perm=%s): %m",
-                                          enforce ? "" : ", ignoring",
-                                          permission);
-                        if (!enforce)
-                                return 0;
-
-                        return sd_bus_error_setf(error, SD_BUS_ERROR_ACCESS_DENIED, "Failed to get current context: %m");
-                }
-                if (!fcon) {
-                        if (!enforce)
-                                return 0;
-
-                        return sd_bus_error_setf(error, SD_BUS_ERROR_ACCESS_DENIED, "We appear not to have any SELinux context: %m");
-                }
-
-                acon = fcon;
-                tclass = "system";
-        }
-
         sd_bus_creds_get_cmdline(creds, &cmdline);
         cl = strv_join(cmdline, " ");
 
@@ -258,18 +294,54 @@ int mac_selinux_access_check_internal(
                 .function = function,
         };
 
-        r = selinux_check_access(scon, acon, tclass, permission, &audit_info);
-        if (r < 0) {
-                errno = -(r = errno_or_else(EPERM));
+        return access_check_context(scon, unit_context, permission, &audit_info, error);
+}
 
-                if (enforce)
-                        sd_bus_error_setf(error, SD_BUS_ERROR_ACCESS_DENIED, "SELinux policy denies access: %m");
-        }
+int mac_selinux_access_check_varlink_internal(
+                Varlink *link,
+                const char *unit_path,
+                const char *unit_context,
+                const char *permission,
+                const char *function) {
 
-        log_full_errno_zerook(LOG_DEBUG, r,
-                              "SELinux access check scon=%s tcon=%s tclass=%s perm=%s state=%s function=%s path=%s cmdline=%s: %m",
-                              scon, acon, tclass, permission, enforce ? "enforcing" : "permissive", function, strna(unit_path), strna(empty_to_null(cl)));
-        return enforce ? r : 0;
+        _cleanup_freecon_ char *scon = NULL;
+        _cleanup_free_ char *cl = NULL;
+        struct ucred ucred;
+        int fd, r;
+
+        assert(link);
+        assert(permission);
+        assert(function);
+
+        /* Same as mac_selinux_access_check_internal(), but for the peer of a Varlink connection. Returns
+         * -EACCES or similar if access is denied. */
+
+        r = access_init(/* error= */ NULL);
+        if (r <= 0)
+                return r;
+
+        fd = varlink_get_fd(link);
+        if (fd < 0)
+                return fd;
+
+        r = getpeercred(fd, &ucred);
+        if (r < 0)
+                return r;
+
+        /* Unlike D-Bus, the peer's context is always taken from the socket directly */
+        if (getpeercon_raw(fd, &scon) < 0)
+                return -errno;
+
+        (void) pid_get_cmdline(ucred.pid, SIZE_MAX, /* flags= */ 0, &cl);
+
+        struct audit_info audit_info = {
+                .ucred = &ucred,
+                .path = unit_path,
+                .cmdline = cl,
+                .function = function,
+        };
+
+        return access_check_context(scon, unit_context, permission, &audit_info, /* error= */ NULL);
 }
 
 #else /* HAVE_SELINUX */
@@ -285,4 +357,14 @@ int mac_selinux_access_check_internal(
         return 0;
 }
 
+int mac_selinux_access_check_varlink_internal(
+                Varlink *link,
+                const char *unit_path,
+                const char *unit_label,
+                const char *permission,
+                const char *function) {
+
+        return 0;
+}
+
 #endif /* HAVE_SELINUX */
@@ -4,6 +4,7 @@
 #include "sd-bus.h"
 
 #include "manager.h"
+#include "varlink.h"
 
 int mac_selinux_access_check_internal(sd_bus_message *message, const char *unit_path, const char *unit_label, const char *permission, const char *function, sd_bus_error *error);
 
@@ -12,3 +13,11 @@ int mac_selinux_access_check_internal(sd_bus_message *message, const char *unit_
 
 #define mac_selinux_unit_access_check(unit, message, permission, error) \
         mac_selinux_access_check_internal((message), (unit)->fragment_path, (unit)->access_selinux_context, (permission), __func__, (error))
+
+int mac_selinux_access_check_varlink_internal(Varlink *link, const char *unit_path, const char *unit_label, const char *permission, const char *function);
+
+#define mac_selinux_access_check_varlink(link, permission) \
+        mac_selinux_access_check_varlink_internal((link), NULL, NULL, (permission), __func__)
+
+#define mac_selinux_unit_access_check_varlink(unit, link, permission) \
+        mac_selinux_access_check_varlink_internal((link), (unit)->fragment_path, (unit)->access_selinux_context, (permission), __func__)
@@ -12,6 +12,7 @@
 #include "transaction.h"
 
 static void transaction_unlink_job(Transaction *tr, Job *j, bool delete_dependencies);
+static int transaction_collect_garbage(Transaction *tr);
 
 static void transaction_delete_job(Transaction *tr, Job *j, bool delete_dependencies) {
         assert(tr);
@@ -212,42 +213,86 @@ static int delete_one_unmergeable_job(Transaction *tr, Job *job) {
         return -EINVAL;
 }
 
-static int transaction_merge_jobs(Transaction *tr, sd_bus_error *e) {
+static Job* job_find_unmergeable(Job *j, JobType *ret_type) {
+        JobType t;
+
+        assert(j);
+        assert(ret_type);
+
+        /* Returns the first job for j->unit that cannot be merged with the ones before it, if any */
+
+        t = j->type;
+        LIST_FOREACH(transaction, k, j->transaction_next)
+                if (job_type_merge_and_collapse(&t, k->type, j->unit) < 0) {
+                        *ret_type = t;
+                        return k;
+                }
+
+        return NULL;
+}
+
+static int transaction_merge_jobs(Transaction *tr, bool collect_garbage, sd_bus_error *e) {
+        _cleanup_free_ Unit **units = NULL;
+        size_t n_units = 0;
         Job *j;
         int r;
 
         assert(tr);
 
         /* First step, check whether any of the jobs for one specific
-         * task conflict. If so, try to drop one of them. */
+         * task conflict. If so, try to drop one of them. The units
+         * with conflicting jobs are collected first and then dealt
+         * with in one batch, instead of rescanning the whole
+         * transaction after each dropped job. */
         HASHMAP_FOREACH(j, tr->jobs) {
                 JobType t;
 
-                t = j->type;
-                LIST_FOREACH(transaction, k, j->transaction_next) {
-                        if (job_type_merge_and_collapse(&t, k->type, j->unit) >= 0)
-                                continue;
+                if (!job_find_unmergeable(j, &t))
+                        continue;
+
+                if (!GREEDY_REALLOC(units, n_units + 1))
+                        return -ENOMEM;
+
+                units[n_units++] = j->unit;
+        }
+
+        FOREACH_ARRAY(u, units, n_units)
+                for (;;) {
+                        JobType t;
+                        Job *k;
+
+                        /* Dropping jobs for the units before might have
+                         * resolved the conflict already */
+                        j = hashmap_get(tr->jobs, *u);
+                        if (!j)
+                                break;
+
+                        k = job_find_unmergeable(j, &t);
+                        if (!k)
+                                break;
 
                         /* OK, we could not merge all jobs for this
                          * action. Let's see if we can get rid of one
                          * of them */
-
                         r = delete_one_unmergeable_job(tr, j);
-                        if (r >= 0)
-                                /* Ok, we managed to drop one, now
-                                 * let's ask our callers to call us
-                                 * again after garbage collecting */
-                                return -EAGAIN;
-
-                        /* We couldn't merge anything. Failure */
-                        return sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_JOBS_CONFLICTING,
-                                                 "Transaction contains conflicting jobs '%s' and '%s' for %s. "
-                                                 "Probably contradicting requirement dependencies configured.",
-                                                 job_type_to_string(t),
-                                                 job_type_to_string(k->type),
-                                                 k->unit->id);
+                        if (r < 0)
+                                /* We couldn't merge anything. Failure */
+                                return sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_JOBS_CONFLICTING,
+                                                         "Transaction contains conflicting jobs '%s' and '%s' for %s. "
+                                                         "Probably contradicting requirement dependencies configured.",
+                                                         job_type_to_string(t),
+                                                         job_type_to_string(k->type),
+                                                         k->unit->id);
+
+                        /* Ok, we managed to drop one, now let's garbage
+                         * collect its dependencies before looking at
+                         * the next conflict */
+                        if (collect_garbage) {
+                                r = transaction_collect_garbage(tr);
+                                if (r < 0)
+                                        return r;
+                        }
                 }
-        }
 
         /* Second step, merge the jobs. */
         HASHMAP_FOREACH(j, tr->jobs) {
@@ -274,38 +319,34 @@ static int transaction_merge_jobs(Transaction *tr, sd_bus_error *e) {
 }
 
 static void transaction_drop_redundant(Transaction *tr) {
-        bool again;
+        Job *j;
 
         /* Goes through the transaction and removes all jobs of the units whose jobs are all noops. If not
-         * all of a unit's jobs are redundant, they are kept. */
+         * all of a unit's jobs are redundant, they are kept. The jobs are dropped without their
+         * dependencies, hence only the current entry is removed and a single pass is enough. */
 
         assert(tr);
 
-        do {
-                Job *j;
-
-                again = false;
-
-                HASHMAP_FOREACH(j, tr->jobs) {
-                        bool keep = false;
-
-                        LIST_FOREACH(transaction, k, j)
-                                if (tr->anchor_job == k ||
-                                    !job_type_is_redundant(k->type, unit_active_state(k->unit)) ||
-                                    (k->unit->job && job_type_is_conflicting(k->type, k->unit->job->type))) {
-                                        keep = true;
-                                        break;
-                                }
+        HASHMAP_FOREACH(j, tr->jobs) {
+                bool keep = false;
 
-                        if (!keep) {
-                                log_trace("Found redundant job %s/%s, dropping from transaction.",
-                                          j->unit->id, job_type_to_string(j->type));
-                                transaction_delete_job(tr, j, false);
-                                again = true;
+                LIST_FOREACH(transaction, k, j)
+                        if (tr->anchor_job == k ||
+                            !job_type_is_redundant(k->type, unit_active_state(k->unit)) ||
+                            (k->unit->job && job_type_is_conflicting(k->type, k->unit->job->type))) {
+                                keep = true;
                                 break;
                         }
+
+                if (keep)
+                        continue;
+
+                LIST_FOREACH(transaction, k, j) {
+                        log_trace("Found redundant job %s/%s, dropping from transaction.",
+                                  k->unit->id, job_type_to_string(k->type));
+                        transaction_delete_job(tr, k, false);
                 }
-        } while (again);
+        }
 }
 
 static bool job_matters_to_anchor(Job *job) {
@@ -347,105 +388,129 @@ static char* merge_unit_ids(const char* unit_log_field, char * const* pairs) {
         return TAKE_PTR(ans);
 }
 
-static int transaction_verify_order_one(Transaction *tr, Job *j, Job *from, unsigned generation, sd_bus_error *e) {
-
-        static const UnitDependencyAtom directions[] = {
-                UNIT_ATOM_BEFORE,
-                UNIT_ATOM_AFTER,
-        };
-
-        int r;
+static int transaction_break_order_cycle(Transaction *tr, Job *j, Job *from, unsigned generation, sd_bus_error *e) {
+        Job *k, *delete = NULL;
+        _cleanup_free_ char **array = NULL, *unit_ids = NULL;
 
         assert(tr);
         assert(j);
-        assert(!j->transaction_prev);
-
-        /* Does a recursive sweep through the ordering graph, looking for a cycle. If we find a cycle we try
-         * to break it. */
+        assert(from);
 
-        /* Have we seen this before? */
-        if (j->generation == generation) {
-                Job *k, *delete = NULL;
-                _cleanup_free_ char **array = NULL, *unit_ids = NULL;
-
-                /* If the marker is NULL we have been here already and decided the job was loop-free from
-                 * here. Hence shortcut things and return right-away. */
-                if (!j->marker)
-                        return 0;
+        /* We went from 'from' to 'j', which is on our path already. We have a cycle. Let's try to break
+         * it. We go backwards in our path and try to find a suitable job to remove. We use the marker to
+         * find our way back, since smart how we are we stored our way back in there. */
+        for (k = from; k; k = ((k->generation == generation && k->marker != k) ? k->marker : NULL)) {
 
-                /* So, the marker is not NULL and we already have been here. We have a cycle. Let's try to
-                 * break it. We go backwards in our path and try to find a suitable job to remove. We use the
-                 * marker to find our way back, since smart how we are we stored our way back in there. */
-                for (k = from; k; k = ((k->generation == generation && k->marker != k) ? k->marker : NULL)) {
+                /* For logging below */
+                if (strv_push_pair(&array, k->unit->id, (char*) job_type_to_string(k->type)) < 0)
+                        log_oom();
 
-                        /* For logging below */
-                        if (strv_push_pair(&array, k->unit->id, (char*) job_type_to_string(k->type)) < 0)
-                                log_oom();
+                if (!delete && hashmap_contains(tr->jobs, k->unit) && !job_matters_to_anchor(k))
+                        /* Ok, we can drop this one, so let's do so. */
+                        delete = k;
 
-                        if (!delete && hashmap_contains(tr->jobs, k->unit) && !job_matters_to_anchor(k))
-                                /* Ok, we can drop this one, so let's do so. */
-                                delete = k;
+                /* Check if this in fact was the beginning of the cycle */
+                if (k == j)
+                        break;
+        }
 
-                        /* Check if this in fact was the beginning of the cycle */
-                        if (k == j)
-                                break;
-                }
+        unit_ids = merge_unit_ids(j->manager->unit_log_field, array); /* ignore error */
 
-                unit_ids = merge_unit_ids(j->manager->unit_log_field, array); /* ignore error */
-
-                STRV_FOREACH_PAIR(unit_id, job_type, array)
-                        /* logging for j not k here to provide a consistent narrative */
-                        log_struct(LOG_WARNING,
-                                   LOG_UNIT_MESSAGE(j->unit,
-                                                    "Found %s on %s/%s",
-                                                    unit_id == array ? "ordering cycle" : "dependency",
-                                                    *unit_id, *job_type),
-                                   "%s", strna(unit_ids));
-
-                if (delete) {
-                        const char *status;
-                        /* logging for j not k here to provide a consistent narrative */
-                        log_struct(LOG_ERR,
-                                   LOG_UNIT_MESSAGE(j->unit,
-                                                    "Job %s/%s deleted to break ordering cycle starting with %s/%s",
-                                                    delete->unit->id, job_type_to_string(delete->type),
-                                                    j->unit->id, job_type_to_string(j->type)),
-                                   "%s", strna(unit_ids));
-
-                        if (log_get_show_color())
-                                status = ANSI_HIGHLIGHT_RED " SKIP " ANSI_NORMAL;
-                        else
-                                status = " SKIP ";
-
-                        unit_status_printf(delete->unit,
-                                           STATUS_TYPE_NOTICE,
-                                           status,
-                                           "Ordering cycle found, skipping %s",
-                                           unit_status_string(delete->unit, NULL));
-                        transaction_delete_unit(tr, delete->unit);
-                        return -EAGAIN;
-                }
+        STRV_FOREACH_PAIR(unit_id, job_type, array)
+                /* logging for j not k here to provide a consistent narrative */
+                log_struct(LOG_WARNING,
+                           LOG_UNIT_MESSAGE(j->unit,
+                                            "Found %s on %s/%s",
+                                            unit_id == array ? "ordering cycle" : "dependency",
+                                            *unit_id, *job_type),
+                           "%s", strna(unit_ids));
 
+        if (delete) {
+                const char *status;
+                /* logging for j not k here to provide a consistent narrative */
                 log_struct(LOG_ERR,
-                           LOG_UNIT_MESSAGE(j->unit, "Unable to break cycle starting with %s/%s",
+                           LOG_UNIT_MESSAGE(j->unit,
+                                            "Job %s/%s deleted to break ordering cycle starting with %s/%s",
+                                            delete->unit->id, job_type_to_string(delete->type),
                                             j->unit->id, job_type_to_string(j->type)),
                            "%s", strna(unit_ids));
 
-                return sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC,
-                                         "Transaction order is cyclic. See system logs for details.");
+                if (log_get_show_color())
+                        status = ANSI_HIGHLIGHT_RED " SKIP " ANSI_NORMAL;
+                else
+                        status = " SKIP ";
+
+                unit_status_printf(delete->unit,
+                                   STATUS_TYPE_NOTICE,
+                                   status,
+                                   "Ordering cycle found, skipping %s",
+                                   unit_status_string(delete->unit, NULL));
+                transaction_delete_unit(tr, delete->unit);
+                return -EAGAIN;
         }
 
+        log_struct(LOG_ERR,
+                   LOG_UNIT_MESSAGE(j->unit, "Unable to break cycle starting with %s/%s",
+                                    j->unit->id, job_type_to_string(j->type)),
+                   "%s", strna(unit_ids));
+
+        return sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC,
+                                 "Transaction order is cyclic. See system logs for details.");
+}
+
+/* The state of the depth-first sweep through the ordering graph. Instead of recursing, the jobs on the
+ * current path are kept on an explicit stack, so that long ordering chains can't exhaust the stack. Each
+ * entry refers to the jobs ordered after its job, which are collected once when the job is entered and
+ * stacked up in 'after'. */
+typedef struct OrderPathEntry {
+        Job *job;
+        size_t after_start;
+        size_t after_next;
+} OrderPathEntry;
+
+typedef struct OrderSweep {
+        unsigned generation;
+
+        OrderPathEntry *path;
+        size_t n_path;
+
+        Job **after;
+        size_t n_after;
+} OrderSweep;
+
+static void order_sweep_done(OrderSweep *w) {
+        assert(w);
+
+        free(w->path);
+        free(w->after);
+}
+
+static int order_sweep_enter(Transaction *tr, OrderSweep *w, Job *j, Job *from) {
+
+        static const UnitDependencyAtom directions[] = {
+                UNIT_ATOM_BEFORE,
+                UNIT_ATOM_AFTER,
+        };
+
+        size_t start;
+
+        assert(tr);
+        assert(w);
+        assert(j);
+        assert(!j->transaction_prev);
+
         /* Make the marker point to where we come from, so that we can
          * find our way backwards if we want to break a cycle. We use
          * a special marker for the beginning: we point to
          * ourselves. */
         j->marker = from ?: j;
-        j->generation = generation;
+        j->generation = w->generation;
 
         /* Actual ordering of jobs depends on the unit ordering dependency and job types. We need to traverse
          * the graph over 'before' edges in the actual job execution order. We traverse over both unit
          * ordering dependencies and we test with job_compare() whether it is the 'before' edge in the job
          * execution ordering. */
+        start = w->n_after;
         for (size_t d = 0; d < ELEMENTSOF(directions); d++) {
                 Unit *u;
 
@@ -466,23 +531,80 @@ static int transaction_verify_order_one(Transaction *tr, Job *j, Job *from, unsi
                         if (job_compare(j, o, directions[d]) >= 0)
                                 continue;
 
-                        r = transaction_verify_order_one(tr, o, j, generation, e);
-                        if (r < 0)
-                                return r;
+                        if (!GREEDY_REALLOC(w->after, w->n_after + 1))
+                                return -ENOMEM;
+
+                        w->after[w->n_after++] = o;
                 }
         }
 
-        /* Ok, let's backtrack, and remember that this entry is not on
-         * our path anymore. */
-        j->marker = NULL;
+        if (!GREEDY_REALLOC(w->path, w->n_path + 1))
+                return -ENOMEM;
+
+        w->path[w->n_path++] = (OrderPathEntry) {
+                .job = j,
+                .after_start = start,
+                .after_next = start,
+        };
+
+        return 0;
+}
+
+static int transaction_verify_order_one(Transaction *tr, OrderSweep *w, Job *j, sd_bus_error *e) {
+        int r;
+
+        assert(tr);
+        assert(w);
+        assert(j);
+
+        /* Does a depth-first sweep through the ordering graph starting at j, looking for a cycle. If we
+         * find a cycle we try to break it. */
+
+        /* Have we been here before and decided the job was loop-free from here? */
+        if (j->generation == w->generation)
+                return 0;
+
+        r = order_sweep_enter(tr, w, j, NULL);
+        if (r < 0)
+                return r;
+
+        while (w->n_path > 0) {
+                OrderPathEntry *p = w->path + w->n_path - 1;
+                Job *o;
+
+                /* The jobs ordered after the innermost job on our path are at the end of the stack */
+                if (p->after_next >= w->n_after) {
+                        /* Ok, let's backtrack, and remember that this entry is not on
+                         * our path anymore. */
+                        p->job->marker = NULL;
+                        w->n_after = p->after_start;
+                        w->n_path--;
+                        continue;
+                }
+
+                o = w->after[p->after_next++];
+
+                if (o->generation == w->generation) {
+                        /* If the marker is NULL we have been here already and decided the job was
+                         * loop-free from here. Hence shortcut things. */
+                        if (!o->marker)
+                                continue;
+
+                        return transaction_break_order_cycle(tr, o, p->job, w->generation, e);
+                }
+
+                r = order_sweep_enter(tr, w, o, p->job);
+                if (r < 0)
+                        return r;
+        }
 
         return 0;
 }
 
 static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bus_error *e) {
+        _cleanup_(order_sweep_done) OrderSweep w = {};
         Job *j;
         int r;
-        unsigned g;
 
         assert(tr);
         assert(generation);
@@ -490,10 +612,10 @@ static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bu
         /* Check if the ordering graph is cyclic. If it is, try to fix
          * that up by dropping one of the jobs. */
 
-        g = (*generation)++;
+        w.generation = (*generation)++;
 
         HASHMAP_FOREACH(j, tr->jobs) {
-                r = transaction_verify_order_one(tr, j, NULL, g, e);
+                r = transaction_verify_order_one(tr, &w, j, e);
                 if (r < 0)
                         return r;
         }
@@ -501,36 +623,73 @@ static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bu
         return 0;
 }
 
-static void transaction_collect_garbage(Transaction *tr) {
-        bool again;
+static int transaction_collect_garbage_queue(Job ***queue, size_t *n_queue, Transaction *tr, Job *j) {
+        assert(queue);
+        assert(n_queue);
+        assert(tr);
+
+        /* Only the first job of a unit is looked at, as before the jobs are merged the others are kept
+         * regardless of whether anything requires them. When the first job is dropped, the next one
+         * takes its place and is considered instead. */
+        if (!j || j->transaction_prev || tr->anchor_job == j || j->object_list)
+                return 0;
+
+        if (!GREEDY_REALLOC(*queue, *n_queue + 1))
+                return -ENOMEM;
+
+        (*queue)[(*n_queue)++] = j;
+        return 0;
+}
+
+static int transaction_collect_garbage(Transaction *tr) {
+        _cleanup_free_ Job **queue = NULL;
+        size_t n_queue = 0;
+        Job *j;
+        int r;
 
         assert(tr);
 
-        /* Drop jobs that are not required by any other job */
+        /* Drop jobs that are not required by any other job. Dropping a job may leave the jobs it pulled in
+         * without anything requiring them, hence those are queued up and dropped too, instead of
+         * rescanning the whole transaction after each dropped job. */
 
-        do {
-                Job *j;
+        HASHMAP_FOREACH(j, tr->jobs) {
+                r = transaction_collect_garbage_queue(&queue, &n_queue, tr, j);
+                if (r < 0)
+                        return r;
+        }
 
-                again = false;
+        while (n_queue > 0) {
+                Job *next;
 
-                HASHMAP_FOREACH(j, tr->jobs) {
-                        if (tr->anchor_job == j)
-                                continue;
+                j = queue[--n_queue];
+                next = j->transaction_next;
 
-                        if (!j->object_list) {
-                                log_trace("Garbage collecting job %s/%s", j->unit->id, job_type_to_string(j->type));
-                                transaction_delete_job(tr, j, true);
-                                again = true;
-                                break;
-                        }
+                log_trace("Garbage collecting job %s/%s", j->unit->id, job_type_to_string(j->type));
+
+                /* Drop the links to the jobs pulled in by this one first. A job is queued when its last
+                 * link goes away or when it becomes the first job of its unit, hence exactly once. */
+                while (j->subject_list) {
+                        Job *o = j->subject_list->object;
+
+                        job_dependency_free(j->subject_list);
+
+                        if (o == j)
+                                continue;
 
-                        log_trace("Keeping job %s/%s because of %s/%s",
-                                  j->unit->id, job_type_to_string(j->type),
-                                  j->object_list->subject ? j->object_list->subject->unit->id : "root",
-                                  j->object_list->subject ? job_type_to_string(j->object_list->subject->type) : "root");
+                        r = transaction_collect_garbage_queue(&queue, &n_queue, tr, o);
+                        if (r < 0)
+                                return r;
                 }
 
-        } while (again);
+                transaction_delete_job(tr, j, true);
+
+                r = transaction_collect_garbage_queue(&queue, &n_queue, tr, next);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
 }
 
 static int transaction_is_destructive(Transaction *tr, JobMode mode, sd_bus_error *e) {
@@ -730,8 +889,11 @@ int transaction_activate(
         for (;;) {
                 /* Fourth step: Let's remove unneeded jobs that might
                  * be lurking. */
-                if (mode != JOB_ISOLATE)
-                        transaction_collect_garbage(tr);
+                if (mode != JOB_ISOLATE) {
+                        r = transaction_collect_garbage(tr);
+                        if (r < 0)
+                                return log_oom();
+                }
 
                 /* Fifth step: verify order makes sense and correct
                  * cycles if necessary and possible */
@@ -739,6 +901,8 @@ int transaction_activate(
                 if (r >= 0)
                         break;
 
+                if (r == -ENOMEM)
+                        return log_oom();
                 if (r != -EAGAIN)
                         return log_warning_errno(r, "Requested transaction contains an unfixable cyclic ordering dependency: %s", bus_error_message(e, r));
 
@@ -746,25 +910,14 @@ int transaction_activate(
                  * graph is still cyclic... */
         }
 
-        for (;;) {
-                /* Sixth step: let's drop unmergeable entries if
-                 * necessary and possible, merge entries we can
-                 * merge */
-                r = transaction_merge_jobs(tr, e);
-                if (r >= 0)
-                        break;
-
-                if (r != -EAGAIN)
-                        return log_warning_errno(r, "Requested transaction contains unmergeable jobs: %s", bus_error_message(e, r));
-
-                /* Seventh step: an entry got dropped, let's garbage
-                 * collect its dependencies. */
-                if (mode != JOB_ISOLATE)
-                        transaction_collect_garbage(tr);
-
-                /* Let's see if the resulting transaction still has
-                 * unmergeable entries ... */
-        }
+        /* Sixth step: let's drop unmergeable entries if necessary and
+         * possible, merge entries we can merge. Seventh step: whenever
+         * an entry got dropped, garbage collect its dependencies. */
+        r = transaction_merge_jobs(tr, /* collect_garbage= */ mode != JOB_ISOLATE, e);
+        if (r == -ENOMEM)
+                return log_oom();
+        if (r < 0)
+                return log_warning_errno(r, "Requested transaction contains unmergeable jobs: %s", bus_error_message(e, r));
 
         /* Eights step: Drop redundant jobs again, if the merging now allows us to drop more. */
         transaction_drop_redundant(tr);
@@ -973,14 +1126,24 @@ int transaction_add_job_and_dependencies(
                  * before we had a chance to retry loading this particular unit.
                  *
                  * Given building up the transaction is a synchronous operation, attempt
-                 * to load the unit immediately. */
-                if (r < 0 && manager_unit_cache_should_retry_load(unit)) {
-                        sd_bus_error_free(e);
-                        unit->load_state = UNIT_STUB;
-                        r = unit_load(unit);
-                        if (r < 0 || unit->load_state == UNIT_STUB)
-                                unit->load_state = UNIT_NOT_FOUND;
-                        r = bus_unit_validate_load_state(unit, e);
+                 * to load the unit immediately.
+                 *
+                 * Checking the paths means looking at all unit directories, and units that are not found
+                 * tend to be pulled in by many others, hence do this only once per unit and transaction. */
+                if (r < 0) {
+                        int k;
+
+                        k = set_ensure_put(&tr->units_load_checked, NULL, unit);
+                        if (k < 0)
+                                return k;
+                        if (k > 0 && manager_unit_cache_should_retry_load(unit)) {
+                                sd_bus_error_free(e);
+                                unit->load_state = UNIT_STUB;
+                                r = unit_load(unit);
+                                if (r < 0 || unit->load_state == UNIT_STUB)
+                                        unit->load_state = UNIT_NOT_FOUND;
+                                r = bus_unit_validate_load_state(unit, e);
+                        }
                 }
                 if (r < 0)
                         return r;
@@ -1247,6 +1410,7 @@ Transaction *transaction_free(Transaction *tr) {
 
         assert(hashmap_isempty(tr->jobs));
         hashmap_free(tr->jobs);
+        set_free(tr->units_load_checked);
 
         return mfree(tr);
 }
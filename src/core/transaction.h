@@ -6,12 +6,14 @@ typedef struct Transaction Transaction;
 #include "hashmap.h"
 #include "job.h"
 #include "manager.h"
+#include "set.h"
 #include "unit.h"
 
 struct Transaction {
         /* Jobs to be added */
         Hashmap *jobs;      /* Unit object => Job object list 1:1 */
         Job *anchor_job;      /* the job the user asked for */
+        Set *units_load_checked; /* units not loaded properly that were checked for changes on disk */
         bool irreversible;
 };
 
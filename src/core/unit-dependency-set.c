@@ -0,0 +1,363 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "unit-dependency-set.h"
+
+static UnitDependencyEntry* unit_dependency_set_find(const UnitDependencySet *s, const Unit *u) {
+        assert(s);
+        assert(!s->is_hashmap);
+
+        for (unsigned i = 0; i < s->n_entries; i++)
+                if (s->array[i].unit == u)
+                        return s->array + i;
+
+        return NULL;
+}
+
+UnitDependencyInfo unit_dependency_set_get(const UnitDependencySet *s, const Unit *u) {
+        UnitDependencyEntry *e;
+
+        if (!s)
+                return (UnitDependencyInfo) {};
+
+        if (s->is_hashmap)
+                return (UnitDependencyInfo) { .data = hashmap_get(s->hashmap, u) };
+
+        e = unit_dependency_set_find(s, u);
+        return e ? e->info : (UnitDependencyInfo) {};
+}
+
+static int unit_dependency_set_make_hashmap(UnitDependencySet *s, unsigned n_entries) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        int r;
+
+        assert(s);
+        assert(!s->is_hashmap);
+
+        h = hashmap_new(NULL);
+        if (!h)
+                return -ENOMEM;
+
+        r = hashmap_reserve(h, n_entries);
+        if (r < 0)
+                return r;
+
+        FOREACH_ARRAY(e, s->array, s->n_entries)
+                assert_se(hashmap_put(h, e->unit, e->info.data) > 0);
+
+        free(s->array);
+        s->hashmap = TAKE_PTR(h);
+        s->is_hashmap = true;
+        return 0;
+}
+
+int unit_dependency_set_reserve(UnitDependencySet *s, unsigned n_entries_add) {
+        unsigned n;
+
+        assert(s);
+
+        /* Makes sure that adding the specified number of entries cannot fail */
+
+        if (s->is_hashmap)
+                return hashmap_reserve(s->hashmap, n_entries_add);
+
+        if (n_entries_add > UINT_MAX - s->n_entries)
+                return -ENOMEM;
+
+        n = s->n_entries + n_entries_add;
+        if (n > UNIT_DEPENDENCY_SET_ARRAY_MAX)
+                return unit_dependency_set_make_hashmap(s, n);
+
+        if (!GREEDY_REALLOC(s->array, n))
+                return -ENOMEM;
+
+        return 0;
+}
+
+int unit_dependency_set_replace(UnitDependencySet *s, Unit *u, UnitDependencyInfo info) {
+        UnitDependencyEntry *e;
+        int r;
+
+        assert(s);
+        assert(u);
+        assert(info.data);
+
+        if (!s->is_hashmap) {
+                e = unit_dependency_set_find(s, u);
+                if (e) {
+                        e->info = info;
+                        return 0;
+                }
+
+                r = unit_dependency_set_reserve(s, 1);
+                if (r < 0)
+                        return r;
+        }
+
+        if (s->is_hashmap) {
+                r = hashmap_replace(s->hashmap, u, info.data);
+                if (r < 0)
+                        return r;
+
+                s->n_entries = hashmap_size(s->hashmap);
+                return 0;
+        }
+
+        s->array[s->n_entries++] = (UnitDependencyEntry) {
+                .unit = u,
+                .info = info,
+        };
+
+        return 0;
+}
+
+UnitDependencyInfo unit_dependency_set_remove(UnitDependencySet *s, const Unit *u) {
+        UnitDependencyInfo info = {};
+        UnitDependencyEntry *e;
+
+        if (!s)
+                return info;
+
+        if (s->is_hashmap) {
+                info.data = hashmap_remove(s->hashmap, u);
+                s->n_entries = hashmap_size(s->hashmap);
+        } else {
+                e = unit_dependency_set_find(s, u);
+                if (!e)
+                        return info;
+
+                /* Move the last entry into the hole. As arrays are iterated backwards, this doesn't disturb
+                 * an iteration that is at the removed entry. */
+                info = e->info;
+                *e = s->array[--s->n_entries];
+        }
+
+        return info;
+}
+
+bool unit_dependency_set_move(UnitDependencySet *s, const Unit *from, Unit *to) {
+        UnitDependencyInfo info, existing;
+        UnitDependencyEntry *e, *f;
+
+        assert(to);
+
+        if (!s)
+                return false;
+
+        if (s->is_hashmap) {
+                info.data = hashmap_remove(s->hashmap, from);
+                if (!info.data)
+                        return false;
+
+                existing.data = hashmap_get(s->hashmap, to);
+                if (existing.data) {
+                        info.origin_mask |= existing.origin_mask;
+                        info.destination_mask |= existing.destination_mask;
+                }
+
+                /* An entry was just removed, hence this doesn't need to allocate */
+                assert_se(hashmap_replace(s->hashmap, to, info.data) >= 0);
+                s->n_entries = hashmap_size(s->hashmap);
+                return true;
+        }
+
+        e = unit_dependency_set_find(s, from);
+        if (!e)
+                return false;
+
+        f = unit_dependency_set_find(s, to);
+        if (!f) {
+                e->unit = to;
+                return true;
+        }
+
+        f->info.origin_mask |= e->info.origin_mask;
+        f->info.destination_mask |= e->info.destination_mask;
+        *e = s->array[--s->n_entries];
+        return true;
+}
+
+Unit* unit_dependency_set_steal_first(UnitDependencySet *s, UnitDependencyInfo *ret_info) {
+        UnitDependencyInfo info;
+        Unit *u;
+
+        if (!s || s->n_entries == 0)
+                return NULL;
+
+        if (s->is_hashmap) {
+                info.data = hashmap_steal_first_key_and_value(s->hashmap, (void**) &u);
+                s->n_entries = hashmap_size(s->hashmap);
+        } else {
+                s->n_entries--;
+                u = s->array[s->n_entries].unit;
+                info = s->array[s->n_entries].info;
+        }
+
+        if (ret_info)
+                *ret_info = info;
+
+        return u;
+}
+
+void unit_dependency_set_done(UnitDependencySet *s) {
+        assert(s);
+
+        if (s->is_hashmap)
+                hashmap_free(s->hashmap);
+        else
+                free(s->array);
+
+        *s = (UnitDependencySet) {};
+}
+
+bool unit_dependency_set_iterate(
+                const UnitDependencySet *s,
+                UnitDependencySetIterator *i,
+                Unit **ret_unit,
+                UnitDependencyInfo *ret_info) {
+
+        UnitDependencyInfo info;
+        Unit *u;
+
+        assert(i);
+
+        if (!s || s->n_entries == 0)
+                return false;
+
+        if (s->is_hashmap) {
+                if (!hashmap_iterate(s->hashmap, &i->iterator, &info.data, (const void**) &u))
+                        return false;
+        } else {
+                /* Arrays are iterated backwards, so that removing the current entry, which moves the last
+                 * entry into its place, doesn't make us skip any. */
+                i->idx = MIN(i->idx, s->n_entries);
+                if (i->idx == 0)
+                        return false;
+
+                i->idx--;
+                u = s->array[i->idx].unit;
+                info = s->array[i->idx].info;
+        }
+
+        if (ret_unit)
+                *ret_unit = u;
+        if (ret_info)
+                *ret_info = info;
+
+        return true;
+}
+
+UnitDependencySet* unit_dependencies_ensure(UnitDependencies *d, UnitDependency t) {
+        UnitDependencySet *s;
+        size_t n, k;
+
+        assert(d);
+        assert(t >= 0 && t < _UNIT_DEPENDENCY_MAX);
+
+        s = unit_dependencies_get(d, t);
+        if (s)
+                return s;
+
+        n = __builtin_popcountll(d->types);
+        k = __builtin_popcountll(d->types & ((UINT64_C(1) << t) - 1));
+
+        /* The array is allocated to the exact size, most units have a fixed set of dependency types once
+         * loaded */
+        s = reallocarray(d->sets, n + 1, sizeof(UnitDependencySet));
+        if (!s)
+                return NULL;
+
+        d->sets = s;
+        memmove(d->sets + k + 1, d->sets + k, (n - k) * sizeof(UnitDependencySet));
+        d->sets[k] = (UnitDependencySet) {};
+        SET_BIT(d->types, t);
+
+        return d->sets + k;
+}
+
+void unit_dependencies_remove(UnitDependencies *d, UnitDependency t) {
+        UnitDependencySet *s;
+        size_t n, k;
+
+        assert(d);
+
+        s = unit_dependencies_get(d, t);
+        if (!s)
+                return;
+
+        unit_dependency_set_done(s);
+
+        n = __builtin_popcountll(d->types);
+        k = s - d->sets;
+        memmove(d->sets + k, d->sets + k + 1, (n - k - 1) * sizeof(UnitDependencySet));
+        CLEAR_BIT(d->types, t);
+
+        if (d->types == 0)
+                d->sets = mfree(d->sets);
+}
+
+void unit_dependencies_trim(UnitDependencies *d) {
+        uint64_t types;
+
+        assert(d);
+
+        types = d->types;
+        BIT_FOREACH(t, types)
+                if (unit_dependency_set_isempty(unit_dependencies_get(d, t)))
+                        unit_dependencies_remove(d, t);
+}
+
+bool unit_dependencies_steal_first(UnitDependencies *d, UnitDependency *ret_type, UnitDependencySet *ret_set) {
+        UnitDependency t;
+        size_t n;
+
+        assert(d);
+        assert(ret_type);
+        assert(ret_set);
+
+        if (d->types == 0)
+                return false;
+
+        t = __builtin_ctzll(d->types);
+        n = __builtin_popcountll(d->types);
+
+        *ret_type = t;
+        *ret_set = d->sets[0];
+
+        memmove(d->sets, d->sets + 1, (n - 1) * sizeof(UnitDependencySet));
+        CLEAR_BIT(d->types, t);
+
+        if (d->types == 0)
+                d->sets = mfree(d->sets);
+
+        return true;
+}
+
+void unit_dependencies_done(UnitDependencies *d) {
+        assert(d);
+
+        FOREACH_ARRAY(s, d->sets, __builtin_popcountll(d->types))
+                unit_dependency_set_done(s);
+
+        d->sets = mfree(d->sets);
+        d->types = 0;
+}
+
+void unit_dependencies_memory_usage(UnitDependencies *d, UnitDependenciesMemory *m) {
+        assert(d);
+        assert(m);
+
+        FOREACH_ARRAY(s, d->sets, __builtin_popcountll(d->types)) {
+                if (s->is_hashmap) {
+                        m->n_sets_hashmap++;
+                        m->size += hashmap_memory_usage(s->hashmap);
+                } else {
+                        m->n_sets_array++;
+                        m->size += MALLOC_SIZEOF_SAFE(s->array);
+                }
+
+                m->n_entries += s->n_entries;
+        }
+
+        m->size += MALLOC_SIZEOF_SAFE(d->sets);
+}
@@ -0,0 +1,171 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bitfield.h"
+#include "hashmap.h"
+#include "macro.h"
+#include "unit-def.h"
+
+typedef struct Unit Unit;
+
+/* Stores the 'reason' a dependency was created as a bit mask, i.e. due to which configuration source it came to be. We
+ * use this so that we can selectively flush out parts of dependencies again. Note that the same dependency might be
+ * created as a result of multiple "reasons", hence the bitmask. */
+typedef enum UnitDependencyMask {
+        /* Configured directly by the unit file, .wants/.requires symlink or drop-in, or as an immediate result of a
+         * non-dependency option configured that way.  */
+        UNIT_DEPENDENCY_FILE               = 1 << 0,
+
+        /* As unconditional implicit dependency (not affected by unit configuration — except by the unit name and
+         * type) */
+        UNIT_DEPENDENCY_IMPLICIT           = 1 << 1,
+
+        /* A dependency effected by DefaultDependencies=yes. Note that dependencies marked this way are conceptually
+         * just a subset of UNIT_DEPENDENCY_FILE, as DefaultDependencies= is itself a unit file setting that can only
+         * be set in unit files. We make this two separate bits only to help debugging how dependencies came to be. */
+        UNIT_DEPENDENCY_DEFAULT            = 1 << 2,
+
+        /* A dependency created from udev rules */
+        UNIT_DEPENDENCY_UDEV               = 1 << 3,
+
+        /* A dependency created because of some unit's RequiresMountsFor= setting */
+        UNIT_DEPENDENCY_PATH               = 1 << 4,
+
+        /* A dependency initially configured from the mount unit file however the dependency will be updated
+         * from /proc/self/mountinfo as soon as the kernel will make the entry for that mount available in
+         * the /proc file */
+        UNIT_DEPENDENCY_MOUNT_FILE         = 1 << 5,
+
+        /* A dependency created or updated because of data read from /proc/self/mountinfo */
+        UNIT_DEPENDENCY_MOUNTINFO          = 1 << 6,
+
+        /* A dependency created because of data read from /proc/swaps and no other configuration source */
+        UNIT_DEPENDENCY_PROC_SWAP          = 1 << 7,
+
+        /* A dependency for units in slices assigned by directly setting Slice= */
+        UNIT_DEPENDENCY_SLICE_PROPERTY     = 1 << 8,
+
+        _UNIT_DEPENDENCY_MASK_FULL         = (1 << 9) - 1,
+} UnitDependencyMask;
+
+/* The dependency sets and the requires_mounts_for hashmap of a unit use this structure as value. It has the same size
+ * as a void pointer, and thus can be stored directly as hashmap value, without any indirection. Note that this stores
+ * two masks, as both the origin and the destination of a dependency might have created it. A zero value means there
+ * is no dependency. */
+typedef union UnitDependencyInfo {
+        void *data;
+        struct {
+                UnitDependencyMask origin_mask:16;
+                UnitDependencyMask destination_mask:16;
+        } _packed_;
+} UnitDependencyInfo;
+
+/* The dependencies of a unit of one type, i.e. a map Unit* → UnitDependencyInfo. Most units only have a
+ * handful of dependencies of each type, hence they are kept in a small array, which is searched linearly.
+ * Only once it grows beyond UNIT_DEPENDENCY_SET_ARRAY_MAX entries the set is converted into a hashmap. */
+#define UNIT_DEPENDENCY_SET_ARRAY_MAX 16U
+
+typedef struct UnitDependencyEntry {
+        Unit *unit;
+        UnitDependencyInfo info;
+} UnitDependencyEntry;
+
+typedef struct UnitDependencySet {
+        union {
+                UnitDependencyEntry *array; /* if !is_hashmap */
+                Hashmap *hashmap;           /* if  is_hashmap */
+        };
+        unsigned n_entries;
+        bool is_hashmap;
+} UnitDependencySet;
+
+/* All dependencies of a unit. Only the sets of the dependency types the unit actually has dependencies of are
+ * allocated, in a single array ordered by type. */
+typedef struct UnitDependencies {
+        uint64_t types;          /* mask of UnitDependency types that have a set */
+        UnitDependencySet *sets; /* one for each bit set in types */
+} UnitDependencies;
+
+assert_cc(_UNIT_DEPENDENCY_MAX <= 64);
+
+typedef struct UnitDependencySetIterator {
+        unsigned idx;
+        Iterator iterator;
+} UnitDependencySetIterator;
+
+#define UNIT_DEPENDENCY_SET_ITERATOR_FIRST              \
+        ((UnitDependencySetIterator) {                  \
+                .idx = UINT_MAX,                        \
+                .iterator = ITERATOR_FIRST,             \
+        })
+
+static inline UnitDependencySet* unit_dependencies_get(const UnitDependencies *d, UnitDependency t) {
+        assert(d);
+        assert(t >= 0 && t < _UNIT_DEPENDENCY_MAX);
+
+        if (!BIT_SET(d->types, t))
+                return NULL;
+
+        return d->sets + __builtin_popcountll(d->types & ((UINT64_C(1) << t) - 1));
+}
+
+UnitDependencySet* unit_dependencies_ensure(UnitDependencies *d, UnitDependency t);
+void unit_dependencies_remove(UnitDependencies *d, UnitDependency t);
+/* Removes the sets that became empty */
+void unit_dependencies_trim(UnitDependencies *d);
+bool unit_dependencies_steal_first(UnitDependencies *d, UnitDependency *ret_type, UnitDependencySet *ret_set);
+void unit_dependencies_done(UnitDependencies *d);
+
+static inline unsigned unit_dependency_set_size(const UnitDependencySet *s) {
+        return s ? s->n_entries : 0;
+}
+
+static inline bool unit_dependency_set_isempty(const UnitDependencySet *s) {
+        return unit_dependency_set_size(s) == 0;
+}
+
+UnitDependencyInfo unit_dependency_set_get(const UnitDependencySet *s, const Unit *u);
+static inline bool unit_dependency_set_contains(const UnitDependencySet *s, const Unit *u) {
+        return !!unit_dependency_set_get(s, u).data;
+}
+
+/* Adds the entry, or replaces an existing one for the same unit. Replacing never fails. */
+int unit_dependency_set_replace(UnitDependencySet *s, Unit *u, UnitDependencyInfo info);
+int unit_dependency_set_reserve(UnitDependencySet *s, unsigned n_entries_add);
+/* Sets keep their memory when entries are removed, see unit_dependencies_trim() */
+UnitDependencyInfo unit_dependency_set_remove(UnitDependencySet *s, const Unit *u);
+/* Makes the entry of 'from' refer to 'to', merging it into an existing entry of 'to'. Never fails. */
+bool unit_dependency_set_move(UnitDependencySet *s, const Unit *from, Unit *to);
+Unit* unit_dependency_set_steal_first(UnitDependencySet *s, UnitDependencyInfo *ret_info);
+void unit_dependency_set_done(UnitDependencySet *s);
+
+/* Like with hashmaps, the current entry may be removed or updated while iterating. The set expression
+ * passed to the FOREACH macros is evaluated in each step, hence if it looks the set up in the unit, the
+ * dependency sets of the unit may be reallocated while iterating, e.g. by adding dependencies of other
+ * types. */
+bool unit_dependency_set_iterate(
+                const UnitDependencySet *s,
+                UnitDependencySetIterator *i,
+                Unit **ret_unit,
+                UnitDependencyInfo *ret_info);
+
+#define _UNIT_DEPENDENCY_SET_FOREACH(u, info, s, i)                     \
+        for (UnitDependencySetIterator i = UNIT_DEPENDENCY_SET_ITERATOR_FIRST; \
+             unit_dependency_set_iterate((s), &i, &(u), (info)); )
+#define UNIT_DEPENDENCY_SET_FOREACH(u, s)                               \
+        _UNIT_DEPENDENCY_SET_FOREACH(u, NULL, s, UNIQ_T(i, UNIQ))
+#define UNIT_DEPENDENCY_SET_FOREACH_INFO(u, info, s)                    \
+        _UNIT_DEPENDENCY_SET_FOREACH(u, &(info), s, UNIQ_T(i, UNIQ))
+
+typedef struct UnitDependenciesMemory {
+        size_t n_sets_array;
+        size_t n_sets_hashmap;
+        size_t n_entries;
+        size_t size;
+} UnitDependenciesMemory;
+
+/* Adds the memory used by the dependencies to the counters */
+void unit_dependencies_memory_usage(UnitDependencies *d, UnitDependenciesMemory *m);
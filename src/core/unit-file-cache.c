@@ -0,0 +1,759 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <sys/mman.h>
+
+#include "alloc-util.h"
+#include "conf-parser.h"
+#include "cpu-set-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "load-fragment.h"
+#include "log.h"
+#include "memfd-util.h"
+#include "mkdir.h"
+#include "parse-util.h"
+#include "path-lookup.h"
+#include "process-util.h"
+#include "sparse-endian.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "unaligned.h"
+#include "unit-file-cache.h"
+#include "unit.h"
+
+/* An entry starts with the identity of the file it was read from, followed by the logical lines of the
+ * file, each as 32-bit line number and NUL terminated text. */
+struct unit_file_cache_entry_f {
+        le64_t dev;
+        le64_t ino;
+        le64_t size;
+        le64_t mtime;
+        le64_t ctime;
+} _packed_;
+
+/* Preloading only pays off if there is something to split among the workers */
+#define UNIT_FILE_CACHE_PRELOAD_MIN 16U
+#define UNIT_FILE_CACHE_PRELOAD_WORKERS_MAX 8U
+
+/* Worker processes pass their results as a sequence of these, each followed by an entry */
+struct unit_file_cache_preload_f {
+        le64_t index;
+        le64_t size;
+} _packed_;
+
+typedef struct UnitFileCacheEntry {
+        size_t size;
+        uint8_t data[];
+} UnitFileCacheEntry;
+
+int unit_file_cache_path(RuntimeScope scope, char **ret) {
+        char *p;
+
+        assert(ret);
+
+        switch (scope) {
+
+        case RUNTIME_SCOPE_SYSTEM:
+                p = strdup("/run/systemd/unit-file.cache");
+                if (!p)
+                        return -ENOMEM;
+
+                *ret = p;
+                return 0;
+
+        case RUNTIME_SCOPE_USER:
+                return xdg_user_runtime_dir(ret, "/systemd/unit-file.cache");
+
+        default:
+                return -EOPNOTSUPP;
+        }
+}
+
+void unit_file_cache_done(UnitFileCache *c) {
+        assert(c);
+
+        c->path = mfree(c->path);
+        c->table = strtab_free(c->table);
+        c->entries = hashmap_free(c->entries);
+        c->preloaded = hashmap_free(c->preloaded);
+        c->active = false;
+}
+
+static bool entry_matches(const struct unit_file_cache_entry_f *e, const struct stat *st) {
+        assert(e);
+        assert(st);
+
+        return le64toh(e->dev) == (uint64_t) st->st_dev &&
+                le64toh(e->ino) == (uint64_t) st->st_ino &&
+                le64toh(e->size) == (uint64_t) st->st_size &&
+                le64toh(e->mtime) == timespec_load_nsec(&st->st_mtim) &&
+                le64toh(e->ctime) == timespec_load_nsec(&st->st_ctim);
+}
+
+static int entry_new(const struct stat *st, const ConfigLines *lines, UnitFileCacheEntry **ret) {
+        _cleanup_free_ UnitFileCacheEntry *e = NULL;
+        size_t size = sizeof(struct unit_file_cache_entry_f);
+        uint8_t *p;
+
+        assert(st);
+        assert(lines);
+        assert(ret);
+
+        FOREACH_ARRAY(i, lines->lines, lines->n_lines)
+                size += sizeof(le32_t) + strlen(i->text) + 1;
+
+        e = malloc(offsetof(UnitFileCacheEntry, data) + size);
+        if (!e)
+                return -ENOMEM;
+
+        e->size = size;
+
+        struct unit_file_cache_entry_f h = {
+                .dev = htole64(st->st_dev),
+                .ino = htole64(st->st_ino),
+                .size = htole64(st->st_size),
+                .mtime = htole64(timespec_load_nsec(&st->st_mtim)),
+                .ctime = htole64(timespec_load_nsec(&st->st_ctim)),
+        };
+        p = mempcpy(e->data, &h, sizeof(h));
+
+        FOREACH_ARRAY(i, lines->lines, lines->n_lines) {
+                unaligned_write_le32(p, i->line);
+                p = (uint8_t*) stpcpy((char*) p + sizeof(le32_t), i->text) + 1;
+        }
+
+        assert(p == e->data + size);
+
+        *ret = TAKE_PTR(e);
+        return 0;
+}
+
+/* Returns 0 if the entry does not match the file anymore, 1 and the lines if it does. */
+static int entry_get_lines(const void *data, size_t size, const struct stat *st, ConfigLines *ret) {
+        _cleanup_(config_lines_done) ConfigLines lines = {};
+        const uint8_t *p = data, *end = p + size;
+        int r;
+
+        assert(data || size == 0);
+        assert(st);
+        assert(ret);
+
+        if (size < sizeof(struct unit_file_cache_entry_f))
+                return -EBADMSG;
+
+        if (!entry_matches(data, st))
+                return 0;
+
+        p += sizeof(struct unit_file_cache_entry_f);
+        while (p < end) {
+                const uint8_t *t;
+
+                if ((size_t) (end - p) <= sizeof(le32_t))
+                        return -EBADMSG;
+
+                t = memchr(p + sizeof(le32_t), 0, end - p - sizeof(le32_t));
+                if (!t)
+                        return -EBADMSG;
+
+                r = config_lines_add(&lines, unaligned_read_le32(p), (const char*) p + sizeof(le32_t));
+                if (r < 0)
+                        return r;
+
+                p = t + 1;
+        }
+
+        *ret = TAKE_STRUCT(lines);
+        return 1;
+}
+
+static int unit_file_cache_record(UnitFileCache *c, const char *filename, UnitFileCacheEntry *e) {
+        _cleanup_free_ UnitFileCacheEntry *old = NULL;
+        _cleanup_free_ char *k = NULL;
+        int r;
+
+        assert(c);
+        assert(filename);
+        assert(e);
+
+        old = hashmap_get(c->entries, filename);
+        if (old)
+                return hashmap_update(c->entries, filename, e);
+
+        k = strdup(filename);
+        if (!k)
+                return -ENOMEM;
+
+        r = hashmap_ensure_put(&c->entries, &path_hash_ops_free_free, k, e);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(k);
+        return 0;
+}
+
+/* Files that were modified very recently might be modified again without their timestamps changing, hence
+ * don't cache them. Similar to how git handles its index. */
+static bool stat_is_racy(const struct stat *st) {
+        assert(st);
+
+        return timespec_load(&st->st_ctim) + USEC_PER_SEC > now(CLOCK_REALTIME);
+}
+
+void unit_file_cache_begin(UnitFileCache *c) {
+        int r;
+
+        assert(c);
+
+        if (!c->path)
+                return;
+
+        c->table = strtab_free(c->table);
+        c->entries = hashmap_free(c->entries);
+        c->preloaded = hashmap_free(c->preloaded);
+        c->n_hits = c->n_misses = c->n_preloaded = c->n_preload_rounds = 0;
+        c->preload_usec = 0;
+        c->begin_usec = now(CLOCK_MONOTONIC);
+        c->active = true;
+
+        r = strtab_open(c->path, UNIT_FILE_CACHE_TYPE, &c->table);
+        if (r == -ENOENT)
+                return;
+        if (r < 0) {
+                log_debug_errno(r, "Failed to open unit file cache %s, ignoring: %m", c->path);
+                return;
+        }
+
+        if (strtab_get_stamp(c->table) != UNIT_FILE_CACHE_FORMAT) {
+                log_debug("Unit file cache %s has unknown format, ignoring.", c->path);
+                c->table = strtab_free(c->table);
+        }
+}
+
+static int stats_add(StrtabWriter *w, const char *name, uint64_t value) {
+        char buf[DECIMAL_STR_MAX(uint64_t)];
+
+        xsprintf(buf, "%" PRIu64, value);
+        return strtab_writer_add_string(w, UNIT_FILE_CACHE_SECTION_STATS, name, buf);
+}
+
+static int unit_file_cache_write(UnitFileCache *c) {
+        _cleanup_(strtab_writer_freep) StrtabWriter *w = NULL;
+        UnitFileCacheEntry *e;
+        const char *path;
+        int r;
+
+        assert(c);
+
+        r = strtab_writer_new(_UNIT_FILE_CACHE_SECTION_MAX, &w);
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH_KEY(e, path, c->entries) {
+                r = strtab_writer_add(w, UNIT_FILE_CACHE_SECTION_FILES, path, e->data, e->size);
+                if (r < 0)
+                        return r;
+        }
+
+        r = stats_add(w, "hits", c->n_hits);
+        if (r < 0)
+                return r;
+
+        r = stats_add(w, "misses", c->n_misses);
+        if (r < 0)
+                return r;
+
+        r = stats_add(w, "preloaded", c->n_preloaded);
+        if (r < 0)
+                return r;
+
+        r = stats_add(w, "preload-usec", c->preload_usec);
+        if (r < 0)
+                return r;
+
+        r = stats_add(w, "load-usec", usec_sub_unsigned(now(CLOCK_MONOTONIC), c->begin_usec));
+        if (r < 0)
+                return r;
+
+        r = stats_add(w, "timestamp", now(CLOCK_REALTIME));
+        if (r < 0)
+                return r;
+
+        (void) mkdir_parents(c->path, 0755);
+
+        /* Unit files and drop-ins might not be world-readable, and neither may be the settings we copied
+         * from them */
+        return strtab_writer_write(w, UNIT_FILE_CACHE_TYPE, UNIT_FILE_CACHE_FORMAT, c->path, 0600);
+}
+
+void unit_file_cache_end(UnitFileCache *c) {
+        int r;
+
+        assert(c);
+
+        if (!c->active)
+                return;
+
+        log_debug("Unit file cache: %u files up-to-date, %u files read (%u preloaded in %u rounds, %s).",
+                  c->n_hits, c->n_misses, c->n_preloaded, c->n_preload_rounds,
+                  FORMAT_TIMESPAN(c->preload_usec, USEC_PER_MSEC));
+
+        r = unit_file_cache_write(c);
+        if (r < 0)
+                log_debug_errno(r, "Failed to write unit file cache %s, ignoring: %m", c->path);
+
+        c->table = strtab_free(c->table);
+        c->entries = hashmap_free(c->entries);
+        c->preloaded = hashmap_free(c->preloaded);
+        c->active = false;
+}
+
+static int unit_file_cache_lookup(UnitFileCache *c, const char *filename, const struct stat *st, ConfigLines *ret) {
+        UnitFileCacheEntry *e;
+        const void *data;
+        size_t size;
+        int r;
+
+        assert(c);
+        assert(filename);
+        assert(st);
+        assert(ret);
+
+        /* Files used by multiple units, e.g. templates, are likely to be looked up again in the same cycle */
+        e = hashmap_get(c->entries, filename);
+        if (e)
+                return entry_get_lines(e->data, e->size, st, ret);
+
+        if (!c->table)
+                return 0;
+
+        r = strtab_lookup(c->table, UNIT_FILE_CACHE_SECTION_FILES, filename, &data, &size);
+        if (r <= 0)
+                return r;
+
+        r = entry_get_lines(data, size, st, ret);
+        if (r <= 0)
+                return r;
+
+        /* Carry the entry over into the next version of the cache */
+        e = malloc(offsetof(UnitFileCacheEntry, data) + size);
+        if (!e)
+                return -ENOMEM;
+
+        e->size = size;
+        memcpy(e->data, data, size);
+
+        r = unit_file_cache_record(c, filename, e);
+        if (r < 0) {
+                free(e);
+                return r;
+        }
+
+        return 1;
+}
+
+static int unit_file_cache_take_preloaded(UnitFileCache *c, const char *filename, const struct stat *st, ConfigLines *ret) {
+        _cleanup_free_ UnitFileCacheEntry *e = NULL;
+        _cleanup_free_ char *k = NULL;
+        int r;
+
+        assert(c);
+        assert(filename);
+        assert(st);
+        assert(ret);
+
+        e = hashmap_remove2(c->preloaded, filename, (void**) &k);
+        if (!e)
+                return 0;
+
+        /* The file might have been changed since it was read by the worker */
+        r = entry_get_lines(e->data, e->size, st, ret);
+        if (r <= 0)
+                return r;
+
+        if (stat_is_racy(st))
+                return 1;
+
+        r = unit_file_cache_record(c, filename, e);
+        if (r < 0)
+                log_debug_errno(r, "Failed to add %s to unit file cache, ignoring: %m", filename);
+        else
+                TAKE_PTR(e);
+
+        return 1;
+}
+
+int unit_file_cache_read_lines(UnitFileCache *c, const char *filename, FILE *f, ConfigLines *ret, struct stat *ret_stat) {
+        _cleanup_free_ UnitFileCacheEntry *e = NULL;
+        struct stat st;
+        int r;
+
+        assert(c);
+        assert(filename);
+        assert(ret);
+        assert(ret_stat);
+
+        if ((f ? fstat(fileno(f), &st) : stat(filename, &st)) >= 0 && S_ISREG(st.st_mode)) {
+                r = unit_file_cache_lookup(c, filename, &st, ret);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to look up %s in unit file cache, ignoring: %m", filename);
+                if (r > 0) {
+                        (void) stat_warn_permissions(filename, &st);
+
+                        c->n_hits++;
+                        *ret_stat = st;
+                        return 1;
+                }
+
+                r = unit_file_cache_take_preloaded(c, filename, &st, ret);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to use preloaded contents of %s, ignoring: %m", filename);
+                if (r > 0) {
+                        (void) stat_warn_permissions(filename, &st);
+
+                        c->n_misses++;
+                        c->n_preloaded++;
+                        *ret_stat = st;
+                        return 1;
+                }
+        }
+
+        r = config_read_lines(filename, f, /* flags= */ 0, ret, &st);
+        if (r <= 0) {
+                *ret_stat = st;
+                return r;
+        }
+
+        c->n_misses++;
+        *ret_stat = st;
+
+        if (!S_ISREG(st.st_mode) || stat_is_racy(&st))
+                return 1;
+
+        r = entry_new(&st, ret, &e);
+        if (r >= 0)
+                r = unit_file_cache_record(c, filename, e);
+        if (r < 0)
+                log_debug_errno(r, "Failed to add %s to unit file cache, ignoring: %m", filename);
+        else
+                TAKE_PTR(e);
+
+        return 1;
+}
+
+static int preload_worker(int fd, const char * const *paths, size_t n_paths, size_t k, size_t n_workers) {
+        _cleanup_fclose_ FILE *f = NULL;
+        int r;
+
+        assert(fd >= 0);
+        assert(paths || n_paths == 0);
+        assert(k < n_workers);
+
+        f = take_fdopen(&fd, "w");
+        if (!f)
+                return -errno;
+
+        for (size_t i = k; i < n_paths; i += n_workers) {
+                _cleanup_(config_lines_done) ConfigLines lines = {};
+                _cleanup_free_ UnitFileCacheEntry *e = NULL;
+                struct stat st;
+
+                /* Files which cannot be read are skipped, the manager will try again and log about it */
+                r = config_read_lines(paths[i], NULL, /* flags= */ 0, &lines, &st);
+                if (r <= 0 || !S_ISREG(st.st_mode))
+                        continue;
+
+                r = entry_new(&st, &lines, &e);
+                if (r < 0)
+                        return r;
+
+                struct unit_file_cache_preload_f h = {
+                        .index = htole64(i),
+                        .size = htole64(e->size),
+                };
+
+                if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+                    fwrite(e->data, e->size, 1, f) != 1)
+                        return errno_or_else(EIO);
+        }
+
+        return fflush_and_check(f);
+}
+
+static int preload_parse(UnitFileCache *c, const uint8_t *p, size_t size, const char * const *paths, size_t n_paths) {
+        int n = 0, r;
+
+        assert(c);
+        assert(p || size == 0);
+        assert(paths);
+
+        while (size > 0) {
+                _cleanup_free_ UnitFileCacheEntry *e = NULL;
+                _cleanup_free_ char *k = NULL;
+                struct unit_file_cache_preload_f h;
+                uint64_t i, sz;
+
+                if (size < sizeof(h))
+                        return -EBADMSG;
+
+                memcpy(&h, p, sizeof(h));
+                p += sizeof(h);
+                size -= sizeof(h);
+
+                i = le64toh(h.index);
+                sz = le64toh(h.size);
+                if (i >= n_paths || sz > size)
+                        return -EBADMSG;
+
+                e = malloc(offsetof(UnitFileCacheEntry, data) + sz);
+                if (!e)
+                        return -ENOMEM;
+
+                e->size = sz;
+                memcpy(e->data, p, sz);
+                p += sz;
+                size -= sz;
+
+                k = strdup(paths[i]);
+                if (!k)
+                        return -ENOMEM;
+
+                r = hashmap_ensure_put(&c->preloaded, &path_hash_ops_free_free, k, e);
+                if (r < 0)
+                        return r;
+
+                TAKE_PTR(k);
+                TAKE_PTR(e);
+                n++;
+        }
+
+        return n;
+}
+
+static int preload_collect(UnitFileCache *c, int fd, const char * const *paths, size_t n_paths) {
+        struct stat st;
+        void *p;
+        int r;
+
+        assert(c);
+        assert(fd >= 0);
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+        if (st.st_size == 0)
+                return 0;
+
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        r = preload_parse(c, p, st.st_size, paths, n_paths);
+        (void) munmap(p, st.st_size);
+        return r;
+}
+
+int unit_file_cache_preload(UnitFileCache *c, Set *paths) {
+        int fds[UNIT_FILE_CACHE_PRELOAD_WORKERS_MAX] = { [0 ... UNIT_FILE_CACHE_PRELOAD_WORKERS_MAX - 1] = -EBADF };
+        pid_t pids[UNIT_FILE_CACHE_PRELOAD_WORKERS_MAX] = {};
+        _cleanup_free_ const char **todo = NULL;
+        size_t n_todo = 0, n_workers, n_forked = 0;
+        int r = 0, n_added = 0, cpus;
+        const char *p;
+        usec_t start;
+
+        assert(c);
+
+        /* Reads the specified files in parallel in a number of worker processes, which pass back the
+         * tokenized contents, so that unit_file_cache_parse() can pick them up later. We use processes
+         * rather than threads here, as the manager is not supposed to be multi-threaded. Files that are
+         * already known, or that cannot be read, are left alone. */
+
+        if (!c->active)
+                return 0;
+
+        c->n_preload_rounds++;
+
+        SET_FOREACH(p, paths) {
+                if (hashmap_contains(c->entries, p) || hashmap_contains(c->preloaded, p))
+                        continue;
+
+                if (c->table && strtab_lookup(c->table, UNIT_FILE_CACHE_SECTION_FILES, p, NULL, NULL) > 0)
+                        continue;
+
+                if (!GREEDY_REALLOC(todo, n_todo + 1))
+                        return -ENOMEM;
+
+                todo[n_todo++] = p;
+        }
+
+        if (n_todo < UNIT_FILE_CACHE_PRELOAD_MIN)
+                return 0;
+
+        cpus = cpus_in_affinity_mask();
+        if (cpus < 0)
+                return log_debug_errno(cpus, "Failed to determine number of CPUs, not preloading unit files: %m");
+
+        n_workers = MIN3((size_t) cpus, DIV_ROUND_UP(n_todo, UNIT_FILE_CACHE_PRELOAD_MIN), UNIT_FILE_CACHE_PRELOAD_WORKERS_MAX);
+        if (n_workers < 2)
+                return 0;
+
+        start = now(CLOCK_MONOTONIC);
+
+        for (; n_forked < n_workers; n_forked++) {
+                fds[n_forked] = memfd_new("unit-file-preload");
+                if (fds[n_forked] < 0) {
+                        r = log_debug_errno(fds[n_forked], "Failed to allocate memfd for preloading unit files: %m");
+                        break;
+                }
+
+                r = safe_fork_full("(sd-preload)",
+                                   /* stdio_fds= */ NULL,
+                                   &fds[n_forked], 1,
+                                   FORK_RESET_SIGNALS|FORK_CLOSE_ALL_FDS|FORK_DEATHSIG_SIGKILL|FORK_LOG,
+                                   &pids[n_forked]);
+                if (r < 0)
+                        break;
+                if (r == 0) {
+                        /* Child */
+                        log_set_max_level(LOG_CRIT);
+
+                        r = preload_worker(fds[n_forked], todo, n_todo, n_forked, n_workers);
+                        _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+                }
+        }
+
+        for (size_t k = 0; k < n_forked; k++) {
+                int q;
+
+                q = wait_for_terminate_and_check("(sd-preload)", pids[k], WAIT_LOG_ABNORMAL);
+                if (q == EXIT_SUCCESS) {
+                        q = preload_collect(c, fds[k], todo, n_todo);
+                        if (q < 0)
+                                log_debug_errno(q, "Failed to collect preloaded unit files, ignoring: %m");
+                        else
+                                n_added += q;
+                }
+        }
+
+        for (size_t k = 0; k < ELEMENTSOF(fds); k++)
+                safe_close(fds[k]);
+
+        c->preload_usec += usec_sub_unsigned(now(CLOCK_MONOTONIC), start);
+
+        log_debug("Preloaded %i of %zu unit files in %zu worker processes.", n_added, n_todo, n_forked);
+        return r < 0 ? r : n_added;
+}
+
+int unit_file_cache_parse(Unit *u, const char *filename, FILE *f, struct stat *ret_stat) {
+        _cleanup_(config_lines_done) ConfigLines lines = {};
+        UnitFileCache *c;
+        struct stat st;
+        int r;
+
+        assert(u);
+        assert(filename);
+
+        c = &u->manager->unit_file_cache;
+        if (!c->active)
+                return config_parse(u->id, filename, f,
+                                    UNIT_VTABLE(u)->sections,
+                                    config_item_perf_lookup, load_fragment_gperf_lookup,
+                                    0, u, ret_stat);
+
+        r = unit_file_cache_read_lines(c, filename, f, &lines, &st);
+        if (r <= 0) {
+                if (r == 0 && ret_stat)
+                        *ret_stat = st;
+                return r;
+        }
+
+        r = config_parse_lines(u->id, filename, &lines,
+                               UNIT_VTABLE(u)->sections,
+                               config_item_perf_lookup, load_fragment_gperf_lookup,
+                               0, u);
+        if (r < 0)
+                return r;
+
+        if (ret_stat)
+                *ret_stat = st;
+
+        return 1;
+}
+
+static int stats_get(Strtab *t, const char *name, uint64_t *ret) {
+        const void *value;
+        int r;
+
+        r = strtab_lookup(t, UNIT_FILE_CACHE_SECTION_STATS, name, &value, NULL);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                *ret = 0;
+                return 0;
+        }
+
+        return safe_atou64(value, ret);
+}
+
+int unit_file_cache_get_stats(const char *path, UnitFileCacheStats *ret) {
+        _cleanup_(strtab_freep) Strtab *t = NULL;
+        UnitFileCacheStats stats = {};
+        int r;
+
+        assert(path);
+        assert(ret);
+
+        r = strtab_open(path, UNIT_FILE_CACHE_TYPE, &t);
+        if (r < 0)
+                return r;
+
+        if (strtab_get_stamp(t) != UNIT_FILE_CACHE_FORMAT)
+                return -EPROTONOSUPPORT;
+
+        stats.size = strtab_get_size(t);
+        stats.n_entries = strtab_section_get_n_entries(t, UNIT_FILE_CACHE_SECTION_FILES);
+
+        for (size_t i = 0; i < stats.n_entries; i++) {
+                const char *filename;
+                const void *data;
+                struct stat st;
+                size_t size;
+
+                r = strtab_get_entry(t, UNIT_FILE_CACHE_SECTION_FILES, i, &filename, &data, &size);
+                if (r < 0)
+                        return r;
+
+                if (stat(filename, &st) < 0)
+                        continue;
+
+                if (size >= sizeof(struct unit_file_cache_entry_f) && entry_matches(data, &st))
+                        stats.n_up_to_date++;
+        }
+
+        r = stats_get(t, "hits", &stats.n_hits);
+        if (r < 0)
+                return r;
+
+        r = stats_get(t, "misses", &stats.n_misses);
+        if (r < 0)
+                return r;
+
+        r = stats_get(t, "preloaded", &stats.n_preloaded);
+        if (r < 0)
+                return r;
+
+        r = stats_get(t, "preload-usec", &stats.preload_usec);
+        if (r < 0)
+                return r;
+
+        r = stats_get(t, "load-usec", &stats.load_usec);
+        if (r < 0)
+                return r;
+
+        r = stats_get(t, "timestamp", &stats.timestamp);
+        if (r < 0)
+                return r;
+
+        *ret = stats;
+        return 0;
+}
@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "conf-parser.h"
+#include "hashmap.h"
+#include "runtime-scope.h"
+#include "set.h"
+#include "strtab.h"
+#include "time-util.h"
+
+typedef struct Unit Unit;
+typedef struct UnitFileCache UnitFileCache;
+
+/* A cache of the logical lines of unit files and drop-ins (see ConfigLines), so that reloads only need to
+ * read the files that changed. The cache is kept in a file in /run/, which is read at the beginning of
+ * each load cycle (startup, reload, reexecution) and rewritten with the files actually used at its end.
+ * Entries are validated against the inode, size, mtime and ctime of the file.
+ *
+ * Files that are not in the cache yet may be preloaded in bulk by unit_file_cache_preload(), which reads
+ * and tokenizes them in a number of worker processes. The units are still loaded one after the other
+ * afterwards, they just find the contents of their files ready. */
+
+#define UNIT_FILE_CACHE_TYPE "unit-files"
+
+/* Stored as the stamp of the table, bump this when the format of the entries changes */
+#define UNIT_FILE_CACHE_FORMAT UINT64_C(1)
+
+enum {
+        UNIT_FILE_CACHE_SECTION_FILES,  /* path → entry */
+        UNIT_FILE_CACHE_SECTION_STATS,  /* name → decimal number */
+        _UNIT_FILE_CACHE_SECTION_MAX,
+};
+
+/* How many new units need to pile up in the load queue before their files are preloaded */
+#define UNIT_FILE_CACHE_PRELOAD_BATCH 64U
+
+struct UnitFileCache {
+        char *path;
+
+        Strtab *table;          /* the cache file written at the end of the previous cycle */
+        Hashmap *entries;       /* path → UnitFileCacheEntry, the files used during this cycle */
+        Hashmap *preloaded;     /* path → UnitFileCacheEntry, read by worker processes, not used yet */
+        bool active;
+
+        unsigned n_hits;
+        unsigned n_misses;
+        unsigned n_preloaded;
+        unsigned n_preload_rounds;
+        usec_t preload_usec;
+        usec_t begin_usec;
+};
+
+typedef struct UnitFileCacheStats {
+        uint64_t size;
+        uint64_t n_entries;
+        uint64_t n_up_to_date;
+        uint64_t n_hits;
+        uint64_t n_misses;
+        uint64_t n_preloaded;
+        usec_t preload_usec;
+        usec_t load_usec;
+        usec_t timestamp;
+} UnitFileCacheStats;
+
+int unit_file_cache_path(RuntimeScope scope, char **ret);
+
+void unit_file_cache_done(UnitFileCache *c);
+
+void unit_file_cache_begin(UnitFileCache *c);
+void unit_file_cache_end(UnitFileCache *c);
+
+int unit_file_cache_preload(UnitFileCache *c, Set *paths);
+
+/* Returns the logical lines of the file from the cache if they are still up-to-date, reads the file
+ * otherwise. Like config_read_lines(), the file is opened unless f is specified. */
+int unit_file_cache_read_lines(UnitFileCache *c, const char *filename, FILE *f, ConfigLines *ret, struct stat *ret_stat);
+
+/* Like config_parse() with the unit file parser tables, but uses the cache if active */
+int unit_file_cache_parse(Unit *u, const char *filename, FILE *f, struct stat *ret_stat);
+
+int unit_file_cache_get_stats(const char *path, UnitFileCacheStats *ret);
@@ -175,6 +175,9 @@ int unit_serialize_state(Unit *u, FILE *f, FDSet *fds, bool switching_root) {
                         (void) serialize_item_format(f, io_accounting_metric_field_last_to_string(im), "%" PRIu64, u->io_accounting_last[im]);
         }
 
+        /* Serialize the current counters, not the ones recently served to clients */
+        unit_flush_cgroup_stats(u);
+
         for (CGroupMemoryAccountingMetric metric = 0; metric <= _CGROUP_MEMORY_ACCOUNTING_METRIC_CACHED_LAST; metric++) {
                 uint64_t v;
 
@@ -651,6 +654,7 @@ void unit_dump(Unit *u, FILE *f, const char *prefix) {
         const char *prefix2;
         Unit *following;
         _cleanup_set_free_ Set *following_set = NULL;
+        UnitDependenciesMemory dm = {};
         CGroupMask m;
         int r;
 
@@ -697,6 +701,12 @@ void unit_dump(Unit *u, FILE *f, const char *prefix) {
                 prefix, yes_no(u->perpetual),
                 prefix, collect_mode_to_string(u->collect_mode));
 
+        unit_dependencies_memory_usage(&u->dependencies, &dm);
+        fprintf(f,
+                "%s\tMemory: object %s, dependencies %s (%zu entries in %zu arrays and %zu hashmaps)\n",
+                prefix, FORMAT_BYTES(UNIT_VTABLE(u)->object_size), FORMAT_BYTES(dm.size),
+                dm.n_entries, dm.n_sets_array, dm.n_sets_hashmap);
+
         if (u->markers != 0) {
                 fprintf(f, "%s\tMarkers:", prefix);
 
@@ -819,7 +829,7 @@ void unit_dump(Unit *u, FILE *f, const char *prefix) {
                 UnitDependencyInfo di;
                 Unit *other;
 
-                HASHMAP_FOREACH_KEY(di.data, other, unit_get_dependencies(u, d)) {
+                UNIT_DEPENDENCY_SET_FOREACH_INFO(other, di, unit_get_dependencies(u, d)) {
                         bool space = false;
 
                         fprintf(f, "%s\t%s: %s (", prefix, unit_dependency_to_string(d), other->id);
@@ -514,6 +514,23 @@ void unit_add_to_load_queue(Unit *u) {
 
         LIST_PREPEND(load_queue, u->manager->load_queue, u);
         u->in_load_queue = true;
+        u->load_queue_preloaded = false;
+        u->manager->n_load_queue_pending++;
+}
+
+static void unit_remove_from_load_queue(Unit *u) {
+        assert(u);
+
+        if (!u->in_load_queue)
+                return;
+
+        LIST_REMOVE(load_queue, u->manager->load_queue, u);
+        u->in_load_queue = false;
+
+        if (!u->load_queue_preloaded) {
+                assert(u->manager->n_load_queue_pending > 0);
+                u->manager->n_load_queue_pending--;
+        }
 }
 
 void unit_add_to_cleanup_queue(Unit *u) {
@@ -641,25 +658,26 @@ void unit_submit_to_release_resources_queue(Unit *u) {
 }
 
 static void unit_clear_dependencies(Unit *u) {
+        UnitDependency dt;
+
         assert(u);
 
         /* Removes all dependencies configured on u and their reverse dependencies. */
 
-        for (Hashmap *deps; (deps = hashmap_steal_first(u->dependencies));) {
+        for (UnitDependencySet deps; unit_dependencies_steal_first(&u->dependencies, &dt, &deps);) {
 
-                for (Unit *other; (other = hashmap_steal_first_key(deps));) {
-                        Hashmap *other_deps;
-
-                        HASHMAP_FOREACH(other_deps, other->dependencies)
-                                hashmap_remove(other_deps, u);
+                for (Unit *other; (other = unit_dependency_set_steal_first(&deps, NULL));) {
+                        BIT_FOREACH(d, other->dependencies.types)
+                                (void) unit_dependency_set_remove(unit_get_dependencies(other, d), u);
 
+                        unit_dependencies_trim(&other->dependencies);
                         unit_add_to_gc_queue(other);
                 }
 
-                hashmap_free(deps);
+                unit_dependency_set_done(&deps);
         }
 
-        u->dependencies = hashmap_free(u->dependencies);
+        unit_dependencies_done(&u->dependencies);
 }
 
 static void unit_remove_transient(Unit *u) {
@@ -825,8 +843,7 @@ Unit* unit_free(Unit *u) {
         if (u->type != _UNIT_TYPE_INVALID)
                 LIST_REMOVE(units_by_type, u->manager->units_by_type[u->type], u);
 
-        if (u->in_load_queue)
-                LIST_REMOVE(load_queue, u->manager->load_queue, u);
+        unit_remove_from_load_queue(u);
 
         if (u->in_dbus_queue)
                 LIST_REMOVE(dbus_queue, u->manager->dbus_unit_queue, u);
@@ -881,6 +898,7 @@ Unit* unit_free(Unit *u) {
         free(u->fragment_path);
         free(u->source_path);
         strv_free(u->dropin_paths);
+        strv_free(u->load_queue_dropin_paths);
         free(u->instance);
 
         free(u->job_timeout_reboot_arg);
@@ -974,45 +992,26 @@ static int unit_merge_names(Unit *u, Unit *other) {
 }
 
 static int unit_reserve_dependencies(Unit *u, Unit *other) {
-        size_t n_reserve;
-        Hashmap* deps;
-        void *d;
         int r;
 
         assert(u);
         assert(other);
 
-        /* Let's reserve some space in the dependency hashmaps so that later on merging the units cannot
-         * fail.
-         *
-         * First make some room in the per dependency type hashmaps. Using the summed size of both units'
-         * hashmaps is an estimate that is likely too high since they probably use some of the same
-         * types. But it's never too low, and that's all we need. */
-
-        n_reserve = MIN(hashmap_size(other->dependencies), LESS_BY((size_t) _UNIT_DEPENDENCY_MAX, hashmap_size(u->dependencies)));
-        if (n_reserve > 0) {
-                r = hashmap_ensure_allocated(&u->dependencies, NULL);
-                if (r < 0)
-                        return r;
-
-                r = hashmap_reserve(u->dependencies, n_reserve);
-                if (r < 0)
-                        return r;
-        }
-
-        /* Now, enlarge our per dependency type hashmaps by the number of entries in the same hashmap of the
-         * other unit's dependencies.
+        /* Let's reserve some space in the dependency sets so that later on merging the units cannot fail.
          *
-         * NB: If u does not have a dependency set allocated for some dependency type, there is no need to
-         * reserve anything for. In that case other's set will be transferred as a whole to u by
-         * complete_move(). */
+         * Make sure we have a set for each dependency type the other unit has, and enlarge it by the number
+         * of entries in the same set of the other unit. Using the summed size of both units' sets is an
+         * estimate that is likely too high since they probably share some entries. But it's never too low,
+         * and that's all we need. */
 
-        HASHMAP_FOREACH_KEY(deps, d, u->dependencies) {
-                Hashmap *other_deps;
+        BIT_FOREACH(d, other->dependencies.types) {
+                UnitDependencySet *deps;
 
-                other_deps = hashmap_get(other->dependencies, d);
+                deps = unit_dependencies_ensure(&u->dependencies, d);
+                if (!deps)
+                        return -ENOMEM;
 
-                r = hashmap_reserve(deps, hashmap_size(other_deps));
+                r = unit_dependency_set_reserve(deps, unit_dependency_set_size(unit_get_dependencies(other, d)));
                 if (r < 0)
                         return r;
         }
@@ -1033,8 +1032,8 @@ static bool unit_should_warn_about_dependency(UnitDependency dependency) {
                       UNIT_TRIGGERED_BY);
 }
 
-static int unit_per_dependency_type_hashmap_update(
-                Hashmap *per_type,
+static int unit_dependency_set_add_mask(
+                UnitDependencySet *deps,
                 Unit *other,
                 UnitDependencyMask origin_mask,
                 UnitDependencyMask destination_mask) {
@@ -1042,32 +1041,22 @@ static int unit_per_dependency_type_hashmap_update(
         UnitDependencyInfo info;
         int r;
 
+        assert(deps);
         assert(other);
-        assert_cc(sizeof(void*) == sizeof(info));
 
         /* Acquire the UnitDependencyInfo entry for the Unit* we are interested in, and update it if it
          * exists, or insert it anew if not. */
 
-        info.data = hashmap_get(per_type, other);
-        if (info.data) {
-                /* Entry already exists. Add in our mask. */
+        info = unit_dependency_set_get(deps, other);
+        if (info.data &&
+            FLAGS_SET(info.origin_mask, origin_mask) &&
+            FLAGS_SET(info.destination_mask, destination_mask))
+                return 0; /* NOP */
 
-                if (FLAGS_SET(origin_mask, info.origin_mask) &&
-                    FLAGS_SET(destination_mask, info.destination_mask))
-                        return 0; /* NOP */
+        info.origin_mask |= origin_mask;
+        info.destination_mask |= destination_mask;
 
-                info.origin_mask |= origin_mask;
-                info.destination_mask |= destination_mask;
-
-                r = hashmap_update(per_type, other, info.data);
-        } else {
-                info = (UnitDependencyInfo) {
-                        .origin_mask = origin_mask,
-                        .destination_mask = destination_mask,
-                };
-
-                r = hashmap_put(per_type, other, info.data);
-        }
+        r = unit_dependency_set_replace(deps, other, info);
         if (r < 0)
                 return r;
 
@@ -1075,9 +1064,8 @@ static int unit_per_dependency_type_hashmap_update(
 }
 
 static void unit_merge_dependencies(Unit *u, Unit *other) {
-        Hashmap *deps;
-        void *dt; /* Actually of type UnitDependency, except that we don't bother casting it here,
-                   * since the hashmaps all want it as void pointer. */
+        UnitDependencySet other_deps;
+        UnitDependency dt;
 
         assert(u);
         assert(other);
@@ -1086,79 +1074,55 @@ static void unit_merge_dependencies(Unit *u, Unit *other) {
                 return;
 
         /* First, remove dependency to other. */
-        HASHMAP_FOREACH_KEY(deps, dt, u->dependencies) {
-                if (hashmap_remove(deps, other) && unit_should_warn_about_dependency(UNIT_DEPENDENCY_FROM_PTR(dt)))
+        BIT_FOREACH(d, u->dependencies.types)
+                if (unit_dependency_set_remove(unit_get_dependencies(u, d), other).data &&
+                    unit_should_warn_about_dependency(d))
                         log_unit_warning(u, "Dependency %s=%s is dropped, as %s is merged into %s.",
-                                         unit_dependency_to_string(UNIT_DEPENDENCY_FROM_PTR(dt)),
+                                         unit_dependency_to_string(d),
                                          other->id, other->id, u->id);
 
-                if (hashmap_isempty(deps))
-                        hashmap_free(hashmap_remove(u->dependencies, dt));
-        }
-
-        for (;;) {
-                _cleanup_hashmap_free_ Hashmap *other_deps = NULL;
+        /* Let's focus on one dependency type at a time, that 'other' has defined. */
+        while (unit_dependencies_steal_first(&other->dependencies, &dt, &other_deps)) {
+                UnitDependencySet *deps;
                 UnitDependencyInfo di_back;
                 Unit *back;
 
-                /* Let's focus on one dependency type at a time, that 'other' has defined. */
-                other_deps = hashmap_steal_first_key_and_value(other->dependencies, &dt);
-                if (!other_deps)
-                        break; /* done! */
-
-                deps = hashmap_get(u->dependencies, dt);
+                /* Allocated by unit_reserve_dependencies() */
+                deps = unit_get_dependencies(u, dt);
+                assert(deps);
 
                 /* Now iterate through all dependencies of this dependency type, of 'other'. We refer to the
                  * referenced units as 'back'. */
-                HASHMAP_FOREACH_KEY(di_back.data, back, other_deps) {
-                        Hashmap *back_deps;
-                        void *back_dt;
+                while ((back = unit_dependency_set_steal_first(&other_deps, &di_back))) {
 
                         if (back == u) {
                                 /* This is a dependency pointing back to the unit we want to merge with?
                                  * Suppress it (but warn) */
-                                if (unit_should_warn_about_dependency(UNIT_DEPENDENCY_FROM_PTR(dt)))
+                                if (unit_should_warn_about_dependency(dt))
                                         log_unit_warning(u, "Dependency %s=%s in %s is dropped, as %s is merged into %s.",
-                                                         unit_dependency_to_string(UNIT_DEPENDENCY_FROM_PTR(dt)),
+                                                         unit_dependency_to_string(dt),
                                                          u->id, other->id, other->id, u->id);
-
-                                hashmap_remove(other_deps, back);
                                 continue;
                         }
 
                         /* Now iterate through all deps of 'back', and fix the ones pointing to 'other' to
                          * point to 'u' instead. */
-                        HASHMAP_FOREACH_KEY(back_deps, back_dt, back->dependencies) {
-                                UnitDependencyInfo di_move;
-
-                                di_move.data = hashmap_remove(back_deps, other);
-                                if (!di_move.data)
-                                        continue;
-
-                                assert_se(unit_per_dependency_type_hashmap_update(
-                                                          back_deps,
-                                                          u,
-                                                          di_move.origin_mask,
-                                                          di_move.destination_mask) >= 0);
-                        }
-
-                        /* The target unit already has dependencies of this type, let's then merge this individually. */
-                        if (deps)
-                                assert_se(unit_per_dependency_type_hashmap_update(
-                                                          deps,
-                                                          back,
-                                                          di_back.origin_mask,
-                                                          di_back.destination_mask) >= 0);
+                        BIT_FOREACH(back_dt, back->dependencies.types)
+                                (void) unit_dependency_set_move(unit_get_dependencies(back, back_dt), other, u);
+
+                        /* Space for this was reserved by unit_reserve_dependencies() */
+                        assert_se(unit_dependency_set_add_mask(
+                                                  deps,
+                                                  back,
+                                                  di_back.origin_mask,
+                                                  di_back.destination_mask) >= 0);
                 }
 
-                /* Now all references towards 'other' of the current type 'dt' are corrected to point to 'u'.
-                 * Lets's now move the deps of type 'dt' from 'other' to 'u'. If the unit does not have
-                 * dependencies of this type, let's move them per type wholesale. */
-                if (!deps)
-                        assert_se(hashmap_put(u->dependencies, dt, TAKE_PTR(other_deps)) >= 0);
+                unit_dependency_set_done(&other_deps);
         }
 
-        other->dependencies = hashmap_free(other->dependencies);
+        unit_dependencies_done(&other->dependencies);
+        unit_dependencies_trim(&u->dependencies);
 }
 
 int unit_merge(Unit *u, Unit *other) {
@@ -1656,10 +1620,7 @@ int unit_load(Unit *u) {
 
         assert(u);
 
-        if (u->in_load_queue) {
-                LIST_REMOVE(load_queue, u->manager->load_queue, u);
-                u->in_load_queue = false;
-        }
+        unit_remove_from_load_queue(u);
 
         if (u->type == _UNIT_TYPE_INVALID)
                 return -EINVAL;
@@ -1680,6 +1641,11 @@ int unit_load(Unit *u) {
         }
 
         r = UNIT_VTABLE(u)->load(u);
+
+        /* Drop the drop-ins found when preloading, in case unit_load_dropin() didn't consume them */
+        u->load_queue_dropin_paths = strv_free(u->load_queue_dropin_paths);
+        u->load_queue_dropins_known = false;
+
         if (r < 0)
                 goto fail;
 
@@ -2346,6 +2312,10 @@ static int unit_log_resources(Unit *u) {
          * accounting was enabled for a unit. It does this in two ways: a friendly human readable string with reduced
          * information and the complete data in structured fields. */
 
+        /* This is the final account of the unit's resource usage, hence don't serve it from the snapshot taken
+         * for some earlier query, which might miss what the unit consumed in its last moments. */
+        unit_flush_cgroup_stats(u);
+
         (void) unit_get_cpu_usage(u, &nsec);
         if (nsec != NSEC_INFINITY) {
                 /* Format the CPU time for inclusion in the structured log message */
@@ -3128,29 +3098,6 @@ bool unit_job_is_applicable(Unit *u, JobType j) {
         }
 }
 
-static Hashmap *unit_get_dependency_hashmap_per_type(Unit *u, UnitDependency d) {
-        Hashmap *deps;
-
-        assert(u);
-        assert(d >= 0 && d < _UNIT_DEPENDENCY_MAX);
-
-        deps = hashmap_get(u->dependencies, UNIT_DEPENDENCY_TO_PTR(d));
-        if (!deps) {
-                _cleanup_hashmap_free_ Hashmap *h = NULL;
-
-                h = hashmap_new(NULL);
-                if (!h)
-                        return NULL;
-
-                if (hashmap_ensure_put(&u->dependencies, NULL, UNIT_DEPENDENCY_TO_PTR(d), h) < 0)
-                        return NULL;
-
-                deps = TAKE_PTR(h);
-        }
-
-        return deps;
-}
-
 typedef enum NotifyDependencyFlags {
         NOTIFY_DEPENDENCY_UPDATE_FROM = 1 << 0,
         NOTIFY_DEPENDENCY_UPDATE_TO   = 1 << 1,
@@ -3196,7 +3143,7 @@ static int unit_add_dependency_impl(
                 [UNIT_SLICE_OF]               = UNIT_IN_SLICE,
         };
 
-        Hashmap *u_deps, *other_deps;
+        UnitDependencySet *u_deps, *other_deps;
         UnitDependencyInfo u_info, u_info_old, other_info, other_info_old;
         NotifyDependencyFlags flags = 0;
         int r;
@@ -3207,20 +3154,18 @@ static int unit_add_dependency_impl(
         assert(inverse_table[d] >= 0 && inverse_table[d] < _UNIT_DEPENDENCY_MAX);
         assert(mask > 0 && mask < _UNIT_DEPENDENCY_MASK_FULL);
 
-        /* Ensure the following two hashmaps for each unit exist:
-         * - the top-level dependency hashmap that maps UnitDependency → Hashmap(Unit* → UnitDependencyInfo),
-         * - the inner hashmap, that maps Unit* → UnitDependencyInfo, for the specified dependency type. */
-        u_deps = unit_get_dependency_hashmap_per_type(u, d);
+        /* Ensure the sets for the specified dependency type and its inverse exist. */
+        u_deps = unit_dependencies_ensure(&u->dependencies, d);
         if (!u_deps)
                 return -ENOMEM;
 
-        other_deps = unit_get_dependency_hashmap_per_type(other, inverse_table[d]);
+        other_deps = unit_dependencies_ensure(&other->dependencies, inverse_table[d]);
         if (!other_deps)
                 return -ENOMEM;
 
         /* Save the original dependency info. */
-        u_info.data = u_info_old.data = hashmap_get(u_deps, other);
-        other_info.data = other_info_old.data = hashmap_get(other_deps, u);
+        u_info = u_info_old = unit_dependency_set_get(u_deps, other);
+        other_info = other_info_old = unit_dependency_set_get(other_deps, u);
 
         /* Update dependency info. */
         u_info.origin_mask |= mask;
@@ -3228,7 +3173,7 @@ static int unit_add_dependency_impl(
 
         /* Save updated dependency info. */
         if (u_info.data != u_info_old.data) {
-                r = hashmap_replace(u_deps, other, u_info.data);
+                r = unit_dependency_set_replace(u_deps, other, u_info);
                 if (r < 0)
                         return r;
 
@@ -3236,14 +3181,14 @@ static int unit_add_dependency_impl(
         }
 
         if (other_info.data != other_info_old.data) {
-                r = hashmap_replace(other_deps, u, other_info.data);
+                r = unit_dependency_set_replace(other_deps, u, other_info);
                 if (r < 0) {
                         if (u_info.data != u_info_old.data) {
                                 /* Restore the old dependency. */
                                 if (u_info_old.data)
-                                        (void) hashmap_update(u_deps, other, u_info_old.data);
+                                        (void) unit_dependency_set_replace(u_deps, other, u_info_old);
                                 else
-                                        hashmap_remove(u_deps, other);
+                                        (void) unit_dependency_set_remove(u_deps, other);
                         }
                         return r;
                 }
@@ -5525,20 +5470,19 @@ int unit_fork_and_watch_rm_rf(Unit *u, char **paths, PidRef *ret_pid) {
         return 0;
 }
 
-static void unit_update_dependency_mask(Hashmap *deps, Unit *other, UnitDependencyInfo di) {
+static void unit_update_dependency_mask(UnitDependencySet *deps, Unit *other, UnitDependencyInfo di) {
         assert(deps);
         assert(other);
 
         if (di.origin_mask == 0 && di.destination_mask == 0)
                 /* No bit set anymore, let's drop the whole entry */
-                assert_se(hashmap_remove(deps, other));
+                assert_se(unit_dependency_set_remove(deps, other).data);
         else
                 /* Mask was reduced, let's update the entry */
-                assert_se(hashmap_update(deps, other, di.data) == 0);
+                assert_se(unit_dependency_set_replace(deps, other, di) >= 0);
 }
 
 void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
-        Hashmap *deps;
         assert(u);
 
         /* Removes all dependencies u has on other units marked for ownership by 'mask'. */
@@ -5546,51 +5490,44 @@ void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
         if (mask == 0)
                 return;
 
-        HASHMAP_FOREACH(deps, u->dependencies) {
-                bool done;
-
-                do {
-                        UnitDependencyInfo di;
-                        Unit *other;
-
-                        done = true;
-
-                        HASHMAP_FOREACH_KEY(di.data, other, deps) {
-                                Hashmap *other_deps;
-
-                                if (FLAGS_SET(~mask, di.origin_mask))
-                                        continue;
-
-                                di.origin_mask &= ~mask;
-                                unit_update_dependency_mask(deps, other, di);
-
-                                /* We updated the dependency from our unit to the other unit now. But most
-                                 * dependencies imply a reverse dependency. Hence, let's delete that one
-                                 * too. For that we go through all dependency types on the other unit and
-                                 * delete all those which point to us and have the right mask set. */
+        BIT_FOREACH(d, u->dependencies.types) {
+                UnitDependencySet *deps = unit_get_dependencies(u, d);
+                UnitDependencyInfo di;
+                Unit *other;
 
-                                HASHMAP_FOREACH(other_deps, other->dependencies) {
-                                        UnitDependencyInfo dj;
+                UNIT_DEPENDENCY_SET_FOREACH_INFO(other, di, deps) {
+                        if (FLAGS_SET(~mask, di.origin_mask))
+                                continue;
 
-                                        dj.data = hashmap_get(other_deps, u);
-                                        if (FLAGS_SET(~mask, dj.destination_mask))
-                                                continue;
+                        di.origin_mask &= ~mask;
+                        unit_update_dependency_mask(deps, other, di);
 
-                                        dj.destination_mask &= ~mask;
-                                        unit_update_dependency_mask(other_deps, u, dj);
-                                }
+                        /* We updated the dependency from our unit to the other unit now. But most
+                         * dependencies imply a reverse dependency. Hence, let's delete that one too. For
+                         * that we go through all dependency types on the other unit and delete all those
+                         * which point to us and have the right mask set. */
 
-                                unit_add_to_gc_queue(other);
+                        BIT_FOREACH(e, other->dependencies.types) {
+                                UnitDependencySet *other_deps = unit_get_dependencies(other, e);
+                                UnitDependencyInfo dj;
 
-                                /* The unit 'other' may not be wanted by the unit 'u'. */
-                                unit_submit_to_stop_when_unneeded_queue(other);
+                                dj = unit_dependency_set_get(other_deps, u);
+                                if (FLAGS_SET(~mask, dj.destination_mask))
+                                        continue;
 
-                                done = false;
-                                break;
+                                dj.destination_mask &= ~mask;
+                                unit_update_dependency_mask(other_deps, u, dj);
                         }
 
-                } while (!done);
+                        unit_dependencies_trim(&other->dependencies);
+                        unit_add_to_gc_queue(other);
+
+                        /* The unit 'other' may not be wanted by the unit 'u'. */
+                        unit_submit_to_stop_when_unneeded_queue(other);
+                }
         }
+
+        unit_dependencies_trim(&u->dependencies);
 }
 
 static int unit_get_invocation_path(Unit *u, char **ret) {
@@ -6316,6 +6253,47 @@ static const char* const collect_mode_table[_COLLECT_MODE_MAX] = {
 
 DEFINE_STRING_TABLE_LOOKUP(collect_mode, CollectMode);
 
+bool unit_foreach_dependency_next(UnitForEachDependencyData *data) {
+        assert(data);
+
+        if (data->current_type < 0) {
+                UnitDependency d;
+
+                /* Pick the dependency types of the unit that have the atom. If the atom is unique, we'll
+                 * directly go to the right set. */
+                d = unit_dependency_from_unique_atom(data->match_atom);
+                if (d >= 0) {
+                        if (BIT_SET(data->unit->dependencies.types, d))
+                                SET_BIT(data->types, d);
+                } else
+                        BIT_FOREACH(t, data->unit->dependencies.types)
+                                if ((unit_dependency_to_atom(t) & data->match_atom) != 0)
+                                        SET_BIT(data->types, t);
+
+                data->current_type = _UNIT_DEPENDENCY_MAX;
+        }
+
+        for (;;) {
+                int t;
+
+                if (data->current_type < _UNIT_DEPENDENCY_MAX &&
+                    unit_dependency_set_iterate(
+                                    unit_get_dependencies(data->unit, data->current_type),
+                                    &data->iterator,
+                                    data->current_unit,
+                                    NULL))
+                        return true;
+
+                t = BIT_FIRST_SET(data->types);
+                if (t < 0)
+                        return false;
+
+                CLEAR_BIT(data->types, t);
+                data->current_type = t;
+                data->iterator = UNIT_DEPENDENCY_SET_ITERATOR_FIRST;
+        }
+}
+
 Unit* unit_has_dependency(const Unit *u, UnitDependencyAtom atom, Unit *other) {
         Unit *i;
 
@@ -17,6 +17,7 @@
 #include "pidref.h"
 #include "set.h"
 #include "show-status.h"
+#include "unit-dependency-set.h"
 #include "unit-file.h"
 
 typedef struct UnitRef UnitRef;
@@ -58,57 +59,6 @@ static inline bool UNIT_IS_LOAD_COMPLETE(UnitLoadState t) {
         return t >= 0 && t < _UNIT_LOAD_STATE_MAX && t != UNIT_STUB && t != UNIT_MERGED;
 }
 
-/* Stores the 'reason' a dependency was created as a bit mask, i.e. due to which configuration source it came to be. We
- * use this so that we can selectively flush out parts of dependencies again. Note that the same dependency might be
- * created as a result of multiple "reasons", hence the bitmask. */
-typedef enum UnitDependencyMask {
-        /* Configured directly by the unit file, .wants/.requires symlink or drop-in, or as an immediate result of a
-         * non-dependency option configured that way.  */
-        UNIT_DEPENDENCY_FILE               = 1 << 0,
-
-        /* As unconditional implicit dependency (not affected by unit configuration — except by the unit name and
-         * type) */
-        UNIT_DEPENDENCY_IMPLICIT           = 1 << 1,
-
-        /* A dependency effected by DefaultDependencies=yes. Note that dependencies marked this way are conceptually
-         * just a subset of UNIT_DEPENDENCY_FILE, as DefaultDependencies= is itself a unit file setting that can only
-         * be set in unit files. We make this two separate bits only to help debugging how dependencies came to be. */
-        UNIT_DEPENDENCY_DEFAULT            = 1 << 2,
-
-        /* A dependency created from udev rules */
-        UNIT_DEPENDENCY_UDEV               = 1 << 3,
-
-        /* A dependency created because of some unit's RequiresMountsFor= setting */
-        UNIT_DEPENDENCY_PATH               = 1 << 4,
-
-        /* A dependency initially configured from the mount unit file however the dependency will be updated
-         * from /proc/self/mountinfo as soon as the kernel will make the entry for that mount available in
-         * the /proc file */
-        UNIT_DEPENDENCY_MOUNT_FILE         = 1 << 5,
-
-        /* A dependency created or updated because of data read from /proc/self/mountinfo */
-        UNIT_DEPENDENCY_MOUNTINFO          = 1 << 6,
-
-        /* A dependency created because of data read from /proc/swaps and no other configuration source */
-        UNIT_DEPENDENCY_PROC_SWAP          = 1 << 7,
-
-        /* A dependency for units in slices assigned by directly setting Slice= */
-        UNIT_DEPENDENCY_SLICE_PROPERTY     = 1 << 8,
-
-        _UNIT_DEPENDENCY_MASK_FULL         = (1 << 9) - 1,
-} UnitDependencyMask;
-
-/* The Unit's dependencies[] hashmaps use this structure as value. It has the same size as a void pointer, and thus can
- * be stored directly as hashmap value, without any indirection. Note that this stores two masks, as both the origin
- * and the destination of a dependency might have created it. */
-typedef union UnitDependencyInfo {
-        void *data;
-        struct {
-                UnitDependencyMask origin_mask:16;
-                UnitDependencyMask destination_mask:16;
-        } _packed_;
-} UnitDependencyInfo;
-
 /* Store information about why a unit was activated.
  * We start with trigger units (.path/.timer), eventually it will be expanded to include more metadata. */
 typedef struct ActivationDetails {
@@ -178,16 +128,6 @@ static inline const ActivationDetailsVTable* ACTIVATION_DETAILS_VTABLE(const Act
         return activation_details_vtable[a->trigger_unit_type];
 }
 
-/* Newer LLVM versions don't like implicit casts from large pointer types to smaller enums, hence let's add
- * explicit type-safe helpers for that. */
-static inline UnitDependency UNIT_DEPENDENCY_FROM_PTR(const void *p) {
-        return PTR_TO_INT(p);
-}
-
-static inline void* UNIT_DEPENDENCY_TO_PTR(UnitDependency d) {
-        return INT_TO_PTR(d);
-}
-
 #include "job.h"
 
 struct UnitRef {
@@ -211,10 +151,9 @@ typedef struct Unit {
 
         Set *aliases; /* All the other names. */
 
-        /* For each dependency type we can look up another Hashmap with this, whose key is a Unit* object,
-         * and whose value encodes why the dependency exists, using the UnitDependencyInfo type. i.e. a
-         * Hashmap(UnitDependency → Hashmap(Unit* → UnitDependencyInfo)) */
-        Hashmap *dependencies;
+        /* For each dependency type we can look up a set with this, whose key is a Unit* object, and whose
+         * value encodes why the dependency exists, using the UnitDependencyInfo type. */
+        UnitDependencies dependencies;
 
         /* Similar, for RequiresMountsFor= path dependencies. The key is the path, the value the
          * UnitDependencyInfo type */
@@ -232,6 +171,11 @@ typedef struct Unit {
         char *source_path; /* if converted, the source file */
         char **dropin_paths;
 
+        /* The drop-ins found when the unit's files were preloaded from the load queue, and the hash of the
+         * unit path cache at that time, so that unit_load_dropin() doesn't have to search again */
+        char **load_queue_dropin_paths;
+        uint64_t load_queue_dropin_timestamp_hash;
+
         usec_t fragment_not_found_timestamp_hash;
         usec_t fragment_mtime;
         usec_t source_mtime;
@@ -378,11 +322,15 @@ typedef struct Unit {
         uint64_t io_accounting_base[_CGROUP_IO_ACCOUNTING_METRIC_MAX];
         uint64_t io_accounting_last[_CGROUP_IO_ACCOUNTING_METRIC_MAX]; /* the most recently read value */
 
+        /* Recently read accounting data, served to clients asking again shortly after */
+        CGroupStats *cgroup_stats;
+
         /* Counterparts in the cgroup filesystem */
         char *cgroup_path;
         uint64_t cgroup_id;
         CGroupMask cgroup_realized_mask;           /* In which hierarchies does this unit's cgroup exist? (only relevant on cgroup v1) */
         CGroupMask cgroup_enabled_mask;            /* Which controllers are enabled (or more correctly: enabled for the children) for this unit's cgroup? (only relevant on cgroup v2) */
+        CGroupAttributeCache cgroup_attribute_cache; /* What we know about the attributes we write (only relevant on cgroup v2) */
         CGroupMask cgroup_invalidated_mask;        /* A mask specifying controllers which shall be considered invalidated, and require re-realization */
         CGroupMask cgroup_members_mask;            /* A cache for the controllers required by all children of this cgroup (only relevant for slice units) */
 
@@ -492,6 +440,11 @@ typedef struct Unit {
         bool in_stop_when_bound_queue:1;
         bool in_release_resources_queue:1;
 
+        /* Whether the unit's files were already handed to unit_file_cache_preload() while in the load queue */
+        bool load_queue_preloaded:1;
+        /* Whether load_queue_dropin_paths is set, possibly to an empty list */
+        bool load_queue_dropins_known:1;
+
         bool sent_dbus_new_signal:1;
 
         bool job_running_timeout_set:1;
@@ -830,8 +783,8 @@ Unit* unit_has_dependency(const Unit *u, UnitDependencyAtom atom, Unit *other);
 int unit_get_dependency_array(const Unit *u, UnitDependencyAtom atom, Unit ***ret_array);
 int unit_get_transitive_dependency_set(Unit *u, UnitDependencyAtom atom, Set **ret);
 
-static inline Hashmap* unit_get_dependencies(Unit *u, UnitDependency d) {
-        return hashmap_get(u->dependencies, UNIT_DEPENDENCY_TO_PTR(d));
+static inline UnitDependencySet* unit_get_dependencies(const Unit *u, UnitDependency d) {
+        return unit_dependencies_get(&u->dependencies, d);
 }
 
 static inline Unit* UNIT_TRIGGER(Unit *u) {
@@ -1190,49 +1143,27 @@ CollectMode collect_mode_from_string(const char *s) _pure_;
 typedef struct UnitForEachDependencyData {
         /* Stores state for the FOREACH macro below for iterating through all deps that have any of the
          * specified dependency atom bits set */
+        const Unit *unit;
         UnitDependencyAtom match_atom;
-        Hashmap *by_type, *by_unit;
-        void *current_type;
-        Iterator by_type_iterator, by_unit_iterator;
+        uint64_t types;
+        UnitDependency current_type;
+        UnitDependencySetIterator iterator;
         Unit **current_unit;
 } UnitForEachDependencyData;
 
-/* Iterates through all dependencies that have a specific atom in the dependency type set. This tries to be
- * smart: if the atom is unique, we'll directly go to right entry. Otherwise we'll iterate through the
- * per-dependency type hashmap and match all dep that have the right atom set. */
+bool unit_foreach_dependency_next(UnitForEachDependencyData *data);
+
+/* Iterates through all dependencies that have a specific atom in the dependency type set. The dependency
+ * types to look at are determined once at the beginning, only the sets of those types that carry the atom
+ * are iterated through. */
 #define _UNIT_FOREACH_DEPENDENCY(other, u, ma, data)                    \
         for (UnitForEachDependencyData data = {                         \
+                        .unit = (u),                                    \
                         .match_atom = (ma),                             \
-                        .by_type = (u)->dependencies,                   \
-                        .by_type_iterator = ITERATOR_FIRST,             \
+                        .current_type = _UNIT_DEPENDENCY_INVALID,       \
                         .current_unit = &(other),                       \
                 };                                                      \
-             ({                                                         \
-                     UnitDependency _dt = _UNIT_DEPENDENCY_INVALID;     \
-                     bool _found;                                       \
-                                                                        \
-                     if (data.by_type && ITERATOR_IS_FIRST(data.by_type_iterator)) { \
-                             _dt = unit_dependency_from_unique_atom(data.match_atom); \
-                             if (_dt >= 0) {                            \
-                                     data.by_unit = hashmap_get(data.by_type, UNIT_DEPENDENCY_TO_PTR(_dt)); \
-                                     data.current_type = UNIT_DEPENDENCY_TO_PTR(_dt); \
-                                     data.by_type = NULL;               \
-                                     _found = !!data.by_unit;           \
-                             }                                          \
-                     }                                                  \
-                     if (_dt < 0)                                       \
-                             _found = hashmap_iterate(data.by_type,     \
-                                                      &data.by_type_iterator, \
-                                                      (void**)&(data.by_unit), \
-                                                      (const void**) &(data.current_type)); \
-                     _found;                                            \
-             }); )                                                      \
-                if ((unit_dependency_to_atom(UNIT_DEPENDENCY_FROM_PTR(data.current_type)) & data.match_atom) != 0) \
-                        for (data.by_unit_iterator = ITERATOR_FIRST;    \
-                                hashmap_iterate(data.by_unit,           \
-                                                &data.by_unit_iterator, \
-                                                NULL,                   \
-                                                (const void**) data.current_unit); )
+             unit_foreach_dependency_next(&data); )
 
 /* Note: this matches deps that have *any* of the atoms specified in match_atom set */
 #define UNIT_FOREACH_DEPENDENCY(other, u, match_atom) \
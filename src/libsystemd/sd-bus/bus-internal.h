@@ -8,6 +8,7 @@
 #include "bus-error.h"
 #include "bus-kernel.h"
 #include "bus-match.h"
+#include "bus-signature.h"
 #include "constants.h"
 #include "hashmap.h"
 #include "list.h"
@@ -103,6 +104,10 @@ struct node_vtable {
         const sd_bus_vtable *vtable;
         sd_bus_object_find_t find;
 
+        /* The compiled property signatures, indexed like the vtable entries (see bus_vtable_index()),
+         * NULL for entries that are not properties. The programs are owned by the bus. */
+        const BusSignatureProgram **programs;
+
         LIST_FIELDS(struct node_vtable, vtables);
 };
 
@@ -113,6 +118,7 @@ struct vtable_member {
         struct node_vtable *parent;
         unsigned last_iteration;
         const sd_bus_vtable *vtable;
+        const BusSignatureProgram *program;
 };
 
 typedef enum BusSlotType {
@@ -191,6 +197,7 @@ struct sd_bus {
         int message_endian;
 
         bool can_fds:1;
+        bool can_memfd_body:1;
         bool bus_client:1;
         bool ucred_valid:1;
         bool is_server:1;
@@ -210,6 +217,7 @@ struct sd_bus {
         bool watch_bind:1;
         bool is_monitor:1;
         bool accept_fd:1;
+        bool accept_memfd_body:1;
         bool attach_timestamp:1;
         bool connected_signal:1;
         bool close_on_exit:1;
@@ -220,6 +228,7 @@ struct sd_bus {
 
         void *rbuffer;
         size_t rbuffer_size;
+        size_t rbuffer_offset;
 
         sd_bus_message **rqueue;
         size_t rqueue_size;
@@ -243,6 +252,9 @@ struct sd_bus {
         Hashmap *vtable_methods;
         Hashmap *vtable_properties;
 
+        /* Compiled vtable property signatures, keyed by signature */
+        Hashmap *signature_programs;
+
         union sockaddr_union sockaddr;
         socklen_t sockaddr_size;
 
@@ -258,7 +270,7 @@ struct sd_bus {
 
         enum bus_auth auth;
         unsigned auth_index;
-        struct iovec auth_iovec[3];
+        struct iovec auth_iovec[4];
         size_t auth_rbegin;
         char *auth_buffer;
         usec_t auth_timeout;
@@ -337,6 +349,10 @@ struct sd_bus {
 
 #define BUS_MESSAGE_SIZE_MAX (128*1024*1024)
 #define BUS_AUTH_SIZE_MAX (64*1024)
+
+/* Messages up to this size are read from the socket in batches, into a receive buffer that is reused for the
+ * lifetime of the connection. Larger messages are read directly into a buffer of their own. */
+#define BUS_RBUFFER_READ_AHEAD (64*1024)
 /* Note that the D-Bus specification states that bus paths shall have no size limit. We enforce here one
  * anyway, since truly unbounded strings are a security problem. The limit we pick is relatively large however,
  * to not clash unnecessarily with real-life applications. */
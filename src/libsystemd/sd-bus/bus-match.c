@@ -53,9 +53,22 @@ static bool BUS_MATCH_IS_COMPARE(enum bus_match_node_type t) {
 }
 
 static bool BUS_MATCH_CAN_HASH(enum bus_match_node_type t) {
-        return (t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_PATH) ||
+        return (t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_PATH_NAMESPACE) ||
                 (t >= BUS_MATCH_ARG && t <= BUS_MATCH_ARG_LAST) ||
-                (t >= BUS_MATCH_ARG_HAS && t <= BUS_MATCH_ARG_HAS_LAST);
+                (t >= BUS_MATCH_ARG_NAMESPACE && t <= BUS_MATCH_ARG_HAS_LAST);
+}
+
+static char BUS_MATCH_PREFIX_SEPARATOR(enum bus_match_node_type t) {
+        /* Namespace matches are hashed by their pattern, and looked up by enumerating all prefixes of the
+         * tested value that the pattern could possibly be equal to. Returns the label separator for those,
+         * or 0 for types that are looked up by the full value only. */
+
+        if (t == BUS_MATCH_PATH_NAMESPACE)
+                return '/';
+        if (t >= BUS_MATCH_ARG_NAMESPACE && t <= BUS_MATCH_ARG_NAMESPACE_LAST)
+                return '.';
+
+        return 0;
 }
 
 static void bus_match_node_free(struct bus_match_node *node) {
@@ -235,6 +248,75 @@ static bool value_node_same(
         }
 }
 
+static int bus_match_run_prefixes(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                char separator,
+                const char *test_str,
+                sd_bus_message *m) {
+
+        _cleanup_free_ char *buf = NULL;
+        size_t n, last = SIZE_MAX;
+        int r;
+
+        assert(node);
+        assert(separator != 0);
+
+        /* A namespace pattern matches a value if it is equal to it, or if it is a prefix of it that either
+         * ends in a separator or is followed by one in the value (see simple_pattern_check()). Hence, rather
+         * than testing every pattern against the value, enumerate exactly those prefixes of the value and
+         * look each of them up in the hash table. This makes the lookup O(number of labels) instead of
+         * O(number of matches). */
+
+        if (!test_str || hashmap_isempty(node->compare.children))
+                return 0;
+
+        n = strlen(test_str);
+        buf = memdup_suffix0(test_str, n);
+        if (!buf)
+                return -ENOMEM;
+
+        for (size_t i = 0; i <= n; i++) {
+                size_t candidates[2];
+                size_t n_candidates = 0;
+
+                if (i == n)
+                        candidates[n_candidates++] = n;
+                else if (test_str[i] == separator) {
+                        candidates[n_candidates++] = i;
+                        candidates[n_candidates++] = i + 1;
+                } else
+                        continue;
+
+                for (size_t j = 0; j < n_candidates; j++) {
+                        struct bus_match_node *found;
+                        size_t l = candidates[j];
+
+                        /* Consecutive separators (and a trailing one) yield the same prefix twice, but
+                         * each match must only be run once. */
+                        if (last != SIZE_MAX && l <= last)
+                                continue;
+                        last = l;
+
+                        buf[l] = 0;
+                        found = hashmap_get(node->compare.children, buf);
+                        buf[l] = test_str[l];
+
+                        if (!found)
+                                continue;
+
+                        r = bus_match_run(bus, found, m);
+                        if (r != 0)
+                                return r;
+
+                        if (bus && bus->match_callbacks_modified)
+                                return 0;
+                }
+        }
+
+        return 0;
+}
+
 int bus_match_run(
                 sd_bus *bus,
                 struct bus_match_node *node,
@@ -375,7 +457,12 @@ int bus_match_run(
                 assert_not_reached();
         }
 
-        if (BUS_MATCH_CAN_HASH(node->type)) {
+        if (BUS_MATCH_PREFIX_SEPARATOR(node->type) != 0) {
+                r = bus_match_run_prefixes(bus, node, BUS_MATCH_PREFIX_SEPARATOR(node->type), test_str, m);
+                if (r != 0)
+                        return r;
+
+        } else if (BUS_MATCH_CAN_HASH(node->type)) {
                 struct bus_match_node *found;
 
                 /* Lookup via hash table, nice! So let's jump directly. */
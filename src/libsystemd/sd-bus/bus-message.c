@@ -12,9 +12,11 @@
 #include "bus-signature.h"
 #include "bus-type.h"
 #include "fd-util.h"
+#include "io-util.h"
 #include "iovec-util.h"
 #include "memfd-util.h"
 #include "memory-util.h"
+#include "mempool.h"
 #include "string-util.h"
 #include "strv.h"
 #include "time-util.h"
@@ -23,6 +25,34 @@
 static int message_append_basic(sd_bus_message *m, char type, const void *p, const void **stored);
 static int message_parse_fields(sd_bus_message *m);
 
+/* Large enough for messages we create ourselves (which carry their header inline) as well as for received
+ * messages without a security label */
+DEFINE_MEMPOOL_SIZE(bus_message_pool,
+                    CONST_ALIGN_TO(sizeof(sd_bus_message), sizeof(void*)) + sizeof(struct bus_header),
+                    64);
+
+static sd_bus_message* message_alloc0(size_t size) {
+        sd_bus_message *m;
+        bool from_pool;
+
+        m = mempool_alloc0_tile_or_heap(&bus_message_pool, size, &from_pool);
+        if (!m)
+                return NULL;
+
+        m->from_pool = from_pool;
+        m->body_memfd = -EBADF;
+        return m;
+}
+
+static sd_bus_message* message_free_memory(sd_bus_message *m) {
+        if (!m)
+                return NULL;
+
+        return mempool_free_tile_or_heap(&bus_message_pool, m, m->from_pool);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(sd_bus_message*, message_free_memory);
+
 static void *adjust_pointer(const void *p, void *old_base, size_t sz, void *new_base) {
 
         if (!p)
@@ -101,7 +131,8 @@ static void message_free_last_container(sd_bus_message *m) {
 
         c = message_get_last_container(m);
 
-        free(c->signature);
+        if (!c->borrowed_signature)
+                free(c->signature);
         free(c->peeked_signature);
 
         /* Move to previous container, but not if we are on root container */
@@ -138,12 +169,15 @@ static sd_bus_message* message_free(sd_bus_message *m) {
         if (m->iovec != m->iovec_fixed)
                 free(m->iovec);
 
+        safe_close(m->body_memfd);
+        free(m->body_memfd_header);
+
         message_reset_containers(m);
         assert(m->n_containers == 0);
         message_free_last_container(m);
 
         bus_creds_done(&m->creds);
-        return mfree(m);
+        return message_free_memory(m);
 }
 
 static void *message_extend_fields(sd_bus_message *m, size_t sz, bool add_offset) {
@@ -338,7 +372,7 @@ static int message_from_header(
                 const char *label,
                 sd_bus_message **ret) {
 
-        _cleanup_free_ sd_bus_message *m = NULL;
+        _cleanup_(message_free_memoryp) sd_bus_message *m = NULL;
         struct bus_header *h;
         size_t a, label_sz = 0; /* avoid false maybe-uninitialized warning */
 
@@ -369,7 +403,7 @@ static int message_from_header(
                 a += label_sz + 1;
         }
 
-        m = malloc0(a);
+        m = message_alloc0(a);
         if (!m)
                 return -ENOMEM;
 
@@ -427,23 +461,27 @@ int bus_message_from_malloc(
         if (r < 0)
                 return r;
 
+        m->body.memfd = -EBADF;
+
         sz = length - sizeof(struct bus_header) - ALIGN8(m->fields_size);
         if (sz > 0) {
                 m->n_body_parts = 1;
                 m->body.data = (uint8_t*) buffer + sizeof(struct bus_header) + ALIGN8(m->fields_size);
                 m->body.size = sz;
                 m->body.sealed = true;
-                m->body.memfd = -EBADF;
         }
 
-        m->n_iovec = 1;
-        m->iovec = m->iovec_fixed;
-        m->iovec[0] = IOVEC_MAKE(buffer, length);
-
         r = message_parse_fields(m);
         if (r < 0)
                 return r;
 
+        /* If the body was passed as memfd, the buffer only contains the header */
+        if (m->body.memfd < 0) {
+                m->n_iovec = 1;
+                m->iovec = m->iovec_fixed;
+                m->iovec[0] = IOVEC_MAKE(buffer, length);
+        }
+
         /* We take possession of the memory and fds now */
         m->free_header = true;
         m->free_fds = true;
@@ -464,7 +502,7 @@ _public_ int sd_bus_message_new(
         /* Creation of messages with _SD_BUS_MESSAGE_TYPE_INVALID is allowed. */
         assert_return(type < _SD_BUS_MESSAGE_TYPE_MAX, -EINVAL);
 
-        sd_bus_message *t = malloc0(ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header));
+        sd_bus_message *t = message_alloc0(ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header));
         if (!t)
                 return -ENOMEM;
 
@@ -1256,12 +1294,13 @@ static void *message_extend_body(
                                 p = (uint8_t*) p + padding;
                         }
 
-                        /* Readjust pointers */
-                        if (m->n_containers > 0)
+                        /* Readjust pointers, but only if realloc() actually moved the part */
+                        if (part->data != op) {
                                 for (struct bus_container *c = m->containers; c < m->containers + m->n_containers; c++)
                                         c->array_size = adjust_pointer(c->array_size, op, os, part->data);
 
-                        m->error.message = (const char*) adjust_pointer(m->error.message, op, os, part->data);
+                                m->error.message = (const char*) adjust_pointer(m->error.message, op, os, part->data);
+                        }
                 }
         } else
                 /* Return something that is not NULL and is aligned */
@@ -1544,9 +1583,6 @@ static int bus_message_open_array(
         assert(array_size);
         assert(begin);
 
-        if (!signature_is_single(contents, true))
-                return -EINVAL;
-
         if (c->signature && c->signature[c->index]) {
 
                 /* Verify the existing signature */
@@ -1616,12 +1652,6 @@ static int bus_message_open_variant(
         assert(c);
         assert(contents);
 
-        if (!signature_is_single(contents, false))
-                return -EINVAL;
-
-        if (*contents == SD_BUS_TYPE_DICT_ENTRY_BEGIN)
-                return -EINVAL;
-
         if (c->signature && c->signature[c->index]) {
 
                 if (c->signature[c->index] != SD_BUS_TYPE_VARIANT)
@@ -1667,9 +1697,6 @@ static int bus_message_open_struct(
         assert(contents);
         assert(begin);
 
-        if (!signature_is_valid(contents, false))
-                return -EINVAL;
-
         if (c->signature && c->signature[c->index]) {
                 size_t l;
 
@@ -1717,9 +1744,6 @@ static int bus_message_open_dict_entry(
         assert(contents);
         assert(begin);
 
-        if (!signature_is_pair(contents))
-                return -EINVAL;
-
         if (c->enclosing != SD_BUS_TYPE_ARRAY)
                 return -ENXIO;
 
@@ -1742,10 +1766,31 @@ static int bus_message_open_dict_entry(
         return 0;
 }
 
-_public_ int sd_bus_message_open_container(
+static bool container_contents_is_valid(char type, const char *contents) {
+        switch (type) {
+
+        case SD_BUS_TYPE_ARRAY:
+                return signature_is_single(contents, true);
+
+        case SD_BUS_TYPE_VARIANT:
+                return signature_is_single(contents, false) && *contents != SD_BUS_TYPE_DICT_ENTRY_BEGIN;
+
+        case SD_BUS_TYPE_STRUCT:
+                return signature_is_valid(contents, false);
+
+        case SD_BUS_TYPE_DICT_ENTRY:
+                return signature_is_pair(contents);
+
+        default:
+                return false;
+        }
+}
+
+static int message_open_container_internal(
                 sd_bus_message *m,
                 char type,
-                const char *contents) {
+                const char *contents,
+                bool trusted) {
 
         struct bus_container *c;
         uint32_t *array_size = NULL;
@@ -1753,10 +1798,11 @@ _public_ int sd_bus_message_open_container(
         size_t before, begin = 0;
         int r;
 
-        assert_return(m, -EINVAL);
-        assert_return(!m->sealed, -EPERM);
-        assert_return(contents, -EINVAL);
-        assert_return(!m->poisoned, -ESTALE);
+        assert(m);
+        assert(contents);
+
+        /* If 'trusted' is set the contents signature has been validated already and is guaranteed to stay
+         * around at least as long as the message, hence we neither check nor copy it. */
 
         /* Make sure we have space for one more container */
         if (!GREEDY_REALLOC(m->containers, m->n_containers + 1)) {
@@ -1766,10 +1812,15 @@ _public_ int sd_bus_message_open_container(
 
         c = message_get_last_container(m);
 
-        signature = strdup(contents);
-        if (!signature) {
-                m->poisoned = true;
-                return -ENOMEM;
+        if (!trusted) {
+                if (!container_contents_is_valid(type, contents))
+                        return -EINVAL;
+
+                signature = strdup(contents);
+                if (!signature) {
+                        m->poisoned = true;
+                        return -ENOMEM;
+                }
         }
 
         /* Save old index in the parent container, in case we have to
@@ -1793,7 +1844,8 @@ _public_ int sd_bus_message_open_container(
         /* OK, let's fill it in */
         m->containers[m->n_containers++] = (struct bus_container) {
                 .enclosing = type,
-                .signature = TAKE_PTR(signature),
+                .signature = trusted ? (char*) contents : TAKE_PTR(signature),
+                .borrowed_signature = trusted,
                 .array_size = array_size,
                 .before = before,
                 .begin = begin,
@@ -1802,6 +1854,36 @@ _public_ int sd_bus_message_open_container(
         return 0;
 }
 
+_public_ int sd_bus_message_open_container(
+                sd_bus_message *m,
+                char type,
+                const char *contents) {
+
+        assert_return(m, -EINVAL);
+        assert_return(!m->sealed, -EPERM);
+        assert_return(contents, -EINVAL);
+        assert_return(!m->poisoned, -ESTALE);
+
+        if (m->property_program) {
+                const char *t;
+
+                t = bus_signature_program_find_contents(m->property_program, type, contents);
+                if (t)
+                        return message_open_container_internal(m, type, t, /* trusted= */ true);
+        }
+
+        return message_open_container_internal(m, type, contents, /* trusted= */ false);
+}
+
+int bus_message_open_container_trusted(sd_bus_message *m, char type, const char *contents) {
+        assert_return(m, -EINVAL);
+        assert_return(!m->sealed, -EPERM);
+        assert_return(contents, -EINVAL);
+        assert_return(!m->poisoned, -ESTALE);
+
+        return message_open_container_internal(m, type, contents, /* trusted= */ true);
+}
+
 _public_ int sd_bus_message_close_container(sd_bus_message *m) {
         struct bus_container *c;
 
@@ -1818,7 +1900,8 @@ _public_ int sd_bus_message_close_container(sd_bus_message *m) {
 
         m->n_containers--;
 
-        free(c->signature);
+        if (!c->borrowed_signature)
+                free(c->signature);
 
         return 0;
 }
@@ -1862,6 +1945,157 @@ static int type_stack_pop(TypeStack *stack, unsigned max, unsigned *i, const cha
         return 1;
 }
 
+typedef struct ProgramStack {
+        size_t pc, begin, end;
+        unsigned n_array;
+} ProgramStack;
+
+static int message_append_program(
+                sd_bus_message *m,
+                const BusSignatureProgram *p,
+                size_t begin,
+                size_t end,
+                va_list ap) {
+
+        ProgramStack stack[BUS_CONTAINER_DEPTH];
+        unsigned stack_ptr = 0, n_array = UINT_MAX;
+        size_t pc = begin;
+        int r;
+
+        assert(m);
+        assert(p);
+        assert(!p->has_variant);
+        assert(begin <= end && end <= p->n_ops);
+
+        /* Same as sd_bus_message_appendv(), but walks the operations [begin, end) of a compiled signature
+         * instead of parsing the signature string. Inside an array [begin, end) is the range of the element
+         * type, and 'n_array' the number of elements left after the current one. */
+
+        for (;;) {
+                const BusSignatureOp *op;
+
+                if (pc >= end) {
+                        if (n_array != UINT_MAX && n_array > 0) {
+                                n_array--;
+                                pc = begin;
+                                continue;
+                        }
+
+                        if (stack_ptr == 0)
+                                break;
+
+                        r = sd_bus_message_close_container(m);
+                        if (r < 0)
+                                return r;
+
+                        stack_ptr--;
+                        pc = stack[stack_ptr].pc;
+                        begin = stack[stack_ptr].begin;
+                        end = stack[stack_ptr].end;
+                        n_array = stack[stack_ptr].n_array;
+                        continue;
+                }
+
+                op = p->ops + pc;
+
+                switch (op->type) {
+
+                case SD_BUS_TYPE_BYTE: {
+                        uint8_t x;
+
+                        x = (uint8_t) va_arg(ap, int);
+                        r = sd_bus_message_append_basic(m, op->type, &x);
+                        break;
+                }
+
+                case SD_BUS_TYPE_BOOLEAN:
+                case SD_BUS_TYPE_INT32:
+                case SD_BUS_TYPE_UINT32:
+                case SD_BUS_TYPE_UNIX_FD: {
+                        uint32_t x;
+
+                        x = va_arg(ap, uint32_t);
+                        r = sd_bus_message_append_basic(m, op->type, &x);
+                        break;
+                }
+
+                case SD_BUS_TYPE_INT16:
+                case SD_BUS_TYPE_UINT16: {
+                        uint16_t x;
+
+                        x = (uint16_t) va_arg(ap, int);
+                        r = sd_bus_message_append_basic(m, op->type, &x);
+                        break;
+                }
+
+                case SD_BUS_TYPE_INT64:
+                case SD_BUS_TYPE_UINT64: {
+                        uint64_t x;
+
+                        x = va_arg(ap, uint64_t);
+                        r = sd_bus_message_append_basic(m, op->type, &x);
+                        break;
+                }
+
+                case SD_BUS_TYPE_DOUBLE: {
+                        double x;
+
+                        x = va_arg(ap, double);
+                        r = sd_bus_message_append_basic(m, op->type, &x);
+                        break;
+                }
+
+                case SD_BUS_TYPE_STRING:
+                case SD_BUS_TYPE_OBJECT_PATH:
+                case SD_BUS_TYPE_SIGNATURE:
+                        r = sd_bus_message_append_basic(m, op->type, va_arg(ap, const char*));
+                        break;
+
+                case SD_BUS_TYPE_ARRAY:
+                case SD_BUS_TYPE_STRUCT:
+                case SD_BUS_TYPE_DICT_ENTRY:
+                        if (stack_ptr >= ELEMENTSOF(stack))
+                                return -EINVAL;
+
+                        r = bus_message_open_container_trusted(m, op->type, op->contents);
+                        if (r < 0)
+                                return r;
+
+                        stack[stack_ptr++] = (ProgramStack) {
+                                .pc = op->end,
+                                .begin = begin,
+                                .end = end,
+                                .n_array = n_array,
+                        };
+
+                        begin = pc + 1;
+                        end = op->end;
+
+                        if (op->type == SD_BUS_TYPE_ARRAY) {
+                                unsigned n;
+
+                                n = va_arg(ap, unsigned);
+                                n_array = n > 0 ? n - 1 : UINT_MAX;
+                                pc = n > 0 ? begin : end;
+                        } else {
+                                n_array = UINT_MAX;
+                                pc = begin;
+                        }
+
+                        continue;
+
+                default:
+                        return -EINVAL;
+                }
+                if (r < 0)
+                        return r;
+
+                pc++;
+        }
+
+        return 1;
+}
+
 _public_ int sd_bus_message_appendv(
                 sd_bus_message *m,
                 const char *types,
@@ -1877,6 +2111,13 @@ _public_ int sd_bus_message_appendv(
         assert_return(!m->sealed, -EPERM);
         assert_return(!m->poisoned, -ESTALE);
 
+        if (m->property_program && !m->property_program->has_variant) {
+                size_t begin, end;
+
+                if (bus_signature_program_match(m->property_program, types, &begin, &end))
+                        return message_append_program(m, m->property_program, begin, end, ap);
+        }
+
         n_array = UINT_MAX;
         n_struct = strlen(types);
 
@@ -2869,9 +3110,6 @@ static int bus_message_enter_array(
         assert(contents);
         assert(array_size);
 
-        if (!signature_is_single(contents, true))
-                return -EINVAL;
-
         if (!c->signature || c->signature[c->index] == 0)
                 return -ENXIO;
 
@@ -2922,12 +3160,6 @@ static int bus_message_enter_variant(
         assert(c);
         assert(contents);
 
-        if (!signature_is_single(contents, false))
-                return -EINVAL;
-
-        if (*contents == SD_BUS_TYPE_DICT_ENTRY_BEGIN)
-                return -EINVAL;
-
         if (!c->signature || c->signature[c->index] == 0)
                 return -ENXIO;
 
@@ -2975,9 +3207,6 @@ static int bus_message_enter_struct(
         assert(c);
         assert(contents);
 
-        if (!signature_is_valid(contents, false))
-                return -EINVAL;
-
         if (!c->signature || c->signature[c->index] == 0)
                 return -ENXIO;
 
@@ -3010,9 +3239,6 @@ static int bus_message_enter_dict_entry(
         assert(c);
         assert(contents);
 
-        if (!signature_is_pair(contents))
-                return -EINVAL;
-
         if (c->enclosing != SD_BUS_TYPE_ARRAY)
                 return -ENXIO;
 
@@ -3036,37 +3262,20 @@ static int bus_message_enter_dict_entry(
         return 1;
 }
 
-_public_ int sd_bus_message_enter_container(sd_bus_message *m,
-                                            char type,
-                                            const char *contents) {
+static int message_enter_container_internal(
+                sd_bus_message *m,
+                char type,
+                const char *contents,
+                bool trusted) {
+
         struct bus_container *c;
         uint32_t *array_size = NULL;
         _cleanup_free_ char *signature = NULL;
         size_t before;
         int r;
 
-        assert_return(m, -EINVAL);
-        assert_return(m->sealed, -EPERM);
-        assert_return(type != 0 || !contents, -EINVAL);
-
-        if (type == 0 || !contents) {
-                const char *cc;
-                char tt;
-
-                /* Allow entering into anonymous containers */
-                r = sd_bus_message_peek_type(m, &tt, &cc);
-                if (r < 0)
-                        return r;
-
-                if (type != 0 && type != tt)
-                        return -ENXIO;
-
-                if (contents && !streq(contents, cc))
-                        return -ENXIO;
-
-                type = tt;
-                contents = cc;
-        }
+        assert(m);
+        assert(contents);
 
         /*
          * We enforce a global limit on container depth, that is much
@@ -3098,9 +3307,15 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
 
         c = message_get_last_container(m);
 
-        signature = strdup(contents);
-        if (!signature)
-                return -ENOMEM;
+        /* Same as for message_open_container_internal(): trusted contents are neither checked nor copied. */
+        if (!trusted) {
+                if (!container_contents_is_valid(type, contents))
+                        return -EINVAL;
+
+                signature = strdup(contents);
+                if (!signature)
+                        return -ENOMEM;
+        }
 
         c->saved_index = c->index;
         before = m->rindex;
@@ -3121,7 +3336,8 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
         /* OK, let's fill it in */
         m->containers[m->n_containers++] = (struct bus_container) {
                  .enclosing = type,
-                 .signature = TAKE_PTR(signature),
+                 .signature = trusted ? (char*) contents : TAKE_PTR(signature),
+                 .borrowed_signature = trusted,
 
                  .before = before,
                  .begin = m->rindex,
@@ -3133,6 +3349,53 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
         return 1;
 }
 
+_public_ int sd_bus_message_enter_container(sd_bus_message *m,
+                                            char type,
+                                            const char *contents) {
+        int r;
+
+        assert_return(m, -EINVAL);
+        assert_return(m->sealed, -EPERM);
+        assert_return(type != 0 || !contents, -EINVAL);
+
+        if (type == 0 || !contents) {
+                const char *cc;
+                char tt;
+
+                /* Allow entering into anonymous containers */
+                r = sd_bus_message_peek_type(m, &tt, &cc);
+                if (r < 0)
+                        return r;
+
+                if (type != 0 && type != tt)
+                        return -ENXIO;
+
+                if (contents && !streq(contents, cc))
+                        return -ENXIO;
+
+                type = tt;
+                contents = cc;
+        }
+
+        if (m->property_program) {
+                const char *t;
+
+                t = bus_signature_program_find_contents(m->property_program, type, contents);
+                if (t)
+                        return message_enter_container_internal(m, type, t, /* trusted= */ true);
+        }
+
+        return message_enter_container_internal(m, type, contents, /* trusted= */ false);
+}
+
+int bus_message_enter_container_trusted(sd_bus_message *m, char type, const char *contents) {
+        assert_return(m, -EINVAL);
+        assert_return(m->sealed, -EPERM);
+        assert_return(contents, -EINVAL);
+
+        return message_enter_container_internal(m, type, contents, /* trusted= */ true);
+}
+
 _public_ int sd_bus_message_exit_container(sd_bus_message *m) {
         struct bus_container *c;
 
@@ -3314,6 +3577,121 @@ _public_ int sd_bus_message_rewind(sd_bus_message *m, int complete) {
         return !isempty(c->signature);
 }
 
+static int message_read_program(
+                sd_bus_message *m,
+                const BusSignatureProgram *p,
+                size_t begin,
+                size_t end,
+                va_list ap) {
+
+        ProgramStack stack[BUS_CONTAINER_DEPTH];
+        unsigned stack_ptr = 0, n_array = UINT_MAX, n_loop = 0;
+        size_t pc = begin;
+        int r;
+
+        assert(m);
+        assert(p);
+        assert(!p->has_variant);
+        assert(begin <= end && end <= p->n_ops);
+
+        /* Same as sd_bus_message_readv(), but walks a compiled signature, see message_append_program(). */
+
+        for (;;) {
+                const BusSignatureOp *op;
+
+                n_loop++;
+
+                if (pc >= end) {
+                        if (n_array != UINT_MAX && n_array > 0) {
+                                n_array--;
+                                pc = begin;
+                                continue;
+                        }
+
+                        if (stack_ptr == 0)
+                                break;
+
+                        r = sd_bus_message_exit_container(m);
+                        if (r < 0)
+                                return r;
+
+                        stack_ptr--;
+                        pc = stack[stack_ptr].pc;
+                        begin = stack[stack_ptr].begin;
+                        end = stack[stack_ptr].end;
+                        n_array = stack[stack_ptr].n_array;
+                        continue;
+                }
+
+                op = p->ops + pc;
+
+                switch (op->type) {
+
+                case SD_BUS_TYPE_BYTE:
+                case SD_BUS_TYPE_BOOLEAN:
+                case SD_BUS_TYPE_INT16:
+                case SD_BUS_TYPE_UINT16:
+                case SD_BUS_TYPE_INT32:
+                case SD_BUS_TYPE_UINT32:
+                case SD_BUS_TYPE_INT64:
+                case SD_BUS_TYPE_UINT64:
+                case SD_BUS_TYPE_DOUBLE:
+                case SD_BUS_TYPE_STRING:
+                case SD_BUS_TYPE_OBJECT_PATH:
+                case SD_BUS_TYPE_SIGNATURE:
+                case SD_BUS_TYPE_UNIX_FD:
+                        r = sd_bus_message_read_basic(m, op->type, va_arg(ap, void*));
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                return n_loop <= 1 ? 0 : -ENXIO;
+
+                        pc++;
+                        continue;
+
+                case SD_BUS_TYPE_ARRAY:
+                case SD_BUS_TYPE_STRUCT:
+                case SD_BUS_TYPE_DICT_ENTRY:
+                        if (stack_ptr >= ELEMENTSOF(stack))
+                                return -EINVAL;
+
+                        r = bus_message_enter_container_trusted(m, op->type, op->contents);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                return n_loop <= 1 ? 0 : -ENXIO;
+
+                        stack[stack_ptr++] = (ProgramStack) {
+                                .pc = op->end,
+                                .begin = begin,
+                                .end = end,
+                                .n_array = n_array,
+                        };
+
+                        begin = pc + 1;
+                        end = op->end;
+
+                        if (op->type == SD_BUS_TYPE_ARRAY) {
+                                unsigned n;
+
+                                n = va_arg(ap, unsigned);
+                                n_array = n > 0 ? n - 1 : UINT_MAX;
+                                pc = n > 0 ? begin : end;
+                        } else {
+                                n_array = UINT_MAX;
+                                pc = begin;
+                        }
+
+                        continue;
+
+                default:
+                        return -EINVAL;
+                }
+        }
+
+        return 1;
+}
+
 _public_ int sd_bus_message_readv(
                 sd_bus_message *m,
                 const char *types,
@@ -3332,6 +3710,13 @@ _public_ int sd_bus_message_readv(
         if (isempty(types))
                 return 0;
 
+        if (m->property_program && !m->property_program->has_variant) {
+                size_t begin, end;
+
+                if (bus_signature_program_match(m->property_program, types, &begin, &end))
+                        return message_read_program(m, m->property_program, begin, end, ap);
+        }
+
         /* Ideally, we'd just call ourselves recursively on every
          * complex type. However, the state of a va_list that is
          * passed to a function is undefined after that function
@@ -4023,9 +4408,59 @@ static int message_skip_fields(
         }
 }
 
+static int message_adopt_memfd_body(sd_bus_message *m, uint32_t size, size_t fields_size) {
+        struct bus_body_part part;
+        uint64_t sz;
+        int fd, r;
+
+        assert(m);
+        assert(m->n_fds > 0);
+
+        /* The body was passed as sealed memfd, as additional fd after the ones the message carries. Make
+         * sure the sender can't modify it anymore, and map it read-only as the one body part. Then drop the
+         * MEMFD_BODY field from the header, so that the message looks as if the body had been sent
+         * inline, in case it is forwarded to another connection. */
+
+        if (m->body_size != 0 || m->n_body_parts != 0)
+                return -EBADMSG;
+
+        fd = m->fds[m->n_fds - 1];
+
+        r = memfd_get_sealed(fd);
+        if (r <= 0)
+                return -EBADMSG;
+
+        r = memfd_get_size(fd, &sz);
+        if (r < 0 || sz != size)
+                return -EBADMSG;
+
+        part = (struct bus_body_part) {
+                .memfd = fd,
+                .size = size,
+                .sealed = true,
+        };
+
+        r = bus_body_part_map(&part);
+        if (r < 0)
+                return r;
+
+        m->n_fds--;
+
+        m->body = part;
+        m->n_body_parts = 1;
+        m->body_size = m->user_body_size = size;
+
+        m->fields_size = fields_size;
+        m->header->fields_size = BUS_MESSAGE_BSWAP32(m, fields_size);
+        m->header->body_size = BUS_MESSAGE_BSWAP32(m, size);
+
+        return 0;
+}
+
 static int message_parse_fields(sd_bus_message *m) {
-        uint32_t unix_fds = 0;
-        bool unix_fds_set = false;
+        uint32_t unix_fds = 0, memfd_body_size = 0;
+        bool unix_fds_set = false, memfd_body_set = false;
+        size_t memfd_body_fields_size = 0;
         int r;
 
         assert(m);
@@ -4035,9 +4470,13 @@ static int message_parse_fields(sd_bus_message *m) {
         for (size_t ri = 0; ri < m->fields_size; ) {
                 const char *signature;
                 uint64_t field_type;
-                size_t item_size = SIZE_MAX;
+                size_t item_size = SIZE_MAX, field_begin = ri;
                 uint8_t *u8;
 
+                /* The MEMFD_BODY field must be the last one */
+                if (memfd_body_set)
+                        return -EBADMSG;
+
                 r = message_peek_fields(m, &ri, 8, 1, (void**) &u8);
                 if (r < 0)
                         return r;
@@ -4185,6 +4624,22 @@ static int message_parse_fields(sd_bus_message *m) {
                         unix_fds_set = true;
                         break;
 
+                case BUS_MESSAGE_HEADER_MEMFD_BODY:
+                        if (!m->bus->can_memfd_body)
+                                return -EBADMSG;
+
+                        if (!streq(signature, "u"))
+                                return -EBADMSG;
+
+                        r = message_peek_field_uint32(m, &ri, item_size, &memfd_body_size);
+                        if (r < 0)
+                                return -EBADMSG;
+
+                        /* Remember where the header ended without this field */
+                        memfd_body_fields_size = field_begin;
+                        memfd_body_set = true;
+                        break;
+
                 default:
                         r = message_skip_fields(m, &ri, UINT32_MAX, (const char **) &signature);
                 }
@@ -4192,7 +4647,7 @@ static int message_parse_fields(sd_bus_message *m) {
                         return r;
         }
 
-        if (m->n_fds != unix_fds)
+        if (m->n_fds != unix_fds + memfd_body_set)
                 return -EBADMSG;
 
         switch (m->header->type) {
@@ -4237,6 +4692,12 @@ static int message_parse_fields(sd_bus_message *m) {
         if (streq_ptr(m->sender, "org.freedesktop.DBus.Local"))
                 return -EBADMSG;
 
+        if (memfd_body_set) {
+                r = message_adopt_memfd_body(m, memfd_body_size, memfd_body_fields_size);
+                if (r < 0)
+                        return r;
+        }
+
         m->root_container.end = m->user_body_size;
 
         /* Try to read the error message, but if we can't it's a non-issue */
@@ -4246,6 +4707,68 @@ static int message_parse_fields(sd_bus_message *m) {
         return 0;
 }
 
+int bus_message_peek_unix_fds(
+                sd_bus *bus,
+                void *buffer,
+                size_t length,
+                size_t *ret) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        uint32_t unix_fds = 0;
+        bool memfd_body = false;
+        int r;
+
+        assert(ret);
+
+        /* Returns the number of file descriptors the message in the specified buffer claims to carry, without
+         * taking possession of the buffer. This only looks for the UNIX_FDS and MEMFD_BODY header fields,
+         * everything else is validated by bus_message_from_malloc() later on. */
+
+        r = message_from_header(
+                        bus,
+                        buffer, length,
+                        NULL, 0,
+                        NULL,
+                        &m);
+        if (r < 0)
+                return r;
+
+        for (size_t ri = 0; ri < m->fields_size; ) {
+                const char *signature;
+                uint8_t *u8;
+
+                r = message_peek_fields(m, &ri, 8, 1, (void**) &u8);
+                if (r < 0)
+                        return r;
+
+                r = message_peek_field_signature(m, &ri, 0, &signature);
+                if (r < 0)
+                        return r;
+
+                if (*u8 == BUS_MESSAGE_HEADER_UNIX_FDS) {
+                        if (!streq(signature, "u"))
+                                return -EBADMSG;
+
+                        r = message_peek_field_uint32(m, &ri, SIZE_MAX, &unix_fds);
+                        if (r < 0)
+                                return -EBADMSG;
+
+                        continue;
+                }
+
+                /* The memfd with the body comes on top of the fds the message carries */
+                if (*u8 == BUS_MESSAGE_HEADER_MEMFD_BODY)
+                        memfd_body = true;
+
+                r = message_skip_fields(m, &ri, UINT32_MAX, (const char **) &signature);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = (size_t) unix_fds + memfd_body;
+        return 0;
+}
+
 _public_ int sd_bus_message_set_destination(sd_bus_message *m, const char *destination) {
         assert_return(m, -EINVAL);
         assert_return(destination, -EINVAL);
@@ -4266,6 +4789,62 @@ _public_ int sd_bus_message_set_sender(sd_bus_message *m, const char *sender) {
         return message_append_field_string(m, BUS_MESSAGE_HEADER_SENDER, SD_BUS_TYPE_STRING, sender, &m->sender);
 }
 
+int bus_message_setup_memfd_body(sd_bus_message *m) {
+        _cleanup_free_ struct bus_header *h = NULL;
+        _cleanup_close_ int fd = -EBADF;
+        struct bus_body_part *part;
+        uint8_t *p;
+        unsigned i;
+        int r;
+
+        assert(m);
+        assert(m->sealed);
+
+        /* Copies the body into a sealed memfd, and prepares a header announcing it, which is the original
+         * header with the MEMFD_BODY field appended and no inline body. Both are kept, so that the message
+         * can be sent more than once. */
+
+        if (m->body_memfd >= 0)
+                return 0;
+
+        fd = memfd_new("sd-bus-body");
+        if (fd < 0)
+                return fd;
+
+        MESSAGE_FOREACH_PART(part, i, m) {
+                r = bus_body_part_map(part);
+                if (r < 0)
+                        return r;
+
+                r = loop_write(fd, part->data, part->size);
+                if (r < 0)
+                        return r;
+        }
+
+        r = memfd_set_sealed(fd);
+        if (r < 0)
+                return r;
+
+        h = malloc0(BUS_MESSAGE_MEMFD_BODY_HEADER_SIZE(m));
+        if (!h)
+                return -ENOMEM;
+
+        memcpy(h, m->header, sizeof(struct bus_header) + m->fields_size);
+        h->fields_size = BUS_MESSAGE_BSWAP32(m, ALIGN8(m->fields_size) + 8);
+        h->body_size = 0;
+
+        p = (uint8_t*) h + BUS_MESSAGE_BODY_BEGIN(m);
+        p[0] = BUS_MESSAGE_HEADER_MEMFD_BODY;
+        p[1] = 1;
+        p[2] = SD_BUS_TYPE_UINT32;
+        p[3] = 0;
+        ((uint32_t*) p)[1] = BUS_MESSAGE_BSWAP32(m, m->body_size);
+
+        m->body_memfd = TAKE_FD(fd);
+        m->body_memfd_header = TAKE_PTR(h);
+        return 0;
+}
+
 int bus_message_get_blob(sd_bus_message *m, void **buffer, size_t *sz) {
         size_t total;
         void *p, *e;
@@ -9,6 +9,7 @@
 
 #include "bus-creds.h"
 #include "bus-protocol.h"
+#include "bus-signature.h"
 #include "macro.h"
 #include "time-util.h"
 
@@ -19,6 +20,9 @@ struct bus_container {
         unsigned index, saved_index;
         char *signature;
 
+        /* If set, 'signature' points into a BusSignatureProgram owned by the bus, and is not freed */
+        bool borrowed_signature;
+
         size_t before, begin, end;
 
         /* pointer to the array size value, if this is a value */
@@ -80,6 +84,7 @@ struct sd_bus_message {
         bool free_fds:1;
         bool poisoned:1;
         bool sensitive:1;
+        bool from_pool:1;
 
         /* The first bytes of the message */
         struct bus_header *header;
@@ -113,8 +118,18 @@ struct sd_bus_message {
          * from the vtable data */
         const char *enforced_reply_signature;
 
+        /* If set, the compiled signature of the property whose getter or setter is currently running on
+         * this message. sd_bus_message_append()/sd_bus_message_read() and opening/entering containers use
+         * it instead of re-parsing and copying the signature. Owned by the bus. */
+        const BusSignatureProgram *property_program;
+
         usec_t timeout;
 
+        /* The body as sealed memfd, and the header announcing it, for sending to peers that agreed to
+         * receive large bodies that way. Set up on first use by bus_message_setup_memfd_body(). */
+        int body_memfd;
+        struct bus_header *body_memfd_header;
+
         size_t header_offsets[_BUS_MESSAGE_HEADER_MAX];
         unsigned n_header_offsets;
 
@@ -154,11 +169,17 @@ static inline size_t BUS_MESSAGE_BODY_BEGIN(sd_bus_message *m) {
                 ALIGN8(m->fields_size);
 }
 
+/* The size of the header announcing a memfd body: the original header, padded, plus the MEMFD_BODY field */
+static inline size_t BUS_MESSAGE_MEMFD_BODY_HEADER_SIZE(sd_bus_message *m) {
+        return BUS_MESSAGE_BODY_BEGIN(m) + 8;
+}
+
 static inline void* BUS_MESSAGE_FIELDS(sd_bus_message *m) {
         return (uint8_t*) m->header + sizeof(struct bus_header);
 }
 
 int bus_message_get_blob(sd_bus_message *m, void **buffer, size_t *sz);
+int bus_message_setup_memfd_body(sd_bus_message *m);
 
 int bus_message_from_malloc(
                 sd_bus *bus,
@@ -169,6 +190,8 @@ int bus_message_from_malloc(
                 const char *label,
                 sd_bus_message **ret);
 
+int bus_message_peek_unix_fds(sd_bus *bus, void *buffer, size_t length, size_t *ret);
+
 int bus_message_get_arg(sd_bus_message *m, unsigned i, const char **str);
 int bus_message_get_arg_strv(sd_bus_message *m, unsigned i, char ***strv);
 
@@ -180,6 +203,9 @@ void bus_body_part_unmap(struct bus_body_part *part);
 
 int bus_message_new_synthetic_error(sd_bus *bus, uint64_t serial, const sd_bus_error *e, sd_bus_message **m);
 
+int bus_message_open_container_trusted(sd_bus_message *m, char type, const char *contents);
+int bus_message_enter_container_trusted(sd_bus_message *m, char type, const char *contents);
+
 int bus_message_remarshal(sd_bus *bus, sd_bus_message **m);
 
 void bus_message_set_sender_driver(sd_bus *bus, sd_bus_message *m);
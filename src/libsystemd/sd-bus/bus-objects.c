@@ -419,43 +419,16 @@ static int method_callbacks_run(
         return 1;
 }
 
-static int invoke_property_get(
-                sd_bus *bus,
-                sd_bus_slot *slot,
+static int property_get_default(
                 const sd_bus_vtable *v,
-                const char *path,
-                const char *interface,
-                const char *property,
                 sd_bus_message *reply,
-                void *userdata,
-                sd_bus_error *error) {
+                void *userdata) {
 
         const void *p;
-        int r;
 
-        assert(bus);
-        assert(slot);
         assert(v);
-        assert(path);
-        assert(interface);
-        assert(property);
         assert(reply);
 
-        if (v->x.property.get) {
-
-                bus->current_slot = sd_bus_slot_ref(slot);
-                bus->current_userdata = userdata;
-                r = v->x.property.get(bus, path, interface, property, reply, userdata, error);
-                bus->current_userdata = NULL;
-                bus->current_slot = sd_bus_slot_unref(slot);
-
-                if (r < 0)
-                        return r;
-                if (sd_bus_error_is_set(error))
-                        return -sd_bus_error_get_errno(error);
-                return r;
-        }
-
         /* Automatic handling if no callback is defined. */
 
         if (streq(v->x.property.signature, "as"))
@@ -484,10 +457,111 @@ static int invoke_property_get(
         return sd_bus_message_append_basic(reply, v->x.property.signature[0], p);
 }
 
+static int invoke_property_get(
+                sd_bus *bus,
+                sd_bus_slot *slot,
+                const sd_bus_vtable *v,
+                const BusSignatureProgram *program,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        const BusSignatureProgram *saved_program;
+        int r;
+
+        assert(bus);
+        assert(slot);
+        assert(v);
+        assert(path);
+        assert(interface);
+        assert(property);
+        assert(reply);
+
+        if (!v->x.property.get)
+                return property_get_default(v, reply, userdata);
+
+        /* Let the getter's sd_bus_message_append() calls use the compiled property signature. The program
+         * is owned by the bus, which the reply holds a reference on, hence it doesn't matter if the slot
+         * goes away while the getter runs. */
+        saved_program = reply->property_program;
+        reply->property_program = program;
+
+        bus->current_slot = sd_bus_slot_ref(slot);
+        bus->current_userdata = userdata;
+        r = v->x.property.get(bus, path, interface, property, reply, userdata, error);
+        bus->current_userdata = NULL;
+        bus->current_slot = sd_bus_slot_unref(slot);
+
+        reply->property_program = saved_program;
+
+        if (r < 0)
+                return r;
+        if (sd_bus_error_is_set(error))
+                return -sd_bus_error_get_errno(error);
+        return r;
+}
+
+int bus_vtable_append_property(
+                sd_bus *bus,
+                sd_bus_message *reply,
+                const char *path,
+                const char *interface,
+                const sd_bus_vtable *v,
+                void *userdata,
+                sd_bus_error *error) {
+
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(path);
+        assert(interface);
+        assert(v);
+        assert(IN_SET(v->type, _SD_BUS_VTABLE_PROPERTY, _SD_BUS_VTABLE_WRITABLE_PROPERTY));
+
+        /* Appends a single "{sv}" entry for the specified property to the message, calling the getter
+         * directly, i.e. without going through the object tree. This allows object implementations to
+         * return properties of many objects in a single reply. 'userdata' is the object pointer as
+         * returned by the find callback, the property offset is applied here. */
+
+        r = sd_bus_message_open_container(reply, 'e', "sv");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append_basic(reply, 's', v->x.property.member);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'v', v->x.property.signature);
+        if (r < 0)
+                return r;
+
+        userdata = vtable_property_convert_userdata(v, userdata);
+
+        if (v->x.property.get) {
+                r = v->x.property.get(bus, path, interface, v->x.property.member, reply, userdata, error);
+                if (r >= 0 && sd_bus_error_is_set(error))
+                        r = -sd_bus_error_get_errno(error);
+        } else
+                r = property_get_default(v, reply, userdata);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_close_container(reply);
+}
+
 static int invoke_property_set(
                 sd_bus *bus,
                 sd_bus_slot *slot,
                 const sd_bus_vtable *v,
+                const BusSignatureProgram *program,
                 const char *path,
                 const char *interface,
                 const char *property,
@@ -506,6 +580,9 @@ static int invoke_property_set(
         assert(value);
 
         if (v->x.property.set) {
+                const BusSignatureProgram *saved_program = value->property_program;
+
+                value->property_program = program;
 
                 bus->current_slot = sd_bus_slot_ref(slot);
                 bus->current_userdata = userdata;
@@ -513,6 +590,8 @@ static int invoke_property_set(
                 bus->current_userdata = NULL;
                 bus->current_slot = sd_bus_slot_unref(slot);
 
+                value->property_program = saved_program;
+
                 if (r < 0)
                         return r;
                 if (sd_bus_error_is_set(error))
@@ -614,7 +693,7 @@ static int property_get_set_callbacks_run(
                  * ultimately without side-effects or if they aren't
                  * then at least idempotent. */
 
-                r = sd_bus_message_open_container(reply, 'v', c->vtable->x.property.signature);
+                r = bus_message_open_container_trusted(reply, 'v', c->program->signature);
                 if (r < 0)
                         return r;
 
@@ -623,7 +702,7 @@ static int property_get_set_callbacks_run(
                  * PropertiesChanged signals broadcast contents
                  * anyway. */
 
-                r = invoke_property_get(bus, slot, c->vtable, m->path, c->interface, c->member, reply, u, &error);
+                r = invoke_property_get(bus, slot, c->vtable, c->program, m->path, c->interface, c->member, reply, u, &error);
                 if (r < 0)
                         return bus_maybe_reply_error(m, r, &error);
 
@@ -662,7 +741,7 @@ static int property_get_set_callbacks_run(
                                                           "Incorrect parameters for property '%s', expected '%s', got '%s'.",
                                                           c->member, strempty(c->vtable->x.property.signature), strempty(signature));
 
-                r = sd_bus_message_enter_container(m, 'v', c->vtable->x.property.signature);
+                r = bus_message_enter_container_trusted(m, 'v', c->program->signature);
                 if (r < 0)
                         return r;
 
@@ -670,7 +749,7 @@ static int property_get_set_callbacks_run(
                 if (r < 0)
                         return bus_maybe_reply_error(m, r, &error);
 
-                r = invoke_property_set(bus, slot, c->vtable, m->path, c->interface, c->member, m, u, &error);
+                r = invoke_property_set(bus, slot, c->vtable, c->program, m->path, c->interface, c->member, m, u, &error);
                 if (r < 0)
                         return bus_maybe_reply_error(m, r, &error);
 
@@ -698,6 +777,7 @@ static int vtable_append_one_property(
                 void *userdata,
                 sd_bus_error *error) {
 
+        const BusSignatureProgram *program;
         sd_bus_slot *slot;
         int r;
 
@@ -713,21 +793,25 @@ static int vtable_append_one_property(
                         return r;
         }
 
-        r = sd_bus_message_open_container(reply, 'e', "sv");
+        program = c->programs[bus_vtable_index(c->vtable, v)];
+        assert(program);
+
+        /* Both signatures are known to be valid and stay around, hence skip checking and copying them */
+        r = bus_message_open_container_trusted(reply, 'e', "sv");
         if (r < 0)
                 return r;
 
-        r = sd_bus_message_append(reply, "s", v->x.property.member);
+        r = sd_bus_message_append_basic(reply, 's', v->x.property.member);
         if (r < 0)
                 return r;
 
-        r = sd_bus_message_open_container(reply, 'v', v->x.property.signature);
+        r = bus_message_open_container_trusted(reply, 'v', program->signature);
         if (r < 0)
                 return r;
 
         slot = container_of(c, sd_bus_slot, node_vtable);
 
-        r = invoke_property_get(bus, slot, v, path, c->interface, v->x.property.member, reply, vtable_property_convert_userdata(v, userdata), error);
+        r = invoke_property_get(bus, slot, v, program, path, c->interface, v->x.property.member, reply, vtable_property_convert_userdata(v, userdata), error);
         if (r < 0)
                 return r;
         if (bus->nodes_modified)
@@ -1495,7 +1579,7 @@ static struct node* bus_node_allocate(sd_bus *bus, const char *path) {
         if (n)
                 return n;
 
-        r = hashmap_ensure_allocated(&bus->nodes, &string_hash_ops);
+        r = hashmap_ensure_allocated(&bus->nodes, &string_fast_hash_ops);
         if (r < 0)
                 return NULL;
 
@@ -1779,6 +1863,44 @@ const sd_bus_vtable* bus_vtable_next(const sd_bus_vtable *vtable, const sd_bus_v
         return (const sd_bus_vtable*) ((char*) v + vtable[0].x.start.element_size);
 }
 
+size_t bus_vtable_index(const sd_bus_vtable *vtable, const sd_bus_vtable *v) {
+        return ((const char*) v - (const char*) vtable) / vtable[0].x.start.element_size;
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(
+                signature_program_hash_ops,
+                char, string_hash_func, string_compare_func,
+                BusSignatureProgram, bus_signature_program_free);
+
+static int bus_get_signature_program(sd_bus *bus, const char *signature, const BusSignatureProgram **ret) {
+        _cleanup_(bus_signature_program_freep) BusSignatureProgram *p = NULL;
+        const BusSignatureProgram *existing;
+        int r;
+
+        assert(bus);
+        assert(signature);
+        assert(ret);
+
+        /* Most properties share a handful of signatures, hence compile each only once per bus. */
+
+        existing = hashmap_get(bus->signature_programs, signature);
+        if (existing) {
+                *ret = existing;
+                return 0;
+        }
+
+        r = bus_signature_compile(signature, &p);
+        if (r < 0)
+                return r;
+
+        r = hashmap_ensure_put(&bus->signature_programs, &signature_program_hash_ops, p->signature, p);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(p);
+        return 0;
+}
+
 static int add_object_vtable_internal(
                 sd_bus *bus,
                 sd_bus_slot **slot,
@@ -1857,6 +1979,14 @@ static int add_object_vtable_internal(
                 goto fail;
         }
 
+        for (v = vtable; v->type != _SD_BUS_VTABLE_END; v = bus_vtable_next(vtable, v))
+                ;
+        s->node_vtable.programs = new0(const BusSignatureProgram*, bus_vtable_index(vtable, v) + 1);
+        if (!s->node_vtable.programs) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
         v = s->node_vtable.vtable;
         for (v = bus_vtable_next(vtable, v); v->type != _SD_BUS_VTABLE_END; v = bus_vtable_next(vtable, v)) {
 
@@ -1940,6 +2070,14 @@ static int add_object_vtable_internal(
                         m->member = v->x.property.member;
                         m->vtable = v;
 
+                        r = bus_get_signature_program(bus, v->x.property.signature, &m->program);
+                        if (r < 0) {
+                                free(m);
+                                goto fail;
+                        }
+
+                        s->node_vtable.programs[bus_vtable_index(vtable, v)] = m->program;
+
                         r = hashmap_put(bus->vtable_properties, m, m);
                         if (r < 0) {
                                 free(m);
@@ -6,9 +6,19 @@
 
 const sd_bus_vtable* bus_vtable_next(const sd_bus_vtable *vtable, const sd_bus_vtable *v);
 bool bus_vtable_has_names(const sd_bus_vtable *vtable);
+size_t bus_vtable_index(const sd_bus_vtable *vtable, const sd_bus_vtable *v);
 int bus_process_object(sd_bus *bus, sd_bus_message *m);
 void bus_node_gc(sd_bus *b, struct node *n);
 
+int bus_vtable_append_property(
+                sd_bus *bus,
+                sd_bus_message *reply,
+                const char *path,
+                const char *interface,
+                const sd_bus_vtable *v,
+                void *userdata,
+                sd_bus_error *error);
+
 int introspect_path(
                 sd_bus *bus,
                 const char *path,
@@ -58,6 +58,11 @@ enum {
         _BUS_MESSAGE_HEADER_MAX
 };
 
+/* Not part of the specification: carries the size of a body that is not sent inline, but as sealed memfd
+ * passed as additional file descriptor after those counted in the UNIX_FDS field. Always the last field of
+ * the header, and only sent to peers that agreed to it during authentication, see bus-socket.c. */
+#define BUS_MESSAGE_HEADER_MEMFD_BODY 0xfe
+
 /* RequestName parameters */
 
 enum  {
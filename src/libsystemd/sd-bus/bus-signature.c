@@ -2,8 +2,10 @@
 
 #include "sd-bus.h"
 
+#include "alloc-util.h"
 #include "bus-signature.h"
 #include "bus-type.h"
+#include "string-util.h"
 
 static int signature_element_length_internal(
                 const char *s,
@@ -144,3 +146,174 @@ bool signature_is_valid(const char *s, bool allow_dict_entry) {
 
         return p - s <= SD_BUS_MAXIMUM_SIGNATURE_LENGTH;
 }
+
+typedef struct SignatureCompiler {
+        BusSignatureOp *ops;    /* NULL while we are only counting */
+        char *strings;
+        size_t n_ops, n_strings;
+        bool has_variant;
+} SignatureCompiler;
+
+static const char* signature_compile_contents(SignatureCompiler *c, const char *s, size_t l) {
+        char *p = NULL;
+
+        assert(c);
+        assert(s);
+
+        if (c->strings) {
+                p = c->strings + c->n_strings;
+                memcpy(p, s, l);
+                p[l] = 0;
+        }
+
+        c->n_strings += l + 1;
+        return p;
+}
+
+static void signature_compile_element(SignatureCompiler *c, const char *s, size_t l) {
+        const char *contents = NULL;
+        size_t i;
+        char type;
+
+        assert(c);
+        assert(s);
+        assert(l > 0);
+
+        /* The signature has been validated already, hence we don't need to check anything here. */
+
+        i = c->n_ops++;
+
+        switch (*s) {
+
+        case SD_BUS_TYPE_ARRAY:
+                type = SD_BUS_TYPE_ARRAY;
+                contents = signature_compile_contents(c, s + 1, l - 1);
+                signature_compile_element(c, s + 1, l - 1);
+                break;
+
+        case SD_BUS_TYPE_STRUCT_BEGIN:
+        case SD_BUS_TYPE_DICT_ENTRY_BEGIN:
+                type = *s == SD_BUS_TYPE_STRUCT_BEGIN ? SD_BUS_TYPE_STRUCT : SD_BUS_TYPE_DICT_ENTRY;
+                contents = signature_compile_contents(c, s + 1, l - 2);
+
+                for (const char *p = s + 1; p < s + l - 1;) {
+                        size_t k;
+
+                        assert_se(signature_element_length(p, &k) >= 0);
+                        signature_compile_element(c, p, k);
+                        p += k;
+                }
+                break;
+
+        case SD_BUS_TYPE_VARIANT:
+                c->has_variant = true;
+                _fallthrough_;
+
+        default:
+                type = *s;
+        }
+
+        if (c->ops)
+                c->ops[i] = (BusSignatureOp) {
+                        .type = type,
+                        .end = c->n_ops,
+                        .contents = contents,
+                };
+}
+
+static void signature_compile_all(SignatureCompiler *c, const char *s) {
+        assert(c);
+        assert(s);
+
+        while (*s) {
+                size_t k;
+
+                assert_se(signature_element_length(s, &k) >= 0);
+                signature_compile_element(c, s, k);
+                s += k;
+        }
+}
+
+int bus_signature_compile(const char *s, BusSignatureProgram **ret) {
+        _cleanup_(bus_signature_program_freep) BusSignatureProgram *p = NULL;
+        SignatureCompiler c = {};
+
+        assert(ret);
+
+        if (!signature_is_valid(s, false))
+                return -EINVAL;
+
+        /* First pass: count the operations and the size of the contents strings, second pass: fill them in. */
+        signature_compile_all(&c, s);
+
+        p = new(BusSignatureProgram, 1);
+        if (!p)
+                return -ENOMEM;
+
+        *p = (BusSignatureProgram) {
+                .signature = strdup(s),
+                .ops = new(BusSignatureOp, MAX(c.n_ops, 1u)),
+                .strings = new(char, MAX(c.n_strings, 1u)),
+                .has_variant = c.has_variant,
+        };
+        if (!p->signature || !p->ops || !p->strings)
+                return -ENOMEM;
+
+        c = (SignatureCompiler) {
+                .ops = p->ops,
+                .strings = p->strings,
+        };
+        signature_compile_all(&c, s);
+        p->n_ops = c.n_ops;
+
+        *ret = TAKE_PTR(p);
+        return 0;
+}
+
+BusSignatureProgram* bus_signature_program_free(BusSignatureProgram *p) {
+        if (!p)
+                return NULL;
+
+        free(p->signature);
+        free(p->ops);
+        free(p->strings);
+        return mfree(p);
+}
+
+bool bus_signature_program_match(const BusSignatureProgram *p, const char *types, size_t *ret_begin, size_t *ret_end) {
+        assert(p);
+        assert(types);
+        assert(ret_begin);
+        assert(ret_end);
+
+        /* Checks whether 'types' is the signature the program was compiled from, or the element signature
+         * of an array program, and returns the range of operations to run for it. */
+
+        if (streq(types, p->signature)) {
+                *ret_begin = 0;
+                *ret_end = p->n_ops;
+                return true;
+        }
+
+        if (p->n_ops > 0 && p->ops[0].type == SD_BUS_TYPE_ARRAY && streq(types, p->ops[0].contents)) {
+                *ret_begin = 1;
+                *ret_end = p->ops[0].end;
+                return true;
+        }
+
+        return false;
+}
+
+const char* bus_signature_program_find_contents(const BusSignatureProgram *p, char type, const char *contents) {
+        assert(p);
+        assert(contents);
+
+        /* Returns the program's own, already validated copy of the specified container contents, if the
+         * program has a container of that type and contents. */
+
+        FOREACH_ARRAY(op, p->ops, p->n_ops)
+                if (op->type == type && op->contents && streq(op->contents, contents))
+                        return op->contents;
+
+        return NULL;
+}
@@ -2,9 +2,39 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
+
+#include "macro.h"
 
 bool signature_is_single(const char *s, bool allow_dict_entry);
 bool signature_is_pair(const char *s);
 bool signature_is_valid(const char *s, bool allow_dict_entry);
 
 int signature_element_length(const char *s, size_t *l);
+
+/* A signature compiled into a flat list of operations, so that the marshalling code can walk a
+ * signature that is used over and over again (such as the one of a vtable property) without
+ * re-parsing and re-validating it, and without copying container contents signatures each time.
+ * Containers are followed by the operations for their contents, 'end' is the index of the first
+ * operation after the container. 'contents' are NUL-terminated strings owned by the program. Variants
+ * are compiled as a single operation, since their contents are only known at runtime. */
+typedef struct BusSignatureOp {
+        char type;
+        unsigned end;
+        const char *contents;
+} BusSignatureOp;
+
+typedef struct BusSignatureProgram {
+        char *signature;
+        BusSignatureOp *ops;
+        size_t n_ops;
+        bool has_variant;
+        char *strings;
+} BusSignatureProgram;
+
+int bus_signature_compile(const char *s, BusSignatureProgram **ret);
+BusSignatureProgram* bus_signature_program_free(BusSignatureProgram *p);
+DEFINE_TRIVIAL_CLEANUP_FUNC(BusSignatureProgram*, bus_signature_program_free);
+
+bool bus_signature_program_match(const BusSignatureProgram *p, const char *types, size_t *ret_begin, size_t *ret_end);
+const char* bus_signature_program_find_contents(const BusSignatureProgram *p, char type, const char *contents);
@@ -10,6 +10,7 @@
 
 #include "alloc-util.h"
 #include "bus-internal.h"
+#include "bus-kernel.h"
 #include "bus-message.h"
 #include "bus-socket.h"
 #include "escape.h"
@@ -27,6 +28,7 @@
 #include "signal-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
+#include "unaligned.h"
 #include "user-util.h"
 #include "utf8.h"
 
@@ -125,8 +127,15 @@ bool bus_socket_auth_needs_write(sd_bus *b) {
         return false;
 }
 
+static bool bus_socket_negotiate_memfd_body(sd_bus *b) {
+        assert(b);
+
+        /* Bodies can only be passed as memfd if fds can be passed at all */
+        return b->accept_fd && b->accept_memfd_body;
+}
+
 static int bus_socket_auth_verify_client(sd_bus *b) {
-        char *l, *lines[4] = {};
+        char *l, *lines[5] = {};
         sd_id128_t peer;
         size_t i, n;
         int r;
@@ -134,15 +143,16 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
         assert(b);
 
         /*
-         * We expect up to three response lines:
+         * We expect up to four response lines:
          *   "DATA\r\n"                 (optional)
          *   "OK <server-id>\r\n"
          *   "AGREE_UNIX_FD\r\n"        (optional)
+         *   "AGREE_MEMFD_BODY\r\n"     (optional)
          */
 
         n = 0;
         lines[n] = b->rbuffer;
-        for (i = 0; i < 3; ++i) {
+        for (i = 0; i < 4; ++i) {
                 l = memmem_safe(lines[n], b->rbuffer_size - (lines[n] - (char*) b->rbuffer), "\r\n", 2);
                 if (l)
                         lines[++n] = l + 2;
@@ -157,9 +167,11 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
          * challenge, reply with our own DATA, and expect an OK reply. We do
          * this for EXTERNAL.
          * If FD negotiation was requested, we additionally expect
-         * an AGREE_UNIX_FD response in all cases.
+         * an AGREE_UNIX_FD response in all cases. The same goes for
+         * passing bodies as memfd, which servers that don't know about
+         * it reply to with ERROR.
          */
-        if (n < (b->anonymous_auth ? 1U : 2U) + !!b->accept_fd)
+        if (n < (b->anonymous_auth ? 1U : 2U) + !!b->accept_fd + bus_socket_negotiate_memfd_body(b))
                 return 0; /* wait for more data */
 
         i = 0;
@@ -220,6 +232,11 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
                 b->can_fds = !!memory_startswith(l, lines[i] - l, "AGREE_UNIX_FD");
         }
 
+        if (bus_socket_negotiate_memfd_body(b)) {
+                l = lines[i++];
+                b->can_memfd_body = b->can_fds && memory_startswith(l, lines[i] - l, "AGREE_MEMFD_BODY");
+        }
+
         assert(i == n);
 
         b->rbuffer_size -= (lines[i] - (char*) b->rbuffer);
@@ -470,6 +487,13 @@ static int bus_socket_auth_verify_server(sd_bus *b) {
                                 b->can_fds = true;
                                 r = bus_socket_auth_write(b, "AGREE_UNIX_FD\r\n");
                         }
+                } else if (line_equals(line, l, "NEGOTIATE_MEMFD_BODY")) {
+                        if (b->auth == _BUS_AUTH_INVALID || !b->can_fds || !b->accept_memfd_body)
+                                r = bus_socket_auth_write(b, "ERROR\r\n");
+                        else {
+                                b->can_memfd_body = true;
+                                r = bus_socket_auth_write(b, "AGREE_MEMFD_BODY\r\n");
+                        }
                 } else
                         r = bus_socket_auth_write(b, "ERROR\r\n");
 
@@ -681,6 +705,10 @@ static int bus_socket_start_auth_client(sd_bus *b) {
         static const char sasl_negotiate_unix_fd[] = {
                 "NEGOTIATE_UNIX_FD\r\n"
         };
+        /* Not part of the specification, see BUS_MESSAGE_HEADER_MEMFD_BODY */
+        static const char sasl_negotiate_memfd_body[] = {
+                "NEGOTIATE_MEMFD_BODY\r\n"
+        };
         static const char sasl_begin[] = {
                 "BEGIN\r\n"
         };
@@ -696,6 +724,9 @@ static int bus_socket_start_auth_client(sd_bus *b) {
         if (b->accept_fd)
                 b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_negotiate_unix_fd);
 
+        if (bus_socket_negotiate_memfd_body(b))
+                b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_negotiate_memfd_body);
+
         b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_begin);
 
         return bus_socket_write_auth(b);
@@ -1087,11 +1118,33 @@ int bus_socket_take_fd(sd_bus *b) {
         return bus_socket_start_auth(b);
 }
 
+static bool bus_socket_use_memfd_body(sd_bus *bus, sd_bus_message *m) {
+        assert(bus);
+        assert(m);
+
+        /* Large bodies are passed as sealed memfd to peers that agreed to it, so that they are neither
+         * copied through the socket nor into the receive buffer. Sensitive data is kept out of memfds, since
+         * we can't erase it there. */
+        return bus->can_memfd_body &&
+                !m->sensitive &&
+                m->body_size >= MEMFD_MIN_SIZE &&
+                m->n_fds < BUS_FDS_MAX;
+}
+
+size_t bus_socket_message_size(sd_bus *bus, sd_bus_message *m) {
+        assert(bus);
+        assert(m);
+
+        /* The number of bytes the message takes up on the connection */
+        return bus_socket_use_memfd_body(bus, m) ? BUS_MESSAGE_MEMFD_BODY_HEADER_SIZE(m) : BUS_MESSAGE_SIZE(m);
+}
+
 int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         struct iovec *iov;
+        unsigned j, n_iovec;
+        size_t n, n_fds;
+        int *fds;
         ssize_t k;
-        size_t n;
-        unsigned j;
         int r;
 
         assert(bus);
@@ -1099,44 +1152,63 @@ int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         assert(idx);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        if (*idx >= BUS_MESSAGE_SIZE(m))
+        if (*idx >= bus_socket_message_size(bus, m))
                 return 0;
 
-        r = bus_message_setup_iovec(m);
-        if (r < 0)
-                return r;
+        if (bus_socket_use_memfd_body(bus, m)) {
+                r = bus_message_setup_memfd_body(m);
+                if (r < 0)
+                        return r;
+
+                n_iovec = 1;
+                iov = newa(struct iovec, 1);
+                iov[0] = IOVEC_MAKE(m->body_memfd_header, BUS_MESSAGE_MEMFD_BODY_HEADER_SIZE(m));
 
-        n = m->n_iovec * sizeof(struct iovec);
-        iov = newa(struct iovec, n);
-        memcpy_safe(iov, m->iovec, n);
+                n_fds = m->n_fds + 1;
+                fds = newa(int, n_fds);
+                memcpy_safe(fds, m->fds, sizeof(int) * m->n_fds);
+                fds[m->n_fds] = m->body_memfd;
+        } else {
+                r = bus_message_setup_iovec(m);
+                if (r < 0)
+                        return r;
+
+                n_iovec = m->n_iovec;
+                n = n_iovec * sizeof(struct iovec);
+                iov = newa(struct iovec, n);
+                memcpy_safe(iov, m->iovec, n);
+
+                n_fds = m->n_fds;
+                fds = m->fds;
+        }
 
         j = 0;
         iovec_advance(iov, &j, *idx);
 
         if (bus->prefer_writev)
-                k = writev(bus->output_fd, iov, m->n_iovec);
+                k = writev(bus->output_fd, iov, n_iovec);
         else {
                 struct msghdr mh = {
                         .msg_iov = iov,
-                        .msg_iovlen = m->n_iovec,
+                        .msg_iovlen = n_iovec,
                 };
 
-                if (m->n_fds > 0 && *idx == 0) {
+                if (n_fds > 0 && *idx == 0) {
                         struct cmsghdr *control;
 
-                        mh.msg_controllen = CMSG_SPACE(sizeof(int) * m->n_fds);
+                        mh.msg_controllen = CMSG_SPACE(sizeof(int) * n_fds);
                         mh.msg_control = alloca0(mh.msg_controllen);
                         control = CMSG_FIRSTHDR(&mh);
-                        control->cmsg_len = CMSG_LEN(sizeof(int) * m->n_fds);
+                        control->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
                         control->cmsg_level = SOL_SOCKET;
                         control->cmsg_type = SCM_RIGHTS;
-                        memcpy(CMSG_DATA(control), m->fds, sizeof(int) * m->n_fds);
+                        memcpy(CMSG_DATA(control), fds, sizeof(int) * n_fds);
                 }
 
                 k = sendmsg(bus->output_fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
                 if (k < 0 && errno == ENOTSOCK) {
                         bus->prefer_writev = true;
-                        k = writev(bus->output_fd, iov, m->n_iovec);
+                        k = writev(bus->output_fd, iov, n_iovec);
                 }
         }
 
@@ -1148,6 +1220,7 @@ int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
 }
 
 static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
+        const uint8_t *p;
         uint32_t a, b;
         uint8_t e;
         uint64_t sum;
@@ -1178,10 +1251,12 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
                 return 0;
         }
 
-        a = ((const uint32_t*) bus->rbuffer)[1];
-        b = ((const uint32_t*) bus->rbuffer)[3];
+        p = (const uint8_t*) bus->rbuffer + bus->rbuffer_offset;
 
-        e = ((const uint8_t*) bus->rbuffer)[0];
+        a = unaligned_read_ne32(p + 4);
+        b = unaligned_read_ne32(p + 12);
+
+        e = p[0];
         if (e == BUS_LITTLE_ENDIAN) {
                 a = le32toh(a);
                 b = le32toh(b);
@@ -1199,9 +1274,50 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
         return 0;
 }
 
+static int bus_socket_take_fds(sd_bus *bus, void *buffer, size_t size, int **ret_fds, size_t *ret_n_fds) {
+        size_t n;
+        int r;
+
+        assert(bus);
+        assert(ret_fds);
+        assert(ret_n_fds);
+
+        /* Several messages might have been read in one go, hence the fds we received so far might belong to
+         * more than one of them. Take only as many as this message says it carries. If that can't be
+         * determined, or doesn't add up, pass all of them on and let the message parser refuse it. */
+
+        if (bus->n_fds > 0) {
+                r = bus_message_peek_unix_fds(bus, buffer, size, &n);
+                if (r == -ENOMEM)
+                        return r;
+                if (r >= 0 && n < bus->n_fds) {
+                        _cleanup_free_ int *fds = NULL;
+
+                        if (n > 0) {
+                                fds = newdup(int, bus->fds, n);
+                                if (!fds)
+                                        return -ENOMEM;
+                        }
+
+                        memmove(bus->fds, bus->fds + n, (bus->n_fds - n) * sizeof(int));
+                        bus->n_fds -= n;
+
+                        *ret_fds = TAKE_PTR(fds);
+                        *ret_n_fds = n;
+                        return 0;
+                }
+        }
+
+        *ret_fds = TAKE_PTR(bus->fds);
+        *ret_n_fds = TAKE_GENERIC(bus->n_fds, size_t, 0);
+        return 0;
+}
+
 static int bus_socket_make_message(sd_bus *bus, size_t size) {
-        sd_bus_message *t = NULL;
-        void *b;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *t = NULL;
+        _cleanup_free_ void *b = NULL;
+        _cleanup_free_ int *fds = NULL;
+        size_t n_fds = 0;
         int r;
 
         assert(bus);
@@ -1212,39 +1328,51 @@ static int bus_socket_make_message(sd_bus *bus, size_t size) {
         if (r < 0)
                 return r;
 
-        if (bus->rbuffer_size > size) {
-                b = memdup((const uint8_t*) bus->rbuffer + size,
-                           bus->rbuffer_size - size);
+        if (size > BUS_RBUFFER_READ_AHEAD) {
+                /* Large messages have been read into a buffer of their own, just pass it on. */
+                assert(bus->rbuffer_offset == 0);
+                assert(bus->rbuffer_size == size);
+
+                b = TAKE_PTR(bus->rbuffer);
+        } else {
+                /* Small messages are copied out of the receive buffer, so that it can be reused for the
+                 * next batch and the message doesn't pin more memory than it needs. */
+                b = memdup((const uint8_t*) bus->rbuffer + bus->rbuffer_offset, size);
                 if (!b)
                         return -ENOMEM;
-        } else
-                b = NULL;
+
+                bus->rbuffer_offset += size;
+        }
+
+        bus->rbuffer_size -= size;
+        if (bus->rbuffer_size == 0)
+                bus->rbuffer_offset = 0;
+
+        r = bus_socket_take_fds(bus, b, size, &fds, &n_fds);
+        if (r < 0)
+                return r;
 
         r = bus_message_from_malloc(bus,
-                                    bus->rbuffer, size,
-                                    bus->fds, bus->n_fds,
+                                    b, size,
+                                    fds, n_fds,
                                     NULL,
                                     &t);
         if (r == -EBADMSG) {
                 log_debug_errno(r, "Received invalid message from connection %s, dropping.", strna(bus->description));
-                free(bus->rbuffer); /* We want to drop current rbuffer and proceed with whatever remains in b */
-        } else if (r < 0) {
-                free(b);
+                close_many(fds, n_fds);
+                return 1;
+        }
+        if (r < 0) {
+                close_many(fds, n_fds);
                 return r;
         }
 
-        /* rbuffer ownership was either transferred to t, or we got EBADMSG and dropped it. */
-        bus->rbuffer = b;
-        bus->rbuffer_size -= size;
-
-        bus->fds = NULL;
-        bus->n_fds = 0;
+        /* Buffer and fds ownership was transferred to t */
+        TAKE_PTR(b);
+        TAKE_PTR(fds);
 
-        if (t) {
-                t->read_counter = ++bus->read_counter;
-                bus->rqueue[bus->rqueue_size++] = bus_message_ref_queued(t, bus);
-                sd_bus_message_unref(t);
-        }
+        t->read_counter = ++bus->read_counter;
+        bus->rqueue[bus->rqueue_size++] = bus_message_ref_queued(t, bus);
 
         return 1;
 }
@@ -1253,7 +1381,7 @@ int bus_socket_read_message(sd_bus *bus) {
         struct msghdr mh;
         struct iovec iov = {};
         ssize_t k;
-        size_t need;
+        size_t need, want;
         int r;
         void *b;
         CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(int) * BUS_FDS_MAX)) control;
@@ -1269,13 +1397,26 @@ int bus_socket_read_message(sd_bus *bus) {
         if (bus->rbuffer_size >= need)
                 return bus_socket_make_message(bus, need);
 
-        b = realloc(bus->rbuffer, need);
-        if (!b)
-                return -ENOMEM;
+        /* Whatever is left in the buffer is an incomplete message, move it to the front */
+        if (bus->rbuffer_offset > 0) {
+                memmove(bus->rbuffer, (uint8_t*) bus->rbuffer + bus->rbuffer_offset, bus->rbuffer_size);
+                bus->rbuffer_offset = 0;
+        }
 
-        bus->rbuffer = b;
+        /* For small messages, read as much as we can get in one go, so that subsequent messages can be
+         * dispatched without further syscalls. Large messages are read exactly, so that they can take
+         * possession of the buffer without copying. */
+        want = need <= BUS_RBUFFER_READ_AHEAD ? BUS_RBUFFER_READ_AHEAD : need;
 
-        iov = IOVEC_MAKE((uint8_t *)bus->rbuffer + bus->rbuffer_size, need - bus->rbuffer_size);
+        if (MALLOC_SIZEOF_SAFE(bus->rbuffer) < want) {
+                b = realloc(bus->rbuffer, want);
+                if (!b)
+                        return -ENOMEM;
+
+                bus->rbuffer = b;
+        }
+
+        iov = IOVEC_MAKE((uint8_t *)bus->rbuffer + bus->rbuffer_size, want - bus->rbuffer_size);
 
         if (bus->prefer_readv) {
                 k = readv(bus->input_fd, &iov, 1);
@@ -1343,14 +1484,21 @@ int bus_socket_read_message(sd_bus *bus) {
                                           cmsg->cmsg_level, cmsg->cmsg_type);
         }
 
-        r = bus_socket_read_message_need(bus, &need);
-        if (r < 0)
-                return r;
+        /* Queue every complete message we got right away. sd_bus_get_events(), sd_bus_get_timeout() and
+         * bus_poll() only look at the read queue, hence messages left in the receive buffer would otherwise
+         * only be dispatched once more data arrives on the socket, which might be never. */
+        for (;;) {
+                r = bus_socket_read_message_need(bus, &need);
+                if (r < 0)
+                        return r;
 
-        if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
+                if (bus->rbuffer_size < need)
+                        return 1;
 
-        return 1;
+                r = bus_socket_make_message(bus, need);
+                if (r < 0)
+                        return r;
+        }
 }
 
 int bus_socket_process_opening(sd_bus *b) {
@@ -10,6 +10,7 @@ int bus_socket_exec(sd_bus *b);
 int bus_socket_take_fd(sd_bus *b);
 int bus_socket_start_auth(sd_bus *b);
 
+size_t bus_socket_message_size(sd_bus *bus, sd_bus_message *m);
 int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx);
 int bus_socket_read_message(sd_bus *bus);
 
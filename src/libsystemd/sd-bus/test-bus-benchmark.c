@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -7,15 +8,18 @@
 
 #include "alloc-util.h"
 #include "bus-internal.h"
-#include "bus-kernel.h"
 #include "constants.h"
 #include "fd-util.h"
+#include "format-util.h"
+#include "memfd-util.h"
 #include "missing_resource.h"
 #include "string-util.h"
 #include "tests.h"
 #include "time-util.h"
 
 #define MAX_SIZE (2*1024*1024)
+#define THROUGHPUT_SIZE (1024*1024)
+#define PAYLOAD_BYTE 0x80
 
 static usec_t arg_loop_usec = 100 * USEC_PER_MSEC;
 
@@ -24,6 +28,17 @@ typedef enum Type {
         TYPE_DIRECT,
 } Type;
 
+static void verify_payload(const void *p, size_t sz) {
+        uint64_t sum = 0;
+
+        /* Read every byte of the payload, so that the receiving side pays for actually looking at the data
+         * in both modes, and not only for getting it mapped. */
+        for (const uint8_t *q = p; q < (const uint8_t*) p + sz; q++)
+                sum += *q;
+
+        assert_se(sum == (uint64_t) sz * PAYLOAD_BYTE);
+}
+
 static void server(sd_bus *b, size_t *result) {
         int r;
 
@@ -44,8 +59,24 @@ static void server(sd_bus *b, size_t *result) {
                         const void *p;
                         size_t sz;
 
-                        /* Make sure the mmap is mapped */
                         assert_se(sd_bus_message_read_array(m, 'y', &p, &sz) > 0);
+                        verify_payload(p, sz);
+
+                        r = sd_bus_reply_method_return(m, NULL);
+                        assert_se(r >= 0);
+                } else if (sd_bus_message_is_method_call(m, "benchmark.server", "WorkFd")) {
+                        uint64_t sz;
+                        void *p;
+                        int fd;
+
+                        /* The payload is passed as sealed memfd, and only mapped read-only here, so that it
+                         * is never copied. Refuse anything the sender could still modify under our feet. */
+                        assert_se(sd_bus_message_read(m, "h", &fd) > 0);
+                        assert_se(memfd_get_sealed(fd) > 0);
+                        assert_se(memfd_get_size(fd, &sz) >= 0);
+                        assert_se(memfd_map(fd, 0, sz, &p) >= 0);
+                        verify_payload(p, sz);
+                        assert_se(munmap(p, sz) >= 0);
 
                         r = sd_bus_reply_method_return(m, NULL);
                         assert_se(r >= 0);
@@ -68,14 +99,47 @@ static void transaction(sd_bus *b, size_t sz, const char *server_name) {
         assert_se(sd_bus_message_new_method_call(b, &m, server_name, "/", "benchmark.server", "Work") >= 0);
         assert_se(sd_bus_message_append_array_space(m, 'y', sz, (void**) &p) >= 0);
 
-        memset(p, 0x80, sz);
+        memset(p, PAYLOAD_BYTE, sz);
 
         assert_se(sd_bus_call(b, m, 0, NULL, &reply) >= 0);
 }
 
+static void transaction_memfd(sd_bus *b, size_t sz, const char *server_name) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_close_ int fd = -EBADF;
+        void *p;
+
+        /* Write the payload directly into the memfd, then seal it, so that it is never copied on the way
+         * to the receiver. */
+        fd = memfd_new_and_map("benchmark", sz, &p);
+        assert_se(fd >= 0);
+
+        memset(p, PAYLOAD_BYTE, sz);
+        assert_se(munmap(p, sz) >= 0);
+        assert_se(memfd_set_sealed(fd) >= 0);
+
+        assert_se(sd_bus_call_method(b, server_name, "/", "benchmark.server", "WorkFd", NULL, &reply, "h", fd) >= 0);
+}
+
+static unsigned measure(void (*func)(sd_bus *b, size_t sz, const char *server_name),
+                        sd_bus *b, size_t sz, const char *server_name) {
+        unsigned n;
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+        for (n = 0;; n++) {
+                func(b, sz, server_name);
+                if (now(CLOCK_MONOTONIC) >= t + arg_loop_usec)
+                        break;
+        }
+
+        return (unsigned) ((n * USEC_PER_SEC) / arg_loop_usec);
+}
+
 static void client_bisect(const char *address, const char *server_name) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *x = NULL;
         size_t lsize, rsize, csize;
+        bool can_memfd;
         sd_bus *b;
         int r;
 
@@ -85,19 +149,39 @@ static void client_bisect(const char *address, const char *server_name) {
         r = sd_bus_set_address(b, address);
         assert_se(r >= 0);
 
+        r = sd_bus_set_bus_client(b, true);
+        assert_se(r >= 0);
+
         r = sd_bus_start(b);
         assert_se(r >= 0);
 
+        r = sd_bus_can_send(b, SD_BUS_TYPE_UNIX_FD);
+        assert_se(r >= 0);
+        can_memfd = r > 0;
+        if (!can_memfd)
+                log_notice("Bus connection cannot pass file descriptors, skipping the memfd column.");
+
         r = sd_bus_call_method(b, server_name, "/", "benchmark.server", "Ping", NULL, NULL, NULL);
         assert_se(r >= 0);
 
+        if (!can_memfd) {
+                /* There is nothing to bisect against, hence only show how copying scales, and report 0
+                 * as crossover point. */
+                printf("SIZE\tCOPY\n");
+
+                for (csize = 1; csize <= MAX_SIZE; csize *= 2)
+                        printf("%zu\t%u\n", csize, measure(transaction, b, csize, server_name));
+
+                csize = 0;
+                goto finish;
+        }
+
         lsize = 1;
         rsize = MAX_SIZE;
 
         printf("SIZE\tCOPY\tMEMFD\n");
 
         for (;;) {
-                usec_t t;
                 unsigned n_copying, n_memfd;
 
                 csize = (lsize + rsize) / 2;
@@ -110,25 +194,11 @@ static void client_bisect(const char *address, const char *server_name) {
 
                 printf("%zu\t", csize);
 
-                b->use_memfd = 0;
-
-                t = now(CLOCK_MONOTONIC);
-                for (n_copying = 0;; n_copying++) {
-                        transaction(b, csize, server_name);
-                        if (now(CLOCK_MONOTONIC) >= t + arg_loop_usec)
-                                break;
-                }
-                printf("%u\t", (unsigned) ((n_copying * USEC_PER_SEC) / arg_loop_usec));
+                n_copying = measure(transaction, b, csize, server_name);
+                printf("%u\t", n_copying);
 
-                b->use_memfd = -1;
-
-                t = now(CLOCK_MONOTONIC);
-                for (n_memfd = 0;; n_memfd++) {
-                        transaction(b, csize, server_name);
-                        if (now(CLOCK_MONOTONIC) >= t + arg_loop_usec)
-                                break;
-                }
-                printf("%u\n", (unsigned) ((n_memfd * USEC_PER_SEC) / arg_loop_usec));
+                n_memfd = measure(transaction_memfd, b, csize, server_name);
+                printf("%u\n", n_memfd);
 
                 if (n_copying == n_memfd)
                         break;
@@ -139,9 +209,81 @@ static void client_bisect(const char *address, const char *server_name) {
                         rsize = csize;
         }
 
-        b->use_memfd = 1;
+finish:
         assert_se(sd_bus_message_new_method_call(b, &x, server_name, "/", "benchmark.server", "Exit") >= 0);
-        assert_se(sd_bus_message_append(x, "t", csize) >= 0);
+        assert_se(sd_bus_message_append(x, "t", (uint64_t) csize) >= 0);
+        assert_se(sd_bus_send(b, x, NULL) >= 0);
+
+        sd_bus_unref(b);
+}
+
+static void client_throughput(Type type, const char *address, const char *server_name, int fd) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *x = NULL;
+        unsigned n_copying, n_body = 0, n_memfd = 0;
+        bool can_memfd, can_memfd_body;
+        sd_bus *b;
+        int r;
+
+        r = sd_bus_new(&b);
+        assert_se(r >= 0);
+
+        if (type == TYPE_DIRECT) {
+                r = sd_bus_set_fd(b, fd, fd);
+                assert_se(r >= 0);
+        } else {
+                r = sd_bus_set_address(b, address);
+                assert_se(r >= 0);
+
+                r = sd_bus_set_bus_client(b, true);
+                assert_se(r >= 0);
+        }
+
+        r = sd_bus_start(b);
+        assert_se(r >= 0);
+
+        r = sd_bus_can_send(b, SD_BUS_TYPE_UNIX_FD);
+        assert_se(r >= 0);
+        can_memfd = r > 0;
+        if (!can_memfd)
+                log_notice("Bus connection cannot pass file descriptors, skipping the memfd columns.");
+
+        /* Large bodies are passed as sealed memfd automatically if the peer agreed to it during
+         * authentication, which a broker doesn't. */
+        can_memfd_body = b->can_memfd_body;
+        if (can_memfd && !can_memfd_body)
+                log_notice("Peer does not accept message bodies as memfd, skipping the BODY column.");
+
+        r = sd_bus_call_method(b, server_name, "/", "benchmark.server", "Ping", NULL, NULL, NULL);
+        assert_se(r >= 0);
+
+        /* Always send the body inline for the COPY column */
+        b->can_memfd_body = false;
+        n_copying = measure(transaction, b, THROUGHPUT_SIZE, server_name);
+        b->can_memfd_body = can_memfd_body;
+
+        if (can_memfd_body)
+                n_body = measure(transaction, b, THROUGHPUT_SIZE, server_name);
+        if (can_memfd)
+                n_memfd = measure(transaction_memfd, b, THROUGHPUT_SIZE, server_name);
+
+        printf("SIZE\tCOPY%s%s\n", can_memfd_body ? "\tBODY" : "", can_memfd ? "\tMEMFD" : "");
+
+        printf("%i\t%u", THROUGHPUT_SIZE, n_copying);
+        if (can_memfd_body)
+                printf("\t%u", n_body);
+        if (can_memfd)
+                printf("\t%u", n_memfd);
+        printf("\t(messages/s)\n");
+
+        printf("%i\t%s", THROUGHPUT_SIZE, FORMAT_BYTES((uint64_t) n_copying * THROUGHPUT_SIZE));
+        if (can_memfd_body)
+                printf("\t%s", FORMAT_BYTES((uint64_t) n_body * THROUGHPUT_SIZE));
+        if (can_memfd)
+                printf("\t%s", FORMAT_BYTES((uint64_t) n_memfd * THROUGHPUT_SIZE));
+        printf("\t(bytes/s)\n");
+
+        assert_se(sd_bus_message_new_method_call(b, &x, server_name, "/", "benchmark.server", "Exit") >= 0);
+        assert_se(sd_bus_message_append(x, "t", (uint64_t) THROUGHPUT_SIZE) >= 0);
         assert_se(sd_bus_send(b, x, NULL) >= 0);
 
         sd_bus_unref(b);
@@ -182,23 +324,9 @@ static void client_chart(Type type, const char *address, const char *server_name
                 break;
         }
 
-        for (csize = 1; csize <= MAX_SIZE; csize *= 2) {
-                usec_t t;
-                unsigned n_memfd;
+        for (csize = 1; csize <= MAX_SIZE; csize *= 2)
+                printf("%zu\t%u\n", csize, measure(transaction, b, csize, server_name));
 
-                printf("%zu\t", csize);
-
-                t = now(CLOCK_MONOTONIC);
-                for (n_memfd = 0;; n_memfd++) {
-                        transaction(b, csize, server_name);
-                        if (now(CLOCK_MONOTONIC) >= t + arg_loop_usec)
-                                break;
-                }
-
-                printf("%u\n", (unsigned) ((n_memfd * USEC_PER_SEC) / arg_loop_usec));
-        }
-
-        b->use_memfd = 1;
         assert_se(sd_bus_message_new_method_call(b, &x, server_name, "/", "benchmark.server", "Exit") >= 0);
         assert_se(sd_bus_message_append(x, "t", csize) >= 0);
         assert_se(sd_bus_send(b, x, NULL) >= 0);
@@ -210,6 +338,7 @@ int main(int argc, char *argv[]) {
         enum {
                 MODE_BISECT,
                 MODE_CHART,
+                MODE_THROUGHPUT,
         } mode = MODE_BISECT;
         Type type = TYPE_LEGACY;
         int i, pair[2] = EBADF_PAIR;
@@ -228,6 +357,9 @@ int main(int argc, char *argv[]) {
                 if (streq(argv[i], "chart")) {
                         mode = MODE_CHART;
                         continue;
+                } else if (streq(argv[i], "throughput")) {
+                        mode = MODE_THROUGHPUT;
+                        continue;
                 } else if (streq(argv[i], "legacy")) {
                         type = TYPE_LEGACY;
                         continue;
@@ -303,8 +435,14 @@ int main(int argc, char *argv[]) {
                 case MODE_CHART:
                         client_chart(type, address, server_name, pair[1]);
                         break;
+
+                case MODE_THROUGHPUT:
+                        client_throughput(type, address, server_name, pair[1]);
+                        break;
                 }
 
+                /* _exit() does not flush stdio, and the results would get lost if stdout is not a tty */
+                fflush(stdout);
                 _exit(EXIT_SUCCESS);
         }
 
@@ -314,7 +452,7 @@ int main(int argc, char *argv[]) {
 
         server(b, &result);
 
-        if (mode == MODE_BISECT)
+        if (mode == MODE_BISECT && result > 0)
                 printf("Copying/memfd are equally fast at %zu bytes\n", result);
 
         assert_se(waitpid(pid, NULL, 0) == pid);
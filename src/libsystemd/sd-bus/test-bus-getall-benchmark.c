@@ -0,0 +1,378 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+
+#include "alloc-util.h"
+#include "bus-error.h"
+#include "bus-internal.h"
+#include "errno-util.h"
+#include "parse-util.h"
+#include "path-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Roughly what "systemctl show" does for every loaded unit: a server exposes a number of objects below a
+ * common prefix through a fallback vtable that mirrors the property set of org.freedesktop.systemd1.Unit,
+ * and a client calls GetAll() on each of them and walks the reply. Reports the time per GetAll() call. */
+
+#define PREFIX "/org/freedesktop/systemd1/unit"
+#define INTERFACE "org.freedesktop.systemd1.Unit"
+
+static unsigned arg_n_objects = 1000;
+static unsigned arg_n_rounds = 5;
+
+typedef struct Object {
+        char *id;
+        char *description;
+        char *state;
+        char *path;
+        char *unset;
+        char **names;
+        char **dependencies;
+        char **empty;
+        uint64_t timestamp;
+        uint64_t timeout;
+        uint32_t burst;
+        int32_t exit_status;
+        int boolean;
+} Object;
+
+typedef struct Context {
+        int fds[2];
+        Object *objects;
+} Context;
+
+static int property_get_job(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        return sd_bus_message_append(reply, "(uo)", 0, "/");
+}
+
+static int property_get_conditions(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        return sd_bus_message_append(reply, "a(sbbsi)", 2,
+                                     "ConditionPathExists", false, false, "/etc/benchmark", 1,
+                                     "ConditionVirtualization", false, true, "!container", 1);
+}
+
+static int property_get_load_error(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        return sd_bus_message_append(reply, "(ss)", NULL, NULL);
+}
+
+static int property_get_invocation_id(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        return sd_bus_message_append_array(reply, 'y', &SD_ID128_NULL, sizeof(sd_id128_t));
+}
+
+static int property_get_activation_details(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        return sd_bus_message_append(reply, "a(ss)", 0);
+}
+
+#define STRING(name, field) \
+        SD_BUS_PROPERTY(name, "s", NULL, offsetof(Object, field), SD_BUS_VTABLE_PROPERTY_CONST)
+#define STRV(name, field) \
+        SD_BUS_PROPERTY(name, "as", NULL, offsetof(Object, field), SD_BUS_VTABLE_PROPERTY_CONST)
+#define BOOLEAN(name) \
+        SD_BUS_PROPERTY(name, "b", NULL, offsetof(Object, boolean), SD_BUS_VTABLE_PROPERTY_CONST)
+#define USEC(name, field) \
+        SD_BUS_PROPERTY(name, "t", NULL, offsetof(Object, field), SD_BUS_VTABLE_PROPERTY_CONST)
+#define DUAL_TIMESTAMP(name) \
+        USEC(name, timestamp), \
+        USEC(name "Monotonic", timestamp)
+
+static const sd_bus_vtable vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        STRING("Id", id),
+        STRV("Names", names),
+        STRING("Following", unset),
+        STRV("Requires", dependencies),
+        STRV("Requisite", empty),
+        STRV("Wants", dependencies),
+        STRV("BindsTo", empty),
+        STRV("PartOf", empty),
+        STRV("Upholds", empty),
+        STRV("RequiredBy", empty),
+        STRV("RequisiteOf", empty),
+        STRV("WantedBy", dependencies),
+        STRV("BoundBy", empty),
+        STRV("UpheldBy", empty),
+        STRV("ConsistsOf", empty),
+        STRV("Conflicts", dependencies),
+        STRV("ConflictedBy", empty),
+        STRV("Before", dependencies),
+        STRV("After", dependencies),
+        STRV("OnSuccess", empty),
+        STRV("OnSuccessOf", empty),
+        STRV("OnFailure", empty),
+        STRV("OnFailureOf", empty),
+        STRV("Triggers", empty),
+        STRV("TriggeredBy", empty),
+        STRV("PropagatesReloadTo", empty),
+        STRV("ReloadPropagatedFrom", empty),
+        STRV("PropagatesStopTo", empty),
+        STRV("StopPropagatedFrom", empty),
+        STRV("JoinsNamespaceOf", empty),
+        STRV("SliceOf", empty),
+        STRV("RequiresMountsFor", empty),
+        STRV("Documentation", names),
+        STRING("Description", description),
+        STRING("AccessSELinuxContext", unset),
+        STRING("LoadState", state),
+        STRING("ActiveState", state),
+        STRING("FreezerState", state),
+        STRING("SubState", state),
+        STRING("FragmentPath", path),
+        STRING("SourcePath", unset),
+        STRV("DropInPaths", empty),
+        STRING("UnitFileState", state),
+        STRING("UnitFilePreset", state),
+        DUAL_TIMESTAMP("StateChangeTimestamp"),
+        DUAL_TIMESTAMP("InactiveExitTimestamp"),
+        DUAL_TIMESTAMP("ActiveEnterTimestamp"),
+        DUAL_TIMESTAMP("ActiveExitTimestamp"),
+        DUAL_TIMESTAMP("InactiveEnterTimestamp"),
+        BOOLEAN("CanStart"),
+        BOOLEAN("CanStop"),
+        BOOLEAN("CanReload"),
+        BOOLEAN("CanIsolate"),
+        STRV("CanClean", empty),
+        BOOLEAN("CanFreeze"),
+        SD_BUS_PROPERTY("Job", "(uo)", property_get_job, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        BOOLEAN("StopWhenUnneeded"),
+        BOOLEAN("RefuseManualStart"),
+        BOOLEAN("RefuseManualStop"),
+        BOOLEAN("AllowIsolate"),
+        BOOLEAN("DefaultDependencies"),
+        BOOLEAN("SurviveFinalKillSignal"),
+        STRING("OnSuccessJobMode", state),
+        STRING("OnFailureJobMode", state),
+        BOOLEAN("IgnoreOnIsolate"),
+        BOOLEAN("NeedDaemonReload"),
+        STRV("Markers", empty),
+        USEC("JobTimeoutUSec", timeout),
+        USEC("JobRunningTimeoutUSec", timeout),
+        STRING("JobTimeoutAction", state),
+        STRING("JobTimeoutRebootArgument", unset),
+        BOOLEAN("ConditionResult"),
+        BOOLEAN("AssertResult"),
+        DUAL_TIMESTAMP("ConditionTimestamp"),
+        DUAL_TIMESTAMP("AssertTimestamp"),
+        SD_BUS_PROPERTY("Conditions", "a(sbbsi)", property_get_conditions, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Asserts", "a(sbbsi)", property_get_conditions, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("LoadError", "(ss)", property_get_load_error, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        BOOLEAN("Transient"),
+        BOOLEAN("Perpetual"),
+        USEC("StartLimitIntervalUSec", timeout),
+        SD_BUS_PROPERTY("StartLimitBurst", "u", NULL, offsetof(Object, burst), SD_BUS_VTABLE_PROPERTY_CONST),
+        STRING("StartLimitAction", state),
+        STRING("FailureAction", state),
+        SD_BUS_PROPERTY("FailureActionExitStatus", "i", NULL, offsetof(Object, exit_status), SD_BUS_VTABLE_PROPERTY_CONST),
+        STRING("SuccessAction", state),
+        SD_BUS_PROPERTY("SuccessActionExitStatus", "i", NULL, offsetof(Object, exit_status), SD_BUS_VTABLE_PROPERTY_CONST),
+        STRING("RebootArgument", unset),
+        SD_BUS_PROPERTY("InvocationID", "ay", property_get_invocation_id, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        STRING("CollectMode", state),
+        STRV("Refs", empty),
+        SD_BUS_PROPERTY("ActivationDetails", "a(ss)", property_get_activation_details, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_VTABLE_END
+};
+
+static size_t vtable_n_properties(void) {
+        size_t n = 0;
+
+        for (const sd_bus_vtable *v = vtable; v->type != _SD_BUS_VTABLE_END; v++)
+                if (v->type == _SD_BUS_VTABLE_PROPERTY)
+                        n++;
+
+        return n;
+}
+
+static int object_find(sd_bus *bus, const char *path, const char *interface, void *userdata, void **found, sd_bus_error *error) {
+        Context *c = ASSERT_PTR(userdata);
+        const char *e;
+        unsigned i;
+
+        e = path_startswith(path, PREFIX);
+        if (!e || safe_atou(e, &i) < 0 || i >= arg_n_objects)
+                return 0;
+
+        *found = c->objects + i;
+        return 1;
+}
+
+static void *server(void *p) {
+        Context *c = ASSERT_PTR(p);
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        sd_id128_t id;
+        int r;
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, c->fds[0], c->fds[0]) >= 0);
+        assert_se(sd_bus_set_server(bus, true, id) >= 0);
+        assert_se(sd_bus_add_fallback_vtable(bus, NULL, PREFIX, INTERFACE, vtable, object_find, c) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        for (;;) {
+                r = sd_bus_process(bus, NULL);
+                if (ERRNO_IS_NEG_DISCONNECT(r))
+                        break;
+                assert_se(r >= 0);
+
+                if (r == 0)
+                        assert_se(sd_bus_wait(bus, USEC_INFINITY) >= 0);
+        }
+
+        return NULL;
+}
+
+static size_t get_all(sd_bus *bus, const char *path) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        size_t n = 0;
+        int r;
+
+        r = sd_bus_call_method(bus, NULL, path, "org.freedesktop.DBus.Properties", "GetAll", &error, &reply, "s", "");
+        if (r < 0)
+                log_error_errno(r, "GetAll() on %s failed: %s", path, bus_error_message(&error, r));
+        assert_se(r >= 0);
+
+        /* Walk the reply the way a client that shows the properties has to */
+        assert_se(sd_bus_message_enter_container(reply, 'a', "{sv}") > 0);
+        while ((r = sd_bus_message_enter_container(reply, 'e', "sv")) > 0) {
+                const char *name;
+
+                assert_se(sd_bus_message_read_basic(reply, 's', &name) > 0);
+                assert_se(sd_bus_message_skip(reply, "v") >= 0);
+                assert_se(sd_bus_message_exit_container(reply) >= 0);
+                n++;
+        }
+        assert_se(r == 0);
+        assert_se(sd_bus_message_exit_container(reply) >= 0);
+
+        return n;
+}
+
+static void client(Context *c) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        size_t n_properties = vtable_n_properties();
+        usec_t best = USEC_INFINITY;
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, c->fds[1], c->fds[1]) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        for (unsigned round = 0; round < arg_n_rounds; round++) {
+                usec_t t;
+
+                t = now(CLOCK_MONOTONIC);
+                for (unsigned i = 0; i < arg_n_objects; i++) {
+                        char path[STRLEN(PREFIX "/") + DECIMAL_STR_MAX(unsigned)];
+
+                        xsprintf(path, PREFIX "/%u", i);
+                        assert_se(get_all(bus, path) == n_properties);
+                }
+                t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+                log_info("Round %u: GetAll() on %u objects with %zu properties each took %s, %.1fµs per call",
+                         round, arg_n_objects, n_properties,
+                         FORMAT_TIMESPAN(t, USEC_PER_MSEC), (double) t / arg_n_objects);
+
+                best = MIN(best, t);
+        }
+
+        log_info("Best round: %.1fµs per GetAll() call", (double) best / arg_n_objects);
+}
+
+int main(int argc, char *argv[]) {
+        Context c = {};
+        pthread_t s;
+
+        test_setup_logging(LOG_INFO);
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &arg_n_objects) >= 0 && arg_n_objects > 0);
+        if (argc >= 3)
+                assert_se(safe_atou(argv[2], &arg_n_rounds) >= 0 && arg_n_rounds > 0);
+        else if (slow_tests_enabled())
+                arg_n_rounds = 20;
+
+        assert_se(c.objects = new0(Object, arg_n_objects));
+        for (unsigned i = 0; i < arg_n_objects; i++) {
+                Object *o = c.objects + i;
+
+                assert_se(asprintf(&o->id, "benchmark-%u.service", i) >= 0);
+                assert_se(asprintf(&o->description, "Benchmark Service %u", i) >= 0);
+                assert_se(o->path = path_join("/usr/lib/systemd/system", o->id));
+                assert_se(o->state = strdup("active"));
+                assert_se(o->names = strv_new(o->id));
+                assert_se(o->dependencies = strv_new("system.slice", "sysinit.target", "basic.target"));
+                o->timestamp = 1700000000 * USEC_PER_SEC + i;
+                o->timeout = 90 * USEC_PER_SEC;
+                o->burst = 5;
+                o->boolean = i % 2;
+        }
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, c.fds) >= 0);
+
+        assert_se(pthread_create(&s, NULL, server, &c) == 0);
+        client(&c);
+        assert_se(pthread_join(s, NULL) == 0);
+
+        for (unsigned i = 0; i < arg_n_objects; i++) {
+                Object *o = c.objects + i;
+
+                free(o->id);
+                free(o->description);
+                free(o->path);
+                free(o->state);
+                strv_free(o->names);
+                strv_free(o->dependencies);
+        }
+        free(c.objects);
+
+        return EXIT_SUCCESS;
+}
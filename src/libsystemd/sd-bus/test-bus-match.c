@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include "alloc-util.h"
 #include "bus-match.h"
 #include "bus-message.h"
 #include "bus-slot.h"
@@ -7,6 +8,7 @@
 #include "macro.h"
 #include "memory-util.h"
 #include "tests.h"
+#include "time-util.h"
 
 static bool mask[32];
 
@@ -66,6 +68,66 @@ static void test_match_scope(const char *match, enum bus_match_scope scope) {
         assert_se(bus_match_get_scope(components, n_components) == scope);
 }
 
+static unsigned n_hits = 0;
+
+static int filter_count(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        n_hits++;
+        return 0;
+}
+
+static void test_match_benchmark(sd_bus *bus) {
+        struct bus_match_node root = {
+                .type = BUS_MATCH_ROOT,
+        };
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_free_ sd_bus_slot *slots = NULL;
+        unsigned n_matches = slow_tests_enabled() ? 10000 : 1000,
+                n_iterations = slow_tests_enabled() ? 100000 : 1000;
+        usec_t t;
+
+        /* Mimics a PID1-like client subscribed to PropertiesChanged of many units */
+
+        slots = new0(sd_bus_slot, n_matches);
+        assert_se(slots);
+
+        for (unsigned i = 0; i < n_matches; i++) {
+                struct bus_match_component *components = NULL;
+                size_t n_components = 0;
+                _cleanup_free_ char *match = NULL;
+
+                CLEANUP_ARRAY(components, n_components, bus_match_parse_free);
+
+                assert_se(asprintf(&match,
+                                   "type='signal',"
+                                   "interface='org.freedesktop.DBus.Properties',"
+                                   "member='PropertiesChanged',"
+                                   "path_namespace='/org/freedesktop/systemd1/unit/u%u',"
+                                   "arg0namespace='org.freedesktop.systemd1'", i) >= 0);
+                assert_se(bus_match_parse(match, &components, &n_components) >= 0);
+
+                slots[i].match_callback.callback = filter_count;
+                assert_se(bus_match_add(&root, components, n_components, &slots[i].match_callback) >= 0);
+        }
+
+        assert_se(sd_bus_message_new_signal(bus, &m, "/org/freedesktop/systemd1/unit/u42",
+                                            "org.freedesktop.DBus.Properties", "PropertiesChanged") >= 0);
+        assert_se(sd_bus_message_append(m, "s", "org.freedesktop.systemd1.Unit") >= 0);
+        assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+
+        n_hits = 0;
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++)
+                assert_se(bus_match_run(NULL, &root, m) == 0);
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        assert_se(n_hits == n_iterations);
+        log_info("%u matches, %u messages: %s, %.1f ns/message",
+                 n_matches, n_iterations, FORMAT_TIMESPAN(t, 1), (double) t * NSEC_PER_USEC / n_iterations);
+
+        bus_match_free(&root);
+}
+
 int main(int argc, char *argv[]) {
         struct bus_match_node root = {
                 .type = BUS_MATCH_ROOT,
@@ -73,7 +135,7 @@ int main(int argc, char *argv[]) {
 
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
-        sd_bus_slot slots[19] = {};
+        sd_bus_slot slots[24] = {};
         int r;
 
         test_setup_logging(LOG_INFO);
@@ -102,6 +164,11 @@ int main(int argc, char *argv[]) {
         assert_se(match_add(slots, &root, "arg4has='pa'", 16) >= 0);
         assert_se(match_add(slots, &root, "arg4has='po'", 17) >= 0);
         assert_se(match_add(slots, &root, "arg4='pi'", 18) >= 0);
+        assert_se(match_add(slots, &root, "path_namespace='/'", 19) >= 0);
+        assert_se(match_add(slots, &root, "path_namespace='/foo/bar'", 20) >= 0);
+        assert_se(match_add(slots, &root, "path_namespace='/fo'", 21) >= 0);
+        assert_se(match_add(slots, &root, "arg3namespace='prefix.four'", 22) >= 0);
+        assert_se(match_add(slots, &root, "arg3namespace='prefix.fo'", 23) >= 0);
 
         bus_match_dump(stdout, &root, 0);
 
@@ -111,7 +178,7 @@ int main(int argc, char *argv[]) {
 
         zero(mask);
         assert_se(bus_match_run(NULL, &root, m) == 0);
-        assert_se(mask_contains((unsigned[]) { 9, 8, 7, 5, 10, 12, 13, 14, 15, 16, 17 }, 11));
+        assert_se(mask_contains((unsigned[]) { 9, 8, 7, 5, 10, 12, 13, 14, 15, 16, 17, 19, 20, 22 }, 14));
 
         assert_se(bus_match_remove(&root, &slots[8].match_callback) >= 0);
         assert_se(bus_match_remove(&root, &slots[13].match_callback) >= 0);
@@ -120,7 +187,7 @@ int main(int argc, char *argv[]) {
 
         zero(mask);
         assert_se(bus_match_run(NULL, &root, m) == 0);
-        assert_se(mask_contains((unsigned[]) { 9, 5, 10, 12, 14, 7, 15, 16, 17 }, 9));
+        assert_se(mask_contains((unsigned[]) { 9, 5, 10, 12, 14, 7, 15, 16, 17, 19, 20, 22 }, 12));
 
         for (enum bus_match_node_type i = 0; i < _BUS_MATCH_NODE_TYPE_MAX; i++) {
                 char buf[32];
@@ -141,5 +208,7 @@ int main(int argc, char *argv[]) {
         test_match_scope("member='gurke',path='/org/freedesktop/DBus/Local'", BUS_MATCH_LOCAL);
         test_match_scope("arg2='piep',sender='org.freedesktop.DBus',member='waldo'", BUS_MATCH_DRIVER);
 
+        test_match_benchmark(bus);
+
         return 0;
 }
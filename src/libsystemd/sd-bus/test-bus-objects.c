@@ -20,6 +20,9 @@ struct context {
         char *something;
         char *automatic_string_property;
         uint32_t automatic_integer_property;
+        char *complex_names[2];
+        uint32_t complex_numbers[2];
+        char *complex_values[2];
 };
 
 static int something_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
@@ -182,6 +185,48 @@ static int emit_object_removed(sd_bus_message *m, void *userdata, sd_bus_error *
         return 1;
 }
 
+static int complex_get_handler(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        struct context *c = userdata;
+
+        /* Appends the whole property signature in one go, which is run from the compiled signature */
+        assert_se(sd_bus_message_append(reply, "a(sua{ss})", 2,
+                                        c->complex_names[0], c->complex_numbers[0], 1, "value", c->complex_values[0],
+                                        c->complex_names[1], c->complex_numbers[1], 0) >= 0);
+
+        return 1;
+}
+
+static int complex_set_handler(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *value, void *userdata, sd_bus_error *error) {
+        struct context *c = userdata;
+        size_t i = 0;
+        int r;
+
+        /* Reads the array element by element, which is run from the array element's compiled signature */
+        assert_se(sd_bus_message_enter_container(value, 'a', "(sua{ss})") > 0);
+
+        for (;;) {
+                const char *name, *key, *v;
+                uint32_t n;
+
+                r = sd_bus_message_read(value, "(sua{ss})", &name, &n, 1, &key, &v);
+                assert_se(r >= 0);
+                if (r == 0)
+                        break;
+
+                assert_se(i < ELEMENTSOF(c->complex_names));
+                assert_se(streq(key, "value"));
+                assert_se(free_and_strdup(&c->complex_names[i], name) >= 0);
+                assert_se(free_and_strdup(&c->complex_values[i], v) >= 0);
+                c->complex_numbers[i] = n;
+                i++;
+        }
+
+        assert_se(i == ELEMENTSOF(c->complex_names));
+        assert_se(sd_bus_message_exit_container(value) > 0);
+
+        return 1;
+}
+
 static const sd_bus_vtable vtable[] = {
         SD_BUS_VTABLE_START(0),
         SD_BUS_METHOD("AlterSomething", "s", "s", something_handler, 0),
@@ -189,6 +234,7 @@ static const sd_bus_vtable vtable[] = {
         SD_BUS_WRITABLE_PROPERTY("Something", "s", get_handler, set_handler, 0, 0),
         SD_BUS_WRITABLE_PROPERTY("AutomaticStringProperty", "s", NULL, NULL, offsetof(struct context, automatic_string_property), 0),
         SD_BUS_WRITABLE_PROPERTY("AutomaticIntegerProperty", "u", NULL, NULL, offsetof(struct context, automatic_integer_property), 0),
+        SD_BUS_WRITABLE_PROPERTY("Complex", "a(sua{ss})", complex_get_handler, complex_set_handler, 0, 0),
         SD_BUS_METHOD("NoOperation", NULL, NULL, NULL, 0),
         SD_BUS_METHOD("EmitInterfacesAdded", NULL, NULL, emit_interfaces_added, 0),
         SD_BUS_METHOD("EmitInterfacesRemoved", NULL, NULL, emit_interfaces_removed, 0),
@@ -370,6 +416,34 @@ static int client(struct context *c) {
 
         assert_se(streq(c->automatic_string_property, "Du Dödel, Du!"));
 
+        r = sd_bus_set_property(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "Complex", &error, "a(sua{ss})", 2,
+                                "first", 1, 1, "value", "one",
+                                "second", 2, 1, "value", "two");
+        assert_se(r >= 0);
+
+        assert_se(streq(c->complex_names[0], "first"));
+        assert_se(streq(c->complex_values[1], "two"));
+        assert_se(c->complex_numbers[1] == 2);
+
+        r = sd_bus_get_property(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "Complex", &error, &reply, "a(sua{ss})");
+        assert_se(r >= 0);
+
+        {
+                const char *n1, *n2, *k1, *v1;
+                uint32_t u1, u2;
+
+                r = sd_bus_message_read(reply, "a(sua{ss})", 2, &n1, &u1, 1, &k1, &v1, &n2, &u2, 0);
+                assert_se(r > 0);
+                assert_se(streq(n1, "first"));
+                assert_se(u1 == 1);
+                assert_se(streq(k1, "value"));
+                assert_se(streq(v1, "one"));
+                assert_se(streq(n2, "second"));
+                assert_se(u2 == 2);
+        }
+
+        reply = sd_bus_message_unref(reply);
+
         r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.DBus.Introspectable", "Introspect", &error, &reply, "");
         assert_se(r >= 0);
 
@@ -672,6 +746,8 @@ int main(int argc, char *argv[]) {
 
         free(c.something);
         free(c.automatic_string_property);
+        free_many_charp(c.complex_names, ELEMENTSOF(c.complex_names));
+        free_many_charp(c.complex_values, ELEMENTSOF(c.complex_values));
 
         return EXIT_SUCCESS;
 }
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+#include "sd-event.h"
+
+#include "fd-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+#define N_SIGNALS 64U
+
+static int on_signal(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        unsigned *n = ASSERT_PTR(userdata);
+        uint32_t i;
+
+        if (!sd_bus_message_is_signal(m, "foo.Bar", "Waldo"))
+                return 0;
+
+        assert_se(sd_bus_message_read(m, "u", &i) >= 0);
+        assert_se(i == *n);
+        (*n)++;
+
+        return 1;
+}
+
+TEST(read_batch) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *a = NULL, *b = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR;
+        sd_id128_t id;
+        unsigned n = 0;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_id128_randomize(&id) >= 0);
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+
+        assert_se(sd_bus_new(&a) >= 0);
+        assert_se(sd_bus_set_fd(a, pair[0], pair[0]) >= 0);
+        TAKE_FD(pair[0]);
+        assert_se(sd_bus_set_server(a, true, id) >= 0);
+        assert_se(sd_bus_add_filter(a, NULL, on_signal, &n) >= 0);
+        assert_se(sd_bus_attach_event(a, e, SD_EVENT_PRIORITY_NORMAL) >= 0);
+        assert_se(sd_bus_start(a) >= 0);
+
+        assert_se(sd_bus_new(&b) >= 0);
+        assert_se(sd_bus_set_fd(b, pair[1], pair[1]) >= 0);
+        TAKE_FD(pair[1]);
+        assert_se(sd_bus_attach_event(b, e, SD_EVENT_PRIORITY_NORMAL) >= 0);
+        assert_se(sd_bus_start(b) >= 0);
+
+        while (sd_bus_is_ready(a) <= 0 || sd_bus_is_ready(b) <= 0)
+                assert_se(sd_event_run(e, 5 * USEC_PER_SEC) > 0);
+
+        /* Put a number of small messages on the socket before the other side reads anything, so that all of
+         * them are read in one go, and make sure the sender causes no further socket activity afterwards. */
+        for (uint32_t i = 0; i < N_SIGNALS; i++)
+                assert_se(sd_bus_emit_signal(b, "/foo", "foo.Bar", "Waldo", "u", i) >= 0);
+        assert_se(sd_bus_flush(b) >= 0);
+        assert_se(sd_bus_detach_event(b) >= 0);
+
+        /* All of them need to be dispatched without waiting for the socket to become readable again */
+        while (n < N_SIGNALS)
+                assert_se(sd_event_run(e, 5 * USEC_PER_SEC) > 0);
+
+        assert_se(n == N_SIGNALS);
+}
+
+DEFINE_TEST_MAIN(LOG_DEBUG);
@@ -1,17 +1,24 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdlib.h>
 
 #include "sd-bus.h"
 
 #include "bus-internal.h"
+#include "bus-kernel.h"
+#include "bus-message.h"
+#include "fd-util.h"
 #include "log.h"
 #include "macro.h"
 #include "memory-util.h"
 #include "string-util.h"
 #include "tests.h"
 
+/* Large enough to be passed as memfd, if negotiated */
+#define ECHO_SIZE (MEMFD_MIN_SIZE + 4711)
+
 struct context {
         int fds[2];
 
@@ -20,8 +27,52 @@ struct context {
 
         bool client_anonymous_auth;
         bool server_anonymous_auth;
+
+        bool client_negotiate_memfd_body;
+        bool server_negotiate_memfd_body;
 };
 
+static bool context_memfd_body(const struct context *c) {
+        return c->client_negotiate_unix_fds && c->server_negotiate_unix_fds &&
+                c->client_negotiate_memfd_body && c->server_negotiate_memfd_body;
+}
+
+static void check_echo_payload(sd_bus_message *m, const struct context *c) {
+        const uint8_t *p;
+        size_t sz;
+
+        /* Whether the body was passed as memfd must be invisible to the reader */
+        assert_se((m->body.memfd >= 0) == context_memfd_body(c));
+
+        assert_se(sd_bus_message_read_array(m, 'y', (const void**) &p, &sz) > 0);
+        assert_se(sz == ECHO_SIZE);
+        for (size_t i = 0; i < sz; i++)
+                assert_se(p[i] == (uint8_t) i);
+}
+
+static void check_echo_reparse(sd_bus *bus, sd_bus_message *m) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *copy = NULL;
+        _cleanup_free_ int *fds = NULL;
+        size_t sz;
+        void *blob;
+
+        /* A message that got its body as memfd must look as if it got it inline, so that it can be
+         * forwarded to connections that don't pass bodies as memfd. */
+        assert_se(bus_message_get_blob(m, &blob, &sz) >= 0);
+        assert_se(sz == BUS_MESSAGE_SIZE(m));
+
+        assert_se(fds = new(int, m->n_fds));
+        for (size_t i = 0; i < m->n_fds; i++)
+                assert_se((fds[i] = fcntl(m->fds[i], F_DUPFD_CLOEXEC, 3)) >= 0);
+
+        assert_se(bus_message_from_malloc(bus, blob, sz, fds, m->n_fds, NULL, &copy) >= 0);
+        TAKE_PTR(fds);
+
+        assert_se(copy->body.memfd < 0);
+        assert_se(copy->n_fds == m->n_fds);
+        assert_se(streq(sd_bus_message_get_signature(copy, true), "ayhs"));
+}
+
 static int _server(struct context *c) {
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         sd_id128_t id;
@@ -35,6 +86,7 @@ static int _server(struct context *c) {
         assert_se(sd_bus_set_server(bus, 1, id) >= 0);
         assert_se(sd_bus_set_anonymous(bus, c->server_anonymous_auth) >= 0);
         assert_se(sd_bus_negotiate_fds(bus, c->server_negotiate_unix_fds) >= 0);
+        bus->accept_memfd_body = c->server_negotiate_memfd_body;
         assert_se(sd_bus_start(bus) >= 0);
 
         while (!quit) {
@@ -60,6 +112,7 @@ static int _server(struct context *c) {
 
                         assert_se((sd_bus_can_send(bus, 'h') >= 1) ==
                                   (c->server_negotiate_unix_fds && c->client_negotiate_unix_fds));
+                        assert_se(bus->can_memfd_body == context_memfd_body(c));
 
                         r = sd_bus_message_new_method_return(m, &reply);
                         if (r < 0)
@@ -67,6 +120,32 @@ static int _server(struct context *c) {
 
                         quit = true;
 
+                } else if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Echo")) {
+                        const void *p;
+                        const char *s;
+                        size_t sz;
+                        int fd;
+
+                        check_echo_reparse(bus, m);
+                        check_echo_payload(m, c);
+
+                        /* The fds passed along with the body are not affected */
+                        assert_se(sd_bus_message_read(m, "hs", &fd, &s) > 0);
+                        assert_se(fcntl(fd, F_GETFD) >= 0);
+                        assert_se(streq(s, "waldo"));
+                        assert_se(m->n_fds == 1);
+
+                        assert_se(sd_bus_message_rewind(m, true) >= 0);
+                        assert_se(sd_bus_message_read_array(m, 'y', &p, &sz) > 0);
+
+                        r = sd_bus_message_new_method_return(m, &reply);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to allocate return: %m");
+
+                        r = sd_bus_message_append_array(reply, 'y', p, sz);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to append reply: %m");
+
                 } else if (sd_bus_message_is_method_call(m, NULL, NULL)) {
                         r = sd_bus_message_new_method_error(
                                         m,
@@ -100,8 +179,40 @@ static int client(struct context *c) {
         assert_se(sd_bus_set_fd(bus, c->fds[1], c->fds[1]) >= 0);
         assert_se(sd_bus_negotiate_fds(bus, c->client_negotiate_unix_fds) >= 0);
         assert_se(sd_bus_set_anonymous(bus, c->client_anonymous_auth) >= 0);
+        bus->accept_memfd_body = c->client_negotiate_memfd_body;
         assert_se(sd_bus_start(bus) >= 0);
 
+        if (sd_bus_can_send(bus, 'h') > 0) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *echo = NULL, *echo_reply = NULL;
+                _cleanup_free_ uint8_t *payload = NULL;
+
+                assert_se(bus->can_memfd_body == context_memfd_body(c));
+
+                assert_se(payload = new(uint8_t, ECHO_SIZE));
+                for (size_t i = 0; i < ECHO_SIZE; i++)
+                        payload[i] = (uint8_t) i;
+
+                r = sd_bus_message_new_method_call(
+                                bus,
+                                &echo,
+                                "org.freedesktop.systemd.test",
+                                "/",
+                                "org.freedesktop.systemd.test",
+                                "Echo");
+                if (r < 0)
+                        return log_error_errno(r, "Failed to allocate method call: %m");
+
+                assert_se(sd_bus_message_append_array(echo, 'y', payload, ECHO_SIZE) >= 0);
+                assert_se(sd_bus_message_append(echo, "hs", STDERR_FILENO, "waldo") >= 0);
+
+                r = sd_bus_call(bus, echo, 0, &error, &echo_reply);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to issue method call: %s", bus_error_message(&error, r));
+
+                check_echo_payload(echo_reply, c);
+        } else
+                assert_se(!bus->can_memfd_body);
+
         r = sd_bus_message_new_method_call(
                         bus,
                         &m,
@@ -120,7 +231,8 @@ static int client(struct context *c) {
 }
 
 static int test_one(bool client_negotiate_unix_fds, bool server_negotiate_unix_fds,
-                    bool client_anonymous_auth, bool server_anonymous_auth) {
+                    bool client_anonymous_auth, bool server_anonymous_auth,
+                    bool client_negotiate_memfd_body, bool server_negotiate_memfd_body) {
 
         struct context c;
         pthread_t s;
@@ -135,6 +247,8 @@ static int test_one(bool client_negotiate_unix_fds, bool server_negotiate_unix_f
         c.server_negotiate_unix_fds = server_negotiate_unix_fds;
         c.client_anonymous_auth = client_anonymous_auth;
         c.server_anonymous_auth = server_anonymous_auth;
+        c.client_negotiate_memfd_body = client_negotiate_memfd_body;
+        c.server_negotiate_memfd_body = server_negotiate_memfd_body;
 
         r = pthread_create(&s, NULL, server, &c);
         if (r != 0)
@@ -160,26 +274,36 @@ int main(int argc, char *argv[]) {
 
         test_setup_logging(LOG_DEBUG);
 
-        r = test_one(true, true, false, false);
+        r = test_one(true, true, false, false, true, true);
         assert_se(r >= 0);
 
-        r = test_one(true, false, false, false);
+        r = test_one(true, false, false, false, true, true);
         assert_se(r >= 0);
 
-        r = test_one(false, true, false, false);
+        r = test_one(false, true, false, false, true, true);
         assert_se(r >= 0);
 
-        r = test_one(false, false, false, false);
+        r = test_one(false, false, false, false, true, true);
         assert_se(r >= 0);
 
-        r = test_one(true, true, true, true);
+        r = test_one(true, true, true, true, true, true);
         assert_se(r >= 0);
 
-        r = test_one(true, true, false, true);
+        r = test_one(true, true, false, true, true, true);
         assert_se(r >= 0);
 
-        r = test_one(true, true, true, false);
+        r = test_one(true, true, true, false, true, true);
         assert_se(r == -EPERM);
 
+        /* Large bodies are sent inline if either side doesn't want them as memfd */
+        r = test_one(true, true, false, false, true, false);
+        assert_se(r >= 0);
+
+        r = test_one(true, true, false, false, false, true);
+        assert_se(r >= 0);
+
+        r = test_one(true, true, true, true, false, false);
+        assert_se(r >= 0);
+
         return EXIT_SUCCESS;
 }
@@ -6,6 +6,59 @@
 #include "string-util.h"
 #include "tests.h"
 
+static void test_signature_compile(void) {
+        _cleanup_(bus_signature_program_freep) BusSignatureProgram *p = NULL;
+        size_t begin, end;
+
+        assert_se(bus_signature_compile("a(sua{ss})", &p) >= 0);
+        assert_se(streq(p->signature, "a(sua{ss})"));
+        assert_se(!p->has_variant);
+        assert_se(p->n_ops == 8);
+
+        assert_se(p->ops[0].type == SD_BUS_TYPE_ARRAY && p->ops[0].end == 8 && streq(p->ops[0].contents, "(sua{ss})"));
+        assert_se(p->ops[1].type == SD_BUS_TYPE_STRUCT && p->ops[1].end == 8 && streq(p->ops[1].contents, "sua{ss}"));
+        assert_se(p->ops[2].type == SD_BUS_TYPE_STRING && p->ops[2].end == 3 && !p->ops[2].contents);
+        assert_se(p->ops[3].type == SD_BUS_TYPE_UINT32 && p->ops[3].end == 4);
+        assert_se(p->ops[4].type == SD_BUS_TYPE_ARRAY && p->ops[4].end == 8 && streq(p->ops[4].contents, "{ss}"));
+        assert_se(p->ops[5].type == SD_BUS_TYPE_DICT_ENTRY && p->ops[5].end == 8 && streq(p->ops[5].contents, "ss"));
+        assert_se(p->ops[6].type == SD_BUS_TYPE_STRING && p->ops[6].end == 7);
+        assert_se(p->ops[7].type == SD_BUS_TYPE_STRING && p->ops[7].end == 8);
+
+        assert_se(bus_signature_program_match(p, "a(sua{ss})", &begin, &end));
+        assert_se(begin == 0 && end == 8);
+        assert_se(bus_signature_program_match(p, "(sua{ss})", &begin, &end));
+        assert_se(begin == 1 && end == 8);
+        assert_se(!bus_signature_program_match(p, "sua{ss}", &begin, &end));
+        assert_se(!bus_signature_program_match(p, "a{ss}", &begin, &end));
+
+        assert_se(bus_signature_program_find_contents(p, SD_BUS_TYPE_ARRAY, "{ss}") == p->ops[4].contents);
+        assert_se(bus_signature_program_find_contents(p, SD_BUS_TYPE_DICT_ENTRY, "ss") == p->ops[5].contents);
+        assert_se(!bus_signature_program_find_contents(p, SD_BUS_TYPE_STRUCT, "ss"));
+        assert_se(!bus_signature_program_find_contents(p, SD_BUS_TYPE_ARRAY, "s"));
+
+        p = bus_signature_program_free(p);
+
+        assert_se(bus_signature_compile("a{sv}", &p) >= 0);
+        assert_se(p->has_variant);
+        assert_se(p->n_ops == 4);
+        assert_se(p->ops[3].type == SD_BUS_TYPE_VARIANT && !p->ops[3].contents);
+        p = bus_signature_program_free(p);
+
+        assert_se(bus_signature_compile("sb", &p) >= 0);
+        assert_se(p->n_ops == 2);
+        assert_se(!bus_signature_program_match(p, "s", &begin, &end));
+        p = bus_signature_program_free(p);
+
+        assert_se(bus_signature_compile("", &p) >= 0);
+        assert_se(p->n_ops == 0);
+        assert_se(!bus_signature_program_find_contents(p, SD_BUS_TYPE_ARRAY, "s"));
+        p = bus_signature_program_free(p);
+
+        assert_se(bus_signature_compile("{ss}", &p) == -EINVAL);
+        assert_se(bus_signature_compile("a", &p) == -EINVAL);
+        assert_se(bus_signature_compile("(", &p) == -EINVAL);
+}
+
 int main(int argc, char *argv[]) {
         char prefix[256];
         int r;
@@ -146,5 +199,7 @@ int main(int argc, char *argv[]) {
         }
         assert_se(r == 3);
 
+        test_signature_compile();
+
         return 0;
 }
@@ -22,6 +22,7 @@
 #include "macro.h"
 #include "mallinfo-util.h"
 #include "memory-util.h"
+#include "mempool.h"
 #include "missing_magic.h"
 #include "missing_syscall.h"
 #include "missing_threads.h"
@@ -1887,7 +1888,7 @@ _public_ int sd_event_trim_memory(void) {
 #endif
 
         usec_t before_timestamp = now(CLOCK_MONOTONIC);
-        hashmap_trim_pools();
+        mempool_trim_all();
         r = malloc_trim(0);
         usec_t after_timestamp = now(CLOCK_MONOTONIC);
 
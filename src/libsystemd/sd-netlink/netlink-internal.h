@@ -124,6 +124,7 @@ struct sd_netlink_message {
         unsigned n_containers; /* number of containers */
         uint32_t multicast_group;
         bool sealed:1;
+        bool from_pool:1;
 
         sd_netlink_message *next; /* next in a chain of multi-part messages */
 };
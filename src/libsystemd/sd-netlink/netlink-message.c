@@ -9,6 +9,7 @@
 #include "alloc-util.h"
 #include "format-util.h"
 #include "memory-util.h"
+#include "mempool.h"
 #include "netlink-internal.h"
 #include "netlink-types.h"
 #include "netlink-util.h"
@@ -20,8 +21,11 @@
 #define RTA_TYPE(rta) ((rta)->rta_type & NLA_TYPE_MASK)
 #define RTA_FLAGS(rta) ((rta)->rta_type & ~NLA_TYPE_MASK)
 
+DEFINE_MEMPOOL(netlink_message_pool, sd_netlink_message, 64);
+
 int message_new_empty(sd_netlink *nl, sd_netlink_message **ret) {
         sd_netlink_message *m;
+        bool from_pool;
 
         assert(nl);
         assert(ret);
@@ -29,7 +33,7 @@ int message_new_empty(sd_netlink *nl, sd_netlink_message **ret) {
         /* Note that 'nl' is currently unused, if we start using it internally we must take care to
          * avoid problems due to mutual references between buses and their queued messages. See sd-bus. */
 
-        m = new(sd_netlink_message, 1);
+        m = mempool_alloc0_tile_or_heap(&netlink_message_pool, sizeof(sd_netlink_message), &from_pool);
         if (!m)
                 return -ENOMEM;
 
@@ -37,6 +41,7 @@ int message_new_empty(sd_netlink *nl, sd_netlink_message **ret) {
                 .n_ref = 1,
                 .protocol = nl->protocol,
                 .sealed = false,
+                .from_pool = from_pool,
         };
 
         *ret = m;
@@ -140,7 +145,7 @@ sd_netlink_message* sd_netlink_message_unref(sd_netlink_message *m) {
 
                 sd_netlink_message *t = m;
                 m = m->next;
-                free(t);
+                mempool_free_tile_or_heap(&netlink_message_pool, t, t->from_pool);
         }
 
         return NULL;
@@ -8,6 +8,7 @@
 #include "escape.h"
 #include "hexdecoct.h"
 #include "memory-util.h"
+#include "mempool.h"
 #include "resolved-dns-dnssec.h"
 #include "resolved-dns-packet.h"
 #include "resolved-dns-rr.h"
@@ -368,10 +369,14 @@ bool dns_resource_key_reduce(DnsResourceKey **a, DnsResourceKey **b) {
         return true;
 }
 
+/* Records are created and dropped in large numbers while parsing packets and maintaining the caches */
+DEFINE_MEMPOOL(dns_resource_record_pool, DnsResourceRecord, 64);
+
 DnsResourceRecord* dns_resource_record_new(DnsResourceKey *key) {
         DnsResourceRecord *rr;
+        bool from_pool;
 
-        rr = new(DnsResourceRecord, 1);
+        rr = mempool_alloc0_tile_or_heap(&dns_resource_record_pool, sizeof(DnsResourceRecord), &from_pool);
         if (!rr)
                 return NULL;
 
@@ -381,6 +386,7 @@ DnsResourceRecord* dns_resource_record_new(DnsResourceKey *key) {
                 .expiry = USEC_INFINITY,
                 .n_skip_labels_signer = UINT8_MAX,
                 .n_skip_labels_source = UINT8_MAX,
+                .from_pool = from_pool,
         };
 
         return rr;
@@ -488,7 +494,7 @@ static DnsResourceRecord* dns_resource_record_free(DnsResourceRecord *rr) {
         }
 
         free(rr->to_string);
-        return mfree(rr);
+        return mempool_free_tile_or_heap(&dns_resource_record_pool, rr, rr->from_pool);
 }
 
 DEFINE_TRIVIAL_REF_UNREF_FUNC(DnsResourceRecord, dns_resource_record, dns_resource_record_free);
@@ -106,6 +106,7 @@ struct DnsResourceRecord {
 
         bool unparsable;
         bool wire_format_canonical;
+        bool from_pool;
 
         void *wire_format;
         size_t wire_format_size;
@@ -20,7 +20,9 @@
 #include "bus-util.h"
 #include "data-fd-util.h"
 #include "fd-util.h"
+#include "json.h"
 #include "memstream-util.h"
+#include "mempool.h"
 #include "path-util.h"
 #include "socket-util.h"
 #include "stdio-util.h"
@@ -622,6 +624,8 @@ static int method_dump_memory_state_by_fd(sd_bus_message *message, void *userdat
         if (r < 0)
                 return r;
 
+        mempool_dump_all(f);
+
         r = memstream_finalize(&m, &dump, &dump_size);
         if (r < 0)
                 return r;
@@ -709,3 +713,246 @@ int bus_property_get_string_set(
 
         return bus_message_append_string_set(reply, *s);
 }
+
+static int bus_message_read_json_key(sd_bus_message *m, JsonVariant **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *k = NULL;
+        _cleanup_free_ char *s = NULL;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        /* JSON objects only have string keys, while D-Bus dictionaries may be keyed by any basic type.
+         * Use the JSON formatting of integers and booleans as key then, like "42" or "true", and the
+         * doubles with all of their precision, like "1.5" or "0.10000000000000001". */
+
+        r = bus_message_read_json(m, &k);
+        if (r < 0)
+                return r;
+
+        if (json_variant_is_string(k)) {
+                *ret = TAKE_PTR(k);
+                return 0;
+        }
+
+        if (json_variant_type(k) == JSON_VARIANT_REAL) {
+                if (asprintf(&s, "%.17g", json_variant_real(k)) < 0)
+                        return -ENOMEM;
+        } else {
+                r = json_variant_format(k, 0, &s);
+                if (r < 0)
+                        return r;
+        }
+
+        return json_variant_new_string(ret, s);
+}
+
+static int bus_message_read_json_container(sd_bus_message *m, bool dict, JsonVariant **ret) {
+        JsonVariant **elements = NULL;
+        size_t n_elements = 0;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        CLEANUP_ARRAY(elements, n_elements, json_variant_unref_many);
+
+        for (;;) {
+                r = sd_bus_message_at_end(m, false);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        break;
+
+                if (!GREEDY_REALLOC(elements, n_elements + 2))
+                        return -ENOMEM;
+
+                if (!dict) {
+                        r = bus_message_read_json(m, elements + n_elements);
+                        if (r < 0)
+                                return r;
+
+                        n_elements++;
+                        continue;
+                }
+
+                r = sd_bus_message_enter_container(m, SD_BUS_TYPE_DICT_ENTRY, NULL);
+                if (r < 0)
+                        return r;
+
+                r = bus_message_read_json_key(m, elements + n_elements);
+                if (r < 0)
+                        return r;
+
+                n_elements++;
+
+                r = bus_message_read_json(m, elements + n_elements);
+                if (r < 0)
+                        return r;
+
+                n_elements++;
+
+                r = sd_bus_message_exit_container(m);
+                if (r < 0)
+                        return r;
+        }
+
+        if (dict)
+                return json_variant_new_object(ret, elements, n_elements);
+
+        return json_variant_new_array(ret, elements, n_elements);
+}
+
+int bus_message_read_json(sd_bus_message *m, JsonVariant **ret) {
+        const char *contents;
+        char type;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        /* Converts the next element of a D-Bus message into plain JSON. Unlike busctl's JSON output
+         * this drops the type information of variants, for callers that asked for specific properties
+         * and know their types, like io.systemd.Manager.GetUnitsProperties(). Dictionaries become JSON
+         * objects, everything else that is iterable becomes a JSON array. */
+
+        r = sd_bus_message_peek_type(m, &type, &contents);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return -EBADMSG;
+
+        switch (type) {
+
+        case SD_BUS_TYPE_BYTE: {
+                uint8_t b;
+
+                r = sd_bus_message_read_basic(m, type, &b);
+                if (r < 0)
+                        return r;
+
+                return json_variant_new_unsigned(ret, b);
+        }
+
+        case SD_BUS_TYPE_BOOLEAN: {
+                int b;
+
+                r = sd_bus_message_read_basic(m, type, &b);
+                if (r < 0)
+                        return r;
+
+                return json_variant_new_boolean(ret, b);
+        }
+
+        case SD_BUS_TYPE_INT16: {
+                int16_t i;
+
+                r = sd_bus_message_read_basic(m, type, &i);
+                if (r < 0)
+                        return r;
+
+                return json_variant_new_integer(ret, i);
+        }
+
+        case SD_BUS_TYPE_UINT16: {
+                uint16_t u;
+
+                r = sd_bus_message_read_basic(m, type, &u);
+                if (r < 0)
+                        return r;
+
+                return json_variant_new_unsigned(ret, u);
+        }
+
+        case SD_BUS_TYPE_INT32: {
+                int32_t i;
+
+                r = sd_bus_message_read_basic(m, type, &i);
+                if (r < 0)
+                        return r;
+
+                return json_variant_new_integer(ret, i);
+        }
+
+        case SD_BUS_TYPE_UINT32: {
+                uint32_t u;
+
+                r = sd_bus_message_read_basic(m, type, &u);
+                if (r < 0)
+                        return r;
+
+                return json_variant_new_unsigned(ret, u);
+        }
+
+        case SD_BUS_TYPE_INT64: {
+                int64_t i;
+
+                r = sd_bus_message_read_basic(m, type, &i);
+                if (r < 0)
+                        return r;
+
+                return json_variant_new_integer(ret, i);
+        }
+
+        case SD_BUS_TYPE_UINT64: {
+                uint64_t u;
+
+                r = sd_bus_message_read_basic(m, type, &u);
+                if (r < 0)
+                        return r;
+
+                return json_variant_new_unsigned(ret, u);
+        }
+
+        case SD_BUS_TYPE_DOUBLE: {
+                double d;
+
+                r = sd_bus_message_read_basic(m, type, &d);
+                if (r < 0)
+                        return r;
+
+                return json_variant_new_real(ret, d);
+        }
+
+        case SD_BUS_TYPE_STRING:
+        case SD_BUS_TYPE_OBJECT_PATH:
+        case SD_BUS_TYPE_SIGNATURE: {
+                const char *s;
+
+                r = sd_bus_message_read_basic(m, type, &s);
+                if (r < 0)
+                        return r;
+
+                return json_variant_new_string(ret, s);
+        }
+
+        case SD_BUS_TYPE_UNIX_FD:
+                r = sd_bus_message_skip(m, CHAR_TO_STR(type));
+                if (r < 0)
+                        return r;
+
+                return json_variant_new_null(ret);
+
+        case SD_BUS_TYPE_ARRAY:
+        case SD_BUS_TYPE_VARIANT:
+        case SD_BUS_TYPE_STRUCT:
+                r = sd_bus_message_enter_container(m, type, contents);
+                if (r < 0)
+                        return r;
+
+                if (type == SD_BUS_TYPE_VARIANT)
+                        r = bus_message_read_json(m, ret);
+                else
+                        r = bus_message_read_json_container(
+                                        m,
+                                        type == SD_BUS_TYPE_ARRAY && contents[0] == SD_BUS_TYPE_DICT_ENTRY_BEGIN,
+                                        ret);
+                if (r < 0)
+                        return r;
+
+                return sd_bus_message_exit_container(m);
+
+        default:
+                return -EBADMSG;
+        }
+}
@@ -10,6 +10,7 @@
 #include "sd-event.h"
 
 #include "errno-util.h"
+#include "json.h"
 #include "macro.h"
 #include "runtime-scope.h"
 #include "set.h"
@@ -73,3 +74,5 @@ extern const struct hash_ops bus_message_hash_ops;
 int bus_message_append_string_set(sd_bus_message *m, Set *s);
 
 int bus_property_get_string_set(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error);
+
+int bus_message_read_json(sd_bus_message *m, JsonVariant **ret);
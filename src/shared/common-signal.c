@@ -4,6 +4,7 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "memstream-util.h"
+#include "mempool.h"
 #include "process-util.h"
 #include "signal-util.h"
 
@@ -71,6 +72,8 @@ int sigrtmin18_handler(sd_event_source *s, const struct signalfd_siginfo *si, vo
                         break;
                 }
 
+                mempool_dump_all(f);
+
                 (void) memstream_dump(LOG_INFO, &m);
                 break;
         }
@@ -271,111 +271,80 @@ static int parse_line(
                                userdata);
 }
 
-/* Go through the file and parse each line */
-int config_parse(
-                const char *unit,
-                const char *filename,
-                FILE *f,
-                const char *sections,
-                ConfigItemLookup lookup,
-                const void *table,
-                ConfigParseFlags flags,
-                void *userdata,
-                struct stat *ret_stat) {
-
-        _cleanup_free_ char *section = NULL, *continuation = NULL;
-        _cleanup_fclose_ FILE *ours = NULL;
-        unsigned line = 0, section_line = 0;
-        bool section_ignored = false, bom_seen = false;
-        struct stat st;
-        int r, fd;
-
-        assert(filename);
-        assert(lookup);
-
-        if (!f) {
-                f = ours = fopen(filename, "re");
-                if (!f) {
-                        /* Only log on request, except for ENOENT,
-                         * since we return 0 to the caller. */
-                        if ((flags & CONFIG_PARSE_WARN) || errno == ENOENT)
-                                log_full_errno(errno == ENOENT ? LOG_DEBUG : LOG_ERR, errno,
-                                               "Failed to open configuration file '%s': %m", filename);
-
-                        if (errno == ENOENT) {
-                                if (ret_stat)
-                                        *ret_stat = (struct stat) {};
-
-                                return 0;
-                        }
-
-                        return -errno;
-                }
-        }
-
-        fd = fileno(f);
-        if (fd >= 0) { /* stream might not have an fd, let's be careful hence */
+typedef struct ConfigReader {
+        const char *filename;
+        FILE *f;
+        ConfigParseFlags flags;
+        unsigned line;
+        bool bom_seen;
+        char *continuation;
+} ConfigReader;
+
+static void config_reader_done(ConfigReader *c) {
+        c->continuation = mfree(c->continuation);
+}
 
-                if (fstat(fd, &st) < 0)
-                        return log_full_errno(FLAGS_SET(flags, CONFIG_PARSE_WARN) ? LOG_ERR : LOG_DEBUG, errno,
-                                              "Failed to fstat(%s): %m", filename);
+/* Reads the next logical line, i.e. skips comments, strips the byte order mark and joins continuation lines.
+ * Returns 0 at the end of the file. */
+static int config_reader_next(ConfigReader *c, unsigned *ret_line, char **ret) {
+        int r;
 
-                (void) stat_warn_permissions(filename, &st);
-        } else
-                st = (struct stat) {};
+        assert(c);
+        assert(ret_line);
+        assert(ret);
 
         for (;;) {
                 _cleanup_free_ char *buf = NULL;
                 bool escaped = false;
                 char *l, *p, *e;
 
-                r = read_line(f, LONG_LINE_MAX, &buf);
+                r = read_line(c->f, LONG_LINE_MAX, &buf);
                 if (r == 0)
                         break;
                 if (r == -ENOBUFS) {
-                        if (flags & CONFIG_PARSE_WARN)
-                                log_error_errno(r, "%s:%u: Line too long", filename, line);
+                        if (c->flags & CONFIG_PARSE_WARN)
+                                log_error_errno(r, "%s:%u: Line too long", c->filename, c->line);
 
                         return r;
                 }
                 if (r < 0) {
-                        if (FLAGS_SET(flags, CONFIG_PARSE_WARN))
-                                log_error_errno(r, "%s:%u: Error while reading configuration file: %m", filename, line);
+                        if (FLAGS_SET(c->flags, CONFIG_PARSE_WARN))
+                                log_error_errno(r, "%s:%u: Error while reading configuration file: %m", c->filename, c->line);
 
                         return r;
                 }
 
-                line++;
+                c->line++;
 
                 l = skip_leading_chars(buf, WHITESPACE);
                 if (*l != '\0' && strchr(COMMENTS, *l))
                         continue;
 
                 l = buf;
-                if (!bom_seen) {
+                if (!c->bom_seen) {
                         char *q;
 
                         q = startswith(buf, UTF8_BYTE_ORDER_MARK);
                         if (q) {
                                 l = q;
-                                bom_seen = true;
+                                c->bom_seen = true;
                         }
                 }
 
-                if (continuation) {
-                        if (strlen(continuation) + strlen(l) > LONG_LINE_MAX) {
-                                if (flags & CONFIG_PARSE_WARN)
-                                        log_error("%s:%u: Continuation line too long", filename, line);
+                if (c->continuation) {
+                        if (strlen(c->continuation) + strlen(l) > LONG_LINE_MAX) {
+                                if (c->flags & CONFIG_PARSE_WARN)
+                                        log_error("%s:%u: Continuation line too long", c->filename, c->line);
                                 return -ENOBUFS;
                         }
 
-                        if (!strextend(&continuation, l)) {
-                                if (flags & CONFIG_PARSE_WARN)
+                        if (!strextend(&c->continuation, l)) {
+                                if (c->flags & CONFIG_PARSE_WARN)
                                         log_oom();
                                 return -ENOMEM;
                         }
 
-                        p = continuation;
+                        p = c->continuation;
                 } else
                         p = l;
 
@@ -389,10 +358,10 @@ int config_parse(
                 if (escaped) {
                         *(e-1) = ' ';
 
-                        if (!continuation) {
-                                continuation = strdup(l);
-                                if (!continuation) {
-                                        if (flags & CONFIG_PARSE_WARN)
+                        if (!c->continuation) {
+                                c->continuation = strdup(l);
+                                if (!c->continuation) {
+                                        if (c->flags & CONFIG_PARSE_WARN)
                                                 log_oom();
                                         return -ENOMEM;
                                 }
@@ -401,6 +370,113 @@ int config_parse(
                         continue;
                 }
 
+                *ret_line = c->line;
+                if (c->continuation)
+                        *ret = TAKE_PTR(c->continuation);
+                else {
+                        if (l != buf)
+                                memmove(buf, l, strlen(l) + 1);
+                        *ret = TAKE_PTR(buf);
+                }
+
+                return 1;
+        }
+
+        if (c->continuation) {
+                *ret_line = ++c->line;
+                *ret = TAKE_PTR(c->continuation);
+                return 1;
+        }
+
+        return 0;
+}
+
+static int config_open(const char *filename, FILE **f, FILE **ours, ConfigParseFlags flags, struct stat *ret_stat) {
+        int fd;
+
+        assert(filename);
+        assert(f);
+        assert(ours);
+        assert(ret_stat);
+
+        if (!*f) {
+                *f = *ours = fopen(filename, "re");
+                if (!*f) {
+                        /* Only log on request, except for ENOENT,
+                         * since we return 0 to the caller. */
+                        if ((flags & CONFIG_PARSE_WARN) || errno == ENOENT)
+                                log_full_errno(errno == ENOENT ? LOG_DEBUG : LOG_ERR, errno,
+                                               "Failed to open configuration file '%s': %m", filename);
+
+                        if (errno == ENOENT) {
+                                *ret_stat = (struct stat) {};
+                                return 0;
+                        }
+
+                        return -errno;
+                }
+        }
+
+        fd = fileno(*f);
+        if (fd >= 0) { /* stream might not have an fd, let's be careful hence */
+
+                if (fstat(fd, ret_stat) < 0)
+                        return log_full_errno(FLAGS_SET(flags, CONFIG_PARSE_WARN) ? LOG_ERR : LOG_DEBUG, errno,
+                                              "Failed to fstat(%s): %m", filename);
+
+                (void) stat_warn_permissions(filename, ret_stat);
+        } else
+                *ret_stat = (struct stat) {};
+
+        return 1;
+}
+
+/* Go through the file and parse each line */
+int config_parse(
+                const char *unit,
+                const char *filename,
+                FILE *f,
+                const char *sections,
+                ConfigItemLookup lookup,
+                const void *table,
+                ConfigParseFlags flags,
+                void *userdata,
+                struct stat *ret_stat) {
+
+        _cleanup_(config_reader_done) ConfigReader reader = {};
+        _cleanup_free_ char *section = NULL;
+        _cleanup_fclose_ FILE *ours = NULL;
+        unsigned section_line = 0;
+        bool section_ignored = false;
+        struct stat st;
+        int r;
+
+        assert(filename);
+        assert(lookup);
+
+        r = config_open(filename, &f, &ours, flags, &st);
+        if (r <= 0) {
+                if (r == 0 && ret_stat)
+                        *ret_stat = st;
+                return r;
+        }
+
+        reader = (ConfigReader) {
+                .filename = filename,
+                .f = f,
+                .flags = flags,
+        };
+
+        for (;;) {
+                _cleanup_free_ char *l = NULL;
+                unsigned line;
+
+                r = config_reader_next(&reader, &line, &l);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
                 r = parse_line(unit,
                                filename,
                                line,
@@ -411,21 +487,130 @@ int config_parse(
                                &section,
                                &section_line,
                                &section_ignored,
-                               p,
+                               l,
                                userdata);
                 if (r < 0) {
                         if (flags & CONFIG_PARSE_WARN)
                                 log_warning_errno(r, "%s:%u: Failed to parse file: %m", filename, line);
                         return r;
                 }
+        }
 
-                continuation = mfree(continuation);
+        if (ret_stat)
+                *ret_stat = st;
+
+        return 1;
+}
+
+void config_lines_done(ConfigLines *lines) {
+        assert(lines);
+
+        FOREACH_ARRAY(i, lines->lines, lines->n_lines)
+                free(i->text);
+
+        lines->lines = mfree(lines->lines);
+        lines->n_lines = 0;
+}
+
+int config_lines_add(ConfigLines *lines, unsigned line, const char *text) {
+        char *t;
+
+        assert(lines);
+        assert(text);
+
+        if (!GREEDY_REALLOC(lines->lines, lines->n_lines + 1))
+                return -ENOMEM;
+
+        t = strdup(text);
+        if (!t)
+                return -ENOMEM;
+
+        lines->lines[lines->n_lines++] = (ConfigLine) {
+                .line = line,
+                .text = t,
+        };
+
+        return 0;
+}
+
+int config_read_lines(
+                const char *filename,
+                FILE *f,
+                ConfigParseFlags flags,
+                ConfigLines *ret,
+                struct stat *ret_stat) {
+
+        _cleanup_(config_reader_done) ConfigReader reader = {};
+        _cleanup_(config_lines_done) ConfigLines lines = {};
+        _cleanup_fclose_ FILE *ours = NULL;
+        struct stat st;
+        int r;
+
+        assert(filename);
+        assert(ret);
+
+        r = config_open(filename, &f, &ours, flags, &st);
+        if (r < 0)
+                return r;
+        if (r > 0) {
+                reader = (ConfigReader) {
+                        .filename = filename,
+                        .f = f,
+                        .flags = flags,
+                };
+
+                for (;;) {
+                        _cleanup_free_ char *l = NULL;
+                        unsigned line;
+
+                        r = config_reader_next(&reader, &line, &l);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                break;
+
+                        if (!GREEDY_REALLOC(lines.lines, lines.n_lines + 1))
+                                return -ENOMEM;
+
+                        lines.lines[lines.n_lines++] = (ConfigLine) {
+                                .line = line,
+                                .text = TAKE_PTR(l),
+                        };
+                }
+
+                r = 1;
         }
 
-        if (continuation) {
+        *ret = TAKE_STRUCT(lines);
+        if (ret_stat)
+                *ret_stat = st;
+
+        return r;
+}
+
+int config_parse_lines(
+                const char *unit,
+                const char *filename,
+                ConfigLines *lines,
+                const char *sections,
+                ConfigItemLookup lookup,
+                const void *table,
+                ConfigParseFlags flags,
+                void *userdata) {
+
+        _cleanup_free_ char *section = NULL;
+        unsigned section_line = 0;
+        bool section_ignored = false;
+        int r;
+
+        assert(filename);
+        assert(lines);
+        assert(lookup);
+
+        FOREACH_ARRAY(i, lines->lines, lines->n_lines) {
                 r = parse_line(unit,
                                filename,
-                               ++line,
+                               i->line,
                                sections,
                                lookup,
                                table,
@@ -433,18 +618,15 @@ int config_parse(
                                &section,
                                &section_line,
                                &section_ignored,
-                               continuation,
+                               i->text,
                                userdata);
                 if (r < 0) {
                         if (flags & CONFIG_PARSE_WARN)
-                                log_warning_errno(r, "%s:%u: Failed to parse file: %m", filename, line);
+                                log_warning_errno(r, "%s:%u: Failed to parse file: %m", filename, i->line);
                         return r;
                 }
         }
 
-        if (ret_stat)
-                *ret_stat = st;
-
         return 1;
 }
 
@@ -93,6 +93,40 @@ int config_parse(
                 void *userdata,
                 struct stat *ret_stat);     /* possibly NULL */
 
+/* The logical lines of a configuration file, i.e. with comments and empty lines dropped, and continuation
+ * lines joined. config_parse() is config_read_lines() followed by config_parse_lines(), but the two steps may
+ * also be done separately, e.g. to cache the lines read from a file. */
+typedef struct ConfigLine {
+        unsigned line;
+        char *text;
+} ConfigLine;
+
+typedef struct ConfigLines {
+        ConfigLine *lines;
+        size_t n_lines;
+} ConfigLines;
+
+void config_lines_done(ConfigLines *lines);
+int config_lines_add(ConfigLines *lines, unsigned line, const char *text);
+
+int config_read_lines(
+                const char *filename,
+                FILE *f,
+                ConfigParseFlags flags,
+                ConfigLines *ret,
+                struct stat *ret_stat);     /* possibly NULL */
+
+/* Note that this modifies the text of the lines. */
+int config_parse_lines(
+                const char *unit,
+                const char *filename,
+                ConfigLines *lines,
+                const char *sections,       /* nulstr */
+                ConfigItemLookup lookup,
+                const void *table,
+                ConfigParseFlags flags,
+                void *userdata);
+
 int config_parse_config_file(
                 const char *conf_file,
                 const char *sections,       /* nulstr */
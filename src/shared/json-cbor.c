@@ -0,0 +1,430 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <math.h>
+
+#include "alloc-util.h"
+#include "json-cbor.h"
+#include "memory-util.h"
+#include "unaligned.h"
+
+/* Refuse nesting deeper than this, same as the JSON parser does */
+#define CBOR_DEPTH_MAX (2U*1024U)
+
+enum {
+        CBOR_MAJOR_UNSIGNED = 0,
+        CBOR_MAJOR_NEGATIVE = 1,
+        CBOR_MAJOR_BYTES    = 2,
+        CBOR_MAJOR_TEXT     = 3,
+        CBOR_MAJOR_ARRAY    = 4,
+        CBOR_MAJOR_MAP      = 5,
+        CBOR_MAJOR_TAG      = 6,
+        CBOR_MAJOR_SIMPLE   = 7,
+};
+
+enum {
+        CBOR_SIMPLE_FALSE   = 20,
+        CBOR_SIMPLE_TRUE    = 21,
+        CBOR_SIMPLE_NULL    = 22,
+        CBOR_SIMPLE_FLOAT16 = 25,
+        CBOR_SIMPLE_FLOAT32 = 26,
+        CBOR_SIMPLE_FLOAT64 = 27,
+};
+
+static size_t cbor_head_size(uint64_t n) {
+        if (n < 24)
+                return 1;
+        if (n <= UINT8_MAX)
+                return 2;
+        if (n <= UINT16_MAX)
+                return 3;
+        if (n <= UINT32_MAX)
+                return 5;
+        return 9;
+}
+
+static uint8_t* cbor_write_head(uint8_t *p, uint8_t major, uint64_t n) {
+        assert(p);
+        assert(major <= CBOR_MAJOR_SIMPLE);
+
+        major <<= 5;
+
+        if (n < 24)
+                *(p++) = major | n;
+        else if (n <= UINT8_MAX) {
+                *(p++) = major | 24;
+                *(p++) = n;
+        } else if (n <= UINT16_MAX) {
+                *(p++) = major | 25;
+                unaligned_write_be16(p, n);
+                p += 2;
+        } else if (n <= UINT32_MAX) {
+                *(p++) = major | 26;
+                unaligned_write_be32(p, n);
+                p += 4;
+        } else {
+                *(p++) = major | 27;
+                unaligned_write_be64(p, n);
+                p += 8;
+        }
+
+        return p;
+}
+
+static bool cbor_real_fits_float(double d) {
+        /* Use the shorter single precision encoding whenever that is lossless */
+        return (double) (float) d == d;
+}
+
+static size_t cbor_size(JsonVariant *v) {
+        JsonVariant *e;
+        size_t sz;
+
+        switch (json_variant_type(v)) {
+
+        case JSON_VARIANT_NULL:
+        case JSON_VARIANT_BOOLEAN:
+                return 1;
+
+        case JSON_VARIANT_INTEGER: {
+                int64_t i = json_variant_integer(v);
+
+                return cbor_head_size(i < 0 ? (uint64_t) -(i + 1) : (uint64_t) i);
+        }
+
+        case JSON_VARIANT_UNSIGNED:
+                return cbor_head_size(json_variant_unsigned(v));
+
+        case JSON_VARIANT_REAL:
+                return cbor_real_fits_float(json_variant_real(v)) ? 5 : 9;
+
+        case JSON_VARIANT_STRING:
+                sz = strlen(json_variant_string(v));
+                return cbor_head_size(sz) + sz;
+
+        case JSON_VARIANT_ARRAY:
+                sz = cbor_head_size(json_variant_elements(v));
+                JSON_VARIANT_ARRAY_FOREACH(e, v)
+                        sz += cbor_size(e);
+                return sz;
+
+        case JSON_VARIANT_OBJECT: {
+                const char *k;
+
+                sz = cbor_head_size(json_variant_elements(v) / 2);
+                JSON_VARIANT_OBJECT_FOREACH(k, e, v)
+                        sz += cbor_head_size(strlen(k)) + strlen(k) + cbor_size(e);
+                return sz;
+        }
+
+        default:
+                assert_not_reached();
+        }
+}
+
+static uint8_t* cbor_write(uint8_t *p, JsonVariant *v) {
+        JsonVariant *e;
+
+        assert(p);
+
+        switch (json_variant_type(v)) {
+
+        case JSON_VARIANT_NULL:
+                return cbor_write_head(p, CBOR_MAJOR_SIMPLE, CBOR_SIMPLE_NULL);
+
+        case JSON_VARIANT_BOOLEAN:
+                return cbor_write_head(p, CBOR_MAJOR_SIMPLE, json_variant_boolean(v) ? CBOR_SIMPLE_TRUE : CBOR_SIMPLE_FALSE);
+
+        case JSON_VARIANT_INTEGER: {
+                int64_t i = json_variant_integer(v);
+
+                if (i < 0)
+                        return cbor_write_head(p, CBOR_MAJOR_NEGATIVE, (uint64_t) -(i + 1));
+
+                return cbor_write_head(p, CBOR_MAJOR_UNSIGNED, (uint64_t) i);
+        }
+
+        case JSON_VARIANT_UNSIGNED:
+                return cbor_write_head(p, CBOR_MAJOR_UNSIGNED, json_variant_unsigned(v));
+
+        case JSON_VARIANT_REAL: {
+                double d = json_variant_real(v);
+
+                if (cbor_real_fits_float(d)) {
+                        float f = (float) d;
+                        uint32_t u;
+
+                        memcpy(&u, &f, sizeof(u));
+                        *(p++) = CBOR_MAJOR_SIMPLE << 5 | CBOR_SIMPLE_FLOAT32;
+                        unaligned_write_be32(p, u);
+                        return p + 4;
+                } else {
+                        uint64_t u;
+
+                        memcpy(&u, &d, sizeof(u));
+                        *(p++) = CBOR_MAJOR_SIMPLE << 5 | CBOR_SIMPLE_FLOAT64;
+                        unaligned_write_be64(p, u);
+                        return p + 8;
+                }
+        }
+
+        case JSON_VARIANT_STRING: {
+                const char *s = json_variant_string(v);
+                size_t n = strlen(s);
+
+                p = cbor_write_head(p, CBOR_MAJOR_TEXT, n);
+                return mempcpy(p, s, n);
+        }
+
+        case JSON_VARIANT_ARRAY:
+                p = cbor_write_head(p, CBOR_MAJOR_ARRAY, json_variant_elements(v));
+                JSON_VARIANT_ARRAY_FOREACH(e, v)
+                        p = cbor_write(p, e);
+                return p;
+
+        case JSON_VARIANT_OBJECT: {
+                const char *k;
+
+                p = cbor_write_head(p, CBOR_MAJOR_MAP, json_variant_elements(v) / 2);
+                JSON_VARIANT_OBJECT_FOREACH(k, e, v) {
+                        size_t n = strlen(k);
+
+                        p = cbor_write_head(p, CBOR_MAJOR_TEXT, n);
+                        p = mempcpy(p, k, n);
+                        p = cbor_write(p, e);
+                }
+                return p;
+        }
+
+        default:
+                assert_not_reached();
+        }
+}
+
+int json_variant_format_cbor(JsonVariant *v, void **ret, size_t *ret_size) {
+        _cleanup_free_ uint8_t *buf = NULL;
+        size_t sz;
+
+        assert_return(v, -EINVAL);
+        assert_return(ret, -EINVAL);
+        assert_return(ret_size, -EINVAL);
+
+        /* Two passes: first determine the size, then write everything into a single allocation of exactly
+         * that size. This way we never leave copies of sensitive data behind in realloc()ed buffers. */
+        sz = cbor_size(v);
+
+        buf = new(uint8_t, sz);
+        if (!buf)
+                return -ENOMEM;
+
+        assert_se(cbor_write(buf, v) == buf + sz);
+
+        *ret = TAKE_PTR(buf);
+        *ret_size = sz;
+        return 0;
+}
+
+static int cbor_read_head(const uint8_t **p, const uint8_t *end, uint8_t *ret_major, uint8_t *ret_info, uint64_t *ret_value) {
+        const uint8_t *q;
+        uint8_t info;
+        size_t n;
+
+        assert(p);
+        assert(end);
+        assert(ret_major);
+        assert(ret_info);
+        assert(ret_value);
+
+        q = *p;
+        if (q >= end)
+                return -EBADMSG;
+
+        *ret_major = *q >> 5;
+        info = *q & 0x1f;
+        q++;
+
+        if (info < 24) {
+                *ret_value = info;
+                *ret_info = info;
+                *p = q;
+                return 0;
+        }
+
+        switch (info) {
+        case 24:
+                n = 1;
+                break;
+        case 25:
+                n = 2;
+                break;
+        case 26:
+                n = 4;
+                break;
+        case 27:
+                n = 8;
+                break;
+        case 31:
+                return -EOPNOTSUPP; /* Indefinite length, we never generate these */
+        default:
+                return -EBADMSG; /* Reserved */
+        }
+
+        if ((size_t) (end - q) < n)
+                return -EBADMSG;
+
+        *ret_value = n == 1 ? *q :
+                     n == 2 ? unaligned_read_be16(q) :
+                     n == 4 ? unaligned_read_be32(q) :
+                              unaligned_read_be64(q);
+        *ret_info = info;
+        *p = q + n;
+        return 0;
+}
+
+static double cbor_half_to_double(uint16_t h) {
+        unsigned e = (h >> 10) & 0x1f, m = h & 0x3ff;
+        double d;
+
+        if (e == 0)
+                d = ldexp(m, -24);
+        else if (e != 31)
+                d = ldexp(m + 1024, (int) e - 25);
+        else
+                d = m == 0 ? INFINITY : NAN;
+
+        return h & 0x8000 ? -d : d;
+}
+
+static int cbor_parse_item(const uint8_t **p, const uint8_t *end, unsigned depth, JsonVariant **ret) {
+        uint8_t major, info;
+        uint64_t n;
+        int r;
+
+        assert(p);
+        assert(end);
+        assert(ret);
+
+        if (depth >= CBOR_DEPTH_MAX)
+                return -ELNRNG;
+
+        r = cbor_read_head(p, end, &major, &info, &n);
+        if (r < 0)
+                return r;
+
+        switch (major) {
+
+        case CBOR_MAJOR_UNSIGNED:
+                return json_variant_new_unsigned(ret, n);
+
+        case CBOR_MAJOR_NEGATIVE:
+                if (n > INT64_MAX)
+                        return -ERANGE;
+
+                return json_variant_new_integer(ret, -(int64_t) n - 1);
+
+        case CBOR_MAJOR_TEXT:
+                if (n > (uint64_t) (end - *p))
+                        return -EBADMSG;
+
+                r = json_variant_new_stringn(ret, (const char*) *p, n);
+                if (r < 0)
+                        return r;
+
+                *p += n;
+                return 0;
+
+        case CBOR_MAJOR_ARRAY:
+        case CBOR_MAJOR_MAP: {
+                JsonVariant **elements = NULL;
+                size_t n_elements = 0, m;
+
+                /* Every item takes up at least one byte, use that to refuse bogus sizes early */
+                if (n > (uint64_t) (end - *p) || (major == CBOR_MAJOR_MAP && n > (uint64_t) (end - *p) / 2))
+                        return -EBADMSG;
+
+                m = major == CBOR_MAJOR_MAP ? n * 2 : n;
+
+                CLEANUP_ARRAY(elements, n_elements, json_variant_unref_many);
+
+                if (m > 0) {
+                        elements = new(JsonVariant*, m);
+                        if (!elements)
+                                return -ENOMEM;
+                }
+
+                while (n_elements < m) {
+                        /* Map keys must be strings, like in JSON */
+                        if (major == CBOR_MAJOR_MAP && n_elements % 2 == 0 &&
+                            (*p >= end || (**p >> 5) != CBOR_MAJOR_TEXT))
+                                return -EBADMSG;
+
+                        r = cbor_parse_item(p, end, depth + 1, elements + n_elements);
+                        if (r < 0)
+                                return r;
+
+                        n_elements++;
+                }
+
+                if (major == CBOR_MAJOR_MAP)
+                        return json_variant_new_object(ret, elements, n_elements);
+
+                return json_variant_new_array(ret, elements, n_elements);
+        }
+
+        case CBOR_MAJOR_SIMPLE:
+                switch (info) {
+
+                case CBOR_SIMPLE_FALSE:
+                case CBOR_SIMPLE_TRUE:
+                        return json_variant_new_boolean(ret, info == CBOR_SIMPLE_TRUE);
+
+                case CBOR_SIMPLE_NULL:
+                        return json_variant_new_null(ret);
+
+                case CBOR_SIMPLE_FLOAT16:
+                        return json_variant_new_real(ret, cbor_half_to_double(n));
+
+                case CBOR_SIMPLE_FLOAT32: {
+                        uint32_t u = n;
+                        float f;
+
+                        memcpy(&f, &u, sizeof(f));
+                        return json_variant_new_real(ret, f);
+                }
+
+                case CBOR_SIMPLE_FLOAT64: {
+                        double d;
+
+                        memcpy(&d, &n, sizeof(d));
+                        return json_variant_new_real(ret, d);
+                }
+
+                default:
+                        return -EOPNOTSUPP; /* "undefined" and other simple values have no JSON equivalent */
+                }
+
+        default:
+                return -EOPNOTSUPP; /* Byte strings and tags have no JSON equivalent */
+        }
+}
+
+int json_parse_cbor(const void *data, size_t size, JsonVariant **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        const uint8_t *p = data, *end;
+        int r;
+
+        assert_return(data || size == 0, -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        end = p + size;
+
+        r = cbor_parse_item(&p, end, 0, &v);
+        if (r < 0)
+                return r;
+
+        /* We expect exactly one data item */
+        if (p != end)
+                return -EBADMSG;
+
+        *ret = TAKE_PTR(v);
+        return 0;
+}
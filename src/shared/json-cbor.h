@@ -0,0 +1,13 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include "json.h"
+
+/* Converts JsonVariant objects from and to CBOR (RFC 8949). Only the subset of CBOR that maps 1:1 onto JSON
+ * is supported: unsigned and negative integers, floating point numbers, UTF-8 text strings, arrays and maps
+ * with text string keys, as well as the simple values false, true and null. All items are encoded with
+ * definite lengths. Byte strings, tags, indefinite length items, "undefined" and other simple values are
+ * refused when parsing. */
+
+int json_variant_format_cbor(JsonVariant *v, void **ret, size_t *ret_size);
+int json_parse_cbor(const void *data, size_t size, JsonVariant **ret);
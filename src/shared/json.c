@@ -2,6 +2,7 @@
 
 #include <errno.h>
 #include <locale.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -21,7 +22,9 @@
 #include "math-util.h"
 #include "memory-util.h"
 #include "memstream-util.h"
+#include "random-util.h"
 #include "set.h"
+#include "siphash24.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
@@ -50,6 +53,16 @@ typedef struct JsonSource {
         char name[];
 } JsonSource;
 
+/* Objects with at least this many fields get a hash index for lookups by key, unless they are sorted (in which
+ * case we bisect). The index is built when the object is created, and is stored in an extra slot after the
+ * last element. Lookups never modify the object, hence it may be looked at from multiple threads. */
+#define OBJECT_INDEX_FIELDS_MIN 16U
+
+typedef struct JsonObjectIndex {
+        size_t mask;            /* number of buckets - 1 */
+        uint32_t buckets[];     /* field number + 1, or 0 if the bucket is empty */
+} JsonObjectIndex;
+
 /* On x86-64 this whole structure should have a size of 6 * 64 bit = 48 bytes */
 struct JsonVariant {
         union {
@@ -93,6 +106,14 @@ struct JsonVariant {
         /* If in addition to this object all objects referenced by it are also ordered strictly by name */
         bool normalized:1;
 
+        /* If this variant is part of a document that was parsed into a single allocation (see
+         * JSON_PARSE_ARENA). References between variants of the same arena are not reference counted, since
+         * the arena is released as a whole, and the arena may never be reallocated. */
+        bool in_arena:1;
+
+        /* If this is an object with an index slot after its elements, see OBJECT_INDEX_FIELDS_MIN */
+        bool has_index_slot:1;
+
         union {
                 /* For simple types we store the value in-line. */
                 JsonValue value;
@@ -103,6 +124,9 @@ struct JsonVariant {
                 /* If is_reference as indicated above is set, this is where the reference object is actually stored. */
                 JsonVariant *reference;
 
+                /* In the index slot of large objects, their index, see OBJECT_INDEX_FIELDS_MIN */
+                JsonObjectIndex *index;
+
                 /* Strings are placed immediately after the structure. Note that when this is a JsonVariant
                  * embedded into an array we might encode strings up to INLINE_STRING_LENGTH characters
                  * directly inside the element, while longer strings are stored as references. When this
@@ -699,6 +723,85 @@ int json_variant_new_array_strv(JsonVariant **ret, char **l) {
         return 0;
 }
 
+static size_t json_object_index_slots(size_t n_elements) {
+        /* Returns the number of variants to allocate after the elements of an object for the index slot */
+        if (n_elements / 2 < OBJECT_INDEX_FIELDS_MIN || n_elements / 2 >= UINT32_MAX)
+                return 0;
+
+        return 1;
+}
+
+static uint8_t object_index_hash_key[HASH_KEY_SIZE];
+
+static void object_index_hash_key_initialize(void) {
+        random_bytes(object_index_hash_key, sizeof(object_index_hash_key));
+}
+
+static uint64_t json_object_index_hash(const char *key) {
+        static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+        assert_se(pthread_once(&once, object_index_hash_key_initialize) == 0);
+
+        return siphash24_string(key, object_index_hash_key);
+}
+
+static const char *json_object_field_name(JsonVariant *v, size_t field) {
+        return json_variant_string(json_variant_dereference(v + 1 + field * 2));
+}
+
+static JsonObjectIndex *json_object_index_new(JsonVariant *v) {
+        JsonObjectIndex *index;
+        size_t n_fields, n_buckets;
+
+        assert(v);
+
+        /* Keep the load factor at or below 1/2, so that linear probing stays short */
+        n_fields = v->n_elements / 2;
+        n_buckets = ALIGN_POWER2(n_fields * 2);
+        if (n_buckets == 0)
+                return NULL;
+
+        index = malloc0(offsetof(JsonObjectIndex, buckets) + n_buckets * sizeof(uint32_t));
+        if (!index)
+                return NULL;
+
+        index->mask = n_buckets - 1;
+
+        for (size_t i = 0; i < n_fields; i++) {
+                const char *k = json_object_field_name(v, i);
+
+                for (size_t b = json_object_index_hash(k) & index->mask;; b = (b + 1) & index->mask) {
+                        if (index->buckets[b] == 0) {
+                                index->buckets[b] = i + 1;
+                                break;
+                        }
+
+                        /* On duplicate keys the first one wins, like with the linear search */
+                        if (streq(json_object_field_name(v, index->buckets[b] - 1), k))
+                                break;
+                }
+        }
+
+        return index;
+}
+
+static void json_object_init_index_slot(JsonVariant *v) {
+        assert(v);
+        assert(v->type == JSON_VARIANT_OBJECT);
+
+        /* Call this only once all elements are in place and v->sorted is known, the slot follows the last
+         * element. Sorted objects are bisected instead. If we fail to allocate the index, lookups fall back
+         * to searching linearly. */
+
+        if (json_object_index_slots(v->n_elements) == 0)
+                return;
+
+        v[1 + v->n_elements] = (JsonVariant) {
+                .index = v->sorted ? NULL : json_object_index_new(v),
+        };
+        v->has_index_slot = true;
+}
+
 int json_variant_new_object(JsonVariant **ret, JsonVariant **array, size_t n) {
         _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
         const char *prev = NULL;
@@ -712,7 +815,7 @@ int json_variant_new_object(JsonVariant **ret, JsonVariant **array, size_t n) {
         assert_return(array, -EINVAL);
         assert_return(n % 2 == 0, -EINVAL);
 
-        v = new(JsonVariant, n + 1);
+        v = new(JsonVariant, n + 1 + json_object_index_slots(n));
         if (!v)
                 return -ENOMEM;
 
@@ -759,6 +862,8 @@ int json_variant_new_object(JsonVariant **ret, JsonVariant **array, size_t n) {
         v->normalized = normalized;
         v->sorted = sorted;
 
+        json_object_init_index_slot(v);
+
         *ret = TAKE_PTR(v);
         return 0;
 }
@@ -812,6 +917,12 @@ static void json_variant_free_inner(JsonVariant *v, bool force_sensitive) {
         sensitive = v->sensitive || force_sensitive;
 
         if (v->is_reference) {
+                if (v->in_arena) {
+                        /* References within an arena are borrowed, the memory goes away with the arena */
+                        json_variant_free_inner(v->reference, sensitive);
+                        return;
+                }
+
                 if (sensitive)
                         json_variant_sensitive(v->reference);
 
@@ -819,10 +930,14 @@ static void json_variant_free_inner(JsonVariant *v, bool force_sensitive) {
                 return;
         }
 
-        if (IN_SET(v->type, JSON_VARIANT_ARRAY, JSON_VARIANT_OBJECT))
+        if (IN_SET(v->type, JSON_VARIANT_ARRAY, JSON_VARIANT_OBJECT)) {
                 for (size_t i = 0; i < v->n_elements; i++)
                         json_variant_free_inner(v + 1 + i, sensitive);
 
+                if (v->has_index_slot)
+                        free(v[1 + v->n_elements].index);
+        }
+
         if (sensitive)
                 explicit_bzero_safe(v, json_variant_size(v));
 }
@@ -1248,7 +1363,42 @@ mismatch:
         return NULL;
 }
 
+static int json_object_index_find(JsonVariant *v, const char *key, size_t *ret) {
+        JsonObjectIndex *index;
+
+        assert(v);
+        assert(key);
+        assert(ret);
+
+        /* Looks up the key via the object's hash index. Returns -EOPNOTSUPP if the object has no index
+         * (because it is small or sorted, or we failed to allocate it), in which case the caller has to
+         * bisect or search linearly. Otherwise returns > 0
+         * and the element index of the key if found, and 0 if not. */
+
+        if (!v->has_index_slot)
+                return -EOPNOTSUPP;
+
+        index = v[1 + v->n_elements].index;
+        if (!index)
+                return -EOPNOTSUPP;
+
+        for (size_t b = json_object_index_hash(key) & index->mask;; b = (b + 1) & index->mask) {
+                uint32_t f = index->buckets[b];
+
+                if (f == 0)
+                        return 0;
+
+                if (streq(json_object_field_name(v, f - 1), key)) {
+                        *ret = (f - 1) * 2;
+                        return 1;
+                }
+        }
+}
+
 JsonVariant *json_variant_by_key_full(JsonVariant *v, const char *key, JsonVariant **ret_key) {
+        size_t idx;
+        int r;
+
         if (!v)
                 goto not_found;
         if (!key)
@@ -1293,7 +1443,17 @@ JsonVariant *json_variant_by_key_full(JsonVariant *v, const char *key, JsonVaria
                 goto not_found;
         }
 
-        /* The variant is not sorted, hence search for the field linearly */
+        r = json_object_index_find(v, key, &idx);
+        if (r == 0)
+                goto not_found;
+        if (r > 0) {
+                if (ret_key)
+                        *ret_key = json_variant_conservative_formalize(v + 1 + idx);
+
+                return json_variant_conservative_formalize(v + 1 + idx + 1);
+        }
+
+        /* The variant is not sorted and not indexed, hence search for the field linearly */
         for (size_t i = 0; i < v->n_elements; i += 2) {
                 JsonVariant *p;
 
@@ -2124,10 +2284,11 @@ int json_variant_append_array(JsonVariant **v, JsonVariant *element) {
                 r = json_variant_new_array(&nv, (JsonVariant*[]) { element }, 1);
                 if (r < 0)
                         return r;
-        } else if (json_variant_n_ref(*v) == 1) {
+        } else if (json_variant_n_ref(*v) == 1 && !(*v)->in_arena) {
                 /* Let's bump the reference count on element. We can't do the realloc if we're appending *v
                  * to itself, or one of the objects embedded in *v to *v. If the reference count grows, we
-                 * need to fall back to the other method below. */
+                 * need to fall back to the other method below. Arenas can't be reallocated either, as they
+                 * contain more than just the array. */
 
                 _unused_ _cleanup_(json_variant_unrefp) JsonVariant *dummy = json_variant_ref(element);
                 if (json_variant_n_ref(*v) == 1) {
@@ -2487,14 +2648,16 @@ static int unhex_ucs2(const char *c, uint16_t *ret) {
         return 0;
 }
 
-static int json_parse_string(const char **p, char **ret) {
-        _cleanup_free_ char *s = NULL;
+static int json_parse_string(const char **p, char **buffer) {
         size_t n = 0;
         const char *c;
 
         assert(p);
         assert(*p);
-        assert(ret);
+        assert(buffer);
+
+        /* Unescapes the string at *p into *buffer, which is (re)allocated as needed. The buffer may be
+         * reused between calls, which saves allocations when tokenizing many strings in a row. */
 
         c = *p;
 
@@ -2504,8 +2667,22 @@ static int json_parse_string(const char **p, char **ret) {
         c++;
 
         for (;;) {
+                size_t k;
                 int len;
 
+                /* Copy runs of plain printable ASCII characters in one go, that's what strings consist of
+                 * almost always. Note that 'char' might be signed, hence non-ASCII bytes end the run too. */
+                for (k = 0; c[k] >= ' ' && c[k] < 0x7f && !IN_SET(c[k], '"', '\\'); k++)
+                        ;
+                if (k > 0) {
+                        if (!GREEDY_REALLOC(*buffer, n + k + 1))
+                                return -ENOMEM;
+
+                        memcpy(*buffer + n, c, k);
+                        n += k;
+                        c += k;
+                }
+
                 /* Check for EOF */
                 if (*c == 0)
                         return -EINVAL;
@@ -2519,16 +2696,12 @@ static int json_parse_string(const char **p, char **ret) {
                         return -EINVAL;
 
                 if (*c == '"') {
-                        if (!s) {
-                                s = strdup("");
-                                if (!s)
-                                        return -ENOMEM;
-                        } else
-                                s[n] = 0;
+                        if (!GREEDY_REALLOC(*buffer, n + 1))
+                                return -ENOMEM;
 
-                        *p = c + 1;
+                        (*buffer)[n] = 0;
 
-                        *ret = TAKE_PTR(s);
+                        *p = c + 1;
                         return JSON_TOKEN_STRING;
                 }
 
@@ -2561,11 +2734,11 @@ static int json_parse_string(const char **p, char **ret) {
 
                                 c += 5;
 
-                                if (!GREEDY_REALLOC(s, n + 5))
+                                if (!GREEDY_REALLOC(*buffer, n + 5))
                                         return -ENOMEM;
 
                                 if (!utf16_is_surrogate(x))
-                                        n += utf8_encode_unichar(s + n, (char32_t) x);
+                                        n += utf8_encode_unichar(*buffer + n, (char32_t) x);
                                 else if (utf16_is_trailing_surrogate(x))
                                         return -EINVAL;
                                 else {
@@ -2583,17 +2756,17 @@ static int json_parse_string(const char **p, char **ret) {
                                         if (!utf16_is_trailing_surrogate(y))
                                                 return -EINVAL;
 
-                                        n += utf8_encode_unichar(s + n, utf16_surrogate_pair_to_unichar(x, y));
+                                        n += utf8_encode_unichar(*buffer + n, utf16_surrogate_pair_to_unichar(x, y));
                                 }
 
                                 continue;
                         } else
                                 return -EINVAL;
 
-                        if (!GREEDY_REALLOC(s, n + 2))
+                        if (!GREEDY_REALLOC(*buffer, n + 2))
                                 return -ENOMEM;
 
-                        s[n++] = ch;
+                        (*buffer)[n++] = ch;
                         c ++;
                         continue;
                 }
@@ -2602,10 +2775,10 @@ static int json_parse_string(const char **p, char **ret) {
                 if (len < 0)
                         return len;
 
-                if (!GREEDY_REALLOC(s, n + len + 1))
+                if (!GREEDY_REALLOC(*buffer, n + len + 1))
                         return -ENOMEM;
 
-                memcpy(s + n, c, len);
+                memcpy(*buffer + n, c, len);
                 n += len;
                 c += len;
         }
@@ -2716,9 +2889,15 @@ static int json_parse_number(const char **p, JsonValue *ret) {
         }
 }
 
-int json_tokenize(
+enum {
+        STATE_NULL,
+        STATE_VALUE,
+        STATE_VALUE_POST,
+};
+
+static int json_tokenize_internal(
                 const char **p,
-                char **ret_string,
+                char **string_buffer, /* reused between calls, only written to for JSON_TOKEN_STRING */
                 JsonValue *ret_value,
                 unsigned *ret_line,   /* 'ret_line' returns the line at the beginning of this token */
                 unsigned *ret_column,
@@ -2731,15 +2910,9 @@ int json_tokenize(
         size_t n;
         int t, r;
 
-        enum {
-                STATE_NULL,
-                STATE_VALUE,
-                STATE_VALUE_POST,
-        };
-
         assert(p);
         assert(*p);
-        assert(ret_string);
+        assert(string_buffer);
         assert(ret_value);
         assert(ret_line);
         assert(ret_column);
@@ -2765,7 +2938,6 @@ int json_tokenize(
         start_column = *column;
 
         if (*c == 0) {
-                *ret_string = NULL;
                 *ret_value = JSON_VALUE_NULL;
                 r = JSON_TOKEN_END;
                 goto finish;
@@ -2801,7 +2973,7 @@ int json_tokenize(
 
                 } else if (*c == '"') {
 
-                        r = json_parse_string(&c, ret_string);
+                        r = json_parse_string(&c, string_buffer);
                         if (r < 0)
                                 return r;
 
@@ -2815,12 +2987,10 @@ int json_tokenize(
                         if (r < 0)
                                 return r;
 
-                        *ret_string = NULL;
                         *state = INT_TO_PTR(STATE_VALUE_POST);
                         goto finish;
 
                 } else if (startswith(c, "true")) {
-                        *ret_string = NULL;
                         ret_value->boolean = true;
                         c += 4;
                         *state = INT_TO_PTR(STATE_VALUE_POST);
@@ -2828,7 +2998,6 @@ int json_tokenize(
                         goto finish;
 
                 } else if (startswith(c, "false")) {
-                        *ret_string = NULL;
                         ret_value->boolean = false;
                         c += 5;
                         *state = INT_TO_PTR(STATE_VALUE_POST);
@@ -2836,7 +3005,6 @@ int json_tokenize(
                         goto finish;
 
                 } else if (startswith(c, "null")) {
-                        *ret_string = NULL;
                         *ret_value = JSON_VALUE_NULL;
                         c += 4;
                         *state = INT_TO_PTR(STATE_VALUE_POST);
@@ -2881,7 +3049,6 @@ int json_tokenize(
         }
 
 null_return:
-        *ret_string = NULL;
         *ret_value = JSON_VALUE_NULL;
 
 finish:
@@ -2894,6 +3061,29 @@ finish:
         return r;
 }
 
+int json_tokenize(
+                const char **p,
+                char **ret_string,
+                JsonValue *ret_value,
+                unsigned *ret_line,
+                unsigned *ret_column,
+                void **state,
+                unsigned *line,
+                unsigned *column) {
+
+        _cleanup_free_ char *buffer = NULL;
+        int r;
+
+        assert(ret_string);
+
+        r = json_tokenize_internal(p, &buffer, ret_value, ret_line, ret_column, state, line, column);
+        if (r < 0)
+                return r;
+
+        *ret_string = r == JSON_TOKEN_STRING ? TAKE_PTR(buffer) : NULL;
+        return r;
+}
+
 typedef enum JsonExpect {
         /* The following values are used by json_parse() */
         EXPECT_TOPLEVEL,
@@ -2927,6 +3117,683 @@ static void json_stack_release(JsonStack *s) {
         CLEANUP_ARRAY(s->elements, s->n_elements, json_variant_unref_many);
 }
 
+/* The tokenizer behind the arena parser: returns the document as a stream of events, and checks the grammar
+ * while doing so. */
+typedef enum JsonPullEvent {
+        JSON_PULL_END,
+        JSON_PULL_OBJECT_BEGIN,
+        JSON_PULL_OBJECT_END,
+        JSON_PULL_ARRAY_BEGIN,
+        JSON_PULL_ARRAY_END,
+        JSON_PULL_KEY,
+        JSON_PULL_STRING,
+        JSON_PULL_INTEGER,
+        JSON_PULL_UNSIGNED,
+        JSON_PULL_REAL,
+        JSON_PULL_BOOLEAN,
+        JSON_PULL_NULL,
+        _JSON_PULL_EVENT_MAX,
+        _JSON_PULL_EVENT_INVALID = -EINVAL,
+} JsonPullEvent;
+
+typedef struct JsonPullParser {
+        const char *input;      /* Where the tokenizer continues */
+        void *tokenizer_state;
+        unsigned line, column;
+        unsigned token_line, token_column;
+
+        JsonExpect *stack;
+        size_t n_stack;
+
+        int event;              /* The last event returned, or the error that ended parsing */
+        char *string;           /* Buffer for string tokens, reused for all of them */
+        JsonValue value;
+
+        bool sensitive;
+} JsonPullParser;
+
+static JsonPullParser *json_pull_parser_free(JsonPullParser *p) {
+        if (!p)
+                return NULL;
+
+        free(p->stack);
+
+        if (p->sensitive)
+                erase_and_free(p->string);
+        else
+                free(p->string);
+
+        return mfree(p);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(JsonPullParser*, json_pull_parser_free);
+
+static int json_pull_parser_new(JsonPullParser **ret, const char *input) {
+        _cleanup_(json_pull_parser_freep) JsonPullParser *p = NULL;
+
+        assert(ret);
+        assert(input);
+
+        p = new(JsonPullParser, 1);
+        if (!p)
+                return -ENOMEM;
+
+        *p = (JsonPullParser) {
+                .input = input,
+        };
+
+        p->stack = new(JsonExpect, 1);
+        if (!p->stack)
+                return -ENOMEM;
+
+        p->stack[p->n_stack++] = EXPECT_TOPLEVEL;
+
+        *ret = TAKE_PTR(p);
+        return 0;
+}
+
+static bool json_expect_value(JsonExpect e) {
+        return IN_SET(e, EXPECT_TOPLEVEL, EXPECT_OBJECT_VALUE, EXPECT_ARRAY_FIRST_ELEMENT, EXPECT_ARRAY_NEXT_ELEMENT);
+}
+
+static JsonExpect json_expect_after_value(JsonExpect e) {
+        if (e == EXPECT_TOPLEVEL)
+                return EXPECT_END;
+        if (e == EXPECT_OBJECT_VALUE)
+                return EXPECT_OBJECT_COMMA;
+
+        assert(IN_SET(e, EXPECT_ARRAY_FIRST_ELEMENT, EXPECT_ARRAY_NEXT_ELEMENT));
+        return EXPECT_ARRAY_COMMA;
+}
+
+static int json_pull_parser_step(JsonPullParser *p) {
+        int r;
+
+        assert(p);
+        assert(p->n_stack > 0);
+
+        for (;;) {
+                JsonExpect *current = p->stack + p->n_stack - 1;
+                int token;
+
+                token = json_tokenize_internal(&p->input, &p->string, &p->value, &p->token_line, &p->token_column, &p->tokenizer_state, &p->line, &p->column);
+                if (token < 0)
+                        return token;
+
+                switch (token) {
+
+                case JSON_TOKEN_END:
+                        if (*current != EXPECT_END)
+                                return -EINVAL;
+
+                        return JSON_PULL_END;
+
+                case JSON_TOKEN_COLON:
+                        if (*current != EXPECT_OBJECT_COLON)
+                                return -EINVAL;
+
+                        *current = EXPECT_OBJECT_VALUE;
+                        break;
+
+                case JSON_TOKEN_COMMA:
+                        if (*current == EXPECT_OBJECT_COMMA)
+                                *current = EXPECT_OBJECT_NEXT_KEY;
+                        else if (*current == EXPECT_ARRAY_COMMA)
+                                *current = EXPECT_ARRAY_NEXT_ELEMENT;
+                        else
+                                return -EINVAL;
+
+                        break;
+
+                case JSON_TOKEN_OBJECT_OPEN:
+                case JSON_TOKEN_ARRAY_OPEN:
+                        if (!json_expect_value(*current))
+                                return -EINVAL;
+
+                        /* Refuse too deep nesting, same as json_variant_new_array()/json_variant_new_object() */
+                        if (p->n_stack > DEPTH_MAX)
+                                return -ELNRNG;
+
+                        *current = json_expect_after_value(*current);
+
+                        if (!GREEDY_REALLOC(p->stack, p->n_stack + 1))
+                                return -ENOMEM;
+
+                        if (token == JSON_TOKEN_OBJECT_OPEN) {
+                                p->stack[p->n_stack++] = EXPECT_OBJECT_FIRST_KEY;
+                                return JSON_PULL_OBJECT_BEGIN;
+                        }
+
+                        p->stack[p->n_stack++] = EXPECT_ARRAY_FIRST_ELEMENT;
+                        return JSON_PULL_ARRAY_BEGIN;
+
+                case JSON_TOKEN_OBJECT_CLOSE:
+                        if (!IN_SET(*current, EXPECT_OBJECT_FIRST_KEY, EXPECT_OBJECT_COMMA))
+                                return -EINVAL;
+
+                        assert(p->n_stack > 1);
+                        p->n_stack--;
+                        return JSON_PULL_OBJECT_END;
+
+                case JSON_TOKEN_ARRAY_CLOSE:
+                        if (!IN_SET(*current, EXPECT_ARRAY_FIRST_ELEMENT, EXPECT_ARRAY_COMMA))
+                                return -EINVAL;
+
+                        assert(p->n_stack > 1);
+                        p->n_stack--;
+                        return JSON_PULL_ARRAY_END;
+
+                case JSON_TOKEN_STRING:
+                        if (IN_SET(*current, EXPECT_OBJECT_FIRST_KEY, EXPECT_OBJECT_NEXT_KEY)) {
+                                *current = EXPECT_OBJECT_COLON;
+                                return JSON_PULL_KEY;
+                        }
+
+                        if (!json_expect_value(*current))
+                                return -EINVAL;
+
+                        *current = json_expect_after_value(*current);
+                        return JSON_PULL_STRING;
+
+                case JSON_TOKEN_REAL:
+                case JSON_TOKEN_INTEGER:
+                case JSON_TOKEN_UNSIGNED:
+                case JSON_TOKEN_BOOLEAN:
+                case JSON_TOKEN_NULL:
+                        if (!json_expect_value(*current))
+                                return -EINVAL;
+
+                        *current = json_expect_after_value(*current);
+
+                        r = token == JSON_TOKEN_REAL     ? JSON_PULL_REAL :
+                            token == JSON_TOKEN_INTEGER  ? JSON_PULL_INTEGER :
+                            token == JSON_TOKEN_UNSIGNED ? JSON_PULL_UNSIGNED :
+                            token == JSON_TOKEN_BOOLEAN  ? JSON_PULL_BOOLEAN :
+                                                           JSON_PULL_NULL;
+                        return r;
+
+                default:
+                        assert_not_reached();
+                }
+        }
+}
+
+static int json_pull_parser_next(JsonPullParser *p) {
+        assert(p);
+
+        /* Errors are sticky, the tokenizer state is undefined afterwards */
+        if (p->event < 0)
+                return p->event;
+
+        return (p->event = json_pull_parser_step(p));
+}
+
+static JsonVariantType json_pull_event_to_type(int event) {
+        switch (event) {
+        case JSON_PULL_KEY:
+        case JSON_PULL_STRING:
+                return JSON_VARIANT_STRING;
+        case JSON_PULL_INTEGER:
+                return JSON_VARIANT_INTEGER;
+        case JSON_PULL_UNSIGNED:
+                return JSON_VARIANT_UNSIGNED;
+        case JSON_PULL_REAL:
+                return JSON_VARIANT_REAL;
+        case JSON_PULL_BOOLEAN:
+                return JSON_VARIANT_BOOLEAN;
+        case JSON_PULL_NULL:
+                return JSON_VARIANT_NULL;
+        default:
+                return _JSON_VARIANT_TYPE_INVALID;
+        }
+}
+
+/* When building a variant from the pull parser we first record the tokens of the whole object or array on a
+ * "tape", and count the elements of each container as well as the size of long strings. With that we know the
+ * exact memory the document needs, and can build all of it in a single allocation ("arena"), with no
+ * reallocation and copying of elements. */
+typedef struct JsonTapeEntry {
+        JsonPullEvent event;
+        unsigned line, column;
+        union {
+                JsonValue value;
+                struct {
+                        size_t offset;
+                        size_t length;
+                } string;
+                size_t n_elements;
+        };
+} JsonTapeEntry;
+
+typedef struct JsonTape {
+        JsonTapeEntry *entries;
+        size_t n_entries;
+
+        char *strings;
+        size_t n_strings;
+
+        size_t *open;           /* Entries of containers we haven't seen the end of yet */
+        size_t n_open;
+
+        size_t arena_size;
+        bool sensitive;
+} JsonTape;
+
+static void json_tape_done(JsonTape *t) {
+        assert(t);
+
+        free(t->entries);
+        free(t->open);
+
+        if (t->sensitive)
+                explicit_bzero_safe(t->strings, t->n_strings);
+        free(t->strings);
+}
+
+static size_t json_arena_string_size(size_t length) {
+        return ALIGN_TO(offsetof(JsonVariant, string) + length + 1, alignof(JsonVariant));
+}
+
+static size_t json_arena_container_size(JsonPullEvent event, size_t n_elements) {
+        size_t n = 1 + n_elements;
+
+        if (IN_SET(event, JSON_PULL_OBJECT_BEGIN, JSON_PULL_OBJECT_END))
+                n += json_object_index_slots(n_elements);
+
+        return n * sizeof(JsonVariant);
+}
+
+static int json_tape_record(JsonTape *t, JsonPullParser *p) {
+        int r;
+
+        assert(t);
+        assert(p);
+        assert(IN_SET(p->event, JSON_PULL_OBJECT_BEGIN, JSON_PULL_ARRAY_BEGIN));
+
+        for (r = p->event;; ) {
+                JsonTapeEntry *e;
+
+                if (!GREEDY_REALLOC(t->entries, t->n_entries + 1))
+                        return -ENOMEM;
+
+                e = t->entries + t->n_entries++;
+                *e = (JsonTapeEntry) {
+                        .event = r,
+                        .line = p->token_line,
+                        .column = p->token_column,
+                };
+
+                if (t->n_open > 0 && !IN_SET(r, JSON_PULL_OBJECT_END, JSON_PULL_ARRAY_END))
+                        t->entries[t->open[t->n_open - 1]].n_elements++;
+
+                switch (r) {
+
+                case JSON_PULL_OBJECT_BEGIN:
+                case JSON_PULL_ARRAY_BEGIN:
+                        if (!GREEDY_REALLOC(t->open, t->n_open + 1))
+                                return -ENOMEM;
+
+                        t->open[t->n_open++] = t->n_entries - 1;
+                        break;
+
+                case JSON_PULL_OBJECT_END:
+                case JSON_PULL_ARRAY_END: {
+                        size_t n;
+
+                        assert(t->n_open > 0);
+                        n = t->entries[t->open[--t->n_open]].n_elements;
+                        if (n > 0)
+                                t->arena_size += json_arena_container_size(r, n);
+
+                        if (t->n_open == 0)
+                                return 0;
+                        break;
+                }
+
+                case JSON_PULL_KEY:
+                case JSON_PULL_STRING: {
+                        size_t k = strlen(p->string);
+
+                        if (!GREEDY_REALLOC(t->strings, t->n_strings + k + 1))
+                                return -ENOMEM;
+
+                        memcpy(t->strings + t->n_strings, p->string, k + 1);
+                        e->string.offset = t->n_strings;
+                        e->string.length = k;
+                        t->n_strings += k + 1;
+
+                        if (k > INLINE_STRING_MAX)
+                                t->arena_size += json_arena_string_size(k);
+                        break;
+                }
+
+                default:
+                        e->value = p->value;
+                }
+
+                r = json_pull_parser_next(p);
+                if (r < 0)
+                        return r;
+        }
+}
+
+typedef struct JsonArena {
+        const JsonTape *tape;
+        size_t index;
+
+        JsonVariant *root;
+        uint8_t *next;
+
+        JsonSource *source;
+        bool sensitive;
+} JsonArena;
+
+static JsonVariant *json_arena_alloc(JsonArena *a, size_t size) {
+        JsonVariant *v;
+
+        assert(a);
+        assert(size % alignof(JsonVariant) == 0);
+
+        v = (JsonVariant*) a->next;
+        a->next += size;
+
+        assert(a->next <= (uint8_t*) a->root + a->tape->arena_size);
+        return v;
+}
+
+static void json_arena_init_variant(JsonArena *a, JsonVariant *v, JsonVariant *parent, JsonVariantType type, const JsonTapeEntry *e) {
+        assert(a);
+        assert(v);
+        assert(e);
+
+        *v = (JsonVariant) {
+                .source = json_source_ref(a->source),
+                .line = e->line,
+                .column = e->column,
+                .type = type,
+                .sensitive = a->sensitive,
+                .in_arena = true,
+        };
+
+        if (parent) {
+                v->is_embedded = true;
+                v->parent = parent;
+        } else
+                v->n_ref = 1;
+
+        if (a->source) {
+                a->source->max_line = MAX(a->source->max_line, e->line);
+                a->source->max_column = MAX(a->source->max_column, e->column);
+        }
+}
+
+static void json_arena_build_container(JsonArena *a, JsonVariant *v, JsonVariant *parent);
+
+static void json_arena_build_element(JsonArena *a, JsonVariant *w, JsonVariant *parent) {
+        const JsonTapeEntry *e;
+
+        assert(a);
+        assert(w);
+        assert(parent);
+
+        e = a->tape->entries + a->index;
+
+        switch (e->event) {
+
+        case JSON_PULL_OBJECT_BEGIN:
+        case JSON_PULL_ARRAY_BEGIN: {
+                JsonVariantType type = e->event == JSON_PULL_OBJECT_BEGIN ? JSON_VARIANT_OBJECT : JSON_VARIANT_ARRAY;
+
+                json_arena_init_variant(a, w, parent, type, e);
+                w->is_reference = true;
+
+                if (e->n_elements == 0) {
+                        w->reference = type == JSON_VARIANT_OBJECT ? JSON_VARIANT_MAGIC_EMPTY_OBJECT : JSON_VARIANT_MAGIC_EMPTY_ARRAY;
+                        a->index += 2; /* skip over the begin and end */
+                        return;
+                }
+
+                /* Nested containers are embedded into the root of the arena, since only that is reference
+                 * counted. */
+                w->reference = json_arena_alloc(a, json_arena_container_size(e->event, e->n_elements));
+                json_arena_build_container(a, w->reference, a->root);
+                return;
+        }
+
+        case JSON_PULL_KEY:
+        case JSON_PULL_STRING: {
+                const char *s = a->tape->strings + e->string.offset;
+                JsonVariant *c;
+
+                json_arena_init_variant(a, w, parent, JSON_VARIANT_STRING, e);
+
+                if (e->string.length <= INLINE_STRING_MAX) {
+                        memcpy(w->string, s, e->string.length + 1);
+                        break;
+                }
+
+                c = json_arena_alloc(a, json_arena_string_size(e->string.length));
+                json_arena_init_variant(a, c, a->root, JSON_VARIANT_STRING, e);
+                memcpy(c->string, s, e->string.length + 1);
+
+                w->is_reference = true;
+                w->reference = c;
+                break;
+        }
+
+        case JSON_PULL_REAL:
+                /* Same normalization as json_variant_new_real() */
+                switch (fpclassify(e->value.real)) {
+                case FP_NAN:
+                case FP_INFINITE:
+                        json_arena_init_variant(a, w, parent, JSON_VARIANT_NULL, e);
+                        break;
+                case FP_ZERO:
+                        json_arena_init_variant(a, w, parent, JSON_VARIANT_REAL, e);
+                        w->value.real = 0.0;
+                        break;
+                default:
+                        json_arena_init_variant(a, w, parent, JSON_VARIANT_REAL, e);
+                        w->value = e->value;
+                }
+                break;
+
+        default:
+                json_arena_init_variant(a, w, parent, json_pull_event_to_type(e->event), e);
+                w->value = e->value;
+        }
+
+        a->index++;
+}
+
+static void json_arena_build_container(JsonArena *a, JsonVariant *v, JsonVariant *parent) {
+        const JsonTapeEntry *e;
+        bool sorted = true, normalized = true;
+        const char *prev = NULL;
+
+        assert(a);
+        assert(v);
+
+        e = a->tape->entries + a->index++;
+        assert(IN_SET(e->event, JSON_PULL_OBJECT_BEGIN, JSON_PULL_ARRAY_BEGIN));
+        assert(e->n_elements > 0);
+
+        json_arena_init_variant(a, v, parent, e->event == JSON_PULL_OBJECT_BEGIN ? JSON_VARIANT_OBJECT : JSON_VARIANT_ARRAY, e);
+        v->n_elements = e->n_elements;
+
+        for (size_t i = 0; i < v->n_elements; i++) {
+                JsonVariant *w = v + 1 + i;
+                uint16_t d;
+
+                json_arena_build_element(a, w, v);
+
+                if (v->type == JSON_VARIANT_OBJECT && (i & 1) == 0) {
+                        const char *k = json_variant_string(w);
+
+                        if (prev && strcmp(k, prev) <= 0)
+                                sorted = normalized = false;
+
+                        prev = k;
+                } else if (!json_variant_is_normalized(json_variant_dereference(w)))
+                        normalized = false;
+
+                d = json_variant_depth(w);
+                if (d >= v->depth)
+                        v->depth = d + 1;
+        }
+
+        assert(IN_SET(a->tape->entries[a->index].event, JSON_PULL_OBJECT_END, JSON_PULL_ARRAY_END));
+        a->index++;
+
+        v->normalized = normalized;
+
+        if (v->type == JSON_VARIANT_OBJECT) {
+                v->sorted = sorted;
+                json_object_init_index_slot(v);
+        }
+}
+
+static int json_pull_parser_read_variant_internal(
+                JsonPullParser *p,
+                JsonSource *source,
+                JsonParseFlags flags,
+                JsonVariant **ret) {
+
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        _cleanup_(json_tape_done) JsonTape tape = {
+                .sensitive = FLAGS_SET(flags, JSON_PARSE_SENSITIVE),
+        };
+        unsigned line = p->token_line, column = p->token_column;
+        JsonArena arena;
+        int r;
+
+        assert(p);
+        assert(ret);
+
+        if (FLAGS_SET(flags, JSON_PARSE_SENSITIVE))
+                p->sensitive = true;
+
+        switch (p->event) {
+
+        case JSON_PULL_OBJECT_BEGIN:
+        case JSON_PULL_ARRAY_BEGIN:
+                r = json_tape_record(&tape, p);
+                if (r < 0)
+                        return r;
+
+                if (tape.arena_size == 0) {
+                        /* An empty object or array, there's a magic variant for that */
+                        assert(tape.n_entries == 2);
+
+                        if (tape.entries[0].event == JSON_PULL_OBJECT_BEGIN)
+                                r = json_variant_new_object(&v, NULL, 0);
+                        else
+                                r = json_variant_new_array(&v, NULL, 0);
+                        if (r < 0)
+                                return r;
+
+                        break;
+                }
+
+                arena = (JsonArena) {
+                        .tape = &tape,
+                        .source = source,
+                        .sensitive = tape.sensitive,
+                };
+
+                arena.root = malloc(tape.arena_size);
+                if (!arena.root)
+                        return -ENOMEM;
+
+                arena.next = (uint8_t*) arena.root;
+                (void) json_arena_alloc(&arena, json_arena_container_size(tape.entries[0].event, tape.entries[0].n_elements));
+                json_arena_build_container(&arena, arena.root, NULL);
+                assert(arena.next == (uint8_t*) arena.root + tape.arena_size);
+                assert(arena.index == tape.n_entries);
+
+                *ret = arena.root;
+                return 0;
+
+        case JSON_PULL_KEY:
+        case JSON_PULL_STRING:
+                r = json_variant_new_string(&v, p->string);
+                break;
+
+        case JSON_PULL_INTEGER:
+                r = json_variant_new_integer(&v, p->value.integer);
+                break;
+
+        case JSON_PULL_UNSIGNED:
+                r = json_variant_new_unsigned(&v, p->value.unsig);
+                break;
+
+        case JSON_PULL_REAL:
+                r = json_variant_new_real(&v, p->value.real);
+                break;
+
+        case JSON_PULL_BOOLEAN:
+                r = json_variant_new_boolean(&v, p->value.boolean);
+                break;
+
+        case JSON_PULL_NULL:
+                r = json_variant_new_null(&v);
+                break;
+
+        default:
+                return -EINVAL;
+        }
+        if (r < 0)
+                return r;
+
+        if (FLAGS_SET(flags, JSON_PARSE_SENSITIVE))
+                json_variant_sensitive(v);
+
+        r = json_variant_set_source(&v, source, line, column);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(v);
+        return 0;
+}
+
+static int json_parse_arena(
+                const char **input,
+                JsonSource *source,
+                JsonParseFlags flags,
+                JsonVariant **ret,
+                unsigned *line,
+                unsigned *column,
+                bool continue_end) {
+
+        _cleanup_(json_pull_parser_freep) JsonPullParser *p = NULL;
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        int r;
+
+        assert(input);
+        assert(ret);
+
+        r = json_pull_parser_new(&p, *input);
+        if (r < 0)
+                return r;
+
+        r = json_pull_parser_next(p);
+        if (r >= 0)
+                r = json_pull_parser_read_variant_internal(p, source, flags, &v);
+        if (r >= 0 && !continue_end)
+                r = json_pull_parser_next(p); /* Only JSON_PULL_END may follow */
+
+        if (line)
+                *line = p->line;
+        if (column)
+                *column = p->column;
+        if (r < 0)
+                return r;
+
+        *input = p->input;
+        *ret = TAKE_PTR(v);
+        return 0;
+}
+
 static int json_parse_internal(
                 const char **input,
                 JsonSource *source,
@@ -2939,6 +3806,7 @@ static int json_parse_internal(
         size_t n_stack = 1;
         unsigned line_buffer = 0, column_buffer = 0;
         void *tokenizer_state = NULL;
+        _cleanup_free_ char *string = NULL;
         JsonStack *stack = NULL;
         const char *p;
         int r;
@@ -2946,6 +3814,9 @@ static int json_parse_internal(
         assert_return(input, -EINVAL);
         assert_return(ret, -EINVAL);
 
+        if (FLAGS_SET(flags, JSON_PARSE_ARENA))
+                return json_parse_arena(input, source, flags, ret, line, column, continue_end);
+
         p = *input;
 
         if (!GREEDY_REALLOC(stack, n_stack))
@@ -2962,7 +3833,6 @@ static int json_parse_internal(
 
         for (;;) {
                 _cleanup_(json_variant_unrefp) JsonVariant *add = NULL;
-                _cleanup_free_ char *string = NULL;
                 unsigned line_token, column_token;
                 JsonStack *current;
                 JsonValue value;
@@ -2974,7 +3844,7 @@ static int json_parse_internal(
                 if (continue_end && current->expect == EXPECT_END)
                         goto done;
 
-                token = json_tokenize(&p, &string, &value, &line_token, &column_token, &tokenizer_state, line, column);
+                token = json_tokenize_internal(&p, &string, &value, &line_token, &column_token, &tokenizer_state, line, column);
                 if (token < 0) {
                         r = token;
                         goto finish;
@@ -4484,6 +5354,34 @@ static void *dispatch_userdata(const JsonDispatch *p, void *userdata) {
         return SIZE_TO_PTR(p->offset);
 }
 
+static const JsonDispatch **json_dispatch_match_fields(JsonVariant *v, const JsonDispatch table[]) {
+        _cleanup_free_ const JsonDispatch **matches = NULL;
+        size_t idx;
+
+        /* For objects with a hash index, find the table entry of each field by looking up the table entries
+         * in the object, instead of comparing every field with the whole table. Fields that don't get a
+         * match here (unknown ones, duplicates, and those that a catch-all entry applies to) are matched
+         * against the table linearly by the caller, so that the result is the same either way. */
+
+        v = json_variant_dereference(v);
+        if (!json_variant_is_regular(v) || !v->has_index_slot || v->sorted)
+                return NULL;
+
+        matches = new0(const JsonDispatch*, v->n_elements / 2);
+        if (!matches)
+                return NULL;
+
+        for (const JsonDispatch *p = table; p->name && p->name != POINTER_MAX; p++) {
+                if (json_object_index_find(v, p->name, &idx) <= 0)
+                        continue;
+
+                if (!matches[idx / 2])
+                        matches[idx / 2] = p;
+        }
+
+        return TAKE_PTR(matches);
+}
+
 int json_dispatch_full(
                 JsonVariant *v,
                 const JsonDispatch table[],
@@ -4491,6 +5389,7 @@ int json_dispatch_full(
                 JsonDispatchFlags flags,
                 void *userdata,
                 const char **reterr_bad_field) {
+        _cleanup_free_ const JsonDispatch **matches = NULL;
         size_t m;
         int r, done = 0;
         bool *found;
@@ -4513,6 +5412,8 @@ int json_dispatch_full(
 
         found = newa0(bool, m);
 
+        matches = json_dispatch_match_fields(v, table);
+
         size_t n = json_variant_elements(v);
         for (size_t i = 0; i < n; i += 2) {
                 JsonVariant *key, *value;
@@ -4521,10 +5422,13 @@ int json_dispatch_full(
                 assert_se(key = json_variant_by_index(v, i));
                 assert_se(value = json_variant_by_index(v, i+1));
 
-                for (p = table; p->name; p++)
-                        if (p->name == POINTER_MAX ||
-                            streq_ptr(json_variant_string(key), p->name))
-                                break;
+                if (matches && matches[i / 2])
+                        p = matches[i / 2];
+                else
+                        for (p = table; p->name; p++)
+                                if (p->name == POINTER_MAX ||
+                                    streq_ptr(json_variant_string(key), p->name))
+                                        break;
 
                 if (p->name) { /* Found a matching entry! 🙂 */
                         JsonDispatchFlags merged_flags;
@@ -4833,7 +5737,7 @@ int json_dispatch_strv(const char *name, JsonVariant *variant, JsonDispatchFlags
         }
 
         if (!json_variant_is_array(variant))
-                return json_log(variant, SYNTHETIC_ERRNO(EINVAL), flags, "JSON field '%s' is not an array.", strna(name));
+                return json_log(variant, flags, SYNTHETIC_ERRNO(EINVAL), "JSON field '%s' is not an array.", strna(name));
 
         JSON_VARIANT_ARRAY_FOREACH(e, variant) {
                 if (!json_variant_is_string(e))
@@ -231,6 +231,7 @@ int json_variant_normalize(JsonVariant **v);
 
 typedef enum JsonParseFlags {
         JSON_PARSE_SENSITIVE = 1 << 0, /* mark variant as "sensitive", i.e. something containing secret key material or such */
+        JSON_PARSE_ARENA     = 1 << 1, /* build the whole document in a single allocation, released at once */
 } JsonParseFlags;
 
 int json_parse_with_source(const char *string, const char *source, JsonParseFlags flags, JsonVariant **ret, unsigned *ret_line, unsigned *ret_column);
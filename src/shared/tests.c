@@ -22,6 +22,7 @@
 #include "fs-util.h"
 #include "log.h"
 #include "namespace-util.h"
+#include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
 #include "random-util.h"
@@ -112,6 +113,16 @@ bool slow_tests_enabled(void) {
         return SYSTEMD_SLOW_TESTS_DEFAULT;
 }
 
+unsigned test_size_from_args(unsigned n, unsigned n_slow) {
+        unsigned k;
+
+        if (saved_argc < 2)
+                return slow_tests_enabled() ? n_slow : n;
+
+        assert_se(safe_atou(saved_argv[1], &k) >= 0);
+        return k;
+}
+
 void test_setup_logging(int level) {
         log_set_max_level(level);
         log_parse_environment();
@@ -304,6 +315,16 @@ int enter_cgroup_root(char **ret_cgroup) {
         return enter_cgroup(ret_cgroup, false);
 }
 
+int setup_manager_test(char **ret_runtime_dir) {
+        assert(ret_runtime_dir);
+
+        if (enter_cgroup_subroot(NULL) == -ENOMEDIUM)
+                return log_tests_skipped("cgroupfs not available");
+
+        assert_se(*ret_runtime_dir = setup_fake_runtime_dir());
+        return EXIT_SUCCESS;
+}
+
 const char *ci_environment(void) {
         /* We return a string because we might want to provide multiple bits of information later on: not
          * just the general CI environment type, but also whether we're sanitizing or not, etc. The caller is
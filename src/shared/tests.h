@@ -24,9 +24,16 @@ static inline bool manager_errno_skip_test(int r) {
 char* setup_fake_runtime_dir(void);
 int enter_cgroup_subroot(char **ret_cgroup);
 int enter_cgroup_root(char **ret_cgroup);
+/* Prepares for running the service manager in a test: enters a cgroup of its own and sets up a runtime
+ * directory, which the caller needs to remove. Returns EXIT_SUCCESS, or EXIT_TEST_SKIP if there are no
+ * cgroups to use, for use as or in the intro of DEFINE_TEST_MAIN_WITH_INTRO(). */
+int setup_manager_test(char **ret_runtime_dir);
 int get_testdata_dir(const char *suffix, char **ret);
 const char* get_catalog_dir(void);
 bool slow_tests_enabled(void);
+/* Returns the number of objects a test creates: the number passed as first argument, so that it can be used
+ * as benchmark, or else n, or n_slow if slow tests are enabled. */
+unsigned test_size_from_args(unsigned n, unsigned n_slow);
 void test_setup_logging(int level);
 
 #define log_tests_skipped(fmt, ...)                                     \
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include <sys/auxv.h>
+#include <sys/stat.h>
 
 #include "conf-files.h"
 #include "dirent-util.h"
@@ -8,10 +9,14 @@
 #include "errno-util.h"
 #include "fd-util.h"
 #include "format-util.h"
+#include "io-util.h"
 #include "missing_syscall.h"
 #include "parse-util.h"
+#include "process-util.h"
+#include "pthread-util.h"
 #include "set.h"
 #include "socket-util.h"
+#include "stat-util.h"
 #include "strv.h"
 #include "user-record-nss.h"
 #include "user-util.h"
@@ -21,6 +26,169 @@
 
 DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(link_hash_ops, void, trivial_hash_func, trivial_compare_func, Varlink, varlink_unref);
 
+/* Connections that completed their query are not closed right away, but kept around while an enumeration
+ * is in progress, so that the lookups done along the way (think getgrent() looking up the members of each
+ * group) can reuse them, instead of paying for connect() and peer authentication on the service side each
+ * time. Once the last enumeration ends, all of them are closed. Hence no connection outlives the burst of
+ * lookups it was kept for, even though there's no event loop here that could expire them on a timer. */
+#define USERDB_POOL_MAX 8U
+#define USERDB_POOL_IDLE_USEC (5 * USEC_PER_SEC)
+
+typedef struct UserDBPooledLink {
+        char *path;
+        Varlink *link;
+        struct stat st; /* of the socket, to recognize it again */
+        usec_t since;
+} UserDBPooledLink;
+
+static pthread_mutex_t userdb_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static UserDBPooledLink userdb_pool[USERDB_POOL_MAX] = {};
+static unsigned userdb_pool_n_bursts = 0;
+static pid_t userdb_pool_pid = 0;
+
+static bool userdb_pooled_link_is_ours(UserDBPooledLink *p) {
+        struct stat st;
+
+        assert(p);
+        assert(p->link);
+
+        /* We hand out no references to pooled connections, but NSS lives in other programs' address space:
+         * if the program closes all fds it doesn't know (think: before exec()ing something), the fd number
+         * might be taken by something else by now. Never read, write or close it then. */
+        if (fstat(varlink_get_fd(p->link), &st) < 0)
+                return false;
+
+        return stat_inode_same(&st, &p->st);
+}
+
+static void userdb_pooled_link_done(UserDBPooledLink *p) {
+        assert(p);
+
+        if (p->link && !userdb_pooled_link_is_ours(p))
+                (void) varlink_forget_fd(p->link);
+
+        p->path = mfree(p->path);
+        p->link = varlink_unref(p->link);
+        p->st = (struct stat) {};
+        p->since = 0;
+}
+
+static void userdb_pool_check_fork(void) {
+        /* Never share a connection with a forked off child, replies would end up in random processes */
+        if (userdb_pool_pid == getpid_cached())
+                return;
+
+        FOREACH_ARRAY(p, userdb_pool, ELEMENTSOF(userdb_pool))
+                userdb_pooled_link_done(p);
+
+        userdb_pool_pid = getpid_cached();
+}
+
+static void userdb_pool_begin_burst(void) {
+        _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *_l = pthread_mutex_lock_assert(&userdb_pool_mutex);
+
+        userdb_pool_check_fork();
+
+        userdb_pool_n_bursts++;
+}
+
+static void userdb_pool_end_burst(void) {
+        _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *_l = pthread_mutex_lock_assert(&userdb_pool_mutex);
+
+        userdb_pool_check_fork();
+
+        assert(userdb_pool_n_bursts > 0);
+        if (--userdb_pool_n_bursts > 0)
+                return;
+
+        FOREACH_ARRAY(p, userdb_pool, ELEMENTSOF(userdb_pool))
+                userdb_pooled_link_done(p);
+}
+
+static Varlink* userdb_pool_take(const char *path) {
+        usec_t n = now(CLOCK_MONOTONIC);
+
+        assert(path);
+
+        _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *_l = pthread_mutex_lock_assert(&userdb_pool_mutex);
+
+        userdb_pool_check_fork();
+
+        FOREACH_ARRAY(p, userdb_pool, ELEMENTSOF(userdb_pool)) {
+                if (!p->link || !streq(p->path, path))
+                        continue;
+
+                /* The service might have closed the connection on its end in the meantime. An idle
+                 * connection must never become readable, hence anything showing up on it means the
+                 * connection is going away. */
+                if (usec_sub_unsigned(n, p->since) > USERDB_POOL_IDLE_USEC ||
+                    !userdb_pooled_link_is_ours(p) ||
+                    fd_wait_for_event(varlink_get_fd(p->link), POLLIN, 0) != 0) {
+                        userdb_pooled_link_done(p);
+                        continue;
+                }
+
+                p->path = mfree(p->path);
+                return TAKE_PTR(p->link);
+        }
+
+        return NULL;
+}
+
+static void userdb_pool_put(Varlink *link) {
+        _cleanup_free_ char *path = NULL;
+        UserDBPooledLink *slot = NULL;
+        struct stat st;
+        const char *d;
+
+        assert(link);
+
+        if (varlink_is_idle(link) <= 0 || varlink_get_fd(link) < 0)
+                return;
+
+        /* We use the socket path as description, see userdb_connect() */
+        d = varlink_get_description(link);
+        if (!d)
+                return;
+
+        if (fstat(varlink_get_fd(link), &st) < 0)
+                return;
+
+        path = strdup(d);
+        if (!path)
+                return;
+
+        _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *_l = pthread_mutex_lock_assert(&userdb_pool_mutex);
+
+        userdb_pool_check_fork();
+
+        /* Outside of enumerations connections are closed right away, see above */
+        if (userdb_pool_n_bursts == 0)
+                return;
+
+        varlink_detach_event(link);
+        varlink_set_userdata(link, NULL);
+
+        /* Take a free slot, or evict the connection that has been idle the longest */
+        FOREACH_ARRAY(p, userdb_pool, ELEMENTSOF(userdb_pool)) {
+                if (!p->link) {
+                        slot = p;
+                        break;
+                }
+
+                if (!slot || p->since < slot->since)
+                        slot = p;
+        }
+
+        userdb_pooled_link_done(slot);
+        *slot = (UserDBPooledLink) {
+                .path = TAKE_PTR(path),
+                .link = varlink_ref(link),
+                .st = st,
+                .since = now(CLOCK_MONOTONIC),
+        };
+}
+
 typedef enum LookupWhat {
         LOOKUP_USER,
         LOOKUP_GROUP,
@@ -32,12 +200,14 @@ struct UserDBIterator {
         LookupWhat what;
         UserDBFlags flags;
         Set *links;
+        Set *idle_links;                          /* connections that completed their query, for reuse */
         bool nss_covered:1;
         bool nss_iterating:1;
         bool dropin_covered:1;
         bool synthesize_root:1;
         bool synthesize_nobody:1;
         bool nss_systemd_blocked:1;
+        bool pool_burst:1;                        /* whether this is an enumeration keeping the pool alive */
         char **dropins;
         size_t current_dropin;
         int error;
@@ -53,10 +223,20 @@ struct UserDBIterator {
 };
 
 UserDBIterator* userdb_iterator_free(UserDBIterator *iterator) {
+        Varlink *link;
+
         if (!iterator)
                 return NULL;
 
         set_free(iterator->links);
+
+        SET_FOREACH(link, iterator->idle_links)
+                userdb_pool_put(link);
+        set_free(iterator->idle_links);
+
+        if (iterator->pool_burst)
+                userdb_pool_end_burst();
+
         strv_free(iterator->dropins);
 
         switch (iterator->what) {
@@ -121,6 +301,15 @@ static UserDBIterator* userdb_iterator_new(LookupWhat what, UserDBFlags flags) {
         return i;
 }
 
+static void userdb_iterator_begin_burst(UserDBIterator *iterator) {
+        assert(iterator);
+        assert(!iterator->pool_burst);
+
+        /* Enumerations are what the lookups that can reuse pooled connections happen during */
+        userdb_pool_begin_burst();
+        iterator->pool_burst = true;
+}
+
 static int userdb_iterator_block_nss_systemd(UserDBIterator *iterator) {
         int r;
 
@@ -335,7 +524,13 @@ finish:
                 iterator->error = -r;
 
         assert_se(set_remove(iterator->links, link) == link);
-        link = varlink_unref(link);
+
+        /* If the connection itself is still fine, let's keep it around for later lookups */
+        if (error_id && STR_IN_SET(error_id, VARLINK_ERROR_DISCONNECTED, VARLINK_ERROR_TIMEOUT, VARLINK_ERROR_PROTOCOL))
+                link = varlink_unref(link);
+        else if (set_ensure_consume(&iterator->idle_links, &link_hash_ops, link) < 0)
+                log_debug("Failed to keep finished varlink connection around, closing.");
+
         return 0;
 }
 
@@ -353,9 +548,12 @@ static int userdb_connect(
         assert(path);
         assert(method);
 
-        r = varlink_connect_address(&vl, path);
-        if (r < 0)
-                return log_debug_errno(r, "Unable to connect to %s: %m", path);
+        vl = userdb_pool_take(path);
+        if (!vl) {
+                r = varlink_connect_address(&vl, path);
+                if (r < 0)
+                        return log_debug_errno(r, "Unable to connect to %s: %m", path);
+        }
 
         varlink_set_userdata(vl, iterator);
 
@@ -723,6 +921,8 @@ int userdb_all(UserDBFlags flags, UserDBIterator **ret) {
         if (!iterator)
                 return -ENOMEM;
 
+        userdb_iterator_begin_burst(iterator);
+
         qr = userdb_start_query(iterator, "io.systemd.UserDatabase.GetUserRecord", true, NULL, flags);
 
         if (!FLAGS_SET(flags, USERDB_EXCLUDE_NSS) && (qr < 0 || !iterator->nss_covered)) {
@@ -993,6 +1193,8 @@ int groupdb_all(UserDBFlags flags, UserDBIterator **ret) {
         if (!iterator)
                 return -ENOMEM;
 
+        userdb_iterator_begin_burst(iterator);
+
         qr = userdb_start_query(iterator, "io.systemd.UserDatabase.GetGroupRecord", true, NULL, flags);
 
         if (!FLAGS_SET(flags, USERDB_EXCLUDE_NSS) && (qr < 0 || !iterator->nss_covered)) {
@@ -1254,6 +1456,8 @@ int membershipdb_all(UserDBFlags flags, UserDBIterator **ret) {
         if (!iterator)
                 return -ENOMEM;
 
+        userdb_iterator_begin_burst(iterator);
+
         qr = userdb_start_query(iterator, "io.systemd.UserDatabase.GetMemberships", true, NULL, flags);
 
         if (!FLAGS_SET(flags, USERDB_EXCLUDE_NSS) && (qr < 0 || !iterator->nss_covered)) {
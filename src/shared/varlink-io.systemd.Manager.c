@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "varlink-io.systemd.Manager.h"
+
+/* This is PID1's read-only introspection interface, the Varlink counterpart of the query methods of the
+ * org.freedesktop.systemd1.Manager D-Bus interface. */
+
+static VARLINK_DEFINE_STRUCT_TYPE(
+                UnitProperties,
+                VARLINK_DEFINE_FIELD(name, VARLINK_STRING, 0),
+                VARLINK_DEFINE_FIELD(properties, VARLINK_OBJECT, 0));
+
+static VARLINK_DEFINE_METHOD(
+                GetUnitsProperties,
+                VARLINK_DEFINE_INPUT(patterns, VARLINK_STRING, VARLINK_NULLABLE|VARLINK_ARRAY),
+                VARLINK_DEFINE_INPUT(properties, VARLINK_STRING, VARLINK_NULLABLE|VARLINK_ARRAY),
+                VARLINK_DEFINE_OUTPUT_BY_TYPE(units, UnitProperties, VARLINK_ARRAY));
+
+/* The accounting data of a unit, as also exposed by the D-Bus properties of the same names. Counters whose
+ * accounting is turned off or that aren't available for other reasons are left out. */
+static VARLINK_DEFINE_STRUCT_TYPE(
+                UnitAccounting,
+                VARLINK_DEFINE_FIELD(name, VARLINK_STRING, 0),
+                VARLINK_DEFINE_FIELD(memoryCurrent, VARLINK_INT, VARLINK_NULLABLE),
+                VARLINK_DEFINE_FIELD(memoryAvailable, VARLINK_INT, VARLINK_NULLABLE),
+                VARLINK_DEFINE_FIELD(memoryPeak, VARLINK_INT, VARLINK_NULLABLE),
+                VARLINK_DEFINE_FIELD(memorySwapCurrent, VARLINK_INT, VARLINK_NULLABLE),
+                VARLINK_DEFINE_FIELD(memorySwapPeak, VARLINK_INT, VARLINK_NULLABLE),
+                VARLINK_DEFINE_FIELD(memoryZSwapCurrent, VARLINK_INT, VARLINK_NULLABLE),
+                VARLINK_DEFINE_FIELD(tasksCurrent, VARLINK_INT, VARLINK_NULLABLE),
+                VARLINK_DEFINE_FIELD(cpuUsageNSec, VARLINK_INT, VARLINK_NULLABLE),
+                VARLINK_DEFINE_FIELD(ioReadBytes, VARLINK_INT, VARLINK_NULLABLE),
+                VARLINK_DEFINE_FIELD(ioWriteBytes, VARLINK_INT, VARLINK_NULLABLE),
+                VARLINK_DEFINE_FIELD(ioReadOperations, VARLINK_INT, VARLINK_NULLABLE),
+                VARLINK_DEFINE_FIELD(ioWriteOperations, VARLINK_INT, VARLINK_NULLABLE),
+                VARLINK_DEFINE_FIELD(ipIngressBytes, VARLINK_INT, VARLINK_NULLABLE),
+                VARLINK_DEFINE_FIELD(ipIngressPackets, VARLINK_INT, VARLINK_NULLABLE),
+                VARLINK_DEFINE_FIELD(ipEgressBytes, VARLINK_INT, VARLINK_NULLABLE),
+                VARLINK_DEFINE_FIELD(ipEgressPackets, VARLINK_INT, VARLINK_NULLABLE));
+
+static VARLINK_DEFINE_METHOD(
+                GetUnitsAccounting,
+                VARLINK_DEFINE_INPUT(patterns, VARLINK_STRING, VARLINK_NULLABLE|VARLINK_ARRAY),
+                VARLINK_DEFINE_OUTPUT_BY_TYPE(units, UnitAccounting, VARLINK_ARRAY));
+
+static VARLINK_DEFINE_STRUCT_TYPE(
+                JobMetrics,
+                VARLINK_DEFINE_FIELD(id, VARLINK_INT, 0),
+                VARLINK_DEFINE_FIELD(type, VARLINK_STRING, 0),
+                VARLINK_DEFINE_FIELD(state, VARLINK_STRING, 0),
+                /* How long the job waited before it started running, or has been waiting so far */
+                VARLINK_DEFINE_FIELD(waitingUSec, VARLINK_INT, 0),
+                /* How long the job has been running so far, if it is */
+                VARLINK_DEFINE_FIELD(runningUSec, VARLINK_INT, VARLINK_NULLABLE));
+
+static VARLINK_DEFINE_STRUCT_TYPE(
+                UnitMetrics,
+                VARLINK_DEFINE_FIELD(name, VARLINK_STRING, 0),
+                VARLINK_DEFINE_FIELD(loadState, VARLINK_STRING, 0),
+                VARLINK_DEFINE_FIELD(activeState, VARLINK_STRING, 0),
+                VARLINK_DEFINE_FIELD(subState, VARLINK_STRING, 0),
+                /* Only for services */
+                VARLINK_DEFINE_FIELD(nRestarts, VARLINK_INT, VARLINK_NULLABLE),
+                /* How long the last completed activation took, from leaving the inactive state until
+                 * entering the active state */
+                VARLINK_DEFINE_FIELD(activationUSec, VARLINK_INT, VARLINK_NULLABLE),
+                VARLINK_DEFINE_FIELD_BY_TYPE(job, JobMetrics, VARLINK_NULLABLE),
+                /* Only for units with a cgroup, and unless turned off in the request */
+                VARLINK_DEFINE_FIELD_BY_TYPE(accounting, UnitAccounting, VARLINK_NULLABLE));
+
+/* Streams one reply per unit. Requires the "more" flag. The units are reported on in batches, each taken in
+ * one event loop iteration, the next one once the client read the replies of the previous one. */
+static VARLINK_DEFINE_METHOD(
+                ListUnitMetrics,
+                VARLINK_DEFINE_INPUT(patterns, VARLINK_STRING, VARLINK_NULLABLE|VARLINK_ARRAY),
+                VARLINK_DEFINE_INPUT(accounting, VARLINK_BOOL, VARLINK_NULLABLE),
+                /* CLOCK_REALTIME of when the data of the unit was taken, the same for all units of a batch */
+                VARLINK_DEFINE_OUTPUT(timestamp, VARLINK_INT, 0),
+                /* Not set if no unit matched */
+                VARLINK_DEFINE_OUTPUT_BY_TYPE(unit, UnitMetrics, VARLINK_NULLABLE));
+
+static VARLINK_DEFINE_ERROR(BusNotAvailable);
+
+VARLINK_DEFINE_INTERFACE(
+                io_systemd_Manager,
+                "io.systemd.Manager",
+                &vl_method_GetUnitsProperties,
+                &vl_type_UnitProperties,
+                &vl_method_GetUnitsAccounting,
+                &vl_type_UnitAccounting,
+                &vl_method_ListUnitMetrics,
+                &vl_type_UnitMetrics,
+                &vl_type_JobMetrics,
+                &vl_error_BusNotAvailable);
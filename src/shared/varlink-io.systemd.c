@@ -12,9 +12,16 @@ static VARLINK_DEFINE_ERROR(
                 System,
                 VARLINK_DEFINE_FIELD(errno, VARLINK_INT, 0));
 
+/* Switches the connection to a different wire encoding, see varlink_negotiate_encoding() */
+static VARLINK_DEFINE_METHOD(
+                SetEncoding,
+                VARLINK_DEFINE_INPUT(encoding, VARLINK_STRING, 0),
+                VARLINK_DEFINE_OUTPUT(encoding, VARLINK_STRING, 0));
+
 VARLINK_DEFINE_INTERFACE(
                 io_systemd,
                 "io.systemd",
+                &vl_method_SetEncoding,
                 &vl_error_Disconnected,
                 &vl_error_TimedOut,
                 &vl_error_Protocol,
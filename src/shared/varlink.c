@@ -2,19 +2,24 @@
 
 #include <malloc.h>
 #include <poll.h>
+#include <sys/eventfd.h>
 
 #include <sd-daemon.h>
 
 #include "alloc-util.h"
+#include "cpu-set-util.h"
 #include "errno-util.h"
 #include "fd-util.h"
 #include "glyph-util.h"
 #include "hashmap.h"
 #include "io-util.h"
 #include "iovec-util.h"
+#include "json-cbor.h"
 #include "list.h"
+#include "missing_threads.h"
 #include "path-util.h"
 #include "process-util.h"
+#include "pthread-util.h"
 #include "selinux-util.h"
 #include "serialize.h"
 #include "set.h"
@@ -24,6 +29,7 @@
 #include "strv.h"
 #include "time-util.h"
 #include "umask-util.h"
+#include "unaligned.h"
 #include "user-util.h"
 #include "varlink.h"
 #include "varlink-internal.h"
@@ -96,6 +102,7 @@ typedef struct VarlinkJsonQueueItem VarlinkJsonQueueItem;
 struct VarlinkJsonQueueItem {
         LIST_FIELDS(VarlinkJsonQueueItem, queue);
         JsonVariant *data;
+        VarlinkEncoding encoding; /* the encoding in effect when the message was enqueued */
         size_t n_fds;
         int fds[];
 };
@@ -133,6 +140,8 @@ struct Varlink {
                           * at most. */
         unsigned n_pending;
 
+        VarlinkEncoding encoding;
+
         int fd;
 
         char *input_buffer; /* valid data starts at input_buffer_index, ends at input_buffer_index+input_buffer_size */
@@ -167,6 +176,7 @@ struct Varlink {
         size_t n_pushed_fds;
 
         VarlinkReply reply_callback;
+        VarlinkDrained drained_callback;
 
         JsonVariant *current;
         VarlinkSymbol *current_method;
@@ -214,8 +224,36 @@ struct VarlinkServerSocket {
         LIST_FIELDS(VarlinkServerSocket, sockets);
 };
 
+#define VARLINK_SERVER_WORKER_THREADS_MAX 64U
+
+typedef struct VarlinkServerWorker {
+        VarlinkServer *server;  /* not a reference */
+
+        pthread_t thread;
+        sd_event *event;
+        sd_event_source *handoff_event_source;
+        int handoff_fds[2];     /* VarlinkServerHandoff records, closing the write side stops the worker */
+} VarlinkServerWorker;
+
+/* Sent from the accepting thread to a worker, small enough to be written atomically to a pipe */
+typedef struct VarlinkServerHandoff {
+        int fd;
+        bool ucred_acquired;
+        struct ucred ucred;
+} VarlinkServerHandoff;
+
+assert_cc(sizeof(VarlinkServerHandoff) <= PIPE_BUF);
+
+static thread_local VarlinkServerWorker *varlink_server_current_worker = NULL;
+
+static bool varlink_server_called_from_worker(VarlinkServer *s) {
+        assert(s);
+
+        return varlink_server_current_worker && varlink_server_current_worker->server == s;
+}
+
 struct VarlinkServer {
-        unsigned n_ref;
+        unsigned n_ref;                /* Modified atomically, see varlink_server_ref() */
         VarlinkServerFlags flags;
 
         LIST_HEAD(VarlinkServerSocket, sockets);
@@ -229,6 +267,7 @@ struct VarlinkServer {
         sd_event *event;
         int64_t event_priority;
 
+        pthread_mutex_t mutex;         /* Protects n_connections, by_uid, idle_event_fd and shutdown_requested */
         unsigned n_connections;
         Hashmap *by_uid;               /* UID_TO_PTR(uid) → UINT_TO_PTR(n_connections) */
 
@@ -239,6 +278,15 @@ struct VarlinkServer {
         unsigned connections_per_uid_max;
 
         bool exit_on_idle;
+
+        /* Only used with VARLINK_SERVER_THREADED */
+        unsigned n_worker_threads;
+        VarlinkServerWorker **workers;
+        size_t n_workers;
+        size_t next_worker;
+        int idle_event_fd;             /* Poked by workers when the last connection went away */
+        sd_event_source *idle_event_source;
+        bool shutdown_requested;       /* Set by workers, see varlink_server_shutdown() */
 };
 
 typedef struct VarlinkCollectContext {
@@ -271,6 +319,13 @@ static const char* const varlink_state_table[_VARLINK_STATE_MAX] = {
 
 DEFINE_PRIVATE_STRING_TABLE_LOOKUP_TO_STRING(varlink_state, VarlinkState);
 
+static const char* const varlink_encoding_table[_VARLINK_ENCODING_MAX] = {
+        [VARLINK_ENCODING_JSON] = "json",
+        [VARLINK_ENCODING_CBOR] = "cbor",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(varlink_encoding, VarlinkEncoding);
+
 #define varlink_log_errno(v, error, fmt, ...)                           \
         log_debug_errno(error, "%s: " fmt, varlink_description(v), ##__VA_ARGS__)
 
@@ -304,7 +359,7 @@ static VarlinkJsonQueueItem *varlink_json_queue_item_free(VarlinkJsonQueueItem *
         return mfree(q);
 }
 
-static VarlinkJsonQueueItem *varlink_json_queue_item_new(JsonVariant *m, const int fds[], size_t n_fds) {
+static VarlinkJsonQueueItem *varlink_json_queue_item_new(JsonVariant *m, VarlinkEncoding encoding, const int fds[], size_t n_fds) {
         VarlinkJsonQueueItem *q;
 
         assert(m);
@@ -316,6 +371,7 @@ static VarlinkJsonQueueItem *varlink_json_queue_item_new(JsonVariant *m, const i
 
         *q = (VarlinkJsonQueueItem) {
                 .data = json_variant_ref(m),
+                .encoding = encoding,
                 .n_fds = n_fds,
         };
 
@@ -931,6 +987,57 @@ static int varlink_read(Varlink *v) {
         return 1;
 }
 
+static int varlink_parse_message_cbor(Varlink *v) {
+        const char *begin;
+        size_t sz;
+        int r;
+
+        assert(v);
+
+        /* Each CBOR message is prefixed by its size, see varlink_format_cbor() */
+        if (v->input_buffer_size < sizeof(uint32_t)) {
+                v->input_buffer_unscanned = 0;
+                return 0;
+        }
+
+        begin = v->input_buffer + v->input_buffer_index;
+
+        sz = unaligned_read_le32(begin);
+        if (sz > VARLINK_BUFFER_MAX - sizeof(uint32_t)) {
+                v->input_buffer_index = v->input_buffer_size = v->input_buffer_unscanned = 0;
+                return varlink_log_errno(v, SYNTHETIC_ERRNO(EBADMSG), "Incoming CBOR message too large, refusing.");
+        }
+
+        if (v->input_buffer_size - sizeof(uint32_t) < sz) {
+                v->input_buffer_unscanned = 0;
+                return 0;
+        }
+
+        r = json_parse_cbor(begin + sizeof(uint32_t), sz, &v->current);
+        if (r < 0) {
+                v->input_buffer_index = v->input_buffer_size = v->input_buffer_unscanned = 0;
+                return varlink_log_errno(v, r, "Failed to parse CBOR: %m");
+        }
+
+        if (DEBUG_LOGGING) {
+                _cleanup_free_ char *text = NULL;
+
+                (void) json_variant_format(v->current, 0, &text);
+                varlink_log(v, "New incoming message (%zu bytes CBOR): %s", sz, strna(text));
+        }
+
+        sz += sizeof(uint32_t);
+        v->input_buffer_size -= sz;
+
+        if (v->input_buffer_size == 0)
+                v->input_buffer_index = 0;
+        else
+                v->input_buffer_index += sz;
+
+        v->input_buffer_unscanned = v->input_buffer_size;
+        return 1;
+}
+
 static int varlink_parse_message(Varlink *v) {
         const char *e, *begin;
         size_t sz;
@@ -946,6 +1053,9 @@ static int varlink_parse_message(Varlink *v) {
         assert(v->input_buffer_unscanned <= v->input_buffer_size);
         assert(v->input_buffer_index + v->input_buffer_size <= MALLOC_SIZEOF_SAFE(v->input_buffer));
 
+        if (v->encoding == VARLINK_ENCODING_CBOR)
+                return varlink_parse_message_cbor(v);
+
         begin = v->input_buffer + v->input_buffer_index;
 
         e = memchr(begin + v->input_buffer_size - v->input_buffer_unscanned, 0, v->input_buffer_unscanned);
@@ -960,7 +1070,8 @@ static int varlink_parse_message(Varlink *v) {
                                                             * This may produce a non-printable journal entry if the message
                                                             * is invalid. We may also expose privileged information. */
 
-        r = json_parse(begin, 0, &v->current, NULL, NULL);
+        /* Messages are parsed into a single allocation, they are short-lived and released as a whole */
+        r = json_parse(begin, JSON_PARSE_ARENA, &v->current, NULL, NULL);
         if (r < 0) {
                 /* If we encounter a parse failure flush all data. We cannot possibly recover from this,
                  * hence drop all buffered data now. */
@@ -1037,6 +1148,29 @@ static int varlink_dispatch_disconnect(Varlink *v) {
         return 1;
 }
 
+static int varlink_dispatch_drained(Varlink *v) {
+        VarlinkDrained callback;
+        int r;
+
+        assert(v);
+
+        if (!v->drained_callback)
+                return 0;
+        if (!VARLINK_STATE_IS_ALIVE(v->state) || v->write_disconnected)
+                return 0;
+        if (v->output_buffer_size > 0 || v->output_queue)
+                return 0;
+
+        /* The callback is called once only, it may bind itself again if it queued more output */
+        callback = TAKE_PTR(v->drained_callback);
+
+        r = callback(v, v->userdata);
+        if (r < 0)
+                log_debug_errno(r, "Drained callback returned error, ignoring: %m");
+
+        return 1;
+}
+
 static int varlink_sanitize_parameters(JsonVariant **v) {
         int r;
 
@@ -1237,6 +1371,45 @@ static int generic_method_get_interface_description(
                                            JSON_BUILD_PAIR_STRING("description", text)));
 }
 
+static int generic_method_set_encoding(
+                Varlink *link,
+                JsonVariant *parameters,
+                VarlinkMethodFlags flags,
+                void *userdata) {
+
+        static const struct JsonDispatch dispatch_table[] = {
+                { "encoding", JSON_VARIANT_STRING, json_dispatch_const_string, 0, JSON_MANDATORY },
+                {}
+        };
+        const char *name = NULL;
+        VarlinkEncoding encoding;
+        int r;
+
+        assert(link);
+
+        r = json_dispatch(parameters, dispatch_table, 0, &name);
+        if (r < 0)
+                return r;
+
+        encoding = varlink_encoding_from_string(name);
+        if (encoding < 0)
+                return varlink_errorb(link, VARLINK_ERROR_INVALID_PARAMETER,
+                                      JSON_BUILD_OBJECT(JSON_BUILD_PAIR_STRING("parameter", "encoding")));
+
+        /* Without a reply the client cannot know when to switch, hence ignore this in oneway mode */
+        if (FLAGS_SET(flags, VARLINK_METHOD_ONEWAY))
+                return 0;
+
+        /* The reply is still sent in the old encoding (queue entries remember the encoding they were
+         * enqueued with), everything after it in the new one, in both directions. */
+        r = varlink_replyb(link, JSON_BUILD_OBJECT(JSON_BUILD_PAIR_STRING("encoding", name)));
+        if (r < 0)
+                return r;
+
+        link->encoding = encoding;
+        return 0;
+}
+
 static int varlink_dispatch_method(Varlink *v) {
         _cleanup_(json_variant_unrefp) JsonVariant *parameters = NULL;
         VarlinkMethodFlags flags = 0;
@@ -1320,6 +1493,8 @@ static int varlink_dispatch_method(Varlink *v) {
                         callback = generic_method_get_info;
                 else if (streq(method, "org.varlink.service.GetInterfaceDescription"))
                         callback = generic_method_get_interface_description;
+                else if (streq(method, "io.systemd.SetEncoding"))
+                        callback = generic_method_set_encoding;
         }
 
         if (callback) {
@@ -1415,6 +1590,10 @@ int varlink_process(Varlink *v) {
         if (r != 0)
                 goto finish;
 
+        r = varlink_dispatch_drained(v);
+        if (r != 0)
+                goto finish;
+
         r = varlink_dispatch_reply(v);
         if (r < 0)
                 varlink_log_errno(v, r, "Reply dispatch failed: %m");
@@ -1652,29 +1831,44 @@ int varlink_flush(Varlink *v) {
         return ret;
 }
 
-static void varlink_detach_server(Varlink *v) {
-        VarlinkServer *saved_server;
-        assert(v);
+static unsigned uncount_connection(VarlinkServer *server, const struct ucred *ucred, bool ucred_acquired) {
+        assert(server);
+        assert(ucred);
 
-        if (!v->server)
-                return;
+        _unused_ _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *m = pthread_mutex_lock_assert(&server->mutex);
 
-        if (v->server->by_uid &&
-            v->ucred_acquired &&
-            uid_is_valid(v->ucred.uid)) {
+        if (server->by_uid &&
+            ucred_acquired &&
+            uid_is_valid(ucred->uid)) {
                 unsigned c;
 
-                c = PTR_TO_UINT(hashmap_get(v->server->by_uid, UID_TO_PTR(v->ucred.uid)));
+                c = PTR_TO_UINT(hashmap_get(server->by_uid, UID_TO_PTR(ucred->uid)));
                 assert(c > 0);
 
                 if (c == 1)
-                        (void) hashmap_remove(v->server->by_uid, UID_TO_PTR(v->ucred.uid));
+                        (void) hashmap_remove(server->by_uid, UID_TO_PTR(ucred->uid));
                 else
-                        (void) hashmap_replace(v->server->by_uid, UID_TO_PTR(v->ucred.uid), UINT_TO_PTR(c - 1));
+                        (void) hashmap_replace(server->by_uid, UID_TO_PTR(ucred->uid), UINT_TO_PTR(c - 1));
         }
 
-        assert(v->server->n_connections > 0);
-        v->server->n_connections--;
+        assert(server->n_connections > 0);
+        server->n_connections--;
+
+        /* Wake up the accepting thread, so that it can check whether to exit on idle */
+        if (server->n_connections == 0 && server->idle_event_fd >= 0)
+                (void) eventfd_write(server->idle_event_fd, 1);
+
+        return server->n_connections;
+}
+
+static void varlink_detach_server(Varlink *v) {
+        VarlinkServer *saved_server;
+        assert(v);
+
+        if (!v->server)
+                return;
+
+        (void) uncount_connection(v->server, &v->ucred, v->ucred_acquired);
 
         /* If this is a connection associated to a server, then let's disconnect the server and the
          * connection from each other. This drops the dangling reference that connect_callback() set up. But
@@ -1685,8 +1879,13 @@ static void varlink_detach_server(Varlink *v) {
         if (saved_server->disconnect_callback)
                 saved_server->disconnect_callback(saved_server, v, saved_server->userdata);
 
-        varlink_server_test_exit_on_idle(saved_server);
-        varlink_server_unref(saved_server);
+        /* In threaded mode we run in a worker thread here, and must not touch the server's event loop. The
+         * idle check is done by the accepting thread then, see above. We also didn't take a reference on
+         * the server in that case. */
+        if (!FLAGS_SET(saved_server->flags, VARLINK_SERVER_THREADED)) {
+                varlink_server_test_exit_on_idle(saved_server);
+                varlink_server_unref(saved_server);
+        }
         varlink_unref(v);
 }
 
@@ -1708,6 +1907,18 @@ int varlink_close(Varlink *v) {
         return 1;
 }
 
+int varlink_forget_fd(Varlink *v) {
+        assert_return(v, -EINVAL);
+
+        /* Disconnects without closing the fd. For connections whose fd was closed behind our back, and whose
+         * fd number might hence refer to something else entirely by now. */
+
+        varlink_detach_event_sources(v);
+        v->fd = -EBADF;
+
+        return varlink_close(v);
+}
+
 Varlink* varlink_close_unref(Varlink *v) {
         if (!v)
                 return NULL;
@@ -1778,6 +1989,88 @@ static int varlink_format_json(Varlink *v, JsonVariant *m) {
         return 0;
 }
 
+static void* varlink_output_extend(Varlink *v, size_t n) {
+        char *p;
+
+        assert(v);
+
+        /* Makes room for n more bytes at the end of the output buffer, and returns a pointer to them */
+
+        if (v->output_buffer_index == 0) {
+                if (!GREEDY_REALLOC(v->output_buffer, v->output_buffer_size + n))
+                        return NULL;
+        } else {
+                char *b;
+
+                b = new(char, v->output_buffer_size + n);
+                if (!b)
+                        return NULL;
+
+                memcpy(b, v->output_buffer + v->output_buffer_index, v->output_buffer_size);
+
+                free_and_replace(v->output_buffer, b);
+                v->output_buffer_index = 0;
+        }
+
+        p = v->output_buffer + v->output_buffer_size;
+        v->output_buffer_size += n;
+
+        return p;
+}
+
+static int varlink_format_cbor(Varlink *v, JsonVariant *m) {
+        _cleanup_(erase_and_freep) void *data = NULL;
+        size_t size;
+        uint8_t *p;
+        int r;
+
+        assert(v);
+        assert(m);
+
+        r = json_variant_format_cbor(m, &data, &size);
+        if (r < 0)
+                return r;
+
+        if (size > VARLINK_BUFFER_MAX - sizeof(uint32_t) ||
+            v->output_buffer_size + sizeof(uint32_t) + size > VARLINK_BUFFER_MAX)
+                return -ENOBUFS;
+
+        if (DEBUG_LOGGING) {
+                _cleanup_(erase_and_freep) char *text = NULL;
+
+                (void) json_variant_format(m, 0, &text);
+                varlink_log(v, "Sending message (%zu bytes CBOR): %s", size, strna(text));
+        }
+
+        /* CBOR data may contain NUL bytes, hence we can't use NUL as message separator. Instead, prefix
+         * each message with its size. */
+        p = varlink_output_extend(v, sizeof(uint32_t) + size);
+        if (!p)
+                return -ENOMEM;
+
+        unaligned_write_le32(p, size);
+        memcpy(p + sizeof(uint32_t), data, size);
+
+        if (json_variant_is_sensitive(m))
+                v->output_buffer_sensitive = true; /* Propagate sensitive flag */
+
+        return 0;
+}
+
+static int varlink_format_message(Varlink *v, JsonVariant *m, VarlinkEncoding encoding) {
+        switch (encoding) {
+
+        case VARLINK_ENCODING_JSON:
+                return varlink_format_json(v, m);
+
+        case VARLINK_ENCODING_CBOR:
+                return varlink_format_cbor(v, m);
+
+        default:
+                assert_not_reached();
+        }
+}
+
 static int varlink_enqueue_json(Varlink *v, JsonVariant *m) {
         VarlinkJsonQueueItem *q;
 
@@ -1787,10 +2080,10 @@ static int varlink_enqueue_json(Varlink *v, JsonVariant *m) {
         /* If there are no file descriptors to be queued and no queue entries yet we can shortcut things and
          * append this entry directly to the output buffer */
         if (v->n_pushed_fds == 0 && !v->output_queue)
-                return varlink_format_json(v, m);
+                return varlink_format_message(v, m, v->encoding);
 
         /* Otherwise add a queue entry for this */
-        q = varlink_json_queue_item_new(m, v->pushed_fds, v->n_pushed_fds);
+        q = varlink_json_queue_item_new(m, v->encoding, v->pushed_fds, v->n_pushed_fds);
         if (!q)
                 return -ENOMEM;
 
@@ -1822,7 +2115,7 @@ static int varlink_format_queue(Varlink *v) {
                                 return -ENOMEM;
                 }
 
-                r = varlink_format_json(v, q->data);
+                r = varlink_format_message(v, q->data, q->encoding);
                 if (r < 0)
                         return r;
 
@@ -1842,6 +2135,46 @@ static int varlink_format_queue(Varlink *v) {
         return 0;
 }
 
+int varlink_negotiate_encoding(Varlink *v, VarlinkEncoding encoding) {
+        JsonVariant *reply = NULL;
+        const char *error_id = NULL;
+        int r;
+
+        assert_return(v, -EINVAL);
+        assert_return(encoding >= 0 && encoding < _VARLINK_ENCODING_MAX, -EINVAL);
+
+        if (v->encoding == encoding)
+                return 0;
+
+        /* Asks the server to switch the wire encoding. Both sides switch right after the reply. Since
+         * varlink_call() insists on an idle connection no other message can be in flight at that
+         * point, hence there's no ambiguity about which encoding a message is in. Returns -EOPNOTSUPP if
+         * the server doesn't know the encoding (or the switching mechanism), in which case the connection
+         * remains fully usable with the old encoding. */
+
+        r = varlink_callb(v, "io.systemd.SetEncoding", &reply, &error_id, NULL,
+                          JSON_BUILD_OBJECT(JSON_BUILD_PAIR_STRING("encoding", varlink_encoding_to_string(encoding))));
+        if (r < 0)
+                return r;
+        if (error_id) {
+                if (STR_IN_SET(error_id, VARLINK_ERROR_METHOD_NOT_FOUND, VARLINK_ERROR_INVALID_PARAMETER))
+                        return varlink_log_errno(v, SYNTHETIC_ERRNO(EOPNOTSUPP),
+                                                 "Server does not support %s encoding.", varlink_encoding_to_string(encoding));
+
+                return varlink_log_errno(v, SYNTHETIC_ERRNO(EBADE), "Failed to switch encoding: %s", error_id);
+        }
+
+        v->encoding = encoding;
+        varlink_log(v, "Switched to %s encoding.", varlink_encoding_to_string(encoding));
+        return 1;
+}
+
+VarlinkEncoding varlink_get_encoding(Varlink *v) {
+        assert_return(v, _VARLINK_ENCODING_INVALID);
+
+        return v->encoding;
+}
+
 int varlink_send(Varlink *v, const char *method, JsonVariant *parameters) {
         _cleanup_(json_variant_unrefp) JsonVariant *m = NULL;
         int r;
@@ -2108,52 +2441,21 @@ int varlink_callb(
         return varlink_call(v, method, parameters, ret_parameters, ret_error_id, ret_flags);
 }
 
-static void varlink_collect_context_free(VarlinkCollectContext *cc) {
-        assert(cc);
-
-        json_variant_unref(cc->parameters);
-        free((char *)cc->error_id);
-}
-
-static int collect_callback(
-                Varlink *v,
-                JsonVariant *parameters,
-                const char *error_id,
-                VarlinkReplyFlags flags,
-                void *userdata) {
-
-        VarlinkCollectContext *context = ASSERT_PTR(userdata);
-        int r;
-
-        assert(v);
-
-        context->flags = flags;
-        /* If we hit an error, we will drop all collected replies and just return the error_id and flags in varlink_collect() */
-        if (error_id) {
-                context->error_id = error_id;
-                return 0;
-        }
-
-        r = json_variant_append_array(&context->parameters, parameters);
-        if (r < 0)
-                return varlink_log_errno(v, r, "Failed to append JSON object to array: %m");
-
-        return 1;
-}
-
-int varlink_collect(
+int varlink_call_many(
                 Varlink *v,
                 const char *method,
-                JsonVariant *parameters,
-                JsonVariant **ret_parameters,
-                const char **ret_error_id,
-                VarlinkReplyFlags *ret_flags) {
+                JsonVariant * const *parameters,
+                size_t n,
+                JsonVariant **ret_replies) {
 
-        _cleanup_(varlink_collect_context_free) VarlinkCollectContext context = {};
+        JsonVariant **replies = NULL;
+        size_t n_replies = 0, n_enqueued = 0;
         int r;
 
         assert_return(v, -EINVAL);
         assert_return(method, -EINVAL);
+        assert_return(parameters || n == 0, -EINVAL);
+        assert_return(n <= UINT_MAX, -E2BIG);
 
         if (v->state == VARLINK_DISCONNECTED)
                 return varlink_log_errno(v, SYNTHETIC_ERRNO(ENOTCONN), "Not connected.");
@@ -2162,28 +2464,190 @@ int varlink_collect(
 
         assert(v->n_pending == 0); /* n_pending can't be > 0 if we are in VARLINK_IDLE_CLIENT state */
 
-        /* If there was still a reply pinned from a previous call, now it's the time to get rid of it, so
-         * that we can assign a new reply shortly. */
+        /* Like varlink_call(), but pipelines all calls: all method calls are written to the connection in
+         * one go, and the replies are then collected in order, so that we pay the round trip only once
+         * instead of once per call. Replies are returned as an array of reply objects, one per call, each
+         * carrying either a "parameters" or an "error" field. */
+
         varlink_clear_current(v);
 
-        r = varlink_bind_reply(v, collect_callback);
-        if (r < 0)
-                return varlink_log_errno(v, r, "Failed to bind collect callback");
+        if (n == 0) {
+                if (ret_replies) {
+                        r = json_variant_new_array(ret_replies, NULL, 0);
+                        if (r < 0)
+                                return r;
+                }
+                return 1;
+        }
 
-        varlink_set_userdata(v, &context);
-        r = varlink_observe(v, method, parameters);
-        if (r < 0)
-                return varlink_log_errno(v, r, "Failed to collect varlink method: %m");
+        CLEANUP_ARRAY(replies, n_replies, json_variant_unref_many);
 
-        while (v->state == VARLINK_AWAITING_REPLY_MORE) {
+        replies = new(JsonVariant*, n);
+        if (!replies)
+                return log_oom_debug();
 
-                r = varlink_process(v);
+        FOREACH_ARRAY(p, parameters, n) {
+                _cleanup_(json_variant_unrefp) JsonVariant *m = NULL;
+                JsonVariant *q = *p;
+
+                r = varlink_sanitize_parameters(&q);
                 if (r < 0)
-                        return r;
+                        goto fail;
 
-                /* If we get an error from any of the replies, return immediately with just the error_id and flags*/
-                if (context.error_id) {
-                        if (ret_error_id)
+                r = json_build(&m, JSON_BUILD_OBJECT(
+                                               JSON_BUILD_PAIR("method", JSON_BUILD_STRING(method)),
+                                               JSON_BUILD_PAIR("parameters", JSON_BUILD_VARIANT(q))));
+                if (r < 0)
+                        goto fail;
+
+                r = varlink_enqueue_json(v, m);
+                if (r < 0)
+                        goto fail;
+
+                n_enqueued++;
+        }
+
+        varlink_set_state(v, VARLINK_CALLING);
+        v->n_pending = n;
+        v->timestamp = now(CLOCK_MONOTONIC);
+
+        while (v->n_pending > 0) {
+
+                while (v->state == VARLINK_CALLING) {
+
+                        r = varlink_process(v);
+                        if (r < 0)
+                                return r;
+                        if (r > 0)
+                                continue;
+
+                        r = varlink_wait(v, USEC_INFINITY);
+                        if (r < 0)
+                                return r;
+                }
+
+                switch (v->state) {
+
+                case VARLINK_CALLED:
+                        assert(v->current);
+
+                        replies[n_replies++] = json_variant_ref(v->current);
+                        varlink_clear_current(v);
+
+                        /* Each reply re-arms the timeout, as if each call had been issued individually */
+                        v->n_pending--;
+                        varlink_set_state(v, v->n_pending > 0 ? VARLINK_CALLING : VARLINK_IDLE_CLIENT);
+                        v->timestamp = now(CLOCK_MONOTONIC);
+                        break;
+
+                case VARLINK_PENDING_DISCONNECT:
+                case VARLINK_DISCONNECTED:
+                        return varlink_log_errno(v, SYNTHETIC_ERRNO(ECONNRESET), "Connection was closed.");
+
+                case VARLINK_PENDING_TIMEOUT:
+                        return varlink_log_errno(v, SYNTHETIC_ERRNO(ETIME), "Connection timed out.");
+
+                default:
+                        assert_not_reached();
+                }
+        }
+
+        if (ret_replies) {
+                r = json_variant_new_array(ret_replies, replies, n_replies);
+                if (r < 0)
+                        return varlink_log_errno(v, r, "Failed to build reply array: %m");
+        }
+
+        return 1;
+
+fail:
+        /* Whatever made it into the output queue already is a regular asynchronous method call now, whose
+         * replies are delivered to the reply callback, if there is any. */
+        if (n_enqueued > 0) {
+                varlink_set_state(v, VARLINK_AWAITING_REPLY);
+                v->n_pending = n_enqueued;
+                v->timestamp = now(CLOCK_MONOTONIC);
+        }
+
+        return varlink_log_errno(v, r, "Failed to enqueue method calls: %m");
+}
+
+static void varlink_collect_context_free(VarlinkCollectContext *cc) {
+        assert(cc);
+
+        json_variant_unref(cc->parameters);
+        free((char *)cc->error_id);
+}
+
+static int collect_callback(
+                Varlink *v,
+                JsonVariant *parameters,
+                const char *error_id,
+                VarlinkReplyFlags flags,
+                void *userdata) {
+
+        VarlinkCollectContext *context = ASSERT_PTR(userdata);
+        int r;
+
+        assert(v);
+
+        context->flags = flags;
+        /* If we hit an error, we will drop all collected replies and just return the error_id and flags in varlink_collect() */
+        if (error_id) {
+                context->error_id = error_id;
+                return 0;
+        }
+
+        r = json_variant_append_array(&context->parameters, parameters);
+        if (r < 0)
+                return varlink_log_errno(v, r, "Failed to append JSON object to array: %m");
+
+        return 1;
+}
+
+int varlink_collect(
+                Varlink *v,
+                const char *method,
+                JsonVariant *parameters,
+                JsonVariant **ret_parameters,
+                const char **ret_error_id,
+                VarlinkReplyFlags *ret_flags) {
+
+        _cleanup_(varlink_collect_context_free) VarlinkCollectContext context = {};
+        int r;
+
+        assert_return(v, -EINVAL);
+        assert_return(method, -EINVAL);
+
+        if (v->state == VARLINK_DISCONNECTED)
+                return varlink_log_errno(v, SYNTHETIC_ERRNO(ENOTCONN), "Not connected.");
+        if (v->state != VARLINK_IDLE_CLIENT)
+                return varlink_log_errno(v, SYNTHETIC_ERRNO(EBUSY), "Connection busy.");
+
+        assert(v->n_pending == 0); /* n_pending can't be > 0 if we are in VARLINK_IDLE_CLIENT state */
+
+        /* If there was still a reply pinned from a previous call, now it's the time to get rid of it, so
+         * that we can assign a new reply shortly. */
+        varlink_clear_current(v);
+
+        r = varlink_bind_reply(v, collect_callback);
+        if (r < 0)
+                return varlink_log_errno(v, r, "Failed to bind collect callback");
+
+        varlink_set_userdata(v, &context);
+        r = varlink_observe(v, method, parameters);
+        if (r < 0)
+                return varlink_log_errno(v, r, "Failed to collect varlink method: %m");
+
+        while (v->state == VARLINK_AWAITING_REPLY_MORE) {
+
+                r = varlink_process(v);
+                if (r < 0)
+                        return r;
+
+                /* If we get an error from any of the replies, return immediately with just the error_id and flags*/
+                if (context.error_id) {
+                        if (ret_error_id)
                                 *ret_error_id = TAKE_PTR(context.error_id);
                         if (ret_flags)
                                 *ret_flags = context.flags;
@@ -2523,6 +2987,17 @@ int varlink_bind_reply(Varlink *v, VarlinkReply callback) {
         return 0;
 }
 
+int varlink_bind_drained(Varlink *v, VarlinkDrained callback) {
+        assert_return(v, -EINVAL);
+
+        if (callback && v->drained_callback && callback != v->drained_callback)
+                return varlink_log_errno(v, SYNTHETIC_ERRNO(EBUSY), "A different callback was already set.");
+
+        v->drained_callback = callback;
+
+        return 0;
+}
+
 void* varlink_set_userdata(Varlink *v, void *userdata) {
         void *old;
 
@@ -2610,6 +3085,12 @@ int varlink_set_description(Varlink *v, const char *description) {
         return free_and_strdup(&v->description, description);
 }
 
+const char* varlink_get_description(Varlink *v) {
+        assert_return(v, NULL);
+
+        return v->description;
+}
+
 static int io_callback(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         Varlink *v = ASSERT_PTR(userdata);
 
@@ -2929,8 +3410,10 @@ int varlink_server_new(VarlinkServer **ret, VarlinkServerFlags flags) {
         *s = (VarlinkServer) {
                 .n_ref = 1,
                 .flags = flags,
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
                 .connections_max = varlink_server_connections_max(NULL),
                 .connections_per_uid_max = varlink_server_connections_per_uid_max(NULL),
+                .idle_event_fd = -EBADF,
         };
 
         r = varlink_server_add_interface_many(
@@ -2950,7 +3433,12 @@ static VarlinkServer* varlink_server_destroy(VarlinkServer *s) {
         if (!s)
                 return NULL;
 
+        /* Worker threads need to be joined first, which they cannot do for themselves, hence the last
+         * reference to a threaded server must not be dropped from a method handler. */
+        assert(!varlink_server_called_from_worker(s));
+
         varlink_server_shutdown(s);
+        varlink_server_detach_event(s);
 
         while ((m = hashmap_steal_first_key(s->methods)))
                 free(m);
@@ -2960,14 +3448,30 @@ static VarlinkServer* varlink_server_destroy(VarlinkServer *s) {
         hashmap_free(s->symbols);
         hashmap_free(s->by_uid);
 
-        sd_event_unref(s->event);
-
         free(s->description);
 
         return mfree(s);
 }
 
-DEFINE_TRIVIAL_REF_UNREF_FUNC(VarlinkServer, varlink_server, varlink_server_destroy);
+/* Method handlers running in worker threads might take references, hence count atomically */
+VarlinkServer* varlink_server_ref(VarlinkServer *s) {
+        if (!s)
+                return NULL;
+
+        assert_se(__atomic_add_fetch(&s->n_ref, 1, __ATOMIC_RELAXED) >= 2);
+        return s;
+}
+
+VarlinkServer* varlink_server_unref(VarlinkServer *s) {
+        if (!s)
+                return NULL;
+
+        assert(s->n_ref > 0);
+        if (__atomic_sub_fetch(&s->n_ref, 1, __ATOMIC_ACQ_REL) > 0)
+                return NULL;
+
+        return varlink_server_destroy(s);
+}
 
 static int validate_connection(VarlinkServer *server, const struct ucred *ucred) {
         int allowed = -1;
@@ -3018,8 +3522,6 @@ static int count_connection(VarlinkServer *server, const struct ucred *ucred) {
         assert(server);
         assert(ucred);
 
-        server->n_connections++;
-
         if (FLAGS_SET(server->flags, VARLINK_SERVER_ACCOUNT_UID)) {
                 r = hashmap_ensure_allocated(&server->by_uid, NULL);
                 if (r < 0)
@@ -3035,47 +3537,40 @@ static int count_connection(VarlinkServer *server, const struct ucred *ucred) {
                         return log_debug_errno(r, "Failed to increment counter in UID hash table: %m");
         }
 
+        server->n_connections++;
         return 0;
 }
 
-int varlink_server_add_connection(VarlinkServer *server, int fd, Varlink **ret) {
+static int varlink_server_link_connection(
+                VarlinkServer *server,
+                sd_event *event,
+                int fd,
+                const struct ucred *ucred,
+                bool ucred_acquired,
+                Varlink **ret) {
+
         _cleanup_(varlink_unrefp) Varlink *v = NULL;
-        struct ucred ucred = UCRED_INVALID;
-        bool ucred_acquired;
         int r;
 
-        assert_return(server, -EINVAL);
-        assert_return(fd >= 0, -EBADF);
-
-        if ((server->flags & (VARLINK_SERVER_ROOT_ONLY|VARLINK_SERVER_ACCOUNT_UID)) != 0) {
-                r = getpeercred(fd, &ucred);
-                if (r < 0)
-                        return varlink_server_log_errno(server, r, "Failed to acquire peer credentials of incoming socket, refusing: %m");
-
-                ucred_acquired = true;
+        assert(server);
+        assert(fd >= 0);
+        assert(ucred);
 
-                r = validate_connection(server, &ucred);
-                if (r < 0)
-                        return r;
-                if (r == 0)
-                        return -EPERM;
-        } else
-                ucred_acquired = false;
+        /* Sets up the connection object for a connection that has already been accounted for. On failure the
+         * fd is left untouched, but the accounting is undone. */
 
         r = varlink_new(&v);
-        if (r < 0)
+        if (r < 0) {
+                (void) uncount_connection(server, ucred, ucred_acquired);
                 return varlink_server_log_errno(server, r, "Failed to allocate connection object: %m");
-
-        r = count_connection(server, &ucred);
-        if (r < 0)
-                return r;
+        }
 
         v->fd = fd;
         if (server->flags & VARLINK_SERVER_INHERIT_USERDATA)
                 v->userdata = server->userdata;
 
         if (ucred_acquired) {
-                v->ucred = ucred;
+                v->ucred = *ucred;
                 v->ucred_acquired = true;
         }
 
@@ -3085,14 +3580,16 @@ int varlink_server_add_connection(VarlinkServer *server, int fd, Varlink **ret)
 
         /* Link up the server and the connection, and take reference in both directions. Note that the
          * reference on the connection is left dangling. It will be dropped when the connection is closed,
-         * which happens in varlink_close(), including in the event loop quit callback. */
-        v->server = varlink_server_ref(server);
+         * which happens in varlink_close(), including in the event loop quit callback. Connections served by
+         * worker threads don't pin the server though: destroying the server stops the workers, which closes
+         * their connections first. That way the server is always destroyed in the thread owning it. */
+        v->server = FLAGS_SET(server->flags, VARLINK_SERVER_THREADED) ? server : varlink_server_ref(server);
         varlink_ref(v);
 
         varlink_set_state(v, VARLINK_IDLE_SERVER);
 
-        if (server->event) {
-                r = varlink_attach_event(v, server->event, server->event_priority);
+        if (event) {
+                r = varlink_attach_event(v, event, server->event_priority);
                 if (r < 0) {
                         varlink_log_errno(v, r, "Failed to attach new connection: %m");
                         v->fd = -EBADF; /* take the fd out of the connection again */
@@ -3107,6 +3604,286 @@ int varlink_server_add_connection(VarlinkServer *server, int fd, Varlink **ret)
         return 0;
 }
 
+static void varlink_server_call_connect_callback(VarlinkServer *s, Varlink *v) {
+        int r;
+
+        assert(s);
+        assert(v);
+
+        if (!s->connect_callback)
+                return;
+
+        r = s->connect_callback(s, v, s->userdata);
+        if (r < 0) {
+                varlink_log_errno(v, r, "Connection callback returned error, disconnecting client: %m");
+                varlink_close(v);
+        }
+}
+
+static VarlinkServerWorker* varlink_server_worker_free(VarlinkServerWorker *w) {
+        if (!w)
+                return NULL;
+
+        sd_event_source_disable_unref(w->handoff_event_source);
+        sd_event_unref(w->event);
+        safe_close_pair(w->handoff_fds);
+
+        return mfree(w);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(VarlinkServerWorker*, varlink_server_worker_free);
+
+static void varlink_server_worker_adopt(VarlinkServerWorker *w, const VarlinkServerHandoff *h) {
+        VarlinkServer *s = ASSERT_PTR(w->server);
+        Varlink *v;
+        int r;
+
+        assert(h);
+
+        r = varlink_server_link_connection(s, w->event, h->fd, &h->ucred, h->ucred_acquired, &v);
+        if (r < 0) {
+                safe_close(h->fd);
+                return;
+        }
+
+        varlink_server_call_connect_callback(s, v);
+}
+
+static int varlink_server_worker_handoff(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        VarlinkServerWorker *w = ASSERT_PTR(userdata);
+
+        for (;;) {
+                VarlinkServerHandoff h;
+                ssize_t n;
+
+                n = read(fd, &h, sizeof(h));
+                if (n < 0) {
+                        if (ERRNO_IS_TRANSIENT(errno))
+                                return 0;
+
+                        log_debug_errno(errno, "Failed to read from varlink worker handoff pipe, exiting: %m");
+                        return sd_event_exit(w->event, -errno);
+                }
+                if (n == 0) /* The write side got closed, i.e. we shall exit */
+                        return sd_event_exit(w->event, 0);
+
+                /* Records are smaller than PIPE_BUF, hence are written and read atomically */
+                assert((size_t) n == sizeof(h));
+
+                varlink_server_worker_adopt(w, &h);
+        }
+}
+
+static void* varlink_server_worker_thread(void *userdata) {
+        VarlinkServerWorker *w = ASSERT_PTR(userdata);
+        int r;
+
+        varlink_server_current_worker = w;
+
+        /* Runs until the write side of the handoff pipe is closed. When exiting, the quit callbacks of the
+         * connections close them. */
+        r = sd_event_loop(w->event);
+        if (r < 0)
+                log_debug_errno(r, "Varlink worker event loop failed: %m");
+
+        return NULL;
+}
+
+static int varlink_server_worker_new(VarlinkServer *s, VarlinkServerWorker **ret) {
+        _cleanup_(varlink_server_worker_freep) VarlinkServerWorker *w = NULL;
+        int r;
+
+        assert(s);
+        assert(ret);
+
+        w = new(VarlinkServerWorker, 1);
+        if (!w)
+                return -ENOMEM;
+
+        *w = (VarlinkServerWorker) {
+                .server = s,
+                .handoff_fds = EBADF_PAIR,
+        };
+
+        if (pipe2(w->handoff_fds, O_CLOEXEC|O_NONBLOCK) < 0)
+                return -errno;
+
+        r = sd_event_new(&w->event);
+        if (r < 0)
+                return r;
+
+        r = sd_event_add_io(w->event, &w->handoff_event_source, w->handoff_fds[0], EPOLLIN, varlink_server_worker_handoff, w);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(w->handoff_event_source, "varlink-server-handoff");
+
+        *ret = TAKE_PTR(w);
+        return 0;
+}
+
+static void varlink_server_stop_workers(VarlinkServer *s) {
+        assert(s);
+
+        /* The connections served by the workers refer to the server, hence the workers need to be joined
+         * before the server may go away, which a worker cannot do for itself. */
+        assert(!varlink_server_called_from_worker(s));
+
+        /* First tell all workers to exit, so that they shut down in parallel, then wait for them */
+        FOREACH_ARRAY(i, s->workers, s->n_workers)
+                (*i)->handoff_fds[1] = safe_close((*i)->handoff_fds[1]);
+
+        FOREACH_ARRAY(i, s->workers, s->n_workers) {
+                assert_se(pthread_join((*i)->thread, NULL) == 0);
+                varlink_server_worker_free(*i);
+        }
+
+        s->workers = mfree(s->workers);
+        s->n_workers = s->next_worker = 0;
+}
+
+static int varlink_server_start_workers(VarlinkServer *s) {
+        sigset_t ss, saved_ss;
+        unsigned n;
+        int r = 0, k;
+
+        assert(s);
+
+        if (s->n_workers > 0)
+                return 0;
+
+        if (s->n_worker_threads > 0)
+                n = s->n_worker_threads;
+        else {
+                k = cpus_in_affinity_mask();
+                n = k > 0 ? MIN((unsigned) k, VARLINK_SERVER_WORKER_THREADS_MAX) : 1;
+        }
+
+        s->workers = new0(VarlinkServerWorker*, n);
+        if (!s->workers)
+                return log_oom_debug();
+
+        /* No signals in worker threads please. We set the mask before starting them, so that the threads
+         * never exist with a different mask than a fully blocked one. */
+        assert_se(sigfillset(&ss) >= 0);
+        k = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (k > 0) {
+                s->workers = mfree(s->workers);
+                return -k;
+        }
+
+        while (s->n_workers < n) {
+                _cleanup_(varlink_server_worker_freep) VarlinkServerWorker *w = NULL;
+
+                r = varlink_server_worker_new(s, &w);
+                if (r < 0)
+                        break;
+
+                r = -pthread_create(&w->thread, NULL, varlink_server_worker_thread, w);
+                if (r < 0)
+                        break;
+
+                s->workers[s->n_workers++] = TAKE_PTR(w);
+        }
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (k > 0 && r >= 0)
+                r = -k;
+        if (r < 0) {
+                varlink_server_stop_workers(s);
+                return varlink_server_log_errno(s, r, "Failed to start worker threads: %m");
+        }
+
+        varlink_server_log(s, "Started %u worker threads.", n);
+        return 0;
+}
+
+static int varlink_server_handoff_connection(
+                VarlinkServer *server,
+                int fd,
+                const struct ucred *ucred,
+                bool ucred_acquired) {
+
+        VarlinkServerHandoff h = {
+                .fd = fd,
+                .ucred = *ucred,
+                .ucred_acquired = ucred_acquired,
+        };
+        VarlinkServerWorker *w;
+        ssize_t n;
+        int r;
+
+        assert(server);
+        assert(fd >= 0);
+        assert(ucred);
+
+        r = varlink_server_start_workers(server);
+        if (r < 0)
+                goto fail;
+
+        /* Round-robin is good enough here, each worker multiplexes its connections anyway */
+        w = server->workers[server->next_worker++ % server->n_workers];
+
+        n = write(w->handoff_fds[1], &h, sizeof(h));
+        if (n < 0) {
+                r = -errno;
+
+                if (ERRNO_IS_TRANSIENT(r))
+                        varlink_server_log(server, "Worker thread is not keeping up, refusing connection.");
+                else
+                        varlink_server_log_errno(server, r, "Failed to hand connection to worker thread: %m");
+                goto fail;
+        }
+        assert((size_t) n == sizeof(h));
+
+        return 0;
+
+fail:
+        (void) uncount_connection(server, ucred, ucred_acquired);
+        return r;
+}
+
+int varlink_server_add_connection(VarlinkServer *server, int fd, Varlink **ret) {
+        struct ucred ucred = UCRED_INVALID;
+        bool ucred_acquired;
+        int r;
+
+        assert_return(server, -EINVAL);
+        assert_return(fd >= 0, -EBADF);
+        /* In threaded mode the connection object is created in a worker thread later on */
+        assert_return(!ret || !FLAGS_SET(server->flags, VARLINK_SERVER_THREADED), -EOPNOTSUPP);
+
+        if ((server->flags & (VARLINK_SERVER_ROOT_ONLY|VARLINK_SERVER_ACCOUNT_UID)) != 0) {
+                r = getpeercred(fd, &ucred);
+                if (r < 0)
+                        return varlink_server_log_errno(server, r, "Failed to acquire peer credentials of incoming socket, refusing: %m");
+
+                ucred_acquired = true;
+        } else
+                ucred_acquired = false;
+
+        {
+                _unused_ _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *m = pthread_mutex_lock_assert(&server->mutex);
+
+                if (ucred_acquired) {
+                        r = validate_connection(server, &ucred);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                return -EPERM;
+                }
+
+                r = count_connection(server, &ucred);
+                if (r < 0)
+                        return r;
+        }
+
+        if (FLAGS_SET(server->flags, VARLINK_SERVER_THREADED))
+                return varlink_server_handoff_connection(server, fd, &ucred, ucred_acquired);
+
+        return varlink_server_link_connection(server, server->event, fd, &ucred, ucred_acquired, ret);
+}
+
 static VarlinkServerSocket *varlink_server_socket_free(VarlinkServerSocket *ss) {
         if (!ss)
                 return NULL;
@@ -3135,20 +3912,15 @@ static int connect_callback(sd_event_source *source, int fd, uint32_t revents, v
                 return varlink_server_log_errno(ss->server, errno, "Failed to accept incoming socket: %m");
         }
 
-        r = varlink_server_add_connection(ss->server, cfd, &v);
+        /* In threaded mode the worker thread calls the connect callback */
+        r = varlink_server_add_connection(ss->server, cfd, FLAGS_SET(ss->server->flags, VARLINK_SERVER_THREADED) ? NULL : &v);
         if (r < 0)
                 return 0;
 
         TAKE_FD(cfd);
 
-        if (ss->server->connect_callback) {
-                r = ss->server->connect_callback(ss->server, v, ss->server->userdata);
-                if (r < 0) {
-                        varlink_log_errno(v, r, "Connection callback returned error, disconnecting client: %m");
-                        varlink_close(v);
-                        return 0;
-                }
-        }
+        if (v)
+                varlink_server_call_connect_callback(ss->server, v);
 
         return 0;
 }
@@ -3356,22 +4128,102 @@ static VarlinkServerSocket* varlink_server_socket_destroy(VarlinkServerSocket *s
         return mfree(ss);
 }
 
+static int varlink_server_request_shutdown(VarlinkServer *s) {
+        assert(s);
+
+        _unused_ _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *m = pthread_mutex_lock_assert(&s->mutex);
+
+        if (s->idle_event_fd < 0)
+                return varlink_server_log_errno(s, SYNTHETIC_ERRNO(EBUSY),
+                                                "Cannot shut down server from worker thread without event loop.");
+
+        s->shutdown_requested = true;
+        (void) eventfd_write(s->idle_event_fd, 1);
+        return 0;
+}
+
+static bool varlink_server_take_shutdown_request(VarlinkServer *s) {
+        assert(s);
+
+        _unused_ _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *m = pthread_mutex_lock_assert(&s->mutex);
+
+        return TAKE_GENERIC(s->shutdown_requested, bool, false);
+}
+
 int varlink_server_shutdown(VarlinkServer *s) {
         assert_return(s, -EINVAL);
 
+        /* A method handler running in one of our worker threads may neither touch the server's event loop,
+         * nor join its own thread. Hence let the accepting thread do the work, once it gets to it. */
+        if (varlink_server_called_from_worker(s))
+                return varlink_server_request_shutdown(s);
+
         while (s->sockets)
                 varlink_server_socket_destroy(s->sockets);
 
+        /* Worker threads close their connections when exiting */
+        varlink_server_stop_workers(s);
+
         return 0;
 }
 
 static void varlink_server_test_exit_on_idle(VarlinkServer *s) {
         assert(s);
 
-        if (s->exit_on_idle && s->event && s->n_connections == 0)
+        if (s->exit_on_idle && s->event && varlink_server_current_connections(s) == 0)
                 (void) sd_event_exit(s->event, 0);
 }
 
+static int idle_callback(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        VarlinkServer *s = ASSERT_PTR(userdata);
+
+        (void) flush_fd(fd);
+
+        if (varlink_server_take_shutdown_request(s))
+                (void) varlink_server_shutdown(s);
+
+        varlink_server_test_exit_on_idle(s);
+        return 0;
+}
+
+static int varlink_server_add_idle_event_source(VarlinkServer *s, int64_t priority) {
+        _cleanup_(sd_event_source_unrefp) sd_event_source *es = NULL;
+        _cleanup_close_ int fd = -EBADF;
+        int r;
+
+        assert(s);
+        assert(s->event);
+        assert(!s->idle_event_source);
+
+        /* In threaded mode connections go away in the worker threads, which use this to notify us. They
+         * also use it to ask us to shut down the server. */
+
+        fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (fd < 0)
+                return -errno;
+
+        r = sd_event_add_io(s->event, &es, fd, EPOLLIN, idle_callback, s);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_io_fd_own(es, true);
+        if (r < 0)
+                return r;
+
+        TAKE_FD(fd);
+
+        r = sd_event_source_set_priority(es, priority);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(es, "varlink-server-idle");
+
+        _unused_ _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *m = pthread_mutex_lock_assert(&s->mutex);
+        s->idle_event_fd = sd_event_source_get_io_fd(es);
+        s->idle_event_source = TAKE_PTR(es);
+        return 0;
+}
+
 int varlink_server_set_exit_on_idle(VarlinkServer *s, bool b) {
         assert_return(s, -EINVAL);
 
@@ -3422,6 +4274,12 @@ int varlink_server_attach_event(VarlinkServer *s, sd_event *e, int64_t priority)
                         goto fail;
         }
 
+        if (FLAGS_SET(s->flags, VARLINK_SERVER_THREADED)) {
+                r = varlink_server_add_idle_event_source(s, priority);
+                if (r < 0)
+                        goto fail;
+        }
+
         s->event_priority = priority;
         return 0;
 
@@ -3436,7 +4294,13 @@ int varlink_server_detach_event(VarlinkServer *s) {
         LIST_FOREACH(sockets, ss, s->sockets)
                 ss->event_source = sd_event_source_disable_unref(ss->event_source);
 
-        sd_event_unref(s->event);
+        if (s->idle_event_source) {
+                _unused_ _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *m = pthread_mutex_lock_assert(&s->mutex);
+                s->idle_event_fd = -EBADF;
+        }
+        s->idle_event_source = sd_event_source_disable_unref(s->idle_event_source);
+
+        s->event = sd_event_unref(s->event);
         return 0;
 }
 
@@ -3642,6 +4506,7 @@ int varlink_server_set_connections_max(VarlinkServer *s, unsigned m) {
 unsigned varlink_server_current_connections(VarlinkServer *s) {
         assert_return(s, UINT_MAX);
 
+        _unused_ _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *m = pthread_mutex_lock_assert(&s->mutex);
         return s->n_connections;
 }
 
@@ -3651,6 +4516,18 @@ int varlink_server_set_description(VarlinkServer *s, const char *description) {
         return free_and_strdup(&s->description, description);
 }
 
+int varlink_server_set_worker_threads(VarlinkServer *s, unsigned n) {
+        assert_return(s, -EINVAL);
+        assert_return(FLAGS_SET(s->flags, VARLINK_SERVER_THREADED), -EOPNOTSUPP);
+        assert_return(n <= VARLINK_SERVER_WORKER_THREADS_MAX, -ERANGE);
+
+        if (s->n_workers > 0)
+                return -EBUSY;
+
+        s->n_worker_threads = n;
+        return 0;
+}
+
 int varlink_server_serialize(VarlinkServer *s, FILE *f, FDSet *fds) {
         assert(f);
         assert(fds);
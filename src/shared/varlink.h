@@ -41,16 +41,25 @@ typedef enum VarlinkMethodFlags {
         VARLINK_METHOD_MORE   = 2 << 1,
 } VarlinkMethodFlags;
 
+typedef enum VarlinkEncoding {
+        VARLINK_ENCODING_JSON, /* NUL terminated JSON text, as per the Varlink spec */
+        VARLINK_ENCODING_CBOR, /* CBOR (RFC 8949), each message prefixed by its size as 32-bit LE integer */
+        _VARLINK_ENCODING_MAX,
+        _VARLINK_ENCODING_INVALID = -EINVAL,
+} VarlinkEncoding;
+
 typedef enum VarlinkServerFlags {
         VARLINK_SERVER_ROOT_ONLY        = 1 << 0, /* Only accessible by root */
         VARLINK_SERVER_MYSELF_ONLY      = 1 << 1, /* Only accessible by our own UID */
         VARLINK_SERVER_ACCOUNT_UID      = 1 << 2, /* Do per user accounting */
         VARLINK_SERVER_INHERIT_USERDATA = 1 << 3, /* Initialize Varlink connection userdata from VarlinkServer userdata */
-        _VARLINK_SERVER_FLAGS_ALL = (1 << 4) - 1,
+        VARLINK_SERVER_THREADED         = 1 << 4, /* Dispatch connections on a pool of worker threads, see below */
+        _VARLINK_SERVER_FLAGS_ALL = (1 << 5) - 1,
 } VarlinkServerFlags;
 
 typedef int (*VarlinkMethod)(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata);
 typedef int (*VarlinkReply)(Varlink *link, JsonVariant *parameters, const char *error_id, VarlinkReplyFlags flags, void *userdata);
+typedef int (*VarlinkDrained)(Varlink *link, void *userdata);
 typedef int (*VarlinkConnect)(VarlinkServer *server, Varlink *link, void *userdata);
 typedef void (*VarlinkDisconnect)(VarlinkServer *server, Varlink *link, void *userdata);
 
@@ -77,10 +86,15 @@ int varlink_is_idle(Varlink *v);
 
 int varlink_flush(Varlink *v);
 int varlink_close(Varlink *v);
+int varlink_forget_fd(Varlink *v);
 
 Varlink* varlink_flush_close_unref(Varlink *v);
 Varlink* varlink_close_unref(Varlink *v);
 
+/* Switch the connection to a different wire encoding, if the server supports that */
+int varlink_negotiate_encoding(Varlink *v, VarlinkEncoding encoding);
+VarlinkEncoding varlink_get_encoding(Varlink *v);
+
 /* Enqueue method call, not expecting a reply */
 int varlink_send(Varlink *v, const char *method, JsonVariant *parameters);
 int varlink_sendb(Varlink *v, const char *method, ...);
@@ -89,6 +103,9 @@ int varlink_sendb(Varlink *v, const char *method, ...);
 int varlink_call(Varlink *v, const char *method, JsonVariant *parameters, JsonVariant **ret_parameters, const char **ret_error_id, VarlinkReplyFlags *ret_flags);
 int varlink_callb(Varlink *v, const char *method, JsonVariant **ret_parameters, const char **ret_error_id, VarlinkReplyFlags *ret_flags, ...);
 
+/* Send many calls of the same method in one go, and wait for all replies, returned as array of reply objects */
+int varlink_call_many(Varlink *v, const char *method, JsonVariant * const *parameters, size_t n, JsonVariant **ret_replies);
+
 /* Send method call and begin collecting all 'more' replies into an array, finishing when a final reply is sent */
 int varlink_collect(Varlink *v, const char *method, JsonVariant *parameters, JsonVariant **ret_parameters, const char **ret_error_id, VarlinkReplyFlags *ret_flags);
 int varlink_collectb(Varlink *v, const char *method, JsonVariant **ret_parameters, const char **ret_error_id, VarlinkReplyFlags *ret_flags, ...);
@@ -133,6 +150,11 @@ int varlink_set_allow_fd_passing_output(Varlink *v, bool b);
 /* Bind a disconnect, reply or timeout callback */
 int varlink_bind_reply(Varlink *v, VarlinkReply reply);
 
+/* Calls the callback once, as soon as everything queued so far has been written to the socket. Lets a
+ * method that streams many "more" replies generate them as the peer reads them, instead of buffering all
+ * of them at once. */
+int varlink_bind_drained(Varlink *v, VarlinkDrained drained);
+
 void* varlink_set_userdata(Varlink *v, void *userdata);
 void* varlink_get_userdata(Varlink *v);
 
@@ -144,6 +166,7 @@ int varlink_set_relative_timeout(Varlink *v, usec_t usec);
 VarlinkServer* varlink_get_server(Varlink *v);
 
 int varlink_set_description(Varlink *v, const char *d);
+const char* varlink_get_description(Varlink *v);
 
 /* Create a varlink server */
 int varlink_server_new(VarlinkServer **ret, VarlinkServerFlags flags);
@@ -191,6 +214,15 @@ unsigned varlink_server_current_connections(VarlinkServer *s);
 
 int varlink_server_set_description(VarlinkServer *s, const char *description);
 
+/* If a server is allocated with VARLINK_SERVER_THREADED, accepted connections are handed out round-robin to a
+ * pool of worker threads, each running its own event loop. The server's event loop then only accepts
+ * connections. Method, connect and disconnect callbacks are called from the worker threads, hence must be
+ * thread-safe, and all methods and interfaces have to be bound before the first connection comes in. If the
+ * number of threads is not configured explicitly, one per CPU is started. If varlink_server_shutdown() is
+ * called from a method handler, the server is shut down by the thread owning it once it gets to it. The last
+ * reference to the server must not be dropped from a worker thread. */
+int varlink_server_set_worker_threads(VarlinkServer *s, unsigned n);
+
 typedef enum VarlinkInvocationFlags {
         VARLINK_ALLOW_LISTEN                     = 1 << 0,
         VARLINK_ALLOW_ACCEPT                     = 1 << 1,
@@ -200,6 +232,9 @@ typedef enum VarlinkInvocationFlags {
 
 int varlink_invocation(VarlinkInvocationFlags flags);
 
+const char* varlink_encoding_to_string(VarlinkEncoding e) _const_;
+VarlinkEncoding varlink_encoding_from_string(const char *s) _pure_;
+
 DEFINE_TRIVIAL_CLEANUP_FUNC(Varlink *, varlink_unref);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Varlink *, varlink_close_unref);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Varlink *, varlink_flush_close_unref);
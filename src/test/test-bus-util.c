@@ -1,6 +1,9 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include <sys/socket.h>
+
 #include "bus-util.h"
+#include "fd-util.h"
 #include "log.h"
 #include "tests.h"
 
@@ -44,4 +47,69 @@ TEST(destroy_callback) {
         assert_se(n_called == 1);
 }
 
+TEST(bus_message_read_json) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL, *w = NULL;
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR;
+
+        /* Any bus will do, nothing is ever sent on it */
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, pair[0], pair[0]) >= 0);
+        TAKE_FD(pair[0]);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        assert_se(sd_bus_message_new(bus, &m, SD_BUS_MESSAGE_METHOD_RETURN) >= 0);
+        assert_se(sd_bus_message_append(m, "a{sv}", 2, "foo", "u", 4711, "bar", "(sb)", "waldo", true) >= 0);
+        assert_se(sd_bus_message_append(m, "a{uv}", 2, 1, "s", "one", 2, "as", 2, "a", "b") >= 0);
+        assert_se(sd_bus_message_append(m, "a{ib}", 1, -5, false) >= 0);
+        assert_se(sd_bus_message_append(m, "a{bs}", 2, true, "yes", false, "no") >= 0);
+        assert_se(sd_bus_message_append(m, "a{ds}", 1, 1.5, "x") >= 0);
+        assert_se(sd_bus_message_append(m, "a{ou}", 1, "/org/freedesktop", 7) >= 0);
+        assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+
+        assert_se(json_build(&w, JSON_BUILD_OBJECT(
+                                             JSON_BUILD_PAIR_UNSIGNED("foo", 4711),
+                                             JSON_BUILD_PAIR("bar", JSON_BUILD_ARRAY(JSON_BUILD_STRING("waldo"), JSON_BUILD_BOOLEAN(true))))) >= 0);
+        assert_se(bus_message_read_json(m, &v) >= 0);
+        assert_se(json_variant_equal(v, w));
+        v = json_variant_unref(v);
+        w = json_variant_unref(w);
+
+        /* Dictionaries with keys other than strings become objects all the same */
+        assert_se(json_build(&w, JSON_BUILD_OBJECT(
+                                             JSON_BUILD_PAIR_STRING("1", "one"),
+                                             JSON_BUILD_PAIR_STRV("2", STRV_MAKE("a", "b")))) >= 0);
+        assert_se(bus_message_read_json(m, &v) >= 0);
+        assert_se(json_variant_equal(v, w));
+        v = json_variant_unref(v);
+        w = json_variant_unref(w);
+
+        assert_se(json_build(&w, JSON_BUILD_OBJECT(JSON_BUILD_PAIR_BOOLEAN("-5", false))) >= 0);
+        assert_se(bus_message_read_json(m, &v) >= 0);
+        assert_se(json_variant_equal(v, w));
+        v = json_variant_unref(v);
+        w = json_variant_unref(w);
+
+        assert_se(json_build(&w, JSON_BUILD_OBJECT(
+                                             JSON_BUILD_PAIR_STRING("true", "yes"),
+                                             JSON_BUILD_PAIR_STRING("false", "no"))) >= 0);
+        assert_se(bus_message_read_json(m, &v) >= 0);
+        assert_se(json_variant_equal(v, w));
+        v = json_variant_unref(v);
+        w = json_variant_unref(w);
+
+        assert_se(bus_message_read_json(m, &v) >= 0);
+        assert_se(json_variant_is_object(v));
+        assert_se(streq_ptr(json_variant_string(json_variant_by_key(v, "1.5")), "x"));
+        v = json_variant_unref(v);
+
+        assert_se(bus_message_read_json(m, &v) >= 0);
+        assert_se(json_variant_unsigned(json_variant_by_key(v, "/org/freedesktop")) == 7);
+        v = json_variant_unref(v);
+
+        assert_se(sd_bus_message_at_end(m, true) > 0);
+}
+
 DEFINE_TEST_MAIN(LOG_DEBUG);
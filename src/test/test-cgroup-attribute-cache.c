@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "cgroup.h"
+#include "tests.h"
+
+static void cache_done(CGroupAttributeCache *c) {
+        cgroup_attribute_cache_reset(c, /* created = */ false);
+}
+
+TEST(cgroup_attribute_cache_created) {
+        _cleanup_(cache_done) CGroupAttributeCache c = {};
+
+        /* A fresh cgroup has all attributes with known defaults at them, in the form we write them */
+        cgroup_attribute_cache_reset(&c, /* created = */ true);
+        assert_se(cgroup_attribute_cache_is_applied(&c, "cpu.weight", "100\n"));
+        assert_se(cgroup_attribute_cache_is_applied(&c, "memory.max", "max\n"));
+        assert_se(cgroup_attribute_cache_is_applied(&c, "memory.oom.group", "0"));
+        assert_se(cgroup_attribute_cache_is_applied(&c, "pids.max", "max\n"));
+
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "cpu.weight", "100"));
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "cpu.weight", "200\n"));
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "memory.oom.group", "1"));
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "cpu.max.burst", "0\n"));
+
+        /* Anything else we know nothing about */
+        cgroup_attribute_cache_reset(&c, /* created = */ false);
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "cpu.weight", "100\n"));
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "memory.max", "max\n"));
+}
+
+TEST(cgroup_attribute_cache_update) {
+        _cleanup_(cache_done) CGroupAttributeCache c = {};
+
+        cgroup_attribute_cache_reset(&c, /* created = */ true);
+
+        /* A value other than the default is remembered, and the default has to be written again */
+        assert_se(cgroup_attribute_cache_update(&c, "cpu.weight", "200\n", true) >= 0);
+        assert_se(cgroup_attribute_cache_is_applied(&c, "cpu.weight", "200\n"));
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "cpu.weight", "300\n"));
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "cpu.weight", "100\n"));
+        assert_se(cgroup_attribute_cache_is_applied(&c, "memory.max", "max\n"));
+
+        assert_se(cgroup_attribute_cache_update(&c, "cpu.weight", "300\n", true) >= 0);
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "cpu.weight", "200\n"));
+        assert_se(cgroup_attribute_cache_is_applied(&c, "cpu.weight", "300\n"));
+        assert_se(hashmap_size(c.applied) == 1);
+
+        /* Going back to the default only needs the bit */
+        assert_se(cgroup_attribute_cache_update(&c, "cpu.weight", "100\n", true) >= 0);
+        assert_se(cgroup_attribute_cache_is_applied(&c, "cpu.weight", "100\n"));
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "cpu.weight", "300\n"));
+        assert_se(hashmap_isempty(c.applied));
+
+        /* Attributes without known default are remembered all the same */
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "cpu.max.burst", "0\n"));
+        assert_se(cgroup_attribute_cache_update(&c, "cpu.max.burst", "0\n", true) >= 0);
+        assert_se(cgroup_attribute_cache_is_applied(&c, "cpu.max.burst", "0\n"));
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "cpu.max.burst", "1000\n"));
+}
+
+TEST(cgroup_attribute_cache_failed) {
+        _cleanup_(cache_done) CGroupAttributeCache c = {};
+
+        /* After a failed write we don't know the value anymore, whatever it was before */
+        cgroup_attribute_cache_reset(&c, /* created = */ true);
+        assert_se(cgroup_attribute_cache_update(&c, "memory.max", "max\n", false) >= 0);
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "memory.max", "max\n"));
+
+        assert_se(cgroup_attribute_cache_update(&c, "memory.high", "4096\n", true) >= 0);
+        assert_se(cgroup_attribute_cache_update(&c, "memory.high", "4096\n", false) >= 0);
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "memory.high", "4096\n"));
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "memory.high", "max\n"));
+        assert_se(hashmap_isempty(c.applied));
+
+        /* The next successful write is known again */
+        assert_se(cgroup_attribute_cache_update(&c, "memory.max", "max\n", true) >= 0);
+        assert_se(cgroup_attribute_cache_is_applied(&c, "memory.max", "max\n"));
+}
+
+TEST(cgroup_attribute_cache_forget) {
+        _cleanup_(cache_done) CGroupAttributeCache c = {};
+
+        cgroup_attribute_cache_reset(&c, /* created = */ true);
+        assert_se(cgroup_attribute_cache_update(&c, "pids.max", "32\n", true) >= 0);
+        assert_se(cgroup_attribute_cache_update(&c, "io.weight", "default 500\n", true) >= 0);
+
+        /* When controllers change, values other than the defaults are gone */
+        cgroup_attribute_cache_forget(&c);
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "pids.max", "32\n"));
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "io.weight", "default 500\n"));
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "pids.max", "max\n"));
+        assert_se(cgroup_attribute_cache_is_applied(&c, "memory.max", "max\n"));
+        assert_se(!c.applied);
+
+        cgroup_attribute_cache_reset(&c, /* created = */ false);
+        assert_se(c.defaults == 0);
+        assert_se(!cgroup_attribute_cache_is_applied(&c, "memory.max", "max\n"));
+}
+
+DEFINE_TEST_MAIN(LOG_DEBUG);
@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "cgroup.h"
+#include "tests.h"
+
+static void test_parse_one(const char *contents, uint64_t rbytes, uint64_t wbytes, uint64_t rios, uint64_t wios) {
+        _cleanup_free_ char *copy = NULL;
+        uint64_t v[_CGROUP_IO_ACCOUNTING_METRIC_MAX];
+
+        /* The parser splits up the string in place */
+        assert_se(copy = strdup(contents));
+        assert_se(cgroup_io_stat_parse(copy, v) >= 0);
+
+        assert_se(v[CGROUP_IO_READ_BYTES] == rbytes);
+        assert_se(v[CGROUP_IO_WRITE_BYTES] == wbytes);
+        assert_se(v[CGROUP_IO_READ_OPERATIONS] == rios);
+        assert_se(v[CGROUP_IO_WRITE_OPERATIONS] == wios);
+}
+
+TEST(cgroup_io_stat_parse) {
+        test_parse_one("", 0, 0, 0, 0);
+        test_parse_one("\n", 0, 0, 0, 0);
+
+        test_parse_one("8:0 rbytes=1 wbytes=2 rios=3 wios=4 dbytes=5 dios=6\n",
+                       1, 2, 3, 4);
+
+        /* The counters of all devices are summed up */
+        test_parse_one("8:0 rbytes=1 wbytes=2 rios=3 wios=4 dbytes=0 dios=0\n"
+                       "8:16 rbytes=10 wbytes=20 rios=30 wios=40 dbytes=0 dios=0\n"
+                       "253:0 rbytes=100 wbytes=200 rios=300 wios=400 dbytes=0 dios=0\n",
+                       111, 222, 333, 444);
+
+        /* Missing keys, in either device */
+        test_parse_one("8:0 rbytes=1 rios=3\n"
+                       "8:16 wbytes=20 wios=40 rios=30\n",
+                       1, 20, 33, 40);
+        test_parse_one("8:0\n"
+                       "8:16 dbytes=7\n",
+                       0, 0, 0, 0);
+
+        /* No trailing newline, trailing and repeated whitespace, empty lines */
+        test_parse_one("8:0 rbytes=1 wbytes=2 rios=3 wios=4",
+                       1, 2, 3, 4);
+        test_parse_one("8:0 rbytes=1 wbytes=2 rios=3 wios=4   \n"
+                       "\n"
+                       "8:16  rbytes=10\twbytes=20  rios=30 wios=40 \t\n\n",
+                       11, 22, 33, 44);
+
+        /* Keys that merely start like the ones we know are not taken for them */
+        test_parse_one("8:0 xrbytes=1 rbytesx=2 rbytes=3\n",
+                       3, 0, 0, 0);
+
+        /* Full range */
+        test_parse_one("8:0 rbytes=18446744073709551615 wbytes=0\n",
+                       UINT64_MAX, 0, 0, 0);
+}
+
+TEST(cgroup_io_stat_parse_invalid) {
+        uint64_t v[_CGROUP_IO_ACCOUNTING_METRIC_MAX];
+
+        FOREACH_STRING(s,
+                       "8:0 rbytes=\n",
+                       "8:0 rbytes=foo wbytes=2\n",
+                       "8:0 wios=-1\n",
+                       "8:0 rios=18446744073709551616\n") {
+                _cleanup_free_ char *copy = NULL;
+
+                assert_se(copy = strdup(s));
+                assert_se(cgroup_io_stat_parse(copy, v) < 0);
+        }
+}
+
+DEFINE_TEST_MAIN(LOG_DEBUG);
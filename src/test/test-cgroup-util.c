@@ -5,15 +5,18 @@
 #include "dirent-util.h"
 #include "errno-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "format-util.h"
 #include "parse-util.h"
 #include "proc-cmdline.h"
 #include "process-util.h"
+#include "rm-rf.h"
 #include "special.h"
 #include "stat-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "tests.h"
+#include "tmpfile-util.h"
 #include "user-util.h"
 
 static void check_p_d_u(const char *path, int code, const char *result) {
@@ -454,6 +457,33 @@ TEST(cg_get_keyed_attribute) {
         }
 }
 
+static void test_set_attribute_at_one(int dir_fd, const char *value, const char *expected) {
+        _cleanup_free_ char *contents = NULL;
+
+        /* Attributes aren't created, and a write replaces the value, like on cgroupfs */
+        assert_se(write_string_file_at(dir_fd, "cpu.weight", "", WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_TRUNCATE) >= 0);
+        assert_se(cg_set_attribute_at(dir_fd, "cpu.weight", value) >= 0);
+        assert_se(read_full_file_at(dir_fd, "cpu.weight", &contents, NULL) >= 0);
+        assert_se(streq(contents, expected));
+}
+
+TEST(cg_set_attribute_at) {
+        _cleanup_(rm_rf_physical_and_freep) char *t = NULL;
+        _cleanup_close_ int fd = -EBADF;
+
+        assert_se((fd = mkdtemp_open(NULL, 0, &t)) >= 0);
+
+        assert_se(cg_set_attribute_at(fd, "cpu.weight", "100") == -ENOENT);
+        assert_se(faccessat(fd, "cpu.weight", F_OK, 0) < 0 && errno == ENOENT);
+
+        test_set_attribute_at_one(fd, "100", "100\n");
+        test_set_attribute_at_one(fd, "max 100000\n", "max 100000\n");
+        test_set_attribute_at_one(fd, "", "\n");
+
+        assert_se(mkdirat(fd, "sub.scope", 0755) >= 0);
+        assert_se(cg_set_attribute_at(fd, "sub.scope", "1") == -EISDIR);
+}
+
 TEST(bfq_weight_conversion) {
         assert_se(BFQ_WEIGHT(1) == 1);
         assert_se(BFQ_WEIGHT(50) == 50);
@@ -314,7 +314,7 @@ static void test_config_parse_one(unsigned i, const char *s) {
         _cleanup_(unlink_tempfilep) char name[] = "/tmp/test-conf-parser.XXXXXX";
         _cleanup_fclose_ FILE *f = NULL;
         _cleanup_free_ char *setting1 = NULL;
-        int r;
+        int r, q;
 
         const ConfigTableItem items[] = {
                 { "Section", "setting1",  config_parse_string,   0, &setting1},
@@ -383,6 +383,23 @@ static void test_config_parse_one(unsigned i, const char *s) {
                 assert_se(streq(setting1, "2"));
                 break;
         }
+
+        /* Reading the lines first and parsing them afterwards must give the same result */
+        _cleanup_(config_lines_done) ConfigLines lines = {};
+        _cleanup_free_ char *parsed = TAKE_PTR(setting1);
+
+        rewind(f);
+
+        q = config_read_lines(name, f, CONFIG_PARSE_WARN, &lines, NULL);
+        if (q > 0)
+                q = config_parse_lines(NULL, name, &lines,
+                                       "Section\0"
+                                       "-NoWarnSection\0",
+                                       config_item_table_lookup, items,
+                                       CONFIG_PARSE_WARN,
+                                       NULL);
+        assert_se(q == r);
+        assert_se(streq_ptr(setting1, parsed));
 }
 
 TEST(config_parse) {
@@ -0,0 +1,426 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+
+#include "core-varlink.h"
+#include "fd-util.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "socket-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+/* More units than ListUnitMetrics() reports on in one batch */
+#define N_UNITS 1000U
+
+static char *runtime_dir = NULL, *unit_dir = NULL;
+
+STATIC_DESTRUCTOR_REGISTER(runtime_dir, rm_rf_physical_and_freep);
+STATIC_DESTRUCTOR_REGISTER(unit_dir, rm_rf_physical_and_freep);
+
+typedef struct Replies {
+        unsigned n_units;
+        unsigned n_accounting;
+        bool done;
+        char *error_id;
+} Replies;
+
+static void replies_done(Replies *r) {
+        r->error_id = mfree(r->error_id);
+}
+
+static Manager* setup(VarlinkServer **ret_server, Varlink **ret_client) {
+        _cleanup_(varlink_server_unrefp) VarlinkServer *s = NULL;
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR;
+        Manager *m;
+        int r;
+
+        r = manager_new(RUNTIME_SCOPE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (manager_errno_skip_test(r)) {
+                log_tests_skipped_errno(r, "manager_new");
+                return NULL;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL, NULL) >= 0);
+
+        /* None of them has a unit file, but they are all known to the manager nonetheless */
+        for (unsigned i = 0; i < N_UNITS; i++) {
+                _cleanup_free_ char *name = NULL;
+
+                assert_se(asprintf(&name, "metrics-%u.service", i) >= 0);
+                assert_se(manager_load_unit(m, name, NULL, NULL, NULL) >= 0);
+        }
+
+        assert_se(manager_setup_varlink_server(m, &s) >= 0);
+        assert_se(varlink_server_attach_event(s, m->event, SD_EVENT_PRIORITY_NORMAL) >= 0);
+
+        /* Keep the socket buffers small, so that the replies don't fit in them all at once and the server
+         * really needs to wait for the client to read them */
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        assert_se(fd_set_sndbuf(pair[0], 4096, /* increase= */ false) >= 0);
+        assert_se(fd_set_rcvbuf(pair[1], 4096, /* increase= */ false) >= 0);
+        assert_se(varlink_server_add_connection(s, pair[0], NULL) >= 0);
+        TAKE_FD(pair[0]);
+        assert_se(varlink_connect_fd(ret_client, pair[1]) >= 0);
+        TAKE_FD(pair[1]);
+        assert_se(varlink_attach_event(*ret_client, m->event, SD_EVENT_PRIORITY_NORMAL) >= 0);
+
+        *ret_server = TAKE_PTR(s);
+        return m;
+}
+
+static int on_unit_metrics(Varlink *link, JsonVariant *parameters, const char *error_id, VarlinkReplyFlags flags, void *userdata) {
+        Replies *r = ASSERT_PTR(userdata);
+        JsonVariant *unit;
+
+        if (error_id) {
+                assert_se(r->error_id = strdup(error_id));
+                r->done = true;
+                return 0;
+        }
+
+        assert_se(json_variant_unsigned(json_variant_by_key(parameters, "timestamp")) > 0);
+
+        unit = json_variant_by_key(parameters, "unit");
+        if (unit) {
+                const char *name = json_variant_string(json_variant_by_key(unit, "name"));
+
+                assert_se(name);
+                assert_se(json_variant_string(json_variant_by_key(unit, "activeState")));
+
+                if (startswith(name, "metrics-"))
+                        r->n_units++;
+                if (json_variant_by_key(unit, "accounting"))
+                        r->n_accounting++;
+        }
+
+        if (!FLAGS_SET(flags, VARLINK_REPLY_CONTINUES))
+                r->done = true;
+
+        return 0;
+}
+
+static void list_unit_metrics(Manager *m, Varlink *c, JsonVariant *parameters, bool more, Replies *ret) {
+        *ret = (Replies) {};
+
+        varlink_set_userdata(c, ret);
+        assert_se(varlink_bind_reply(c, on_unit_metrics) >= 0);
+        if (more)
+                assert_se(varlink_observe(c, "io.systemd.Manager.ListUnitMetrics", parameters) >= 0);
+        else
+                assert_se(varlink_invoke(c, "io.systemd.Manager.ListUnitMetrics", parameters) >= 0);
+
+        while (!ret->done)
+                assert_se(sd_event_run(m->event, 5 * USEC_PER_SEC) > 0);
+
+        assert_se(varlink_bind_reply(c, NULL) >= 0);
+}
+
+typedef struct Reply {
+        JsonVariant *parameters;
+        char *error_id;
+        bool done;
+} Reply;
+
+static void reply_done(Reply *r) {
+        r->parameters = json_variant_unref(r->parameters);
+        r->error_id = mfree(r->error_id);
+}
+
+static int on_reply(Varlink *link, JsonVariant *parameters, const char *error_id, VarlinkReplyFlags flags, void *userdata) {
+        Reply *r = ASSERT_PTR(userdata);
+
+        r->parameters = json_variant_ref(parameters);
+        if (error_id)
+                assert_se(r->error_id = strdup(error_id));
+        r->done = true;
+
+        return 0;
+}
+
+static void call(Manager *m, Varlink *c, const char *method, JsonVariant *parameters, Reply *ret) {
+        *ret = (Reply) {};
+
+        varlink_set_userdata(c, ret);
+        assert_se(varlink_bind_reply(c, on_reply) >= 0);
+        assert_se(varlink_invoke(c, method, parameters) >= 0);
+
+        while (!ret->done)
+                assert_se(sd_event_run(m->event, 5 * USEC_PER_SEC) > 0);
+
+        assert_se(varlink_bind_reply(c, NULL) >= 0);
+}
+
+static void callb(Manager *m, Varlink *c, const char *method, Reply *ret, ...) {
+        _cleanup_(json_variant_unrefp) JsonVariant *parameters = NULL;
+        va_list ap;
+        int r;
+
+        va_start(ap, ret);
+        r = json_buildv(&parameters, ap);
+        va_end(ap);
+        assert_se(r >= 0);
+
+        call(m, c, method, parameters, ret);
+}
+
+static unsigned count_units(JsonVariant *parameters) {
+        JsonVariant *e;
+        unsigned n = 0;
+
+        JSON_VARIANT_ARRAY_FOREACH(e, json_variant_by_key(parameters, "units"))
+                if (startswith(json_variant_string(json_variant_by_key(e, "name")), "metrics-"))
+                        n++;
+
+        return n;
+}
+
+TEST(get_units_properties) {
+        _cleanup_(varlink_server_unrefp) VarlinkServer *s = NULL;
+        _cleanup_(varlink_unrefp) Varlink *c = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR;
+        _cleanup_(reply_done) Reply r = {};
+        JsonVariant *e;
+
+        m = setup(&s, &c);
+        if (!m)
+                return;
+
+        /* Without any bus there is nothing to get the properties from */
+        call(m, c, "io.systemd.Manager.GetUnitsProperties", NULL, &r);
+        assert_se(streq_ptr(r.error_id, "io.systemd.Manager.BusNotAvailable"));
+        reply_done(&r);
+
+        /* Any bus will do, nothing is ever sent on it */
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, pair[0], pair[0]) >= 0);
+        TAKE_FD(pair[0]);
+        assert_se(sd_bus_start(bus) >= 0);
+        m->api_bus = bus;
+
+        /* No patterns, explicitly so */
+        callb(m, c, "io.systemd.Manager.GetUnitsProperties", &r,
+              JSON_BUILD_OBJECT(
+                        JSON_BUILD_PAIR_NULL("patterns"),
+                        JSON_BUILD_PAIR_STRV("properties", STRV_MAKE("Id", "ActiveState"))));
+        assert_se(!r.error_id);
+        assert_se(count_units(r.parameters) == N_UNITS);
+        JSON_VARIANT_ARRAY_FOREACH(e, json_variant_by_key(r.parameters, "units")) {
+                JsonVariant *p = json_variant_by_key(e, "properties");
+
+                assert_se(json_variant_elements(p) == 4);
+                assert_se(streq_ptr(json_variant_string(json_variant_by_key(p, "Id")),
+                                    json_variant_string(json_variant_by_key(e, "name"))));
+                assert_se(json_variant_string(json_variant_by_key(p, "ActiveState")));
+        }
+        reply_done(&r);
+
+        /* No properties, i.e. all of them, explicitly so and by leaving them out */
+        callb(m, c, "io.systemd.Manager.GetUnitsProperties", &r,
+              JSON_BUILD_OBJECT(
+                        JSON_BUILD_PAIR_STRV("patterns", STRV_MAKE("metrics-1?.service")),
+                        JSON_BUILD_PAIR_NULL("properties")));
+        assert_se(!r.error_id);
+        assert_se(count_units(r.parameters) == 10);
+        JSON_VARIANT_ARRAY_FOREACH(e, json_variant_by_key(r.parameters, "units")) {
+                JsonVariant *p = json_variant_by_key(e, "properties");
+
+                assert_se(json_variant_by_key(p, "Id"));
+                assert_se(json_variant_by_key(p, "Description"));
+                assert_se(json_variant_by_key(p, "ExecMainPID"));
+        }
+        reply_done(&r);
+
+        callb(m, c, "io.systemd.Manager.GetUnitsProperties", &r,
+              JSON_BUILD_OBJECT(
+                        JSON_BUILD_PAIR_STRV("patterns", STRV_MAKE("metrics-2.service"))));
+        assert_se(!r.error_id);
+        assert_se(count_units(r.parameters) == 1);
+        reply_done(&r);
+
+        /* Nothing matches */
+        callb(m, c, "io.systemd.Manager.GetUnitsProperties", &r,
+              JSON_BUILD_OBJECT(
+                        JSON_BUILD_PAIR_STRV("patterns", STRV_MAKE("nomatch-*.service")),
+                        JSON_BUILD_PAIR_STRV("properties", STRV_MAKE("Id"))));
+        assert_se(!r.error_id);
+        assert_se(json_variant_is_blank_array(json_variant_by_key(r.parameters, "units")));
+        reply_done(&r);
+
+        /* Not an array */
+        callb(m, c, "io.systemd.Manager.GetUnitsProperties", &r,
+              JSON_BUILD_OBJECT(
+                        JSON_BUILD_PAIR_INTEGER("patterns", 4711)));
+        assert_se(streq_ptr(r.error_id, VARLINK_ERROR_INVALID_PARAMETER));
+
+        /* The bus is ours, not the manager's */
+        m->api_bus = NULL;
+}
+
+TEST(get_units_accounting) {
+        _cleanup_(varlink_server_unrefp) VarlinkServer *s = NULL;
+        _cleanup_(varlink_unrefp) Varlink *c = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        _cleanup_(reply_done) Reply r = {};
+        JsonVariant *e;
+
+        m = setup(&s, &c);
+        if (!m)
+                return;
+
+        /* No patterns, explicitly so and by leaving them out */
+        callb(m, c, "io.systemd.Manager.GetUnitsAccounting", &r,
+              JSON_BUILD_OBJECT(
+                        JSON_BUILD_PAIR_NULL("patterns")));
+        assert_se(!r.error_id);
+        assert_se(count_units(r.parameters) == N_UNITS);
+        reply_done(&r);
+
+        call(m, c, "io.systemd.Manager.GetUnitsAccounting", NULL, &r);
+        assert_se(!r.error_id);
+        assert_se(count_units(r.parameters) == N_UNITS);
+        reply_done(&r);
+
+        /* The cgroups of the units were never realized, hence there are no counters to report */
+        callb(m, c, "io.systemd.Manager.GetUnitsAccounting", &r,
+              JSON_BUILD_OBJECT(
+                        JSON_BUILD_PAIR_STRV("patterns", STRV_MAKE("metrics-1?.service", "metrics-2.service"))));
+        assert_se(!r.error_id);
+        assert_se(count_units(r.parameters) == 11);
+        JSON_VARIANT_ARRAY_FOREACH(e, json_variant_by_key(r.parameters, "units")) {
+                assert_se(!json_variant_by_key(e, "memoryCurrent"));
+                assert_se(!json_variant_by_key(e, "tasksCurrent"));
+                assert_se(!json_variant_by_key(e, "ioReadBytes"));
+        }
+        reply_done(&r);
+
+        /* Units without a cgroup are left out */
+        callb(m, c, "io.systemd.Manager.GetUnitsAccounting", &r,
+              JSON_BUILD_OBJECT(
+                        JSON_BUILD_PAIR_STRV("patterns", STRV_MAKE("*.target"))));
+        assert_se(!r.error_id);
+        assert_se(json_variant_is_blank_array(json_variant_by_key(r.parameters, "units")));
+        reply_done(&r);
+
+        callb(m, c, "io.systemd.Manager.GetUnitsAccounting", &r,
+              JSON_BUILD_OBJECT(
+                        JSON_BUILD_PAIR_BOOLEAN("patterns", true)));
+        assert_se(streq_ptr(r.error_id, VARLINK_ERROR_INVALID_PARAMETER));
+}
+
+TEST(list_unit_metrics) {
+        _cleanup_(varlink_server_unrefp) VarlinkServer *s = NULL;
+        _cleanup_(varlink_unrefp) Varlink *c = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        _cleanup_(json_variant_unrefp) JsonVariant *p = NULL;
+        _cleanup_(replies_done) Replies r = {};
+
+        m = setup(&s, &c);
+        if (!m)
+                return;
+
+        /* All units, in several batches */
+        list_unit_metrics(m, c, NULL, /* more= */ true, &r);
+        assert_se(!r.error_id);
+        assert_se(r.n_units == N_UNITS);
+        replies_done(&r);
+
+        /* Only some */
+        assert_se(json_build(&p, JSON_BUILD_OBJECT(
+                                     JSON_BUILD_PAIR_STRV("patterns", STRV_MAKE("metrics-1?.service", "metrics-2.service")),
+                                     JSON_BUILD_PAIR_BOOLEAN("accounting", false))) >= 0);
+        list_unit_metrics(m, c, p, /* more= */ true, &r);
+        assert_se(!r.error_id);
+        assert_se(r.n_units == 11);
+        assert_se(r.n_accounting == 0);
+        replies_done(&r);
+        p = json_variant_unref(p);
+
+        /* All units again, with null parameters, which is the same as leaving them out */
+        assert_se(json_build(&p, JSON_BUILD_OBJECT(
+                                     JSON_BUILD_PAIR_NULL("patterns"),
+                                     JSON_BUILD_PAIR_NULL("accounting"))) >= 0);
+        list_unit_metrics(m, c, p, /* more= */ true, &r);
+        assert_se(!r.error_id);
+        assert_se(r.n_units == N_UNITS);
+        replies_done(&r);
+        p = json_variant_unref(p);
+
+        /* None, the final reply carries no unit then */
+        assert_se(json_build(&p, JSON_BUILD_OBJECT(
+                                     JSON_BUILD_PAIR_STRV("patterns", STRV_MAKE("nomatch-*.service")))) >= 0);
+        list_unit_metrics(m, c, p, /* more= */ true, &r);
+        assert_se(!r.error_id);
+        assert_se(r.n_units == 0);
+        replies_done(&r);
+        p = json_variant_unref(p);
+
+        /* Parameters of the wrong type */
+        assert_se(json_build(&p, JSON_BUILD_OBJECT(
+                                     JSON_BUILD_PAIR_STRING("accounting", "yes"))) >= 0);
+        list_unit_metrics(m, c, p, /* more= */ true, &r);
+        assert_se(streq_ptr(r.error_id, VARLINK_ERROR_INVALID_PARAMETER));
+        replies_done(&r);
+        p = json_variant_unref(p);
+
+        /* Without the "more" flag */
+        list_unit_metrics(m, c, NULL, /* more= */ false, &r);
+        assert_se(streq_ptr(r.error_id, VARLINK_ERROR_EXPECTED_MORE));
+
+        assert_se(hashmap_isempty(m->varlink_unit_metrics));
+}
+
+static int on_first_unit_metrics(Varlink *link, JsonVariant *parameters, const char *error_id, VarlinkReplyFlags flags, void *userdata) {
+        bool *got = ASSERT_PTR(userdata);
+
+        *got = true;
+        return 0;
+}
+
+TEST(list_unit_metrics_disconnect) {
+        _cleanup_(varlink_server_unrefp) VarlinkServer *s = NULL;
+        _cleanup_(varlink_unrefp) Varlink *c = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        bool got = false;
+
+        m = setup(&s, &c);
+        if (!m)
+                return;
+
+        /* The client goes away in the middle of the listing, which needs to be cleaned up */
+        varlink_set_userdata(c, &got);
+        assert_se(varlink_bind_reply(c, on_first_unit_metrics) >= 0);
+        assert_se(varlink_observe(c, "io.systemd.Manager.ListUnitMetrics", NULL) >= 0);
+
+        while (!got)
+                assert_se(sd_event_run(m->event, 5 * USEC_PER_SEC) > 0);
+
+        assert_se(!hashmap_isempty(m->varlink_unit_metrics));
+
+        c = varlink_close_unref(c);
+
+        while (varlink_server_current_connections(s) > 0)
+                assert_se(sd_event_run(m->event, 5 * USEC_PER_SEC) > 0);
+
+        assert_se(hashmap_isempty(m->varlink_unit_metrics));
+}
+
+static int intro(void) {
+        if (enter_cgroup_subroot(NULL) == -ENOMEDIUM)
+                return log_tests_skipped("cgroupfs not available");
+
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+        assert_se(mkdtemp_malloc("/tmp/test-core-varlink-XXXXXX", &unit_dir) >= 0);
+        assert_se(set_unit_path(unit_dir) >= 0);
+
+        return EXIT_SUCCESS;
+}
+
+DEFINE_TEST_MAIN_WITH_INTRO(LOG_DEBUG, intro);
@@ -0,0 +1,154 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "dirent-util.h"
+#include "executor-pool.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "iovec-util.h"
+#include "memfd-util.h"
+#include "parse-util.h"
+#include "process-util.h"
+#include "socket-util.h"
+#include "string-util.h"
+#include "tests.h"
+
+/* The numbers the fds had in the "manager". Those in the lower range collide with whatever the receiving
+ * executor has open, or gets the fds at, and the last one lies beyond anything it has open. */
+static const int targets[] = { 8, 7, 6, 5, 4, 3, 42 };
+
+static int make_memfd(const char *contents) {
+        _cleanup_close_ int fd = -EBADF;
+
+        fd = memfd_new("test-executor-pool");
+        assert_se(fd >= 0);
+        assert_se(write(fd, contents, strlen(contents)) == (ssize_t) strlen(contents));
+
+        return TAKE_FD(fd);
+}
+
+static void send_message(int socket_fd, const int *fd_targets, size_t n_targets) {
+        _cleanup_free_ char *serialization = NULL;
+        int fds[ELEMENTSOF(targets) + 1];
+        ExecutorPoolMessage message = {
+                .log_level = log_get_max_level(),
+                .log_target = log_get_target(),
+        };
+        size_t n_fds = 0;
+
+        assert_se(n_targets <= ELEMENTSOF(targets));
+
+        /* Each fd has its intended number as contents, and the serialization lists them all */
+        for (size_t i = 0; i < n_targets; i++) {
+                char buf[DECIMAL_STR_MAX(int)];
+
+                xsprintf(buf, "%i", fd_targets[i]);
+                assert_se(strextend_with_separator(&serialization, "\n", buf));
+
+                message.fds[i] = fd_targets[i];
+                assert_se((fds[1 + i] = make_memfd(buf)) >= 0);
+        }
+
+        assert_se((fds[0] = make_memfd(strempty(serialization))) >= 0);
+        assert_se(lseek(fds[0], 0, SEEK_SET) == 0);
+        n_fds = n_targets + 1;
+
+        assert_se(send_many_fds_iov(
+                                  socket_fd,
+                                  fds, n_fds,
+                                  &IOVEC_MAKE(&message, offsetof(ExecutorPoolMessage, fds) + n_targets * sizeof(int)), 1,
+                                  MSG_DONTWAIT) >= 0);
+
+        close_many(fds, n_fds);
+}
+
+static void check_received(FILE *f) {
+        _cleanup_closedir_ DIR *d = NULL;
+        size_t n_seen = 0;
+
+        /* Every fd needs to be at its number, refer to the right file, and be inheritable */
+        for (;;) {
+                _cleanup_free_ char *line = NULL;
+                char contents[DECIMAL_STR_MAX(int)] = {};
+                int fd;
+
+                assert_se(read_line(f, LONG_LINE_MAX, &line) >= 0);
+                if (isempty(line))
+                        break;
+
+                assert_se(safe_atoi(line, &fd) >= 0);
+                assert_se(fd > STDERR_FILENO);
+                assert_se(fd < fileno(f));
+
+                assert_se(pread(fd, contents, sizeof(contents) - 1, 0) > 0);
+                assert_se(streq(contents, line));
+                assert_se(fcntl(fd, F_GETFD) == 0);
+
+                n_seen++;
+        }
+
+        assert_se(n_seen == ELEMENTSOF(targets));
+
+        /* Nothing else may be left open: no copies, and not the socket */
+        assert_se(d = opendir("/proc/self/fd"));
+        FOREACH_DIRENT(de, d, assert_not_reached()) {
+                int fd;
+
+                assert_se(safe_atoi(de->d_name, &fd) >= 0);
+                if (fd <= STDERR_FILENO || fd == fileno(f) || fd == dirfd(d))
+                        continue;
+
+                bool found = false;
+                FOREACH_ARRAY(t, targets, ELEMENTSOF(targets))
+                        found = found || *t == fd;
+                assert_se(found);
+        }
+}
+
+TEST(executor_pool_receive) {
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR;
+        int r;
+
+        assert_se(socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, pair) >= 0);
+        send_message(pair[0], targets, ELEMENTSOF(targets));
+
+        /* Receive in a child that has nothing open but stdio and the socket, so that the socket and the
+         * received fds occupy the numbers the fds need to be moved to. */
+        r = safe_fork_full("(receive)",
+                           /* stdio_fds= */ NULL,
+                           &pair[1], 1,
+                           FORK_CLOSE_ALL_FDS|FORK_DEATHSIG_SIGTERM|FORK_LOG|FORK_WAIT,
+                           NULL);
+        assert_se(r >= 0);
+        if (r == 0) {
+                _cleanup_fclose_ FILE *f = NULL;
+
+                assert_se(executor_pool_receive(pair[1], &f) > 0);
+
+                check_received(f);
+                _exit(EXIT_SUCCESS);
+        }
+}
+
+TEST(executor_pool_receive_invalid) {
+        _cleanup_fclose_ FILE *f = NULL;
+        int pair[2];
+
+        /* The fds can't be moved onto stdio */
+        assert_se(socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, pair) >= 0);
+        send_message(pair[0], (const int[]) { 7, STDERR_FILENO }, 2);
+        safe_close(pair[0]);
+        assert_se(executor_pool_receive(pair[1], &f) == -EBADMSG);
+        assert_se(fcntl(STDERR_FILENO, F_GETFD) >= 0);
+
+        /* The manager went away without passing anything on */
+        assert_se(socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, pair) >= 0);
+        safe_close(pair[0]);
+        assert_se(executor_pool_receive(pair[1], &f) == 0);
+        assert_se(!f);
+}
+
+DEFINE_TEST_MAIN(LOG_DEBUG);
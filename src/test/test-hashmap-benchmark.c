@@ -0,0 +1,183 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "parse-util.h"
+#include "random-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Measures the basic operations on hashmaps of different sizes and key types, both with the SipHash based
+ * and the fast hash_ops, so that changes to the implementation can be compared. Pass the decimal exponent of the largest size to test as argument, e.g. 7
+ * for 10^7 entries. */
+
+#define OPS_MIN 1000000U
+
+static unsigned arg_max_exponent;
+
+typedef enum KeyType {
+        KEY_PTR,
+        KEY_UINT64,
+        KEY_STRING,
+        _KEY_TYPE_MAX,
+} KeyType;
+
+static const char* const key_type_table[_KEY_TYPE_MAX] = {
+        [KEY_PTR]    = "ptr",
+        [KEY_UINT64] = "uint64",
+        [KEY_STRING] = "string",
+};
+
+static const struct hash_ops* const key_hash_ops[2][_KEY_TYPE_MAX] = {
+        {
+                [KEY_PTR]    = &trivial_hash_ops,
+                [KEY_UINT64] = &uint64_hash_ops,
+                [KEY_STRING] = &string_hash_ops,
+        },
+        {
+                [KEY_PTR]    = &trivial_fast_hash_ops,
+                [KEY_UINT64] = &uint64_fast_hash_ops,
+                [KEY_STRING] = &string_fast_hash_ops,
+        },
+};
+
+typedef struct Keys {
+        KeyType type;
+        size_t n;
+        const void **present;   /* n keys to insert */
+        const void **absent;    /* n keys never inserted */
+        uint64_t *numbers;
+        char **strings;
+} Keys;
+
+static void keys_done(Keys *k) {
+        free(k->present);
+        free(k->absent);
+        free(k->numbers);
+        if (k->strings)
+                for (size_t i = 0; i < 2 * k->n; i++)
+                        free(k->strings[i]);
+        free(k->strings);
+}
+
+static void keys_init(Keys *k, KeyType type, size_t n) {
+        *k = (Keys) {
+                .type = type,
+                .n = n,
+        };
+
+        assert_se(k->present = new(const void*, n));
+        assert_se(k->absent = new(const void*, n));
+
+        switch (type) {
+
+        case KEY_PTR:
+                /* Small distinct integers, like the PIDs and fds that are used as keys a lot */
+                for (size_t i = 0; i < n; i++) {
+                        k->present[i] = UINT_TO_PTR(2 * i + 1);
+                        k->absent[i] = UINT_TO_PTR(2 * i + 2);
+                }
+                break;
+
+        case KEY_UINT64:
+                assert_se(k->numbers = new(uint64_t, 2 * n));
+                for (size_t i = 0; i < 2 * n; i++) {
+                        k->numbers[i] = random_u64();
+                        (i < n ? k->present : k->absent)[i % n] = k->numbers + i;
+                }
+                break;
+
+        case KEY_STRING:
+                /* Something that looks like unit names */
+                assert_se(k->strings = new(char*, 2 * n));
+                for (size_t i = 0; i < 2 * n; i++) {
+                        assert_se(asprintf(k->strings + i, "%s-%zu.service", i < n ? "unit" : "absent", i % n) >= 0);
+                        (i < n ? k->present : k->absent)[i % n] = k->strings[i];
+                }
+                break;
+
+        default:
+                assert_not_reached();
+        }
+
+        /* Look things up in a different order than they were inserted */
+        for (size_t i = n; i > 1; i--) {
+                size_t j = random_u64_range(i);
+                SWAP_TWO(k->absent[i - 1], k->absent[j]);
+        }
+}
+
+static void report(const Keys *k, bool fast, const char *op, usec_t t, size_t n_ops) {
+        log_info("%-7s %-4s %9zu  %-12s %7.1f ns/op",
+                 key_type_table[k->type], fast ? "fast" : "sip", k->n, op, (double) t * NSEC_PER_USEC / n_ops);
+}
+
+static void test_one(KeyType type, bool fast, size_t n) {
+        _cleanup_(keys_done) Keys k = {};
+        usec_t t_insert = 0, t_hit = 0, t_miss = 0, t_iterate = 0, t_remove = 0;
+        size_t rounds;
+
+        keys_init(&k, type, n);
+
+        /* Repeat small maps, so that the numbers are not dominated by noise */
+        rounds = DIV_ROUND_UP(OPS_MIN, n);
+
+        for (size_t r = 0; r < rounds; r++) {
+                _cleanup_hashmap_free_ Hashmap *h = NULL;
+                usec_t ts;
+                size_t c = 0;
+                void *v;
+
+                assert_se(h = hashmap_new(key_hash_ops[fast][type]));
+
+                ts = now(CLOCK_MONOTONIC);
+                for (size_t i = 0; i < n; i++)
+                        assert_se(hashmap_put(h, k.present[i], UINT_TO_PTR(i + 1)) > 0);
+                t_insert += now(CLOCK_MONOTONIC) - ts;
+
+                ts = now(CLOCK_MONOTONIC);
+                for (size_t i = 0; i < n; i++)
+                        assert_se(hashmap_get(h, k.present[n - i - 1]));
+                t_hit += now(CLOCK_MONOTONIC) - ts;
+
+                ts = now(CLOCK_MONOTONIC);
+                for (size_t i = 0; i < n; i++)
+                        assert_se(!hashmap_get(h, k.absent[i]));
+                t_miss += now(CLOCK_MONOTONIC) - ts;
+
+                ts = now(CLOCK_MONOTONIC);
+                HASHMAP_FOREACH(v, h)
+                        c++;
+                t_iterate += now(CLOCK_MONOTONIC) - ts;
+                assert_se(c == n);
+
+                ts = now(CLOCK_MONOTONIC);
+                for (size_t i = 0; i < n; i++)
+                        assert_se(hashmap_remove(h, k.present[i]));
+                t_remove += now(CLOCK_MONOTONIC) - ts;
+                assert_se(hashmap_isempty(h));
+        }
+
+        report(&k, fast, "insert", t_insert, rounds * n);
+        report(&k, fast, "lookup-hit", t_hit, rounds * n);
+        report(&k, fast, "lookup-miss", t_miss, rounds * n);
+        report(&k, fast, "iterate", t_iterate, rounds * n);
+        report(&k, fast, "remove", t_remove, rounds * n);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_INFO);
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &arg_max_exponent) >= 0 && arg_max_exponent >= 3);
+        else
+                arg_max_exponent = slow_tests_enabled() ? 7 : 4;
+
+        for (KeyType type = 0; type < _KEY_TYPE_MAX; type++)
+                for (size_t n = 1000, e = 3; e <= arg_max_exponent; n *= 10, e++)
+                        for (int fast = 0; fast < 2; fast++)
+                                test_one(type, fast, n);
+
+        return 0;
+}
@@ -3,6 +3,7 @@
 #include "alloc-util.h"
 #include "hashmap.h"
 #include "log.h"
+#include "memstream-util.h"
 #include "nulstr-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
@@ -655,6 +656,16 @@ static const struct hash_ops crippled_hashmap_ops = {
         .compare = trivial_compare_func,
 };
 
+static void colliding_hashmap_func(const void *p, struct siphash *state) {
+        return trivial_hash_func(NULL, state);
+}
+
+/* All entries end up in one long probe sequence, with displacements beyond what fits in a DIB byte */
+static const struct hash_ops colliding_hashmap_ops = {
+        .hash = colliding_hashmap_func,
+        .compare = trivial_compare_func,
+};
+
 TEST(hashmap_many) {
         Hashmap *h;
         unsigned i, j;
@@ -667,6 +678,8 @@ TEST(hashmap_many) {
         } tests[] = {
                 { "trivial_hashmap_ops",  NULL,                  slow ? 1 << 20 : 240 },
                 { "crippled_hashmap_ops", &crippled_hashmap_ops, slow ? 1 << 14 : 140 },
+                { "colliding_hashmap_ops", &colliding_hashmap_ops, slow ? 1 << 11 : 300 },
+                { "trivial_fast_hash_ops", &trivial_fast_hash_ops, slow ? 1 << 20 : 240 },
         };
 
         log_info("/* %s (%s) */", __func__, slow ? "slow" : "fast");
@@ -1001,6 +1014,53 @@ TEST(hashmap_dump_sorted) {
         assert_se(memcmp(vals, expected, n * sizeof(void*)) == 0);
 }
 
+/* The stats code is shared, and the type name would get mangled in the generated OrderedHashmap variant */
+#ifndef ORDERED
+TEST(hashmap_stats) {
+        _cleanup_hashmap_free_ Hashmap *m = NULL;
+        _cleanup_(memstream_done) MemStream ms = {};
+        _cleanup_free_ char *buf = NULL;
+        HashmapStats stats;
+        FILE *f;
+
+        hashmap_get_stats(NULL, &stats);
+        assert_se(stats.n_entries == 0 && stats.n_buckets == 0 && stats.max_dib == 0);
+
+        /* With a constant hash the n-th entry is n buckets away from where it wants to be */
+        assert_se(m = hashmap_new(&colliding_hashmap_ops));
+        for (unsigned i = 1; i <= 10; i++)
+                assert_se(hashmap_put(m, UINT_TO_PTR(i), UINT_TO_PTR(i)) == 1);
+
+        hashmap_get_stats(m, &stats);
+        assert_se(stats.n_entries == 10);
+        assert_se(stats.n_buckets >= 10);
+        assert_se(!stats.fast_hash);
+        assert_se(stats.max_dib == 9);
+        assert_se(stats.total_dib == 45);
+        assert_se(stats.dib_histogram[0] == 1);   /* 0 */
+        assert_se(stats.dib_histogram[1] == 1);   /* 1 */
+        assert_se(stats.dib_histogram[2] == 2);   /* 2-3 */
+        assert_se(stats.dib_histogram[3] == 4);   /* 4-7 */
+        assert_se(stats.dib_histogram[4] == 2);   /* 8-9 */
+
+        assert_se(f = memstream_init(&ms));
+        hashmap_dump_stats(m, f, "\t");
+        assert_se(memstream_finalize(&ms, &buf, NULL) >= 0);
+        log_debug("%s", buf);
+        assert_se(strstr(buf, "\tEntries: 10\n"));
+        assert_se(strstr(buf, "\tHash function: siphash24\n"));
+        assert_se(strstr(buf, "\tProbe length: mean 4.50, max 9\n"));
+        assert_se(strstr(buf, "\tProbe length 4-7: 4\n"));
+
+        m = hashmap_free(m);
+
+        assert_se(m = hashmap_new(&uint64_fast_hash_ops));
+        hashmap_get_stats(m, &stats);
+        assert_se(stats.fast_hash);
+        assert_se(stats.n_entries == 0 && stats.total_dib == 0);
+}
+#endif
+
 /* Signal to test-hashmap.c that tests from this compilation unit were run. */
 extern int n_extern_tests_run;
 TEST(ensure_extern_hashmap_tests) {
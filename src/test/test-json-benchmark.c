@@ -0,0 +1,274 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "json-cbor.h"
+#include "json.h"
+#include "parse-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "time-util.h"
+
+static usec_t arg_duration;
+
+static char* make_user_record(void) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        char *text;
+
+        /* Something that looks like a typical user record as passed around by userdb/homed */
+        assert_se(json_build(&v, JSON_BUILD_OBJECT(
+                        JSON_BUILD_PAIR("userName", JSON_BUILD_CONST_STRING("benchmarkuser")),
+                        JSON_BUILD_PAIR("realName", JSON_BUILD_CONST_STRING("Benchmark User of the Test Suite")),
+                        JSON_BUILD_PAIR("uid", JSON_BUILD_UNSIGNED(60123)),
+                        JSON_BUILD_PAIR("gid", JSON_BUILD_UNSIGNED(60123)),
+                        JSON_BUILD_PAIR("memberOf", JSON_BUILD_STRV(STRV_MAKE("wheel", "audio", "video", "systemd-journal", "libvirt"))),
+                        JSON_BUILD_PAIR("homeDirectory", JSON_BUILD_CONST_STRING("/home/benchmarkuser")),
+                        JSON_BUILD_PAIR("shell", JSON_BUILD_CONST_STRING("/bin/bash")),
+                        JSON_BUILD_PAIR("disposition", JSON_BUILD_CONST_STRING("regular")),
+                        JSON_BUILD_PAIR("lastChangeUSec", JSON_BUILD_UNSIGNED(1700000000123456)),
+                        JSON_BUILD_PAIR("lastPasswordChangeUSec", JSON_BUILD_UNSIGNED(1700000000123456)),
+                        JSON_BUILD_PAIR("locked", JSON_BUILD_BOOLEAN(false)),
+                        JSON_BUILD_PAIR("diskSize", JSON_BUILD_UNSIGNED(UINT64_C(256) * 1024 * 1024 * 1024)),
+                        JSON_BUILD_PAIR("service", JSON_BUILD_CONST_STRING("io.systemd.Home")),
+                        JSON_BUILD_PAIR("privileged", JSON_BUILD_OBJECT(
+                                        JSON_BUILD_PAIR("hashedPassword", JSON_BUILD_STRV(STRV_MAKE("$y$j9T$wRt3y0cVh1lSOTDu2NB8m.$9Tx6Ts2qLAAhPCBnrhJKgpW6hsGqpNuDKF6oQKGPiq3"))))),
+                        JSON_BUILD_PAIR("perMachine", JSON_BUILD_ARRAY(
+                                        JSON_BUILD_OBJECT(
+                                                JSON_BUILD_PAIR("matchMachineId", JSON_BUILD_CONST_STRING("a1b2c3d4e5f60718293a4b5c6d7e8f90")),
+                                                JSON_BUILD_PAIR("diskQuota", JSON_BUILD_UNSIGNED(UINT64_C(10) * 1024 * 1024 * 1024)),
+                                                JSON_BUILD_PAIR("nice", JSON_BUILD_INTEGER(-5))),
+                                        JSON_BUILD_OBJECT(
+                                                JSON_BUILD_PAIR("matchHostname", JSON_BUILD_CONST_STRING("workstation.example.com")),
+                                                JSON_BUILD_PAIR("cpuWeight", JSON_BUILD_UNSIGNED(200)),
+                                                JSON_BUILD_PAIR("ioWeight", JSON_BUILD_UNSIGNED(300))))),
+                        JSON_BUILD_PAIR("binding", JSON_BUILD_OBJECT(
+                                        JSON_BUILD_PAIR("a1b2c3d4e5f60718293a4b5c6d7e8f90", JSON_BUILD_OBJECT(
+                                                        JSON_BUILD_PAIR("imagePath", JSON_BUILD_CONST_STRING("/home/benchmarkuser.home")),
+                                                        JSON_BUILD_PAIR("storage", JSON_BUILD_CONST_STRING("luks")),
+                                                        JSON_BUILD_PAIR("fileSystemType", JSON_BUILD_CONST_STRING("btrfs")),
+                                                        JSON_BUILD_PAIR("fileSystemUuid", JSON_BUILD_CONST_STRING("5b0d6a4c-1e3f-4b5a-9c8d-7e6f5a4b3c2d")),
+                                                        JSON_BUILD_PAIR("luksUuid", JSON_BUILD_CONST_STRING("0f1e2d3c-4b5a-6978-8796-a5b4c3d2e1f0")),
+                                                        JSON_BUILD_PAIR("partitionUuid", JSON_BUILD_CONST_STRING("11223344-5566-7788-99aa-bbccddeeff00")),
+                                                        JSON_BUILD_PAIR("uid", JSON_BUILD_UNSIGNED(60123)),
+                                                        JSON_BUILD_PAIR("gid", JSON_BUILD_UNSIGNED(60123)))))),
+                        JSON_BUILD_PAIR("status", JSON_BUILD_OBJECT(
+                                        JSON_BUILD_PAIR("a1b2c3d4e5f60718293a4b5c6d7e8f90", JSON_BUILD_OBJECT(
+                                                        JSON_BUILD_PAIR("diskUsage", JSON_BUILD_UNSIGNED(UINT64_C(12345678901))),
+                                                        JSON_BUILD_PAIR("diskFree", JSON_BUILD_UNSIGNED(UINT64_C(98765432109))),
+                                                        JSON_BUILD_PAIR("diskSize", JSON_BUILD_UNSIGNED(UINT64_C(111111111010))),
+                                                        JSON_BUILD_PAIR("diskCeiling", JSON_BUILD_REAL(0.95)),
+                                                        JSON_BUILD_PAIR("state", JSON_BUILD_CONST_STRING("active")),
+                                                        JSON_BUILD_PAIR("service", JSON_BUILD_CONST_STRING("io.systemd.Home")),
+                                                        JSON_BUILD_PAIR("signedLocally", JSON_BUILD_BOOLEAN(true)))))))) >= 0);
+
+        assert_se(json_variant_format(v, 0, &text) >= 0);
+        return text;
+}
+
+static char* make_large_array(size_t n) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        char *text;
+
+        /* Something that looks like a long list of records, e.g. a userdb enumeration */
+        for (size_t i = 0; i < n; i++) {
+                _cleanup_free_ char *name = NULL;
+
+                assert_se(asprintf(&name, "user-%zu", i) >= 0);
+
+                assert_se(json_variant_append_arrayb(&v, JSON_BUILD_OBJECT(
+                                        JSON_BUILD_PAIR("userName", JSON_BUILD_STRING(name)),
+                                        JSON_BUILD_PAIR("uid", JSON_BUILD_UNSIGNED(10000 + i)),
+                                        JSON_BUILD_PAIR("gid", JSON_BUILD_UNSIGNED(10000 + i)),
+                                        JSON_BUILD_PAIR("realName", JSON_BUILD_CONST_STRING("Some Enumerated User")),
+                                        JSON_BUILD_PAIR("homeDirectory", JSON_BUILD_CONST_STRING("/home/enumerated")),
+                                        JSON_BUILD_PAIR("disposition", JSON_BUILD_CONST_STRING("regular")),
+                                        JSON_BUILD_PAIR("locked", JSON_BUILD_BOOLEAN(false)))) >= 0);
+        }
+
+        assert_se(json_variant_format(v, 0, &text) >= 0);
+        return text;
+}
+
+static void parse_tree(const char *text) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+
+        assert_se(json_parse(text, 0, &v, NULL, NULL) >= 0);
+}
+
+static void parse_arena(const char *text) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+
+        assert_se(json_parse(text, JSON_PARSE_ARENA, &v, NULL, NULL) >= 0);
+}
+
+static void test_parse_one(const char *label, const char *mode, const char *text, void (*parse)(const char *text)) {
+        size_t n = 0, total = 0;
+        usec_t t, dt;
+
+        t = now(CLOCK_MONOTONIC);
+        do {
+                for (unsigned k = 0; k < 100; k++) {
+                        parse(text);
+                        total += strlen(text);
+                        n++;
+                }
+
+                dt = now(CLOCK_MONOTONIC) - t;
+        } while (dt < arg_duration);
+
+        log_info("%s: parsed (%s) %zu documents of %zu bytes in %s, %.2f µs/document, %.2f MiB/s",
+                 label, mode, n, strlen(text), FORMAT_TIMESPAN(dt, USEC_PER_MSEC),
+                 (double) dt / n, total / 1024. / 1024. / ((double) dt / USEC_PER_SEC));
+}
+
+static void test_format_one(const char *label, const char *text) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        size_t n = 0, total = 0;
+        usec_t t, dt;
+
+        assert_se(json_parse(text, 0, &v, NULL, NULL) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        do {
+                for (unsigned k = 0; k < 100; k++) {
+                        _cleanup_free_ char *s = NULL;
+
+                        assert_se(json_variant_format(v, 0, &s) >= 0);
+                        total += strlen(s);
+                        n++;
+                }
+
+                dt = now(CLOCK_MONOTONIC) - t;
+        } while (dt < arg_duration);
+
+        log_info("%s: formatted %zu documents in %s, %.2f µs/document, %.2f MiB/s",
+                 label, n, FORMAT_TIMESPAN(dt, USEC_PER_MSEC),
+                 (double) dt / n, total / 1024. / 1024. / ((double) dt / USEC_PER_SEC));
+}
+
+static void test_cbor_one(const char *label, const char *text) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        _cleanup_free_ void *data = NULL;
+        size_t size, n = 0;
+        usec_t t, dt;
+
+        assert_se(json_parse(text, 0, &v, NULL, NULL) >= 0);
+        assert_se(json_variant_format_cbor(v, &data, &size) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        do {
+                for (unsigned k = 0; k < 100; k++) {
+                        _cleanup_free_ void *d = NULL;
+                        size_t s;
+
+                        assert_se(json_variant_format_cbor(v, &d, &s) >= 0);
+                        n++;
+                }
+
+                dt = now(CLOCK_MONOTONIC) - t;
+        } while (dt < arg_duration);
+
+        log_info("%s: formatted %zu documents as CBOR (%zu bytes instead of %zu) in %s, %.2f µs/document",
+                 label, n, size, strlen(text), FORMAT_TIMESPAN(dt, USEC_PER_MSEC), (double) dt / n);
+
+        n = 0;
+        t = now(CLOCK_MONOTONIC);
+        do {
+                for (unsigned k = 0; k < 100; k++) {
+                        _cleanup_(json_variant_unrefp) JsonVariant *w = NULL;
+
+                        assert_se(json_parse_cbor(data, size, &w) >= 0);
+                        n++;
+                }
+
+                dt = now(CLOCK_MONOTONIC) - t;
+        } while (dt < arg_duration);
+
+        log_info("%s: parsed (cbor) %zu documents in %s, %.2f µs/document",
+                 label, n, FORMAT_TIMESPAN(dt, USEC_PER_MSEC), (double) dt / n);
+}
+
+static void test_dispatch_one(const char *label, const char *text) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        _cleanup_free_ JsonDispatch *table = NULL;
+        _cleanup_free_ uint64_t *values = NULL;
+        size_t n = 0, m = 0;
+        usec_t t, dt;
+
+        assert_se(json_parse(text, 0, &v, NULL, NULL) >= 0);
+
+        /* A dispatch table covering all fields, in reverse order, as if written without looking at the data */
+        m = json_variant_elements(v) / 2;
+        assert_se(table = new0(JsonDispatch, m + 1));
+        assert_se(values = new(uint64_t, m));
+        for (size_t i = 0; i < m; i++)
+                table[i] = (JsonDispatch) {
+                        .name = json_variant_string(json_variant_by_index(v, (m - 1 - i) * 2)),
+                        .type = _JSON_VARIANT_TYPE_INVALID,
+                        .callback = json_dispatch_uint64,
+                        .offset = i * sizeof(uint64_t),
+                };
+
+        t = now(CLOCK_MONOTONIC);
+        do {
+                for (unsigned k = 0; k < 100; k++) {
+                        assert_se(json_dispatch(v, table, 0, values) >= 0);
+                        n++;
+                }
+
+                dt = now(CLOCK_MONOTONIC) - t;
+        } while (dt < arg_duration);
+
+        log_info("%s: dispatched %zu fields %zu times in %s, %.2f µs/dispatch",
+                 label, m, n, FORMAT_TIMESPAN(dt, USEC_PER_MSEC), (double) dt / n);
+}
+
+static char* make_wide_object(size_t n) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        char *text;
+
+        /* An object with many fields in no particular order, like an OCI runtime config */
+        for (size_t i = 0; i < n; i++) {
+                _cleanup_free_ char *name = NULL;
+
+                assert_se(asprintf(&name, "someFieldName%zu", (i * 7919) % n) >= 0);
+                assert_se(json_variant_set_field_unsigned(&v, name, i) >= 0);
+        }
+
+        assert_se(json_variant_format(v, 0, &text) >= 0);
+        return text;
+}
+
+static void test_one(const char *label, const char *text) {
+        test_parse_one(label, "tree", text, parse_tree);
+        test_parse_one(label, "arena", text, parse_arena);
+        test_format_one(label, text);
+        test_cbor_one(label, text);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_free_ char *record = NULL, *array = NULL, *wide = NULL;
+
+        test_setup_logging(LOG_INFO);
+
+        if (argc >= 2) {
+                unsigned x;
+
+                assert_se(safe_atou(argv[1], &x) >= 0);
+                arg_duration = x * USEC_PER_SEC;
+        } else
+                arg_duration = slow_tests_enabled() ?
+                        2 * USEC_PER_SEC : USEC_PER_SEC / 50;
+
+        record = make_user_record();
+        array = make_large_array(1000);
+        wide = make_wide_object(100);
+
+        test_one("varlink-message", "{\"method\":\"io.systemd.UserDatabase.GetUserRecord\",\"parameters\":{\"userName\":\"benchmarkuser\",\"service\":\"io.systemd.Multiplexer\"}}");
+        test_one("user-record", record);
+        test_one("enumeration", array);
+        test_one("wide-object", wide);
+        test_dispatch_one("wide-object", wide);
+
+        return 0;
+}
@@ -1,11 +1,14 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include <float.h>
+#include <pthread.h>
 
 #include "alloc-util.h"
 #include "escape.h"
 #include "fd-util.h"
 #include "fileio.h"
+#include "hexdecoct.h"
+#include "json-cbor.h"
 #include "json-internal.h"
 #include "json.h"
 #include "math-util.h"
@@ -80,6 +83,8 @@ typedef void (*Test)(JsonVariant *);
 static void test_variant_one(const char *data, Test test) {
         _cleanup_(json_variant_unrefp) JsonVariant *v = NULL, *w = NULL;
         _cleanup_free_ char *s = NULL;
+        _cleanup_free_ void *cbor = NULL;
+        size_t cbor_size;
         int r;
 
         _cleanup_free_ char *cdata;
@@ -104,9 +109,30 @@ static void test_variant_one(const char *data, Test test) {
         assert_se(json_variant_has_type(w, json_variant_type(v)));
         assert_se(json_variant_equal(v, w));
 
-        s = mfree(s);
         w = json_variant_unref(w);
 
+        FOREACH_ARRAY(flags, ((const JsonParseFlags[]) { JSON_PARSE_ARENA, JSON_PARSE_ARENA|JSON_PARSE_SENSITIVE }), 2) {
+                _cleanup_free_ char *t = NULL;
+
+                r = json_parse(data, *flags, &w, NULL, NULL);
+                assert_se(r == 0);
+                assert_se(w);
+                assert_se(json_variant_equal(v, w));
+                assert_se(json_variant_is_sensitive(w) == FLAGS_SET(*flags, JSON_PARSE_SENSITIVE));
+
+                assert_se(json_variant_format(w, 0, &t) >= 0);
+                assert_se(streq(s, t));
+
+                w = json_variant_unref(w);
+        }
+
+        assert_se(json_variant_format_cbor(v, &cbor, &cbor_size) >= 0);
+        assert_se(json_parse_cbor(cbor, cbor_size, &w) >= 0);
+        assert_se(json_variant_equal(v, w));
+        w = json_variant_unref(w);
+
+        s = mfree(s);
+
         r = json_variant_format(v, JSON_FORMAT_PRETTY, &s);
         assert_se(r >= 0);
         assert_se(s);
@@ -813,4 +839,278 @@ TEST(json_dispatch) {
         assert_se(foobar.l == INT16_MIN);
 }
 
+typedef struct IndexData {
+        uint64_t first, last;
+        unsigned unknown;
+} IndexData;
+
+static int count_unknown(const char *name, JsonVariant *variant, JsonDispatchFlags flags, void *userdata) {
+        IndexData *d = ASSERT_PTR(userdata);
+
+        d->unknown++;
+        return 0;
+}
+
+static void test_object_index_one(JsonVariant *v, size_t n) {
+        IndexData data = {};
+
+        assert_se(!json_variant_is_sorted(v));
+
+        for (size_t i = 0; i < n; i++) {
+                _cleanup_free_ char *k = NULL;
+                JsonVariant *key;
+
+                assert_se(asprintf(&k, "field-%zu", i) >= 0);
+                assert_se(json_variant_unsigned(json_variant_by_key_full(v, k, &key)) == i);
+                assert_se(streq(json_variant_string(key), k));
+        }
+
+        assert_se(!json_variant_by_key(v, "field-"));
+        assert_se(!json_variant_by_key(v, "nope"));
+
+        /* The first of duplicate keys is found, and json_dispatch() complains about the second */
+        assert_se(json_variant_unsigned(json_variant_by_key(v, "dup")) == 1);
+
+        const JsonDispatch table[] = {
+                { "dup",       _JSON_VARIANT_TYPE_INVALID, NULL, 0 },
+                { POINTER_MAX, _JSON_VARIANT_TYPE_INVALID, NULL, 0 },
+                {}
+        };
+        assert_se(json_dispatch(v, table, 0, NULL) == -ENOTUNIQ);
+
+        /* Named entries are found via the index, everything else must still reach the 'bad' callback */
+        const JsonDispatch table_named[] = {
+                { "field-0",  _JSON_VARIANT_TYPE_INVALID, json_dispatch_uint64, offsetof(IndexData, first), JSON_MANDATORY  },
+                { "field-99", _JSON_VARIANT_TYPE_INVALID, json_dispatch_uint64, offsetof(IndexData, last),  JSON_MANDATORY  },
+                { "dup",      _JSON_VARIANT_TYPE_INVALID, NULL,                 0,                          JSON_PERMISSIVE },
+                {}
+        };
+        assert_se(json_dispatch_full(v, table_named, count_unknown, 0, &data, NULL) >= 0);
+        assert_se(data.first == 0);
+        assert_se(data.last == 99);
+        assert_se(data.unknown == n - 2);
+}
+
+TEST(object_index) {
+        _cleanup_(json_variant_unrefp) JsonVariant *b = NULL, *v = NULL, *w = NULL;
+        _cleanup_free_ char *text = NULL;
+        const size_t n = 200;
+
+        /* Descending order, so that the object isn't sorted and lookups go through the index */
+        for (size_t i = n; i > 0; i--) {
+                _cleanup_free_ char *k = NULL;
+
+                assert_se(asprintf(&k, "field-%zu", i - 1) >= 0);
+                assert_se(json_variant_set_field_unsigned(&b, k, i - 1) >= 0);
+        }
+
+        /* Replace the closing brace by some duplicate keys */
+        assert_se(json_variant_format(b, 0, &text) >= 0);
+        text[strlen(text) - 1] = 0;
+        assert_se(strextend(&text, ",\"dup\":1,\"dup\":2}"));
+
+        assert_se(json_parse(text, 0, &v, NULL, NULL) >= 0);
+        test_object_index_one(v, n);
+
+        assert_se(json_parse(text, JSON_PARSE_ARENA, &w, NULL, NULL) >= 0);
+        test_object_index_one(w, n);
+
+        assert_se(json_variant_equal(v, w));
+}
+
+static void *object_index_thread(void *p) {
+        test_object_index_one(p, 200);
+        return NULL;
+}
+
+TEST(object_index_threads) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        _cleanup_free_ char *text = NULL;
+        pthread_t threads[4];
+
+        /* The same object may be looked at from multiple threads, e.g. a reply sent by the threaded
+         * varlink server, and lookups mustn't modify it */
+        assert_se(text = strdup("{"));
+        for (size_t i = 200; i > 0; i--)
+                assert_se(strextendf(&text, "\"field-%zu\":%zu,", i - 1, i - 1) >= 0);
+        assert_se(strextend(&text, "\"dup\":1,\"dup\":2}"));
+
+        assert_se(json_parse(text, 0, &v, NULL, NULL) >= 0);
+
+        FOREACH_ARRAY(t, threads, ELEMENTSOF(threads))
+                assert_se(pthread_create(t, NULL, object_index_thread, v) == 0);
+        FOREACH_ARRAY(t, threads, ELEMENTSOF(threads))
+                assert_se(pthread_join(*t, NULL) == 0);
+}
+
+static void test_cbor_one(const char *json, const char *hex) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL, *w = NULL;
+        _cleanup_free_ void *cbor = NULL, *expected = NULL;
+        size_t cbor_size, expected_size;
+
+        log_info("/* %s json=%s cbor=%s */", __func__, json, hex);
+
+        assert_se(json_parse(json, 0, &v, NULL, NULL) >= 0);
+        assert_se(unhexmem(hex, SIZE_MAX, &expected, &expected_size) >= 0);
+
+        assert_se(json_variant_format_cbor(v, &cbor, &cbor_size) >= 0);
+        assert_se(memcmp_nn(cbor, cbor_size, expected, expected_size) == 0);
+
+        assert_se(json_parse_cbor(expected, expected_size, &w) >= 0);
+        assert_se(json_variant_equal(v, w));
+}
+
+static void test_cbor_parse_one(const char *hex, const char *json, int ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL, *w = NULL;
+        _cleanup_free_ void *data = NULL;
+        size_t size;
+
+        log_info("/* %s cbor=%s */", __func__, hex);
+
+        assert_se(unhexmem(hex, SIZE_MAX, &data, &size) >= 0);
+        assert_se(json_parse_cbor(data, size, &w) == ret);
+
+        if (ret < 0)
+                return;
+
+        assert_se(json_parse(json, 0, &v, NULL, NULL) >= 0);
+        assert_se(json_variant_equal(v, w));
+}
+
+TEST(cbor) {
+        /* The examples from RFC 8949, Appendix A */
+        test_cbor_one("0", "00");
+        test_cbor_one("1", "01");
+        test_cbor_one("10", "0a");
+        test_cbor_one("23", "17");
+        test_cbor_one("24", "1818");
+        test_cbor_one("100", "1864");
+        test_cbor_one("1000", "1903e8");
+        test_cbor_one("1000000", "1a000f4240");
+        test_cbor_one("1000000000000", "1b000000e8d4a51000");
+        test_cbor_one("18446744073709551615", "1bffffffffffffffff");
+        test_cbor_one("-1", "20");
+        test_cbor_one("-10", "29");
+        test_cbor_one("-100", "3863");
+        test_cbor_one("-1000", "3903e7");
+        test_cbor_one("-9223372036854775808", "3b7fffffffffffffff");
+        test_cbor_one("1.1", "fb3ff199999999999a");
+        test_cbor_one("100000.0", "fa47c35000");
+        test_cbor_one("-4.1", "fbc010666666666666");
+        test_cbor_one("false", "f4");
+        test_cbor_one("true", "f5");
+        test_cbor_one("null", "f6");
+        test_cbor_one("\"\"", "60");
+        test_cbor_one("\"a\"", "6161");
+        test_cbor_one("\"IETF\"", "6449455446");
+        test_cbor_one("\"\\u00fc\"", "62c3bc");
+        test_cbor_one("[]", "80");
+        test_cbor_one("[1,2,3]", "83010203");
+        test_cbor_one("[1,[2,3],[4,5]]", "8301820203820405");
+        test_cbor_one("{}", "a0");
+        test_cbor_one("{\"a\":1,\"b\":[2,3]}", "a26161016162820203");
+
+        /* Half precision floats are never generated, but accepted */
+        test_cbor_parse_one("f93e00", "1.5", 0);
+        test_cbor_parse_one("f9c400", "-4.0", 0);
+        test_cbor_parse_one("f90001", "5.9604644775390625e-8", 0);
+        test_cbor_parse_one("f97c00", "null", 0);
+
+        /* Things that have no JSON equivalent */
+        test_cbor_parse_one("40", NULL, -EOPNOTSUPP);
+        test_cbor_parse_one("c074323031332d30332d32315432303a30343a30305a", NULL, -EOPNOTSUPP);
+        test_cbor_parse_one("f7", NULL, -EOPNOTSUPP);
+        test_cbor_parse_one("9f018202039f0405ffff", NULL, -EOPNOTSUPP);
+        test_cbor_parse_one("3bffffffffffffffff", NULL, -ERANGE);
+        test_cbor_parse_one("a10102", NULL, -EBADMSG);
+        test_cbor_parse_one("616100", NULL, -EBADMSG);
+        test_cbor_parse_one("6100", NULL, -EINVAL);
+        test_cbor_parse_one("61ff", NULL, -EUCLEAN);
+
+        /* Truncated or otherwise broken data */
+        test_cbor_parse_one("", NULL, -EBADMSG);
+        test_cbor_parse_one("1903", NULL, -EBADMSG);
+        test_cbor_parse_one("6449", NULL, -EBADMSG);
+        test_cbor_parse_one("8301", NULL, -EBADMSG);
+        test_cbor_parse_one("9bffffffffffffffff", NULL, -EBADMSG);
+        test_cbor_parse_one("1c", NULL, -EBADMSG);
+}
+
+TEST(parse_arena) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL, *w = NULL, *e = NULL;
+        const char *text, *p, *source;
+        unsigned line, column;
+
+        text = "{\"a\":[1,2,{\"x\":\"a long string value\",\"y\":\"short\"}],\n"
+               " \"b\":{}, \"c\":[], \"d\":[true,false,null,-1.5,18446744073709551615]}";
+
+        assert_se(json_parse_with_source(text, "regular", 0, &v, NULL, NULL) >= 0);
+        assert_se(json_parse_with_source(text, "arena", JSON_PARSE_ARENA, &w, NULL, NULL) >= 0);
+        assert_se(json_variant_equal(v, w));
+        assert_se(json_variant_is_sorted(w));
+        assert_se(json_variant_is_normalized(w) == json_variant_is_normalized(v));
+
+        /* Source information matches the regular parser */
+        assert_se(json_variant_get_source(json_variant_by_key(w, "d"), &source, &line, &column) >= 0);
+        assert_se(streq(source, "arena"));
+        assert_se(line == 2);
+        assert_se(column == 22);
+        assert_se(json_variant_get_source(json_variant_by_key(v, "d"), &source, &line, &column) >= 0);
+        assert_se(line == 2);
+        assert_se(column == 22);
+
+        /* Elements keep the arena alive */
+        assert_se(e = json_variant_ref(json_variant_by_index(json_variant_by_key(w, "a"), 2)));
+        w = json_variant_unref(w);
+        assert_se(streq(json_variant_string(json_variant_by_key(e, "x")), "a long string value"));
+        assert_se(streq(json_variant_string(json_variant_by_key(e, "y")), "short"));
+
+        /* Appending to an array from an arena must copy it */
+        assert_se(json_parse("[\"first element\"]", JSON_PARSE_ARENA, &w, NULL, NULL) >= 0);
+        assert_se(json_variant_append_array(&w, e) >= 0);
+        assert_se(json_variant_elements(w) == 2);
+        assert_se(streq(json_variant_string(json_variant_by_index(w, 0)), "first element"));
+        assert_se(json_variant_equal(json_variant_by_index(w, 1), e));
+        w = json_variant_unref(w);
+        e = json_variant_unref(e);
+        v = json_variant_unref(v);
+
+        /* Scalars and empty containers */
+        assert_se(json_parse("  \"foo\"", JSON_PARSE_ARENA, &w, NULL, NULL) >= 0);
+        assert_se(streq(json_variant_string(w), "foo"));
+        w = json_variant_unref(w);
+        assert_se(json_parse("{ }", JSON_PARSE_ARENA, &w, NULL, NULL) >= 0);
+        assert_se(json_variant_is_blank_object(w));
+        w = json_variant_unref(w);
+
+        /* Invalid documents */
+        assert_se(json_parse("", JSON_PARSE_ARENA, &w, NULL, NULL) == -EINVAL);
+        assert_se(json_parse("[1,]", JSON_PARSE_ARENA, &w, NULL, NULL) == -EINVAL);
+        assert_se(json_parse("{\"a\" 1}", JSON_PARSE_ARENA, &w, NULL, NULL) == -EINVAL);
+        assert_se(json_parse("[1] 2", JSON_PARSE_ARENA, &w, NULL, NULL) == -EINVAL);
+        assert_se(json_parse("[1]\n[", JSON_PARSE_ARENA, &w, &line, &column) == -EINVAL);
+        assert_se(line == 2);
+        assert_se(column == 1);
+
+        /* Continue mode */
+        p = "{\"a\":1}{\"b\":[2]}";
+        assert_se(json_parse_continue(&p, JSON_PARSE_ARENA, &v, NULL, NULL) >= 0);
+        assert_se(json_parse_continue(&p, JSON_PARSE_ARENA, &w, NULL, NULL) >= 0);
+        assert_se(isempty(p));
+        assert_se(json_variant_unsigned(json_variant_by_key(v, "a")) == 1);
+        assert_se(json_variant_unsigned(json_variant_by_index(json_variant_by_key(w, "b"), 0)) == 2);
+}
+
+TEST(parse_arena_depth) {
+        _cleanup_free_ char *s = NULL;
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+
+        assert_se(s = new(char, 2 * 4096 + 1));
+        memset(s, '[', 4096);
+        memset(s + 4096, ']', 4096);
+        s[2 * 4096] = 0;
+
+        assert_se(json_parse(s, JSON_PARSE_ARENA, &v, NULL, NULL) == -ELNRNG);
+}
+
 DEFINE_TEST_MAIN(LOG_DEBUG);
@@ -0,0 +1,133 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "fileio.h"
+#include "load-dropin.h"
+#include "manager.h"
+#include "mkdir.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "strv.h"
+#include "tests.h"
+#include "time-util.h"
+#include "tmpfile-util.h"
+#include "unit-file-cache.h"
+
+/* Loads a target that pulls in many services, half of them with a drop-in, and one via an alias with a
+ * drop-in of its own, with the unit file cache active, as during startup and reload. Checks that the load
+ * queue is preloaded in a bounded number of rounds rather than once per unit, and that the drop-ins
+ * determined while preloading are the same as those found by searching again. Pass the number of services
+ * to generate as argument to use this as a benchmark. */
+
+static unsigned arg_n_units;
+static char *runtime_dir = NULL;
+
+STATIC_DESTRUCTOR_REGISTER(runtime_dir, rm_rf_physical_and_freep);
+
+static void write_unit(const char *dir, const char *name, const char *contents) {
+        _cleanup_free_ char *p = NULL;
+
+        assert_se(p = path_join(dir, name));
+        assert_se(mkdir_parents(p, 0755) >= 0);
+        assert_se(write_string_file(p, contents, WRITE_STRING_FILE_CREATE) >= 0);
+}
+
+static void write_units(const char *dir) {
+        _cleanup_free_ char *wants = NULL, *target = NULL, *alias = NULL;
+
+        for (unsigned i = 0; i < arg_n_units; i++) {
+                _cleanup_free_ char *name = NULL;
+
+                assert_se(asprintf(&name, "preload-%u.service", i) >= 0);
+                write_unit(dir, name, "[Service]\nExecStart=/bin/true\n");
+
+                if (i % 2 == 0) {
+                        _cleanup_free_ char *dropin = NULL;
+
+                        assert_se(dropin = strjoin(name, ".d/50-test.conf"));
+                        write_unit(dir, dropin, "[Unit]\nDescription=With drop-in\n");
+                }
+
+                assert_se(strextend_with_separator(&wants, " ", name));
+        }
+
+        /* An alias gains its aliases only when its fragment is loaded, hence can't use the preloaded
+         * drop-ins, but needs to pick up the ones of the alias name too */
+        assert_se(alias = path_join(dir, "preload-alias.service"));
+        assert_se(symlink("preload-1.service", alias) >= 0);
+        write_unit(dir, "preload-alias.service.d/50-alias.conf", "[Unit]\nDescription=Via alias\n");
+
+        assert_se(target = strjoin("[Unit]\nWants=", wants, " preload-alias.service\n"));
+        write_unit(dir, "preload.target", target);
+}
+
+TEST(load_queue_preload) {
+        _cleanup_(rm_rf_physical_and_freep) char *unit_dir = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        Unit *target, *u;
+        unsigned n_rounds;
+        usec_t t;
+        int r;
+
+        assert_se(mkdtemp_malloc("/tmp/test-load-queue-XXXXXX", &unit_dir) >= 0);
+        write_units(unit_dir);
+        assert_se(set_unit_path(unit_dir) >= 0);
+
+        r = manager_new(RUNTIME_SCOPE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (manager_errno_skip_test(r))
+                return (void) log_tests_skipped_errno(r, "manager_new");
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL, NULL) >= 0);
+
+        /* The cache isn't used in test mode, enable it, and open a load cycle as startup and reload do */
+        assert_se(m->unit_file_cache.path = path_join(runtime_dir, "unit-file.cache"));
+        unit_file_cache_begin(&m->unit_file_cache);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_load_unit(m, "preload.target", NULL, NULL, &target) >= 0);
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        n_rounds = m->unit_file_cache.n_preload_rounds;
+        log_info("Loaded %u services in %s, %u files preloaded in %u rounds.",
+                 arg_n_units, FORMAT_TIMESPAN(t, USEC_PER_MSEC), m->unit_file_cache.n_preloaded, n_rounds);
+
+        unit_file_cache_end(&m->unit_file_cache);
+
+        assert_se(target->load_state == UNIT_LOADED);
+        assert_se(!m->load_queue);
+        assert_se(m->n_load_queue_pending == 0);
+        assert_se(n_rounds >= 1);
+        assert_se(n_rounds <= 1 + arg_n_units / UNIT_FILE_CACHE_PRELOAD_BATCH);
+
+        for (unsigned i = 0; i < arg_n_units; i++) {
+                _cleanup_strv_free_ char **dropins = NULL;
+                _cleanup_free_ char *name = NULL;
+
+                assert_se(asprintf(&name, "preload-%u.service", i) >= 0);
+                assert_se(u = manager_get_unit(m, name));
+                assert_se(u->load_state == UNIT_LOADED);
+                assert_se(!u->load_queue_dropin_paths);
+
+                /* i == 1 is the target of the alias, and has its drop-in too */
+                assert_se(strv_length(u->dropin_paths) == (i % 2 == 0) + (i == 1));
+
+                (void) unit_find_dropin_paths(u, &dropins);
+                assert_se(strv_equal(u->dropin_paths, dropins));
+        }
+
+        assert_se(u = manager_get_unit(m, "preload-alias.service"));
+        assert_se(streq(u->id, "preload-1.service"));
+        assert_se(strv_length(u->dropin_paths) == 1);
+        assert_se(endswith(u->dropin_paths[0], "/preload-alias.service.d/50-alias.conf"));
+}
+
+static int intro(void) {
+        /* preload-1.service is the target of the alias */
+        arg_n_units = MAX(test_size_from_args(500, 5000), 2u);
+
+        return setup_manager_test(&runtime_dir);
+}
+
+DEFINE_TEST_MAIN_WITH_INTRO(LOG_INFO, intro);
@@ -0,0 +1,309 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <stdio.h>
+
+#include "fd-util.h"
+#include "fileio.h"
+#include "manager-serialize.h"
+#include "manager.h"
+#include "memstream-util.h"
+#include "path-util.h"
+#include "recurse-dir.h"
+#include "rm-rf.h"
+#include "service.h"
+#include "tests.h"
+#include "time-util.h"
+#include "tmpfile-util.h"
+
+/* Passes the state of units on to new instances of the manager, and checks that the state of inactive units
+ * is deferred until they are loaded, and then applied in full, and that the state of units that are never
+ * loaded is passed on again. Does the same for the inputs of the manager serialization fuzzer and a
+ * synthetic serialization of many services, and logs how long it takes. Pass the number of services to
+ * generate as argument to use this as a benchmark. */
+
+static unsigned arg_n_units;
+static char *runtime_dir = NULL, *unit_dir = NULL;
+
+STATIC_DESTRUCTOR_REGISTER(runtime_dir, rm_rf_physical_and_freep);
+STATIC_DESTRUCTOR_REGISTER(unit_dir, rm_rf_physical_and_freep);
+
+static const dual_timestamp ts_enter = { .realtime = 1700000000000000, .monotonic = 12345678 };
+static const dual_timestamp ts_exit = { .realtime = 1700000001000000, .monotonic = 22345678 };
+
+static Manager* manager_new_for_test(void) {
+        Manager *m;
+        int r;
+
+        r = manager_new(RUNTIME_SCOPE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (manager_errno_skip_test(r)) {
+                log_tests_skipped_errno(r, "manager_new");
+                return NULL;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL, NULL) >= 0);
+
+        return m;
+}
+
+static usec_t deserialize(Manager *m, const char *data, size_t size) {
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        usec_t ts;
+
+        assert_se(fds = fdset_new());
+        assert_se(f = fmemopen_unlocked((char*) data, size, "r"));
+
+        ts = now(CLOCK_MONOTONIC);
+        (void) manager_deserialize(m, f, fds);
+        return now(CLOCK_MONOTONIC) - ts;
+}
+
+static usec_t serialize(Manager *m, bool unit_records, char **ret, size_t *ret_size) {
+        _cleanup_(memstream_done) MemStream ms = {};
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        FILE *f;
+        usec_t ts;
+
+        assert_se(fds = fdset_new());
+        assert_se(f = memstream_init(&ms));
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(manager_serialize(m, f, fds, /* switching_root = */ false, unit_records) >= 0);
+        ts = now(CLOCK_MONOTONIC) - ts;
+
+        assert_se(memstream_finalize(&ms, ret, ret_size) >= 0);
+        return ts;
+}
+
+static void pass_on(Manager *m, Manager *n, bool unit_records) {
+        _cleanup_free_ char *buf = NULL;
+        size_t size;
+
+        (void) serialize(m, unit_records, &buf, &size);
+        (void) deserialize(n, buf, size);
+}
+
+static void set_state(Unit *u) {
+        /* An inactive unit that ran and failed before */
+        SERVICE(u)->result = SERVICE_FAILURE_EXIT_CODE;
+        u->active_exit_timestamp = ts_enter;
+        u->inactive_enter_timestamp = ts_exit;
+        u->state_change_timestamp = ts_exit;
+}
+
+static void check_state(Unit *u) {
+        assert_se(u->load_state == UNIT_LOADED);
+        assert_se(!u->job);
+        assert_se(unit_active_state(u) == UNIT_INACTIVE);
+        assert_se(SERVICE(u)->result == SERVICE_FAILURE_EXIT_CODE);
+        assert_se(u->active_exit_timestamp.realtime == ts_enter.realtime);
+        assert_se(u->active_exit_timestamp.monotonic == ts_enter.monotonic);
+        assert_se(u->inactive_enter_timestamp.realtime == ts_exit.realtime);
+        assert_se(u->inactive_enter_timestamp.monotonic == ts_exit.monotonic);
+        assert_se(u->state_change_timestamp.realtime == ts_exit.realtime);
+}
+
+static void check_job(Manager *m) {
+        Unit *u;
+
+        /* Units with a job are not deferred */
+        assert_se(u = manager_get_unit(m, "job.service"));
+        assert_se(u->load_state == UNIT_LOADED);
+        assert_se(u->job);
+        assert_se(u->job->type == JOB_START);
+        assert_se(u->job->state == JOB_WAITING);
+        assert_se(!hashmap_contains(m->deferred_unit_states, "job.service"));
+}
+
+static void check_deferred(Manager *m, const char *name) {
+        Unit *u;
+
+        assert_se(hashmap_contains(m->deferred_unit_states, name));
+        assert_se(!manager_get_unit(m, name));
+
+        assert_se(manager_load_unit(m, name, NULL, NULL, &u) >= 0);
+        assert_se(!hashmap_contains(m->deferred_unit_states, name));
+        check_state(u);
+}
+
+TEST(deferred_unit_state) {
+        _cleanup_(manager_freep) Manager *m = NULL, *n = NULL, *o = NULL, *p = NULL;
+        Unit *u;
+
+        m = manager_new_for_test();
+        if (!m)
+                return;
+
+        assert_se(manager_load_unit(m, "deferred.service", NULL, NULL, &u) >= 0);
+        set_state(u);
+        assert_se(manager_load_unit(m, "never.service", NULL, NULL, &u) >= 0);
+        set_state(u);
+        assert_se(manager_load_unit(m, "job.service", NULL, NULL, &u) >= 0);
+        assert_se(manager_add_job(m, JOB_START, u, JOB_REPLACE, NULL, NULL, NULL) >= 0);
+
+        assert_se(n = manager_new_for_test());
+        pass_on(m, n, /* unit_records = */ true);
+        check_job(n);
+
+        /* The state is applied in full once the unit is loaded */
+        check_deferred(n, "deferred.service");
+
+        /* The state of the unit never loaded is passed on again, and the loaded one is deferred again */
+        assert_se(o = manager_new_for_test());
+        pass_on(n, o, /* unit_records = */ true);
+        check_job(o);
+        check_deferred(o, "never.service");
+        check_deferred(o, "deferred.service");
+
+        /* Versions that don't know about deferred states get the state as text and load the unit right
+         * away */
+        assert_se(p = manager_new_for_test());
+        pass_on(n, p, /* unit_records = */ false);
+        check_job(p);
+        assert_se(!hashmap_contains(p->deferred_unit_states, "never.service"));
+        assert_se(u = manager_get_unit(p, "never.service"));
+        check_state(u);
+}
+
+static void test_one(const char *name, const char *data, size_t size, bool check_state) {
+        _cleanup_(manager_freep) Manager *m = NULL, *n = NULL;
+        _cleanup_free_ char *buf = NULL;
+        usec_t t_text, t_serialize, t_deserialize, t_load = 0;
+        unsigned n_units, n_deferred;
+        size_t buf_size;
+        const char *k;
+        Unit *u;
+
+        m = manager_new_for_test();
+        if (!m)
+                return;
+
+        /* The text serialization of older versions, which loads all units */
+        t_text = deserialize(m, data, size);
+        n_units = hashmap_size(m->units);
+
+        t_serialize = serialize(m, /* unit_records = */ true, &buf, &buf_size);
+
+        /* A new instance only loads the units that need it */
+        assert_se(n = manager_new_for_test());
+        t_deserialize = deserialize(n, buf, buf_size);
+        n_deferred = hashmap_size(n->deferred_unit_states);
+
+        /* … and the remaining ones once they are looked at */
+        HASHMAP_FOREACH_KEY(u, k, m->units) {
+                usec_t ts = now(CLOCK_MONOTONIC);
+                Unit *v;
+                int r;
+
+                r = manager_load_unit(n, k, NULL, NULL, &v);
+                t_load += now(CLOCK_MONOTONIC) - ts;
+
+                /* The fuzzer inputs contain all kinds of contradicting state, hence only compare the
+                 * state of the generated services */
+                if (!check_state)
+                        continue;
+
+                assert_se(r >= 0);
+                assert_se(unit_active_state(v) == unit_active_state(u));
+                assert_se(sd_id128_equal(v->invocation_id, u->invocation_id));
+                assert_se(v->active_exit_timestamp.realtime == u->active_exit_timestamp.realtime);
+                assert_se(v->active_exit_timestamp.monotonic == u->active_exit_timestamp.monotonic);
+        }
+        assert_se(hashmap_isempty(n->deferred_unit_states));
+        assert_se(!check_state || n_deferred == arg_n_units);
+
+        log_info("%-28s %6u units (%u deferred), %8zu → %8zu bytes: "
+                 "text %s, serialize %s, deserialize %s, load deferred %s",
+                 name, n_units, n_deferred, size, buf_size,
+                 FORMAT_TIMESPAN(t_text, 1), FORMAT_TIMESPAN(t_serialize, 1),
+                 FORMAT_TIMESPAN(t_deserialize, 1), FORMAT_TIMESPAN(t_load, 1));
+}
+
+TEST(corpus) {
+        _cleanup_free_ DirectoryEntries *de = NULL;
+        _cleanup_free_ char *dir = NULL;
+        _cleanup_close_ int fd = -EBADF;
+
+        assert_se(get_testdata_dir("fuzz/fuzz-manager-serialize", &dir) >= 0);
+
+        fd = open(dir, O_DIRECTORY|O_CLOEXEC|O_RDONLY);
+        if (fd < 0)
+                return (void) log_tests_skipped_errno(errno, "Fuzzer inputs not available");
+
+        assert_se(readdir_all(fd, RECURSE_DIR_SORT|RECURSE_DIR_IGNORE_DOT, &de) >= 0);
+
+        FOREACH_ARRAY(i, de->entries, de->n_entries) {
+                _cleanup_free_ char *data = NULL;
+                size_t size;
+
+                if ((*i)->d_type != DT_REG)
+                        continue;
+
+                assert_se(read_full_file_at(fd, (*i)->d_name, &data, &size) >= 0);
+                test_one((*i)->d_name, data, size, /* check_state = */ false);
+        }
+}
+
+TEST(services) {
+        _cleanup_(memstream_done) MemStream ms = {};
+        _cleanup_free_ char *data = NULL;
+        size_t size;
+        FILE *f;
+
+        assert_se(f = memstream_init(&ms));
+
+        /* A system with many inactive services, a tenth of which has run and left some state behind */
+        fputc('\n', f);
+        for (unsigned i = 0; i < arg_n_units; i++) {
+                fprintf(f, "bench-%u.service\n", i);
+                fputs("state=dead\n"
+                      "result=success\n"
+                      "reload-result=success\n"
+                      "n-restarts=0\n"
+                      "flush-n-restarts=no\n"
+                      "forbid-restart=no\n", f);
+                if (i % 10 == 0)
+                        fprintf(f,
+                                "main-exec-status-pid=%u\n"
+                                "main-exec-status-code=1\n"
+                                "main-exec-status-status=0\n"
+                                "main-exec-status-start=1700000000000000 12345678\n"
+                                "main-exec-status-exit=1700000001000000 12345679\n"
+                                "active-exit-timestamp=1700000001000000 12345679\n"
+                                "invocation-id=%032x\n",
+                                1000 + i, i + 1);
+                fputs("transient=no\n"
+                      "exported-invocation-id=no\n"
+                      "exported-log-level-max=no\n"
+                      "exported-log-extra-fields=no\n"
+                      "exported-log-rate-limit-interval=no\n"
+                      "exported-log-rate-limit-burst=no\n"
+                      "\n", f);
+        }
+
+        assert_se(memstream_finalize(&ms, &data, &size) >= 0);
+        test_one("services", data, size, /* check_state = */ true);
+}
+
+static int intro(void) {
+        int r;
+
+        r = setup_manager_test(&runtime_dir);
+        if (r != EXIT_SUCCESS)
+                return r;
+
+        assert_se(mkdtemp_malloc("/tmp/test-manager-serialize-XXXXXX", &unit_dir) >= 0);
+        FOREACH_STRING(name, "deferred.service", "never.service", "job.service") {
+                _cleanup_free_ char *path = NULL;
+
+                assert_se(path = path_join(unit_dir, name));
+                assert_se(write_string_file(path, "[Unit]\nDefaultDependencies=no\n[Service]\nExecStart=/bin/true\n", WRITE_STRING_FILE_CREATE) >= 0);
+        }
+        assert_se(set_unit_path(unit_dir) >= 0);
+
+        arg_n_units = test_size_from_args(2000, 20000);
+
+        return EXIT_SUCCESS;
+}
+
+DEFINE_TEST_MAIN_WITH_INTRO(LOG_INFO, intro);
@@ -0,0 +1,108 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "mallinfo-util.h"
+#include "mempool.h"
+#include "parse-util.h"
+#include "random-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Compares allocating and freeing many small objects of the same size via malloc() and via a mempool, in
+ * terms of time and heap usage. The sizes roughly correspond to DnsResourceRecord, sd_bus_message and
+ * sd_netlink_message. Objects are freed in random order and then partly reallocated, so that the heap gets
+ * fragmented similar to what a long-running daemon sees. Pass the number of objects as argument. */
+
+static size_t arg_n_objects = 100000;
+
+/* Pools are registered globally on first use and never unregistered, hence they have to be static */
+DEFINE_MEMPOOL_SIZE(pool_small, 120, 64);
+DEFINE_MEMPOOL_SIZE(pool_medium, 336, 64);
+DEFINE_MEMPOOL_SIZE(pool_large, 600, 64);
+
+static size_t heap_in_use(void) {
+#if HAVE_GENERIC_MALLINFO
+        generic_mallinfo mi = generic_mallinfo_get();
+
+        return (size_t) mi.uordblks + (size_t) mi.hblkhd;
+#else
+        return 0;
+#endif
+}
+
+static void shuffle(void **a, size_t n) {
+        for (size_t i = n; i > 1; i--) {
+                size_t j = random_u64_range(i);
+                SWAP_TWO(a[i - 1], a[j]);
+        }
+}
+
+static void test_one(struct mempool *mp, bool use_pool) {
+        _cleanup_free_ void **objects = NULL;
+        size_t n = arg_n_objects, size = mp->tile_size, before, peak;
+        usec_t ts, t_alloc, t_churn, t_free;
+
+        assert_se(objects = new(void*, n));
+
+        before = heap_in_use();
+
+        ts = now(CLOCK_MONOTONIC);
+        for (size_t i = 0; i < n; i++)
+                assert_se(objects[i] = use_pool ? mempool_alloc0_tile(mp) : malloc0(size));
+        t_alloc = now(CLOCK_MONOTONIC) - ts;
+
+        shuffle(objects, n);
+
+        /* Drop half of the objects in random order, and allocate them again */
+        ts = now(CLOCK_MONOTONIC);
+        for (size_t i = 0; i < n / 2; i++) {
+                if (use_pool)
+                        mempool_free_tile(mp, objects[i]);
+                else
+                        free(objects[i]);
+        }
+        for (size_t i = 0; i < n / 2; i++)
+                assert_se(objects[i] = use_pool ? mempool_alloc0_tile(mp) : malloc0(size));
+        t_churn = now(CLOCK_MONOTONIC) - ts;
+
+        peak = heap_in_use();
+
+        shuffle(objects, n);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (size_t i = 0; i < n; i++) {
+                if (use_pool)
+                        mempool_free_tile(mp, objects[i]);
+                else
+                        free(objects[i]);
+        }
+        t_free = now(CLOCK_MONOTONIC) - ts;
+
+        if (use_pool) {
+                assert_se(mp->n_tiles_used == 0);
+                mempool_trim(mp);
+                assert_se(!mp->first_pool);
+        }
+
+        log_info("%-7s %5zu bytes  alloc %6.1f ns/op  churn %6.1f ns/op  free %6.1f ns/op  heap %6.1f bytes/object",
+                 use_pool ? "mempool" : "malloc", size,
+                 (double) t_alloc * NSEC_PER_USEC / n,
+                 (double) t_churn * NSEC_PER_USEC / n,
+                 (double) t_free * NSEC_PER_USEC / n,
+                 (double) (peak - before) / n);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_INFO);
+
+        if (argc >= 2)
+                assert_se(safe_atozu(argv[1], &arg_n_objects) >= 0 && arg_n_objects > 0);
+        else if (slow_tests_enabled())
+                arg_n_objects = 2000000;
+
+        FOREACH_ARRAY(mp, ((struct mempool*[]) { &pool_small, &pool_medium, &pool_large }), 3)
+                for (int use_pool = 0; use_pool < 2; use_pool++)
+                        test_one(*mp, use_pool);
+
+        return 0;
+}
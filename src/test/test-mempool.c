@@ -1,7 +1,9 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include "memstream-util.h"
 #include "mempool.h"
 #include "random-util.h"
+#include "string-util.h"
 #include "tests.h"
 
 struct element {
@@ -26,6 +28,9 @@ TEST(mempool_trim) {
                 a[i]->value = i;
         }
 
+        assert_se(test_mempool.n_tiles_used == NN);
+        assert_se(test_mempool.n_tiles_used_max == NN);
+
         mempool_trim(&test_mempool);
 
         /* free up to one third randomly */
@@ -82,6 +87,9 @@ TEST(mempool_trim) {
         }
 
         assert_se(n_freed == NN * 2);
+        assert_se(test_mempool.n_tiles_used == 0);
+        assert_se(test_mempool.n_tiles_used_max >= NN);
+        assert_se(test_mempool.n_allocs == NN * 2);
 
         mempool_trim(&test_mempool);
 
@@ -89,4 +97,63 @@ TEST(mempool_trim) {
         assert_se(!test_mempool.freelist);
 }
 
+DEFINE_MEMPOOL(other_mempool, struct element, 8);
+
+TEST(mempool_alloc0_tile_or_heap) {
+        bool use_pool = mempool_enabled && mempool_enabled(), from_pool;
+        struct element *a, *b;
+
+        assert_se(a = mempool_alloc0_tile_or_heap(&other_mempool, sizeof(struct element), &from_pool));
+        assert_se(from_pool == use_pool);
+        assert_se(a->value == 0);
+        assert_se(other_mempool.n_tiles_used == use_pool);
+
+        /* Too large for a tile, always taken from the heap */
+        assert_se(b = mempool_alloc0_tile_or_heap(&other_mempool, sizeof(struct element) * 2, &from_pool));
+        assert_se(!from_pool);
+        assert_se(other_mempool.n_tiles_used == use_pool);
+
+        assert_se(!mempool_free_tile_or_heap(&other_mempool, b, false));
+        assert_se(!mempool_free_tile_or_heap(&other_mempool, a, use_pool));
+        assert_se(other_mempool.n_tiles_used == 0);
+}
+
+TEST(mempool_dump_all) {
+        _cleanup_(memstream_done) MemStream m = {};
+        _cleanup_free_ char *buf = NULL;
+        struct element *e;
+        FILE *f;
+
+        assert_se(e = mempool_alloc_tile(&other_mempool));
+
+        assert_se(f = memstream_init(&m));
+        mempool_dump_all(f);
+        assert_se(memstream_finalize(&m, &buf, NULL) >= 0);
+        log_debug("%s", buf);
+
+        assert_se(startswith(buf, "<mempools>\n"));
+        assert_se(strstr(buf, "<mempool name=\"other_mempool\" tile-size=\"8\">\n"));
+        assert_se(strstr(buf, "<tiles total=\"") && strstr(buf, "used=\"1\""));
+
+        mempool_free_tile(&other_mempool, e);
+        mempool_trim_all();
+        assert_se(!other_mempool.first_pool);
+
+        /* A pool that got trimmed and is used again stays registered exactly once */
+        assert_se(e = mempool_alloc_tile(&other_mempool));
+
+        buf = mfree(buf);
+        assert_se(f = memstream_init(&m));
+        mempool_dump_all(f);
+        assert_se(memstream_finalize(&m, &buf, NULL) >= 0);
+
+        const char *s = strstr(buf, "<mempool name=\"other_mempool\"");
+        assert_se(s);
+        assert_se(!strstr(s + 1, "<mempool name=\"other_mempool\""));
+
+        mempool_free_tile(&other_mempool, e);
+        mempool_trim_all();
+        assert_se(!other_mempool.first_pool);
+}
+
 DEFINE_TEST_MAIN(LOG_DEBUG);
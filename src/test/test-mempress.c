@@ -11,6 +11,7 @@
 #include "bus-locator.h"
 #include "bus-wait-for-jobs.h"
 #include "fd-util.h"
+#include "mempool.h"
 #include "path-util.h"
 #include "process-util.h"
 #include "random-util.h"
@@ -302,7 +303,7 @@ TEST(real_pressure) {
 }
 
 static int outro(void) {
-        hashmap_trim_pools();
+        mempool_trim_all();
         return 0;
 }
 
@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "parse-util.h"
+#include "prioq.h"
+#include "stdio-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Measures the prioq operations in patterns resembling its main users: sd-event rearming timer sources,
+ * resolved's cache expiring and replacing entries, and updating many items at once. Pass the decimal
+ * exponent of the largest queue size to test as argument. */
+
+#define OPS 1000000U
+
+static unsigned arg_max_exponent;
+
+typedef struct Item {
+        usec_t time;
+        int64_t priority;
+        unsigned idx;
+} Item;
+
+/* Something similar to what sd-event compares timer sources by */
+static int item_compare(const Item *x, const Item *y) {
+        int r;
+
+        r = CMP(x->time, y->time);
+        if (r != 0)
+                return r;
+
+        return CMP(x->priority, y->priority);
+}
+
+/* rnd() goes to the kernel, which would dominate the numbers, hence use a cheap generator */
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t rnd(uint64_t max) {
+        rng_state ^= rng_state << 13;
+        rng_state ^= rng_state >> 7;
+        rng_state ^= rng_state << 17;
+        return rng_state % max;
+}
+
+static void report(const char *pattern, unsigned n, usec_t t, size_t n_ops) {
+        log_info("%-16s %8u  %7.1f ns/op", pattern, n, (double) t * NSEC_PER_USEC / n_ops);
+}
+
+static Prioq* queue_new(Item *items, unsigned n) {
+        Prioq *q;
+
+        assert_se(q = prioq_new((compare_func_t) item_compare));
+
+        for (unsigned i = 0; i < n; i++) {
+                items[i] = (Item) {
+                        .time = rnd(n * 10),
+                        .priority = rnd(3),
+                };
+                assert_se(prioq_put(q, items + i, &items[i].idx) >= 0);
+        }
+
+        return q;
+}
+
+static void test_timer_rearm(unsigned n) {
+        _cleanup_(prioq_freep) Prioq *q = NULL;
+        _cleanup_free_ Item *items = NULL;
+        usec_t ts, now_usec = 0;
+
+        assert_se(items = new(Item, n));
+        q = queue_new(items, n);
+
+        /* The earliest timer elapses and is rearmed, like a periodic timer source */
+        ts = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < OPS; i++) {
+                Item *t = prioq_peek(q);
+
+                now_usec = t->time;
+                t->time = now_usec + 1 + rnd(n * 10);
+                prioq_reshuffle(q, t, &t->idx);
+        }
+        report("timer-rearm", n, now(CLOCK_MONOTONIC) - ts, OPS);
+
+        /* Some timer is moved, like a timeout being pushed out because of activity */
+        ts = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < OPS; i++) {
+                Item *t = items + rnd(n);
+
+                t->time = now_usec + rnd(n * 10);
+                prioq_reshuffle(q, t, &t->idx);
+        }
+        report("timer-move", n, now(CLOCK_MONOTONIC) - ts, OPS);
+}
+
+static void test_cache_churn(unsigned n) {
+        _cleanup_(prioq_freep) Prioq *q = NULL;
+        _cleanup_free_ Item *items = NULL;
+        usec_t ts;
+
+        assert_se(items = new(Item, n));
+        q = queue_new(items, n);
+
+        /* A full cache: the entry expiring first is dropped, and a new one added. Every now and then a
+         * random entry is flushed and replaced. */
+        ts = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < OPS; i++) {
+                Item *t;
+
+                if (i % 4 == 0) {
+                        t = items + rnd(n);
+                        assert_se(prioq_remove(q, t, &t->idx) == 1);
+                } else
+                        assert_se(t = prioq_pop(q));
+
+                t->time += rnd(n * 10);
+                assert_se(prioq_put(q, t, &t->idx) >= 0);
+        }
+        report("cache-churn", n, now(CLOCK_MONOTONIC) - ts, OPS);
+}
+
+static void test_reshuffle_many(unsigned n, unsigned n_changed) {
+        _cleanup_(prioq_freep) Prioq *q = NULL;
+        _cleanup_free_ Item *items = NULL;
+        _cleanup_free_ unsigned **changed = NULL;
+        char pattern[32];
+        unsigned rounds;
+        usec_t ts;
+
+        assert_se(items = new(Item, n));
+        assert_se(changed = new(unsigned*, n_changed));
+        q = queue_new(items, n);
+
+        rounds = MAX(OPS / n_changed, 1U);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (unsigned r = 0; r < rounds; r++) {
+                for (unsigned i = 0; i < n_changed; i++) {
+                        Item *t = items + rnd(n);
+
+                        t->time = rnd(n * 10);
+                        changed[i] = &t->idx;
+                }
+
+                prioq_reshuffle_many(q, changed, n_changed);
+        }
+        xsprintf(pattern, "reshuffle-%u", n_changed);
+        report(pattern, n, now(CLOCK_MONOTONIC) - ts, (size_t) rounds * n_changed);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_INFO);
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &arg_max_exponent) >= 0 && arg_max_exponent >= 2);
+        else
+                arg_max_exponent = slow_tests_enabled() ? 6 : 4;
+
+        for (unsigned n = 100, e = 2; e <= arg_max_exponent; n *= 10, e++) {
+                test_timer_rearm(n);
+                test_cache_churn(n);
+                test_reshuffle_many(n, 16);
+                test_reshuffle_many(n, n / 4);
+        }
+
+        return 0;
+}
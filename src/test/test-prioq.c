@@ -120,4 +120,66 @@ TEST(struct) {
         assert_se(set_isempty(s));
 }
 
+static void test_reshuffle_many_one(unsigned n_items, unsigned n_changed) {
+        _cleanup_(prioq_freep) Prioq *q = NULL;
+        _cleanup_free_ struct test *items = NULL;
+        _cleanup_free_ unsigned **changed = NULL;
+        unsigned previous = 0;
+
+        log_info("/* %s(%u, %u) */", __func__, n_items, n_changed);
+
+        assert_se(q = prioq_new((compare_func_t) test_compare));
+        assert_se(items = new(struct test, n_items));
+        assert_se(changed = new(unsigned*, n_changed + 1));
+
+        for (unsigned i = 0; i < n_items; i++) {
+                items[i].value = (unsigned) rand();
+                assert_se(prioq_put(q, items + i, &items[i].idx) >= 0);
+        }
+
+        /* Change some values in both directions, and reshuffle them all at once */
+        for (unsigned i = 0; i < n_changed; i++) {
+                struct test *t = items + (unsigned) rand() % n_items;
+
+                t->value = i % 2 == 0 ? t->value / 2 : t->value + (unsigned) rand() % 1000;
+                changed[i] = &t->idx;
+        }
+
+        /* Items that are not queued are ignored */
+        unsigned not_queued = PRIOQ_IDX_NULL;
+        changed[n_changed] = &not_queued;
+
+        prioq_reshuffle_many(q, changed, n_changed + 1);
+
+        for (unsigned i = 0; i < n_items; i++) {
+                struct test *t;
+
+                assert_se(t = prioq_peek_by_index(q, items[i].idx));
+                assert_se(t == items + i);
+        }
+
+        for (unsigned i = 0; i < n_items; i++) {
+                struct test *t;
+
+                assert_se(t = prioq_pop(q));
+                assert_se(previous <= t->value);
+                previous = t->value;
+        }
+
+        assert_se(prioq_isempty(q));
+}
+
+TEST(reshuffle_many) {
+        srand(0);
+
+        /* Few changes are applied one by one, many by rebuilding the heap */
+        test_reshuffle_many_one(1, 1);
+        test_reshuffle_many_one(SET_SIZE, 0);
+        test_reshuffle_many_one(SET_SIZE, 3);
+        for (unsigned i = 0; i < 50; i++)
+                test_reshuffle_many_one(1 + (unsigned) rand() % SET_SIZE, (unsigned) rand() % 200);
+        test_reshuffle_many_one(SET_SIZE, 100);
+        test_reshuffle_many_one(SET_SIZE, SET_SIZE);
+}
+
 DEFINE_TEST_MAIN(LOG_INFO);
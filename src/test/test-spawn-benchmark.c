@@ -0,0 +1,161 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <stdio.h>
+
+#include "capability-util.h"
+#include "fileio.h"
+#include "manager.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "service.h"
+#include "tests.h"
+#include "time-util.h"
+#include "tmpfile-util.h"
+
+/* Measures how many short-lived services per second the manager can start one after the other, with
+ * executors spawned on demand and taken from a pool of idle executors, and how long it takes to start as many
+ * transient services at once, i.e. to realize their cgroups and get an executor running in each of them.
+ * Pass the number of services to start as argument. */
+
+static unsigned arg_n_units;
+static char *runtime_dir = NULL, *unit_dir = NULL;
+
+STATIC_DESTRUCTOR_REGISTER(runtime_dir, rm_rf_physical_and_freep);
+STATIC_DESTRUCTOR_REGISTER(unit_dir, rm_rf_physical_and_freep);
+
+static Manager* setup(unsigned executor_pool_size) {
+        Manager *m;
+        int r;
+
+        r = manager_new(RUNTIME_SCOPE_SYSTEM, MANAGER_TEST_RUN_BASIC, &m);
+        if (manager_errno_skip_test(r)) {
+                log_tests_skipped_errno(r, "manager_new");
+                return NULL;
+        }
+        assert_se(r >= 0);
+
+        m->defaults.std_output = EXEC_OUTPUT_NULL; /* don't rely on host journald */
+        m->executor_pool_size = executor_pool_size;
+        assert_se(manager_startup(m, NULL, NULL, NULL) >= 0);
+
+        return m;
+}
+
+static void test_one(unsigned executor_pool_size) {
+        _cleanup_(manager_freep) Manager *m = NULL;
+        usec_t ts;
+
+        m = setup(executor_pool_size);
+        if (!m)
+                return;
+
+        ts = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < arg_n_units; i++) {
+                _cleanup_free_ char *name = NULL;
+                Unit *u;
+
+                assert_se(asprintf(&name, "bench@%u.service", i) >= 0);
+                assert_se(manager_load_startable_unit_or_warn(m, name, NULL, &u) >= 0);
+                assert_se(unit_start(u, NULL) >= 0);
+
+                while (!IN_SET(SERVICE(u)->state, SERVICE_DEAD, SERVICE_FAILED))
+                        assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+
+                assert_se(SERVICE(u)->result == SERVICE_SUCCESS);
+
+                /* Idle executors are only ever kept up to the configured number */
+                assert_se(m->n_executor_pool <= executor_pool_size);
+        }
+        ts = now(CLOCK_MONOTONIC) - ts;
+
+        log_info("executor pool size %2u: %u services in %s, %.1f spawns/s",
+                 executor_pool_size, arg_n_units, FORMAT_TIMESPAN(ts, USEC_PER_MSEC),
+                 (double) arg_n_units * USEC_PER_SEC / MAX(ts, 1u));
+}
+
+TEST(spawn) {
+        test_one(0);
+        test_one(1);
+        test_one(8);
+}
+
+static Unit* add_transient_service(Manager *m, const char *name) {
+        Unit *u;
+
+        /* Like StartTransientUnit() does it */
+        assert_se(manager_load_unit(m, name, NULL, NULL, &u) >= 0);
+        assert_se(unit_make_transient(u) >= 0);
+        assert_se(unit_write_setting(u, UNIT_RUNTIME|UNIT_PRIVATE, "Type", "Type=oneshot") >= 0);
+        assert_se(unit_write_setting(u, UNIT_RUNTIME|UNIT_PRIVATE, "ExecStart", "ExecStart=/bin/true") >= 0);
+        unit_add_to_load_queue(u);
+
+        return u;
+}
+
+TEST(transient) {
+        _cleanup_(manager_freep) Manager *m = NULL;
+        _cleanup_free_ Unit **units = NULL;
+        usec_t ts, t_start = 0;
+
+        m = setup(0);
+        if (!m)
+                return;
+
+        assert_se(units = new(Unit*, arg_n_units));
+        for (unsigned i = 0; i < arg_n_units; i++) {
+                _cleanup_free_ char *name = NULL;
+
+                assert_se(asprintf(&name, "bench-transient-%u.service", i) >= 0);
+                units[i] = add_transient_service(m, name);
+        }
+        manager_dispatch_load_queue(m);
+
+        /* Starting a service realizes its cgroup and spawns the executor synchronously */
+        ts = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < arg_n_units; i++) {
+                usec_t t = now(CLOCK_MONOTONIC);
+
+                assert_se(unit_start(units[i], NULL) >= 0);
+                t_start += now(CLOCK_MONOTONIC) - t;
+        }
+
+        for (unsigned i = 0; i < arg_n_units; i++) {
+                while (!IN_SET(SERVICE(units[i])->state, SERVICE_DEAD, SERVICE_FAILED))
+                        assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+
+                assert_se(SERVICE(units[i])->result == SERVICE_SUCCESS);
+        }
+        ts = now(CLOCK_MONOTONIC) - ts;
+
+        log_info("transient: %u services started in %s (%s per service), finished in %s",
+                 arg_n_units, FORMAT_TIMESPAN(t_start, USEC_PER_MSEC),
+                 FORMAT_TIMESPAN(t_start / MAX(arg_n_units, 1u), 1), FORMAT_TIMESPAN(ts, USEC_PER_MSEC));
+}
+
+static int intro(void) {
+        _cleanup_free_ char *p = NULL;
+        int r;
+
+        /* It is needed otherwise cgroup creation fails */
+        if (geteuid() != 0 || have_effective_cap(CAP_SYS_ADMIN) <= 0)
+                return log_tests_skipped("not privileged");
+
+        r = setup_manager_test(&runtime_dir);
+        if (r != EXIT_SUCCESS)
+                return r;
+
+        assert_se(mkdtemp_malloc("/tmp/test-spawn-benchmark-XXXXXX", &unit_dir) >= 0);
+        assert_se(p = path_join(unit_dir, "bench@.service"));
+        assert_se(write_string_file(p,
+                                    "[Service]\n"
+                                    "Type=oneshot\n"
+                                    "ExecStart=/bin/true\n",
+                                    WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(set_unit_path(unit_dir) >= 0);
+
+        arg_n_units = test_size_from_args(200, 2000);
+
+        return EXIT_SUCCESS;
+}
+
+DEFINE_TEST_MAIN_WITH_INTRO(LOG_INFO, intro);
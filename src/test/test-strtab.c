@@ -0,0 +1,158 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fd-util.h"
+#include "fileio.h"
+#include "io-util.h"
+#include "nulstr-util.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "strtab.h"
+#include "strv.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+static const char *lookup_string(Strtab *t, unsigned section, const char *key) {
+        const void *value;
+        size_t size;
+        int r;
+
+        r = strtab_lookup(t, section, key, &value, &size);
+        assert_se(r >= 0);
+        if (r == 0)
+                return NULL;
+
+        assert_se(strlen(value) == size);
+        return value;
+}
+
+TEST(strtab) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmpdir = NULL;
+        _cleanup_(strtab_writer_freep) StrtabWriter *w = NULL;
+        _cleanup_(strtab_freep) Strtab *t = NULL;
+        _cleanup_strv_free_ char **l = NULL;
+        const char *p, *key;
+        const void *value;
+        struct stat st;
+        size_t size;
+
+        assert_se(mkdtemp_malloc("/tmp/test-strtab-XXXXXX", &tmpdir) >= 0);
+        p = strjoina(tmpdir, "/table");
+
+        assert_se(strtab_writer_new(3, &w) >= 0);
+
+        assert_se(strtab_writer_add_string(w, 0, "waldo.service", "/usr/lib/systemd/system/waldo.service") >= 0);
+        assert_se(strtab_writer_add_string(w, 0, "foo.service", "/etc/systemd/system/foo.service") >= 0);
+        assert_se(strtab_writer_add_string(w, 0, "bar.service", "/dev/null") >= 0);
+        assert_se(strtab_writer_add_string(w, 0, "empty.service", "") >= 0);
+        assert_se(strtab_writer_add_strv(w, 1, "waldo.service", STRV_MAKE("waldo.service", "quux.service")) >= 0);
+        assert_se(strtab_writer_add(w, 1, "binary", "a\0b\0\0c", 6) >= 0);
+
+        assert_se(strtab_writer_write(w, "test", 4711, p, 0600) >= 0);
+        assert_se(stat(p, &st) >= 0);
+        assert_se((st.st_mode & 07777) == 0600);
+
+        assert_se(strtab_open(p, "test", &t) >= 0);
+        assert_se(strtab_get_stamp(t) == 4711);
+        assert_se(strtab_get_n_sections(t) == 3);
+        assert_se(strtab_section_get_n_entries(t, 0) == 4);
+        assert_se(strtab_section_get_n_entries(t, 1) == 2);
+        assert_se(strtab_section_get_n_entries(t, 2) == 0);
+        assert_se(strtab_section_get_n_entries(t, 3) == 0);
+
+        assert_se(streq_ptr(lookup_string(t, 0, "waldo.service"), "/usr/lib/systemd/system/waldo.service"));
+        assert_se(streq_ptr(lookup_string(t, 0, "foo.service"), "/etc/systemd/system/foo.service"));
+        assert_se(streq_ptr(lookup_string(t, 0, "bar.service"), "/dev/null"));
+        assert_se(streq_ptr(lookup_string(t, 0, "empty.service"), ""));
+        assert_se(!lookup_string(t, 0, "quux.service"));
+        assert_se(!lookup_string(t, 0, ""));
+        assert_se(!lookup_string(t, 2, "waldo.service"));
+        assert_se(!lookup_string(t, 3, "waldo.service"));
+
+        assert_se(strtab_lookup(t, 1, "waldo.service", &value, &size) == 1);
+        assert_se(l = strv_parse_nulstr(value, size));
+        assert_se(strv_equal(l, STRV_MAKE("waldo.service", "quux.service")));
+
+        assert_se(strtab_lookup(t, 1, "binary", &value, &size) == 1);
+        assert_se(size == 6);
+        assert_se(memcmp(value, "a\0b\0\0c", 7) == 0);
+
+        /* Entries are sorted by key */
+        assert_se(strtab_get_entry(t, 0, 0, &key, &value, &size) >= 0);
+        assert_se(streq(key, "bar.service"));
+        assert_se(streq(value, "/dev/null"));
+        assert_se(size == 9);
+        assert_se(strtab_get_entry(t, 0, 3, &key, NULL, NULL) >= 0);
+        assert_se(streq(key, "waldo.service"));
+        assert_se(strtab_get_entry(t, 0, 4, &key, NULL, NULL) == -ENXIO);
+
+        /* The unit name keys are stored only as tails of the paths, and the string buffer starts with an
+         * empty string */
+        assert_se(strtab_get_size(t) == sizeof(struct strtab_header_f) +
+                                       3 * sizeof(struct strtab_section_f) +
+                                       6 * sizeof(struct strtab_entry_f) +
+                                       sizeof("/usr/lib/systemd/system/waldo.service") +
+                                       sizeof("/etc/systemd/system/foo.service") +
+                                       sizeof("/dev/null") + 7 +
+                                       sizeof("waldo.service\0quux.service\0") +
+                                       sizeof("binary") + sizeof("bar.service") + sizeof("empty.service") + 1);
+
+        t = strtab_free(t);
+        assert_se(strtab_open(p, "other", &t) == -EBADMSG);
+        assert_se(!t);
+
+        /* Duplicate keys are refused */
+        assert_se(strtab_writer_add_string(w, 0, "foo.service", "/run/systemd/system/foo.service") >= 0);
+        assert_se(strtab_writer_write(w, "test", 4711, p, 0444) == -ENOTUNIQ);
+}
+
+static void write_file(const char *p, const void *data, size_t size) {
+        _cleanup_close_ int fd = -EBADF;
+
+        (void) unlink(p);
+
+        fd = open(p, O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC, 0644);
+        assert_se(fd >= 0);
+        assert_se(loop_write(fd, data, size) >= 0);
+}
+
+TEST(strtab_corrupt) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmpdir = NULL;
+        _cleanup_(strtab_writer_freep) StrtabWriter *w = NULL;
+        _cleanup_(strtab_freep) Strtab *t = NULL;
+        _cleanup_free_ char *data = NULL;
+        const char *p;
+        size_t size;
+
+        assert_se(mkdtemp_malloc("/tmp/test-strtab-XXXXXX", &tmpdir) >= 0);
+        p = strjoina(tmpdir, "/table");
+
+        assert_se(strtab_writer_new(1, &w) >= 0);
+        assert_se(strtab_writer_add_string(w, 0, "foo", "bar") >= 0);
+        assert_se(strtab_writer_write(w, "test", 0, p, 0444) >= 0);
+
+        assert_se(read_full_file(p, &data, &size) >= 0);
+
+        /* Truncated */
+        write_file(p, data, size - 1);
+        assert_se(strtab_open(p, "test", &t) == -EBADMSG);
+
+        /* Wrong version */
+        ((struct strtab_header_f*) data)->version = htole32(STRTAB_VERSION + 1);
+        write_file(p, data, size);
+        assert_se(strtab_open(p, "test", &t) == -EBADMSG);
+
+        /* Entry pointing outside of the string buffer */
+        ((struct strtab_header_f*) data)->version = htole32(STRTAB_VERSION);
+        ((struct strtab_entry_f*) (data + sizeof(struct strtab_header_f) + sizeof(struct strtab_section_f)))->value_off = htole64(size);
+        write_file(p, data, size);
+        assert_se(strtab_open(p, "test", &t) >= 0);
+        assert_se(strtab_lookup(t, 0, "foo", NULL, NULL) == -EBADMSG);
+        assert_se(strtab_get_entry(t, 0, 0, NULL, NULL, NULL) == -EBADMSG);
+}
+
+DEFINE_TEST_MAIN(LOG_DEBUG);
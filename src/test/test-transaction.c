@@ -0,0 +1,335 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "bus-error.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "service.h"
+#include "tests.h"
+#include "time-util.h"
+#include "unit-name.h"
+
+/* Checks how transactions are fixed up: ordering cycles broken by dropping a job that doesn't matter,
+ * conflicting jobs for one unit resolved by dropping one of them, and jobs nothing requires anymore
+ * garbage collected. Then builds and applies transactions over a large number of units, and logs how long
+ * it takes: starting a target that pulls in many services ordered one after the other, starting it again
+ * once all of them are running, and isolating to it while as many other services are running. Pass the
+ * number of services to generate as argument to use this as a benchmark. */
+
+static unsigned arg_n_units;
+static char *runtime_dir = NULL;
+
+STATIC_DESTRUCTOR_REGISTER(runtime_dir, rm_rf_physical_and_freep);
+
+static Manager* setup(void) {
+        Manager *m;
+        int r;
+
+        r = manager_new(RUNTIME_SCOPE_SYSTEM, MANAGER_TEST_RUN_MINIMAL|MANAGER_TEST_DONT_OPEN_EXECUTOR, &m);
+        if (manager_errno_skip_test(r)) {
+                log_tests_skipped_errno(r, "manager_new");
+                return NULL;
+        }
+        assert_se(r >= 0);
+
+        manager_override_log_level(m, log_get_max_level());
+        manager_override_log_target(m, log_get_target());
+        return m;
+}
+
+static Unit* add_unit(Manager *m, const char *name) {
+        Unit *u;
+
+        assert_se(unit_new_for_name(m, unit_vtable[unit_name_to_type(name)]->object_size, name, &u) >= 0);
+        u->load_state = UNIT_LOADED;
+
+        return u;
+}
+
+static void add_dependency(Unit *u, UnitDependency d, Unit *other) {
+        assert_se(unit_add_dependency(u, d, other, true, UNIT_DEPENDENCY_FILE) >= 0);
+}
+
+static int start(Manager *m, Unit *u) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        int r;
+
+        r = manager_add_job(m, JOB_START, u, JOB_REPLACE, NULL, &error, NULL);
+        if (r < 0)
+                log_info_errno(r, "Failed to start %s: %s", u->id, bus_error_message(&error, r));
+
+        return r;
+}
+
+TEST(order_cycle_fixable) {
+        _cleanup_(manager_freep) Manager *m = NULL;
+        Unit *a, *b, *c;
+
+        m = setup();
+        if (!m)
+                return;
+
+        /* b and c are ordered after each other. c is only wanted, hence its job is dropped to break the
+         * cycle, while the one of b that a requires is kept. */
+        a = add_unit(m, "a.service");
+        b = add_unit(m, "b.service");
+        c = add_unit(m, "c.service");
+        add_dependency(a, UNIT_REQUIRES, b);
+        add_dependency(b, UNIT_WANTS, c);
+        add_dependency(b, UNIT_AFTER, c);
+        add_dependency(c, UNIT_AFTER, b);
+
+        assert_se(start(m, a) == 0);
+        assert_se(unit_has_job_type(a, JOB_START));
+        assert_se(unit_has_job_type(b, JOB_START));
+        assert_se(!c->job);
+        assert_se(hashmap_size(m->jobs) == 2);
+}
+
+TEST(order_cycle_unfixable) {
+        _cleanup_(manager_freep) Manager *m = NULL;
+        Unit *a, *b, *c;
+
+        m = setup();
+        if (!m)
+                return;
+
+        /* All jobs in the cycle matter to the anchor, hence nothing can be dropped */
+        a = add_unit(m, "a.service");
+        b = add_unit(m, "b.service");
+        c = add_unit(m, "c.service");
+        add_dependency(a, UNIT_REQUIRES, b);
+        add_dependency(b, UNIT_REQUIRES, c);
+        add_dependency(b, UNIT_AFTER, c);
+        add_dependency(c, UNIT_AFTER, b);
+
+        assert_se(start(m, a) == -EDEADLK);
+        assert_se(hashmap_isempty(m->jobs));
+}
+
+TEST(order_cycle_garbage) {
+        _cleanup_(manager_freep) Manager *m = NULL;
+        Unit *a, *b, *c, *d;
+
+        m = setup();
+        if (!m)
+                return;
+
+        /* Neither b nor c matter, whichever of them is dropped to break the cycle takes the other one
+         * with it, either as job requiring it or as job nothing requires anymore. So does d, which only c
+         * wants. */
+        a = add_unit(m, "a.service");
+        b = add_unit(m, "b.service");
+        c = add_unit(m, "c.service");
+        d = add_unit(m, "d.service");
+        add_dependency(a, UNIT_WANTS, b);
+        add_dependency(b, UNIT_REQUIRES, c);
+        add_dependency(b, UNIT_AFTER, c);
+        add_dependency(c, UNIT_AFTER, b);
+        add_dependency(c, UNIT_WANTS, d);
+
+        assert_se(start(m, a) == 0);
+        assert_se(unit_has_job_type(a, JOB_START));
+        assert_se(!b->job);
+        assert_se(!c->job);
+        assert_se(!d->job);
+        assert_se(hashmap_size(m->jobs) == 1);
+}
+
+TEST(merge_conflicting) {
+        _cleanup_(manager_freep) Manager *m = NULL;
+        Unit *a, *b, *c, *d;
+
+        m = setup();
+        if (!m)
+                return;
+
+        /* c conflicts with b, which a requires. The stop job for b doesn't matter, as a only wants c,
+         * hence it is dropped together with the start job of c that pulled it in, and the start job
+         * of d that only c wants is garbage collected. */
+        a = add_unit(m, "a.service");
+        b = add_unit(m, "b.service");
+        c = add_unit(m, "c.service");
+        d = add_unit(m, "d.service");
+        add_dependency(a, UNIT_REQUIRES, b);
+        add_dependency(a, UNIT_WANTS, c);
+        add_dependency(c, UNIT_CONFLICTS, b);
+        add_dependency(c, UNIT_WANTS, d);
+
+        assert_se(start(m, a) == 0);
+        assert_se(unit_has_job_type(a, JOB_START));
+        assert_se(unit_has_job_type(b, JOB_START));
+        assert_se(!c->job);
+        assert_se(!d->job);
+        assert_se(hashmap_size(m->jobs) == 2);
+}
+
+TEST(merge_conflicting_unfixable) {
+        _cleanup_(manager_freep) Manager *m = NULL;
+        Unit *a, *b, *c;
+
+        m = setup();
+        if (!m)
+                return;
+
+        /* a requires both b and c, which conflict with each other */
+        a = add_unit(m, "a.service");
+        b = add_unit(m, "b.service");
+        c = add_unit(m, "c.service");
+        add_dependency(a, UNIT_REQUIRES, b);
+        add_dependency(a, UNIT_REQUIRES, c);
+        add_dependency(c, UNIT_CONFLICTS, b);
+
+        assert_se(start(m, a) == -EDEADLK);
+        assert_se(hashmap_isempty(m->jobs));
+}
+
+TEST(collect_garbage) {
+        _cleanup_(manager_freep) Manager *m = NULL;
+        Unit *a, *b, *c, *d, *e;
+
+        m = setup();
+        if (!m)
+                return;
+
+        /* b is running already, hence its start job is redundant, and the jobs for the units only b
+         * wants are not needed anymore once it is dropped, even those pulled in transitively. The job
+         * for d which a wants too is kept. */
+        a = add_unit(m, "a.service");
+        b = add_unit(m, "b.service");
+        c = add_unit(m, "c.service");
+        d = add_unit(m, "d.service");
+        e = add_unit(m, "e.service");
+        add_dependency(a, UNIT_WANTS, b);
+        add_dependency(a, UNIT_WANTS, d);
+        add_dependency(b, UNIT_WANTS, c);
+        add_dependency(b, UNIT_WANTS, d);
+        add_dependency(c, UNIT_WANTS, e);
+        SERVICE(b)->state = SERVICE_RUNNING;
+
+        assert_se(start(m, a) == 0);
+        assert_se(unit_has_job_type(a, JOB_START));
+        assert_se(!b->job);
+        assert_se(!c->job);
+        assert_se(unit_has_job_type(d, JOB_START));
+        assert_se(!e->job);
+        assert_se(hashmap_size(m->jobs) == 2);
+}
+
+static void set_running(Manager *m, const char *prefix) {
+        for (unsigned i = 0; i < arg_n_units; i++) {
+                _cleanup_free_ char *name = NULL;
+                Unit *u;
+
+                assert_se(asprintf(&name, "%s-%u.service", prefix, i) >= 0);
+                assert_se(u = manager_get_unit(m, name));
+
+                SERVICE(u)->state = SERVICE_RUNNING;
+        }
+}
+
+static Manager* setup_many(Unit **ret_target) {
+        Unit *target, *missing, *prev = NULL;
+        Manager *m;
+
+        m = setup();
+        if (!m)
+                return NULL;
+
+        target = add_unit(m, "bench.target");
+        target->allow_isolate = true;
+
+        missing = add_unit(m, "bench-missing.service");
+        missing->load_state = UNIT_NOT_FOUND;
+
+        for (unsigned i = 0; i < arg_n_units; i++) {
+                _cleanup_free_ char *name = NULL;
+                Unit *u;
+
+                /* The target pulls in all services, each of them is ordered after the one before and
+                 * wants a unit that doesn't exist */
+                assert_se(asprintf(&name, "bench-%u.service", i) >= 0);
+                u = add_unit(m, name);
+
+                assert_se(unit_add_two_dependencies(target, UNIT_AFTER, UNIT_WANTS, u, true, UNIT_DEPENDENCY_FILE) >= 0);
+                add_dependency(u, UNIT_WANTS, missing);
+                if (prev)
+                        add_dependency(u, UNIT_AFTER, prev);
+
+                prev = u;
+
+                /* Services that are not part of the target at all */
+                name = mfree(name);
+                assert_se(asprintf(&name, "other-%u.service", i) >= 0);
+                (void) add_unit(m, name);
+        }
+
+        *ret_target = target;
+        return m;
+}
+
+static void test_many(const char *name, Manager *m, Unit *target, JobMode mode, unsigned n_jobs) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        usec_t ts;
+        int r;
+
+        ts = now(CLOCK_MONOTONIC);
+        r = manager_add_job(m, JOB_START, target, mode, NULL, &error, NULL);
+        ts = now(CLOCK_MONOTONIC) - ts;
+        if (r < 0)
+                log_error_errno(r, "Failed to add job: %s", bus_error_message(&error, r));
+        assert_se(r >= 0);
+
+        log_info("%-14s %6u units: %6u jobs in %s",
+                 name, hashmap_size(m->units), hashmap_size(m->jobs), FORMAT_TIMESPAN(ts, 1));
+
+        assert_se(unit_has_job_type(target, JOB_START));
+        assert_se(hashmap_size(m->jobs) == n_jobs);
+
+        manager_clear_jobs(m);
+}
+
+TEST(many_start) {
+        _cleanup_(manager_freep) Manager *m = NULL;
+        Unit *target;
+
+        m = setup_many(&target);
+        if (!m)
+                return;
+
+        /* All services are started, the missing one is skipped */
+        test_many("start", m, target, JOB_REPLACE, arg_n_units + 1);
+}
+
+TEST(many_start_running) {
+        _cleanup_(manager_freep) Manager *m = NULL;
+        Unit *target;
+
+        m = setup_many(&target);
+        if (!m)
+                return;
+
+        /* All jobs but the one for the target are redundant */
+        set_running(m, "bench");
+        test_many("start-running", m, target, JOB_REPLACE, 1);
+}
+
+TEST(many_isolate) {
+        _cleanup_(manager_freep) Manager *m = NULL;
+        Unit *target;
+
+        m = setup_many(&target);
+        if (!m)
+                return;
+
+        /* All the other services need to be stopped */
+        set_running(m, "other");
+        test_many("isolate", m, target, JOB_ISOLATE, 2 * arg_n_units + 1);
+}
+
+static int intro(void) {
+        arg_n_units = test_size_from_args(1000, 50000);
+
+        return setup_manager_test(&runtime_dir);
+}
+
+DEFINE_TEST_MAIN_WITH_INTRO(LOG_INFO, intro);
@@ -0,0 +1,157 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "tests.h"
+#include "unit-dependency-set.h"
+
+/* The sets never dereference the units, hence fake pointers are good enough */
+#define UNIT(i) ((Unit*) UINT_TO_PTR(0x1000 + (i) * 8))
+#define INFO(o, d) ((UnitDependencyInfo) { .origin_mask = (o), .destination_mask = (d) })
+
+static void test_set_one(unsigned n) {
+        UnitDependencySet s = {};
+        UnitDependencyInfo info;
+        unsigned n_seen = 0;
+        Unit *u;
+
+        for (unsigned i = 0; i < n; i++)
+                assert_se(unit_dependency_set_replace(&s, UNIT(i), INFO(UNIT_DEPENDENCY_FILE, 0)) >= 0);
+
+        /* Replacing doesn't add entries */
+        for (unsigned i = 0; i < n; i += 2)
+                assert_se(unit_dependency_set_replace(&s, UNIT(i), INFO(UNIT_DEPENDENCY_FILE, UNIT_DEPENDENCY_UDEV)) >= 0);
+
+        assert_se(unit_dependency_set_size(&s) == n);
+        assert_se(s.is_hashmap == (n > UNIT_DEPENDENCY_SET_ARRAY_MAX));
+
+        for (unsigned i = 0; i < n; i++) {
+                info = unit_dependency_set_get(&s, UNIT(i));
+                assert_se(info.origin_mask == UNIT_DEPENDENCY_FILE);
+                assert_se(info.destination_mask == (i % 2 == 0 ? UNIT_DEPENDENCY_UDEV : 0));
+        }
+        assert_se(!unit_dependency_set_contains(&s, UNIT(n)));
+        assert_se(!unit_dependency_set_remove(&s, UNIT(n)).data);
+
+        /* The current entry may be removed while iterating */
+        UNIT_DEPENDENCY_SET_FOREACH_INFO(u, info, &s) {
+                assert_se(info.origin_mask == UNIT_DEPENDENCY_FILE);
+
+                if (n_seen++ % 3 == 0)
+                        assert_se(unit_dependency_set_remove(&s, u).data == info.data);
+        }
+        assert_se(n_seen == n);
+        assert_se(unit_dependency_set_size(&s) == n - (n + 2) / 3);
+
+        n_seen = 0;
+        UNIT_DEPENDENCY_SET_FOREACH(u, &s)
+                n_seen++;
+        assert_se(n_seen == unit_dependency_set_size(&s));
+
+        while (unit_dependency_set_steal_first(&s, &info))
+                n_seen--;
+        assert_se(n_seen == 0);
+        assert_se(unit_dependency_set_isempty(&s));
+
+        unit_dependency_set_done(&s);
+}
+
+TEST(set) {
+        test_set_one(1);
+        test_set_one(UNIT_DEPENDENCY_SET_ARRAY_MAX);
+        test_set_one(UNIT_DEPENDENCY_SET_ARRAY_MAX + 1);
+        test_set_one(100);
+}
+
+static void test_move_one(unsigned n) {
+        UnitDependencySet s = {};
+        UnitDependencyInfo info;
+
+        for (unsigned i = 0; i < n; i++)
+                assert_se(unit_dependency_set_replace(&s, UNIT(i), INFO(UNIT_DEPENDENCY_FILE, 0)) >= 0);
+
+        /* Moving onto a unit not in the set */
+        assert_se(unit_dependency_set_move(&s, UNIT(0), UNIT(n)));
+        assert_se(!unit_dependency_set_contains(&s, UNIT(0)));
+        assert_se(unit_dependency_set_contains(&s, UNIT(n)));
+        assert_se(unit_dependency_set_size(&s) == n);
+
+        /* Moving onto a unit in the set merges the masks */
+        assert_se(unit_dependency_set_replace(&s, UNIT(1), INFO(UNIT_DEPENDENCY_IMPLICIT, UNIT_DEPENDENCY_PATH)) >= 0);
+        assert_se(unit_dependency_set_move(&s, UNIT(1), UNIT(n)));
+        assert_se(unit_dependency_set_size(&s) == n - 1);
+        info = unit_dependency_set_get(&s, UNIT(n));
+        assert_se(info.origin_mask == (UNIT_DEPENDENCY_FILE|UNIT_DEPENDENCY_IMPLICIT));
+        assert_se(info.destination_mask == UNIT_DEPENDENCY_PATH);
+
+        assert_se(!unit_dependency_set_move(&s, UNIT(1), UNIT(n)));
+
+        unit_dependency_set_done(&s);
+}
+
+TEST(move) {
+        test_move_one(2);
+        test_move_one(UNIT_DEPENDENCY_SET_ARRAY_MAX * 2);
+}
+
+TEST(reserve) {
+        UnitDependencySet s = {};
+
+        assert_se(unit_dependency_set_reserve(&s, UNIT_DEPENDENCY_SET_ARRAY_MAX) >= 0);
+        assert_se(!s.is_hashmap);
+        assert_se(unit_dependency_set_isempty(&s));
+
+        assert_se(unit_dependency_set_reserve(&s, UNIT_DEPENDENCY_SET_ARRAY_MAX + 1) >= 0);
+        assert_se(s.is_hashmap);
+
+        unit_dependency_set_done(&s);
+}
+
+TEST(dependencies) {
+        UnitDependencies d = {};
+        UnitDependenciesMemory m = {};
+        UnitDependencySet set;
+        UnitDependency t;
+
+        assert_se(!unit_dependencies_get(&d, UNIT_AFTER));
+
+        /* The sets are kept ordered by type, whatever the order they are added in */
+        assert_se(unit_dependency_set_replace(unit_dependencies_ensure(&d, UNIT_AFTER), UNIT(1), INFO(UNIT_DEPENDENCY_FILE, 0)) >= 0);
+        assert_se(unit_dependency_set_replace(unit_dependencies_ensure(&d, UNIT_REQUIRES), UNIT(2), INFO(UNIT_DEPENDENCY_FILE, 0)) >= 0);
+        assert_se(unit_dependency_set_replace(unit_dependencies_ensure(&d, UNIT_IN_SLICE), UNIT(3), INFO(UNIT_DEPENDENCY_FILE, 0)) >= 0);
+        assert_se(unit_dependency_set_replace(unit_dependencies_ensure(&d, UNIT_REQUIRES), UNIT(4), INFO(UNIT_DEPENDENCY_FILE, 0)) >= 0);
+
+        assert_se(d.types == (INDEX_TO_MASK(uint64_t, UNIT_REQUIRES) |
+                              INDEX_TO_MASK(uint64_t, UNIT_AFTER) |
+                              INDEX_TO_MASK(uint64_t, UNIT_IN_SLICE)));
+        assert_se(unit_dependencies_get(&d, UNIT_REQUIRES) == d.sets);
+        assert_se(unit_dependency_set_size(unit_dependencies_get(&d, UNIT_REQUIRES)) == 2);
+        assert_se(unit_dependency_set_contains(unit_dependencies_get(&d, UNIT_AFTER), UNIT(1)));
+        assert_se(unit_dependency_set_contains(unit_dependencies_get(&d, UNIT_IN_SLICE), UNIT(3)));
+        assert_se(!unit_dependencies_get(&d, UNIT_BEFORE));
+
+        unit_dependencies_memory_usage(&d, &m);
+        assert_se(m.n_sets_array == 3);
+        assert_se(m.n_sets_hashmap == 0);
+        assert_se(m.n_entries == 4);
+        assert_se(m.size >= 3 * sizeof(UnitDependencySet) + 4 * sizeof(UnitDependencyEntry));
+
+        /* Empty sets are only dropped when trimming */
+        assert_se(unit_dependency_set_remove(unit_dependencies_get(&d, UNIT_AFTER), UNIT(1)).data);
+        assert_se(unit_dependencies_get(&d, UNIT_AFTER));
+        unit_dependencies_trim(&d);
+        assert_se(!unit_dependencies_get(&d, UNIT_AFTER));
+        assert_se(unit_dependency_set_contains(unit_dependencies_get(&d, UNIT_IN_SLICE), UNIT(3)));
+
+        assert_se(unit_dependencies_steal_first(&d, &t, &set));
+        assert_se(t == UNIT_REQUIRES);
+        assert_se(unit_dependency_set_size(&set) == 2);
+        unit_dependency_set_done(&set);
+
+        unit_dependencies_remove(&d, UNIT_IN_SLICE);
+        assert_se(d.types == 0);
+        assert_se(!d.sets);
+        assert_se(!unit_dependencies_steal_first(&d, &t, &set));
+
+        unit_dependencies_done(&d);
+}
+
+DEFINE_TEST_MAIN(LOG_DEBUG);
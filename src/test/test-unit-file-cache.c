@@ -0,0 +1,300 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "conf-parser.h"
+#include "fileio.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "set.h"
+#include "strtab.h"
+#include "tests.h"
+#include "time-util.h"
+#include "tmpfile-util.h"
+#include "unit-file-cache.h"
+
+#define N_PRELOAD 64U
+
+static void write_file(const char *path, const char *contents) {
+        assert_se(write_string_file(path, contents, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_TRUNCATE) >= 0);
+}
+
+/* Files are only cached once their ctime is at least a second in the past, see stat_is_racy() */
+static void wait_until_not_racy(void) {
+        assert_se(usleep_safe(USEC_PER_SEC + 100 * USEC_PER_MSEC) >= 0);
+}
+
+static void cache_begin(UnitFileCache *c, const char *dir) {
+        if (!c->path)
+                assert_se(c->path = path_join(dir, "unit-file.cache"));
+
+        unit_file_cache_begin(c);
+        assert_se(c->active);
+}
+
+/* Reads the file through the cache, and checks that we get the same lines as when reading it directly */
+static void check_read(UnitFileCache *c, const char *path) {
+        _cleanup_(config_lines_done) ConfigLines cached = {}, plain = {};
+        struct stat st_cached, st_plain;
+
+        assert_se(unit_file_cache_read_lines(c, path, NULL, &cached, &st_cached) > 0);
+        assert_se(config_read_lines(path, NULL, /* flags= */ 0, &plain, &st_plain) > 0);
+
+        assert_se(st_cached.st_ino == st_plain.st_ino);
+        assert_se(st_cached.st_size == st_plain.st_size);
+
+        assert_se(cached.n_lines == plain.n_lines);
+        for (size_t i = 0; i < plain.n_lines; i++) {
+                assert_se(cached.lines[i].line == plain.lines[i].line);
+                assert_se(streq(cached.lines[i].text, plain.lines[i].text));
+        }
+}
+
+static void check_counters(UnitFileCache *c, unsigned n_hits, unsigned n_misses, unsigned n_preloaded) {
+        log_debug("hits=%u misses=%u preloaded=%u", c->n_hits, c->n_misses, c->n_preloaded);
+
+        assert_se(c->n_hits == n_hits);
+        assert_se(c->n_misses == n_misses);
+        assert_se(c->n_preloaded == n_preloaded);
+}
+
+TEST(racy) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmpdir = NULL;
+        _cleanup_(unit_file_cache_done) UnitFileCache c = {};
+        const char *p;
+
+        assert_se(mkdtemp_malloc("/tmp/test-unit-file-cache-XXXXXX", &tmpdir) >= 0);
+        p = strjoina(tmpdir, "/racy.service");
+
+        /* A file that was just written might be written again within the granularity of its timestamps,
+         * hence it must be read, but not cached */
+        write_file(p, "[Unit]\nDescription=Racy\n");
+
+        cache_begin(&c, tmpdir);
+        check_read(&c, p);
+        check_counters(&c, 0, 1, 0);
+        assert_se(!hashmap_contains(c.entries, p));
+        unit_file_cache_end(&c);
+
+        /* Modified in the same second as it was read, with the same size: must not be served from the cache */
+        write_file(p, "[Unit]\nDescription=Yacr\n");
+
+        cache_begin(&c, tmpdir);
+        check_read(&c, p);
+        check_counters(&c, 0, 1, 0);
+        unit_file_cache_end(&c);
+}
+
+TEST(invalidation) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmpdir = NULL;
+        _cleanup_(unit_file_cache_done) UnitFileCache c = {};
+        const char *mtime, *size, *inode, *same, *tmp;
+        struct stat st;
+
+        assert_se(mkdtemp_malloc("/tmp/test-unit-file-cache-XXXXXX", &tmpdir) >= 0);
+        mtime = strjoina(tmpdir, "/mtime.service");
+        size = strjoina(tmpdir, "/size.service");
+        inode = strjoina(tmpdir, "/inode.service");
+        same = strjoina(tmpdir, "/same.service");
+        tmp = strjoina(tmpdir, "/tmp.service");
+
+        write_file(mtime, "[Unit]\nDescription=mtime\n");
+        write_file(size, "[Unit]\nDescription=size\n");
+        write_file(inode, "[Unit]\nDescription=inode\n");
+        write_file(same, "[Unit]\n# comment\nDescription=same \\\n  continued\n\n[Service]\nExecStart=/bin/true\n");
+        wait_until_not_racy();
+
+        /* The first cycle reads and caches all files, the second finds them all in the cache */
+        cache_begin(&c, tmpdir);
+        FOREACH_STRING(p, mtime, size, inode, same)
+                check_read(&c, p);
+        check_counters(&c, 0, 4, 0);
+        FOREACH_STRING(p, mtime, size, inode, same)
+                assert_se(hashmap_contains(c.entries, p));
+        unit_file_cache_end(&c);
+
+        cache_begin(&c, tmpdir);
+        assert_se(c.table);
+        FOREACH_STRING(p, mtime, size, inode, same)
+                check_read(&c, p);
+        check_counters(&c, 4, 0, 0);
+        unit_file_cache_end(&c);
+
+        /* Only the timestamp changes */
+        assert_se(stat(mtime, &st) >= 0);
+        assert_se(utimensat(AT_FDCWD, mtime,
+                            (const struct timespec[2]) { st.st_atim, { st.st_mtim.tv_sec - 10, st.st_mtim.tv_nsec } },
+                            0) >= 0);
+
+        /* Only the size changes */
+        write_file(size, "[Unit]\nDescription=size changed\n");
+
+        /* Only the inode changes: the same contents, with the old timestamps, are renamed over the file */
+        assert_se(stat(inode, &st) >= 0);
+        write_file(tmp, "[Unit]\nDescription=INODE\n");
+        assert_se(utimensat(AT_FDCWD, tmp, (const struct timespec[2]) { st.st_atim, st.st_mtim }, 0) >= 0);
+        assert_se(rename(tmp, inode) >= 0);
+
+        cache_begin(&c, tmpdir);
+        FOREACH_STRING(p, mtime, size, inode, same)
+                check_read(&c, p);
+        check_counters(&c, 1, 3, 0);
+
+        /* The modified files are racy now, only the untouched one is carried over */
+        assert_se(!hashmap_contains(c.entries, mtime));
+        assert_se(!hashmap_contains(c.entries, size));
+        assert_se(!hashmap_contains(c.entries, inode));
+        assert_se(hashmap_contains(c.entries, same));
+        unit_file_cache_end(&c);
+
+        /* Once they are old enough, they are cached again */
+        wait_until_not_racy();
+
+        cache_begin(&c, tmpdir);
+        FOREACH_STRING(p, mtime, size, inode, same)
+                check_read(&c, p);
+        check_counters(&c, 1, 3, 0);
+        unit_file_cache_end(&c);
+
+        cache_begin(&c, tmpdir);
+        FOREACH_STRING(p, mtime, size, inode, same)
+                check_read(&c, p);
+        check_counters(&c, 4, 0, 0);
+        unit_file_cache_end(&c);
+}
+
+TEST(decode_error) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmpdir = NULL;
+        _cleanup_(unit_file_cache_done) UnitFileCache c = {};
+        _cleanup_(strtab_writer_freep) StrtabWriter *w = NULL;
+        _cleanup_(strtab_freep) Strtab *t = NULL;
+        const char *short_entry, *truncated, *good;
+        const void *data;
+        size_t sz;
+
+        assert_se(mkdtemp_malloc("/tmp/test-unit-file-cache-XXXXXX", &tmpdir) >= 0);
+        short_entry = strjoina(tmpdir, "/short.service");
+        truncated = strjoina(tmpdir, "/truncated.service");
+        good = strjoina(tmpdir, "/good.service");
+
+        write_file(short_entry, "[Unit]\nDescription=short\n");
+        write_file(truncated, "[Unit]\nDescription=truncated\n");
+        write_file(good, "[Unit]\nDescription=good\n");
+        wait_until_not_racy();
+
+        cache_begin(&c, tmpdir);
+        FOREACH_STRING(p, short_entry, truncated, good)
+                check_read(&c, p);
+        unit_file_cache_end(&c);
+
+        /* Rewrite the cache: one entry too short to contain the file identity, one with valid identity
+         * but the last line lacking its terminating NUL, and one intact */
+        assert_se(strtab_open(c.path, UNIT_FILE_CACHE_TYPE, &t) >= 0);
+        assert_se(strtab_writer_new(_UNIT_FILE_CACHE_SECTION_MAX, &w) >= 0);
+
+        assert_se(strtab_writer_add(w, UNIT_FILE_CACHE_SECTION_FILES, short_entry, "xyz", 3) >= 0);
+
+        assert_se(strtab_lookup(t, UNIT_FILE_CACHE_SECTION_FILES, truncated, &data, &sz) > 0);
+        assert_se(sz > 1);
+        assert_se(strtab_writer_add(w, UNIT_FILE_CACHE_SECTION_FILES, truncated, data, sz - 1) >= 0);
+
+        assert_se(strtab_lookup(t, UNIT_FILE_CACHE_SECTION_FILES, good, &data, &sz) > 0);
+        assert_se(strtab_writer_add(w, UNIT_FILE_CACHE_SECTION_FILES, good, data, sz) >= 0);
+
+        t = strtab_free(t);
+        assert_se(strtab_writer_write(w, UNIT_FILE_CACHE_TYPE, UNIT_FILE_CACHE_FORMAT, c.path, 0600) >= 0);
+        w = strtab_writer_free(w);
+
+        /* Broken entries are ignored and the files read again, which also replaces the entries */
+        cache_begin(&c, tmpdir);
+        FOREACH_STRING(p, short_entry, truncated, good)
+                check_read(&c, p);
+        check_counters(&c, 1, 2, 0);
+        unit_file_cache_end(&c);
+
+        cache_begin(&c, tmpdir);
+        FOREACH_STRING(p, short_entry, truncated, good)
+                check_read(&c, p);
+        check_counters(&c, 3, 0, 0);
+        unit_file_cache_end(&c);
+
+        /* A cache of an unknown format is ignored as a whole */
+        assert_se(strtab_writer_new(_UNIT_FILE_CACHE_SECTION_MAX, &w) >= 0);
+        assert_se(strtab_writer_write(w, UNIT_FILE_CACHE_TYPE, UNIT_FILE_CACHE_FORMAT + 1, c.path, 0600) >= 0);
+        w = strtab_writer_free(w);
+
+        cache_begin(&c, tmpdir);
+        assert_se(!c.table);
+        FOREACH_STRING(p, short_entry, truncated, good)
+                check_read(&c, p);
+        check_counters(&c, 0, 3, 0);
+        unit_file_cache_end(&c);
+
+        /* And so is a file that isn't a string table at all */
+        write_file(c.path, "garbage");
+
+        cache_begin(&c, tmpdir);
+        assert_se(!c.table);
+        FOREACH_STRING(p, short_entry, truncated, good)
+                check_read(&c, p);
+        check_counters(&c, 0, 3, 0);
+        unit_file_cache_end(&c);
+}
+
+TEST(preload) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmpdir = NULL;
+        _cleanup_(unit_file_cache_done) UnitFileCache c = {};
+        _cleanup_set_free_ Set *paths = NULL;
+        _cleanup_free_ char *changed = NULL;
+        const char *p;
+        int r;
+
+        assert_se(mkdtemp_malloc("/tmp/test-unit-file-cache-XXXXXX", &tmpdir) >= 0);
+
+        for (unsigned i = 0; i < N_PRELOAD; i++) {
+                _cleanup_free_ char *path = NULL, *contents = NULL;
+
+                assert_se(asprintf(&path, "%s/preload-%u.service", tmpdir, i) >= 0);
+                assert_se(asprintf(&contents,
+                                   "# preload test %u\n"
+                                   "[Unit]\n"
+                                   "Description=Preload %u \\\n"
+                                   "  continued\n"
+                                   "\n"
+                                   "[Service]\n"
+                                   "Environment=A=%u\n"
+                                   "ExecStart=/bin/echo %u\n",
+                                   i, i, i, i) >= 0);
+                write_file(path, contents);
+
+                if (i == 7)
+                        assert_se(changed = strdup(path));
+
+                assert_se(set_ensure_consume(&paths, &path_hash_ops_free, TAKE_PTR(path)) > 0);
+        }
+
+        cache_begin(&c, tmpdir);
+
+        r = unit_file_cache_preload(&c, paths);
+        assert_se(r >= 0);
+        if (r == 0)
+                return (void) log_tests_skipped("not enough CPUs to preload in worker processes");
+        assert_se((unsigned) r == N_PRELOAD);
+        assert_se(hashmap_size(c.preloaded) == N_PRELOAD);
+
+        /* Changed after it was preloaded, but before it is used */
+        write_file(changed, "[Unit]\nDescription=Changed after preloading\n");
+
+        /* The preloaded contents must be the same as those read directly, except for the file that
+         * changed, which must be read again */
+        SET_FOREACH(p, paths)
+                check_read(&c, p);
+        check_counters(&c, 0, N_PRELOAD, N_PRELOAD - 1);
+        assert_se(hashmap_isempty(c.preloaded));
+        unit_file_cache_end(&c);
+}
+
+DEFINE_TEST_MAIN(LOG_DEBUG);
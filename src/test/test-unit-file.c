@@ -1,11 +1,20 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fileio.h"
 #include "initrd-util.h"
 #include "path-lookup.h"
+#include "rm-rf.h"
 #include "set.h"
 #include "special.h"
+#include "stat-util.h"
+#include "string-util.h"
 #include "strv.h"
 #include "tests.h"
+#include "tmpfile-util.h"
 #include "unit-file.h"
 
 TEST(unit_validate_alias_symlink_and_warn) {
@@ -86,6 +95,133 @@ TEST(unit_file_build_name_map) {
         }
 }
 
+static void check_maps_same(
+                Hashmap *unit_ids, Hashmap *unit_names, Set *paths,
+                Hashmap *cached_ids, Hashmap *cached_names, Set *cached_paths) {
+
+        const char *k, *dst;
+        char **v;
+
+        assert_se(hashmap_size(cached_ids) == hashmap_size(unit_ids));
+        HASHMAP_FOREACH_KEY(dst, k, unit_ids)
+                assert_se(streq_ptr(hashmap_get(cached_ids, k), dst));
+
+        assert_se(hashmap_size(cached_names) == hashmap_size(unit_names));
+        HASHMAP_FOREACH_KEY(v, k, unit_names)
+                assert_se(strv_equal(hashmap_get(cached_names, k), v));
+
+        assert_se(set_size(cached_paths) == set_size(paths));
+        SET_FOREACH(k, paths)
+                assert_se(set_contains(cached_paths, k));
+}
+
+TEST(unit_file_build_name_map_cached) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmpdir = NULL;
+        _cleanup_(lookup_paths_free) LookupPaths lp = {};
+        _cleanup_hashmap_free_ Hashmap *unit_ids = NULL, *unit_names = NULL, *cached_ids = NULL, *cached_names = NULL;
+        _cleanup_set_free_ Set *paths = NULL, *cached_paths = NULL;
+        uint64_t hash = 0, cached_hash = 0;
+        const char *cache;
+
+        assert_se(mkdtemp_malloc("/tmp/test-unit-file-XXXXXX", &tmpdir) >= 0);
+        cache = strjoina(tmpdir, "/unit-name-map.cache");
+
+        assert_se(lookup_paths_init(&lp, RUNTIME_SCOPE_SYSTEM, 0, NULL) >= 0);
+
+        /* The first call builds the maps and writes the cache file, the second one loads the maps from it */
+        assert_se(unit_file_build_name_map_cached(&lp, cache, &hash, &unit_ids, &unit_names, &paths) == 1);
+        assert_se(access(cache, F_OK) >= 0);
+        assert_se(unit_file_build_name_map_cached(&lp, cache, &cached_hash, &cached_ids, &cached_names, &cached_paths) == 1);
+        assert_se(cached_hash == hash);
+
+        check_maps_same(unit_ids, unit_names, paths, cached_ids, cached_names, cached_paths);
+
+        /* Nothing changed, so the in-memory maps are still up-to-date */
+        assert_se(IN_SET(unit_file_build_name_map_cached(&lp, cache, &hash, &unit_ids, &unit_names, &paths), 0, 1));
+}
+
+static bool build_name_map_cached(const LookupPaths *lp, const char *cache) {
+        _cleanup_hashmap_free_ Hashmap *unit_ids = NULL, *unit_names = NULL, *cached_ids = NULL, *cached_names = NULL;
+        _cleanup_set_free_ Set *paths = NULL, *cached_paths = NULL;
+        struct stat before, after;
+        uint64_t hash = 0;
+        bool existed;
+
+        /* Builds the maps as after a reload, i.e. without any in-memory state, and checks that they match
+         * the maps built from scratch. Returns whether they were loaded from the cache file: it is replaced
+         * whenever it is written. */
+
+        existed = stat(cache, &before) >= 0;
+
+        assert_se(unit_file_build_name_map_cached(lp, cache, &hash, &cached_ids, &cached_names, &cached_paths) == 1);
+        assert_se(unit_file_build_name_map(lp, NULL, &unit_ids, &unit_names, &paths) == 1);
+        check_maps_same(unit_ids, unit_names, paths, cached_ids, cached_names, cached_paths);
+
+        assert_se(stat(cache, &after) >= 0);
+        return existed && stat_inode_same(&before, &after);
+}
+
+TEST(unit_file_build_name_map_cached_invalidation) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmpdir = NULL;
+        _cleanup_(lookup_paths_free) LookupPaths lp = {};
+        const char *cache, *etc, *gen, *outside;
+
+        assert_se(mkdtemp_malloc("/tmp/test-unit-file-XXXXXX", &tmpdir) >= 0);
+        cache = strjoina(tmpdir, "/unit-name-map.cache");
+        etc = strjoina(tmpdir, "/etc");
+        gen = strjoina(tmpdir, "/generator");
+        outside = strjoina(tmpdir, "/outside");
+
+        FOREACH_STRING(d, etc, gen, outside)
+                assert_se(mkdir(d, 0755) >= 0);
+
+        assert_se(lp.search_path = strv_new(etc, gen));
+        assert_se(lp.generator = strdup(gen));
+
+        /* A unit file, an alias of it, a unit file linked in from outside of the search path and an alias
+         * of that, and a generated unit */
+        assert_se(write_string_file_at(AT_FDCWD, strjoina(etc, "/plain.service"), "[Service]", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(symlink("plain.service", strjoina(etc, "/plain-alias.service")) >= 0);
+        assert_se(write_string_file_at(AT_FDCWD, strjoina(outside, "/linked.service"), "[Service]", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(symlink(strjoina(outside, "/linked.service"), strjoina(etc, "/linked.service")) >= 0);
+        assert_se(symlink("linked.service", strjoina(etc, "/linked-alias.service")) >= 0);
+        assert_se(write_string_file_at(AT_FDCWD, strjoina(gen, "/generated.service"), "[Service]", WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(!build_name_map_cached(&lp, cache));
+        assert_se(build_name_map_cached(&lp, cache));
+
+        /* The linked file is emptied, i.e. masked, the directory with the link doesn't notice */
+        assert_se(truncate(strjoina(outside, "/linked.service"), 0) >= 0);
+        assert_se(!build_name_map_cached(&lp, cache));
+        assert_se(build_name_map_cached(&lp, cache));
+
+        /* The linked file is replaced by a link to /dev/null */
+        assert_se(unlink(strjoina(outside, "/linked.service")) >= 0);
+        assert_se(symlink("/dev/null", strjoina(outside, "/linked.service")) >= 0);
+        assert_se(!build_name_map_cached(&lp, cache));
+        assert_se(build_name_map_cached(&lp, cache));
+
+        /* The linked file disappears */
+        assert_se(unlink(strjoina(outside, "/linked.service")) >= 0);
+        assert_se(!build_name_map_cached(&lp, cache));
+        assert_se(build_name_map_cached(&lp, cache));
+
+        /* A unit file is emptied in place */
+        assert_se(truncate(strjoina(etc, "/plain.service"), 0) >= 0);
+        assert_se(!build_name_map_cached(&lp, cache));
+        assert_se(build_name_map_cached(&lp, cache));
+
+        /* A generator adds a unit */
+        assert_se(symlink("generated.service", strjoina(gen, "/generated-alias.service")) >= 0);
+        assert_se(!build_name_map_cached(&lp, cache));
+        assert_se(build_name_map_cached(&lp, cache));
+
+        /* The search path changes */
+        assert_se(strv_extend(&lp.search_path, outside) >= 0);
+        assert_se(!build_name_map_cached(&lp, cache));
+        assert_se(build_name_map_cached(&lp, cache));
+}
+
 TEST(runlevel_to_target) {
         in_initrd_force(false);
         assert_se(streq_ptr(runlevel_to_target(NULL), NULL));
@@ -0,0 +1,205 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "sd-event.h"
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "json.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "sort-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "tmpfile-util.h"
+#include "varlink.h"
+#include "varlink-io.systemd.UserDatabase.h"
+
+/* A small load generator for io.systemd.UserDatabase: a number of clients look up a cheap user record in a
+ * loop, while one more client keeps asking for a record whose lookup blocks for a while, similar to what a
+ * slow NSS module would do. Reports the latency distribution of the cheap lookups, once with a server
+ * running all connections on one event loop and once with worker threads. */
+
+#define SLOW_LOOKUP_USEC (2 * USEC_PER_MSEC)
+
+static unsigned arg_clients = 8;
+static unsigned arg_calls = 200;
+
+typedef struct Client {
+        const char *address;
+        const char *user_name;
+        usec_t *latencies;
+        size_t n_latencies;
+        int done_fd;
+} Client;
+
+static unsigned n_fast_clients_done = 0;
+
+static int method_get_user_record(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        const char *user_name;
+
+        user_name = json_variant_string(json_variant_by_key(parameters, "userName"));
+        if (!user_name)
+                return varlink_error(link, "io.systemd.UserDatabase.NoRecordFound", NULL);
+
+        if (streq(user_name, "slow"))
+                (void) usleep_safe(SLOW_LOOKUP_USEC);
+
+        return varlink_replyb(link, JSON_BUILD_OBJECT(
+                        JSON_BUILD_PAIR("record", JSON_BUILD_OBJECT(
+                                        JSON_BUILD_PAIR("userName", JSON_BUILD_STRING(user_name)),
+                                        JSON_BUILD_PAIR("uid", JSON_BUILD_UNSIGNED(60123)),
+                                        JSON_BUILD_PAIR("gid", JSON_BUILD_UNSIGNED(60123)),
+                                        JSON_BUILD_PAIR("homeDirectory", JSON_BUILD_CONST_STRING("/home/benchmark")),
+                                        JSON_BUILD_PAIR("shell", JSON_BUILD_CONST_STRING("/bin/bash")),
+                                        JSON_BUILD_PAIR("disposition", JSON_BUILD_CONST_STRING("regular")))),
+                        JSON_BUILD_PAIR("incomplete", JSON_BUILD_BOOLEAN(false))));
+}
+
+static void lookup_one(Varlink *c, const char *user_name) {
+        JsonVariant *reply = NULL;
+        const char *error_id = NULL;
+
+        assert_se(varlink_callb(c, "io.systemd.UserDatabase.GetUserRecord", &reply, &error_id, NULL,
+                                JSON_BUILD_OBJECT(
+                                                JSON_BUILD_PAIR("userName", JSON_BUILD_STRING(user_name)),
+                                                JSON_BUILD_PAIR("service", JSON_BUILD_CONST_STRING("io.test.Benchmark")))) >= 0);
+        assert_se(!error_id);
+        assert_se(streq_ptr(json_variant_string(json_variant_by_key(json_variant_by_key(reply, "record"), "userName")), user_name));
+}
+
+static void* client_thread(void *arg) {
+        _cleanup_(varlink_flush_close_unrefp) Varlink *c = NULL;
+        Client *client = ASSERT_PTR(arg);
+
+        assert_se(varlink_connect_address(&c, client->address) >= 0);
+
+        if (client->latencies) {
+                for (unsigned i = 0; i < arg_calls; i++) {
+                        usec_t t = now(CLOCK_MONOTONIC);
+
+                        lookup_one(c, client->user_name);
+                        client->latencies[client->n_latencies++] = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+                }
+
+                __atomic_add_fetch(&n_fast_clients_done, 1, __ATOMIC_SEQ_CST);
+        } else
+                /* The slow client keeps the server busy for as long as the others are running */
+                while (__atomic_load_n(&n_fast_clients_done, __ATOMIC_SEQ_CST) < arg_clients)
+                        lookup_one(c, client->user_name);
+
+        assert_se(eventfd_write(client->done_fd, 1) >= 0);
+        return NULL;
+}
+
+static int done_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        unsigned *n_running = ASSERT_PTR(userdata);
+        eventfd_t n;
+
+        assert_se(eventfd_read(fd, &n) >= 0);
+        assert_se(*n_running >= n);
+
+        *n_running -= n;
+        if (*n_running == 0)
+                return sd_event_exit(sd_event_source_get_event(s), 0);
+
+        return 0;
+}
+
+static int usec_compare(const usec_t *a, const usec_t *b) {
+        return CMP(*a, *b);
+}
+
+static void test_one(const char *label, VarlinkServerFlags flags) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmpdir = NULL;
+        _cleanup_close_ int done_fd = -EBADF;
+        _cleanup_(sd_event_source_unrefp) sd_event_source *done_event = NULL;
+        _cleanup_(varlink_server_unrefp) VarlinkServer *s = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_free_ pthread_t *threads = NULL;
+        _cleanup_free_ Client *clients = NULL;
+        _cleanup_free_ usec_t *all = NULL;
+        unsigned n_running = arg_clients + 1;
+        size_t n_all = 0;
+        const char *sp;
+
+        assert_se(mkdtemp_malloc("/tmp/varlink-benchmark-XXXXXX", &tmpdir) >= 0);
+        sp = strjoina(tmpdir, "/socket");
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        done_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        assert_se(done_fd >= 0);
+        assert_se(sd_event_add_io(e, &done_event, done_fd, EPOLLIN, done_handler, &n_running) >= 0);
+
+        assert_se(varlink_server_new(&s, flags) >= 0);
+        assert_se(varlink_server_set_description(s, label) >= 0);
+        if (FLAGS_SET(flags, VARLINK_SERVER_THREADED))
+                /* One worker for each client, so that the slow client only stalls its own worker */
+                assert_se(varlink_server_set_worker_threads(s, arg_clients + 1) >= 0);
+        assert_se(varlink_server_add_interface(s, &vl_interface_io_systemd_UserDatabase) >= 0);
+        assert_se(varlink_server_bind_method(s, "io.systemd.UserDatabase.GetUserRecord", method_get_user_record) >= 0);
+        assert_se(varlink_server_listen_address(s, sp, 0600) >= 0);
+        assert_se(varlink_server_attach_event(s, e, 0) >= 0);
+
+        n_fast_clients_done = 0;
+
+        assert_se(clients = new0(Client, arg_clients + 1));
+        assert_se(threads = new(pthread_t, arg_clients + 1));
+
+        for (unsigned i = 0; i <= arg_clients; i++) {
+                clients[i] = (Client) {
+                        .address = sp,
+                        .user_name = i < arg_clients ? "benchmark" : "slow",
+                        .done_fd = done_fd,
+                };
+
+                if (i < arg_clients)
+                        assert_se(clients[i].latencies = new(usec_t, arg_calls));
+
+                assert_se(pthread_create(threads + i, NULL, client_thread, clients + i) == 0);
+        }
+
+        assert_se(sd_event_loop(e) >= 0);
+
+        assert_se(all = new(usec_t, arg_clients * arg_calls));
+
+        for (unsigned i = 0; i <= arg_clients; i++) {
+                assert_se(pthread_join(threads[i], NULL) == 0);
+
+                if (!clients[i].latencies)
+                        continue;
+
+                assert_se(clients[i].n_latencies == arg_calls);
+                memcpy(all + n_all, clients[i].latencies, arg_calls * sizeof(usec_t));
+                n_all += arg_calls;
+                free(clients[i].latencies);
+        }
+
+        typesafe_qsort(all, n_all, usec_compare);
+
+        log_info("%-10s clients=%u calls=%zu p50=%s p99=%s max=%s",
+                 label, arg_clients, n_all,
+                 FORMAT_TIMESPAN(all[n_all / 2], 1),
+                 FORMAT_TIMESPAN(all[n_all * 99 / 100], 1),
+                 FORMAT_TIMESPAN(all[n_all - 1], 1));
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_INFO);
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &arg_clients) >= 0 && arg_clients > 0);
+        if (argc >= 3)
+                assert_se(safe_atou(argv[2], &arg_calls) >= 0 && arg_calls > 0);
+        else if (slow_tests_enabled())
+                arg_calls = 2000;
+
+        test_one("single", 0);
+        test_one("threaded", VARLINK_SERVER_THREADED);
+
+        return 0;
+}
@@ -3,6 +3,7 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <pthread.h>
+#include <sys/socket.h>
 
 #include "sd-event.h"
 
@@ -236,6 +237,44 @@ static void flood_test(const char *address) {
                 connections[k] = varlink_unref(connections[k]);
 }
 
+static void test_call_many(Varlink *c) {
+        _cleanup_(json_variant_unrefp) JsonVariant *replies = NULL;
+        JsonVariant *p[5] = {}, *reply;
+        size_t n = 0;
+
+        for (size_t k = 0; k < ELEMENTSOF(p); k++)
+                if (k == 3)
+                        /* Let one call in the middle of the batch fail */
+                        assert_se(json_build(&p[k], JSON_BUILD_OBJECT(JSON_BUILD_PAIR("a", JSON_BUILD_INTEGER(k)))) >= 0);
+                else
+                        assert_se(json_build(&p[k], JSON_BUILD_OBJECT(JSON_BUILD_PAIR("a", JSON_BUILD_INTEGER(k)),
+                                                                      JSON_BUILD_PAIR("b", JSON_BUILD_INTEGER(k * 10)))) >= 0);
+
+        assert_se(varlink_call_many(c, "io.test.DoSomething", p, ELEMENTSOF(p), &replies) > 0);
+        assert_se(json_variant_elements(replies) == ELEMENTSOF(p));
+
+        JSON_VARIANT_ARRAY_FOREACH(reply, replies) {
+                if (n == 3) {
+                        assert_se(streq_ptr(json_variant_string(json_variant_by_key(reply, "error")), "io.test.BadParameters"));
+                        assert_se(!json_variant_by_key(json_variant_by_key(reply, "parameters"), "sum"));
+                } else {
+                        assert_se(!json_variant_by_key(reply, "error"));
+                        assert_se(json_variant_integer(json_variant_by_key(json_variant_by_key(reply, "parameters"), "sum")) == (int64_t) (n * 11));
+                }
+                n++;
+        }
+        assert_se(n == ELEMENTSOF(p));
+
+        /* The connection is idle again afterwards, and can be used for regular calls */
+        assert_se(varlink_is_idle(c) > 0);
+        replies = json_variant_unref(replies);
+        assert_se(varlink_call_many(c, "io.test.DoSomething", NULL, 0, &replies) > 0);
+        assert_se(json_variant_is_blank_array(replies));
+
+        FOREACH_ARRAY(i, p, ELEMENTSOF(p))
+                json_variant_unref(*i);
+}
+
 static void *thread(void *arg) {
         _cleanup_(varlink_flush_close_unrefp) Varlink *c = NULL;
         _cleanup_(json_variant_unrefp) JsonVariant *i = NULL, *j = NULL;
@@ -269,6 +308,19 @@ static void *thread(void *arg) {
         assert_se(json_variant_integer(json_variant_by_key(o, "sum")) == 88 + 99);
         assert_se(!e);
 
+        test_call_many(c);
+
+        /* Switch to the binary encoding, and run everything that follows with that */
+        assert_se(varlink_negotiate_encoding(c, VARLINK_ENCODING_CBOR) > 0);
+        assert_se(varlink_get_encoding(c) == VARLINK_ENCODING_CBOR);
+        assert_se(varlink_negotiate_encoding(c, VARLINK_ENCODING_CBOR) == 0);
+
+        assert_se(varlink_call(c, "io.test.DoSomething", i, &o, &e, NULL) >= 0);
+        assert_se(json_variant_integer(json_variant_by_key(o, "sum")) == 88 + 99);
+        assert_se(!e);
+
+        test_call_many(c);
+
         int fd1 = acquire_data_fd("foo", 3, 0);
         int fd2 = acquire_data_fd("bar", 3, 0);
         int fd3 = acquire_data_fd("quux", 4, 0);
@@ -303,6 +355,157 @@ static void *thread(void *arg) {
         return NULL;
 }
 
+static bool quit_done = false;
+
+static int method_quit(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        /* This runs in a worker thread, the server is shut down by the thread owning it */
+        assert_se(varlink_server_shutdown(varlink_get_server(link)) >= 0);
+
+        return varlink_reply(link, NULL);
+}
+
+static void *quit_thread(void *arg) {
+        _cleanup_(varlink_flush_close_unrefp) Varlink *c = NULL;
+        JsonVariant *o = NULL;
+        const char *e;
+
+        assert_se(varlink_connect_address(&c, arg) >= 0);
+        assert_se(varlink_set_description(c, "quit-client") >= 0);
+
+        assert_se(varlink_call(c, "io.test.Quit", NULL, &o, &e, NULL) >= 0);
+        assert_se(!e);
+
+        __atomic_store_n(&quit_done, true, __ATOMIC_RELEASE);
+        return NULL;
+}
+
+static void test_threaded_shutdown(const char *tmpdir) {
+        _cleanup_(varlink_server_unrefp) VarlinkServer *s = NULL;
+        _cleanup_(varlink_unrefp) Varlink *c = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        pthread_t t;
+        const char *sp;
+
+        sp = strjoina(tmpdir, "/threaded-socket");
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(varlink_server_new(&s, VARLINK_SERVER_THREADED) >= 0);
+        assert_se(varlink_server_set_description(s, "threaded-server") >= 0);
+        assert_se(varlink_server_set_worker_threads(s, 2) >= 0);
+        assert_se(varlink_server_bind_method(s, "io.test.Quit", method_quit) >= 0);
+        assert_se(varlink_server_listen_address(s, sp, 0600) >= 0);
+        assert_se(varlink_server_attach_event(s, e, 0) >= 0);
+
+        assert_se(pthread_create(&t, NULL, quit_thread, (void*) sp) == 0);
+
+        while (!__atomic_load_n(&quit_done, __ATOMIC_ACQUIRE))
+                assert_se(sd_event_run(e, 100 * USEC_PER_MSEC) >= 0);
+
+        /* The shutdown was requested before the reply was sent, process it */
+        while (sd_event_run(e, 0) > 0)
+                ;
+
+        assert_se(pthread_join(t, NULL) == 0);
+        assert_se(varlink_server_current_connections(s) == 0);
+
+        /* Nobody is listening anymore */
+        assert_se(varlink_connect_address(&c, sp) < 0);
+}
+
+#define STREAM_REPLIES 1000U
+#define STREAM_BATCH 10U
+
+static unsigned stream_sent = 0, stream_batches = 0, stream_received = 0;
+static bool stream_done = false;
+
+static int stream_drained(Varlink *link, void *userdata);
+
+static int stream_send(Varlink *link) {
+        /* Queue one batch, and the next one only once it has been written */
+        stream_batches++;
+
+        for (unsigned i = 0; i < STREAM_BATCH; i++) {
+                if (++stream_sent == STREAM_REPLIES)
+                        return varlink_replyb(link, JSON_BUILD_OBJECT(JSON_BUILD_PAIR_UNSIGNED("i", stream_sent)));
+
+                assert_se(varlink_notifyb(link, JSON_BUILD_OBJECT(JSON_BUILD_PAIR_UNSIGNED("i", stream_sent))) >= 0);
+        }
+
+        return varlink_bind_drained(link, stream_drained);
+}
+
+static int stream_drained(Varlink *link, void *userdata) {
+        return stream_send(link);
+}
+
+static int method_stream(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        assert_se(FLAGS_SET(flags, VARLINK_METHOD_MORE));
+
+        return stream_send(link);
+}
+
+static int stream_reply(Varlink *link, JsonVariant *parameters, const char *error_id, VarlinkReplyFlags flags, void *userdata) {
+        assert_se(!error_id);
+        assert_se(json_variant_unsigned(json_variant_by_key(parameters, "i")) == ++stream_received);
+
+        if (!FLAGS_SET(flags, VARLINK_REPLY_CONTINUES))
+                stream_done = true;
+
+        return 0;
+}
+
+static void test_drained(void) {
+        _cleanup_(varlink_server_unrefp) VarlinkServer *s = NULL;
+        _cleanup_(varlink_unrefp) Varlink *c = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(varlink_server_new(&s, 0) >= 0);
+        assert_se(varlink_server_set_description(s, "stream-server") >= 0);
+        assert_se(varlink_server_bind_method(s, "io.test.Stream", method_stream) >= 0);
+        assert_se(varlink_server_attach_event(s, e, 0) >= 0);
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        assert_se(varlink_server_add_connection(s, pair[0], NULL) >= 0);
+        TAKE_FD(pair[0]);
+        assert_se(varlink_connect_fd(&c, pair[1]) >= 0);
+        TAKE_FD(pair[1]);
+        assert_se(varlink_set_description(c, "stream-client") >= 0);
+        assert_se(varlink_bind_reply(c, stream_reply) >= 0);
+        assert_se(varlink_attach_event(c, e, 0) >= 0);
+
+        assert_se(varlink_observe(c, "io.test.Stream", NULL) >= 0);
+
+        while (!stream_done)
+                assert_se(sd_event_run(e, 5 * USEC_PER_SEC) > 0);
+
+        assert_se(stream_received == STREAM_REPLIES);
+        assert_se(stream_batches == STREAM_REPLIES / STREAM_BATCH);
+}
+
+static void test_forget_fd(void) {
+        _cleanup_(varlink_unrefp) Varlink *c = NULL;
+        _cleanup_close_pair_ int pair[2] = EBADF_PAIR, other[2] = EBADF_PAIR;
+        _cleanup_close_ int fd = -EBADF;
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        assert_se(varlink_connect_fd(&c, pair[0]) >= 0);
+        fd = TAKE_FD(pair[0]);
+
+        /* Replace the connection's fd behind its back by something else entirely */
+        assert_se(pipe2(other, O_CLOEXEC) >= 0);
+        assert_se(dup3(other[0], fd, O_CLOEXEC) == fd);
+
+        assert_se(varlink_forget_fd(c) > 0);
+        c = varlink_unref(c);
+
+        /* Whatever took over the fd number is still open */
+        assert_se(fcntl(fd, F_GETFD) >= 0);
+}
+
 static int block_fd_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         char c;
 
@@ -372,5 +575,9 @@ int main(int argc, char *argv[]) {
 
         assert_se(pthread_join(t, NULL) == 0);
 
+        test_threaded_shutdown(tmpdir);
+        test_drained();
+        test_forget_fd();
+
         return 0;
 }
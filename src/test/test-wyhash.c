@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "string-util.h"
+#include "tests.h"
+#include "unaligned.h"
+#include "wyhash.h"
+
+TEST(wyhash_vectors) {
+        /* The test vectors of the reference implementation, where the seed is the index of the vector */
+        static const struct {
+                const char *data;
+                uint64_t hash;
+        } vectors[] = {
+                { "",                                                                                  UINT64_C(0x93228a4de0eec5a2) },
+                { "a",                                                                                 UINT64_C(0xc5bac3db178713c4) },
+                { "abc",                                                                               UINT64_C(0xa97f2f7b1d9b3314) },
+                { "message digest",                                                                    UINT64_C(0x786d1f1df3801df4) },
+                { "abcdefghijklmnopqrstuvwxyz",                                                        UINT64_C(0xdca5a8138ad37c87) },
+                { "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",                    UINT64_C(0xb9e734f117cfaf70) },
+                { "12345678901234567890123456789012345678901234567890123456789012345678901234567890", UINT64_C(0x6cc5eab49a92d617) },
+        };
+
+        for (size_t i = 0; i < ELEMENTSOF(vectors); i++)
+                assert_se(wyhash(vectors[i].data, strlen(vectors[i].data), i) == vectors[i].hash);
+}
+
+TEST(wyhash_alignment) {
+        static const char s[] = "The quick brown fox jumps over the lazy dog, twice: the quick brown fox jumps over the lazy dog";
+        uint8_t buf[sizeof(s) + 8];
+
+        /* Unaligned input and every length that goes through a different code path */
+        for (size_t len = 0; len < sizeof(s); len++) {
+                uint64_t h = wyhash(s, len, 4711);
+
+                for (size_t off = 1; off < 8; off++) {
+                        memcpy(buf + off, s, len);
+                        assert_se(wyhash(buf + off, len, 4711) == h);
+                }
+
+                /* Changing the seed or the data changes the result */
+                assert_se(wyhash(s, len, 4712) != h);
+                if (len > 0) {
+                        memcpy(buf, s, len);
+                        buf[len / 2] ^= 1;
+                        assert_se(wyhash(buf, len, 4711) != h);
+                }
+        }
+}
+
+TEST(wyhash64) {
+        static const uint64_t values[] = { 0, 1, 0x1234, UINT32_MAX, UINT64_C(0x0123456789abcdef), UINT64_MAX };
+        uint8_t le[8];
+
+        FOREACH_ARRAY(v, values, ELEMENTSOF(values))
+                for (uint64_t seed = 0; seed < 4; seed++) {
+                        unaligned_write_le64(le, *v);
+                        assert_se(wyhash64(*v, seed) == wyhash(le, sizeof(le), seed));
+                }
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);